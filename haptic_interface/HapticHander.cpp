@@ -53,13 +53,35 @@
 
 //------------------------------------------------------------------------------
 #include "chai3d.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "../isolde/src/openmm/haptic_link.h"
 
 //------------------------------------------------------------------------------
 using namespace chai3d;
 using namespace std;
 //------------------------------------------------------------------------------
 
-
+/*
+    Threading model
+
+    The haptics thread owns the devices and runs at HAPTIC_RATE_HZ. It never
+    shares plain variables with anything else: everything it exchanges goes
+    through single-producer, single-consumer rings, so neither side ever
+    waits for the other.
+
+      GUI -> haptics     device frame (device <-> model coordinates) and the
+                         legacy GUI target position
+      haptics -> GUI     device position and button states for display
+      haptics <-> sim    Haptic_Link: device targets for the tugged atom go
+                         straight to the simulation worker, and the atom's
+                         position comes straight back for force feedback
+
+    Settings that are only ever written by the GUI (spring constants and
+    on/off flags) are atomics.
+*/
 
 extern "C"
 {
@@ -76,12 +98,21 @@ extern "C"
     // set the spring constant for device i
     void setSpringConstant (int i, double k);
 
+    // set the spring constant (kJ mol-1 A-2) of the simulated tug for device i
+    void setTugSpringConstant (int i, double k);
+
     // switch damping on/off for device i
     void setDamping(int i, bool d);
 
     // set the target position for device i
     void setTargetPosition(int i, double x, double y, double z);
 
+    // set the device <-> model coordinate transforms for device i
+    void setDeviceFrame(int i, const double* toModel, const double* fromModel);
+
+    // the link between device i and the simulation
+    void* getHapticLink(int i);
+
     // Attach device i to an object
     void startTugging(int i);
 
@@ -94,11 +125,8 @@ extern "C"
     // Turn off force feedback for device i
     void turnOffFeedback(int i);
 
-    // return the (x,y,z) position of device i
-    double* getPosition(int i);
-
-    // get the states of the buttons on device i
-    bool* getButtonStates (int i);
+    // get the most recent (x,y,z) position and button states of device i
+    bool getDeviceState(int i, double* pos, bool* buttons);
 
 
 
@@ -108,6 +136,35 @@ extern "C"
 
     // maximum number of devices supported by this application
     static const int MAX_DEVICES = 16;
+
+    // rate of the haptic loop
+    static const int HAPTIC_RATE_HZ = 1000;
+
+    // size of the rings to and from the GUI
+    static const size_t GUI_RING_SIZE = 16;
+
+    //------------------------------------------------------------------------------
+    // DECLARED TYPES
+    //------------------------------------------------------------------------------
+
+    // device state for display
+    struct DeviceState
+    {
+        double position[3];
+        bool buttons[4];
+    };
+
+    // 3x4 affine transforms between device and model coordinates
+    struct DeviceFrame
+    {
+        double toModel[12];
+        double fromModel[12];
+    };
+
+    struct DeviceTarget
+    {
+        double position[3];
+    };
 
     //------------------------------------------------------------------------------
     // DECLARED VARIABLES
@@ -122,35 +179,39 @@ extern "C"
     // number of haptic devices detected
     int numHapticDevices = 0;
 
-    // variable to store the position [m] of each haptic device
-    cVector3d hapticDevicePosition[MAX_DEVICES];
+    // struct holding information about each device
+    cHapticDeviceInfo info[MAX_DEVICES];
 
-    // variable to store the target position of each haptic device
-    cVector3d targetPosition[MAX_DEVICES];
+    // haptics thread -> GUI
+    isolde::Spsc_Ring<DeviceState, GUI_RING_SIZE> deviceStates[MAX_DEVICES];
 
-    // spring constants connecting each device to an object
-    double springConstant[MAX_DEVICES] = {0};
+    // GUI -> haptics thread
+    isolde::Spsc_Ring<DeviceFrame, GUI_RING_SIZE> deviceFrames[MAX_DEVICES];
+    isolde::Spsc_Ring<DeviceTarget, GUI_RING_SIZE> guiTargets[MAX_DEVICES];
 
-    // struct holding information about each device
-    cHapticDeviceInfo info[MAX_DEVICES];
+    // haptics thread <-> simulation worker
+    isolde::Haptic_Link hapticLinks[MAX_DEVICES];
 
-    // 2D vector holding the states of four buttons for each device
-    //vector<vector<bool>> hapticDeviceButtons(MAX_DEVICES, vector <bool>(4, false));
+    // spring constants connecting each device to an object
+    std::atomic<double> springConstant[MAX_DEVICES];
+
+    // spring constants (kJ mol-1 A-2) tugging each atom in the simulation
+    std::atomic<double> tugSpringConstant[MAX_DEVICES];
 
     // flag for using damping (ON/OFF)
-    bool useDamping[MAX_DEVICES] = {false};
+    std::atomic<bool> useDamping[MAX_DEVICES];
 
     // flag for using force feedback (ON/OFF)
-    bool useFeedback[MAX_DEVICES] = {true};
+    std::atomic<bool> useFeedback[MAX_DEVICES];
 
     // is this device currently pulling something?
-    bool deviceInUse[MAX_DEVICES] = {false};
+    std::atomic<bool> deviceInUse[MAX_DEVICES];
 
     // flag to indicate if the haptic simulation currently running
-    bool simulationRunning = false;
+    std::atomic<bool> simulationRunning{false};
 
     // flag to indicate if the haptic simulation has terminated
-    bool simulationFinished = true;
+    std::atomic<bool> simulationFinished{true};
 
     // frequency counter to measure the simulation haptic rate
     cFrequencyCounter frequencyCounter;
@@ -199,9 +260,11 @@ extern "C"
                 // if the device has a gripper, enable the gripper to simulate a user switch
                 hapticDevice[i]->setEnableGripperUserSwitch(true);
 
-                // initialise the target position
-                targetPosition[i].set(0.0, 0.0, 0.0);
-
+                springConstant[i] = 0;
+                tugSpringConstant[i] = 0;
+                useDamping[i] = false;
+                useFeedback[i] = true;
+                deviceInUse[i] = false;
             }
 
 
@@ -253,16 +316,38 @@ extern "C"
         springConstant[i] = k;
     }
 
+    // set the spring constant of the simulated tug for device i
+    void setTugSpringConstant (int i, double k)
+    {
+        tugSpringConstant[i] = k;
+    }
+
     // switch damping on/off for device i
     void setDamping(int i, bool d)
     {
         useDamping[i] = d;
     }
 
-    // set the target position for device i
+    // set the target position for device i (used when no simulation is
+    // feeding back through the link)
     void setTargetPosition(int i, double x, double y, double z)
     {
-        targetPosition[i].set(x, y, z);
+        guiTargets[i].push(DeviceTarget{{x, y, z}});
+    }
+
+    // set the device <-> model coordinate transforms for device i
+    void setDeviceFrame(int i, const double* toModel, const double* fromModel)
+    {
+        DeviceFrame f;
+        std::copy(toModel, toModel+12, f.toModel);
+        std::copy(fromModel, fromModel+12, f.fromModel);
+        deviceFrames[i].push(f);
+    }
+
+    // the link between device i and the simulation
+    void* getHapticLink(int i)
+    {
+        return &hapticLinks[i];
     }
 
     // Attach device i to an object
@@ -289,34 +374,41 @@ extern "C"
         useFeedback[i] = false;
     }
 
-    // return the (x,y,z) position of device i
-    double* getPosition(int i)
+    // Most recent position and button states of device i. Returns false if
+    // nothing new has arrived since the last call.
+    bool getDeviceState(int i, double* pos, bool* buttons)
     {
-        double* pos = new double[3];
-        pos[0] = hapticDevicePosition[i].x();
-        pos[1] = hapticDevicePosition[i].y();
-        pos[2] = hapticDevicePosition[i].z();
-
-        return pos;
+        DeviceState state;
+        if (!deviceStates[i].pop_latest(state))
+            return false;
+        std::copy(state.position, state.position+3, pos);
+        std::copy(state.buttons, state.buttons+4, buttons);
+        return true;
     }
 
-    // Return the states of up to four buttons on the haptic device
-    bool* getButtonStates(int i)
-    {
-        bool * buttons = new bool[4];
-
-        for (int j=0; j < 4; j++) {
-            hapticDevice[i]->getUserSwitch(j, buttons[j]);
-        }
-
-        return buttons;
+    //------------------------------------------------------------------------------
 
+    static cVector3d applyFrame(const double* m, const cVector3d& p)
+    {
+        return cVector3d(
+            m[0]*p.x() + m[1]*p.y() + m[2]*p.z() + m[3],
+            m[4]*p.x() + m[5]*p.y() + m[6]*p.z() + m[7],
+            m[8]*p.x() + m[9]*p.y() + m[10]*p.z() + m[11]);
     }
 
     // Main loop run by cThread object to update haptic device position(s) and
     // manage force feedback
     void updateHaptics(void)
     {
+        // state owned by this thread
+        DeviceFrame frame[MAX_DEVICES];
+        bool haveFrame[MAX_DEVICES] = {false};
+        cVector3d targetPosition[MAX_DEVICES];
+        bool tugging[MAX_DEVICES] = {false};
+
+        const auto tick = std::chrono::microseconds(1000000/HAPTIC_RATE_HZ);
+        auto nextTick = std::chrono::steady_clock::now();
+
         // initialize frequency counter
         frequencyCounter.reset();
 
@@ -349,12 +441,49 @@ extern "C"
                 cVector3d angularVelocity;
                 hapticDevice[i]->getAngularVelocity(angularVelocity);
 
-                // update global variable for graphic display update
-                hapticDevicePosition[i] = position;
+                // hand position and buttons to the GUI (if it has fallen
+                // behind it will catch up on the next push)
+                DeviceState state;
+                state.position[0] = position.x();
+                state.position[1] = position.y();
+                state.position[2] = position.z();
+                for (int j=0; j<4; j++)
+                    hapticDevice[i]->getUserSwitch(j, state.buttons[j]);
+                deviceStates[i].push(state);
+
+                /////////////////////////////////////////////////////////////////////
+                // EXCHANGE WITH THE SIMULATION
+                /////////////////////////////////////////////////////////////////////
+
+                if (deviceFrames[i].pop_latest(frame[i]))
+                    haveFrame[i] = true;
+
+                isolde::Haptic_Link& link = hapticLinks[i];
+                bool inUse = deviceInUse[i];
+                if (haveFrame[i] && (inUse || tugging[i]))
+                {
+                    isolde::Haptic_Target t;
+                    cVector3d m = applyFrame(frame[i].toModel, position);
+                    t.xyz[0] = m.x(); t.xyz[1] = m.y(); t.xyz[2] = m.z();
+                    t.spring_constant = tugSpringConstant[i];
+                    t.tugging = inUse;
+                    // A failed push means the worker is busy with something
+                    // else: try again with a fresh position next tick
+                    if (link.targets.push(t))
+                        tugging[i] = inUse;
+                }
+
+                isolde::Haptic_Feedback fb;
+                if (haveFrame[i] && link.feedback.pop_latest(fb))
+                    targetPosition[i] = applyFrame(frame[i].fromModel,
+                        cVector3d(fb.xyz[0], fb.xyz[1], fb.xyz[2]));
+                DeviceTarget gt;
+                if (guiTargets[i].pop_latest(gt))
+                    targetPosition[i].set(gt.position[0], gt.position[1], gt.position[2]);
 
                 // If this device isn't currently dragging something, there's no need to
                 // compute forces for it
-                if (!deviceInUse[i]) { continue; }
+                if (!inUse) { continue; }
                 /////////////////////////////////////////////////////////////////////
                 // COMPUTE AND APPLY FORCES
                 /////////////////////////////////////////////////////////////////////
@@ -381,7 +510,7 @@ extern "C"
                     force.add(forceField);
 
                     // apply damping term
-                    if (useDamping)
+                    if (useDamping[i])
                     {
                         // compute linear damping force
                         double Kv = 1.0 * info[i].m_maxLinearDamping;
@@ -399,7 +528,7 @@ extern "C"
                         deltaRotation.toAxisAngle(axis, angle);
                         torque = rotation * ((Kr * angle) * axis);
 
-                        if (useDamping)
+                        if (useDamping[i])
                         {
                             // compute angular damping force
                             double Kvr = 1.0 * info[i].m_maxAngularDamping;
@@ -417,6 +546,14 @@ extern "C"
 
             // update frequency counter
             frequencyCounter.signal(1);
+
+            // hold the loop at a steady rate
+            nextTick += tick;
+            auto now = std::chrono::steady_clock::now();
+            if (nextTick > now)
+                std::this_thread::sleep_until(nextTick);
+            else
+                nextTick = now;
         }
 
         // exit haptics thread
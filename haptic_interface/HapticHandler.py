@@ -156,6 +156,10 @@ class HapticHandler(QObject):
         
         # Is the device attached to something?
         self.deviceInUse = [False] * self._MAX_DEVICES
+
+        # Model whose coordinates each device works in when tugging atoms
+        # directly in a simulation
+        self._tug_model = [None] * self._MAX_DEVICES
         
         ####
         # functions defined in _HapticHandler.so
@@ -178,6 +182,17 @@ class HapticHandler(QObject):
         self._setTargetPosition.argtypes = [ctypes.c_int, 
                 ctypes.c_double, ctypes.c_double, ctypes.c_double]
 
+        self._setTugSpringConstant = self._HapticHandler.setTugSpringConstant
+        self._setTugSpringConstant.argtypes = [ctypes.c_int, ctypes.c_double]
+
+        self._setDeviceFrame = self._HapticHandler.setDeviceFrame
+        self._setDeviceFrame.argtypes = [ctypes.c_int,
+                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_double)]
+
+        self._getHapticLink = self._HapticHandler.getHapticLink
+        self._getHapticLink.argtypes = [ctypes.c_int]
+        self._getHapticLink.restype = ctypes.c_void_p
+
         self._startTugging = self._HapticHandler.startTugging
         self._startTugging.argtypes = [ctypes.c_int]
 
@@ -190,13 +205,14 @@ class HapticHandler(QObject):
         self._turnOffFeedback = self._HapticHandler.turnOffFeedback
         self._turnOffFeedback.argtypes = [ctypes.c_int]
          
-        self._getPosition = self._HapticHandler.getPosition
-        self._getPosition.argtypes = [ctypes.c_int]
-        self._getPosition.restype = ctypes.POINTER(ctypes.c_double * 3)
-             
-        self._getButtonStates = self._HapticHandler.getButtonStates
-        self._getButtonStates.argtypes = [ctypes.c_int]
-        self._getButtonStates.restype = ctypes.POINTER(ctypes.c_bool * 4)
+        self._getDeviceState = self._HapticHandler.getDeviceState
+        self._getDeviceState.argtypes = [ctypes.c_int,
+                ctypes.POINTER(ctypes.c_double * 3), ctypes.POINTER(ctypes.c_bool * 4)]
+        self._getDeviceState.restype = ctypes.c_bool
+
+        # Most recent state reported by the haptics thread for each device
+        self._latest_position = [[0.0, 0.0, 0.0] for i in range(self._MAX_DEVICES)]
+        self._latest_buttons = [[False] * 4 for i in range(self._MAX_DEVICES)]
     
     def __enter__(self):
         return self
@@ -300,12 +316,36 @@ class HapticHandler(QObject):
             self._turnOffFeedback(i)
         
     
+    # Set the spring constant (kJ mol-1 A-2) used when device i tugs an atom
+    # directly in a simulation
+    def setTugSpringConstant(self, i, k):
+        if self._running:
+            self._setTugSpringConstant(i, k)
+
+
+    # Pointer to the channel between device i and a simulation (see
+    # Sim_Manager.attach_haptic_device()). Device positions become tugging
+    # targets in the coordinates of the given model.
+    def haptic_link(self, i, model):
+        self._tug_model[i] = model
+        return self._getHapticLink(i)
+
+
+    # Fetch the latest state of device i from the haptics thread
+    def _update_device_state(self, i):
+        pos = (ctypes.c_double * 3)()
+        buttons = (ctypes.c_bool * 4)()
+        if self._getDeviceState(i, ctypes.byref(pos), ctypes.byref(buttons)):
+            self._latest_position[i] = list(pos)
+            self._latest_buttons[i] = list(buttons)
+
+
     # Get the current position of device i
     def getPosition(self, i, scene_coords = False):
         if self._running:
             if scene_coords:
                 return self._arrow_model[i].position.origin()
-            return [i for i in self._getPosition(i).contents]
+            return list(self._latest_position[i])
 
     
     
@@ -313,12 +353,13 @@ class HapticHandler(QObject):
     # Get the states of the buttons on device i
     def getButtonStates(self, i):
         if self._running:
-            buttons = [b for b in self._getButtonStates(i).contents]
-            return buttons
+            return list(self._latest_buttons[i])
     
     def on_refresh(self, *_):
         display_axes_and_origin, axis_scale = self.get_haptic_reference_frame()
         for i in range(self.numHapticDevices):
+            self._update_device_state(i)
+            self._update_device_frame(i, display_axes_and_origin, axis_scale)
             pos = self.getPosition(i)
             old_buttons = self._button_states[i]
             buttons = self.getButtonStates(i)
@@ -346,6 +387,23 @@ class HapticHandler(QObject):
             if self.deviceInUse[i]:
                 self._setSpringConstant(i, self.springConstant[i]*self._final_display_scale)
 
+    # Send the haptics thread the current mapping between device coordinates
+    # and those of the model device i is tugging in
+    def _update_device_frame(self, i, reference_frame, axis_scale):
+        m = self._tug_model[i]
+        if m is None or m.deleted:
+            return
+        from chimerax.core.geometry import place
+        d = numpy.zeros((3,4))
+        for k in range(3):
+            d[k, self._axis_order[k]] = self._axis_directions[k] * axis_scale
+        to_model = place.product([m.scene_position.inverse(), reference_frame,
+            place.Place(matrix=d)])
+        tm = numpy.ascontiguousarray(to_model.matrix, numpy.float64)
+        fm = numpy.ascontiguousarray(to_model.inverse().matrix, numpy.float64)
+        dp = ctypes.POINTER(ctypes.c_double)
+        self._setDeviceFrame(i, tm.ctypes.data_as(dp), fm.ctypes.data_as(dp))
+
     def get_haptic_reference_frame(self):
         s = self.session
         v = s.main_view
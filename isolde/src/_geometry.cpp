@@ -14,6 +14,7 @@
 #include <stdint.h>
 
 #include "geometry/geometry.h"
+#include "thread_pool.h"
 #include "molc.h"
 
 typedef uint8_t npy_bool;
@@ -23,6 +24,99 @@ typedef double float64_t;
 
 using namespace isolde::geometry;
 
+// Batches smaller than twice this are done on the calling thread
+static const size_t MIN_CHUNK = 4096;
+
+// Split a batched kernel over the shared thread pool. fn(start, end) must
+// only touch records in [start, end).
+template <typename F>
+static void run_chunked(size_t n, F fn)
+{
+    if (n < 2*MIN_CHUNK) {
+        fn(0, n);
+        return;
+    }
+    isolde::Thread_Pool::instance().parallel_chunks(n, MIN_CHUNK, fn);
+}
+
+template <typename T, typename R>
+static void _get_dihedrals(const T *coords, size_t n, R *out)
+{
+    run_chunked(n, [=](size_t start, size_t end) {
+        dihedral_angles(end-start, coords+12*start, out+start);
+    });
+}
+
+template <typename T, typename R>
+static void _rotations(T axis[3], const T *angles, size_t n, R *out)
+{
+    normalize_vector_3d<T>(axis);
+    run_chunked(n, [=](size_t start, size_t end) {
+        axis_rotations(axis, end-start, angles+start, out+12*start);
+    });
+}
+
+template <typename T>
+static void _scale_transforms(const T *scales, size_t n, T *transforms)
+{
+    run_chunked(n, [=](size_t start, size_t end) {
+        isolde::geometry::scale_transforms(end-start, scales+start, transforms+12*start);
+    });
+}
+
+template <typename T, typename R>
+static void _flip_rotate_and_shift(size_t n, const npy_bool *flip,
+    const T *flip_op, const T *rot, const T *shift, R *out)
+{
+    run_chunked(n, [=](size_t start, size_t end) {
+        isolde::geometry::flip_rotate_and_shift(end-start, flip+start, flip_op,
+            rot+12*start, shift+12*start, out+12*start);
+    });
+}
+
+template <typename T>
+static void _dihedral_fill_planes(size_t n, const T *coords, float *vertices,
+    float *normals, int32_t *triangles)
+{
+    run_chunked(n, [=](size_t start, size_t end) {
+        isolde::geometry::dihedral_fill_planes(end-start, coords+12*start,
+            vertices+15*start, normals+15*start, triangles+9*start,
+            FILL_PLANE_VERTICES*start);
+    });
+}
+
+template <typename T>
+static void _dihedral_fill_and_color_planes(size_t n, const T *coords,
+    const npy_bool *twisted_mask, const npy_bool *cispro_mask,
+    const uint8_t *default_color, const uint8_t *twisted_color,
+    const uint8_t *cispro_color, float *vertices, float *normals,
+    int32_t *triangles, uint8_t *colors)
+{
+    _dihedral_fill_planes(n, coords, vertices, normals, triangles);
+    run_chunked(n, [=](size_t start, size_t end) {
+        uint8_t* c = colors + 20*start;
+        for (size_t i=start; i<end; ++i) {
+            const uint8_t* ptr = twisted_mask[i] ? twisted_color
+                : (cispro_mask[i] ? cispro_color : default_color);
+            for (size_t j=0; j<FILL_PLANE_VERTICES; ++j) {
+                for (size_t k=0; k<4; ++k) {
+                    *c++ = ptr[k];
+                }
+            }
+        }
+    });
+}
+
+template <typename T>
+static void _accumulate_coord_statistics(size_t n, const T *coords, size_t count,
+    double *mean, double *comoment)
+{
+    run_chunked(n, [=](size_t start, size_t end) {
+        accumulate_coord_statistics(end-start, coords+3*start, count,
+            mean+3*start, comoment+6*start);
+    });
+}
+
 extern "C"
 
 {
@@ -32,156 +126,115 @@ EXPORT double get_dihedral(double p0[3], double p1[3], double p2[3], double p3[3
     return dihedral_angle<double>(p0, p1, p2, p3);
 } // get_dihedral
 
-EXPORT void get_dihedrals(double *coords, int n, double * out)
+EXPORT void get_dihedrals(double *coords, size_t n, double * out)
 {
-    for (int i=0; i<n; ++i) {
-        int j = i*12;
-        *out++ = dihedral_angle<double>(coords+j, coords+j+3, coords+j+6, coords+j+9);
-    }
+    _get_dihedrals(coords, n, out);
 } // get_dihedrals
 
+EXPORT void get_dihedrals_float(double *coords, size_t n, float *out)
+{
+    _get_dihedrals(coords, n, out);
+} // get_dihedrals_float
+
+// Single-precision throughout, for display-only use: reads float32
+// coordinates directly with no upcast copy.
+EXPORT void get_dihedrals_from_float(float *coords, size_t n, float *out)
+{
+    _get_dihedrals(coords, n, out);
+} // get_dihedrals_from_float
+
 // Fill out with a nx3x4 matrix of rotation matrices (translation = 0)
-EXPORT void rotations(double axis[3], double* angles, int n, double* out)
+EXPORT void rotations(double axis[3], double* angles, size_t n, double* out)
 {
-    normalize_vector_3d<double>(axis);
-    for (int i = 0; i < n; ++i) {
-        rotation<double>(axis, *angles++, out);
-        out += 12;
-    }
+    _rotations(axis, angles, n, out);
 } // rotations
 
+EXPORT void rotations_float(double axis[3], double* angles, size_t n, float* out)
+{
+    _rotations(axis, angles, n, out);
+} // rotations_float
+
 // Scale the input transforms by the values in scales, leaving the
 // translation components untouched.
-EXPORT void scale_transforms(double* scales, int n, double* transforms)
-{
-    for (int i = 0, count = 0; i < n; ++i)
-    {
-        for (int j = 0; j < 3; ++j)
-        {
-            for (int k = 0; k < 4; ++k, ++count)
-            {
-                if (k<3) transforms[count] *= scales[i];
-            }
-        }
-    }
+EXPORT void scale_transforms(double* scales, size_t n, double* transforms)
+{
+    _scale_transforms(scales, n, transforms);
 } // scale_transforms
 
+EXPORT void scale_transforms_float(float* scales, size_t n, float* transforms)
+{
+    _scale_transforms(scales, n, transforms);
+} // scale_transforms_float
+
 EXPORT void multiply_transforms(double tf1[3][4], double tf2[3][4], double out[3][4])
 {
     multiply_transforms<double>(tf1, tf2, out);
 }
 
-// void multiply_transforms(double tf1[3][4], double tf2[3][4], double out[3][4])
-// {
-//     const double ll[4] = {0, 0, 0, 1};
-//     for (int i = 0; i < 3; ++i) {
-//         for (int j = 0; j < 4; ++j) {
-//             out[i][j] = tf1[i][0]*tf2[0][j] + tf1[i][1]*tf2[1][j]
-//                       + tf1[i][2]*tf2[2][j] + tf1[i][3]*ll[j];
-//         }
-//     }
-// } // multiply_transforms
-
-EXPORT void flip_rotate_and_shift(int n, npy_bool* flip, double flip_op[3][4], double* rot, double* shift, double* out)
-{
-    double intermediate_result[3][4];
-    double current_rot[3][4];
-    double current_shift[3][4];
-    double current_out[3][4];
-    int tf_start;
-    for (int i = 0; i < n; ++i) {
-        tf_start = i*12;
-        for (int j = 0, count = 0; j < 3; ++j) {
-            for (int k = 0; k < 4; ++k, ++count) {
-                current_rot[j][k] = rot[tf_start + count];
-                current_shift[j][k] = shift[tf_start + count];
-            }
-        }
-
-        if (flip[i]) {
-            multiply_transforms(current_rot, flip_op, intermediate_result);
-            multiply_transforms(current_shift, intermediate_result, current_out);
-        } else {
-            multiply_transforms(current_shift, current_rot, current_out);
-        }
-        for (int j = 0, count = 0; j < 3; ++j) {
-            for (int k = 0; k < 4; ++k, ++count) {
-                out[tf_start+count] = current_out[j][k];
-            }
-        }
-    }
+EXPORT void flip_rotate_and_shift(size_t n, npy_bool* flip, double flip_op[3][4], double* rot, double* shift, double* out)
+{
+    _flip_rotate_and_shift(n, flip, &flip_op[0][0], rot, shift, out);
 } // flip_rotate_and_shift
 
-const int32_t T_INDICES[9] = {0,1,4,1,2,4,2,3,4};
-const int D_LENGTH = 12;
-const int V_LENGTH = 15;
-const int N_LENGTH = 15;
-const int T_LENGTH = 9;
+EXPORT void flip_rotate_and_shift_float(size_t n, npy_bool* flip, double flip_op[3][4], double* rot, double* shift, float* out)
+{
+    _flip_rotate_and_shift(n, flip, &flip_op[0][0], rot, shift, out);
+} // flip_rotate_and_shift_float
 
 // Generate vertices, normals and triangles to fill in a single dihedral
 // with a pseudo-trapezoid.
 EXPORT void dihedral_fill_plane(double* coords, float* vertices, float* normals, int32_t* triangles, int start=0)
 {
-    int count = 0;
-    for (int i=0; i<4; ++i) {
-        for (int j=0; j<3; ++j, ++count) {
-            vertices[count] = coords[count];
-        }
-    }
-    for (int i = 0; i<3; ++i) {
-        vertices[count+i] = (coords[i] + coords[9+i])/2;
-    }
-
-    // Pretend the surface is planar, and assign a single normal.
-    float v1[3], v2[3];
-    for (int i=0; i<3; ++i) {
-        v1[i] = vertices[3+i]-vertices[i];
-        v2[i] = vertices[9+i]-vertices[i];
-    }
-
-    cross_product_3D<float>(v1, v2, normals);
-
-    // Copy the first normal over to the rest
-    for (int i=3; i<N_LENGTH; ++i) {
-        normals[i] = normals[i%3];
-    }
-
-    for (int i=0; i<9; ++i) {
-        triangles[i] = start+T_INDICES[i];
-    }
+    isolde::geometry::dihedral_fill_plane(coords, vertices, normals, triangles, start);
 } // dihedral_fill_plane
 
 
-EXPORT void dihedral_fill_planes(int n, double* coords, float* vertices,
+EXPORT void dihedral_fill_planes(size_t n, double* coords, float* vertices,
                             float* normals, int32_t* triangles)
 {
-    for (int i=0; i<n; ++i) {
-        dihedral_fill_plane(coords+i*D_LENGTH,
-                            vertices+i*V_LENGTH,
-                            normals+i*N_LENGTH,
-                            triangles+i*T_LENGTH,
-                            i*V_LENGTH/3);
-    }
+    _dihedral_fill_planes(n, coords, vertices, normals, triangles);
 } // dihedral_fill_planes
 
-EXPORT void dihedral_fill_and_color_planes(int n, double* coords, npy_bool* twisted_mask,
+EXPORT void dihedral_fill_planes_from_float(size_t n, float* coords, float* vertices,
+                            float* normals, int32_t* triangles)
+{
+    _dihedral_fill_planes(n, coords, vertices, normals, triangles);
+} // dihedral_fill_planes_from_float
+
+EXPORT void dihedral_fill_and_color_planes(size_t n, double* coords, npy_bool* twisted_mask,
                                     npy_bool* cispro_mask, uint8_t* default_color,
                                     uint8_t* twisted_color, uint8_t* cispro_color,
                                     float* vertices, float* normals, int32_t* triangles,
                                     uint8_t* colors)
 {
-    dihedral_fill_planes(n, coords, vertices, normals, triangles);
-    uint8_t* ptr;
-    for (int i=0, count=0; i<n; ++i) {
-        if (twisted_mask[i]) ptr = twisted_color;
-        else if (cispro_mask[i]) ptr = cispro_color;
-        else ptr = default_color;
-        for (int j=0; j<5; ++j) {
-            for (int k=0; k<4; ++k, count++) {
-                colors[count] = ptr[k];
-            }
-        }
-    }
+    _dihedral_fill_and_color_planes(n, coords, twisted_mask, cispro_mask,
+        default_color, twisted_color, cispro_color, vertices, normals,
+        triangles, colors);
 } // dihedral_fill_and_color_planes
 
+EXPORT void dihedral_fill_and_color_planes_from_float(size_t n, float* coords,
+                                    npy_bool* twisted_mask,
+                                    npy_bool* cispro_mask, uint8_t* default_color,
+                                    uint8_t* twisted_color, uint8_t* cispro_color,
+                                    float* vertices, float* normals, int32_t* triangles,
+                                    uint8_t* colors)
+{
+    _dihedral_fill_and_color_planes(n, coords, twisted_mask, cispro_mask,
+        default_color, twisted_color, cispro_color, vertices, normals,
+        triangles, colors);
+} // dihedral_fill_and_color_planes_from_float
+
+// Add a frame of coordinates to per-atom running means and covariance sums
+EXPORT void accumulate_coord_statistics(size_t n, double *coords, size_t count,
+    double *mean, double *comoment)
+{
+    _accumulate_coord_statistics(n, coords, count, mean, comoment);
+} // accumulate_coord_statistics
+
+EXPORT void accumulate_coord_statistics_float(size_t n, float *coords, size_t count,
+    double *mean, double *comoment)
+{
+    _accumulate_coord_statistics(n, coords, count, mean, comoment);
+} // accumulate_coord_statistics_float
+
 } // extern "C"
@@ -0,0 +1,214 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#define PYINSTANCE_EXPORT
+
+#include "atom_index.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <mutex>
+#include "../thread_pool.h"
+#include <pyinstance/PythonInstance.instantiate.h>
+
+template class pyinstance::PythonInstance<isolde::Atom_Index>;
+
+namespace isolde
+{
+
+Atom_Index::Atom_Index(Atom** atoms, size_t n, double cell_size)
+    : _grid(cell_size)
+{
+    _atoms.reserve(n);
+    _coords.resize(3*n);
+    _index.reserve(n);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto a = atoms[i];
+        if (_index.find(a) != _index.end())
+            continue;
+        uint32_t id = _atoms.size();
+        _index[a] = id;
+        _atoms.push_back(a);
+        _read_coord(id);
+        _grid.insert(id, _coords.data()+3*id);
+    }
+    _coords.resize(3*_atoms.size());
+    _live = _atoms.size();
+}
+
+void Atom_Index::_read_coord(uint32_t i)
+{
+    const auto& c = _atoms[i]->coord();
+    double *xyz = _coords.data()+3*i;
+    for (size_t j=0; j<3; ++j)
+        xyz[j] = c[j];
+}
+
+void Atom_Index::update(Atom** atoms, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        auto it = _index.find(atoms[i]);
+        if (it == _index.end())
+            continue;
+        _read_coord(it->second);
+        _grid.move(it->second, _coords.data()+3*it->second);
+    }
+}
+
+void Atom_Index::update()
+{
+    for (uint32_t i=0; i<_atoms.size(); ++i)
+    {
+        if (_atoms[i] == nullptr)
+            continue;
+        _read_coord(i);
+        _grid.move(i, _coords.data()+3*i);
+    }
+}
+
+template <typename F>
+void Atom_Index::_for_each_within(const double *xyz, double radius, F fn) const
+{
+    const double r2 = radius*radius;
+    _grid.for_each_in_box(xyz, radius, [&](uint32_t id) {
+        const double *p = _coords.data()+3*id;
+        double d2 = 0;
+        for (size_t j=0; j<3; ++j)
+        {
+            double d = p[j]-xyz[j];
+            d2 += d*d;
+        }
+        if (d2 <= r2)
+            fn(id, d2);
+    });
+}
+
+void Atom_Index::within(const double *centers, size_t n, double radius,
+    std::vector<Atom*>& found) const
+{
+    std::vector<uint32_t> ids;
+    std::mutex merge_mutex;
+    Thread_Pool::instance().parallel_chunks(n, MIN_QUERY_CHUNK, [&](size_t start, size_t end) {
+        std::vector<uint32_t> local;
+        for (size_t i=start; i<end; ++i)
+            _for_each_within(centers+3*i, radius, [&local](uint32_t id, double) {
+                local.push_back(id);
+            });
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        ids.insert(ids.end(), local.begin(), local.end());
+    });
+    // Report in index order, each atom once
+    std::vector<uint8_t> hit(_atoms.size(), 0);
+    for (auto id: ids)
+        hit[id] = 1;
+    for (size_t i=0; i<_atoms.size(); ++i)
+        if (hit[i])
+            found.push_back(_atoms[i]);
+}
+
+void Atom_Index::within_each(const double *centers, size_t n, double radius,
+    std::vector<size_t>& offsets, std::vector<Atom*>& found) const
+{
+    std::vector<std::vector<uint32_t>> per_center(n);
+    Thread_Pool::instance().parallel_chunks(n, MIN_QUERY_CHUNK, [&](size_t start, size_t end) {
+        for (size_t i=start; i<end; ++i)
+        {
+            auto& ids = per_center[i];
+            _for_each_within(centers+3*i, radius, [&ids](uint32_t id, double) {
+                ids.push_back(id);
+            });
+            std::sort(ids.begin(), ids.end());
+        }
+    });
+    offsets.resize(n+1);
+    offsets[0] = found.size();
+    for (size_t i=0; i<n; ++i)
+    {
+        for (auto id: per_center[i])
+            found.push_back(_atoms[id]);
+        offsets[i+1] = found.size();
+    }
+}
+
+void Atom_Index::nearest(const double *points, size_t n, size_t k, double max_distance,
+    Atom** found, double* distances) const
+{
+    std::fill(found, found+n*k, nullptr);
+    std::fill(distances, distances+n*k, std::numeric_limits<double>::infinity());
+    if (k == 0 || _live == 0)
+        return;
+    const double cell = _grid.cell_size();
+    const double max_d2 = max_distance*max_distance;
+    Thread_Pool::instance().parallel_chunks(n, MIN_QUERY_CHUNK, [&](size_t start, size_t end) {
+        // Max-heap on squared distance of the best k so far
+        std::vector<std::pair<double, uint32_t>> best;
+        for (size_t i=start; i<end; ++i)
+        {
+            const double *xyz = points+3*i;
+            best.clear();
+            size_t seen = 0;
+            for (int64_t s=0; ; ++s)
+            {
+                _grid.for_each_in_shell(xyz, s, [&](uint32_t id) {
+                    ++seen;
+                    const double *p = _coords.data()+3*id;
+                    double d2 = 0;
+                    for (size_t j=0; j<3; ++j)
+                    {
+                        double d = p[j]-xyz[j];
+                        d2 += d*d;
+                    }
+                    if (d2 > max_d2)
+                        return;
+                    if (best.size() < k) {
+                        best.emplace_back(d2, id);
+                        std::push_heap(best.begin(), best.end());
+                    } else if (d2 < best.front().first) {
+                        std::pop_heap(best.begin(), best.end());
+                        best.back() = std::make_pair(d2, id);
+                        std::push_heap(best.begin(), best.end());
+                    }
+                });
+                // Anything in shell s+1 or beyond is at least s cells away
+                double reach = s*cell;
+                if (seen >= _live || reach > max_distance)
+                    break;
+                if (best.size() == k && best.front().first <= reach*reach)
+                    break;
+            }
+            std::sort_heap(best.begin(), best.end());
+            for (size_t j=0; j<best.size(); ++j)
+            {
+                found[i*k+j] = _atoms[best[j].second];
+                distances[i*k+j] = sqrt(best[j].first);
+            }
+        }
+    });
+}
+
+void Atom_Index::destructors_done(const std::set<void*>& destroyed)
+{
+    for (auto ptr: destroyed)
+    {
+        auto it = _index.find(static_cast<Atom*>(ptr));
+        if (it == _index.end())
+            continue;
+        _grid.remove(it->second);
+        _atoms[it->second] = nullptr;
+        _index.erase(it);
+        --_live;
+    }
+}
+
+} // namespace isolde
@@ -0,0 +1,202 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_ATOM_INDEX
+#define ISOLDE_ATOM_INDEX
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <cmath>
+#include <cstdint>
+
+#include <atomstruct/destruct.h>
+#include <atomstruct/Atom.h>
+#include <pyinstance/PythonInstance.declare.h>
+
+using namespace atomstruct;
+
+namespace isolde
+{
+
+//! Hashed uniform grid of cubic cells, each holding a list of integer IDs
+/*! IDs are dense (0..n-1) and owned by the caller, which also holds the
+ *  coordinates: the grid only knows which cell each ID is in. Moving or
+ *  removing an ID is O(1).
+ */
+class Cell_Grid
+{
+public:
+    Cell_Grid() {}
+    Cell_Grid(double cell_size): _cell(cell_size) {}
+
+    double cell_size() const { return _cell; }
+
+    void insert(uint32_t id, const double *xyz)
+    {
+        if (id >= _cell_of.size()) {
+            _cell_of.resize(id+1, (int64_t)NONE);
+            _slot_of.resize(id+1);
+        }
+        int64_t key = key_of(xyz);
+        auto& cell = _cells[key];
+        _cell_of[id] = key;
+        _slot_of[id] = cell.size();
+        cell.push_back(id);
+    }
+
+    void remove(uint32_t id)
+    {
+        int64_t key = _cell_of[id];
+        if (key == NONE)
+            return;
+        auto it = _cells.find(key);
+        auto& cell = it->second;
+        uint32_t last = cell.back();
+        cell[_slot_of[id]] = last;
+        _slot_of[last] = _slot_of[id];
+        cell.pop_back();
+        if (cell.empty())
+            _cells.erase(it);
+        _cell_of[id] = NONE;
+    }
+
+    //! Returns true if the ID changed cell
+    bool move(uint32_t id, const double *xyz)
+    {
+        int64_t key = key_of(xyz);
+        if (key == _cell_of[id])
+            return false;
+        remove(id);
+        insert(id, xyz);
+        return true;
+    }
+
+    //! Call fn(id) for every ID in cells overlapping a cube of half-width r around xyz
+    template <typename F>
+    void for_each_in_box(const double *xyz, double r, F fn) const
+    {
+        int64_t lo[3], hi[3];
+        for (size_t a=0; a<3; ++a)
+        {
+            lo[a] = (int64_t)floor((xyz[a]-r)/_cell);
+            hi[a] = (int64_t)floor((xyz[a]+r)/_cell);
+        }
+        for (int64_t i=lo[0]; i<=hi[0]; ++i)
+            for (int64_t j=lo[1]; j<=hi[1]; ++j)
+                for (int64_t k=lo[2]; k<=hi[2]; ++k)
+                    _visit(pack(i, j, k), fn);
+    }
+
+    //! Call fn(id) for every ID in the cells exactly s cells away (Chebyshev) from xyz's cell
+    template <typename F>
+    void for_each_in_shell(const double *xyz, int64_t s, F fn) const
+    {
+        int64_t c[3];
+        for (size_t a=0; a<3; ++a)
+            c[a] = (int64_t)floor(xyz[a]/_cell);
+        for (int64_t i=-s; i<=s; ++i)
+            for (int64_t j=-s; j<=s; ++j)
+            {
+                bool edge = (i==-s || i==s || j==-s || j==s);
+                int64_t kstep = edge ? 1 : 2*s;
+                for (int64_t k=-s; k<=s; k+=kstep)
+                    _visit(pack(c[0]+i, c[1]+j, c[2]+k), fn);
+            }
+    }
+
+    int64_t key_of(const double *xyz) const
+    {
+        return pack((int64_t)floor(xyz[0]/_cell), (int64_t)floor(xyz[1]/_cell),
+            (int64_t)floor(xyz[2]/_cell));
+    }
+
+    static int64_t pack(int64_t i, int64_t j, int64_t k)
+    {
+        const int64_t off = 1<<20, mask = (1<<21)-1;
+        return ((i+off)&mask) | (((j+off)&mask)<<21) | (((k+off)&mask)<<42);
+    }
+
+private:
+    static const int64_t NONE = -1;
+    double _cell = 4.0;
+    std::unordered_map<int64_t, std::vector<uint32_t>> _cells;
+    std::vector<int64_t> _cell_of;
+    std::vector<uint32_t> _slot_of;
+
+    template <typename F>
+    void _visit(int64_t key, F& fn) const
+    {
+        auto it = _cells.find(key);
+        if (it == _cells.end())
+            return;
+        for (auto id: it->second)
+            fn(id);
+    }
+}; // class Cell_Grid
+
+//! Cell-list index over a set of atoms, for fast radius and nearest-neighbour queries
+/*! Coordinates are snapshotted when the index is built, and refreshed by
+ *  update(). All queries are in the coordinate frame of the atoms' structure.
+ *  Deleted atoms are dropped automatically.
+ */
+class Atom_Index: public DestructionObserver, public pyinstance::PythonInstance<Atom_Index>
+{
+public:
+    Atom_Index() {} // null constructor
+    Atom_Index(Atom** atoms, size_t n, double cell_size);
+    ~Atom_Index() { auto du = DestructionUser(this); }
+
+    //! Number of live atoms in the index
+    size_t size() const { return _live; }
+    double cell_size() const { return _grid.cell_size(); }
+
+    //! Re-read the coordinates of the given atoms. Atoms not in the index are ignored.
+    void update(Atom** atoms, size_t n);
+    //! Re-read the coordinates of every atom in the index
+    void update();
+
+    //! All atoms within radius of any of the centres, each reported once
+    void within(const double *centers, size_t n, double radius, std::vector<Atom*>& found) const;
+    //! Atoms within radius of each centre
+    /*! The atoms for centre i are found[offsets[i]...offsets[i+1]]. offsets
+     *  has n+1 entries.
+     */
+    void within_each(const double *centers, size_t n, double radius,
+        std::vector<size_t>& offsets, std::vector<Atom*>& found) const;
+    //! Up to k nearest atoms to each point, closest first, within max_distance
+    /*! Writes n*k atoms and distances. Unused entries get nullptr and
+     *  infinity.
+     */
+    void nearest(const double *points, size_t n, size_t k, double max_distance,
+        Atom** found, double* distances) const;
+
+    virtual void destructors_done(const std::set<void*>& destroyed);
+
+private:
+    std::vector<Atom*> _atoms; // nullptr once deleted
+    std::vector<double> _coords;
+    std::unordered_map<Atom*, uint32_t> _index;
+    Cell_Grid _grid;
+    size_t _live = 0;
+
+    //! Smallest number of query points worth handing to another thread
+    static const size_t MIN_QUERY_CHUNK = 256;
+
+    void _read_coord(uint32_t i);
+    template <typename F>
+    void _for_each_within(const double *xyz, double radius, F fn) const;
+}; // class Atom_Index
+
+} // namespace isolde
+
+#endif // ISOLDE_ATOM_INDEX
@@ -0,0 +1,142 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ATOM_INDEX_EXT
+#define ATOM_INDEX_EXT
+
+#include "atom_index.h"
+
+#include "../molc.h"
+using namespace atomstruct;
+using namespace isolde;
+
+/*************************************
+ *
+ * Atom_Index functions
+ *
+ *************************************/
+
+SET_PYTHON_INSTANCE(atom_index, Atom_Index)
+GET_PYTHON_INSTANCES(atom_index, Atom_Index)
+
+extern "C" EXPORT void*
+atom_index_new(void *atoms, size_t n, double cell_size)
+{
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        return new Atom_Index(a, n, cell_size);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
+extern "C" EXPORT void
+atom_index_delete(void *index)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        delete idx;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+atom_index_size(void *index)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        return idx->size();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+atom_index_update(void *index, void *atoms, size_t n)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        idx->update(a, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+atom_index_update_all(void *index)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        idx->update();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT PyObject*
+atom_index_within(void *index, double *centers, size_t n, double radius)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        std::vector<Atom *> found;
+        idx->within(centers, n, radius, found);
+        void **aptrs;
+        PyObject *atom_array = python_voidp_array(found.size(), &aptrs);
+        for (auto a: found)
+            *(aptrs++) = a;
+        return atom_array;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+//! offsets must have room for n+1 entries
+extern "C" EXPORT PyObject*
+atom_index_within_each(void *index, double *centers, size_t n, double radius,
+    size_t *offsets)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        std::vector<Atom *> found;
+        std::vector<size_t> off;
+        idx->within_each(centers, n, radius, off, found);
+        std::copy(off.begin(), off.end(), offsets);
+        void **aptrs;
+        PyObject *atom_array = python_voidp_array(found.size(), &aptrs);
+        for (auto a: found)
+            *(aptrs++) = a;
+        return atom_array;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+atom_index_nearest(void *index, double *points, size_t n, size_t k,
+    double max_distance, pyobject_t *found, double *distances)
+{
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    try {
+        idx->nearest(points, n, k, max_distance, reinterpret_cast<Atom **>(found),
+            distances);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+#endif // ATOM_INDEX_EXT
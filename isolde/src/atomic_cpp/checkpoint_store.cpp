@@ -0,0 +1,209 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#include "checkpoint_store.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace isolde
+{
+
+void Delta_Chain::push(const double *data)
+{
+    if (_first.empty())
+    {
+        _first.assign(data, data+3*_n);
+        _head = _first;
+        return;
+    }
+    Delta d;
+    d.mask.assign((_n+63)/64, 0);
+    for (size_t i=0; i<_n; ++i)
+    {
+        float dx[3];
+        bool changed = false;
+        for (size_t j=0; j<3; ++j)
+        {
+            dx[j] = (float)(data[3*i+j] - _head[3*i+j]);
+            changed |= (dx[j] != 0.0f);
+        }
+        if (!changed)
+            continue;
+        d.mask[i/64] |= (uint64_t)1 << (i%64);
+        for (size_t j=0; j<3; ++j)
+        {
+            d.values.push_back(dx[j]);
+            // Exactly what get() will do, so the next delta is taken from
+            // the stored snapshot rather than the true one
+            _head[3*i+j] += dx[j];
+        }
+    }
+    d.values.shrink_to_fit();
+    _deltas.push_back(std::move(d));
+}
+
+void Delta_Chain::_apply(const Delta& d, double *data) const
+{
+    const float *v = d.values.data();
+    for (size_t w=0; w<d.mask.size(); ++w)
+    {
+        uint64_t bits = d.mask[w];
+        for (size_t b=0; bits; ++b, bits >>= 1)
+        {
+            if (!(bits & 1))
+                continue;
+            double *row = data + 3*(64*w+b);
+            for (size_t j=0; j<3; ++j)
+                row[j] += *v++;
+        }
+    }
+}
+
+void Delta_Chain::get(size_t i, double *out) const
+{
+    if (i >= size())
+        throw std::out_of_range("No checkpoint at this level!");
+    if (i == 0)
+    {
+        std::copy(_first.begin(), _first.end(), out);
+        return;
+    }
+    size_t n_deltas = i;
+    if (_has_rolling)
+    {
+        std::copy(_rolling.begin(), _rolling.end(), out);
+        n_deltas = i-1;
+    } else {
+        std::copy(_first.begin(), _first.end(), out);
+    }
+    for (size_t k=0; k<n_deltas; ++k)
+        _apply(_deltas[k], out);
+}
+
+void Delta_Chain::drop_second()
+{
+    if (size() < 2)
+        return;
+    if (!_has_rolling)
+    {
+        if (_deltas.empty())
+            return;
+        _rolling = _first;
+        _apply(_deltas.front(), _rolling.data());
+        _deltas.pop_front();
+        _has_rolling = true;
+    }
+    // Snapshot 1 is now _rolling. Replace it with snapshot 2.
+    if (_deltas.empty())
+    {
+        _rolling.clear();
+        _has_rolling = false;
+        return;
+    }
+    _apply(_deltas.front(), _rolling.data());
+    _deltas.pop_front();
+}
+
+void Delta_Chain::truncate(size_t n)
+{
+    if (n >= size())
+        return;
+    if (n == 0)
+    {
+        _first.clear();
+        _rolling.clear();
+        _has_rolling = false;
+        _deltas.clear();
+        _head.clear();
+        return;
+    }
+    size_t keep_deltas = _has_rolling ? (n >= 2 ? n-2 : 0) : n-1;
+    _deltas.resize(keep_deltas);
+    if (_has_rolling && n == 1)
+    {
+        _rolling.clear();
+        _has_rolling = false;
+    }
+    get(n-1, _head.data());
+}
+
+size_t Delta_Chain::memory_bytes() const
+{
+    size_t bytes = (_first.capacity() + _rolling.capacity() + _head.capacity()) * sizeof(double);
+    for (const auto& d: _deltas)
+        bytes += d.mask.capacity()*sizeof(uint64_t) + d.values.capacity()*sizeof(float);
+    return bytes;
+}
+
+Checkpoint_Store::Checkpoint_Store(size_t n_atoms, size_t max_levels, bool store_velocities)
+    : _n(n_atoms), _coords(n_atoms)
+{
+    if (store_velocities)
+        _velocities.reset(new Delta_Chain(n_atoms));
+    set_max_levels(max_levels);
+}
+
+void Checkpoint_Store::set_max_levels(size_t n)
+{
+    if (n < 2)
+        throw std::invalid_argument("A checkpoint store must hold at least two levels!");
+    _max_levels = n;
+    _enforce_max_levels();
+}
+
+void Checkpoint_Store::push(const double *coords, const double *velocities)
+{
+    if (has_velocities() && velocities == nullptr)
+        throw std::invalid_argument("This checkpoint store needs velocities!");
+    _coords.push(coords);
+    if (has_velocities())
+        _velocities->push(velocities);
+    _enforce_max_levels();
+}
+
+void Checkpoint_Store::get(size_t i, double *coords, double *velocities) const
+{
+    _coords.get(i, coords);
+    if (velocities != nullptr)
+    {
+        if (!has_velocities())
+            throw std::logic_error("This checkpoint store does not hold velocities!");
+        _velocities->get(i, velocities);
+    }
+}
+
+void Checkpoint_Store::truncate(size_t n)
+{
+    _coords.truncate(n);
+    if (has_velocities())
+        _velocities->truncate(n);
+}
+
+size_t Checkpoint_Store::memory_bytes() const
+{
+    size_t bytes = _coords.memory_bytes();
+    if (has_velocities())
+        bytes += _velocities->memory_bytes();
+    return bytes;
+}
+
+void Checkpoint_Store::_enforce_max_levels()
+{
+    while (size() > _max_levels)
+    {
+        _coords.drop_second();
+        if (has_velocities())
+            _velocities->drop_second();
+    }
+}
+
+} // namespace isolde
@@ -0,0 +1,99 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_CHECKPOINT_STORE
+#define ISOLDE_CHECKPOINT_STORE
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <cstdint>
+
+namespace isolde
+{
+
+//! History of snapshots of an (n x 3) array, stored as float32 deltas
+/*! The first snapshot is kept in full. Each later one is stored as the
+ *  float32 difference from the reconstruction of the one before it, so
+ *  rounding error does not accumulate along the chain. Only rows that
+ *  changed are stored, with a bitmask marking which.
+ */
+class Delta_Chain
+{
+public:
+    Delta_Chain(size_t n): _n(n) {}
+
+    size_t size() const { return _first.empty() ? 0 : 1 + _has_rolling + _deltas.size(); }
+    void push(const double *data);
+    //! Reconstruct snapshot i (0 = oldest)
+    void get(size_t i, double *out) const;
+    //! Forget the second-oldest snapshot, keeping the first
+    void drop_second();
+    //! Forget all snapshots after the first n
+    void truncate(size_t n);
+    size_t memory_bytes() const;
+
+private:
+    struct Delta
+    {
+        std::vector<uint64_t> mask;
+        std::vector<float> values; // 3 per changed row
+    };
+    size_t _n;
+    std::vector<double> _first;
+    // Once snapshots start being dropped, snapshot 1 is also kept in full
+    // and the deltas start from there
+    std::vector<double> _rolling;
+    bool _has_rolling = false;
+    std::deque<Delta> _deltas;
+    // Reconstruction of the newest snapshot
+    std::vector<double> _head;
+
+    void _apply(const Delta& d, double *data) const;
+}; // class Delta_Chain
+
+//! Multi-level checkpoint history of atomic coordinates (and optionally velocities)
+/*! Once more than max_levels snapshots are held the second-oldest is
+ *  dropped, so the first (normally the start of a simulation) is always
+ *  kept.
+ */
+class Checkpoint_Store
+{
+public:
+    Checkpoint_Store(size_t n_atoms, size_t max_levels, bool store_velocities);
+
+    size_t n_atoms() const { return _n; }
+    size_t size() const { return _coords.size(); }
+    bool has_velocities() const { return _velocities != nullptr; }
+    size_t max_levels() const { return _max_levels; }
+    void set_max_levels(size_t n);
+
+    //! Save a new snapshot. velocities is ignored unless has_velocities().
+    void push(const double *coords, const double *velocities);
+    //! Reconstruct snapshot i (0 = oldest). velocities may be nullptr.
+    void get(size_t i, double *coords, double *velocities) const;
+    void truncate(size_t n);
+    //! Approximate heap memory used by the stored snapshots
+    size_t memory_bytes() const;
+
+private:
+    size_t _n;
+    size_t _max_levels;
+    Delta_Chain _coords;
+    std::unique_ptr<Delta_Chain> _velocities;
+
+    void _enforce_max_levels();
+}; // class Checkpoint_Store
+
+} // namespace isolde
+
+#endif // ISOLDE_CHECKPOINT_STORE
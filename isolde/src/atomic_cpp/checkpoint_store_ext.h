@@ -0,0 +1,129 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef CHECKPOINT_STORE_EXT
+#define CHECKPOINT_STORE_EXT
+
+#include "checkpoint_store.h"
+
+#include "../molc.h"
+using namespace isolde;
+
+/*************************************
+ *
+ * Checkpoint_Store functions
+ *
+ *************************************/
+
+extern "C" EXPORT void*
+checkpoint_store_new(size_t n_atoms, size_t max_levels, bool velocities)
+{
+    try {
+        return new Checkpoint_Store(n_atoms, max_levels, velocities);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
+extern "C" EXPORT void
+checkpoint_store_delete(void *store)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        delete s;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+checkpoint_store_size(void *store)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        return s->size();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT size_t
+checkpoint_store_max_levels(void *store)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        return s->max_levels();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_checkpoint_store_max_levels(void *store, size_t n)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        s->set_max_levels(n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+checkpoint_store_memory_bytes(void *store)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        return s->memory_bytes();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+checkpoint_store_push(void *store, double *coords, double *velocities)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        s->push(coords, velocities);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+checkpoint_store_get(void *store, size_t i, double *coords, double *velocities)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        s->get(i, coords, velocities);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+checkpoint_store_truncate(void *store, size_t n)
+{
+    Checkpoint_Store *s = static_cast<Checkpoint_Store *>(store);
+    try {
+        s->truncate(n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+#endif
@@ -14,6 +14,8 @@
 
 #include "chiral_mgr.h"
 #include <set>
+#include <limits>
+#include "../thread_pool.h"
 #include <pyinstance/PythonInstance.instantiate.h>
 
 template class pyinstance::PythonInstance<isolde::ChiralMgr>;
@@ -38,6 +40,150 @@ void ChiralMgr::add_chiral_def(const std::string& resname,
     double expected_angle)
 {
     _defs[resname][atom_name] = Chiral_Def(s1, s2, s3, expected_angle);
+    _compiled_dirty = true;
+}
+
+Memory_Usage ChiralMgr::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _atom_to_chiral.size();
+    u.buffer_bytes = _atom_to_chiral.size()*sizeof(ChiralCenter);
+    u.container_bytes = memory::hash_bytes(_atom_to_chiral) + _dependents.container_bytes()
+        + memory::hash_bytes(_defs) + memory::hash_bytes(_compiled)
+        + memory::hash_bytes(_name_ids);
+    for (const auto& rit: _defs)
+    {
+        u.container_bytes += memory::hash_bytes(rit.second);
+        for (const auto& ait: rit.second)
+            for (const auto& names: ait.second.substituents)
+                u.container_bytes += memory::vector_bytes(names);
+    }
+    for (const auto& rit: _compiled)
+    {
+        u.container_bytes += memory::hash_bytes(rit.second);
+        for (const auto& ait: rit.second)
+            for (const auto& ids: ait.second.substituents)
+                u.container_bytes += memory::vector_bytes(ids);
+    }
+    return u;
+}
+
+void ChiralMgr::_compile_defs()
+{
+    _compiled.clear();
+    _name_ids.clear();
+    for (const auto& rit: _defs)
+    {
+        auto& cres = _compiled[rit.first];
+        for (const auto& ait: rit.second)
+        {
+            auto& cdef = cres[ait.first];
+            cdef.def = &(ait.second);
+            for (size_t i=0; i<3; ++i)
+                for (const auto& name: ait.second.substituents[i])
+                {
+                    auto nit = _name_ids.emplace(name, (Name_ID)_name_ids.size()).first;
+                    cdef.substituents[i].push_back(nit->second);
+                }
+        }
+    }
+    _compiled_dirty = false;
+}
+
+size_t ChiralMgr::create_chirals(Residue** residues, size_t n)
+{
+    if (_compiled_dirty)
+        _compile_defs();
+    std::vector<const Compiled_Residue*> res_defs(n, nullptr);
+    size_t max_defs = 0;
+    for (size_t i=0; i<n; ++i)
+    {
+        auto it = _compiled.find(residues[i]->name());
+        if (it == _compiled.end())
+            continue;
+        res_defs[i] = &(it->second);
+        max_defs = std::max(max_defs, it->second.size());
+    }
+    if (max_defs == 0)
+        return 0;
+
+    // As for Dihedral_Mgr::create_dihedrals(): a threaded read-only search in
+    // bounded batches, with a fixed block of results per residue so that
+    // creation order is deterministic.
+    struct Found { Atom* atoms[4]; const Chiral_Def* def; };
+    const size_t batch_size = BULK_BATCH_SIZE;
+    std::vector<Found> results(std::min(n, batch_size)*max_defs);
+    const Name_ID NO_ID = std::numeric_limits<Name_ID>::max();
+    size_t count = 0;
+    for (size_t batch_start=0; batch_start<n; batch_start+=batch_size)
+    {
+        size_t batch_end = std::min(n, batch_start+batch_size);
+        Thread_Pool::instance().parallel_chunks(batch_end-batch_start, MIN_BULK_CHUNK,
+            [&](size_t start, size_t end) {
+            std::vector<Name_ID> neighbor_ids;
+            for (size_t i=batch_start+start; i<batch_start+end; ++i)
+            {
+                Found* f = results.data() + (i-batch_start)*max_defs;
+                for (size_t j=0; j<max_defs; ++j)
+                    f[j].def = nullptr;
+                const Compiled_Residue* cres = res_defs[i];
+                if (cres == nullptr)
+                    continue;
+                size_t nf = 0;
+                for (auto center: residues[i]->atoms())
+                {
+                    if (center->bonds().size() < 3)
+                        continue;
+                    auto cit = cres->find(std::string(center->name()));
+                    if (cit == cres->end())
+                        continue;
+                    if (_atom_to_chiral.find(center) != _atom_to_chiral.end())
+                        continue;
+                    const auto& neighbors = center->neighbors();
+                    neighbor_ids.clear();
+                    for (auto nb: neighbors)
+                    {
+                        auto nit = _name_ids.find(std::string(nb->name()));
+                        neighbor_ids.push_back(nit == _name_ids.end() ? NO_ID : nit->second);
+                    }
+                    Found& this_f = f[nf];
+                    this_f.atoms[0] = center;
+                    bool ok = true;
+                    for (size_t k=0; k<3 && ok; ++k)
+                    {
+                        // First neighbour matching any of the allowed names
+                        Atom* match = nullptr;
+                        for (size_t m=0; m<neighbors.size() && match==nullptr; ++m)
+                            for (auto id: cit->second.substituents[k])
+                                if (neighbor_ids[m] == id) { match = neighbors[m]; break; }
+                        this_f.atoms[k+1] = match;
+                        ok = match != nullptr;
+                    }
+                    if (!ok)
+                        continue;
+                    this_f.def = cit->second.def;
+                    if (++nf == max_defs)
+                        break;
+                }
+            }
+        });
+
+        // Creation modifies the manager, so is serial
+        for (size_t i=batch_start; i<batch_end; ++i)
+        {
+            const Found* f = results.data() + (i-batch_start)*max_defs;
+            for (size_t j=0; j<max_defs; ++j)
+            {
+                if (f[j].def == nullptr)
+                    continue;
+                ChiralCenter* c = new ChiralCenter(f[j].atoms[0], f[j].atoms[1],
+                    f[j].atoms[2], f[j].atoms[3], f[j].def->expected_angle);
+                _add_chiral(c);
+                count++;
+            }
+        }
+    }
+    return count;
 }
 
 const Chiral_Def& ChiralMgr::get_chiral_def(
@@ -86,25 +232,22 @@ ChiralCenter* ChiralMgr::_new_chiral(Atom* center)
     const auto& neighbors = center->neighbors();
     //const auto& def = get_chiral_def(center->residue()->name(), center->name());
 
+    // Each substituent may have several allowed names (e.g. across
+    // glycosidic bonds): take the first neighbour matching any of them
     const auto& subnames = def.substituents;
     size_t i = 0;
     for (const auto& slist: subnames)
     {
-        for (const auto &s: slist)
+        Atom* match = nullptr;
+        for (auto n: neighbors)
         {
-            bool found = false;
-            for (auto n: neighbors)
-            {
-                if (n->name() == s)
-                {
-                    substituents[i] = n;
-                    found = true;
-                    break;
-                }
-            }
-            if (found) { ++i; continue; }
-            return nullptr;
+            for (const auto &s: slist)
+                if (n->name() == s) { match = n; break; }
+            if (match != nullptr) break;
         }
+        if (match == nullptr)
+            return nullptr;
+        substituents[i++] = match;
     }
     ChiralCenter* c = new ChiralCenter(
         center, substituents[0], substituents[1], substituents[2], def.expected_angle);
@@ -116,6 +259,8 @@ ChiralCenter* ChiralMgr::_new_chiral(Atom* center)
 void ChiralMgr::_add_chiral(ChiralCenter *c)
 {
     _atom_to_chiral[c->chiral_atom()] = c;
+    for (auto a: c->atoms())
+        _dependents.add(a, c);
 }
 
 void ChiralMgr::delete_chirals(const std::set<ChiralCenter *>& delete_list)
@@ -128,25 +273,53 @@ void ChiralMgr::_delete_chirals(const std::set<ChiralCenter *>& delete_list)
 {
     for (auto c: delete_list) {
         _atom_to_chiral.erase(c->chiral_atom());
+        for (auto a: c->atoms())
+            _dependents.remove(a, c);
         delete c;
     }
 }
 
+static const size_t MIN_CHIRAL_CHUNK = 4096;
+
+void ChiralMgr::find_inverted(ChiralCenter** chirals, size_t n,
+    std::vector<ChiralCenter*>& inverted) const
+{
+    std::vector<char> flags(n);
+    Thread_Pool::instance().parallel_chunks(n, MIN_CHIRAL_CHUNK,
+        [&](size_t start, size_t end) {
+        size_t m = end-start;
+        std::vector<double> coords(12*m);
+        std::vector<double> signs(m);
+        double *cp = coords.data();
+        for (size_t i=start; i<end; ++i)
+            for (auto a: chirals[i]->atoms())
+            {
+                const auto& c = a->coord();
+                *cp++ = c[0]; *cp++ = c[1]; *cp++ = c[2];
+            }
+        geometry::dihedral_signs(m, coords.data(), signs.data());
+        for (size_t i=0; i<m; ++i)
+            flags[start+i] = signs[i]*chirals[start+i]->expected_angle() < 0;
+    });
+    for (size_t i=0; i<n; ++i)
+        if (flags[i])
+            inverted.push_back(chirals[i]);
+}
+
+void ChiralMgr::find_inverted(std::vector<ChiralCenter*>& inverted) const
+{
+    std::vector<ChiralCenter*> all;
+    all.reserve(_atom_to_chiral.size());
+    for (const auto& it: _atom_to_chiral)
+        all.push_back(it.second);
+    find_inverted(all.data(), all.size(), inverted);
+}
+
 void ChiralMgr::destructors_done(const std::set<void *>& destroyed)
 {
     auto db = DestructionBatcher(this);
     std::set<ChiralCenter *> to_delete;
-    for (const auto &it: _atom_to_chiral)
-    {
-        auto c = it.second;
-        const auto &catoms = c->atoms();
-        for (auto a: catoms) {
-            if (destroyed.find(static_cast<void *>(a)) != destroyed.end()) {
-                to_delete.insert(c);
-                break;
-            }
-        }
-    }
+    _dependents.find_dependents(destroyed, to_delete);
     _delete_chirals(to_delete);
 }
 
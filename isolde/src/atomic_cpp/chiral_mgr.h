@@ -29,6 +29,8 @@
 #include <pyinstance/PythonInstance.declare.h>
 
 #include "chiral.h"
+#include "../destruction_index.h"
+#include "../memory_report.h"
 
 using namespace atomstruct;
 
@@ -88,14 +90,53 @@ public:
      */
     ChiralCenter* get_chiral(Atom* center, bool create=true);
 
+    //! Find and create all defined chiral centres in a set of residues
+    /*! The definitions are compiled (once, until the next add_chiral_def())
+     *  into per-residue tables where substituent names are interned integer
+     *  IDs, and the search (which only reads the structure) is split across
+     *  threads. Centres that already exist are skipped. Returns the number
+     *  of new centres created.
+     */
+    size_t create_chirals(Residue** residues, size_t n);
+
     void delete_chirals(const std::set<ChiralCenter *>& delete_list);
 
+    //! Find the chiral centres whose handedness is opposite to that expected
+    /*! Coordinates are gathered into a packed array and only the sign of
+     *  each chiral "dihedral" is computed, in bulk and split across threads
+     *  for large sets. Inverted centres are appended to inverted, in input
+     *  order.
+     */
+    void find_inverted(ChiralCenter** chirals, size_t n,
+        std::vector<ChiralCenter*>& inverted) const;
+    //! As above, checking every chiral centre currently registered
+    void find_inverted(std::vector<ChiralCenter*>& inverted) const;
+
     size_t num_chirals() const { return _atom_to_chiral.size(); }
+    Memory_Usage memory_usage() const;
     virtual void destructors_done(const std::set<void*>& destroyed);
 
 private:
+    typedef uint32_t Name_ID;
+    // A Chiral_Def with its substituent names interned
+    struct Compiled_Def
+    {
+        const Chiral_Def* def;
+        std::array<std::vector<Name_ID>, 3> substituents;
+    };
+    // All definitions for one residue type, keyed by central atom name
+    typedef std::unordered_map<std::string, Compiled_Def> Compiled_Residue;
+    std::unordered_map<std::string, Compiled_Residue> _compiled;
+    std::unordered_map<std::string, Name_ID> _name_ids;
+    bool _compiled_dirty = true;
+    void _compile_defs();
+    static const size_t MIN_BULK_CHUNK = 512;
+    static const size_t BULK_BATCH_SIZE = 32768;
+
     Rname_Map _defs;
     Amap _atom_to_chiral;
+    // Each of a chiral centre's four atoms maps back to it
+    Destruction_Index<ChiralCenter> _dependents;
     ChiralCenter* _new_chiral(Atom* center);
     void _add_chiral(ChiralCenter* c);
 
@@ -127,6 +127,41 @@ chiral_mgr_get_chiral(void *mgr, void *atom, size_t n, npy_bool create)
     }
 }
 
+extern "C" EXPORT size_t
+chiral_mgr_create_chirals(void *mgr, void *residues, size_t n)
+{
+    ChiralMgr *m = static_cast<ChiralMgr *>(mgr);
+    Residue **r = static_cast<Residue **>(residues);
+    try {
+        return m->create_chirals(r, n);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT PyObject*
+chiral_mgr_find_inverted(void *mgr, void *chirals, size_t n, npy_bool all)
+{
+    ChiralMgr *m = static_cast<ChiralMgr *>(mgr);
+    ChiralCenter **c = static_cast<ChiralCenter **>(chirals);
+    try {
+        std::vector<ChiralCenter *> inverted;
+        if (all)
+            m->find_inverted(inverted);
+        else
+            m->find_inverted(c, n, inverted);
+        void **cptr;
+        PyObject *ca = python_voidp_array(inverted.size(), &cptr);
+        for (auto ic: inverted)
+            *(cptr++) = ic;
+        return ca;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
 extern "C" EXPORT size_t
 chiral_mgr_num_chirals(void *mgr)
 {
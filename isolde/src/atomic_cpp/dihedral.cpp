@@ -51,8 +51,22 @@ Dihedral::coords() const
 double
 Dihedral::angle() const
 {
-    return geometry::dihedral_angle<Coord, Real>(atoms()[0]->coord(),
-        atoms()[1]->coord(), atoms()[2]->coord(), atoms()[3]->coord());
+    const Coord& c0 = atoms()[0]->coord();
+    const Coord& c1 = atoms()[1]->coord();
+    const Coord& c2 = atoms()[2]->coord();
+    const Coord& c3 = atoms()[3]->coord();
+    if (_angle_cached && util::coords_equal(c0, _angle_coords[0])
+        && util::coords_equal(c1, _angle_coords[1])
+        && util::coords_equal(c2, _angle_coords[2])
+        && util::coords_equal(c3, _angle_coords[3]))
+        return _cached_angle;
+    _cached_angle = geometry::dihedral_angle<Coord, Real>(c0, c1, c2, c3);
+    _angle_coords[0] = c0;
+    _angle_coords[1] = c1;
+    _angle_coords[2] = c2;
+    _angle_coords[3] = c3;
+    _angle_cached = true;
+    return _cached_angle;
 }
 
 
@@ -64,6 +64,10 @@ private:
     const char* err_msg_multi_struct() const
         {return "All atoms must be in the same structure!";}
     std::string _name; // Name of the dihedral (e.g. phi, psi, omega, ...)
+    // The last angle computed, and the coordinates it was computed from
+    mutable Coords _angle_coords;
+    mutable double _cached_angle;
+    mutable bool _angle_cached = false;
 
 public:
     Dihedral(Atom* a1, Atom* a2, Atom* a3, Atom* a4, Residue* owner, std::string name);
@@ -72,7 +76,12 @@ public:
     const Atoms& atoms() const { return _atoms; }
     Structure* structure() const { return atoms()[0]->structure(); }
     Residue* residue() const { return _residue; }
-    double angle() const; // return the current dihedral angle in radians
+    /*! Return the current dihedral angle in radians. The result is cached
+     *  along with the coordinates it was calculated from, so repeated calls
+     *  between coordinate changes cost only a comparison. Since this updates
+     *  the cache, concurrent calls on the *same* dihedral are not safe.
+     */
+    double angle() const;
     double angle_deg() const { return util::degrees(angle()); }
     const std::string& name() const { return _name; }
     virtual const Bonds& bonds() const {
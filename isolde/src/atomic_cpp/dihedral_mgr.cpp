@@ -26,12 +26,9 @@ template <class DType>
 Dihedral_Mgr<DType>::~Dihedral_Mgr()
 {
     auto du = DestructionUser(this);
-    _atom_to_dihedral_map.clear();
-    for (auto &dm: _residue_map) {
-        for (auto &d: dm.second)
-            delete d.second;
-    }
+    _atom_heads.clear();
     _residue_map.clear();
+    _dihedrals.clear();
 } //~Dihedral_Mgr
 
 template <class DType>
@@ -51,33 +48,116 @@ template <class DType>
 size_t Dihedral_Mgr<DType>::num_mapped_dihedrals() const
 {
     size_t count = 0;
-    for (auto rm: _residue_map)
+    for (const auto &rm: _residue_map)
         count += rm.second.size();
-        // for (auto dm: rm.second)
-        //     count++;
     return count;
 } //num_mapped_dihedrals
 
+template <class DType>
+Memory_Usage Dihedral_Mgr<DType>::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _dihedrals.size();
+    u.buffer_bytes = _dihedrals.allocated_bytes()
+        + memory::vector_bytes(_atom_links) + memory::vector_bytes(_free_links);
+    u.container_bytes = _dihedrals.bookkeeping_bytes()
+        + memory::hash_bytes(_residue_map) + memory::hash_bytes(_atom_heads)
+        + memory::hash_bytes(_name_ids) + memory::hash_bytes(_residue_name_map);
+    for (const auto &rm: _residue_map)
+        u.container_bytes += memory::vector_bytes(rm.second);
+    for (const auto &n: _name_ids)
+        u.container_bytes += memory::string_bytes(n.first);
+    for (const auto &rn: _residue_name_map)
+    {
+        u.container_bytes += memory::hash_bytes(rn.second);
+        for (const auto &dn: rn.second)
+        {
+            u.container_bytes += memory::vector_bytes(dn.second.first)
+                + dn.second.second.capacity()/8;
+            for (const auto &aname: dn.second.first)
+                u.container_bytes += memory::string_bytes(aname);
+        }
+    }
+    return u;
+} //memory_usage
 
 template <class DType>
-void Dihedral_Mgr<DType>::add_dihedral(DType* d)
+typename Dihedral_Mgr<DType>::Name_ID
+Dihedral_Mgr<DType>::name_id(const std::string &name)
 {
-    //~ _dihedrals.push_back(d);
+    auto it = _name_ids.find(name);
+    if (it != _name_ids.end())
+        return it->second;
+    if (_name_ids.size() >= UINT16_MAX)
+        throw std::out_of_range("Too many distinct dihedral names!");
+    Name_ID id = static_cast<Name_ID>(_name_ids.size());
+    _name_ids[name] = id;
+    return id;
+}
 
-    // Atom to dihedral mappings for fast clean-up
-    for (auto a: d->atoms()) {
-        auto &dset = _atom_to_dihedral_map[a];
-        dset.insert(d);
-        _mapped_atoms.insert(a);
+template <class DType>
+void Dihedral_Mgr<DType>::_link_atom(Atom *a, DType *d)
+{
+    uint32_t link;
+    if (!_free_links.empty()) {
+        link = _free_links.back();
+        _free_links.pop_back();
+    } else {
+        link = static_cast<uint32_t>(_atom_links.size());
+        _atom_links.emplace_back();
+    }
+    auto it = _atom_heads.find(a);
+    uint32_t head = (it == _atom_heads.end()) ? NO_LINK : it->second;
+    _atom_links[link] = {d, head};
+    _atom_heads[a] = link;
+}
+
+template <class DType>
+void Dihedral_Mgr<DType>::_unlink_atom(Atom *a, DType *d)
+{
+    auto it = _atom_heads.find(a);
+    if (it == _atom_heads.end())
+        return;
+    uint32_t prev = NO_LINK;
+    for (uint32_t link = it->second; link != NO_LINK; link = _atom_links[link].next)
+    {
+        if (_atom_links[link].dihedral != d) {
+            prev = link;
+            continue;
+        }
+        uint32_t next = _atom_links[link].next;
+        if (prev == NO_LINK)
+            it->second = next;
+        else
+            _atom_links[prev].next = next;
+        _free_links.push_back(link);
+        break;
     }
+    if (it->second == NO_LINK)
+        _atom_heads.erase(it);
+}
+
+template <class DType>
+void Dihedral_Mgr<DType>::add_dihedral(DType* d)
+{
+    // Atom to dihedral mappings for fast clean-up
+    for (auto a: d->atoms())
+        _link_atom(a, d);
 
     // Add it to the Residue:name map if it has both a Residue and a name
     try {
         Residue* r = d->residue(); // returns an error if no residue assigned
         const std::string &name = d->name();
         if (name != "") {
+            Name_ID id = name_id(name);
             Dmap &dm = _residue_map[r];
-            dm[name] = d;
+            for (auto &nd: dm) {
+                if (nd.name_id == id) {
+                    nd.dihedral = d;
+                    return;
+                }
+            }
+            dm.push_back({id, d});
         }
     } catch(std::runtime_error) {
         return;
@@ -142,7 +222,7 @@ DType* Dihedral_Mgr<DType>::new_dihedral(Residue *res, const std::string &dname,
         }
     }
     if (found) {
-        DType *d = new DType(found_atoms[0],
+        DType *d = _dihedrals.create(found_atoms[0],
             found_atoms[1], found_atoms[2], found_atoms[3],
             res, dname);
         add_dihedral(d);
@@ -151,6 +231,158 @@ DType* Dihedral_Mgr<DType>::new_dihedral(Residue *res, const std::string &dname,
     return nullptr;
 } //new_dihedral
 
+template <class DType>
+bool Dihedral_Mgr<DType>::_find_atoms(Residue *res, const typename Bulk_Template::Def &bdef,
+    Atom * const *internal, Atom **found) const
+{
+    const auto &anames = bdef.def->first;
+    const auto &external = bdef.def->second;
+    auto bonded = [](Atom *a, Atom *b) {
+        for (auto nb: a->neighbors())
+            if (nb == b)
+                return true;
+        return false;
+    };
+    // Any atom external to the residue must be found by walking bonds from
+    // its neighbour in the dihedral, as for new_dihedral()
+    auto external_neighbor = [&](Atom *from, size_t k) -> Atom* {
+        for (auto a: from->neighbors())
+            if (a->residue() != res && a->name() == anames[k])
+                return a;
+        return nullptr;
+    };
+    size_t fi = bdef.first_internal;
+    found[fi] = internal[bdef.slots[fi]];
+    if (found[fi] == nullptr)
+        return false;
+    for (size_t j=fi; j>0; --j) {
+        found[j-1] = external_neighbor(found[j], j-1);
+        if (found[j-1] == nullptr)
+            return false;
+    }
+    for (size_t k=fi+1; k<4; ++k) {
+        if (external[k]) {
+            found[k] = external_neighbor(found[k-1], k);
+        } else {
+            found[k] = internal[bdef.slots[k]];
+            if (found[k] != nullptr && !bonded(found[k-1], found[k]))
+                found[k] = nullptr;
+        }
+        if (found[k] == nullptr)
+            return false;
+    }
+    return true;
+}
+
+template <class DType>
+size_t Dihedral_Mgr<DType>::create_dihedrals(Residue **residues, size_t n,
+    const std::vector<std::string> &names)
+{
+    std::vector<Name_ID> ids;
+    for (const auto &name: names)
+        ids.push_back(name_id(name));
+
+    // One search template per residue type present
+    std::unordered_map<std::string, Bulk_Template> templates;
+    std::vector<const Bulk_Template*> res_templates(n, nullptr);
+    for (size_t i=0; i<n; ++i)
+    {
+        const std::string &rname = residues[i]->name();
+        auto it = templates.find(rname);
+        if (it == templates.end()) {
+            Bulk_Template &t = templates[rname];
+            auto rit = _residue_name_map.find(rname);
+            if (rit != _residue_name_map.end()) {
+                for (size_t j=0; j<names.size(); ++j) {
+                    auto dit = rit->second.find(names[j]);
+                    if (dit == rit->second.end())
+                        continue;
+                    typename Bulk_Template::Def bdef;
+                    bdef.id = ids[j];
+                    bdef.name = &names[j];
+                    bdef.def = &(dit->second);
+                    const auto &external = dit->second.second;
+                    bdef.first_internal = 4;
+                    for (size_t k=0; k<4; ++k) {
+                        if (external[k]) {
+                            bdef.slots[k] = -1;
+                            continue;
+                        }
+                        if (bdef.first_internal == 4)
+                            bdef.first_internal = k;
+                        const auto &aname = dit->second.first[k];
+                        auto sit = t.internal_slots.find(aname);
+                        if (sit == t.internal_slots.end())
+                            sit = t.internal_slots.emplace(aname, t.internal_slots.size()).first;
+                        bdef.slots[k] = static_cast<int>(sit->second);
+                    }
+                    if (bdef.first_internal < 4)
+                        t.defs.push_back(bdef);
+                }
+            }
+            it = templates.find(rname);
+        }
+        if (!it->second.defs.empty())
+            res_templates[i] = &(it->second);
+    }
+
+    // Work through the residues in batches, to bound the size of the
+    // intermediate results. Within each batch the search only reads the
+    // structure, so is split across threads, with each residue getting a
+    // fixed block of results so the creation order is deterministic.
+    size_t max_defs = 0;
+    for (const auto &it: templates)
+        max_defs = std::max(max_defs, it.second.defs.size());
+    struct Found { Atom* atoms[4]; bool ok; };
+    const size_t batch_size = BULK_BATCH_SIZE;
+    std::vector<Found> results(std::min(n, batch_size)*max_defs);
+    size_t count = 0;
+    for (size_t batch_start=0; batch_start<n; batch_start+=batch_size)
+    {
+        size_t batch_end = std::min(n, batch_start+batch_size);
+        Thread_Pool::instance().parallel_chunks(batch_end-batch_start, MIN_BULK_CHUNK,
+            [&](size_t start, size_t end) {
+            std::vector<Atom*> internal;
+            for (size_t i=batch_start+start; i<batch_start+end; ++i)
+            {
+                const Bulk_Template *t = res_templates[i];
+                if (t == nullptr)
+                    continue;
+                internal.assign(t->internal_slots.size(), nullptr);
+                for (auto a: residues[i]->atoms()) {
+                    auto sit = t->internal_slots.find(a->name());
+                    if (sit != t->internal_slots.end() && internal[sit->second] == nullptr)
+                        internal[sit->second] = a;
+                }
+                for (size_t j=0; j<t->defs.size(); ++j) {
+                    auto &f = results[(i-batch_start)*max_defs+j];
+                    f.ok = _find_atoms(residues[i], t->defs[j], internal.data(), f.atoms);
+                }
+            }
+        });
+
+        // Creation modifies the manager, so is serial
+        for (size_t i=batch_start; i<batch_end; ++i)
+        {
+            const Bulk_Template *t = res_templates[i];
+            if (t == nullptr)
+                continue;
+            Residue *res = residues[i];
+            for (size_t j=0; j<t->defs.size(); ++j) {
+                const auto &f = results[(i-batch_start)*max_defs+j];
+                const auto &bdef = t->defs[j];
+                if (!f.ok || find_dihedral(res, bdef.id) != nullptr)
+                    continue;
+                DType *d = _dihedrals.create(f.atoms[0], f.atoms[1], f.atoms[2],
+                    f.atoms[3], res, *bdef.name);
+                add_dihedral(d);
+                count++;
+            }
+        }
+    }
+    return count;
+} //create_dihedrals
+
 template <class DType>
 DType* Dihedral_Mgr<DType>::new_dihedral(Residue *res, const std::string &dname)
 {
@@ -179,13 +411,11 @@ DType* Dihedral_Mgr<DType>::new_dihedral(Residue *res, const std::string &dname)
 template <class DType>
 DType* Dihedral_Mgr<DType>::get_dihedral(Residue *res, const std::string &name, bool create)
 {
-    auto iter1 = _residue_map.find(res);
-    if (iter1 != _residue_map.end()) {
-        auto &dmap = iter1->second;
-        auto iter2 = dmap.find(name);
-        if (iter2 != dmap.end()) {
-            return iter2->second;
-        }
+    auto id_it = _name_ids.find(name);
+    if (id_it != _name_ids.end()) {
+        DType *d = find_dihedral(res, id_it->second);
+        if (d != nullptr)
+            return d;
     }
     if (!create)
     {
@@ -195,20 +425,48 @@ DType* Dihedral_Mgr<DType>::get_dihedral(Residue *res, const std::string &name,
     return new_dihedral(res, name);
 }
 
+template <class DType>
+DType* Dihedral_Mgr<DType>::find_dihedral(Residue *res, Name_ID name_id) const
+{
+    auto it = _residue_map.find(res);
+    if (it == _residue_map.end())
+        return nullptr;
+    for (const auto &nd: it->second) {
+        if (nd.name_id == name_id)
+            return nd.dihedral;
+    }
+    return nullptr;
+}
+
 template <class DType>
 std::vector<DType *> Dihedral_Mgr<DType>::get_dihedrals(Residue *res) const
 {
     std::vector<DType *> dihedrals;
     auto it1 = _residue_map.find(res);
     if (it1 != _residue_map.end()) {
-        const auto &dmap = it1->second;
-        for (const auto &it2: dmap) {
-            dihedrals.push_back(it2.second);
+        for (const auto &nd: it1->second) {
+            dihedrals.push_back(nd.dihedral);
         }
     }
     return dihedrals;
 }
 
+template <class DType>
+void Dihedral_Mgr<DType>::compute_angles(DType **dihedrals, size_t n, double *angles) const
+{
+    for (size_t i=0; i<n; ++i)
+        angles[i] = dihedrals[i]->angle();
+}
+
+template <class DType>
+void Dihedral_Mgr<DType>::compute_all_angles(std::vector<DType *> &dihedrals,
+    std::vector<double> &angles) const
+{
+    dihedrals = _dihedrals.all();
+    angles.resize(dihedrals.size());
+    compute_angles(dihedrals.data(), dihedrals.size(), angles.data());
+}
+
 template <class DType>
 void Dihedral_Mgr<DType>::delete_dihedrals(const std::set<DType *> &delete_list)
 {
@@ -219,15 +477,17 @@ template <class DType>
 void Dihedral_Mgr<DType>::_delete_dihedrals(const std::set<DType *> &delete_list)
 {
     for (auto d: delete_list) {
-        for (auto a: d->atoms()) {
-            auto &dset = _atom_to_dihedral_map.at(a);
-            dset.erase(d);
-        }
+        for (auto a: d->atoms())
+            _unlink_atom(a, d);
         auto rit = _residue_map.find(d->residue());
         if (rit != _residue_map.end()) {
-            _residue_map.erase(rit);
+            auto &dm = rit->second;
+            dm.erase(std::remove_if(dm.begin(), dm.end(),
+                [d](const Named_Dihedral &nd) { return nd.dihedral == d; }), dm.end());
+            if (dm.empty())
+                _residue_map.erase(rit);
         }
-        delete d;
+        _dihedrals.destroy(d);
     }
 } //delete_dihedrals
 
@@ -237,23 +497,18 @@ void Dihedral_Mgr<DType>::destructors_done(const std::set<void*>& destroyed)
 {
     auto db = DestructionBatcher(this);
     std::set<DType *> to_delete;
-    for (auto a: _mapped_atoms) {
-        if (destroyed.find(static_cast<void*>(a)) != destroyed.end()) {
-            auto &dvec = _atom_to_dihedral_map.at(a);
-            for (auto d: dvec) {
-                to_delete.insert(d);
-            }
-        }
-    }
-    for (auto it = _residue_map.begin(); it != _residue_map.end(); ) {
-        auto r = it->first;
-        if (destroyed.find(static_cast<void *>(r)) != destroyed.end())
-            it = _residue_map.erase(it);
-        else
-            ++it;
-    }
-
+    for_each_destroyed(destroyed, _atom_heads, [&](typename std::unordered_map<Atom*, uint32_t>::iterator it) {
+        for (uint32_t link = it->second; link != NO_LINK; link = _atom_links[link].next)
+            to_delete.insert(_atom_links[link].dihedral);
+    });
     _delete_dihedrals(to_delete);
+    // Any dihedrals of a destroyed residue will have lost their atoms too
+    std::vector<Residue *> dead_residues;
+    for_each_destroyed(destroyed, _residue_map, [&](typename Rmap::iterator it) {
+        dead_residues.push_back(it->first);
+    });
+    for (auto r: dead_residues)
+        _residue_map.erase(r);
 } //destructors_done
 
 template class Dihedral_Mgr<ProperDihedral>;
@@ -14,6 +14,7 @@
 #define ISOLDE_DIHEDRAL_MGR
 
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
 #include <string>
 #include <algorithm>
@@ -27,6 +28,10 @@
 #include <pyinstance/PythonInstance.declare.h>
 
 #include "../geometry/geometry.h"
+#include "../slab_pool.h"
+#include "../thread_pool.h"
+#include "../destruction_index.h"
+#include "../memory_report.h"
 #include "dihedral.h"
 
 using namespace atomstruct;
@@ -42,13 +47,17 @@ template<class DType>
 class Dihedral_Mgr: public DestructionObserver, public pyinstance::PythonInstance<Dihedral_Mgr<DType>>
 {
 public:
-    // Rmap maps residue instance and dihedral name to a dihedral instance
-    typedef std::unordered_map<std::string, DType*> Dmap;
+    // Dihedral names are interned, so each residue just needs a short flat
+    // list of (name ID, dihedral) pairs
+    typedef uint16_t Name_ID;
+    struct Named_Dihedral
+    {
+        Name_ID name_id;
+        DType* dihedral;
+    };
+    typedef std::vector<Named_Dihedral> Dmap;
     typedef std::unordered_map<Residue*, Dmap> Rmap;
 
-    // Atom_Map maps individual atoms to a vector of the dihedral(s) they belong to
-    typedef std::unordered_map<Atom*, std::set<DType *> > Atom_Map;
-
     // Nmap maps residue name and dihedral name to the dihedral definition
     typedef std::pair<std::vector<std::string>, std::vector<bool>> d_def;
     typedef std::unordered_map<std::string, d_def> Amap;
@@ -88,14 +97,27 @@ public:
     DType* new_dihedral(Residue *res, const std::string &dname,
         const std::vector<std::string> &anames, const std::vector<bool> &external,
         const size_t &first_internal_atom);
+    /*! Bulk creation of the named dihedrals for many residues at once.
+     *  Atom names are matched through per-residue-type lookup tables built
+     *  once per call, and the search (which only reads the structure) is
+     *  split across threads. Dihedrals that already exist, or that have no
+     *  definition for a given residue type, are skipped. Returns the number
+     *  of new dihedrals created.
+     */
+    size_t create_dihedrals(Residue **residues, size_t n, const std::vector<std::string> &names);
+
     size_t size() const {return _residue_map.size();}
     size_t bucket_count() const {return _residue_map.bucket_count();}
     void reserve(const size_t &n) {_residue_map.reserve(n);}
 
+    //! Interned ID for a dihedral name, adding it if not already known
+    Name_ID name_id(const std::string &name);
+
 
     void delete_dihedrals(const std::set<DType *> &delete_list);
 
     size_t num_mapped_dihedrals() const;
+    Memory_Usage memory_usage() const;
 
     //! Retrieve a dihedral by residue and name
     /*! If the dihedral is not found and create is false, returns nullptr.
@@ -105,9 +127,16 @@ public:
      *  exists but one or more atoms are missing, returns nullptr.
      */
     DType* get_dihedral(Residue *res, const std::string &name, bool create=true);
+    //! Existing dihedral with the given interned name, or nullptr
+    DType* find_dihedral(Residue *res, Name_ID name_id) const;
 
     //! Get all existing dihedrals belonging to a given residue
     std::vector<DType *> get_dihedrals(Residue *res) const;
+
+    //! Current angles (in radians) for n dihedrals, written contiguously
+    void compute_angles(DType **dihedrals, size_t n, double *angles) const;
+    //! Every dihedral held by the manager, with its current angle
+    void compute_all_angles(std::vector<DType *> &dihedrals, std::vector<double> &angles) const;
     virtual void destructors_done(const std::set<void*>& destroyed);
 private:
     //! Add an existing dihedral to the manager.
@@ -115,10 +144,47 @@ private:
      *  and that you are not over-writing an existing map entry!
      */
     void add_dihedral(DType* d);
+    // Search template for create_dihedrals(): the requested dihedrals for
+    // one residue type, with each internal atom name mapped to a slot
+    struct Bulk_Template
+    {
+        struct Def
+        {
+            Name_ID id;
+            const std::string* name;
+            const d_def* def;
+            size_t first_internal;
+            int slots[4]; // index into internal atoms, or -1 if external
+        };
+        std::vector<Def> defs;
+        std::unordered_map<std::string, size_t> internal_slots;
+    };
+    static const size_t MIN_BULK_CHUNK = 512;
+    static const size_t BULK_BATCH_SIZE = 32768;
+    bool _find_atoms(Residue *res, const typename Bulk_Template::Def &bdef,
+        Atom * const *internal, Atom **found) const;
+
+    Slab_Pool<DType> _dihedrals;
     Rmap _residue_map;
     Nmap _residue_name_map;
-    Atom_Map _atom_to_dihedral_map;
-    std::set<Atom *> _mapped_atoms;
+    std::unordered_map<std::string, Name_ID> _name_ids;
+
+    /* Atom to dihedral index for fast clean-up. Each mapped atom has the
+     * head of a singly-linked list of (dihedral, next) links, all stored in
+     * one flat vector with a free list.
+     */
+    static const uint32_t NO_LINK = UINT32_MAX;
+    struct Atom_Link
+    {
+        DType* dihedral;
+        uint32_t next;
+    };
+    std::unordered_map<Atom*, uint32_t> _atom_heads;
+    std::vector<Atom_Link> _atom_links;
+    std::vector<uint32_t> _free_links;
+    void _link_atom(Atom *a, DType *d);
+    void _unlink_atom(Atom *a, DType *d);
+
     void _delete_dihedrals(const std::set<DType *> &delete_list);
 
 }; //class Dihedral_Mgr;
@@ -114,6 +114,23 @@ proper_dihedral_mgr_new_dihedral(void *mgr, void*residues, size_t n, pyobject_t
    }
 }
 
+extern "C" EXPORT size_t
+proper_dihedral_mgr_create_dihedrals(void *mgr, void *residues, size_t n,
+    pyobject_t *names, size_t n_names)
+{
+   ProperDihedralMgr *m = static_cast<ProperDihedralMgr *>(mgr);
+   Residue **r = static_cast<Residue **>(residues);
+   try {
+       std::vector<std::string> dnames;
+       for (size_t i=0; i<n_names; ++i)
+           dnames.push_back(std::string(PyUnicode_AsUTF8(static_cast<PyObject *>(names[i]))));
+       return m->create_dihedrals(r, n, dnames);
+   } catch (...) {
+       molc_error();
+       return 0;
+   }
+}
+
 
 extern "C" EXPORT PyObject*
 proper_dihedral_mgr_get_dihedrals(void *mgr, void *residues, pyobject_t *name, size_t n, npy_bool create)
@@ -0,0 +1,218 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#include "sim_regions.h"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <stdexcept>
+
+namespace isolde
+{
+namespace sim_regions
+{
+
+namespace
+{
+
+class Region_Builder
+{
+public:
+    Region_Builder(Residue** residues, size_t n, uint8_t* state)
+        : _residues(residues), _n(n), _state(state), _res_state(n, OUTSIDE),
+          _offsets(n+1)
+    {
+        _res_index.reserve(n);
+        _offsets[0] = 0;
+        for (size_t i=0; i<n; ++i)
+        {
+            _res_index[residues[i]] = i;
+            _offsets[i+1] = _offsets[i] + residues[i]->atoms().size();
+        }
+    }
+
+    size_t n_atoms() const { return _offsets[_n]; }
+
+    //! Index of a residue, or -1 if it isn't part of the structure
+    int64_t residue_index(Residue* r) const
+    {
+        auto it = _res_index.find(r);
+        return it == _res_index.end() ? -1 : (int64_t)it->second;
+    }
+
+    uint8_t& residue_state(size_t ri) { return _res_state[ri]; }
+
+    //! Coordinates of every atom in residues currently marked MOBILE
+    void mobile_coords(std::vector<double>& coords) const
+    {
+        coords.clear();
+        for (size_t i=0; i<_n; ++i)
+        {
+            if (_res_state[i] != MOBILE)
+                continue;
+            for (auto a: _residues[i]->atoms())
+            {
+                const auto& c = a->coord();
+                coords.push_back(c[0]);
+                coords.push_back(c[1]);
+                coords.push_back(c[2]);
+            }
+        }
+    }
+
+    void mark_residues_of(const std::vector<Atom*>& atoms, uint8_t new_state)
+    {
+        for (auto a: atoms)
+        {
+            auto ri = residue_index(a->residue());
+            if (ri >= 0 && _res_state[ri] == OUTSIDE)
+                _res_state[ri] = new_state;
+        }
+    }
+
+    //! Copy the residue states out to the per-atom state array
+    void expand_to_atoms()
+    {
+        for (size_t i=0; i<_n; ++i)
+            std::fill(_state+_offsets[i], _state+_offsets[i+1], _res_state[i]);
+    }
+
+    //! Per-atom state, or nullptr for atoms outside the structure
+    uint8_t* atom_state(Atom* a)
+    {
+        auto ri = residue_index(a->residue());
+        if (ri < 0)
+            return nullptr;
+        const auto& ratoms = _residues[ri]->atoms();
+        auto it = std::find(ratoms.begin(), ratoms.end(), a);
+        return _state + _offsets[ri] + (it - ratoms.begin());
+    }
+
+private:
+    Residue** _residues;
+    size_t _n;
+    uint8_t* _state;
+    std::vector<uint8_t> _res_state;
+    std::vector<size_t> _offsets;
+    std::unordered_map<Residue*, size_t> _res_index;
+};
+
+} // anonymous namespace
+
+size_t build(Residue** residues, size_t n_residues, Atom** core, size_t n_core,
+    const Atom_Index& index, double soft_cutoff, double hard_cutoff,
+    Atom** restrained_a, Atom** restrained_b, size_t n_pairs,
+    Residue** excluded, size_t n_excluded,
+    uint8_t* state, int64_t* particle_index)
+{
+    Region_Builder b(residues, n_residues, state);
+    for (size_t i=0; i<n_core; ++i)
+    {
+        auto ri = b.residue_index(core[i]->residue());
+        if (ri < 0)
+            throw std::invalid_argument("Core atoms must all come from the given residues!");
+        b.residue_state(ri) = MOBILE;
+    }
+
+    std::vector<double> coords;
+    std::vector<Atom*> found;
+    b.mobile_coords(coords);
+    index.within(coords.data(), coords.size()/3, soft_cutoff, found);
+    b.mark_residues_of(found, MOBILE);
+
+    b.mobile_coords(coords);
+    found.clear();
+    index.within(coords.data(), coords.size()/3, hard_cutoff, found);
+    b.mark_residues_of(found, FIXED);
+
+    // The far end of a restraint from a mobile atom must be in the simulation,
+    // or it would be free to drift
+    for (size_t i=0; i<n_pairs; ++i)
+    {
+        Atom* pair[2] = {restrained_a[i], restrained_b[i]};
+        int64_t ri[2];
+        for (size_t j=0; j<2; ++j)
+            ri[j] = b.residue_index(pair[j]->residue());
+        for (size_t j=0; j<2; ++j)
+        {
+            auto self = ri[j], other = ri[1-j];
+            if (self < 0 || other < 0)
+                continue;
+            if (b.residue_state(self) == MOBILE && b.residue_state(other) == OUTSIDE)
+                b.residue_state(other) = FIXED;
+        }
+    }
+
+    b.expand_to_atoms();
+
+    // Excluded residues drop out of the simulation. Mobile atoms bonded to them
+    // are fixed, along with their other neighbours and those neighbours'
+    // hydrogens, so nothing is left dangling.
+    std::unordered_set<Residue*> excluded_set(excluded, excluded+n_excluded);
+    std::vector<Atom*> extra_fixed;
+    for (auto r: excluded_set)
+    {
+        auto ri = b.residue_index(r);
+        if (ri < 0 || b.residue_state(ri) == OUTSIDE)
+            continue;
+        for (auto x: r->atoms())
+        {
+            for (auto a: x->neighbors())
+            {
+                auto nri = b.residue_index(a->residue());
+                if (a->residue() == r || nri < 0 || b.residue_state(nri) != MOBILE)
+                    continue;
+                extra_fixed.push_back(a);
+                for (auto na: a->neighbors())
+                {
+                    if (na->residue() == r)
+                        continue;
+                    extra_fixed.push_back(na);
+                    if (na->element().number() != 1)
+                        for (auto nb: na->neighbors())
+                            if (nb->element().number() == 1)
+                                extra_fixed.push_back(nb);
+                }
+            }
+        }
+    }
+    for (auto a: extra_fixed)
+    {
+        auto s = b.atom_state(a);
+        // Neighbours outside the simulation are left out: pulling in part of a
+        // residue would break the OpenMM template match.
+        if (s != nullptr && *s != OUTSIDE)
+            *s = FIXED;
+    }
+    for (auto r: excluded_set)
+    {
+        auto ri = b.residue_index(r);
+        if (ri < 0 || b.residue_state(ri) == OUTSIDE)
+            continue;
+        for (auto a: r->atoms())
+            *b.atom_state(a) = EXCLUDED;
+    }
+
+    size_t n_particles = 0;
+    for (size_t i=0; i<b.n_atoms(); ++i)
+    {
+        if (state[i] == MOBILE || state[i] == FIXED)
+            particle_index[i] = n_particles++;
+        else
+            particle_index[i] = -1;
+    }
+    return n_particles;
+}
+
+} // namespace sim_regions
+} // namespace isolde
@@ -0,0 +1,58 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SIM_REGIONS
+#define ISOLDE_SIM_REGIONS
+
+#include <cstddef>
+#include <cstdint>
+#include <atomstruct/Atom.h>
+#include <atomstruct/Residue.h>
+#include "atom_index.h"
+
+using namespace atomstruct;
+
+namespace isolde
+{
+namespace sim_regions
+{
+
+enum Atom_State: uint8_t { OUTSIDE=0, MOBILE=1, FIXED=2, EXCLUDED=3 };
+
+//! Assign every atom of a structure to the mobile, fixed or excluded part of a simulation
+/*! residues must be all residues of the structure, in simulation order; the
+ *  atoms of each residue in turn define the atom numbering of state and
+ *  particle_index, which must each have room for that many entries.
+ *
+ *  Working on whole residues:
+ *    - the residues of the core atoms are mobile, along with every residue
+ *      with an atom within soft_cutoff of them;
+ *    - any other residue with an atom within hard_cutoff of a mobile atom is
+ *      fixed, as is any other residue restrained to a mobile atom by one of
+ *      the (restrained_a[i], restrained_b[i]) atom pairs.
+ *  Then, for each excluded residue that ended up in the simulation, its atoms
+ *  are marked EXCLUDED and the mobile atoms bonded to it are fixed, along with
+ *  their other bonded neighbours (and those neighbours' hydrogens).
+ *
+ *  particle_index gives each MOBILE or FIXED atom its index in the
+ *  simulation, and -1 for all others. Returns the number of particles.
+ */
+size_t build(Residue** residues, size_t n_residues, Atom** core, size_t n_core,
+    const Atom_Index& index, double soft_cutoff, double hard_cutoff,
+    Atom** restrained_a, Atom** restrained_b, size_t n_pairs,
+    Residue** excluded, size_t n_excluded,
+    uint8_t* state, int64_t* particle_index);
+
+} // namespace sim_regions
+} // namespace isolde
+
+#endif // ISOLDE_SIM_REGIONS
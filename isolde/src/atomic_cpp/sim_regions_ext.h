@@ -0,0 +1,49 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef SIM_REGIONS_EXT
+#define SIM_REGIONS_EXT
+
+#include "sim_regions.h"
+
+#include "../molc.h"
+using namespace atomstruct;
+using namespace isolde;
+
+/*************************************
+ *
+ * Simulation region construction
+ *
+ *************************************/
+
+extern "C" EXPORT size_t
+sim_regions_build(void *residues, size_t n_residues, void *core, size_t n_core,
+    void *index, double soft_cutoff, double hard_cutoff, void *restrained_a,
+    void *restrained_b, size_t n_pairs, void *excluded, size_t n_excluded, uint8_t *state,
+    int64_t *particle_index)
+{
+    Residue **r = static_cast<Residue **>(residues);
+    Atom **c = static_cast<Atom **>(core);
+    Atom_Index *idx = static_cast<Atom_Index *>(index);
+    Atom **ra = static_cast<Atom **>(restrained_a);
+    Atom **rb = static_cast<Atom **>(restrained_b);
+    Residue **x = static_cast<Residue **>(excluded);
+    try {
+        return sim_regions::build(r, n_residues, c, n_core, *idx, soft_cutoff,
+            hard_cutoff, ra, rb, n_pairs, x, n_excluded, state, particle_index);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+#endif // SIM_REGIONS_EXT
@@ -0,0 +1,159 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#define PYINSTANCE_EXPORT
+
+#include "symmetry_contacts.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include "../thread_pool.h"
+#include <pyinstance/PythonInstance.instantiate.h>
+
+template class pyinstance::PythonInstance<isolde::Symmetry_Contacts>;
+
+namespace isolde
+{
+
+static bool is_identity(const double *tf)
+{
+    static const double IDENTITY[12] = {1,0,0,0, 0,1,0,0, 0,0,1,0};
+    for (size_t i=0; i<12; ++i)
+        if (std::abs(tf[i]-IDENTITY[i]) > 1e-6)
+            return false;
+    return true;
+}
+
+Symmetry_Contacts::Symmetry_Contacts(Atom** atoms, size_t n, const double *operators,
+    size_t n_ops, double cell_size)
+    : _grid(cell_size)
+{
+    for (size_t i=0; i<n_ops; ++i)
+    {
+        const double *tf = operators + 12*i;
+        if (is_identity(tf))
+            continue;
+        _ops.insert(_ops.end(), tf, tf+12);
+        _op_index.push_back(i);
+    }
+    _atoms.reserve(n);
+    _index.reserve(n);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto a = atoms[i];
+        if (_index.find(a) != _index.end())
+            continue;
+        _index[a] = _atoms.size();
+        _atoms.push_back(a);
+    }
+    if ((uint64_t)_atoms.size()*num_operators() > std::numeric_limits<uint32_t>::max())
+        throw std::logic_error("Too many symmetry mates!");
+    _mate_coords.resize(3*_atoms.size()*num_operators());
+    for (uint32_t i=0; i<_atoms.size(); ++i)
+        _place_mates(i, true);
+    _live = _atoms.size();
+}
+
+void Symmetry_Contacts::_place_mates(uint32_t atom, bool insert)
+{
+    const auto& c = _atoms[atom]->coord();
+    size_t n_ops = num_operators();
+    for (size_t o=0; o<n_ops; ++o)
+    {
+        const double *tf = _ops.data() + 12*o;
+        uint32_t id = atom*n_ops + o;
+        double *xyz = _mate_coords.data() + 3*id;
+        for (size_t j=0; j<3; ++j)
+            xyz[j] = tf[4*j]*c[0] + tf[4*j+1]*c[1] + tf[4*j+2]*c[2] + tf[4*j+3];
+        if (insert)
+            _grid.insert(id, xyz);
+        else
+            _grid.move(id, xyz);
+    }
+}
+
+void Symmetry_Contacts::update(Atom** atoms, size_t n)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        auto it = _index.find(atoms[i]);
+        if (it == _index.end())
+            continue;
+        _place_mates(it->second, false);
+    }
+}
+
+void Symmetry_Contacts::update()
+{
+    for (uint32_t i=0; i<_atoms.size(); ++i)
+        if (_atoms[i] != nullptr)
+            _place_mates(i, false);
+}
+
+void Symmetry_Contacts::contacts(Atom** query, size_t n, double cutoff,
+    std::vector<Atom*>& atoms, std::vector<int32_t>& ops, std::vector<double>& coords) const
+{
+    const double r2 = cutoff*cutoff;
+    std::vector<uint32_t> ids;
+    std::mutex merge_mutex;
+    Thread_Pool::instance().parallel_chunks(n, MIN_QUERY_CHUNK, [&](size_t start, size_t end) {
+        std::vector<uint32_t> local;
+        for (size_t i=start; i<end; ++i)
+        {
+            const auto& q = query[i]->coord();
+            double xyz[3] = {q[0], q[1], q[2]};
+            _grid.for_each_in_box(xyz, cutoff, [&](uint32_t id) {
+                const double *p = _mate_coords.data()+3*id;
+                double d2 = 0;
+                for (size_t j=0; j<3; ++j)
+                {
+                    double d = p[j]-xyz[j];
+                    d2 += d*d;
+                }
+                if (d2 <= r2)
+                    local.push_back(id);
+            });
+        }
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        ids.insert(ids.end(), local.begin(), local.end());
+    });
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    size_t n_ops = num_operators();
+    for (auto id: ids)
+    {
+        atoms.push_back(_atoms[id/n_ops]);
+        ops.push_back(_op_index[id%n_ops]);
+        const double *p = _mate_coords.data()+3*id;
+        coords.insert(coords.end(), p, p+3);
+    }
+}
+
+void Symmetry_Contacts::destructors_done(const std::set<void*>& destroyed)
+{
+    size_t n_ops = num_operators();
+    for (auto ptr: destroyed)
+    {
+        auto it = _index.find(static_cast<Atom*>(ptr));
+        if (it == _index.end())
+            continue;
+        for (size_t o=0; o<n_ops; ++o)
+            _grid.remove(it->second*n_ops + o);
+        _atoms[it->second] = nullptr;
+        _index.erase(it);
+        --_live;
+    }
+}
+
+} // namespace isolde
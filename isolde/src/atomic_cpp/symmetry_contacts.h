@@ -0,0 +1,82 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SYMMETRY_CONTACTS
+#define ISOLDE_SYMMETRY_CONTACTS
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <cstdint>
+
+#include <atomstruct/destruct.h>
+#include <atomstruct/Atom.h>
+#include <pyinstance/PythonInstance.declare.h>
+
+#include "atom_index.h"
+
+using namespace atomstruct;
+
+namespace isolde
+{
+
+//! Cell-list index over the symmetry mates of a set of atoms
+/*! Each (atom, operator) pair is a mate, placed at the operator (a 3x4
+ *  transform acting on the atoms' own coordinates) applied to the atom.
+ *  Identity operators are dropped, so the atoms never find themselves. The
+ *  mates live in a Cell_Grid, so when atoms move only their own mates are
+ *  re-binned. Deleted atoms are dropped automatically.
+ */
+class Symmetry_Contacts: public DestructionObserver, public pyinstance::PythonInstance<Symmetry_Contacts>
+{
+public:
+    Symmetry_Contacts() {} // null constructor
+    Symmetry_Contacts(Atom** atoms, size_t n, const double *operators, size_t n_ops,
+        double cell_size);
+    ~Symmetry_Contacts() { auto du = DestructionUser(this); }
+
+    //! Number of live atoms
+    size_t size() const { return _live; }
+    //! Number of (non-identity) operators in use
+    size_t num_operators() const { return _op_index.size(); }
+
+    //! Re-read the coordinates of the given atoms. Atoms not in the set are ignored.
+    void update(Atom** atoms, size_t n);
+    //! Re-read the coordinates of every atom
+    void update();
+
+    //! Mates within cutoff of any of the query atoms (in their current positions)
+    /*! Each mate is reported once: the atom, the index of its operator in
+     *  the list given to the constructor, and its coordinates.
+     */
+    void contacts(Atom** query, size_t n, double cutoff, std::vector<Atom*>& atoms,
+        std::vector<int32_t>& ops, std::vector<double>& coords) const;
+
+    virtual void destructors_done(const std::set<void*>& destroyed);
+
+private:
+    std::vector<Atom*> _atoms; // nullptr once deleted
+    std::unordered_map<Atom*, uint32_t> _index;
+    std::vector<double> _ops; // 12 per operator in use
+    std::vector<int32_t> _op_index; // position of each in the original list
+    std::vector<double> _mate_coords; // 3 per mate; mate id = atom*num_operators() + op
+    Cell_Grid _grid;
+    size_t _live = 0;
+
+    static const size_t MIN_QUERY_CHUNK = 256;
+
+    void _place_mates(uint32_t atom, bool insert);
+}; // class Symmetry_Contacts
+
+} // namespace isolde
+
+#endif // ISOLDE_SYMMETRY_CONTACTS
@@ -0,0 +1,134 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef SYMMETRY_CONTACTS_EXT
+#define SYMMETRY_CONTACTS_EXT
+
+#include "symmetry_contacts.h"
+
+#include "../molc.h"
+using namespace atomstruct;
+using namespace isolde;
+
+/*************************************
+ *
+ * Symmetry_Contacts functions
+ *
+ *************************************/
+
+SET_PYTHON_INSTANCE(symmetry_contacts, Symmetry_Contacts)
+GET_PYTHON_INSTANCES(symmetry_contacts, Symmetry_Contacts)
+
+extern "C" EXPORT void*
+symmetry_contacts_new(void *atoms, size_t n, double *operators, size_t n_ops,
+    double cell_size)
+{
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        return new Symmetry_Contacts(a, n, operators, n_ops, cell_size);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
+extern "C" EXPORT void
+symmetry_contacts_delete(void *contacts)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    try {
+        delete sc;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+symmetry_contacts_size(void *contacts)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    try {
+        return sc->size();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT size_t
+symmetry_contacts_num_operators(void *contacts)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    try {
+        return sc->num_operators();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+symmetry_contacts_update(void *contacts, void *atoms, size_t n)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        sc->update(a, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+symmetry_contacts_update_all(void *contacts)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    try {
+        sc->update();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! Returns a tuple of (atoms, operator indices, flattened mate coordinates)
+extern "C" EXPORT PyObject*
+symmetry_contacts_find(void *contacts, void *query, size_t n, double cutoff)
+{
+    Symmetry_Contacts *sc = static_cast<Symmetry_Contacts *>(contacts);
+    Atom **q = static_cast<Atom **>(query);
+    PyObject* ret = PyTuple_New(3);
+    try {
+        std::vector<Atom *> atoms;
+        std::vector<int32_t> ops;
+        std::vector<double> coords;
+        sc->contacts(q, n, cutoff, atoms, ops, coords);
+        void **aptrs;
+        PyObject *atom_array = python_voidp_array(atoms.size(), &aptrs);
+        std::copy(atoms.begin(), atoms.end(), aptrs);
+        int *optr;
+        PyObject *op_array = python_int_array(ops.size(), &optr);
+        std::copy(ops.begin(), ops.end(), optr);
+        double *cptr;
+        PyObject *coord_array = python_double_array(coords.size(), &cptr);
+        std::copy(coords.begin(), coords.end(), cptr);
+        PyTuple_SET_ITEM(ret, 0, atom_array);
+        PyTuple_SET_ITEM(ret, 1, op_array);
+        PyTuple_SET_ITEM(ret, 2, coord_array);
+        return ret;
+    } catch (...) {
+        Py_XDECREF(ret);
+        molc_error();
+        return 0;
+    }
+}
+
+#endif // SYMMETRY_CONTACTS_EXT
@@ -2,19 +2,23 @@
 # @Date:   18-Apr-2018
 # @Email:  tic20@cam.ac.uk
 # @Last modified by:   tic20
-# @Last modified time: 02-Jan-2020
+# @Last modified time: 14-Oct-2026
 # @License: Free for non-commercial use (see license.pdf)
 # @Copyright:2016-2019 Tristan Croll
 
 
 
+import ctypes
+import numpy
+from .molobject import c_function, pointer
+
 class CheckPoint:
     '''
     Stores all the necessary information (atom positions, restraint
     parameters etc.) to revert a running simulation and the master
     molecule in ChimeraX back to a given state.
     '''
-    def __init__(self, isolde):
+    def __init__(self, isolde, store=None):
         '''
         Save a snapshot of ISOLDE's currently running simulation. Raises a
         :class:`TypeError` if no simulation is running. The :class:`CheckPoint`
@@ -24,6 +28,9 @@ class CheckPoint:
         Args:
             * isolde
                 - the top-level :class:`Isolde` instance
+            * store
+                - optional :class:`CheckpointStore` to keep the coordinates
+                  in. Normally this is done by :func:`CheckpointStore.save`.
         '''
         if not isolde.simulation_running:
             raise TypeError('Checkpointing is only available when a '\
@@ -41,7 +48,42 @@ class CheckPoint:
             if isinstance(rm, _RestraintMgr):
                 self._restraint_data.append(rm.save_checkpoint(atoms))
 
-        self.saved_coords = sc.all_atoms.coords
+        self._store = store
+        self._discarded = False
+        if store is None:
+            self._saved_coords = sc.all_atoms.coords
+        else:
+            store._push(self, sc.all_atoms.coords)
+
+    @property
+    def saved_coords(self):
+        '''
+        Coordinates of all atoms in the simulation construct at the time the
+        checkpoint was saved.
+        '''
+        self._check_not_discarded()
+        if self._store is None:
+            return self._saved_coords
+        return self._store._coords(self)
+
+    @property
+    def discarded(self):
+        '''
+        True once the :class:`CheckpointStore` holding this checkpoint has
+        dropped it (to stay within its level limit, or on reverting to an
+        earlier one). A discarded checkpoint can no longer be reverted to.
+        '''
+        return self._discarded
+
+    def _discard(self):
+        self._discarded = True
+        self._store = None
+        self._saved_coords = None
+
+    def _check_not_discarded(self):
+        if self._discarded:
+            raise TypeError('This checkpoint has been dropped from its '\
+                +'checkpoint store and is no longer valid!')
 
 
     def revert(self):
@@ -49,8 +91,10 @@ class CheckPoint:
         Revert the master construct and simulation (if applicable) to
         the saved checkpoint state. Can be called after the simulation the
         :class:`CheckPoint` was created in is stopped, but will raise a
-        :class:`TypeError` if called after a new simulation is started.
+        :class:`TypeError` if called after a new simulation is started, or
+        once its :class:`CheckpointStore` has dropped it.
         '''
+        self._check_not_discarded()
         sm = self.isolde.sim_manager
         if sm is not None and sm != self.sim_manager:
             raise TypeError('A new simulation has been started since '\
@@ -60,6 +104,162 @@ class CheckPoint:
         for rm, data in self._restraint_data:
             rm.restore_checkpoint(data)
 
-        self.sim_construct.all_atoms.coords = self.saved_coords
+        coords = self.saved_coords
+        self.sim_construct.all_atoms.coords = coords
         if sm is not None and sm.sim_running:
-            sm.sim_handler.push_coords_to_sim(self.saved_coords)
+            sm.sim_handler.push_coords_to_sim(coords)
+
+
+class CheckpointStore:
+    '''
+    Multi-level checkpoint history for one simulation, for cheap undo. The
+    coordinates are held in C++: the first checkpoint in full, and each later
+    one as float32 differences from the one before, covering only the atoms
+    that moved (so the fixed atoms in a simulation cost almost nothing).
+    Restraint states that are unchanged from the previous checkpoint share
+    its arrays rather than being copied again.
+
+    Once more than :attr:`max_levels` checkpoints are held the second-oldest
+    is dropped, so the first (the start of the simulation) is always kept.
+    '''
+    def __init__(self, isolde, max_levels):
+        '''
+        Args:
+            * isolde
+                - the top-level :class:`Isolde` instance, with a simulation
+                  running
+            * max_levels
+                - maximum number of checkpoints to keep (at least 2)
+        '''
+        self.isolde = isolde
+        n = len(isolde.sim_manager.sim_construct.all_atoms)
+        f = c_function('checkpoint_store_new',
+            args=(ctypes.c_size_t, ctypes.c_size_t, ctypes.c_bool),
+            ret=ctypes.c_void_p)
+        self._c_pointer = ctypes.c_void_p(f(n, max_levels, False))
+        self._n = n
+        self._checkpoints = []
+
+    def __del__(self):
+        if getattr(self, '_c_pointer', None) is not None:
+            c_function('checkpoint_store_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+            self._c_pointer = None
+
+    def __len__(self):
+        return len(self._checkpoints)
+
+    def __getitem__(self, i):
+        return self._checkpoints[i]
+
+    @property
+    def max_levels(self):
+        '''
+        Maximum number of checkpoints kept. Can be set (minimum 2).
+        '''
+        f = c_function('checkpoint_store_max_levels', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @max_levels.setter
+    def max_levels(self, n):
+        f = c_function('set_checkpoint_store_max_levels',
+            args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, n)
+        self._sync()
+
+    @property
+    def memory_bytes(self):
+        '''
+        Approximate memory used by the stored coordinates, in bytes.
+        '''
+        f = c_function('checkpoint_store_memory_bytes', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def save(self):
+        '''
+        Save a new :class:`CheckPoint` of the running simulation and return
+        it.
+        '''
+        return CheckPoint(self.isolde, store=self)
+
+    def revert(self, levels_back=0):
+        '''
+        Revert to a saved checkpoint, discarding all those saved after it.
+
+        Args:
+            * levels_back
+                - 0 reverts to the most recent checkpoint, 1 to the one
+                  before, etc. Going back past the first checkpoint stops at
+                  the first.
+
+        Returns the :class:`CheckPoint` reverted to.
+        '''
+        i = max(len(self._checkpoints)-1-levels_back, 0)
+        cp = self._checkpoints[i]
+        cp.revert()
+        self._truncate(i+1)
+        return cp
+
+    def _push(self, checkpoint, coords):
+        f = c_function('checkpoint_store_push',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.c_void_p))
+        coords = numpy.ascontiguousarray(coords, numpy.double)
+        if coords.shape != (self._n, 3):
+            raise TypeError('Wrong number of coordinates for this checkpoint store!')
+        f(self._c_pointer, pointer(coords), None)
+        if self._checkpoints:
+            _share_unchanged_restraint_data(checkpoint, self._checkpoints[-1])
+        self._checkpoints.append(checkpoint)
+        self._sync()
+
+    def _sync(self):
+        f = c_function('checkpoint_store_size', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        n = f(self._c_pointer)
+        # The C++ store drops the second-oldest checkpoint each time it is
+        # over its limit
+        while len(self._checkpoints) > n:
+            self._checkpoints.pop(1)._discard()
+
+    def _truncate(self, n):
+        f = c_function('checkpoint_store_truncate', args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, n)
+        for cp in self._checkpoints[n:]:
+            cp._discard()
+        del self._checkpoints[n:]
+
+    def _coords(self, checkpoint):
+        try:
+            i = self._checkpoints.index(checkpoint)
+        except ValueError:
+            raise TypeError('This checkpoint is no longer in the history!')
+        f = c_function('checkpoint_store_get',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double),
+                ctypes.c_void_p))
+        coords = numpy.empty((self._n, 3), numpy.double)
+        f(self._c_pointer, i, pointer(coords), None)
+        return coords
+
+
+def _share_unchanged_restraint_data(checkpoint, previous):
+    '''
+    Where a restraint manager's saved state is identical to that in the
+    previous checkpoint, point to the previous arrays instead of keeping a
+    second copy. Saved arrays are never modified in place, so this is safe.
+    '''
+    prev = {id(rm): data for rm, data in previous._restraint_data}
+    for rm, data in checkpoint._restraint_data:
+        pdata = prev.get(id(rm), None)
+        if pdata is None:
+            continue
+        for key, val in data.items():
+            pval = pdata.get(key, None)
+            if pval is None or pval is val:
+                continue
+            if isinstance(val, numpy.ndarray):
+                if isinstance(pval, numpy.ndarray) and numpy.array_equal(val, pval):
+                    data[key] = pval
+            elif hasattr(val, '_pointers') and hasattr(pval, '_pointers'):
+                if numpy.array_equal(val._pointers, pval._pointers):
+                    data[key] = pval
@@ -109,16 +109,40 @@ def isolde_sim(session, cmd, atoms=None, discard_to=None):
         else:
             isolde.discard_sim(revert_to=discard_to, warn=False)
 
-def isolde_report(session, report=True, interval=20):
+def isolde_report(session, report=True, interval=20, stages=False):
     isolde = isolde_start(session)
     if not isolde.simulation_running:
         raise UserError('This command is only valid when a simulation is running!')
     sm = isolde.sim_manager
     if report:
-        sm.start_reporting_performance(report_interval)
+        sm.start_reporting_performance(interval, stages=stages)
     else:
         sm.stop_reporting_performance()
 
+def isolde_memory(session):
+    from .molobject import memory_usage
+    usage = memory_usage(session)
+    if not usage:
+        session.logger.info('ISOLDE: no managers are currently active.')
+        return
+    def mb(nbytes):
+        return '{:.2f}'.format(nbytes/2**20)
+    rows = ['<tr><th>Manager</th><th>Objects</th><th>Containers (MB)</th>'
+        '<th>Buffers (MB)</th><th>Mapped (MB)</th></tr>']
+    totals = [0, 0, 0, 0]
+    for name, kind, *counts in usage:
+        totals = [t+c for t, c in zip(totals, counts)]
+        objects, container, buffer, mapped = counts
+        rows.append('<tr><td>{}</td><td align="right">{}</td><td align="right">{}</td>'
+            '<td align="right">{}</td><td align="right">{}</td></tr>'.format(
+            name, objects, mb(container), mb(buffer), mb(mapped)))
+    rows.append('<tr><th>Total</th><td></td><th align="right">{}</th>'
+        '<th align="right">{}</th><th align="right">{}</th></tr>'.format(
+        *[mb(t) for t in totals[1:]]))
+    session.logger.info('<table border="1" cellpadding="2">{}</table>'.format(''.join(rows)),
+        is_html=True)
+    return usage
+
 def isolde_ignore(session, residues=None, ignore=True):
     isolde_start(session)
     if session.isolde.simulation_running:
@@ -213,11 +237,17 @@ def register_isolde(logger):
     def register_isolde_report():
         desc = CmdDesc(
             optional=[('report', BoolArg),],
-            keyword=[('interval', IntArg)],
+            keyword=[('interval', IntArg), ('stages', BoolArg)],
             synopsis='Report the current simulation performance to the status bar'
         )
         register ('isolde report', desc, isolde_report, logger=logger)
 
+    def register_isolde_memory():
+        desc = CmdDesc(
+            synopsis='Report the approximate memory used by ISOLDE\'s C++ managers'
+        )
+        register('isolde memory', desc, isolde_memory, logger=logger)
+
     def register_isolde_ignore():
         desc = CmdDesc(
             optional=[('residues', ResiduesArg),],
@@ -254,6 +284,7 @@ def register_isolde(logger):
     register_isolde_set()
     register_isolde_sim()
     register_isolde_report()
+    register_isolde_memory()
     register_isolde_ignore()
     register_isolde_stop_ignore()
     register_isolde_tutorial()
@@ -3,7 +3,7 @@
  * @Date:   18-Apr-2018
  * @Email:  tic20@cam.ac.uk
  * @Last modified by:   tic20
- * @Last modified time: 02-Apr-2019
+ * @Last modified time: 14-Oct-2026
  * @License: Free for non-commercial use (see license.pdf)
  * @Copyright:2016-2019 Tristan Croll
  */
@@ -17,7 +17,10 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <stdexcept>
 #include <iostream>
+#include <cmath>
+#include <limits>
 
 namespace isolde
 {
@@ -87,6 +90,7 @@ public:
             _colors.push_back(thiscolor);
         }
         _num_colors = n;
+        _build_ramps();
     }
     const std::vector<std::array<double, 4>>& mapped_colors() const { return _colors; }
 
@@ -112,9 +116,51 @@ public:
             interpolate_colors(_colors[i-1], _colors[i], cutoffs[i-1], cutoffs[i], value, rgba);
         }
     }
+
+    //! As interpolate(), but straight to RGBA8 from precomputed ramps
+    void interpolate(double value, const double *cutoffs, uint8_t *rgba) const
+    {
+        const uint8_t *c;
+        if (!(value > cutoffs[0]))
+            c = _ramps.data();
+        else if (value >= cutoffs[_num_colors-1])
+            c = _ramps.data() + _ramps.size() - 4;
+        else {
+            size_t i=1;
+            while (value >= cutoffs[i])
+                i++;
+            // cutoffs[i-1] <= value < cutoffs[i], so no divide-by-zero
+            double f = (value-cutoffs[i-1])/(cutoffs[i]-cutoffs[i-1]);
+            c = _ramps.data() + ((i-1)*RAMP_SIZE + (size_t)(f*(RAMP_SIZE-1)+0.5))*4;
+        }
+        std::copy(c, c+4, rgba);
+    }
 private:
+    //! Entries per colour-to-colour ramp
+    static const size_t RAMP_SIZE = 256;
     std::vector<std::array<double, 4>> _colors;
     size_t _num_colors;
+    // (_num_colors-1) ramps of RAMP_SIZE RGBA8 entries
+    std::vector<uint8_t> _ramps;
+
+    void _build_ramps()
+    {
+        size_t n_ramps = std::max<size_t>(_num_colors, 2) - 1;
+        _ramps.resize(n_ramps*RAMP_SIZE*4);
+        auto out = _ramps.data();
+        for (size_t i=0; i<n_ramps; ++i)
+        {
+            const auto &lo = _colors[i];
+            const auto &hi = _colors[std::min(i+1, _num_colors-1)];
+            color c;
+            for (size_t j=0; j<RAMP_SIZE; ++j)
+            {
+                interpolate_colors(lo, hi, 0.0, (double)(RAMP_SIZE-1), (double)j, c);
+                for (size_t k=0; k<4; ++k)
+                    *out++ = (uint8_t)(c[k]*255.0);
+            }
+        }
+    }
 };
 
 
@@ -213,6 +259,99 @@ public:
     }
 };
 
+//! Default number of entries sampled by a colormap_lut
+static const size_t DEFAULT_LUT_SIZE = 1024;
+
+/*! Precomputed RGBA8 samples of a colormap over its mapped range, for
+ *  colouring large numbers of objects every frame. A lookup is one multiply
+ *  and a clamp rather than a search and four interpolations. Colours are
+ *  only ever displayed as uint8, so with 1024 samples over the range the
+ *  result differs from colormap::interpolate() by at most one step of the
+ *  nearest sample. Values below/above the mapped range (and NaN, which is
+ *  treated as below) take the colormap's out-of-range colours.
+ */
+class colormap_lut
+{
+public:
+    colormap_lut() {}
+    colormap_lut(colormap &cmap, size_t n=DEFAULT_LUT_SIZE)
+        : _n(std::max<size_t>(n, 2))
+    {
+        const auto &mapped = cmap.mapped_colors();
+        if (mapped.empty())
+            throw std::invalid_argument("Can't make a lookup table from an empty colormap!");
+        _min = mapped.front().val;
+        _max = mapped.back().val;
+        _scale = (_max > _min) ? (_n-1)/(_max-_min) : 0.0;
+        // Entry 0 is below the range, entry _n+1 above it. The first and
+        // last samples are exactly the end colours (colormap::interpolate()
+        // needs its argument strictly inside the mapped range).
+        std::vector<std::array<double, 4>> rgba(_n+2);
+        double below = -std::numeric_limits<double>::infinity();
+        double above = std::numeric_limits<double>::infinity();
+        cmap.interpolate(below, *reinterpret_cast<color*>(rgba[0].data()));
+        cmap.interpolate(above, *reinterpret_cast<color*>(rgba[_n+1].data()));
+        for (size_t i=0; i<_n; ++i)
+        {
+            auto &c = *reinterpret_cast<color*>(rgba[i+1].data());
+            double v = _min + i/_scale;
+            if (_scale == 0 || i == 0)
+                copy_color(mapped.front().thecolor, c);
+            else if (i == _n-1 || !(v < _max))
+                copy_color(mapped.back().thecolor, c);
+            else
+                cmap.interpolate(v, c);
+        }
+        _table.resize((_n+2)*4);
+        auto out = _table.data();
+        for (const auto &c: rgba)
+            for (size_t k=0; k<4; ++k)
+                *out++ = (uint8_t)(c[k]*255.0);
+    }
+
+    size_t size() const { return _n; }
+    bool empty() const { return _table.empty(); }
+
+    const uint8_t* lookup(double value) const
+    {
+        size_t i;
+        if (!(value >= _min))
+            i = 0;
+        else if (value > _max)
+            i = _n+1;
+        else
+            i = (size_t)((value-_min)*_scale + 0.5) + 1;
+        return _table.data() + i*4;
+    }
+
+    void lookup(double value, uint8_t *rgba) const
+    {
+        auto c = lookup(value);
+        std::copy(c, c+4, rgba);
+    }
+
+    //! Colour n values into n*4 bytes of out
+    void apply(const double *values, size_t n, uint8_t *out) const
+    {
+        for (size_t i=0; i<n; ++i, out+=4)
+            lookup(values[i], out);
+    }
+
+    //! For a table built over log values: colour the logs of n values
+    void apply_log(const double *values, size_t n, uint8_t *out) const
+    {
+        for (size_t i=0; i<n; ++i, out+=4)
+            lookup(log(values[i]), out);
+    }
+
+private:
+    size_t _n = 0;
+    double _min = 0;
+    double _max = 0;
+    double _scale = 0;
+    std::vector<uint8_t> _table;
+};
+
 
 } //namespace colors
 } //namespace isolde
@@ -71,6 +71,10 @@ class _Defaults:
         'OPENMM_CONSTRAINT_TOL':      1e-5,
         'OPENMM_FIXED_INTEGRATOR_TS': 0.001, #* unit.picoseconds,
         'SIM_STEPS_PER_GUI_UPDATE':   50,
+        'CONTINUOUS_EQUILIBRATION':   True,
+        'INSTABILITY_CHECK_MIN_INTERVAL': 10,
+        'INSTABILITY_CHECK_MAX_INTERVAL': 50,
+        'INSTABILITY_CHECK_BY_DISPLACEMENT': False,
         'SIM_STARTUP_ROUNDS':         10,
         'MAX_UNSTABLE_ROUNDS':        20,
         'TEMPERATURE':                100.0, # * unit.kelvin,
@@ -88,6 +92,11 @@ class _Defaults:
         'MIN_CONVERGENCE_TOL_START':  1e-5, # * kJ mol-1 atom-1
         'MIN_CONVERGENCE_TOL_END':    1e-5, # * kJ mol-1 atom-1
         'MAX_MIN_ITERATIONS':         1000,
+        'MINIMIZER_PRECISION':        'double', # 'double', 'single' or 'auto'
+        'CLASH_PRESCREEN':            True,
+        'CLASH_PRESCREEN_DISTANCE':   0.2, # *unit.nanometer
+        'CONFORMATION_BIAS':          False, # Add the Rama/rotamer grid bias force to the System
+        'CONFORMATION_BIAS_INTERVAL': 10, # max steps between re-evaluations of the bias
         'SIM_TIMEOUT':                120.0, # seconds
         'TARGET_LOOP_PERIOD':         0.1, # seconds
         'HYDROGENS_FEEL_MAPS':        True,
@@ -95,6 +104,22 @@ class _Defaults:
         'RESTRAIN_PEPTIDE_OMEGA':     True,
         'DISPLAY_OMEGA_RESTRAINTS':   False,
         'MAX_CUBIC_MAP_SIZE':         5e6, # Switch to linear interpolation above this size
+        'MDFF_CROP_PADDING':          10.0, # Angstroms around mobile atoms. 0 disables map cropping
+        'MDFF_COARSE_STEP':           1, # Grid step for a coarse first-pass MDFF map (1 = full resolution)
+        'CACHE_SIM_CONTEXTS':         True, # Keep the last OpenMM context for reuse on restart
+        'SIM_CACHE_MAX_OVERSIZE':     1.5, # Max ratio of cached to needed simulation atoms for reuse
+        'SYSTEM_DISK_CACHE':          True, # Save parameterised Systems to disk for reuse between sessions
+        'SYSTEM_DISK_CACHE_MAX_ENTRIES': 8, # Oldest cached Systems beyond this number are deleted
+        'SPARSE_RESTRAINT_FORCES':    True, # Leave large batches of disabled restraints out of the restraint forces
+        'SPARSE_RESTRAINT_MIN_WITHHELD': 1000, # Smallest number of disabled restraints worth leaving out
+        'SPARSE_RESTRAINT_REBUILD_FRACTION': 0.5, # Compact a restraint force when more than this fraction of its entries are disabled
+        'ADAPTIVE_DISTANCE_FORCES_FROM_SIM': True, # Draw adaptive distance restraints using forces evaluated on the simulation thread
+        'CHECKPOINT_HISTORY_LENGTH':  20, # Checkpoints kept for undo in each simulation (including the start)
+        'ADAPTIVE_PACING':            False, # Size continuous-mode step chunks from measured step time and display rate
+        'PACING_TARGET_LATENCY':      50.0, # ms. Upper limit on the time between coordinate updates with adaptive pacing
+        'PACING_MIN_STEPS_PER_UPDATE': 5,
+        'PACING_MAX_STEPS_PER_UPDATE': 500, # Beyond this the simulation thread sleeps out the rest of each update
+        'BACKGROUND_VALIDATION':      True, # Validate the mobile residues on a background thread against published coordinate snapshots
 
 
         ###
@@ -111,6 +136,7 @@ class _Defaults:
         'PHI_PSI_SPRING_CONSTANT':                250.0, # * unit.kilojoule_per_mole/unit.radians**2,
         'ROTAMER_SPRING_CONSTANT':                500.0, # * unit.kilojoule_per_mole/unit.radians**2,
         'STANDARD_MAP_MDFF_BASE_CONSTANT':            1, # * kJ/mol per map unit,
+        'CONFORMATION_BIAS_STRENGTH':            5.0, # * kJ/mol per unit ln(P),
         #'DIFFERENCE_MAP_K':                         0.5, # * kJ/mol per map unit,
 
         ###
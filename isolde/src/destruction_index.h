@@ -0,0 +1,101 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_DESTRUCTION_INDEX
+#define ISOLDE_DESTRUCTION_INDEX
+
+#include <cstddef>
+#include <set>
+#include <unordered_map>
+#include "memory_report.h"
+
+/*
+ * Helpers for DestructionObserver::destructors_done(). The naive approach of
+ * looping over every managed object and searching the destroyed set costs
+ * O(objects * log(destroyed)) in every manager, every time anything in the
+ * session is deleted. These instead walk whichever side is smaller, so that
+ * deleting a few atoms from a huge model (or a whole unrelated model) stays
+ * cheap for all the managers not involved.
+ */
+
+namespace isolde
+{
+
+/*! Call f(it) for every entry in map whose key is in destroyed. map must be
+ *  a hash map keyed on pointers. f must not modify map.
+ */
+template <typename Map, typename F>
+void for_each_destroyed(const std::set<void*>& destroyed, Map& map, F f)
+{
+    typedef typename Map::key_type Key;
+    if (destroyed.size() < map.size()) {
+        for (auto ptr: destroyed) {
+            auto it = map.find(static_cast<Key>(ptr));
+            if (it != map.end())
+                f(it);
+        }
+    } else {
+        for (auto it = map.begin(); it != map.end(); ++it) {
+            if (destroyed.find(const_cast<void*>(static_cast<const void*>(it->first))) != destroyed.end())
+                f(it);
+        }
+    }
+}
+
+/*! Inverse index from the objects a managed object depends on (atoms,
+ *  dihedrals, ...) to the managed object itself, for managers whose objects
+ *  must be deleted when any of several other objects are.
+ */
+template <typename T>
+class Destruction_Index
+{
+public:
+    void add(const void* key, T* obj) { _index.emplace(const_cast<void*>(key), obj); }
+    //! Remove a single (key, obj) entry, if present
+    void remove(const void* key, T* obj)
+    {
+        auto range = _index.equal_range(const_cast<void*>(key));
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == obj) {
+                _index.erase(it);
+                return;
+            }
+        }
+    }
+    void clear() { _index.clear(); }
+    size_t size() const { return _index.size(); }
+    size_t container_bytes() const { return memory::hash_bytes(_index); }
+
+    //! Add to out every object depending on anything in destroyed
+    void find_dependents(const std::set<void*>& destroyed, std::set<T*>& out) const
+    {
+        if (destroyed.size() < _index.size()) {
+            for (auto ptr: destroyed) {
+                auto range = _index.equal_range(ptr);
+                for (auto it = range.first; it != range.second; ++it)
+                    out.insert(it->second);
+            }
+        } else {
+            for (const auto& it: _index) {
+                if (destroyed.find(it.first) != destroyed.end())
+                    out.insert(it.second);
+            }
+        }
+    }
+
+private:
+    std::unordered_multimap<void*, T*> _index;
+}; // class Destruction_Index
+
+} // namespace isolde
+
+#endif // ISOLDE_DESTRUCTION_INDEX
@@ -63,10 +63,23 @@ def get_dihedral(p0, p1, p2, p3):
                     p3.ctypes.data_as(COORTYPE))
 
 # Get values for an entire set of dihedrals at once. More than an order
-# of magnitude faster than calling get_dihedral() in a Python loop.
+# of magnitude faster than calling get_dihedral() in a Python loop. The
+# batched C++ functions all take size_t counts, and split large batches
+# across threads.
 _get_dihedrals = _geometry.get_dihedrals
+_get_dihedrals.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+_get_dihedrals_float = _geometry.get_dihedrals_float
+_get_dihedrals_float.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+_get_dihedrals_from_float = _geometry.get_dihedrals_from_float
+_get_dihedrals_from_float.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
 
-def get_dihedrals(coords, n):
+def _ptr(arr):
+    return arr.ctypes.data_as(ctypes.c_void_p)
+
+def _is_float32(arr):
+    return getattr(arr, 'dtype', None) == numpy.float32
+
+def get_dihedrals(coords, n, dtype=numpy.double):
     '''
     (Deprecated) Returns the dihedral angles (in radians) defined by the given
     coordinates.
@@ -74,45 +87,71 @@ def get_dihedrals(coords, n):
     Args:
         * coords:
             - The coordinates defining the dihedrals, as a single ((n*4)*3) or
-              (n*4*3) Numpy double array.
+              (n*4*3) Numpy array. Float32 coordinates are used as-is, and
+              the calculation done entirely in single precision; anything
+              else is converted to double.
         * n:
             - The number of dihedrals
+        * dtype:
+            - numpy.double or numpy.float32. The precision of the result.
 
     Returns:
-        * a length-n Numpy double array
-    '''
-    full_len = n*4*3
-    INTYPE = ctypes.POINTER(ctypes.c_double*full_len)
-    ret = numpy.empty(n, numpy.double)
-    RTYPE = ctypes.POINTER(ctypes.c_double)
-    _get_dihedrals.argtypes = [INTYPE, ctypes.c_int, RTYPE]
-    _get_dihedrals(numpy.reshape(coords, -1).ctypes.data_as(INTYPE), n, ret.ctypes.data_as(RTYPE))
+        * a length-n Numpy array of the given dtype
+    '''
+    if _is_float32(coords):
+        coords = convert_and_sanitize_numpy_array(coords, numpy.float32)
+        ret = numpy.empty(n, numpy.float32)
+        _get_dihedrals_from_float(_ptr(coords), n, _ptr(ret))
+        return ret.astype(dtype, copy=False)
+    coords = convert_and_sanitize_numpy_array(coords, numpy.double)
+    ret = numpy.empty(n, dtype)
+    if ret.dtype == numpy.float32:
+        f = _get_dihedrals_float
+    else:
+        f = _get_dihedrals
+    f(_ptr(coords), n, _ptr(ret))
     return ret
 
 
 _rotations = _geometry.rotations
-def rotations(axis, angles):
+_rotations.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+_rotations_float = _geometry.rotations_float
+_rotations_float.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+def rotations(axis, angles, dtype=numpy.double):
     '''
-    Get the rotation matrices around the given axis for an array of angles.
+    Get the rotation matrices around the given axis for an array of angles,
+    as an (n,3,4) array of the given dtype (numpy.double or numpy.float32).
     '''
     n = len(angles)
-    ANGLE_TYPE = ctypes.POINTER(ctypes.c_double*n)
-    ret = numpy.empty((n,3,4), numpy.double)
-    RTYPE=ctypes.POINTER(ctypes.c_double)
-    _rotations.argtypes = [COORTYPE, ANGLE_TYPE, ctypes.c_int, RTYPE]
-    _rotations(axis.ctypes.data_as(COORTYPE), angles.ctypes.data_as(ANGLE_TYPE),
-               n, ret.ctypes.data_as(RTYPE))
+    # The C++ function normalises the axis in place
+    axis = numpy.array(axis, numpy.double)
+    angles = convert_and_sanitize_numpy_array(angles, numpy.double)
+    ret = numpy.empty((n,3,4), dtype)
+    if ret.dtype == numpy.float32:
+        f = _rotations_float
+    else:
+        f = _rotations
+    f(_ptr(axis), _ptr(angles), n, _ptr(ret))
     return ret
 
 _scale_transforms = _geometry.scale_transforms
+_scale_transforms.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
+_scale_transforms_float = _geometry.scale_transforms_float
+_scale_transforms_float.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p]
 def scale_transforms(scales, transforms):
-    ''' Get a set of transformations scaling coordinates by the values in scales.'''
+    '''
+    Get a set of transformations scaling coordinates by the values in scales.
+    Float32 transforms are scaled in single precision, anything else in
+    double.
+    '''
     n = len(scales)
-    tf = convert_and_sanitize_numpy_array(transforms, numpy.double)
-    SCALE_TYPE = ctypes.POINTER(ctypes.c_double*n)
-    RTYPE = ctypes.POINTER(ctypes.c_double)
-    _scale_transforms.argtypes = [SCALE_TYPE, ctypes.c_int, RTYPE]
-    _scale_transforms(scales.ctypes.data_as(SCALE_TYPE), n, tf.ctypes.data_as(RTYPE))
+    if transforms.dtype == numpy.float32:
+        dtype, f = numpy.float32, _scale_transforms_float
+    else:
+        dtype, f = numpy.double, _scale_transforms
+    tf = convert_and_sanitize_numpy_array(transforms, dtype)
+    scales = convert_and_sanitize_numpy_array(scales, dtype)
+    f(_ptr(scales), n, _ptr(tf))
     return tf
 
 
@@ -128,35 +167,76 @@ def multiply_transforms(tf1, tf2):
     return ret
 
 _flip_rotate_shift = _geometry.flip_rotate_and_shift
-def flip_rotate_and_shift(flip_mask, flip_tf, rotations, shifts):
+_flip_rotate_shift.argtypes = [ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p,
+    ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+_flip_rotate_shift_float = _geometry.flip_rotate_and_shift_float
+_flip_rotate_shift_float.argtypes = _flip_rotate_shift.argtypes
+def flip_rotate_and_shift(flip_mask, flip_tf, rotations, shifts, dtype=numpy.double):
     n = len(flip_mask)
     if len(rotations) != n or len(shifts) != n:
         raise TypeError('flip_mask, rotations and shifts must all be the '\
             +'same length!')
-    #~ ftf = numpy.empty(flip_tf.shape, numpy.double)
-    #~ ftf[:] = flip_tf
     from numpy import double
+    fm = convert_and_sanitize_numpy_array(flip_mask, numpy.bool_)
     ftf = convert_and_sanitize_numpy_array(flip_tf, double)
     rot = convert_and_sanitize_numpy_array(rotations, double)
     sh = convert_and_sanitize_numpy_array(shifts, double)
-    #~ shape = rotations.shape
-    #~ rot = numpy.empty(shape, numpy.double)
-    #~ rot[:] = rotations
-    #~ sh = numpy.empty(shape, numpy.double)
-    #~ sh[:] = shifts
-    FLAG_TYPE = ctypes.POINTER(NPY_BOOL*n)
-    TF_TYPE = ctypes.POINTER(ctypes.c_double*12)
-    TF_ARRAY_TYPE = ctypes.POINTER(ctypes.c_double*12*n)
-    ret = numpy.empty(rotations.shape, numpy.double)
-    _flip_rotate_shift.argtypes = [ctypes.c_int, FLAG_TYPE, TF_TYPE,
-                                   TF_ARRAY_TYPE, TF_ARRAY_TYPE, TF_ARRAY_TYPE]
-    _flip_rotate_shift(n, flip_mask.ctypes.data_as(FLAG_TYPE),
-                          ftf.ctypes.data_as(TF_TYPE),
-                          rot.ctypes.data_as(TF_ARRAY_TYPE),
-                          sh.ctypes.data_as(TF_ARRAY_TYPE),
-                          ret.ctypes.data_as(TF_ARRAY_TYPE))
+    ret = numpy.empty(rotations.shape, dtype)
+    if ret.dtype == numpy.float32:
+        f = _flip_rotate_shift_float
+    else:
+        f = _flip_rotate_shift
+    f(n, _ptr(fm), _ptr(ftf), _ptr(rot), _ptr(sh), _ptr(ret))
     return ret
 
+_accumulate_coord_stats = _geometry.accumulate_coord_statistics
+_accumulate_coord_stats.argtypes = [ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t,
+    ctypes.c_void_p, ctypes.c_void_p]
+_accumulate_coord_stats_float = _geometry.accumulate_coord_statistics_float
+_accumulate_coord_stats_float.argtypes = _accumulate_coord_stats.argtypes
+class CoordStatistics:
+    '''
+    Running mean and covariance of the coordinates of a fixed set of atoms,
+    updated one frame at a time (e.g. on each coordinate update of a
+    simulation) without keeping the frames themselves.
+    '''
+    def __init__(self, n):
+        self.count = 0
+        self.mean = numpy.zeros((n,3), numpy.double)
+        # xx, yy, zz, xy, xz, yz sums of products of deviations
+        self._comoment = numpy.zeros((n,6), numpy.double)
+
+    def add(self, coords):
+        '''
+        Add a (n x 3) array of coordinates.
+        '''
+        n = len(self.mean)
+        if len(coords) != n:
+            raise TypeError('Expected coordinates for {} atoms!'.format(n))
+        if _is_float32(coords):
+            coords = convert_and_sanitize_numpy_array(coords, numpy.float32)
+            f = _accumulate_coord_stats_float
+        else:
+            coords = convert_and_sanitize_numpy_array(coords, numpy.double)
+            f = _accumulate_coord_stats
+        f(n, _ptr(coords), self.count, _ptr(self.mean), _ptr(self._comoment))
+        self.count += 1
+
+    def covariances(self, ddof=1):
+        '''
+        Per-atom coordinate covariances as a (n x 6) array in the order xx,
+        yy, zz, xy, xz, yz (the layout of aniso_u6).
+        '''
+        if self.count <= ddof:
+            raise TypeError('Not enough frames!')
+        return self._comoment/(self.count-ddof)
+
+    def variances(self, ddof=0):
+        '''
+        Total (x+y+z) coordinate variance of each atom.
+        '''
+        return self.covariances(ddof)[:,:3].sum(axis=1)
+
 def dihedral_fill_plane(p0, p1, p2, p3):
     '''
     Fill in the "cup" in a dihedral with a pseudo-planar surface
@@ -198,56 +278,63 @@ def dihedral_fill_planes(dihedrals, target_drawing):
     #dw.vertices, dw.normals, dw.triangles = varray, narray, tarray
 
 _dihedral_fill_planes=_geometry.dihedral_fill_planes
-def dihedral_fill_planes(dihedrals, target_drawing):
+_dihedral_fill_planes.argtypes = [ctypes.c_size_t, ctypes.c_void_p,
+    ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+_dihedral_fill_planes_from_float=_geometry.dihedral_fill_planes_from_float
+_dihedral_fill_planes_from_float.argtypes = _dihedral_fill_planes.argtypes
+
+def _plane_coords(dihedrals, coords):
+    '''
+    Coordinates for the plane-fill functions, and whether they are float32.
+    Float32 coordinates (e.g. cached scene coordinates) are passed through
+    without conversion.
+    '''
+    if coords is None:
+        coords = dihedrals.coords
+    if _is_float32(coords):
+        return convert_and_sanitize_numpy_array(coords, numpy.float32), True
+    return convert_and_sanitize_numpy_array(coords, numpy.double), False
+
+def dihedral_fill_planes(dihedrals, target_drawing, coords=None):
+    '''
+    Fill in the "cup" of each dihedral in the target drawing. If coords is
+    given it is used in place of dihedrals.coords, as an (n*4, 3) array in
+    double or float32 precision.
+    '''
     dw = target_drawing
-    coords = dihedrals.coords
+    coords, single = _plane_coords(dihedrals, coords)
     n = len(dihedrals)
     varray = numpy.empty([5*n, 3], numpy.float32)
     narray = numpy.empty([5*n, 3], numpy.float32)
     tarray = numpy.empty([3*n, 3], numpy.int32)
-    COORTYPE = ctypes.POINTER(ctypes.c_double*coords.size)
-    V_TYPE = ctypes.POINTER(ctypes.c_float*varray.size)
-    N_TYPE = ctypes.POINTER(ctypes.c_float*narray.size)
-    T_TYPE = ctypes.POINTER(ctypes.c_int32*tarray.size)
-    _dihedral_fill_planes.argtypes = [ctypes.c_int, COORTYPE, V_TYPE, N_TYPE, T_TYPE]
-    _dihedral_fill_planes(n, coords.ctypes.data_as(COORTYPE),
-                             varray.ctypes.data_as(V_TYPE),
-                             narray.ctypes.data_as(N_TYPE),
-                             tarray.ctypes.data_as(T_TYPE))
+    f = _dihedral_fill_planes_from_float if single else _dihedral_fill_planes
+    f(n, _ptr(coords), _ptr(varray), _ptr(narray), _ptr(tarray))
     dw.set_geometry(varray, narray, tarray)
     #dw.vertices, dw.normals, dw.triangles = varray, narray, tarray
 
 _dihedral_fill_and_color_planes = _geometry.dihedral_fill_and_color_planes
+_dihedral_fill_and_color_planes.argtypes = [ctypes.c_size_t] + [ctypes.c_void_p]*10
+_dihedral_fill_and_color_planes_from_float = _geometry.dihedral_fill_and_color_planes_from_float
+_dihedral_fill_and_color_planes_from_float.argtypes = _dihedral_fill_and_color_planes.argtypes
 def dihedral_fill_and_color_planes(dihedrals, target_drawing,
             twisted_mask, cis_pro_mask, cis_nonpro_color, twisted_color,
-            cis_pro_color):
+            cis_pro_color, coords=None):
     dw = target_drawing
-    coords = dihedrals.coords
+    coords, single = _plane_coords(dihedrals, coords)
     n = len(dihedrals)
     varray = numpy.empty([5*n, 3], numpy.float32)
     narray = numpy.empty([5*n, 3], numpy.float32)
     tarray = numpy.empty([3*n, 3], numpy.int32)
     carray = numpy.empty([5*n, 4], numpy.uint8)
-    COORTYPE = ctypes.POINTER(ctypes.c_double*coords.size)
-    V_TYPE = ctypes.POINTER(ctypes.c_float*varray.size)
-    N_TYPE = ctypes.POINTER(ctypes.c_float*narray.size)
-    T_TYPE = ctypes.POINTER(ctypes.c_int32*tarray.size)
-    C_TYPE = ctypes.POINTER(ctypes.c_uint8*carray.size)
-    COLOR_TYPE = ctypes.POINTER(ctypes.c_uint8*4)
-    MASK_TYPE = ctypes.POINTER(NPY_BOOL*n)
-    _dihedral_fill_planes.argtypes = [ctypes.c_int, COORTYPE, MASK_TYPE,
-        MASK_TYPE, COLOR_TYPE, COLOR_TYPE, COLOR_TYPE,
-        V_TYPE, N_TYPE, T_TYPE, C_TYPE]
-    _dihedral_fill_and_color_planes(n, coords.ctypes.data_as(COORTYPE),
-                             twisted_mask.ctypes.data_as(MASK_TYPE),
-                             cis_pro_mask.ctypes.data_as(MASK_TYPE),
-                             cis_nonpro_color.ctypes.data_as(COLOR_TYPE),
-                             twisted_color.ctypes.data_as(COLOR_TYPE),
-                             cis_pro_color.ctypes.data_as(COLOR_TYPE),
-                             varray.ctypes.data_as(V_TYPE),
-                             narray.ctypes.data_as(N_TYPE),
-                             tarray.ctypes.data_as(T_TYPE),
-                             carray.ctypes.data_as(C_TYPE))
+    twisted_mask = convert_and_sanitize_numpy_array(twisted_mask, numpy.bool_)
+    cis_pro_mask = convert_and_sanitize_numpy_array(cis_pro_mask, numpy.bool_)
+    colors = [convert_and_sanitize_numpy_array(c, numpy.uint8) for c in
+        (cis_nonpro_color, twisted_color, cis_pro_color)]
+    f = (_dihedral_fill_and_color_planes_from_float if single
+        else _dihedral_fill_and_color_planes)
+    f(n, _ptr(coords), _ptr(twisted_mask), _ptr(cis_pro_mask),
+        *[_ptr(c) for c in colors],
+        _ptr(varray), _ptr(narray), _ptr(tarray), _ptr(carray))
     dw.set_geometry(varray, narray, tarray)
     dw.vertex_colors = carray
     #dw.vertices, dw.normals, dw.triangles, dw.vertex_colors = varray, narray, tarray, carray
@@ -14,6 +14,7 @@
 #define isolde_geometry
 
 #include <math.h>
+#include <cmath>
 #include <cstdlib>
 #include <cstdint>
 
@@ -177,7 +178,7 @@ void rotation(T normalized_axis[3], const T &angle, T* out)
 
     *out++ = 1 + k*( ax*ax -1);
     *out++ = -az*sa + k*ax*ay;
-    *out++ = ay*sa + k*ax*ax;
+    *out++ = ay*sa + k*ax*az;
     *out++ = 0;
     *out++ = az*sa + k*ax*ay;
     *out++ = 1 + k*(ay*ay - 1);
@@ -210,7 +211,7 @@ void rotation_gl(const T normalized_axis[3], const T &angle, T* out)
     *out++ = ax*sa + k*ay*az;
     *out++=0;
 
-    *out++ = ay*sa + k*ax*ax;
+    *out++ = ay*sa + k*ax*az;
     *out++ = -ax*sa + k*ay*az;
     *out++ = 1 + k*(az*az - 1);
     *out++ = 0;
@@ -278,6 +279,271 @@ void bond_cylinder_transform_gl(C xyz0, C xyz1, T r, T length_scale, T *rot44)
     *rot44++ = 1;
 }
 
+/*! Batched form of bond_cylinder_transform_gl(). xyz0 and xyz1 are packed
+ *  (n x 3) arrays of end points, r and length_scale hold one value per bond.
+ *  Successive 4x4 matrices are written stride values apart in rot44. The loop
+ *  body is branch-free so that the compiler can vectorise it.
+ */
+template <typename T>
+void bond_cylinder_transforms_gl(size_t n, const T *xyz0, const T *xyz1,
+    const T *r, const T *length_scale, T *rot44, size_t stride=16)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        const T *p0 = xyz0 + 3*i;
+        const T *p1 = xyz1 + 3*i;
+        T *m = rot44 + stride*i;
+        T bx = p1[0]-p0[0], by = p1[1]-p0[1], bz = p1[2]-p0[2];
+        T d = sqrt(bx*bx + by*by + bz*bz);
+        bool degenerate = d < ALMOST_ZERO;
+        T inv_d = degenerate ? 0 : 1/d;
+        bx *= inv_d; by *= inv_d;
+        T c = degenerate ? 1 : bz*inv_d;
+        d = degenerate ? ALMOST_ZERO : d;
+        T c1 = (c <= -1) ? 0 : 1/(1+c);
+        T wx = -by, wy = bx;
+        T cx = c1*wx, cy = c1*wy;
+        T ri = r[i];
+        T h = d * length_scale[i];
+        m[0] = ri*(cx*wx + c);
+        m[1] = ri*cy*wx;
+        m[2] = -ri*wy;
+        m[3] = 0;
+
+        m[4] = ri*cx*wy;
+        m[5] = ri*(cy*wy + c);
+        m[6] = ri*wx;
+        m[7] = 0;
+
+        m[8] = h*wy;
+        m[9] = -h*wx;
+        m[10] = h*c;
+        m[11] = 0;
+
+        m[12] = (p0[0]+p1[0])/2;
+        m[13] = (p0[1]+p1[1])/2;
+        m[14] = (p0[2]+p1[2])/2;
+        m[15] = 1;
+    }
+}
+
+
+/*! Ring transforms for dihedral restraint annotations. For each of n
+ *  angles (radians), the 4x4 OpenGL rotation about z by that angle - flipped
+ *  on x if it is negative, so the arrow points back towards the target - is
+ *  applied ahead of the matching transform in post44. Gives the same result
+ *  as rotation_gl(), flip_on_x_gl() and multiply_transforms_gl() in turn,
+ *  with a branch-free loop body.
+ */
+template <typename T>
+void dihedral_ring_transforms_gl(size_t n, const T *angles, const T *post44, T *ring44)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        const T a = angles[i];
+        const T ca = cos(a), sa = sin(a);
+        const T s = a < 0 ? -1 : 1;
+        const T *p = post44 + 16*i;
+        T *m = ring44 + 16*i;
+        for (size_t j=0; j<4; ++j)
+        {
+            m[j] = ca*p[j] + s*sa*p[4+j];
+            m[4+j] = -sa*p[j] + s*ca*p[4+j];
+            m[8+j] = s*p[8+j];
+            m[12+j] = p[12+j];
+        }
+    }
+}
+
+
+/*
+ * Batched kernels. Each works on n packed records with no dependencies
+ * between them, so callers are free to split the range across threads.
+ * Loop bodies avoid branches and calls through pointers so that the compiler
+ * can vectorise them. Input type T and output type R are independent,
+ * allowing e.g. double coordinates in with float results out.
+ */
+
+//! Dihedral angles (radians) for packed (n x 4 x 3) coordinates
+template <typename T, typename R>
+void dihedral_angles(size_t n, const T *coords, R *out)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        const T *c = coords + 12*i;
+        R b0x = c[0]-c[3], b0y = c[1]-c[4], b0z = c[2]-c[5];
+        R b1x = c[6]-c[3], b1y = c[7]-c[4], b1z = c[8]-c[5];
+        R b2x = c[9]-c[6], b2y = c[10]-c[7], b2z = c[11]-c[8];
+        R inv_nb1 = 1/std::sqrt(b1x*b1x + b1y*b1y + b1z*b1z);
+        b1x *= inv_nb1; b1y *= inv_nb1; b1z *= inv_nb1;
+        R dp01 = b0x*b1x + b0y*b1y + b0z*b1z;
+        R dp21 = b2x*b1x + b2y*b1y + b2z*b1z;
+        R vx = b0x - dp01*b1x, vy = b0y - dp01*b1y, vz = b0z - dp01*b1z;
+        R wx = b2x - dp21*b1x, wy = b2y - dp21*b1y, wz = b2z - dp21*b1z;
+        R x = vx*wx + vy*wy + vz*wz;
+        R y = (b1y*vz - b1z*vy)*wx + (b1z*vx - b1x*vz)*wy + (b1x*vy - b1y*vx)*wz;
+        out[i] = std::atan2(y, x);
+    }
+}
+
+/*! Triple product ((p2-p1) x (p0-p1)) . (p3-p2) for packed (n x 4 x 3)
+ *  coordinates. This has the same sign as dihedral_angle(p0, p1, p2, p3), so
+ *  is a much cheaper test where only the handedness matters.
+ */
+template <typename T, typename R>
+void dihedral_signs(size_t n, const T *coords, R *out)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        const T *c = coords + 12*i;
+        R b0x = c[0]-c[3], b0y = c[1]-c[4], b0z = c[2]-c[5];
+        R b1x = c[6]-c[3], b1y = c[7]-c[4], b1z = c[8]-c[5];
+        R b2x = c[9]-c[6], b2y = c[10]-c[7], b2z = c[11]-c[8];
+        out[i] = (b1y*b0z - b1z*b0y)*b2x + (b1z*b0x - b1x*b0z)*b2y
+               + (b1x*b0y - b1y*b0x)*b2z;
+    }
+}
+
+//! n 3x4 rotation matrices about a normalised axis (translation = 0)
+template <typename T, typename R>
+void axis_rotations(const T normalized_axis[3], size_t n, const T *angles, R *out)
+{
+    const R ax = normalized_axis[0], ay = normalized_axis[1], az = normalized_axis[2];
+    for (size_t i=0; i<n; ++i)
+    {
+        R *m = out + 12*i;
+        R sa = std::sin((R)angles[i]);
+        R ca = std::cos((R)angles[i]);
+        R k = 1 - ca;
+        m[0] = 1 + k*(ax*ax - 1);
+        m[1] = -az*sa + k*ax*ay;
+        m[2] = ay*sa + k*ax*az;
+        m[3] = 0;
+        m[4] = az*sa + k*ax*ay;
+        m[5] = 1 + k*(ay*ay - 1);
+        m[6] = -ax*sa + k*ay*az;
+        m[7] = 0;
+        m[8] = -ay*sa + k*ax*az;
+        m[9] = ax*sa + k*ay*az;
+        m[10] = 1 + k*(az*az - 1);
+        m[11] = 0;
+    }
+}
+
+//! Scale the rotation part of n packed 3x4 transforms, leaving translations
+template <typename T>
+void scale_transforms(size_t n, const T *scales, T *transforms)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        T *m = transforms + 12*i;
+        const T s = scales[i];
+        m[0] *= s; m[1] *= s; m[2] *= s;
+        m[4] *= s; m[5] *= s; m[6] *= s;
+        m[8] *= s; m[9] *= s; m[10] *= s;
+    }
+}
+
+//! out = tf1 * tf2 for packed 3x4 transforms
+template <typename T, typename R>
+inline void multiply_transforms_34(const T *tf1, const T *tf2, R *out)
+{
+    for (size_t i=0; i<3; ++i)
+    {
+        const T *r = tf1 + 4*i;
+        for (size_t j=0; j<4; ++j)
+            out[4*i+j] = r[0]*tf2[j] + r[1]*tf2[4+j] + r[2]*tf2[8+j]
+                + (j==3 ? r[3] : 0);
+    }
+}
+
+/*! For each of n packed 3x4 transforms: out = shift * rot * flip_op where
+ *  flip[i] is set, or shift * rot otherwise.
+ */
+template <typename T, typename R>
+void flip_rotate_and_shift(size_t n, const uint8_t *flip, const T flip_op[12],
+    const T *rot, const T *shift, R *out)
+{
+    for (size_t i=0; i<n; ++i)
+    {
+        const T *r = rot + 12*i;
+        T flipped[12];
+        multiply_transforms_34(r, flip_op, flipped);
+        const T *rf = flip[i] ? flipped : r;
+        multiply_transforms_34(shift + 12*i, rf, out + 12*i);
+    }
+}
+
+//! Vertex/normal/triangle counts for one dihedral_fill_plane()
+const size_t FILL_PLANE_VERTICES = 5;
+const size_t FILL_PLANE_TRIANGLES = 3;
+
+/*! Fill in the "cup" defined by the four points of a dihedral with a
+ *  pseudo-trapezoid: 5 vertices (the 4 atoms plus the midpoint of the first
+ *  and last) and 3 triangles, numbered from start. The surface is treated as
+ *  planar, with a single normal.
+ */
+template <typename T, typename V>
+inline void dihedral_fill_plane(const T *coords, V *vertices, V *normals,
+    int32_t *triangles, int32_t start=0)
+{
+    static const int32_t T_INDICES[9] = {0,1,4,1,2,4,2,3,4};
+    for (size_t j=0; j<12; ++j)
+        vertices[j] = coords[j];
+    for (size_t j=0; j<3; ++j)
+        vertices[12+j] = (coords[j] + coords[9+j])/2;
+    V v1x = vertices[3]-vertices[0], v1y = vertices[4]-vertices[1], v1z = vertices[5]-vertices[2];
+    V v2x = vertices[9]-vertices[0], v2y = vertices[10]-vertices[1], v2z = vertices[11]-vertices[2];
+    V nx = v1y*v2z - v1z*v2y, ny = v1z*v2x - v1x*v2z, nz = v1x*v2y - v1y*v2x;
+    for (size_t j=0; j<FILL_PLANE_VERTICES; ++j)
+    {
+        normals[3*j] = nx; normals[3*j+1] = ny; normals[3*j+2] = nz;
+    }
+    for (size_t j=0; j<9; ++j)
+        triangles[j] = start + T_INDICES[j];
+}
+
+//! dihedral_fill_plane() for n packed (4 x 3) coordinate sets
+template <typename T, typename V>
+void dihedral_fill_planes(size_t n, const T *coords, V *vertices, V *normals,
+    int32_t *triangles, size_t first_vertex=0)
+{
+    for (size_t i=0; i<n; ++i)
+        dihedral_fill_plane(coords + 12*i, vertices + 15*i, normals + 15*i,
+            triangles + 9*i, (int32_t)(first_vertex + FILL_PLANE_VERTICES*i));
+}
+
+/*! Fold one frame of (n x 3) coordinates into running per-atom statistics
+ *  (Welford's method), where count frames have already been added. mean is
+ *  (n x 3); comoment is (n x 6), holding the sums of products of deviations
+ *  in the order xx, yy, zz, xy, xz, yz. Dividing comoment by the number of
+ *  frames (or one less) gives the coordinate covariance of each atom.
+ */
+template <typename T>
+void accumulate_coord_statistics(size_t n, const T *coords, size_t count,
+    double *mean, double *comoment)
+{
+    double inv = 1.0/(count+1);
+    for (size_t i=0; i<n; ++i)
+    {
+        const T *c = coords + 3*i;
+        double *m = mean + 3*i;
+        double *cm = comoment + 6*i;
+        double d_old[3], d_new[3];
+        for (size_t j=0; j<3; ++j)
+        {
+            d_old[j] = c[j] - m[j];
+            m[j] += d_old[j]*inv;
+            d_new[j] = c[j] - m[j];
+        }
+        cm[0] += d_old[0]*d_new[0];
+        cm[1] += d_old[1]*d_new[1];
+        cm[2] += d_old[2]*d_new[2];
+        cm[3] += d_old[0]*d_new[1];
+        cm[4] += d_old[0]*d_new[2];
+        cm[5] += d_old[1]*d_new[2];
+    }
+}
 
 
 } // namespace geometry
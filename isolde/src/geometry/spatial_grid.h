@@ -0,0 +1,152 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef isolde_spatial_grid
+#define isolde_spatial_grid
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+
+namespace isolde
+{
+namespace geometry
+{
+
+/*! Uniform grid of cubic cells over a fixed set of points, for finding all
+ *  pairs of points within a cutoff distance in (roughly) linear time. The
+ *  points are bucketed once on construction by sorting on cell index, so a
+ *  search only ever looks at the 27 cells surrounding each point. The
+ *  coordinates are not copied, and must outlive the grid.
+ */
+template <typename T>
+class Spatial_Grid
+{
+public:
+    Spatial_Grid(const T *coords, size_t n, T cell_size)
+        : _coords(coords), _n(n), _cell_size(cell_size)
+    {
+        if (!(cell_size > 0))
+            throw std::invalid_argument("Grid cell size must be greater than zero!");
+        if (n == 0)
+            return;
+        for (size_t j=0; j<3; ++j)
+        {
+            T cmin = coords[j], cmax = coords[j];
+            for (size_t i=1; i<n; ++i)
+            {
+                cmin = std::min(cmin, coords[3*i+j]);
+                cmax = std::max(cmax, coords[3*i+j]);
+            }
+            _origin[j] = cmin;
+            _dim[j] = (int64_t)((cmax-cmin)/cell_size) + 1;
+        }
+        _cell.resize(n);
+        _order.resize(n);
+        for (size_t i=0; i<n; ++i)
+        {
+            int64_t ijk[3];
+            _cell_coords(coords+3*i, ijk);
+            _cell[i] = _key(ijk);
+            _order[i] = i;
+        }
+        std::sort(_order.begin(), _order.end(),
+            [this](size_t a, size_t b) { return _cell[a] < _cell[b]; });
+    }
+
+    size_t size() const { return _n; }
+
+    /*! Call f(i, j, d) once for each pair of points i < j separated by a
+     *  distance d <= cutoff. The cutoff must be no larger than the cell size.
+     */
+    template <typename F>
+    void for_each_close_pair(T cutoff, F f) const
+    {
+        if (cutoff > _cell_size)
+            throw std::invalid_argument("Search cutoff is larger than the grid cell size!");
+        T cutoff2 = cutoff*cutoff;
+        for (size_t i=0; i<_n; ++i)
+        {
+            const T *ci = _coords+3*i;
+            int64_t ijk[3];
+            _cell_coords(ci, ijk);
+            for (int64_t dx=-1; dx<=1; ++dx)
+            for (int64_t dy=-1; dy<=1; ++dy)
+            for (int64_t dz=-1; dz<=1; ++dz)
+            {
+                int64_t nb[3] = {ijk[0]+dx, ijk[1]+dy, ijk[2]+dz};
+                if (!_in_grid(nb))
+                    continue;
+                auto range = _cell_range(_key(nb));
+                for (auto it = range.first; it != range.second; ++it)
+                {
+                    size_t j = *it;
+                    if (j <= i)
+                        continue;
+                    const T *cj = _coords+3*j;
+                    T d2 = 0;
+                    for (size_t k=0; k<3; ++k)
+                    {
+                        T diff = cj[k]-ci[k];
+                        d2 += diff*diff;
+                    }
+                    if (d2 <= cutoff2)
+                        f(i, j, std::sqrt(d2));
+                }
+            }
+        }
+    }
+
+private:
+    const T *_coords;
+    size_t _n;
+    T _cell_size;
+    T _origin[3];
+    int64_t _dim[3];
+    std::vector<int64_t> _cell; // cell key of each point
+    std::vector<size_t> _order; // point indices sorted by cell key
+
+    void _cell_coords(const T *c, int64_t *ijk) const
+    {
+        for (size_t j=0; j<3; ++j)
+            ijk[j] = (int64_t)((c[j]-_origin[j])/_cell_size);
+    }
+    bool _in_grid(const int64_t *ijk) const
+    {
+        for (size_t j=0; j<3; ++j)
+            if (ijk[j] < 0 || ijk[j] >= _dim[j])
+                return false;
+        return true;
+    }
+    int64_t _key(const int64_t *ijk) const
+    {
+        return (ijk[0]*_dim[1] + ijk[1])*_dim[2] + ijk[2];
+    }
+    std::pair<std::vector<size_t>::const_iterator, std::vector<size_t>::const_iterator>
+    _cell_range(int64_t key) const
+    {
+        return std::equal_range(_order.begin(), _order.end(), key, _Key_Compare{this});
+    }
+    struct _Key_Compare
+    {
+        const Spatial_Grid *g;
+        bool operator()(size_t a, int64_t key) const { return g->_cell[a] < key; }
+        bool operator()(int64_t key, size_t a) const { return key < g->_cell[a]; }
+    };
+}; // class Spatial_Grid
+
+} // namespace geometry
+} // namespace isolde
+
+#endif // isolde_spatial_grid
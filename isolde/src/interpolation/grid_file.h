@@ -0,0 +1,322 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+//! Binary files of regular grids, for memory-mapping into RegularGridInterpolators
+
+#ifndef ISOLDE_GRID_FILE
+#define ISOLDE_GRID_FILE
+
+#include <stdint.h>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef _WIN32
+# ifndef NOMINMAX
+#  define NOMINMAX
+# endif
+# include <windows.h>
+# include <process.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace isolde
+{
+
+/*! Layout (native byte order, which is checked on loading):
+ *
+ *    Grid_File_Header                         64 bytes
+ *    uint32_t lengths[dim]                    (padded to a multiple of 8 bytes)
+ *    double min[dim]
+ *    double max[dim]
+ *    (zero padding up to data_offset, a multiple of 64)
+ *    n_grids grids of n_points values each, value_size bytes per value
+ *
+ *  All grids in a file share the same axes (e.g. the probabilities and their
+ *  logs for one residue type). The data can be used in place from a
+ *  read-only mapping, so every process on a host shares one copy through
+ *  the page cache. Bump GRID_FILE_VERSION whenever the layout changes; files
+ *  of any other version are rejected and should be regenerated.
+ */
+struct Grid_File_Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t dim;
+    uint32_t value_size;
+    uint32_t n_grids;
+    uint32_t pad;
+    uint64_t n_points;
+    uint64_t data_offset;
+    uint64_t reserved[2];
+};
+
+static const char GRID_FILE_MAGIC[8] = {'I','S','O','L','G','R','I','D'};
+static const uint32_t GRID_FILE_VERSION = 1;
+static const uint32_t GRID_FILE_BYTE_ORDER = 0x01020304;
+static const size_t GRID_FILE_ALIGNMENT = 64;
+
+inline size_t grid_file_round_up(size_t n, size_t multiple)
+{
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+//! Write grids sharing the given axes to filename
+/*!
+ * The file is written under a temporary name and then renamed into place,
+ * so that other processes never map a partly-written file.
+ */
+template <typename D>
+void write_grid_file(const std::string &filename, size_t dim, const uint32_t *lengths,
+    const double *min, const double *max, const std::vector<const D*> &grids)
+{
+    uint64_t n_points = 1;
+    for (size_t i=0; i<dim; ++i)
+        n_points *= lengths[i];
+    Grid_File_Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, GRID_FILE_MAGIC, sizeof(h.magic));
+    h.version = GRID_FILE_VERSION;
+    h.byte_order = GRID_FILE_BYTE_ORDER;
+    h.dim = dim;
+    h.value_size = sizeof(D);
+    h.n_grids = grids.size();
+    h.n_points = n_points;
+    size_t axes_start = sizeof(h);
+    size_t min_start = axes_start + grid_file_round_up(dim*sizeof(uint32_t), 8);
+    size_t end_of_axes = min_start + 2*dim*sizeof(double);
+    h.data_offset = grid_file_round_up(end_of_axes, GRID_FILE_ALIGNMENT);
+
+#ifdef _WIN32
+    std::string tmp = filename + ".tmp" + std::to_string(_getpid());
+#else
+    std::string tmp = filename + ".tmp" + std::to_string(getpid());
+#endif
+    {
+        std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+        if (!out)
+            throw std::runtime_error("Could not open " + tmp + " for writing!");
+        std::vector<char> head(h.data_offset, 0);
+        std::memcpy(head.data(), &h, sizeof(h));
+        std::memcpy(head.data()+axes_start, lengths, dim*sizeof(uint32_t));
+        std::memcpy(head.data()+min_start, min, dim*sizeof(double));
+        std::memcpy(head.data()+min_start+dim*sizeof(double), max, dim*sizeof(double));
+        out.write(head.data(), head.size());
+        for (auto g: grids)
+            out.write(reinterpret_cast<const char*>(g), n_points*sizeof(D));
+        if (!out)
+        {
+            out.close();
+            std::remove(tmp.c_str());
+            throw std::runtime_error("Error writing " + tmp + "!");
+        }
+    }
+#ifdef _WIN32
+    // Windows won't rename over an existing file
+    std::remove(filename.c_str());
+#endif
+    if (std::rename(tmp.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Could not rename " + tmp + " to " + filename + "!");
+    }
+}
+
+//! A read-only memory mapping of a grid file
+/*!
+ * Throws std::runtime_error if the file can't be mapped or isn't a valid
+ * grid file of the current version. Interpolators made from the mapped
+ * grids hold a shared_ptr to this, so the mapping stays open as long as any
+ * of them exist.
+ */
+class Mapped_Grid_File
+{
+public:
+    Mapped_Grid_File(const std::string &filename): _filename(filename)
+    {
+        _map();
+        try {
+            _check();
+        } catch (...) {
+            _unmap();
+            throw;
+        }
+    }
+    ~Mapped_Grid_File() { _unmap(); }
+    Mapped_Grid_File(const Mapped_Grid_File&) = delete;
+    Mapped_Grid_File& operator=(const Mapped_Grid_File&) = delete;
+
+    size_t dim() const { return _header()->dim; }
+    size_t n_grids() const { return _header()->n_grids; }
+    size_t n_points() const { return _header()->n_points; }
+    size_t value_size() const { return _header()->value_size; }
+    const uint32_t* lengths() const
+    {
+        return reinterpret_cast<const uint32_t*>(_base + sizeof(Grid_File_Header));
+    }
+    const double* min() const
+    {
+        return reinterpret_cast<const double*>(_base + sizeof(Grid_File_Header)
+            + grid_file_round_up(dim()*sizeof(uint32_t), 8));
+    }
+    const double* max() const { return min() + dim(); }
+
+    template <typename D>
+    const D* grid(size_t i) const
+    {
+        if (sizeof(D) != value_size())
+            throw std::runtime_error(_filename + " holds values of the wrong type!");
+        if (i >= n_grids())
+            throw std::out_of_range("Grid index out of range!");
+        return reinterpret_cast<const D*>(_base + _header()->data_offset) + i*n_points();
+    }
+
+private:
+    std::string _filename;
+    const char *_base = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = NULL;
+#endif
+
+    const Grid_File_Header* _header() const
+    {
+        return reinterpret_cast<const Grid_File_Header*>(_base);
+    }
+
+    void _map()
+    {
+#ifdef _WIN32
+        _file = CreateFileA(_filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Could not open " + _filename + "!");
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size))
+        {
+            _unmap();
+            throw std::runtime_error("Could not get the size of " + _filename + "!");
+        }
+        _size = (size_t)size.QuadPart;
+        if (_size < sizeof(Grid_File_Header))
+        {
+            _unmap();
+            throw std::runtime_error(_filename + " is too short to be a grid file!");
+        }
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_mapping != NULL)
+            _base = static_cast<const char*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+        if (_base == nullptr)
+        {
+            _unmap();
+            throw std::runtime_error("Could not map " + _filename + "!");
+        }
+#else
+        int fd = open(_filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Could not open " + _filename + "!");
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Grid_File_Header))
+        {
+            close(fd);
+            throw std::runtime_error(_filename + " is too short to be a grid file!");
+        }
+        _size = st.st_size;
+        void *p = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+        // The mapping holds its own reference to the file
+        close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("Could not map " + _filename + "!");
+        _base = static_cast<const char*>(p);
+#endif
+    }
+
+    void _unmap()
+    {
+#ifdef _WIN32
+        if (_base != nullptr)
+            UnmapViewOfFile(_base);
+        if (_mapping != NULL)
+            CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+        _mapping = NULL;
+        _file = INVALID_HANDLE_VALUE;
+#else
+        if (_base != nullptr)
+            munmap(const_cast<char*>(_base), _size);
+#endif
+        _base = nullptr;
+    }
+
+    void _check() const
+    {
+        const Grid_File_Header *h = _header();
+        if (std::memcmp(h->magic, GRID_FILE_MAGIC, sizeof(h->magic)) != 0)
+            throw std::runtime_error(_filename + " is not a grid file!");
+        if (h->version != GRID_FILE_VERSION)
+            throw std::runtime_error(_filename + " is from a different version of ISOLDE!");
+        if (h->byte_order != GRID_FILE_BYTE_ORDER)
+            throw std::runtime_error(_filename + " was written on a machine of different byte order!");
+        if (h->data_offset % GRID_FILE_ALIGNMENT != 0)
+            throw std::runtime_error(_filename + " is corrupt!");
+        size_t end_of_axes = sizeof(Grid_File_Header)
+            + grid_file_round_up(h->dim*sizeof(uint32_t), 8) + 2*h->dim*sizeof(double);
+        if (h->data_offset < end_of_axes || h->data_offset > _size)
+            throw std::runtime_error(_filename + " is corrupt!");
+        uint64_t n_points = 1;
+        const uint32_t *n = lengths();
+        for (size_t i=0; i<h->dim; ++i)
+            n_points *= n[i];
+        if (n_points != h->n_points
+            || h->data_offset + (uint64_t)h->n_grids*h->n_points*h->value_size != _size)
+            throw std::runtime_error(_filename + " is truncated or corrupt!");
+    }
+}; // class Mapped_Grid_File
+
+//! The mapping of filename, shared with anything else in the library using it
+/*!
+ * Every manager (in every session) loading the same grid file gets the same
+ * mapping, so there is only one copy of each table in the address space.
+ * The registry holds weak references: a file is unmapped once the last
+ * interpolator using it is gone.
+ */
+inline std::shared_ptr<const Mapped_Grid_File> shared_grid_file(const std::string &filename)
+{
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::weak_ptr<const Mapped_Grid_File>> mapped;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = mapped[filename];
+    auto f = entry.lock();
+    if (!f)
+    {
+        f = std::make_shared<const Mapped_Grid_File>(filename);
+        entry = f;
+    }
+    return f;
+}
+
+} // namespace isolde
+
+#endif // ISOLDE_GRID_FILE
@@ -100,6 +100,8 @@ class RegularGridInterpolator:
         args=(SIZE_TYPE, C_UINT32_P, C_FLOAT_P, C_FLOAT_P, C_FLOAT_P), ret = ctypes.c_void_p)
     _interpolate = c_function('rg_interpolate',
         args=(ctypes.c_void_p, C_FLOAT_P, SIZE_TYPE, C_FLOAT_P))
+    _interpolate_with_gradient = c_function('rg_interpolate_with_gradient',
+        args=(ctypes.c_void_p, C_FLOAT_P, SIZE_TYPE, ctypes.c_void_p, C_FLOAT_P, C_FLOAT_P))
     _delete = c_function('rg_interp_delete', args=(ctypes.c_void_p,))
     _dim = c_function('rg_interp_dim', args=(ctypes.c_void_p, ), ret=SIZE_TYPE)
     _min = c_function('rg_interp_min', args=(ctypes.c_void_p, C_FLOAT_P))
@@ -107,6 +109,9 @@ class RegularGridInterpolator:
     _values = c_function('rg_interp_values', args=(ctypes.c_void_p, C_FLOAT_P))
     _axis_lengths = c_function('rg_interp_lengths', args=(ctypes.c_void_p, C_UINT32_P))
     _copy = c_function('rg_interp_copy', args=(ctypes.c_void_p, ))
+    _new_from_file = c_function('rg_interp_new_from_file',
+        args=(ctypes.c_char_p, SIZE_TYPE), ret=ctypes.c_void_p)
+    _write_file = c_function('rg_interp_write_file', args=(ctypes.c_void_p, ctypes.c_char_p))
     def __init__(self, dim, axis_lengths, min_vals, max_vals, grid_data):
         '''
         Prepare the interpolator for a given n-dimensional grid. Once created,
@@ -140,6 +145,34 @@ class RegularGridInterpolator:
         self._min_vals = min_vals
         self._max_vals = max_vals
 
+    @classmethod
+    def from_file(cls, filename, grid=0):
+        '''
+        Create an interpolator directly on a memory-mapped grid file written
+        by :func:`save`, without copying the data. Processes mapping the same
+        file share a single copy of it in memory.
+
+        Args:
+            * filename:
+                - path to the grid file
+            * grid:
+                - index of the grid to use, for files holding more than one
+        '''
+        import os
+        result = cls.__new__(cls)
+        result._c_pointer = cls._new_from_file(os.fsencode(filename), grid)
+        result._min_vals = result.min
+        result._max_vals = result.max
+        return result
+
+    def save(self, filename):
+        '''
+        Write the grid to a file that can be memory-mapped with
+        :func:`from_file`.
+        '''
+        import os
+        self._write_file(self._c_pointer, os.fsencode(filename))
+
     @property
     def dim(self):
         '''
@@ -227,11 +260,53 @@ class RegularGridInterpolator:
         self._interpolate(self._c_pointer, pointer(in_data), n, pointer(ret))
         return ret
 
+    def interpolate_with_gradient(self, data, periods=None):
+        '''
+        Returns the interpolated values and their gradients for a set of
+        (x(1), x(2), ... x(:attr:`dim`)) points. The interpolation is
+        multilinear within each grid cell, so the gradient is that of the
+        interpolated surface.
+
+        Args:
+            * data:
+                - a (n, :attr:`dim`) 2D NumPy array providing the coordinates at
+                  which to calculate the interpolated values.
+            * periods:
+                - optional array of length :attr:`dim` giving the period of
+                  each axis, or zero for non-periodic axes. Values on a
+                  periodic axis are wrapped to within half a period of the
+                  middle of the axis, so the grid must extend a little beyond
+                  one period (as the padded validation grids do).
+
+        Returns:
+            * a 1D NumPy double array of values, and a (n, :attr:`dim`) array
+              of gradients
+        '''
+        if data.shape[1] != self.dim:
+            raise TypeError('Wrong number of dimensions! This is a '\
+                           +'{}-dimensional interpolator.'.format(self.dim))
+        in_data = convert_and_sanitize_numpy_array(data, NPY_FLOAT)
+        n = len(in_data)
+        if periods is not None:
+            periods = convert_and_sanitize_numpy_array(periods, NPY_FLOAT)
+            if len(periods) != self.dim:
+                raise TypeError('Need one period for each dimension!')
+            p_periods = pointer(periods)
+        else:
+            p_periods = None
+        values = numpy.empty(n, dtype=NPY_FLOAT)
+        gradients = numpy.empty((n, self.dim), dtype=NPY_FLOAT)
+        self._interpolate_with_gradient(self._c_pointer, pointer(in_data), n,
+            p_periods, pointer(values), pointer(gradients))
+        return values, gradients
+
     def __call__(self, data):
         return self.interpolate(data)
 
     def __del__(self):
-        self._delete(self._c_pointer)
+        # Not set if from_file() failed
+        if getattr(self, '_c_pointer', None) is not None:
+            self._delete(self._c_pointer)
 
 
     def __deepcopy__(self, memo):
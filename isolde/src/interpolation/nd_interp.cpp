@@ -11,6 +11,10 @@
 
 
 #include "nd_interp.h"
+#include "grid_file.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <time.h>
 #include <sstream>
 
@@ -24,9 +28,32 @@
 namespace isolde
 {
 
-template <typename T>
-RegularGridInterpolator<T>::RegularGridInterpolator(const size_t& dim,
+template <typename T, typename D>
+RegularGridInterpolator<T, D>::RegularGridInterpolator(const size_t& dim,
         uint32_t* n, T* min, T* max, T* data)
+{
+    size_t d_count = _init_axes(dim, n, min, max);
+    auto values = std::make_shared<std::vector<D>>(data, data+d_count);
+    _values = values->data();
+    _n_values = d_count;
+    _owner = values;
+    _owns_data = true;
+} //RegularGridInterpolator
+
+template <typename T, typename D>
+RegularGridInterpolator<T, D>::RegularGridInterpolator(const size_t& dim,
+        const uint32_t* n, const T* min, const T* max, const D* data,
+        std::shared_ptr<const void> owner)
+    : _owner(owner)
+{
+    _values = data;
+    _n_values = _init_axes(dim, n, min, max);
+}
+
+template <typename T, typename D>
+size_t
+RegularGridInterpolator<T, D>::_init_axes(const size_t& dim,
+        const uint32_t* n, const T* min, const T* max)
 {
     _dim = dim;
     size_t this_n, d_count=1;
@@ -41,7 +68,8 @@ RegularGridInterpolator<T>::RegularGridInterpolator(const size_t& dim,
         _max.push_back(this_max);
         step = (this_max-this_min)/(T)(this_n-1);
         _step.push_back(step);
-        _jump.push_back((size_t)pow(2,i));
+        _inv_step.push_back(1.0/step);
+        _jump.push_back((size_t)1 << i);
         dval = this_min;
         std::vector<T> axis;
 
@@ -53,17 +81,17 @@ RegularGridInterpolator<T>::RegularGridInterpolator(const size_t& dim,
         d_count *= this_n;
     }
 
-    for (size_t i=0; i<d_count; ++i) {
-        _data.push_back(data[i]);
-    }
-    _n_corners = (size_t)pow(2.0, (T)dim);
+    if (d_count > (size_t)std::numeric_limits<int32_t>::max())
+        throw std::out_of_range("Interpolation grid is too large!");
+    _n_corners = (size_t)1 << dim;
     corner_offsets();
-} //RegularGridInterpolator
+    return d_count;
+}
 
-template<typename T>
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::lb_index_and_offsets(T *axis_vals, size_t &lb_index,
-    std::vector<std::pair<T, T> > &offsets)
+RegularGridInterpolator<T, D>::lb_index_and_offsets(T *axis_vals, size_t &lb_index,
+    std::vector<std::pair<T, T> > &offsets) const
 {
 //    for (size_t axis=0; axis<_dim; ++axis) {
     size_t axis_prod = 1;
@@ -95,9 +123,9 @@ RegularGridInterpolator<T>::lb_index_and_offsets(T *axis_vals, size_t &lb_index,
  * ... which is 0 to 7 in binary. The logic below simply extends this
  * to n dimensions.
  */
-template<typename T>
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::corner_offsets()
+RegularGridInterpolator<T, D>::corner_offsets()
 {
     for (size_t i=0; i < _n_corners; ++i) {
         size_t corner = 0;
@@ -110,21 +138,21 @@ RegularGridInterpolator<T>::corner_offsets()
     }
 }
 
-template<typename T>
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::corner_values(const size_t &lb_index, std::vector<T> &corners)
+RegularGridInterpolator<T, D>::corner_values(const size_t &lb_index, std::vector<T> &corners) const
 {
 
     for (size_t i=0; i<_corner_offsets.size(); i++) {
-        corners[i]=(_data[lb_index + _corner_offsets[i]]);
+        corners[i]=(_values[lb_index + _corner_offsets[i]]);
     }
 }
 
 // Reduces the vector of corners in-place for efficiency
-template<typename T>
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::_interpolate(const size_t &dim, std::vector<T> &corners, size_t size,
-    const std::vector<std::pair<T, T> > &offsets, T* value)
+RegularGridInterpolator<T, D>::_interpolate(const size_t &dim, std::vector<T> &corners, size_t size,
+    const std::vector<std::pair<T, T> > &offsets, T* value) const
 {
     for (size_t i=0; i<dim; ++i) {
         const std::pair<T, T> &this_offset=offsets[dim-i-1];
@@ -136,33 +164,217 @@ RegularGridInterpolator<T>::_interpolate(const size_t &dim, std::vector<T> &corn
     *value=corners[0];
 }
 
-template<typename T>
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::_interpolate1d(const std::pair<T, T> &offset, const T &lower, const T &upper, T *val)
+RegularGridInterpolator<T, D>::_interpolate1d(const std::pair<T, T> &offset, const T &lower, const T &upper, T *val) const
 {
     *val= offset.first*upper + offset.second*lower;
 }
 
-template<typename T>
+template<typename T, typename D>
 T
-RegularGridInterpolator<T>::interpolate(T *axis_vals)
+RegularGridInterpolator<T, D>::interpolate(T *axis_vals) const
 {
     T value[1];
     interpolate(axis_vals, 1, value);
     return value[0];
 }
 
-template<typename T>
+template<typename T, typename D>
 T
-RegularGridInterpolator<T>::interpolate(std::vector<T> axis_vals)
+RegularGridInterpolator<T, D>::interpolate(std::vector<T> axis_vals) const
 {
     return interpolate(axis_vals.data());
 }
 
 
-template<typename T>
+template<typename T, typename D>
+void
+RegularGridInterpolator<T, D>::interpolate (T* axis_vals, const size_t &n, T* values) const
+{
+    switch (_dim)
+    {
+        case 1: _interpolate_fixed<1>(axis_vals, n, values); return;
+        case 2: _interpolate_fixed<2>(axis_vals, n, values); return;
+        case 3: _interpolate_fixed<3>(axis_vals, n, values); return;
+        case 4: _interpolate_fixed<4>(axis_vals, n, values); return;
+        default: _interpolate_generic(axis_vals, n, values);
+    }
+}
+
+/*
+ * Same algorithm as the generic path below, but with the number of
+ * dimensions known at compile time, and with points processed in blocks of
+ * BLOCK_SIZE. Within a block, each stage (range check, lower-bound indices
+ * and weights, corner gathers, reduction along each axis) is a separate
+ * branch-free loop across the points, stored structure-of-arrays style so
+ * that the compiler can vectorise across points (with gathers for the
+ * corner values where the instruction set supports them). Lower-bound
+ * indices come from a multiply by the precomputed inverse step rather than
+ * a division and floor() - values are guaranteed to be above the axis
+ * minimum, so truncation is equivalent. Indices are 32-bit so that the
+ * double to integer conversion can be vectorised; the constructor rejects
+ * grids too large for this.
+ */
+template<typename T, typename D>
+template<size_t N>
+void
+RegularGridInterpolator<T, D>::_interpolate_fixed(const T *axis_vals, size_t n, T *values) const
+{
+    const size_t N_CORNERS = (size_t)1 << N;
+    T mins[N], maxs[N], inv_steps[N];
+    int32_t max_li[N], strides[N];
+    int32_t stride = 1;
+    for (size_t k=0; k<N; ++k) {
+        const size_t axis = N-k-1;
+        mins[axis] = _min[axis];
+        maxs[axis] = _max[axis];
+        inv_steps[axis] = _inv_step[axis];
+        // Guards against rounding up to the last grid point
+        max_li[axis] = (int32_t)_n[axis]-2;
+        strides[axis] = stride;
+        stride *= (int32_t)_n[axis];
+    }
+    int32_t corner_offsets[N_CORNERS];
+    for (size_t i=0; i<N_CORNERS; ++i)
+        corner_offsets[i] = (int32_t)_corner_offsets[i];
+    const D *data = _values;
+
+    T offsets[N][BLOCK_SIZE];
+    int32_t lb_index[BLOCK_SIZE];
+    T corners[N_CORNERS][BLOCK_SIZE];
+    for (size_t start=0; start<n; start+=BLOCK_SIZE)
+    {
+        const size_t m = std::min(BLOCK_SIZE, n-start);
+        const T *v = axis_vals + start*N;
+
+        int32_t bad = 0;
+        for (size_t axis=0; axis<N; ++axis)
+            for (size_t j=0; j<m; ++j) {
+                const T &value = v[j*N+axis];
+                // Written so that NaNs are also caught
+                bad |= !((value > mins[axis]) & (value < maxs[axis]));
+            }
+        if (bad)
+            _range_error(v, m, N);
+
+        for (size_t j=0; j<m; ++j)
+            lb_index[j] = 0;
+        for (size_t axis=0; axis<N; ++axis)
+            for (size_t j=0; j<m; ++j) {
+                T scaled = (v[j*N+axis]-mins[axis])*inv_steps[axis];
+                int32_t li = (int32_t)scaled;
+                li = li > max_li[axis] ? max_li[axis] : li;
+                offsets[axis][j] = scaled - (T)li;
+                lb_index[j] += strides[axis]*li;
+            }
+
+        for (size_t c=0; c<N_CORNERS; ++c)
+            for (size_t j=0; j<m; ++j)
+                corners[c][j] = data[lb_index[j] + corner_offsets[c]];
+
+        size_t size = N_CORNERS;
+        for (size_t i=0; i<N; ++i) {
+            const T *o = offsets[N-i-1];
+            for (size_t ind=0, c=0; c<size; ind++, c+=2)
+                for (size_t j=0; j<m; ++j)
+                    corners[ind][j] = o[j]*corners[c+1][j] + (1-o[j])*corners[c][j];
+            size/=2;
+        }
+        for (size_t j=0; j<m; ++j)
+            values[start+j] = corners[0][j];
+    }
+}
+
+template<typename T, typename D>
+void
+RegularGridInterpolator<T, D>::_range_error(const T *axis_vals, size_t n, size_t dim) const
+{
+    for (size_t i=0; i<n; ++i)
+        for (size_t axis=0; axis<dim; ++axis) {
+            const T &value = axis_vals[i*dim+axis];
+            if (!(value > _min[axis] && value < _max[axis])) {
+                std::cerr << "Value " << value << " is outside of the range " << _min[axis] << ".." << _max[axis] << std::endl;
+                throw std::range_error("Value outside of interpolation range!");
+            }
+        }
+}
+
+/*
+ * Each partial derivative is the same reduction over the corners as the
+ * value, except that along its own axis the pair of corners is differenced
+ * (and scaled by the inverse step) rather than interpolated. Corner bit j
+ * corresponds to axis dim-j-1, so reduction step i collapses that axis.
+ */
+template<typename T, typename D>
 void
-RegularGridInterpolator<T>::interpolate (T* axis_vals, const size_t &n, T* values)
+RegularGridInterpolator<T, D>::interpolate_with_gradient(const T* axis_vals,
+    size_t n, T* values, T* gradients, const T* periods) const
+{
+    std::vector<T> v(_dim), offsets(_dim);
+    std::vector<int32_t> strides(_dim);
+    int32_t stride = 1;
+    for (size_t k=0; k<_dim; ++k) {
+        const size_t axis = _dim-k-1;
+        strides[axis] = stride;
+        stride *= (int32_t)_n[axis];
+    }
+    std::vector<T> corners(_n_corners), reduced(_n_corners);
+    for (size_t p=0; p<n; ++p)
+    {
+        const T *in = axis_vals + p*_dim;
+        bool bad = false;
+        for (size_t axis=0; axis<_dim; ++axis) {
+            T value = in[axis];
+            if (periods != nullptr && periods[axis] > 0) {
+                const T &period = periods[axis];
+                T mid = (_min[axis]+_max[axis])/2;
+                value -= period*std::round((value-mid)/period);
+            }
+            // Written so that NaNs are also caught
+            bad |= !(value > _min[axis] && value < _max[axis]);
+            v[axis] = value;
+        }
+        if (bad)
+            _range_error(v.data(), 1, _dim);
+        int32_t lb_index = 0;
+        for (size_t axis=0; axis<_dim; ++axis) {
+            T scaled = (v[axis]-_min[axis])*_inv_step[axis];
+            int32_t li = std::min((int32_t)scaled, (int32_t)_n[axis]-2);
+            offsets[axis] = scaled - (T)li;
+            lb_index += strides[axis]*li;
+        }
+        for (size_t c=0; c<_n_corners; ++c)
+            corners[c] = _values[lb_index + _corner_offsets[c]];
+
+        // d = _dim gives the value, otherwise the derivative along axis d
+        for (size_t d=0; d<=_dim; ++d)
+        {
+            std::copy(corners.begin(), corners.end(), reduced.begin());
+            size_t size = _n_corners;
+            for (size_t i=0; i<_dim; ++i) {
+                const size_t axis = _dim-i-1;
+                const T &o = offsets[axis];
+                if (axis == d) {
+                    for (size_t ind=0, c=0; c<size; ind++, c+=2)
+                        reduced[ind] = (reduced[c+1]-reduced[c])*_inv_step[axis];
+                } else {
+                    for (size_t ind=0, c=0; c<size; ind++, c+=2)
+                        reduced[ind] = o*reduced[c+1] + (1-o)*reduced[c];
+                }
+                size/=2;
+            }
+            if (d == _dim)
+                values[p] = reduced[0];
+            else
+                gradients[p*_dim+d] = reduced[0];
+        }
+    }
+}
+
+template<typename T, typename D>
+void
+RegularGridInterpolator<T, D>::_interpolate_generic(T* axis_vals, size_t n, T* values) const
 {
     std::vector<std::pair<T, T>> offsets(_dim);
     std::vector<T> corners(_n_corners);
@@ -181,6 +393,7 @@ RegularGridInterpolator<T>::interpolate (T* axis_vals, const size_t &n, T* value
 typedef double fp_type;
 
 template class RegularGridInterpolator<fp_type>;
+template class RegularGridInterpolator<fp_type, float>;
 
 //--------------------------------------------------------
 // RegularGridInterpolator
@@ -202,6 +415,33 @@ rg_interp_new(size_t dim, uint32_t* n, fp_type* min, fp_type* max, fp_type* data
     } return nullptr;
 }
 
+//! Map grid i of a grid file (which must hold double values) without copying
+EXPORT void*
+rg_interp_new_from_file(const char *filename, size_t i)
+{
+    try {
+        auto f = shared_grid_file(std::string(filename));
+        return new RegularGridInterpolator<fp_type>(f->dim(), f->lengths(),
+            f->min(), f->max(), f->grid<fp_type>(i), f);
+    } catch (...) {
+        molc_error();
+    } return nullptr;
+}
+
+EXPORT void
+rg_interp_write_file(void *ptr, const char *filename)
+{
+    try {
+        RegularGridInterpolator<fp_type> *rg = static_cast<RegularGridInterpolator<fp_type> *>(ptr);
+        std::vector<uint32_t> lengths(rg->length().begin(), rg->length().end());
+        write_grid_file<fp_type>(std::string(filename), rg->dim(), lengths.data(),
+            rg->min().data(), rg->max().data(), {rg->data()});
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! The copy shares the (immutable) grid values with the original
 EXPORT void*
 rg_interp_copy(void *ptr)
 {
@@ -233,6 +473,22 @@ rg_interpolate(void* ptr, fp_type* axis_vals, size_t n, fp_type* values)
     }
 }
 
+/*! Values (n) and gradients (n*dim) at n points. periods may be null, or
+ *  give the period of each axis (zero for non-periodic axes).
+ */
+EXPORT void
+rg_interpolate_with_gradient(void* ptr, fp_type* axis_vals, size_t n,
+    fp_type* periods, fp_type* values, fp_type* gradients)
+{
+    try {
+        RegularGridInterpolator<fp_type> *rg = static_cast<RegularGridInterpolator<fp_type> *>(ptr);
+        rg->interpolate_with_gradient(axis_vals, n, values, gradients, periods);
+    } catch (...) {
+        molc_error();
+        return;
+    }
+}
+
 EXPORT void
 rg_interp_min(void* ptr, fp_type* ret)
 {
@@ -292,8 +548,9 @@ rg_interp_values(void* ptr, fp_type* ret)
 {
     try {
         RegularGridInterpolator<fp_type> *rg = static_cast<RegularGridInterpolator<fp_type> *>(ptr);
-        for (auto d: rg->data()) {
-            *ret++ = d;
+        auto d = rg->data();
+        for (size_t i=0; i<rg->size(); ++i) {
+            *ret++ = d[i];
         }
     } catch (...) {
         molc_error();
@@ -17,14 +17,25 @@
 
 #include <stdint.h>
 #include <vector>
+#include <memory>
+#include <unordered_set>
 #include <math.h>
 #include <iostream>
 #include "../molc.h"
+#include "../memory_report.h"
 
 namespace isolde
 {
 
-template <typename T>
+/*! T is the type used for axis values and arithmetic. D is the type in
+ *  which the grid values are stored: use float to halve the memory (and
+ *  cache) footprint of large tables.
+ *
+ *  The grid values are immutable and reference-counted: copies of an
+ *  interpolator share them rather than duplicating the table, so the same
+ *  grid can be handed to any number of managers cheaply.
+ */
+template <typename T, typename D=T>
 class RegularGridInterpolator
 {
 
@@ -42,27 +53,88 @@ public:
      *       defined by the previous arguments)
      */
     RegularGridInterpolator(const size_t &dim, uint32_t* n, T* min, T* max, T* data);
+    //! Construct a RegularGridInterpolator viewing data held elsewhere
+    /*!
+     * Nothing is copied. The data must stay valid for the life of the
+     * interpolator (and any copies of it): owner (e.g. the
+     * Mapped_Grid_File the data lives in) is kept alive to ensure that.
+     */
+    RegularGridInterpolator(const size_t &dim, const uint32_t* n, const T* min,
+        const T* max, const D* data, std::shared_ptr<const void> owner);
 
     //! Interpolate a single point
-    T interpolate(T *axis_vals);
+    T interpolate(T *axis_vals) const;
     //! Interpolate a single point
-    T interpolate(std::vector<T> axis_vals);
+    T interpolate(std::vector<T> axis_vals) const;
     //! Interpolate n points
-    void interpolate(T* axis_vals, const size_t &n, T* values);
+    /*!
+     * Grids of up to MAX_FIXED_DIM dimensions (which covers the
+     * Ramachandran and rotamer tables) are handled by a compile-time
+     * specialised kernel working on BLOCK_SIZE points at a time.
+     */
+    void interpolate(T* axis_vals, const size_t &n, T* values) const;
+    //! Interpolate n points, with the gradient at each
+    /*!
+     * gradients receives dim() partial derivatives (per unit of axis value)
+     * for each point. The interpolation is multilinear within each grid
+     * cell, so the gradient is exact for the interpolated surface (and
+     * discontinuous across cell boundaries).
+     *
+     * If periods is given, each axis with a positive period is treated as
+     * periodic: values are wrapped to within half a period of the middle of
+     * the axis before interpolation. This needs the grid to extend a little
+     * beyond one period, as the validation grids (padded by one wrapped
+     * point at each end) do.
+     */
+    void interpolate_with_gradient(const T* axis_vals, size_t n, T* values,
+        T* gradients, const T* periods=nullptr) const;
     const std::vector<T> &min() const {return _min;}
     const std::vector<T> &max() const {return _max;}
     const size_t &dim() const {return _dim;}
-    const std::vector<T> &data() const {return _data;}
+    //! The grid values (length size())
+    const D* data() const {return _values;}
+    size_t size() const {return _n_values;}
+    //! Number of interpolators (and other owners, e.g. a grid file registry) sharing the values
+    long data_use_count() const {return _owner.use_count();}
     const std::vector<size_t> &length() const {return _n;}
+    //! False if the values are viewed from elsewhere (e.g. a mapped grid file)
+    bool owns_data() const {return _owns_data;}
+    /*! Axis tables as container bytes, and the grid values as either
+     *  buffer or mapped bytes. The values are shared between copies, so
+     *  callers holding several should count each data() only once.
+     */
+    Memory_Usage memory_usage(bool include_values=true) const
+    {
+        Memory_Usage u;
+        u.objects = 1;
+        u.container_bytes = memory::vector_bytes(_n) + memory::vector_bytes(_min)
+            + memory::vector_bytes(_max) + memory::vector_bytes(_step)
+            + memory::vector_bytes(_inv_step) + memory::vector_bytes(_axes)
+            + memory::vector_bytes(_corner_offsets) + memory::vector_bytes(_jump);
+        for (const auto& a: _axes)
+            u.container_bytes += memory::vector_bytes(a);
+        if (include_values)
+            (_owns_data ? u.buffer_bytes : u.mapped_bytes) += _n_values*sizeof(D);
+        return u;
+    }
+
+    static const size_t MAX_FIXED_DIM = 4;
+    //! Number of points interpolated together by the fixed-dimension kernel
+    static const size_t BLOCK_SIZE = 8;
 
 private:
-    void corner_values(const size_t &lb_indices, std::vector<T> &corners);
+    template <size_t N>
+    void _interpolate_fixed(const T *axis_vals, size_t n, T *values) const;
+    void _interpolate_generic(T *axis_vals, size_t n, T *values) const;
+    void _range_error(const T *axis_vals, size_t n, size_t dim) const;
+    void corner_values(const size_t &lb_indices, std::vector<T> &corners) const;
     void lb_index_and_offsets(T *axis_vals, size_t &lb_index,
-        std::vector<std::pair<T, T> > &offsets);
+        std::vector<std::pair<T, T> > &offsets) const;
     void _interpolate(const size_t &dim, std::vector<T> &corners, size_t size,
-    const std::vector<std::pair<T, T> > &offsets, T *value);
-    void _interpolate1d(const std::pair<T, T> &offset, const T& lower, const T& upper, T *val);
+    const std::vector<std::pair<T, T> > &offsets, T *value) const;
+    void _interpolate1d(const std::pair<T, T> &offset, const T& lower, const T& upper, T *val) const;
     void corner_offsets();
+    size_t _init_axes(const size_t &dim, const uint32_t* n, const T* min, const T* max);
 
     size_t _dim;
     size_t _n_corners;
@@ -70,16 +142,49 @@ private:
     std::vector<T> _min;
     std::vector<T> _max;
     std::vector<T> _step;
+    std::vector<T> _inv_step;
     std::vector<std::vector<T> > _axes;
 
-    //TODO: Replace _data with a std::unordered_map sparse array implementation
-    //      to minimise memory use for higher dimensions
-    std::vector<T> _data;
+    //TODO: Replace the dense grid with a std::unordered_map sparse array
+    //      implementation to minimise memory use for higher dimensions
+    const D* _values = nullptr;
+    size_t _n_values = 0;
+    bool _owns_data = false;
+    // Keeps _values alive: a std::vector<D> of our own, or e.g. a mapped file
+    std::shared_ptr<const void> _owner;
     std::vector<size_t> _corner_offsets;
     std::vector<size_t> _jump;
 
 }; //RegularGridInterpolator
 
+/*! Memory used by all the interpolators in a map (values of type
+ *  RegularGridInterpolator), counting grid values already in seen only once.
+ */
+template <typename Map>
+Memory_Usage interpolator_memory_usage(const Map& interpolators,
+    std::unordered_set<const void*>& seen)
+{
+    Memory_Usage u;
+    u.container_bytes = memory::hash_bytes(interpolators);
+    for (const auto& it: interpolators)
+        u += it.second.memory_usage(seen.insert(it.second.data()).second);
+    return u;
+}
+
+//! Natural log of each of n values, with values below floor clamped to floor
+/*!
+ * Used to build log-probability grids, so that interpolation directly gives
+ * values ready for a log-scaled colormap.
+ */
+template <typename T>
+std::vector<T> log_values(const T *data, size_t n, T floor)
+{
+    std::vector<T> logs(n);
+    for (size_t i=0; i<n; ++i)
+        logs[i] = log(data[i] > floor ? data[i] : floor);
+    return logs;
+}
+
 
 } //namespace isolde
 
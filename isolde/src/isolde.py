@@ -1858,26 +1858,13 @@ class Isolde():
         restraint_params = ss_restraints[target]
         from . import session_extensions as sx
         dr_m = sx.get_distance_restraint_mgr(m)
-        o_to_n_plus_four, ca_to_ca_plus_two = dr_m.add_ss_restraints(residues)
-        o_to_n_plus_four.targets = restraint_params.O_TO_N_PLUS_FOUR_DISTANCE
-        ca_to_ca_plus_two.targets = restraint_params.CA_TO_CA_PLUS_TWO_DISTANCE
-        o_to_n_plus_four.spring_constants = dist_k
-        ca_to_ca_plus_two.spring_constants = dist_k
-        o_to_n_plus_four.enableds = True
-        ca_to_ca_plus_two.enableds = True
+        dr_m.restrain_secondary_structure(residues,
+            restraint_params.O_TO_N_PLUS_FOUR_DISTANCE,
+            restraint_params.CA_TO_CA_PLUS_TWO_DISTANCE, dist_k)
 
         pdr_m = sx.get_proper_dihedral_restraint_mgr(m)
-        phi = pdr_m.add_restraints_by_residues_and_name(residues, 'phi')
-        phi.targets = restraint_params.PHI_ANGLE
-        phi.spring_constants = dihed_k
-        phi.cutoffs = restraint_params.CUTOFF_ANGLE
-        phi.enableds = True
-
-        psi = pdr_m.add_restraints_by_residues_and_name(residues, 'psi')
-        psi.targets = restraint_params.PSI_ANGLE
-        psi.spring_constants = dihed_k
-        psi.cutoffs = restraint_params.CUTOFF_ANGLE
-        psi.enableds = True
+        pdr_m.restrain_secondary_structure(residues, restraint_params.PHI_ANGLE,
+            restraint_params.PSI_ANGLE, restraint_params.CUTOFF_ANGLE, dihed_k)
 
     def _increment_register_shift(self, *_):
         self.iw._rebuild_register_shift_nres_spinbox.stepUp()
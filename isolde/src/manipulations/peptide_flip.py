@@ -22,7 +22,8 @@ class Peptide_Bond_Flipper:
     printed to the ChimeraX log. If the restraints are satisfied to within
     :attr:`SimParams.dihedral_restraint_cutoff_angle` within the step limit,
     a "polishing" phase is triggered in which the restraint cutoff angles are
-    reduced to zero and maintained for ten coordinate updates, at which point
+    reduced to zero and maintained for ten coordinate updates' worth of
+    simulation steps (timed by the simulation thread itself), at which point
     the restraints are released. There is no real need to keep a handle to a
     :class:`Peptide_Bond_Flipper` instance - just fire and forget.
     '''
@@ -80,7 +81,7 @@ class Peptide_Bond_Flipper:
         offsets = numpy.abs(phipsi.offsets)
         if numpy.all(offsets < phipsi.cutoffs):
             phipsi.cutoffs = 0
-            self._attempt_counter = 0
+            self._start_polish()
             self._coord_update_handler = isolde.sim_handler.triggers.add_handler(
                 'coord update', self._final_polish_cb
             )
@@ -95,11 +96,30 @@ class Peptide_Bond_Flipper:
             from chimerax.core.triggerset import DEREGISTER
             return DEREGISTER
 
+    def _start_polish(self):
+        '''
+        Hand the polishing phase to the simulation thread: the restraints
+        stay as they are for the polishing steps, then switch off.
+        '''
+        import numpy
+        phipsi = self.phipsi
+        sh = self.isolde.sim_handler
+        keyframes = numpy.empty((2, 2, 4))
+        keyframes[:,:,1] = phipsi.spring_constants
+        keyframes[:,:,2] = phipsi.targets
+        keyframes[:,:,3] = numpy.cos(phipsi.cutoffs)
+        keyframes[0,:,0] = 1
+        keyframes[1,:,0] = 0
+        self._polish = sh.animate_restraints('dihedral', phipsi.sim_indices,
+            keyframes, 10*self.sim_params.sim_steps_per_gui_update,
+            stepped=(True, False, False, False))
+
     def _final_polish_cb(self, *_):
-        if self._attempt_counter >= 10:
-            import numpy
-            phipsi = self.phipsi
-            phipsi.enableds = False
-            from chimerax.core.triggerset import DEREGISTER
-            return DEREGISTER
-        self._attempt_counter += 1
+        sh = self.isolde.sim_handler
+        progress = sh.restraint_animation_progress(self._polish)
+        if progress is not None and progress < 1:
+            return
+        sh.end_restraint_animation(self._polish)
+        self.phipsi.enableds = False
+        from chimerax.core.triggerset import DEREGISTER
+        return DEREGISTER
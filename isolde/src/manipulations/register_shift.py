@@ -31,7 +31,10 @@ class Protein_Register_Shifter:
     CB (or HA3 for glycine) atoms of the problem residues respectively). These
     splines are then used to define the positions of position restraints for
     each N, CA, C and CB, which move smoothly along the spline traversing one
-    register position for every ten coordinate updates. This provides a smooth
+    register position for every ten coordinate updates' worth of simulation
+    steps. The whole path is worked out in advance and handed to the
+    simulation thread, which moves the targets along it between blocks of
+    steps (see :func:`Sim_Handler.animate_restraints`). This provides a smooth
     transition from starting to final positions, avoiding any risk of clashes
     or excessive forces. When the traversal is finished the restraints will
     remain in place until :func:`release_all` is called, allowing the user to
@@ -66,11 +69,13 @@ class Protein_Register_Shifter:
                defaults.OPENMM_SPRING_UNIT
            ) # kJ/mol/A2
 
-        # Number of GUI update steps between each residue along the spline
+        # Number of keyframes between each residue along the spline, and the
+        # number of simulation steps from one keyframe to the next
         self.spline_steps_per_residue = 10
+        self.sim_steps_per_spline_step = isolde.sim_params.sim_steps_per_gui_update
         self._spline_step = 1/self.spline_steps_per_residue
-        # Current value of the spline parameter
-        self._current_position_on_spline = 0
+        # ID of the restraint animation on the simulation thread
+        self._animation = None
 
         from chimerax.core.triggerset import TriggerSet
         triggers = self.triggers = TriggerSet()
@@ -83,7 +88,7 @@ class Protein_Register_Shifter:
 
         self.finished = False
 
-        # Trigger handler to update position along spline
+        # Trigger handler checking on progress along the spline
         self._handler = None
 
         self.session = session
@@ -190,7 +195,14 @@ class Protein_Register_Shifter:
 
         self._positions_along_spline = (p.indices(xr) - spline_start_index).astype(float)
 
-        self._handler = isolde.sim_handler.triggers.add_handler('coord update', self._step_forward)
+        prs, keyframes = self._keyframes()
+        self._restraints = prs
+        self._final_keyframe = keyframes[-1]
+        sh = isolde.sim_handler
+        self._animation = sh.animate_restraints('position', prs.sim_indices,
+            keyframes, self.sim_steps_per_spline_step,
+            stepped=(True, False, False, False, False))
+        self._handler = sh.triggers.add_handler('coord update', self._check_progress)
         self.triggers.activate_trigger('register shift started', self)
 
     def release_all(self):
@@ -198,80 +210,69 @@ class Protein_Register_Shifter:
         Release all restraints and clean up. Once this is run this object should
         no longer be used.
         '''
+        isolde = self.isolde
+        if isolde.simulation_running:
+            if self._animation is not None:
+                isolde.sim_handler.end_restraint_animation(self._animation)
+            if self._handler is not None:
+                isolde.sim_handler.triggers.remove_handler(self._handler)
+        self._animation = None
+        self._handler = None
         if self._extended_residues is not None:
             self.isolde.release_xyz_restraints_on_selected_atoms(sel = self._extended_residues.atoms)
-        isolde = self.isolde
-        if isolde.simulation_running and self._handler is not None:
-            isolde.sim_handler.triggers.remove_handler(self._handler)
-            self._handler = None
         self.triggers.activate_trigger('register shift released', self)
 
-    def _step_forward(self, *_):
+    def _keyframes(self):
         '''
-        Move one step forward along the spline, and adjust the target
-        positions accordingly.
+        Returns the position restraints on the N, CA, C and CB atoms of the
+        extended selection, and their parameters (enabled, k, x0, y0, z0 in
+        OpenMM units) at each step along the spline as a (n_steps+1, n, 5)
+        array. Atoms off either end of the spline at a given step are
+        disabled there, with their targets held at the nearest end so that
+        they don't jump on entering it.
         '''
-        isolde = self.isolde
-        xr = self._extended_residues
+        from chimerax.atomic import Atoms
         xa = self._extended_atoms
-        if abs(self._current_position_on_spline) >= abs(self._shift_length):
-            # Our target has reached the end of the spline. Switch to a
-            # final "polishing" routine
-            isolde.sim_handler.triggers.remove_handler(self._handler)
-            self._handler = None
-            self.finished = True
-            self.triggers.activate_trigger('register shift finished', self)
-            #self._handler = self.isolde.triggers.add_handler('completed simulation step', self._final_polish)
-        self._current_position_on_spline += self._spline_step
-        sp = self._positions_along_spline
-        sp += self._spline_step
-        outside = numpy.logical_or(sp < 0, sp > self._spline_length-1)
-        inside = numpy.argwhere(numpy.invert(outside)).ravel()
-        outside = numpy.argwhere(outside).ravel()
-        # Release restraints on atoms outside of the spline
-        out_a = xr[outside].atoms
-        if len(out_a):
-            isolde.release_xyz_restraints_on_selected_atoms(sel = out_a)
-
-        # Update the restraints on atoms inside of the spline
-        in_a = xa[inside]
-        in_pos = sp[inside]
-
-        nspl = self.n_spline
-        caspl = self._ca_spline
-        cspl = self._c_spline
-        cbspl = self._cb_spline
-
+        has_atom = (xa != None)
+        prs = self._pr_mgr.add_restraints(Atoms(xa[has_atom]))
+        n_steps = int(round(abs(self._shift_length)*self.spline_steps_per_residue))
+        positions = (self._positions_along_spline[numpy.newaxis,:]
+            + (numpy.arange(n_steps+1)*self._spline_step)[:,numpy.newaxis])
+        end = self._spline_length-1
+        inside = numpy.logical_and(positions >= 0, positions <= end)
+        clipped = numpy.clip(positions, 0, end).ravel()
+        n_kf, nres = positions.shape
+        targets = numpy.empty((n_kf, nres, 4, 3))
         splev = interpolate.splev
-        #restraints = isolde._sim_pos_restr
-        pr_mgr = self._pr_mgr
-        k = self.spring_constant
-
-        n_targets = numpy.column_stack(splev(in_pos, nspl[0]))
-        ca_targets = numpy.column_stack(splev(in_pos, caspl[0]))
-        c_targets = numpy.column_stack(splev(in_pos, cspl[0]))
-        cb_targets = numpy.column_stack(splev(in_pos, cbspl[0]))
-        #all_targets = numpy.column_stack((n_targets, ca_targets, c_targets, cb_targets))
-        from chimerax.atomic import Atoms
-        for i, targets in enumerate((n_targets, ca_targets, c_targets, cb_targets)):
-            atoms = in_a[:,i]
-            mask = atoms != None
-            targets = targets[mask]
-            atoms = Atoms(atoms[mask])
-            prs = pr_mgr.get_restraints(atoms)
-            prs.targets = targets
-            prs.spring_constants=k
-            prs.enableds = True
-
-
-        # r_list = []
-        #
-        # for n_t, ca_t, c_t, cb_t, atoms in zip(n_targets, ca_targets, c_targets, cb_targets, in_a):
-        #     for t, a in zip((n_t, ca_t, c_t, cb_t), atoms):
-        #         if a is not None:
-        #             rest = restraints[a]
-        #             rest.target = t
-        #             rest.spring_constant = k
-        #             r_list.append(restraints.index(rest))
-        # r_list = numpy.array(r_list, numpy.int)
-        # isolde._sim_interface.update_position_restraints(restraints[r_list])
+        for i, spl in enumerate((self.n_spline, self._ca_spline, self._c_spline,
+                self._cb_spline)):
+            targets[:,:,i] = numpy.column_stack(splev(clipped, spl[0])).reshape((n_kf, nres, 3))
+        enableds = numpy.repeat(inside[:,:,numpy.newaxis], 4, axis=2)
+        keyframes = numpy.empty((n_kf, len(prs), 5))
+        keyframes[:,:,0] = enableds[:, has_atom]
+        keyframes[:,:,1] = self.spring_constant
+        keyframes[:,:,2:] = targets[:, has_atom]/10
+        in_sim = prs.sim_indices != -1
+        return prs[in_sim], keyframes[:, in_sim]
+
+    def _check_progress(self, *_):
+        '''
+        Once the simulation thread has reached the end of the spline, leave
+        the restraints in their final state.
+        '''
+        sh = self.isolde.sim_handler
+        progress = sh.restraint_animation_progress(self._animation)
+        if progress is not None and progress < 1:
+            return
+        from chimerax.core.triggerset import DEREGISTER
+        sh.end_restraint_animation(self._animation)
+        self._animation = None
+        self._handler = None
+        final = self._final_keyframe
+        prs = self._restraints
+        prs.spring_constants = final[:,1]
+        prs.targets = final[:,2:]*10
+        prs.enableds = final[:,0] > 0.5
+        self.finished = True
+        self.triggers.activate_trigger('register shift finished', self)
+        return DEREGISTER
@@ -0,0 +1,79 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_MEMORY_REPORT
+#define ISOLDE_MEMORY_REPORT
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace isolde
+{
+
+/*! Approximate memory held by one manager, for the "isolde memory" report.
+ *  Standard containers don't expose their allocations, so node-based ones
+ *  are estimated from their sizes and bucket counts using libstdc++'s node
+ *  layouts. Good enough to see what dominates a session, not to the byte.
+ */
+struct Memory_Usage
+{
+    //! Managed objects (dihedrals, restraints, grids, ...)
+    size_t objects = 0;
+    //! Maps, indices and lists used to find and track the objects
+    size_t container_bytes = 0;
+    //! Storage for the objects themselves, packed tables, caches and scratch
+    size_t buffer_bytes = 0;
+    //! Read-only file mappings (shared with every other process using them)
+    size_t mapped_bytes = 0;
+
+    Memory_Usage& operator+=(const Memory_Usage& other)
+    {
+        objects += other.objects;
+        container_bytes += other.container_bytes;
+        buffer_bytes += other.buffer_bytes;
+        mapped_bytes += other.mapped_bytes;
+        return *this;
+    }
+}; // struct Memory_Usage
+
+namespace memory
+{
+
+template <typename T>
+size_t vector_bytes(const std::vector<T>& v) { return v.capacity()*sizeof(T); }
+
+//! Heap used by a string (zero if it fits in the small-string buffer)
+inline size_t string_bytes(const std::string& s)
+{
+    return s.capacity() > 15 ? s.capacity()+1 : 0;
+}
+
+//! Bucket array plus one node (next pointer, cached hash, value) per entry
+template <typename Map>
+size_t hash_bytes(const Map& m)
+{
+    return m.bucket_count()*sizeof(void*)
+        + m.size()*(sizeof(typename Map::value_type) + 2*sizeof(void*));
+}
+
+//! One red-black tree node (three links and a colour) per entry
+template <typename Tree>
+size_t tree_bytes(const Tree& t)
+{
+    return t.size()*(sizeof(typename Tree::value_type) + 4*sizeof(void*));
+}
+
+} // namespace memory
+} // namespace isolde
+
+#endif // ISOLDE_MEMORY_REPORT
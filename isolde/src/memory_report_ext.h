@@ -0,0 +1,122 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef MEMORY_REPORT_EXT
+#define MEMORY_REPORT_EXT
+
+#include "memory_report.h"
+#include "atomic_cpp/dihedral_mgr.h"
+#include "atomic_cpp/chiral_mgr.h"
+#include "validation/rama.h"
+#include "validation/rota.h"
+#include "restraints_cpp/changetracker.h"
+#include "restraints_cpp/mdff.h"
+#include "restraints_cpp/position_restraints.h"
+#include "restraints_cpp/distance_restraints.h"
+#include "restraints_cpp/adaptive_distance_restraints.h"
+#include "restraints_cpp/dihedral_restraints.h"
+#include "restraints_cpp/rotamer_restraints.h"
+
+#include "molc.h"
+using namespace isolde;
+
+/*************************************
+ *
+ * Memory accounting
+ *
+ *************************************/
+
+//! Must be kept in sync with MEMORY_REPORT_KINDS in molobject.py
+enum Memory_Report_Kind
+{
+    MEM_PROPER_DIHEDRAL_MGR = 0,
+    MEM_CHIRAL_MGR,
+    MEM_RAMA_MGR,
+    MEM_RAMA_GRIDS,
+    MEM_ROTA_MGR,
+    MEM_ROTA_GRIDS,
+    MEM_CHANGE_TRACKER,
+    MEM_MDFF_MGR,
+    MEM_POSITION_RESTRAINT_MGR,
+    MEM_TUGGABLE_ATOMS_MGR,
+    MEM_DISTANCE_RESTRAINT_MGR,
+    MEM_ADAPTIVE_DISTANCE_RESTRAINT_MGR,
+    MEM_CHIRAL_RESTRAINT_MGR,
+    MEM_PROPER_DIHEDRAL_RESTRAINT_MGR,
+    MEM_ADAPTIVE_DIHEDRAL_RESTRAINT_MGR,
+    MEM_ROTAMER_RESTRAINT_MGR,
+    MEM_NUM_KINDS
+};
+
+static Memory_Usage manager_memory_usage(void *mgr, int32_t kind)
+{
+    switch (kind)
+    {
+        case MEM_PROPER_DIHEDRAL_MGR:
+            return static_cast<ProperDihedralMgr *>(mgr)->memory_usage();
+        case MEM_CHIRAL_MGR:
+            return static_cast<ChiralMgr *>(mgr)->memory_usage();
+        case MEM_RAMA_MGR:
+            return static_cast<RamaMgr *>(mgr)->memory_usage();
+        case MEM_RAMA_GRIDS:
+            return static_cast<RamaMgr *>(mgr)->interpolator_memory_usage();
+        case MEM_ROTA_MGR:
+            return static_cast<RotaMgr *>(mgr)->memory_usage();
+        case MEM_ROTA_GRIDS:
+            return static_cast<RotaMgr *>(mgr)->interpolator_memory_usage();
+        case MEM_CHANGE_TRACKER:
+            return static_cast<Change_Tracker *>(mgr)->memory_usage();
+        case MEM_MDFF_MGR:
+            return static_cast<MDFFMgr *>(mgr)->memory_usage();
+        case MEM_POSITION_RESTRAINT_MGR:
+            return static_cast<PositionRestraintMgr *>(mgr)->memory_usage();
+        case MEM_TUGGABLE_ATOMS_MGR:
+            return static_cast<TuggableAtomsMgr *>(mgr)->memory_usage();
+        case MEM_DISTANCE_RESTRAINT_MGR:
+            return static_cast<DistanceRestraintMgr *>(mgr)->memory_usage();
+        case MEM_ADAPTIVE_DISTANCE_RESTRAINT_MGR:
+            return static_cast<AdaptiveDistanceRestraintMgr *>(mgr)->memory_usage();
+        case MEM_CHIRAL_RESTRAINT_MGR:
+            return static_cast<ChiralRestraintMgr *>(mgr)->memory_usage();
+        case MEM_PROPER_DIHEDRAL_RESTRAINT_MGR:
+            return static_cast<ProperDihedralRestraintMgr *>(mgr)->memory_usage();
+        case MEM_ADAPTIVE_DIHEDRAL_RESTRAINT_MGR:
+            return static_cast<AdaptiveDihedralRestraintMgr *>(mgr)->memory_usage();
+        case MEM_ROTAMER_RESTRAINT_MGR:
+            return static_cast<RotamerRestraintMgr *>(mgr)->memory_usage();
+        default:
+            throw std::invalid_argument("Unrecognised manager kind!");
+    }
+}
+
+/*! For each of n managers, writes (objects, container bytes, buffer bytes,
+ *  mapped bytes) to usage[4*i...]. kinds gives the type of each manager,
+ *  as a Memory_Report_Kind.
+ */
+extern "C" EXPORT void
+isolde_memory_usage(size_t n, void **mgrs, int32_t *kinds, size_t *usage)
+{
+    try {
+        for (size_t i=0; i<n; ++i)
+        {
+            auto u = manager_memory_usage(mgrs[i], kinds[i]);
+            *usage++ = u.objects;
+            *usage++ = u.container_bytes;
+            *usage++ = u.buffer_bytes;
+            *usage++ = u.mapped_bytes;
+        }
+    } catch (...) {
+        molc_error();
+    }
+}
+
+#endif //MEMORY_REPORT_EXT
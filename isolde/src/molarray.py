@@ -348,6 +348,20 @@ class TuggableAtoms(PositionRestraints):
     def __init__(self, c_pointers=None):
         super().__init__(c_pointers, single_type=TuggableAtom, poly_type = TuggableAtoms)
 
+    def set_targets_untracked(self, targets):
+        '''
+        Set new target (x,y,z) positions in Angstroms without notifying the
+        change tracker, so no 'changes' trigger fires. Used by
+        :func:`TuggableAtomsMgr.tug` when the targets are sent to the
+        simulation directly.
+        '''
+        f = c_function('set_position_restraint_target_untracked',
+            args = (ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double)))
+        targets = numpy.ascontiguousarray(targets, float64)
+        if targets.shape != (len(self), 3):
+            raise ValueError('Need one (x,y,z) target per tuggable!')
+        f(self._c_pointers, len(self), pointer(targets))
+
     def take_snapshot(self, session, flags):
         tams = [t.mgr for t in self]
         data = {
@@ -434,6 +448,22 @@ class DistanceRestraints(Collection):
         f(self._c_pointers, n, pointer(transforms))
         return Places(opengl_array=transforms)
 
+    @property
+    def _bond_and_target_transforms(self):
+        '''
+        Equivalent to (self._bond_cylinder_transforms, self._target_transforms),
+        computed in a single pass. Read only.
+        '''
+        from chimerax.core.geometry import Places
+        f = c_function('distance_restraint_transforms',
+            args=(ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_float), ctypes.POINTER(ctypes.c_float)))
+        n = len(self)
+        bonds = empty((n,4,4), float32)
+        targets = empty((n,4,4), float32)
+        f(self._c_pointers, n, pointer(bonds), pointer(targets))
+        return tuple(Places(opengl_array=tf) for tf in (bonds, targets))
+
     def clear_sim_indices(self):
         '''
         Run at the end of a simulation to reset sim indices to -1
@@ -500,6 +530,32 @@ class AdaptiveDistanceRestraints(Collection):
         f(self._c_pointers, n, pointer(tf_ends), pointer(tf_m))
         return tuple(Places(opengl_array=tf) for tf in (tf_ends, tf_m))
 
+    @property
+    def _bond_transforms_and_colors(self):
+        '''
+        Returns a 4-tuple of (end transforms, middle transforms, end colors,
+        middle colors) for drawing the tripartite bonds, computed in a single
+        pass. Read only.
+        '''
+        from chimerax.core.geometry import Places
+        f = c_function('adaptive_distance_restraint_bond_transforms_and_colors',
+            args= (ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_float),
+                ctypes.POINTER(ctypes.c_float),
+                ctypes.POINTER(ctypes.c_uint8),
+                ctypes.POINTER(ctypes.c_uint8),
+            )
+        )
+        n = len(self)
+        tf_ends = empty((n*2,4,4), float32)
+        tf_m = empty((n,4,4), float32)
+        end_colors = empty((n*2,4), uint8)
+        mid_colors = empty((n,4), uint8)
+        f(self._c_pointers, n, pointer(tf_ends), pointer(tf_m),
+            pointer(end_colors), pointer(mid_colors))
+        return (Places(opengl_array=tf_ends), Places(opengl_array=tf_m),
+            end_colors, mid_colors)
+
     def clear_sim_indices(self):
         '''
         Run at the end of a simulation to reset sim indices to -1
@@ -508,6 +564,29 @@ class AdaptiveDistanceRestraints(Collection):
             args = (ctypes.c_void_p, ctypes.c_size_t))
         f(self._c_pointers, len(self))
 
+    def set_sim_forces(self, forces):
+        '''
+        Set the force (kJ/mol/Angstrom) each restraint is applying in a running
+        simulation, to be reported by :attr:`applied_forces` (and used for
+        drawing) until the restraint's parameters change or
+        :func:`clear_sim_forces` is called.
+        '''
+        f = c_function('adaptive_distance_restraint_set_sim_force',
+            args = (ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double)))
+        forces = numpy.ascontiguousarray(forces, float64)
+        if len(forces) != len(self):
+            raise ValueError('Need one force per restraint!')
+        f(self._c_pointers, len(self), pointer(forces))
+
+    def clear_sim_forces(self):
+        '''
+        Go back to calculating :attr:`applied_forces` from the current
+        coordinates.
+        '''
+        f = c_function('adaptive_distance_restraint_clear_sim_force',
+            args = (ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointers, len(self))
+
 
     enableds =cvec_property('adaptive_distance_restraint_enabled', npy_bool,
             doc = 'Enable/disable these restraints or get their current states.')
@@ -758,6 +837,17 @@ class RotamerRestraints(Collection):
             args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double))
         f(self._c_pointers, len(self), k)
 
+    def set_spring_constants(self, k):
+        '''
+        Sets the spring constant for all chi dihedrals of each rotamer, from
+        an array with one value per rotamer. Write-only.
+        '''
+        k = numpy.ascontiguousarray(k, float64)
+        if len(k) != len(self):
+            raise TypeError('Need one spring constant per rotamer restraint!')
+        f = c_function('set_rotamer_restraint_spring_constants',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+        f(self._c_pointers, len(self), pointer(k))
 
     rotamers = cvec_property('rotamer_restraint_rotamer', cptr, astype=_rotamers, read_only=True,
         doc = ':py:class:`Rotamers` to be restrained. Read only.')
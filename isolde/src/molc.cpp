@@ -30,10 +30,15 @@
 #include "atomic_cpp/dihedral_mgr_ext.h"
 #include "atomic_cpp/chiral_ext.h"
 #include "atomic_cpp/chiral_mgr_ext.h"
+#include "atomic_cpp/atom_index_ext.h"
+#include "atomic_cpp/symmetry_contacts_ext.h"
+#include "atomic_cpp/sim_regions_ext.h"
+#include "atomic_cpp/checkpoint_store_ext.h"
 #include "atomic_cpp/util.h"
 
 #include "validation/rama_ext.h"
 #include "validation/rota_ext.h"
+#include "validation/snapshot_validator_ext.h"
 
 #include "restraints_cpp/changetracker_ext.h"
 #include "restraints_cpp/mdff_ext.h"
@@ -42,3 +47,5 @@
 #include "restraints_cpp/adaptive_distance_restraints_ext.h"
 #include "restraints_cpp/dihedral_restraints_ext.h"
 #include "restraints_cpp/rotamer_restraints_ext.h"
+
+#include "memory_report_ext.h"
@@ -210,11 +210,93 @@ def get_rotamer_mgr(session):
         return session.rota_mgr
     return RotaMgr(session)
 
+def get_atom_index(model, create=True, refresh=True):
+    '''
+    Get the :class:`AtomIndex` for the given model, creating it if it doesn't
+    yet exist. The index is rebuilt if atoms have been added since it was
+    made.
+
+    Args:
+        * model:
+            - a :class:`chimerax.AtomicStructure`
+        * create:
+            - if False and no index exists, returns None
+        * refresh:
+            - if True, re-read all coordinates so that edits made since the
+              last query are seen. Atoms that are still in the same cell cost
+              almost nothing. Code that keeps the index current itself (e.g.
+              from the simulation's moved atoms) can skip this.
+    '''
+    idx = getattr(model, '_isolde_atom_index', None)
+    if idx is not None and not idx.deleted:
+        if len(idx) == model.num_atoms:
+            if refresh:
+                idx.update()
+            return idx
+        idx.delete()
+    if not create:
+        return None
+    idx = model._isolde_atom_index = AtomIndex(model)
+    return idx
+
 def _get_restraint_change_tracker(session):
     if hasattr(session, 'isolde_changes') and not session.isolde_changes.deleted:
         return session.isolde_changes
     return RestraintChangeTracker(session)
 
+# Must be kept in sync with Memory_Report_Kind in memory_report_ext.h
+MEMORY_REPORT_KINDS = (
+    'ProperDihedralMgr', 'ChiralMgr', 'RamaMgr', 'RamaMgr grids', 'RotaMgr',
+    'RotaMgr grids', 'RestraintChangeTracker', 'MDFFMgr', 'PositionRestraintMgr',
+    'TuggableAtomsMgr', 'DistanceRestraintMgr', 'AdaptiveDistanceRestraintMgr',
+    'ChiralRestraintMgr', 'ProperDihedralRestraintMgr',
+    'AdaptiveDihedralRestraintMgr', 'RotamerRestraintMgr',
+)
+
+def memory_usage(session):
+    '''
+    Approximate memory held on the C++ side by each existing ISOLDE manager in
+    the session (none are created). Returns a list of (name, kind, objects,
+    container bytes, buffer bytes, mapped bytes) tuples, where "container"
+    covers the maps and indices used to find objects, "buffer" the storage
+    for the objects themselves along with packed tables and caches, and
+    "mapped" any read-only grid files. Node-based containers are estimated
+    from their sizes, so treat the numbers as a guide rather than exact.
+    '''
+    kinds = MEMORY_REPORT_KINDS
+    mgrs = []
+    for attr, names in (
+            ('proper_dihedral_mgr', ('ProperDihedralMgr',)),
+            ('chiral_mgr', ('ChiralMgr',)),
+            ('rama_mgr', ('RamaMgr', 'RamaMgr grids')),
+            ('rota_mgr', ('RotaMgr', 'RotaMgr grids')),
+            ('isolde_changes', ('RestraintChangeTracker',))):
+        mgr = getattr(session, attr, None)
+        if mgr is None or mgr.deleted:
+            continue
+        for kind_name in names:
+            mgrs.append((kind_name, kind_name, mgr))
+    # Most derived classes first
+    restraint_classes = (AdaptiveDihedralRestraintMgr, ProperDihedralRestraintMgr,
+        ChiralRestraintMgr, RotamerRestraintMgr, AdaptiveDistanceRestraintMgr,
+        DistanceRestraintMgr, TuggableAtomsMgr, PositionRestraintMgr, MDFFMgr)
+    for m in session.models.list():
+        if m.deleted:
+            continue
+        for cls in restraint_classes:
+            if isinstance(m, cls):
+                mgrs.append(('{} #{}'.format(m.name, m.id_string), cls.__name__, m))
+                break
+    n = len(mgrs)
+    usage = numpy.zeros((n, 4), numpy.uintp)
+    if n:
+        ptrs = numpy.array([m._c_pointer.value for _, _, m in mgrs], numpy.uintp)
+        kind_ids = numpy.array([kinds.index(k) for _, k, _ in mgrs], int32)
+        f = c_function('isolde_memory_usage',
+            args=(ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p))
+        f(n, pointer(ptrs), pointer(kind_ids), pointer(usage))
+    return [(name, kind, *[int(v) for v in u]) for (name, kind, _), u in zip(mgrs, usage)]
+
 
 # Useful utilities not available in ChimeraX main API
 def residue_bonded_neighbors(residue):
@@ -224,6 +306,72 @@ def residue_bonded_neighbors(residue):
     from chimerax.atomic import Residues
     return Residues(f(residue._c_pointer))
 
+class SimRegionState(IntEnum):
+    '''
+    Per-atom states returned by :func:`build_sim_regions`.
+    '''
+    OUTSIDE = 0
+    MOBILE = 1
+    FIXED = 2
+    EXCLUDED = 3
+
+def build_sim_regions(residues, core_atoms, soft_cutoff, hard_cutoff,
+        restrained_atoms=None, excluded_residues=None):
+    '''
+    Divide the atoms of a structure into the mobile, fixed and excluded parts
+    of a simulation in a single pass. Returns a tuple of two arrays over
+    :attr:`residues.atoms`:
+
+        * a uint8 state per atom (see :class:`SimRegionState`)
+        * the int64 index of each atom in the simulation (-1 for atoms
+          outside it)
+
+    Args:
+        * residues:
+            - a :class:`chimerax.Residues` holding *all* residues in the
+              structure, in the order they are to appear in the simulation
+        * core_atoms:
+            - a :class:`chimerax.Atoms` instance. Their residues, and all
+              residues coming within soft_cutoff of them, will be mobile.
+        * soft_cutoff:
+            - distance in Angstroms defining the mobile shell
+        * hard_cutoff:
+            - any residue with an atom within this distance of a mobile atom
+              (and not itself mobile) is fixed
+        * restrained_atoms:
+            - optional tuple of two :class:`chimerax.Atoms` of the same length
+              (e.g. :attr:`DistanceRestraints.atoms`). The partner of any
+              mobile atom is fixed if not otherwise in the simulation.
+        * excluded_residues:
+            - optional :class:`chimerax.Residues` to be left out of the
+              simulation. Atoms bonded to them are fixed along with their
+              neighbours and attendant hydrogens.
+    '''
+    f = c_function('sim_regions_build',
+        args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_void_p, ctypes.c_double, ctypes.c_double,
+            ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.c_void_p, ctypes.c_void_p),
+        ret=ctypes.c_size_t)
+    from chimerax.atomic import Atoms, Residues
+    model = residues.unique_structures[0]
+    idx = get_atom_index(model)
+    if restrained_atoms is None:
+        restrained_atoms = (Atoms(), Atoms())
+    ra, rb = restrained_atoms
+    if excluded_residues is None:
+        excluded_residues = Residues()
+    n_atoms = residues.num_atoms.sum()
+    state = numpy.empty(n_atoms, uint8)
+    indices = numpy.empty(n_atoms, numpy.int64)
+    f(residues._c_pointers, len(residues), core_atoms._c_pointers, len(core_atoms),
+        idx._c_pointer, soft_cutoff, hard_cutoff,
+        ra._c_pointers, rb._c_pointers, len(ra),
+        excluded_residues._c_pointers, len(excluded_residues),
+        pointer(state), pointer(indices))
+    return state, indices
+
 
 
 class _DihedralMgr:
@@ -261,6 +409,9 @@ class ChiralMgr(_DihedralMgr):
     instantiating directly, it is best created/retrieved using
     :func:`session_extensions.get_chiral_mgr`.
     '''
+    # Above this many atoms, get_chirals() creates missing centres through
+    # create_chirals()
+    _BULK_CREATE_THRESHOLD = 1000
 
     def __init__(self, session, c_pointer=None):
         super().__init__(session, c_pointer=c_pointer)
@@ -395,8 +546,48 @@ class ChiralMgr(_DihedralMgr):
             ret=ctypes.py_object
         )
         n = len(atoms)
+        if create and n > self._BULK_CREATE_THRESHOLD:
+            self.create_chirals(atoms.unique_residues)
+            create = False
         return _chiral_centers(f(self._c_pointer, atoms._c_pointers, n, create))
 
+    def create_chirals(self, residues):
+        '''
+        Find and create every defined chiral centre in the given residues in a
+        single (multithreaded) pass. Centres which already exist are skipped.
+        Returns the number of new centres created.
+
+        Args:
+            * residues:
+                - a :class:`chimerax.Residues` instance
+        '''
+        f = c_function('chiral_mgr_create_chirals',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer, residues._c_pointers, len(residues))
+
+
+    def find_inverted(self, chirals=None):
+        '''
+        Returns a :class:`ChiralCenters` containing only those centres whose
+        handedness is opposite to their definition. Much faster than checking
+        :attr:`ChiralCenters.deviations`, since only the sign of each chiral
+        "dihedral" is calculated.
+
+        Args:
+            * chirals:
+                - a :class:`ChiralCenters` instance. If None, all chiral
+                  centres known to the manager are checked.
+        '''
+        f = c_function('chiral_mgr_find_inverted',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_bool),
+            ret=ctypes.py_object
+        )
+        if chirals is None:
+            return _chiral_centers(f(self._c_pointer, None, 0, True))
+        return _chiral_centers(f(self._c_pointer, chirals._c_pointers,
+            len(chirals), False))
 
     @property
     def num_mapped_chiral_centers(self):
@@ -512,34 +703,34 @@ class ProperDihedralMgr(_DihedralMgr):
         dihedral_dict = self._dihedral_dict
         amino_acid_resnames = dihedral_dict['aminoacids']
         r = residues
-        # self._reserve(len(r))
         aa_residues = r[numpy.in1d(r.names, amino_acid_resnames)]
-        f = c_function('proper_dihedral_mgr_get_dihedrals',
-            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
-                ctypes.c_size_t, ctypes.c_bool),
-            ret=ctypes.py_object)
-        self._find_peptide_backbone_dihedrals(dihedral_dict, aa_residues, f)
-        self._find_rotameric_dihedrals(dihedral_dict, amino_acid_resnames, aa_residues, f)
+        res_dict = dihedral_dict['residues']['protein']
+        max_chi = max(res_dict[aa]['nchi'] for aa in amino_acid_resnames)
+        names = list(dihedral_dict['all_protein'].keys())
+        names.extend('chi'+str(i+1) for i in range(max_chi))
+        self.create_dihedrals(aa_residues, names)
 
-    def _find_peptide_backbone_dihedrals(self, dihedral_dict, aa_residues, f):
-        for key in dihedral_dict['all_protein'].keys():
-            k = ctypes.py_object()
-            k.value = key
-            f(self._c_pointer, aa_residues._c_pointers, ctypes.byref(k),
-                len(aa_residues), True)
+    def create_dihedrals(self, residues, names):
+        '''
+        Create all dihedrals with the given names for a set of residues in a
+        single pass. Dihedrals which already exist, or are not defined for a
+        given residue type, are skipped. Returns the number of new dihedrals
+        created.
 
-    def _find_rotameric_dihedrals(self, dihedral_dict, amino_acid_resnames, all_aa_residues, f):
-        res_dict = dihedral_dict['residues']['protein']
-        for aa in amino_acid_resnames:
-            data = res_dict[aa]
-            nchi = data['nchi']
-            aa_residues = all_aa_residues[all_aa_residues.names == aa]
-            for i in range(nchi):
-                key = 'chi'+str(i+1)
-                k = ctypes.py_object()
-                k.value = key
-                f(self._c_pointer, aa_residues._c_pointers, ctypes.byref(k),
-                    len(aa_residues), True)
+        Args:
+            * residues:
+                - A :class:`chimerax.Residues` instance
+            * names:
+                - A list of dihedral names (e.g. ['phi', 'psi', 'chi1'])
+        '''
+        f = c_function('proper_dihedral_mgr_create_dihedrals',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_void_p, ctypes.c_size_t),
+            ret=ctypes.c_size_t)
+        n_names = len(names)
+        name_arr = numpy.array(names).astype(string)
+        return f(self._c_pointer, residues._c_pointers, len(residues),
+            pointer(name_arr), n_names)
 
     def get_dihedral(self, residue, name, create=True):
         '''
@@ -710,8 +901,40 @@ class RamaMgr:
         for case, details in self.RAMA_CASE_DETAILS.items():
             file_prefix = details['file_prefix']
             if file_prefix is not None:
-                i_data = validation.generate_interpolator_data(data_dir, cache_dir, file_prefix, True)
-                self._add_interpolator(case, *i_data)
+                self._load_interpolator(case, data_dir, cache_dir, file_prefix)
+
+    def _load_interpolator(self, rama_case, data_dir, cache_dir, file_prefix):
+        '''
+        Map the contours for the given case from the binary grid cache if
+        possible. Otherwise build them from the MolProbity data, and write the
+        cache for next time.
+        '''
+        from .validation import validation
+        grid_file = validation.grid_file_path(cache_dir, file_prefix)
+        if os.path.isfile(grid_file):
+            try:
+                self._add_interpolator_from_file(rama_case, grid_file)
+                return
+            except RuntimeError:
+                # Stale or damaged - regenerate it
+                pass
+        i_data = validation.generate_interpolator_data(data_dir, cache_dir, file_prefix, True)
+        self._add_interpolator(rama_case, *i_data)
+        try:
+            self._write_interpolator_file(rama_case, grid_file)
+        except RuntimeError:
+            # e.g. a read-only cache directory. Not fatal.
+            pass
+
+    def _add_interpolator_from_file(self, rama_case, filename):
+        f = c_function('rama_mgr_add_interpolator_from_file',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p))
+        f(self._c_pointer, rama_case, os.fsencode(filename))
+
+    def _write_interpolator_file(self, rama_case, filename):
+        f = c_function('rama_mgr_write_interpolator_file',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p))
+        f(self._c_pointer, rama_case, os.fsencode(filename))
 
     def __init__(self, session, c_pointer=None):
         if hasattr(session, 'rama_mgr'):
@@ -728,12 +951,24 @@ class RamaMgr:
         self._prepare_all_validators()
         self.set_default_cutoffs()
         self.set_default_colors()
+        from chimerax.atomic import get_triggers
+        self._atomic_changes_handler = get_triggers(session).add_handler(
+            'changes', self._atomic_changes_cb)
         session.rama_mgr = self
 
     def delete(self):
+        from chimerax.atomic import get_triggers
+        get_triggers(self.session).remove_handler(self._atomic_changes_handler)
         c_function('rama_mgr_delete', args=(ctypes.c_void_p,))(self._c_pointer)
         delattr(self.session, 'rama_mgr')
 
+    def _atomic_changes_cb(self, trigger_name, changes):
+        # Ramachandran cases are cached in the C++ layer, and need to be
+        # re-determined if any residue is renamed (e.g. on mutation).
+        if 'name changed' in changes.residue_reasons():
+            c_function('rama_mgr_topology_changed',
+                args=(ctypes.c_void_p,))(self._c_pointer)
+
     @property
     def cpp_pointer(self):
         '''Value that can be passed to C++ layer to be used as pointer (Python int)'''
@@ -993,6 +1228,55 @@ class RamaMgr:
         f(self._c_pointer, ramas._c_pointers,  n, pointer(scores), pointer(cases))
         return (scores, cases)
 
+    def _validate_incremental(self, ramas):
+        '''
+        As for :func:`_validate`, but if incremental mode is enabled (see
+        :func:`set_incremental`) only residues whose backbone atoms have moved
+        since they were last scored will actually be re-validated.
+        '''
+        f = c_function('rama_mgr_validate_incremental',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_uint8)))
+        n = len(ramas)
+        scores = numpy.empty(n, float64)
+        cases = numpy.empty(n, uint8)
+        f(self._c_pointer, ramas._c_pointers,  n, pointer(scores), pointer(cases))
+        return (scores, cases)
+
+    def set_incremental(self, flag, threshold=0.05):
+        '''
+        Turn incremental re-validation on or off. When on, the live
+        Ramachandran annotations re-score a residue only if one of its
+        backbone atoms has moved by more than threshold (in Angstroms) since
+        it was last scored. Intended for use during simulations, where the
+        topology is fixed.
+        '''
+        f = c_function('set_rama_mgr_incremental',
+            args=(ctypes.c_void_p, ctypes.c_bool, ctypes.c_double))
+        f(self._c_pointer, flag, threshold)
+
+    @property
+    def incremental(self):
+        '''Is incremental re-validation currently enabled? Read only.'''
+        f = c_function('rama_mgr_incremental',
+            args=(ctypes.c_void_p,), ret=ctypes.c_bool)
+        return f(self._c_pointer)
+
+    def set_mobile_atoms(self, atoms):
+        '''
+        In incremental mode, residues in the same structure(s) as atoms with
+        no backbone atoms in the given set are assumed not to move, and their
+        cached scores are used without checking coordinates.
+        '''
+        f = c_function('rama_mgr_set_mobile_atoms',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, atoms._c_pointers, len(atoms))
+
+    def clear_mobile_atoms(self):
+        f = c_function('rama_mgr_clear_mobile_atoms',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
     def get_rama(self, residue):
         from chimerax.atomic import Residues
         rama = self.get_ramas(Residues([residue]))
@@ -1098,8 +1382,9 @@ class RamaMgr:
                 ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p),
             ret = ctypes.c_size_t)
         n = len(ramas)
-        vertices = numpy.empty((n*5,3), float64)
-        normals = numpy.empty((n*5,3), float64)
+        # Written directly in the float32 format the drawing needs
+        vertices = numpy.empty((n*5,3), float32)
+        normals = numpy.empty((n*5,3), float32)
         triangles = numpy.empty((n*3,3), int32)
         colors = numpy.empty((n*5,4), uint8)
         count = f(self._c_pointer, ramas._c_pointers, n, pointer(vertices),
@@ -1109,6 +1394,17 @@ class RamaMgr:
     #######
     # Access to the underlying interpolator data
     #######
+    def _log_interpolator_pointer(self, rama_case):
+        '''
+        Pointer to the C++ log-probability grid for a given Ramachandran case,
+        as used by the simulation's conformational bias. Only valid for the
+        life of this manager.
+        '''
+        f = c_function('rama_mgr_log_interpolator',
+            args=(ctypes.c_void_p, ctypes.c_size_t),
+            ret=ctypes.c_void_p)
+        return f(self._c_pointer, rama_case)
+
     def interpolator_dim(self, rama_case):
         '''
         Retrieve the number of dimensions in the :class:`RegularGridInterpolator`
@@ -1412,11 +1708,48 @@ class RotaMgr:
             else:
                 fname = prefix + aa.lower()
             if (not os.path.isfile(os.path.join(data_dir, fname+'.data'))
-                and not os.path.isfile(os.path.join(cache_dir, fname+'.pickle'))):
+                and not os.path.isfile(os.path.join(cache_dir, fname+'.pickle'))
+                and not os.path.isfile(validation.grid_file_path(cache_dir, fname))):
                 # Not a rotameric residue
                 continue
-            idata = validation.generate_interpolator_data(data_dir, cache_dir, fname, True)
-            self._add_interpolator(aa, *idata)
+            self._load_interpolator(aa, data_dir, cache_dir, fname)
+
+    def _load_interpolator(self, resname, data_dir, cache_dir, file_prefix):
+        '''
+        Map the grids for the given residue type from the binary grid cache
+        if possible. Otherwise build them from the MolProbity data, and write
+        the cache for next time.
+        '''
+        from .validation import validation
+        grid_file = validation.grid_file_path(cache_dir, file_prefix)
+        if os.path.isfile(grid_file):
+            try:
+                self._add_interpolator_from_file(resname, grid_file)
+                return
+            except RuntimeError:
+                # Stale or damaged - regenerate it
+                pass
+        idata = validation.generate_interpolator_data(data_dir, cache_dir, file_prefix, True)
+        self._add_interpolator(resname, *idata)
+        try:
+            self._write_interpolator_file(resname, grid_file)
+        except RuntimeError:
+            # e.g. a read-only cache directory. Not fatal.
+            pass
+
+    def _add_interpolator_from_file(self, resname, filename):
+        f = c_function('rota_mgr_add_interpolator_from_file',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_char_p))
+        key = ctypes.py_object()
+        key.value = resname
+        f(self._c_pointer, ctypes.byref(key), os.fsencode(filename))
+
+    def _write_interpolator_file(self, resname, filename):
+        f = c_function('rota_mgr_write_interpolator_file',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_char_p))
+        key = ctypes.py_object()
+        key.value = resname
+        f(self._c_pointer, ctypes.byref(key), os.fsencode(filename))
 
     def _add_interpolator(self, resname, ndim, axis_lengths, min_vals, max_vals, data):
         f = c_function('rota_mgr_add_interpolator',
@@ -1429,6 +1762,19 @@ class RotaMgr:
         f(self._c_pointer, ctypes.byref(key), ndim, pointer(axis_lengths),
             pointer(min_vals), pointer(max_vals), pointer(data))
 
+    def _log_interpolator_pointer(self, resname):
+        '''
+        Pointer to the C++ log-probability grid for a given residue type, as
+        used by the simulation's conformational bias. Only valid for the life
+        of this manager.
+        '''
+        f = c_function('rota_mgr_log_interpolator',
+            args=(ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.c_void_p)
+        key = ctypes.py_object()
+        key.value = resname
+        return f(self._c_pointer, ctypes.byref(key))
+
     def get_rotamer(self, residue):
         '''
         Create/retrieve the :class:`Rotamer` object for a given residue
@@ -1509,6 +1855,90 @@ class RotaMgr:
         found = f(self._c_pointer, rotamers._c_pointers, n, pointer(ptrs), pointer(scores))
         return (_rotamers(ptrs[0:found]), scores[0:found])
 
+    def rank_rotamer_targets(self, rotamers, density_map=None, clash_weight=0.5,
+            map_weight=1.0, max_results=None, clash_threshold=0.6,
+            hbond_allowance=0.4):
+        '''
+        Rank the target conformations of each rotamer by building its sidechain
+        in each one and scoring it against the surrounding atoms (and
+        optionally a density map). The model itself is not changed. Scores are
+        lower-is-better: clash_weight times the summed clash overlaps (using the
+        same criteria as ChimeraX's "clashes" command), minus map_weight times
+        the atomic-number-weighted mean density in units of sigma. Clashes
+        between a sidechain and the rest of its own residue are not scored.
+
+        Args:
+            * rotamers:
+                - a :class:`Rotamers` instance
+            * density_map:
+                - optional ChimeraX Volume to fit against
+            * clash_weight:
+                - weight applied to the clash term
+            * map_weight:
+                - weight applied to the density term
+            * max_results:
+                - number of targets to return per rotamer. Defaults to the
+                  largest number of targets defined for any of the rotamers
+            * clash_threshold:
+                - minimum overlap (Angstroms) counted as a clash
+            * hbond_allowance:
+                - overlap forgiven between pairs of polar atoms
+
+        Returns:
+            * an (n, max_results) int32 array of target indices (as used by
+              :func:`Rotamer.get_target` and
+              :func:`RotamerRestraint.target_index`), best first, padded with
+              -1 for rotamers with fewer targets
+            * a matching (n, max_results) array of scores, padded with NaN
+        '''
+        f = c_function('rota_mgr_search',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_double), ctypes.c_void_p,
+                ctypes.POINTER(ctypes.c_size_t), ctypes.POINTER(ctypes.c_double),
+                ctypes.c_double, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
+                ctypes.POINTER(ctypes.c_double)))
+        n = len(rotamers)
+        if max_results is None:
+            nf = c_function('rotamer_num_target_defs',
+                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_uint32)))
+            counts = numpy.empty(n, uint32)
+            nf(rotamers._c_pointers, n, pointer(counts))
+            max_results = int(counts.max()) if n else 0
+        target_indices = numpy.empty((n, max_results), int32)
+        scores = numpy.empty((n, max_results), float64)
+        if n == 0 or max_results == 0:
+            return target_indices, scores
+        weights = numpy.array((clash_weight, map_weight, clash_threshold,
+            hbond_allowance), float64)
+        if density_map is not None:
+            map_data = numpy.ascontiguousarray(density_map.full_matrix(), numpy.float32)
+            map_dims = numpy.array(map_data.shape[::-1], numpy.uintp)
+            sigma = density_map.mean_sd_rms()[1]
+        # Neighbours are searched within a single structure, so each structure
+        # is handled separately with the map transform for its own frame.
+        structures = rotamers.residues.structures
+        for s in structures.unique():
+            mask = (structures == s)
+            srots = rotamers[mask]
+            ns = len(srots)
+            sti = numpy.empty((ns, max_results), int32)
+            ss = numpy.empty((ns, max_results), float64)
+            if density_map is None:
+                f(self._c_pointer, srots._c_pointers, ns, pointer(weights),
+                    None, None, None, 0, max_results, pointer(sti), pointer(ss))
+            else:
+                tf = (density_map.data.xyz_to_ijk_transform
+                    * density_map.scene_position.inverse()
+                    * s.scene_position).matrix
+                tf = numpy.ascontiguousarray(tf, float64)
+                f(self._c_pointer, srots._c_pointers, ns, pointer(weights),
+                    map_data.ctypes.data_as(ctypes.c_void_p),
+                    map_dims.ctypes.data_as(ctypes.POINTER(ctypes.c_size_t)),
+                    pointer(tf), sigma, max_results, pointer(sti), pointer(ss))
+            target_indices[mask] = sti
+            scores[mask] = ss
+        return target_indices, scores
+
     def validate_scale_and_color_rotamers(self, rotamers, max_scale = 2.0, non_favored_only = True, visible_only = True):
         '''
         Used by :class:`RotamerAnnotator` for visualising rotamer validation.
@@ -1544,6 +1974,516 @@ class RotaMgr:
         return (_rotamers(rot_out[0:count]), scale_out[0:count], color_out[0:count])
 
 
+class AtomIndex:
+    '''
+    Cell-list spatial index over the atoms of a structure, answering batched
+    "atoms within r" and k-nearest-neighbour queries in C++. Rather than
+    instantiating directly, it is best created/retrieved using
+    :func:`get_atom_index`, so that one index per structure is shared between
+    all users. Deleted atoms are dropped automatically; coordinates are
+    re-read by :func:`update`.
+
+    All coordinates are in the frame of the structure itself (as given by
+    :attr:`chimerax.Atoms.coords`), not scene coordinates.
+    '''
+    def __init__(self, model, cell_size=4.0, c_pointer=None):
+        '''
+        Args:
+            * model:
+                - a :class:`chimerax.AtomicStructure`
+            * cell_size:
+                - edge length of each grid cell in Angstroms. Queries are
+                  fastest when this is similar to the typical query radius.
+        '''
+        cname = _as_snake_case(type(self).__name__)
+        if c_pointer is None:
+            atoms = model.atoms
+            f = c_function(cname + '_new',
+                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double),
+                ret=ctypes.c_void_p)
+            c_pointer = f(atoms._c_pointers, len(atoms), cell_size)
+        set_c_pointer(self, c_pointer)
+        f = c_function('set_'+cname+'_py_instance', args=(ctypes.c_void_p, ctypes.py_object))
+        f(self._c_pointer, self)
+        self.model = model
+        self._model_delete_handler = model.triggers.add_handler('deleted',
+            self._model_deleted_cb)
+
+    def _model_deleted_cb(self, *_):
+        self.delete()
+        from chimerax.core.triggerset import DEREGISTER
+        return DEREGISTER
+
+    @property
+    def cpp_pointer(self):
+        '''Value that can be passed to C++ layer to be used as pointer (Python int)'''
+        return self._c_pointer.value
+
+    @property
+    def deleted(self):
+        '''Has the C++ side been deleted?'''
+        return not hasattr(self, '_c_pointer')
+
+    def delete(self):
+        if self.deleted:
+            return
+        c_function('atom_index_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+        delattr(self, '_c_pointer')
+
+    def __len__(self):
+        f = c_function('atom_index_size', args=(ctypes.c_void_p,), ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def update(self, atoms=None):
+        '''
+        Re-read atomic coordinates into the index.
+
+        Args:
+            * atoms:
+                - a :class:`chimerax.Atoms` instance giving the atoms known to
+                  have moved. If None, all atoms are checked.
+        '''
+        if atoms is None:
+            f = c_function('atom_index_update_all', args=(ctypes.c_void_p,))
+            f(self._c_pointer)
+        else:
+            f = c_function('atom_index_update',
+                args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t))
+            f(self._c_pointer, atoms._c_pointers, len(atoms))
+
+    def within(self, coords, radius):
+        '''
+        Returns a :class:`chimerax.Atoms` containing every atom within radius
+        of any of the given points, each appearing once.
+
+        Args:
+            * coords:
+                - an (n,3) array of points
+            * radius:
+                - search radius in Angstroms
+        '''
+        f = c_function('atom_index_within',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double),
+                ctypes.c_size_t, ctypes.c_double),
+            ret=ctypes.py_object)
+        coords = numpy.ascontiguousarray(coords, float64).reshape((-1,3))
+        return convert.atoms(f(self._c_pointer, pointer(coords), len(coords), radius))
+
+    def within_each(self, coords, radius):
+        '''
+        Find the atoms within radius of each point separately.
+
+        Args:
+            * coords:
+                - an (n,3) array of points
+            * radius:
+                - search radius in Angstroms
+
+        Returns:
+            * a :class:`chimerax.Atoms` instance with the results for all
+              points concatenated
+            * an array of n+1 offsets, such that the atoms near point i are
+              atoms[offsets[i]:offsets[i+1]]
+        '''
+        f = c_function('atom_index_within_each',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double),
+                ctypes.c_size_t, ctypes.c_double, ctypes.c_void_p),
+            ret=ctypes.py_object)
+        coords = numpy.ascontiguousarray(coords, float64).reshape((-1,3))
+        n = len(coords)
+        offsets = numpy.empty(n+1, numpy.uintp)
+        atoms = convert.atoms(f(self._c_pointer, pointer(coords), n, radius,
+            offsets.ctypes.data_as(ctypes.c_void_p)))
+        return atoms, offsets
+
+    def nearest(self, coords, k=1, max_distance=numpy.inf):
+        '''
+        Find the k nearest atoms to each point.
+
+        Args:
+            * coords:
+                - an (n,3) array of points
+            * k:
+                - number of neighbours to find for each point
+            * max_distance:
+                - atoms further away than this are never reported
+
+        Returns:
+            * a :class:`chimerax.Atoms` instance holding, for each point in
+              turn, its neighbours in order of increasing distance. Points
+              with fewer than k neighbours contribute fewer atoms.
+            * an (n,k) array of distances, padded with inf where fewer than
+              k atoms were found (so `numpy.isfinite(distances)` gives the
+              layout of the returned atoms)
+        '''
+        f = c_function('atom_index_nearest',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double),
+                ctypes.c_size_t, ctypes.c_size_t, ctypes.c_double,
+                ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)))
+        coords = numpy.ascontiguousarray(coords, float64).reshape((-1,3))
+        n = len(coords)
+        ptrs = numpy.empty((n, k), cptr)
+        distances = numpy.empty((n, k), float64)
+        f(self._c_pointer, pointer(coords), n, k, max_distance, pointer(ptrs),
+            pointer(distances))
+        return convert.atoms(ptrs[numpy.isfinite(distances)]), distances
+
+
+class SymmetryContacts:
+    '''
+    Finds the symmetry mates of a structure's atoms lying close to a set of
+    query atoms (typically the mobile atoms of a simulation). The mates of
+    every atom under every (non-identity) operator are binned once into a C++
+    cell-list grid; as atoms move, :func:`update` re-bins only their own
+    mates, so the search stays cheap enough to run on every coordinate update
+    of a live simulation (see :func:`follow_simulation`). Deleted atoms are
+    dropped automatically.
+
+    Operators and all coordinates are in the frame of the structure itself,
+    not scene coordinates.
+    '''
+    def __init__(self, atoms, operators, cell_size=4.0, c_pointer=None):
+        '''
+        Args:
+            * atoms:
+                - a :class:`chimerax.Atoms` instance from a single structure
+            * operators:
+                - a :class:`chimerax.Places` or (n,3,4) array of symmetry
+                  operators (e.g. one NCS group from
+                  :func:`chimerax.isolde.phenix.map_symmetry.parse_map_symmetry_file`)
+            * cell_size:
+                - edge length of each grid cell in Angstroms. Best set close
+                  to the contact cutoff.
+        '''
+        cname = _as_snake_case(type(self).__name__)
+        if c_pointer is None:
+            if hasattr(operators, 'array'):
+                operators = operators.array()
+            ops = numpy.ascontiguousarray(operators, float64).reshape((-1,3,4))
+            f = c_function(cname + '_new',
+                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double),
+                    ctypes.c_size_t, ctypes.c_double),
+                ret=ctypes.c_void_p)
+            c_pointer = f(atoms._c_pointers, len(atoms), pointer(ops), len(ops), cell_size)
+        set_c_pointer(self, c_pointer)
+        f = c_function('set_'+cname+'_py_instance', args=(ctypes.c_void_p, ctypes.py_object))
+        f(self._c_pointer, self)
+        self.atoms = atoms
+        self._sim_handlers = None
+
+    @property
+    def cpp_pointer(self):
+        '''Value that can be passed to C++ layer to be used as pointer (Python int)'''
+        return self._c_pointer.value
+
+    @property
+    def deleted(self):
+        '''Has the C++ side been deleted?'''
+        return not hasattr(self, '_c_pointer')
+
+    def delete(self):
+        self.stop_following()
+        if self.deleted:
+            return
+        c_function('symmetry_contacts_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+        delattr(self, '_c_pointer')
+
+    def __len__(self):
+        f = c_function('symmetry_contacts_size', args=(ctypes.c_void_p,), ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @property
+    def num_operators(self):
+        '''Number of non-identity operators in use.'''
+        f = c_function('symmetry_contacts_num_operators', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def update(self, atoms=None):
+        '''
+        Move the mates of atoms that have moved.
+
+        Args:
+            * atoms:
+                - a :class:`chimerax.Atoms` instance giving the atoms known to
+                  have moved. If None, all atoms are checked.
+        '''
+        if atoms is None:
+            f = c_function('symmetry_contacts_update_all', args=(ctypes.c_void_p,))
+            f(self._c_pointer)
+        else:
+            f = c_function('symmetry_contacts_update',
+                args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t))
+            f(self._c_pointer, atoms._c_pointers, len(atoms))
+
+    def contacts(self, query_atoms, cutoff):
+        '''
+        Find the symmetry mates within cutoff of any of the query atoms (at
+        their current coordinates). Each mate is reported once.
+
+        Returns:
+            * a :class:`chimerax.Atoms` instance holding the atom each mate
+              is a copy of
+            * the index of each mate's operator in the list given on creation
+            * an (n,3) array of the mates' coordinates
+        '''
+        f = c_function('symmetry_contacts_find',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double),
+            ret=ctypes.py_object)
+        atoms, ops, coords = f(self._c_pointer, query_atoms._c_pointers,
+            len(query_atoms), cutoff)
+        return convert.atoms(atoms), ops, coords.reshape((-1,3))
+
+    def follow_simulation(self, sim_handler, mobile_atoms):
+        '''
+        Keep the mates of the mobile atoms up to date on every coordinate
+        update of a simulation, until it ends or :func:`stop_following` is
+        called.
+        '''
+        self.stop_following()
+        def coord_update_cb(*_):
+            self.update(mobile_atoms)
+        def sim_end_cb(*_):
+            self.stop_following()
+        self._sim_handlers = (sim_handler.triggers,
+            sim_handler.triggers.add_handler('coord update', coord_update_cb),
+            sim_handler.triggers.add_handler('sim terminated', sim_end_cb))
+
+    def stop_following(self):
+        if self._sim_handlers is None:
+            return
+        triggers, *handlers = self._sim_handlers
+        for h in handlers:
+            triggers.remove_handler(h)
+        self._sim_handlers = None
+
+
+class SnapshotValidationResults:
+    '''
+    Validation of one coordinate snapshot by a :class:`SnapshotValidator`.
+    Each array matches the corresponding (Python-side) set of targets, which
+    is kept alongside it.
+    '''
+    def __init__(self, generation, ramas, rama_scores, rama_cases, rama_colors,
+            rotamers, rota_scores, rota_colors, chirals, chiral_deviations):
+        self.generation = generation
+        self.ramas = ramas
+        self.rama_scores = rama_scores
+        self.rama_cases = rama_cases
+        self.rama_colors = rama_colors
+        self.rotamers = rotamers
+        self.rota_scores = rota_scores
+        self.rota_colors = rota_colors
+        self.chirals = chirals
+        self.chiral_deviations = chiral_deviations
+
+
+class SnapshotValidator:
+    '''
+    Ramachandran, rotamer and chirality validation run on a background thread
+    against immutable coordinate snapshots, so that during a simulation it
+    overlaps with integration and drawing rather than adding to the time of
+    each frame. Targets are resolved once to indices into the snapshot
+    layout (the atoms given on creation), and the background thread never
+    touches the model itself. Results come back as packed score and colour
+    arrays (see :class:`SnapshotValidationResults`).
+
+    Results for a snapshot are normally picked up on the coordinate update
+    after the one that published it, so (by design) they lag the display by
+    about one frame. Setting any targets discards results for the old ones.
+    Deleting any target drops all targets of that kind (see
+    :attr:`targets_version`).
+    '''
+    def __init__(self, rama_mgr, rota_mgr, atoms, c_pointer=None):
+        '''
+        Args:
+            * rama_mgr:
+                - the session's :class:`RamaMgr`
+            * rota_mgr:
+                - the session's :class:`RotaMgr`
+            * atoms:
+                - a :class:`chimerax.Atoms` instance defining the snapshot
+                  layout (e.g. all atoms in a simulation, in simulation order)
+        '''
+        cname = _as_snake_case(type(self).__name__)
+        if c_pointer is None:
+            f = c_function(cname + '_new',
+                args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t),
+                ret=ctypes.c_void_p)
+            c_pointer = f(rama_mgr._c_pointer, rota_mgr._c_pointer,
+                atoms._c_pointers, len(atoms))
+        set_c_pointer(self, c_pointer)
+        f = c_function('set_'+cname+'_py_instance', args=(ctypes.c_void_p, ctypes.py_object))
+        f(self._c_pointer, self)
+        self.atoms = atoms
+        self._ramas = None
+        self._rotamers = None
+        self._chirals = None
+        self._last_submitted = 0
+        from chimerax.core.triggerset import TriggerSet
+        t = self.triggers = TriggerSet()
+        t.add_trigger('results')
+        self._sim_handlers = None
+
+    @property
+    def cpp_pointer(self):
+        '''Value that can be passed to C++ layer to be used as pointer (Python int)'''
+        return self._c_pointer.value
+
+    @property
+    def deleted(self):
+        '''Has the C++ side been deleted?'''
+        return not hasattr(self, '_c_pointer')
+
+    def delete(self):
+        self.stop_following()
+        if self.deleted:
+            return
+        c_function('snapshot_validator_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+        delattr(self, '_c_pointer')
+
+    def _set_targets(self, kind, targets):
+        f = c_function('snapshot_validator_set_'+kind,
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t))
+        if targets is None:
+            f(self._c_pointer, None, 0)
+        else:
+            f(self._c_pointer, targets._c_pointers, len(targets))
+        setattr(self, '_'+kind, targets)
+
+    @property
+    def ramas(self):
+        '''A :class:`Ramas` instance (or None) to be validated.'''
+        return self._ramas
+
+    @ramas.setter
+    def ramas(self, ramas):
+        self._set_targets('ramas', ramas)
+
+    @property
+    def rotamers(self):
+        '''A :class:`Rotamers` instance (or None) to be validated.'''
+        return self._rotamers
+
+    @rotamers.setter
+    def rotamers(self, rotamers):
+        self._set_targets('rotamers', rotamers)
+
+    @property
+    def chirals(self):
+        '''A :class:`ChiralCenters` instance (or None) to be validated.'''
+        return self._chirals
+
+    @chirals.setter
+    def chirals(self, chirals):
+        self._set_targets('chirals', chirals)
+
+    @property
+    def targets_version(self):
+        '''
+        Changes whenever targets are set, or any are deleted.
+        '''
+        f = c_function('snapshot_validator_targets_version', args=(ctypes.c_void_p,),
+            ret=ctypes.c_uint64)
+        return f(self._c_pointer)
+
+    @property
+    def busy(self):
+        '''True if the background thread has a snapshot in hand.'''
+        f = c_function('snapshot_validator_busy', args=(ctypes.c_void_p,),
+            ret=ctypes.c_bool)
+        return f(self._c_pointer)
+
+    def submit(self, coords, generation):
+        '''
+        Queue a copy of an (n,3) array of coordinates in the layout given on
+        creation for validation, and return immediately. If the background
+        thread is still busy, only the newest queued snapshot is kept.
+        '''
+        f = c_function('snapshot_validator_submit',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_uint64))
+        coords = numpy.ascontiguousarray(coords, float64)
+        f(self._c_pointer, len(coords), pointer(coords), generation)
+        self._last_submitted = generation
+
+    def fetch(self):
+        '''
+        Returns a :class:`SnapshotValidationResults` for the most recent
+        snapshot finished since the last call, or None if there is none (or
+        the targets have changed since it was submitted). Never waits on the
+        background thread.
+        '''
+        f = c_function('snapshot_validator_fetch', args=(ctypes.c_void_p,),
+            ret=ctypes.c_bool)
+        if not f(self._c_pointer):
+            return None
+        f = c_function('snapshot_validator_results_info',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p))
+        versions = numpy.empty(2, numpy.uint64)
+        sizes = numpy.empty(3, numpy.uintp)
+        f(self._c_pointer, pointer(versions), pointer(sizes))
+        if int(versions[1]) != self.targets_version:
+            return None
+        n_rama, n_rota, n_chiral = (int(n) for n in sizes)
+        rama_scores = numpy.empty(n_rama, float64)
+        rama_cases = numpy.empty(n_rama, uint8)
+        rama_colors = numpy.empty((n_rama,4), uint8)
+        f = c_function('snapshot_validator_rama_results',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p,
+                ctypes.c_void_p))
+        f(self._c_pointer, n_rama, pointer(rama_scores), pointer(rama_cases),
+            pointer(rama_colors))
+        rota_scores = numpy.empty(n_rota, float64)
+        rota_colors = numpy.empty((n_rota,4), uint8)
+        f = c_function('snapshot_validator_rota_results',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, n_rota, pointer(rota_scores), pointer(rota_colors))
+        chiral_deviations = numpy.empty(n_chiral, float64)
+        f = c_function('snapshot_validator_chiral_results',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+        f(self._c_pointer, n_chiral, pointer(chiral_deviations))
+        return SnapshotValidationResults(int(versions[0]), self._ramas, rama_scores,
+            rama_cases, rama_colors, self._rotamers, rota_scores, rota_colors,
+            self._chirals, chiral_deviations)
+
+    def follow_simulation(self, sim_handler):
+        '''
+        On every coordinate update of a simulation, fire the 'results'
+        trigger (with a :class:`SnapshotValidationResults`) if new results
+        are ready, then hand the newest snapshot from the simulation thread
+        to the background thread. Continues until the simulation ends or
+        :func:`stop_following` is called. The atoms given on creation must be
+        the simulation's atoms in simulation order.
+        '''
+        self.stop_following()
+        def coord_update_cb(*_):
+            results = self.fetch()
+            if results is not None:
+                self.triggers.activate_trigger('results', results)
+            th = sim_handler.thread_handler
+            if th is None:
+                return
+            if not th.publish_snapshots:
+                th.publish_snapshots = True
+                return
+            generation, coords = th.coord_snapshot()
+            if generation != self._last_submitted and coords is not None:
+                self.submit(coords, generation)
+        def sim_end_cb(*_):
+            self.stop_following()
+        self._sim_handlers = (sim_handler.triggers,
+            sim_handler.triggers.add_handler('coord update', coord_update_cb),
+            sim_handler.triggers.add_handler('sim terminated', sim_end_cb))
+
+    def stop_following(self):
+        if self._sim_handlers is None:
+            return
+        triggers, *handlers = self._sim_handlers
+        for h in handlers:
+            triggers.remove_handler(h)
+        self._sim_handlers = None
+
+
 class RestraintChangeTracker:
     '''
     A per-session singleton tracking changes in ISOLDE restraints, and firing
@@ -1603,6 +2543,7 @@ class RestraintChangeTracker:
 
     def _get_and_clear_changes(self, *_):
         self._get_and_process_changes()
+        self._get_and_process_coalesced_changes()
         self.clear()
 
     def _process_changes(self, changes):
@@ -1629,6 +2570,51 @@ class RestraintChangeTracker:
             ret = ctypes.py_object)
         return self._process_changes(f(self._c_pointer))
 
+    def _get_and_process_coalesced_changes(self):
+        '''
+        Fire the 'coalesced changes' trigger of each manager with changes
+        (and at least one handler for it) this frame, with a single
+        :class:`CoalescedChanges` record.
+        '''
+        f = c_function('change_tracker_coalesced_changes',
+            args = (ctypes.c_void_p,),
+            ret = ctypes.py_object)
+        records = f(self._c_pointer)
+        if not records:
+            return
+        fill = c_function('change_tracker_coalesced_fill',
+            args = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p))
+        reason_bits = self.reason_bits
+        # Handlers may make changes of their own, which rebuilds the records,
+        # so every one is fetched before any trigger fires
+        pending = []
+        for i, (mgr_name, mgr_ptr, n) in enumerate(records):
+            class_funcs = self._mgr_name_to_class_functions[mgr_name]
+            mgr = class_funcs[0](mgr_ptr)
+            if mgr is None or not mgr.triggers.has_handlers('coalesced changes'):
+                continue
+            ptrs = numpy.empty(n, numpy.uintp)
+            reasons = numpy.empty(n, uint32)
+            fill(self._c_pointer, i, n, pointer(ptrs), pointer(reasons))
+            pending.append((mgr, CoalescedChanges(class_funcs[1](ptrs), reasons,
+                reason_bits)))
+        for mgr, changes in pending:
+            mgr.triggers.activate_trigger('coalesced changes', (mgr, changes))
+
+    @property
+    def reason_bits(self):
+        '''
+        Dict mapping each change reason name to its bit in
+        :attr:`CoalescedChanges.reasons`.
+        '''
+        if not hasattr(self, '_reason_bits'):
+            f = c_function('change_tracker_reason_bits',
+                args=(ctypes.c_void_p,),
+                ret = ctypes.py_object)
+            self._reason_bits = f(self._c_pointer)
+        return self._reason_bits
+
     @property
     def reason_names(self):
         f= c_function('change_tracker_reason_names',
@@ -1636,6 +2622,38 @@ class RestraintChangeTracker:
             ret = ctypes.py_object)
         return f(self._c_pointer)
 
+class CoalescedChanges:
+    '''
+    All changes to the restraints of one manager over one frame, as handed to
+    handlers of the manager's 'coalesced changes' trigger. Each changed
+    restraint appears once in :attr:`changed`, and the matching entry in
+    :attr:`reasons` is a bitmask of every reason it changed (see
+    :attr:`RestraintChangeTracker.reason_bits`).
+    '''
+    def __init__(self, changed, reasons, reason_bits):
+        self.changed = changed
+        self.reasons = reasons
+        self._reason_bits = reason_bits
+
+    def __len__(self):
+        return len(self.changed)
+
+    def mask(self, reasons):
+        '''Bitmask combining the named reasons.'''
+        bits = self._reason_bits
+        m = 0
+        for r in reasons:
+            m |= bits[r]
+        return m
+
+    def any_of(self, reasons):
+        '''Restraints changed for at least one of the named reasons.'''
+        return self.changed[(self.reasons & self.mask(reasons)) != 0]
+
+    @property
+    def created(self):
+        return self.any_of(('created',))
+
 class _RestraintMgr(Model):
     '''Base class. Do not instantiate directly.'''
     SESSION_SAVE=False
@@ -1661,6 +2679,7 @@ class _RestraintMgr(Model):
             from chimerax.core.triggerset import TriggerSet
             self.triggers = TriggerSet()
         self.triggers.add_trigger('changes')
+        self.triggers.add_trigger('coalesced changes')
         self.pickable = False
         self.model = model
         self.allow_hydrogens = allow_hydrogens
@@ -1909,6 +2928,42 @@ class MDFFMgr(_RestraintMgr):
         '''
         return self._get_mdff_atoms(atoms, create=False)
 
+    def set_coupling_constants(self, atoms, k):
+        '''
+        Set the per-atom coupling constants for any of the given atoms which
+        are coupled to this map, in a single call. Atoms without a
+        :cpp:class:`MDFFAtom` are ignored. Returns the number of MDFF atoms
+        changed.
+
+        Args:
+            * atoms:
+                - a :py:class:`chimerax.Atoms` instance
+            * k:
+                - a single value, or an array of values (one per atom)
+        '''
+        f = c_function('mdff_mgr_set_coupling_constants',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p),
+            ret=ctypes.c_size_t)
+        n = len(atoms)
+        k = numpy.ascontiguousarray(numpy.broadcast_to(k, (n,)), float64)
+        return f(self._c_pointer, atoms._c_pointers, n, pointer(k))
+
+    def reset_coupling_constants_to_mass(self, atoms=None, scale=1.0):
+        '''
+        Set the coupling constant of each MDFF atom to scale times the mass
+        of its element (the default on creation). If atoms is None, applies to
+        every MDFF atom for this map. Returns the number of MDFF atoms changed.
+        '''
+        if atoms is None:
+            f = c_function('mdff_mgr_reset_all_coupling_constants_to_mass',
+                args=(ctypes.c_void_p, ctypes.c_double),
+                ret=ctypes.c_size_t)
+            return f(self._c_pointer, scale)
+        f = c_function('mdff_mgr_reset_coupling_constants_to_mass',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer, atoms._c_pointers, len(atoms), scale)
+
     def get_mdff_atom(self, atom):
         from chimerax.atomic import Atoms
         mdatom = self.get_mdff_atoms(Atoms([atom]))
@@ -2021,6 +3076,7 @@ class PositionRestraintMgr(_RestraintMgr):
         super().__init__('Position Restraints', model, c_pointer=c_pointer, allow_hydrogens='no')
         self._prepare_drawings()
         self._last_visibles = None
+        self.direct_tug_handler = None
         self._model_update_handler = self.model.triggers.add_handler('changes', self._model_changes_cb)
         self._restraint_update_handler = self.triggers.add_handler('changes', self._restraint_changes_cb)
         if auto_add_to_session:
@@ -2326,6 +3382,7 @@ class TuggableAtomsMgr(_RestraintMgr):
         super().__init__('Tuggable atoms', model, c_pointer=c_pointer, allow_hydrogens=allow_hydrogens)
         self._prepare_drawings()
         self._last_visibles = None
+        self.direct_tug_handler = None
         self._model_update_handler = self.model.triggers.add_handler('changes', self._model_changes_cb)
         self._restraint_update_handler = self.triggers.add_handler('changes', self._restraint_changes_cb)
         # self._show_nearest_atoms = False
@@ -2483,6 +3540,28 @@ class TuggableAtomsMgr(_RestraintMgr):
         return None
 
 
+    def tug(self, tuggables, targets):
+        '''
+        Move the targets of tuggables being dragged interactively. While a
+        simulation is running it sets :attr:`direct_tug_handler`, and the new
+        targets go straight to the simulation thread without a round trip
+        through the change tracker (so no 'changes' trigger fires for them).
+        Otherwise this is equivalent to setting :attr:`tuggables.targets`.
+
+        Args:
+            * tuggables:
+                - a :py:class:`TuggableAtoms` instance from this manager
+            * targets:
+                - a (nx3) array of target (x,y,z) positions in Angstroms
+        '''
+        h = self.direct_tug_handler
+        if h is None:
+            tuggables.targets = targets
+            return
+        tuggables.set_targets_untracked(targets)
+        h(tuggables)
+        self.update_graphics()
+
     @property
     def num_tuggables(self):
         '''
@@ -2574,6 +3653,7 @@ class _DistanceRestraintMgrBase(_RestraintMgr):
         super().__init__(class_name, model, c_pointer)
         self._prepare_drawing()
         self._last_visibles = None
+        self.direct_tug_handler = None
         self._model_update_handler = self.model.triggers.add_handler('changes', self._model_changes_cb)
         self._restraint_update_handler = self.triggers.add_handler('changes', self._restraint_changes_cb)
         if auto_add_to_session:
@@ -2652,13 +3732,24 @@ class _DistanceRestraintMgrBase(_RestraintMgr):
         if 'display changed' in atom_reasons or 'hide changed' in atom_reasons:
             update_needed = True
             update_visibility = True
+            self._invalidate_visible()
         if 'coord changed' in atom_reasons:
             update_needed = True
+            if self.__class__ == AdaptiveDistanceRestraintMgr:
+                # Visibility depends on the distance between the atoms
+                self._invalidate_visible()
         if self.__class__ == AdaptiveDistanceRestraintMgr:
             update_visibility = True
         if update_needed:
             self.update_graphics(update_visibility)
 
+    def _invalidate_visible(self):
+        if not hasattr(self, '_c_func_invalidate_visible'):
+            self._c_func_invalidate_visible = c_function(
+                self._c_function_prefix+'_mgr_invalidate_visible',
+                args=(ctypes.c_void_p,))
+        self._c_func_invalidate_visible(self._c_pointer)
+
     _show_bd = True
     _show_td = True
 
@@ -2813,6 +3904,9 @@ class _DistanceRestraintMgrBase(_RestraintMgr):
         Returns a :py:class:`DistanceRestraints` instance encompassing all
         currently visible restraints owned by this manager. A restraint will be
         visible if it is enabled and both its atoms are visible.
+
+        The result is cached on the C++ side, and only recalculated after
+        restraint or atom display changes.
         '''
         f = self._visible_restraints_c_func()
         return self._plural_restraint_getter(f(self._c_pointer))
@@ -2882,12 +3976,7 @@ class DistanceRestraintMgr(_DistanceRestraintMgrBase):
         from chimerax import surface
         return surface.cylinder_geometry(radius = 0.025, height=1.0, caps=False)
 
-    def _get_ss_restraints(self, residues, create=False):
-        '''
-        Returns (optionally creating) distance restraints suitable for restraining
-        secondary structure. Result is a tuple of two DistanceRestraints
-        objects: O(n)-N(n+4) and CA(n)-CA(n+2).
-        '''
+    def _sorted_protein_residues(self, residues):
         from chimerax.atomic import Residue
         # Reduce to only protein residues
         residues = residues[residues.polymer_types == Residue.PT_AMINO]
@@ -2896,7 +3985,15 @@ class DistanceRestraintMgr(_DistanceRestraintMgrBase):
         indices = m.residues.indices(residues)
         if -1 in indices:
             raise TypeError('All residues must be from the model attached to this handler!')
-        residues = m.residues[numpy.sort(indices)].unique()
+        return m.residues[numpy.sort(indices)].unique()
+
+    def _get_ss_restraints(self, residues, create=False):
+        '''
+        Returns (optionally creating) distance restraints suitable for restraining
+        secondary structure. Result is a tuple of two DistanceRestraints
+        objects: O(n)-N(n+4) and CA(n)-CA(n+2).
+        '''
+        residues = self._sorted_protein_residues(residues)
         n = len(residues)
         try:
             f = c_function('distance_restraint_mgr_get_ss_restraints',
@@ -2932,6 +4029,40 @@ class DistanceRestraintMgr(_DistanceRestraintMgrBase):
         '''
         return self._get_ss_restraints(residues, create=False)
 
+    def restrain_secondary_structure(self, residues, o_to_n_plus_four_target,
+            ca_to_ca_plus_two_target, spring_constant):
+        '''
+        Creates (where necessary) the restraints returned by
+        :func:`add_ss_restraints`, and sets their targets and spring
+        constant and enables them in a single call. Returns the same tuple of
+        (O(n) - N(n+4), CA(n) - CA(n+2)) restraints.
+
+        Args:
+            * residues:
+                - a :py:class:`chimerax.Residues` instance. All residues must
+                  be in the model belonging to this manager.
+            * o_to_n_plus_four_target:
+                - target distance (Angstroms) for the O(n) - N(n+4) restraints
+            * ca_to_ca_plus_two_target:
+                - target distance (Angstroms) for the CA(n) - CA(n+2)
+                  restraints
+            * spring_constant:
+                - in :math:`kJ mol^{-1} nm^{-2}`
+        '''
+        residues = self._sorted_protein_residues(residues)
+        n = len(residues)
+        f = c_function('distance_restraint_mgr_restrain_secondary_structure',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double,
+                ctypes.c_double, ctypes.c_double),
+            ret=ctypes.py_object)
+        try:
+            ptrs = f(self._c_pointer, residues._c_pointers, n, o_to_n_plus_four_target,
+                ca_to_ca_plus_two_target, spring_constant)
+            return tuple((_distance_restraints(ptrs[0]), _distance_restraints(ptrs[1])))
+        except ValueError:
+            from .molarray import DistanceRestraints
+            return tuple((DistanceRestraints(), DistanceRestraints()))
+
     def update_graphics(self, update_visibility=False):
         '''
         Update the restraints drawing. Happens automatically every time
@@ -2952,14 +4083,7 @@ class DistanceRestraintMgr(_DistanceRestraintMgrBase):
             return
         bd.display = self._show_bd
         td.display = self._show_td
-        self._update_bond_drawing(bd, visibles, n)
-        self._update_target_drawing(td, visibles, n)
-
-    def _update_bond_drawing(self, bd, visibles, n):
-        bd.positions = visibles._bond_cylinder_transforms
-
-    def _update_target_drawing(self, td, visibles, n):
-        td.positions = visibles._target_transforms
+        bd.positions, td.positions = visibles._bond_and_target_transforms
 
     def _session_save_info(self):
         drs = self.all_restraints
@@ -3077,6 +4201,35 @@ class AdaptiveDistanceRestraintMgr(_DistanceRestraintMgrBase):
         colors[2,:] = min_color
         cf(self._c_pointer, pointer(colors))
 
+    def restrain_to_template(self, atoms, template_coords, distance_cutoff=8,
+            tolerance=0.025, kappa=5, well_half_width=0.05, fall_off=4):
+        '''
+        Create (or update) restraints between every pair of the given atoms
+        in different residues whose template coordinates are within
+        distance_cutoff of each other, with the template distance as the
+        target. Pairs that can't be restrained (e.g. directly bonded atoms)
+        are skipped. Returns an :class:`AdaptiveDistanceRestraints`. See
+        :func:`restraint_utils.restrain_atom_distances_to_template` for the
+        meanings of the remaining arguments.
+
+        Args:
+            * atoms:
+                - a :class:`chimerax.atomic.Atoms` from this manager's model
+            * template_coords:
+                - a (n,3) array of template coordinates, one per atom
+        '''
+        n = len(atoms)
+        template_coords = numpy.ascontiguousarray(template_coords, float64)
+        if template_coords.shape != (n, 3):
+            raise TypeError('Need one template coordinate per atom!')
+        f = c_function('adaptive_distance_restraint_mgr_restrain_to_template',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double,
+                ctypes.c_double),
+            ret=ctypes.py_object)
+        return _adaptive_distance_restraints(f(self._c_pointer, atoms._c_pointers,
+            pointer(template_coords), n, distance_cutoff, tolerance, kappa,
+            well_half_width, fall_off))
 
     def _target_geometry(self):
         '''
@@ -3136,15 +4289,11 @@ class AdaptiveDistanceRestraintMgr(_DistanceRestraintMgrBase):
             return
         bd.display = self._show_bd
         td.display = self._show_td
-        end_pos, mid_pos = visibles._bond_transforms;
-        colors = visibles.colors
-        bond_colors = numpy.empty((n*2, 4), uint8)
-        bond_colors[0::2] = colors
-        bond_colors[1::2] = colors
+        end_pos, mid_pos, end_colors, mid_colors = visibles._bond_transforms_and_colors
         bd.positions = end_pos
-        bd.colors = bond_colors
+        bd.colors = end_colors
         td.positions = mid_pos
-        td.colors = colors
+        td.colors = mid_colors
 
     def _session_save_info(self):
         drs = self.all_restraints
@@ -3210,7 +4359,70 @@ class AdaptiveDistanceRestraintMgr(_DistanceRestraintMgrBase):
 
 
 
-class ChiralRestraintMgr(_RestraintMgr):
+class _DihedralRestraintColumnsMixin:
+    '''
+    Whole-manager access to the most commonly used properties of dihedral
+    restraints. Rather than building an array of restraint pointers and
+    looking up each property restraint by restraint, the C++ manager keeps
+    struct-of-arrays copies of them (rebuilt only when something has
+    changed) which are copied into numpy arrays in one call.
+    '''
+    _COLUMN_NAMES = ('targets', 'spring_constants', 'enableds', 'displays')
+
+    def columns(self, names=None):
+        '''
+        Returns a tuple of (restraints, dict of numpy arrays) covering all
+        restraints in this manager, in the same order.
+
+        Args:
+            * names:
+                - optional list of the columns to fetch (any of 'targets',
+                  'spring_constants', 'enableds' and 'displays'). Defaults to
+                  all.
+        '''
+        if names is None:
+            names = self._COLUMN_NAMES
+        for name in names:
+            if name not in self._COLUMN_NAMES:
+                raise TypeError('Unrecognised column: {}'.format(name))
+        n = self.num_restraints
+        arrays = {
+            'targets':          numpy.empty(n, float64),
+            'spring_constants': numpy.empty(n, float64),
+            'enableds':         numpy.empty(n, npy_bool),
+            'displays':         numpy.empty(n, npy_bool),
+        }
+        ptrs = [(pointer(arrays[name]) if name in names else None)
+            for name in self._COLUMN_NAMES]
+        f = c_function(self._C_FUNCTION_PREFIX+'_columns',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.py_object)
+        restraints = self._ARRAY_GETTER(f(self._c_pointer, n, *ptrs))
+        return restraints, {name: arrays[name] for name in names}
+
+    def set_columns(self, targets=None, spring_constants=None, enableds=None,
+            displays=None):
+        '''
+        Set properties of all restraints in this manager at once. Each
+        argument (if given) is an array with one value per restraint, in the
+        order returned by :func:`columns`.
+        '''
+        n = self.num_restraints
+        for name, vals, dtype in (
+                ('targets', targets, float64),
+                ('spring_constants', spring_constants, float64),
+                ('enabled', enableds, npy_bool),
+                ('display', displays, npy_bool)):
+            if vals is None:
+                continue
+            vals = numpy.ascontiguousarray(vals, dtype)
+            f = c_function('set_'+self._C_FUNCTION_PREFIX+'_column_'+name,
+                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+            f(self._c_pointer, len(vals), pointer(vals))
+
+
+class ChiralRestraintMgr(_DihedralRestraintColumnsMixin, _RestraintMgr):
     '''
     Manages creation, deletion and mapping of chiral restraints for a single
     atomic structure. Appears as a :py:class:`chimerax.Model` under the
@@ -3229,6 +4441,11 @@ class ChiralRestraintMgr(_RestraintMgr):
         from chimerax.isolde import session_extensions as sx
         chir_mgr = sx.get_chir_restraint_mgr(m)
     '''
+    @classmethod
+    def _ARRAY_GETTER(cls, p):
+        return _chiral_restraints(p)
+    _C_FUNCTION_PREFIX = 'chiral_restraint_mgr'
+
     SESSION_SAVE=True
     def __init__(self, model, c_pointer = None, auto_add_to_session=True):
         super().__init__('Chirality Restraints', model, c_pointer)
@@ -3397,7 +4614,7 @@ class ChiralRestraintMgr(_RestraintMgr):
             _RestraintMgr.restore_checkpoint(self, data)
 
 
-class ProperDihedralRestraintMgr(_RestraintMgr):
+class ProperDihedralRestraintMgr(_DihedralRestraintColumnsMixin, _RestraintMgr):
     '''
     Manages creation, deletion, mapping and drawing of proper dihedral
     restraints for a single atomic structure. Appears as a child
@@ -3559,6 +4776,32 @@ class ProperDihedralRestraintMgr(_RestraintMgr):
         '''
         return self._get_restraints_by_residues_and_name(residues, name, True)
 
+    def restrain_secondary_structure(self, residues, phi, psi, cutoff, spring_constant):
+        '''
+        Creates (where necessary), sets and enables phi and psi restraints
+        for all the given residues in a single call. Returns a tuple of two
+        :py:class:`ProperDihedralRestraints` (phi, psi).
+
+        Args:
+            * residues:
+                - A :py:class:`chimerax.Residues` instance
+            * phi, psi:
+                - target angles in radians
+            * cutoff:
+                - angle (radians) within which no restraining force is
+                  applied
+            * spring_constant:
+                - in :math:`kJ mol^{-1} rad^{-2}`
+        '''
+        pdm = get_proper_dihedral_mgr(self.session)
+        f = c_function('proper_dihedral_restraint_mgr_restrain_secondary_structure',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_double, ctypes.c_double, ctypes.c_double, ctypes.c_double),
+            ret=ctypes.py_object)
+        ptrs = f(self._c_pointer, pdm._c_pointer, residues._c_pointers, len(residues),
+            phi, psi, cutoff, spring_constant)
+        return tuple((self._ARRAY_GETTER(ptrs[0]), self._ARRAY_GETTER(ptrs[1])))
+
     def get_restraint_by_residue_and_name(self, residue, name):
         '''
         Singular form of :func:`get_restraints_by_residues_and_name`. Returns a
@@ -3748,12 +4991,30 @@ class ProperDihedralRestraintMgr(_RestraintMgr):
             return
         ring_d.display = True
         post_d.display = True
-        positions = visibles._annotation_transforms()
-        colors = visibles.annotation_colors
-        ring_d.positions = positions[0]
-        post_d.positions = positions[1]
+        rings, posts, colors = self._annotations(visibles)
+        ring_d.positions = rings
+        post_d.positions = posts
         ring_d.colors = post_d.colors = colors
 
+    def _annotations(self, restraints):
+        '''
+        Ring and post positions and colours for the given restraints, all
+        computed in one call. The manager caches the results, so only
+        restraints which have moved or changed since the last call are
+        recomputed.
+        '''
+        n = len(restraints)
+        f = c_function(self._C_FUNCTION_PREFIX+'_annotations',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p))
+        tf1 = numpy.empty((n,4,4), float32)
+        tf2 = numpy.empty((n,4,4), float32)
+        colors = numpy.empty((n,4), uint8)
+        f(self._c_pointer, restraints._c_pointers, n, pointer(tf1), pointer(tf2),
+            pointer(colors))
+        from chimerax.core.geometry import Places
+        return Places(opengl_array=tf1), Places(opengl_array=tf2), colors
+
     def _session_save_info(self):
         restraints = self.get_all_restraints_for_residues(self.model.residues)
         save_info = {
@@ -3840,6 +5101,44 @@ class AdaptiveDihedralRestraintMgr(ProperDihedralRestraintMgr):
             kappa = 0
         return kappa
 
+    def restrain_to_template(self, dihedrals, template_dihedrals, offsets=None,
+            spring_constant=100, kappa=10):
+        '''
+        Restrain each of the given dihedrals to the current angle of its
+        counterpart in template_dihedrals (which may be in a different model),
+        creating restraints as necessary. Returns the restraints as an
+        :class:`AdaptiveDihedralRestraints`.
+
+        Args:
+            * dihedrals:
+                - a :class:`ProperDihedrals` in this manager's model
+            * template_dihedrals:
+                - a :class:`ProperDihedrals` of the same length
+            * offsets:
+                - optional array of angles (in radians) to add to each
+                  template angle
+            * spring_constant:
+                - in :math:`kJ mol^{-1} rad^{-2}`
+            * kappa:
+                - see :attr:`AdaptiveDihedralRestraint.kappa`
+        '''
+        n = len(dihedrals)
+        if len(template_dihedrals) != n:
+            raise TypeError('Template and restrained dihedral arrays must be the same length!')
+        if offsets is not None:
+            offsets = numpy.ascontiguousarray(offsets, float64)
+            if len(offsets) != n:
+                raise TypeError('Need one offset per dihedral!')
+            offset_ptr = pointer(offsets)
+        else:
+            offset_ptr = None
+        f = c_function('adaptive_dihedral_restraint_mgr_restrain_to_template',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+                ctypes.c_size_t, ctypes.c_double, ctypes.c_double),
+            ret=ctypes.py_object)
+        return _adaptive_dihedral_restraints(f(self._c_pointer, dihedrals._c_pointers,
+            template_dihedrals._c_pointers, offset_ptr, n, spring_constant, kappa))
+
     def disable_mutually_exclusive_restraints(self, restraints, enabled_only=True):
         '''
         ProperDihedralRestraints and AdaptiveDihedralRestraints are mutually
@@ -3964,6 +5263,7 @@ class RotamerRestraintMgr(_RestraintMgr):
             from chimerax.core.triggerset import TriggerSet
             self.triggers = TriggerSet()
         self.triggers.add_trigger('changes')
+        self.triggers.add_trigger('coalesced changes')
         self.pickable=False
         self.model = model
         self._preview_model = None
@@ -3989,6 +5289,51 @@ class RotamerRestraintMgr(_RestraintMgr):
             ret=ctypes.c_size_t)
         return f(self._c_pointer)
 
+    @property
+    def all_restraints(self):
+        '''
+        A :py:class:`RotamerRestraints` covering every restraint this manager
+        holds, read straight from the manager's dense list.
+        '''
+        f=c_function('rotamer_restraint_mgr_all_restraints',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        ret = numpy.empty(self.num_restraints, cptr)
+        f(self._c_pointer, pointer(ret))
+        return _rotamer_restraints(ret)
+
+    def restrain_to_current(self, rotamers_or_residues, spring_constant=None):
+        '''
+        Restrain each rotamer to the target conformation nearest its current
+        chi angles (creating restraints as necessary), in a single pass with
+        all the changes to the chi restraints reported at once. Rotamers
+        without target definitions are skipped. Returns the
+        :py:class:`RotamerRestraints` that were set.
+
+        Args:
+            * rotamers_or_residues:
+                - a :py:class:`Rotamers` or :py:class:`chimerax.Residues` with
+                  all elements belonging to the same molecule as this manager
+            * spring_constant:
+                - in kJ mol-1 rad-2. Defaults to the ISOLDE rotamer spring
+                  constant
+        '''
+        from chimerax.atomic import Residues
+        if isinstance(rotamers_or_residues, Residues):
+            rotamers = get_rotamer_mgr(self.session).get_rotamers(rotamers_or_residues)
+        else:
+            rotamers = rotamers_or_residues
+        if spring_constant is None:
+            from .constants import defaults
+            spring_constant = defaults.ROTAMER_SPRING_CONSTANT
+        f=c_function('rotamer_restraint_mgr_restrain_to_current',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double,
+                ctypes.c_void_p),
+            ret=ctypes.c_size_t)
+        n = len(rotamers)
+        ret = numpy.empty(n, cptr)
+        num = f(self._c_pointer, rotamers._c_pointers, n, spring_constant, pointer(ret))
+        return _rotamer_restraints(ret[0:num])
+
     def _get_restraints(self, rotamers, create=False):
         '''
         Get restraints for the given rotamers. If create is True, any restraints
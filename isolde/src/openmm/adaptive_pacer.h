@@ -0,0 +1,148 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_ADAPTIVE_PACER
+#define ISOLDE_ADAPTIVE_PACER
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace isolde
+{
+
+/*! Chooses how many steps to run between coordinate publishes in a
+ *  continuous simulation, and how long to sleep after each, from the
+ *  measured cost of a step and the rate at which the GUI picks up new
+ *  coordinates.
+ *
+ *  Each chunk of steps is sized to fill one "frame budget": the smaller of
+ *  the target latency and the GUI's polling interval. Publishing more often
+ *  than that only produces frames nobody sees, and publishing less often
+ *  delays what the user sees. The worker doesn't sleep unless the chunk is
+ *  already at max_steps (i.e. the simulation is running faster than it
+ *  needs to), in which case it sleeps out the rest of the budget, just as
+ *  the fixed minimum thread period would.
+ *
+ *  record_poll() is called from the GUI thread, everything else from the
+ *  worker. configure() may be called from either at any time.
+ */
+class Adaptive_Pacer
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    void configure(double target_latency_ms, size_t min_steps, size_t max_steps)
+    {
+        if (!(target_latency_ms > 0))
+            throw std::invalid_argument("Target latency must be greater than zero!");
+        if (min_steps == 0 || max_steps < min_steps)
+            throw std::invalid_argument("Need 0 < min_steps <= max_steps!");
+        _target_latency_ms = target_latency_ms;
+        _min_steps = min_steps;
+        _max_steps = max_steps;
+    }
+    double target_latency_ms() const { return _target_latency_ms; }
+    size_t min_steps() const { return _min_steps; }
+    size_t max_steps() const { return _max_steps; }
+
+    // GUI thread
+    void record_poll()
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+            clock::now().time_since_epoch()).count();
+        int64_t last = _last_poll_us.exchange(now);
+        if (last == 0)
+            return;
+        double dt = (now-last)*1e-3;
+        // Long gaps are pauses or the GUI busy elsewhere, not the render rate
+        if (dt > MAX_POLL_INTERVAL_MS)
+            return;
+        double prev = _gui_interval_ms;
+        _gui_interval_ms = prev > 0 ? prev + ALPHA*(dt-prev) : dt;
+    }
+
+    // Worker thread
+    void reset(size_t steps)
+    {
+        _steps = std::min(std::max(steps, (size_t)_min_steps), (size_t)_max_steps);
+        _step_ms = 0;
+        _overhead_ms = 0;
+        _sleep_ms = 0;
+    }
+    size_t steps() const { return _steps; }
+    clock::duration sleep() const
+    {
+        return std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double, std::milli>(_sleep_ms.load()));
+    }
+
+    //! After each chunk: steps run, time spent integrating and time spent on everything else
+    void update(size_t steps_done, double integrate_ms, double overhead_ms)
+    {
+        if (steps_done == 0)
+            return;
+        double step_ms = integrate_ms/steps_done;
+        double s = _step_ms;
+        _step_ms = s > 0 ? s + ALPHA*(step_ms-s) : step_ms;
+        double o = _overhead_ms;
+        _overhead_ms = o > 0 ? o + ALPHA*(overhead_ms-o) : overhead_ms;
+
+        double budget = frame_budget_ms();
+        double desired = std::max(budget - _overhead_ms, 0.0) / std::max(_step_ms.load(), 1e-6);
+        // At most double or halve per chunk, so that one slow frame (e.g. a
+        // context reinitialisation) doesn't throw the chunk size around
+        double steps = std::min(std::max(desired, 0.5*_steps), 2.0*_steps);
+        size_t n = std::min(std::max((size_t)std::lround(steps), (size_t)_min_steps),
+            (size_t)_max_steps);
+        _steps = n;
+        double predicted = n*_step_ms + _overhead_ms;
+        _sleep_ms = (n == _max_steps) ? std::max(budget - predicted, 0.0) : 0.0;
+    }
+
+    // Either thread
+    double frame_budget_ms() const
+    {
+        double gui = _gui_interval_ms;
+        double target = _target_latency_ms;
+        return gui > 0 ? std::min(gui, target) : target;
+    }
+    double step_time_ms() const { return _step_ms; }
+    double overhead_ms() const { return _overhead_ms; }
+    double gui_interval_ms() const { return _gui_interval_ms; }
+    double sleep_ms() const { return _sleep_ms; }
+    size_t current_steps() const { return _steps; }
+
+private:
+    static constexpr double ALPHA = 0.2; // weight of each new measurement
+    static constexpr double MAX_POLL_INTERVAL_MS = 1000.0;
+
+    std::atomic<double> _target_latency_ms{50.0};
+    std::atomic<size_t> _min_steps{5};
+    std::atomic<size_t> _max_steps{500};
+
+    std::atomic<int64_t> _last_poll_us{0};
+    std::atomic<double> _gui_interval_ms{0};
+
+    std::atomic<size_t> _steps{50};
+    std::atomic<double> _step_ms{0};
+    std::atomic<double> _overhead_ms{0};
+    std::atomic<double> _sleep_ms{0};
+}; // class Adaptive_Pacer
+
+} // namespace isolde
+
+#endif // ISOLDE_ADAPTIVE_PACER
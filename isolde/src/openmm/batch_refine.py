@@ -0,0 +1,386 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Refining many regions of a model one after another in a single simulation,
+for automated post-processing without the GUI. Rather than building and
+starting a new simulation for every region, one is set up to cover them all
+and each region in turn is settled, minimised, briefly equilibrated and
+re-validated with everything else held fixed:
+
+    sm = Sim_Manager(isolde, model, all_region_atoms, isolde.params, isolde.sim_params)
+    batch = sm.batch_refine([residues_1, residues_2, residues_3], steps=500)
+    batch.wait()
+    session.logger.info(batch.summary())
+
+The simulation's System (with all its restraints and MDFF potentials) is
+put in a single OpenMM Context, reused for every region: each is minimised
+with only its own atoms mobile, and equilibrated with the rest of the model
+held in place by a :class:`RegionHoldForce`. The whole settle, minimise and
+equilibrate sequence for a region runs on a :class:`OpenMM_Thread_Handler`
+thread. While it does, the next region's
+mobile selection and starting validation are prepared on the main thread and
+queued behind it, as long as the two don't overlap.
+'''
+
+import numpy
+from simtk import unit
+
+class BatchRefinement:
+    '''
+    Runs the settle, minimise, equilibrate and validate sequence over a list
+    of regions of a :class:`Sim_Handler`'s simulation, without blocking the
+    GUI. The refined coordinates of each region go onto the model as soon as
+    it finishes. When all regions are done the 'finished' trigger fires.
+    '''
+    # Regions handed to the worker at once: the one running, and the next
+    MAX_QUEUED = 2
+
+    def __init__(self, sim_handler, regions, steps=500, settle_iterations=50,
+            settle_tolerance=1.0, max_rounds=5, temperature=None, seed=None):
+        '''
+        Args:
+            * sim_handler:
+                - the :class:`Sim_Handler` whose System to use. Its
+                  simulation must be paused or not yet started, and must stay
+                  that way until the batch is finished
+            * regions:
+                - list of :py:class:`chimerax.Residues` (or
+                  :py:class:`chimerax.Atoms`, expanded to whole residues), one
+                  per region. Only atoms that are mobile in the simulation
+                  take part
+            * steps:
+                - equilibration steps for each region after minimisation
+            * settle_iterations, settle_tolerance:
+                - iteration limit and tolerance (kJ/mol/atom) of the short,
+                  loose minimisation that first settles each region. Zero
+                  iterations skips it
+            * max_rounds:
+                - maximum rounds of (sim_params.minimization_max_iterations)
+                  minimisation for each region
+            * temperature:
+                - equilibration temperature in Kelvin. Defaults to the
+                  simulation temperature
+            * seed:
+                - random number seed for the initial velocities
+        '''
+        sh = self._sim_handler = sim_handler
+        if sh.sim_running and not sh.pause:
+            raise RuntimeError('Pause the simulation before starting a batch refinement!')
+        if max_rounds < 1:
+            raise TypeError('Need at least one round of minimisation!')
+        self._params = params = sh._params
+        self.steps = steps
+        self.settle_iterations = settle_iterations
+        self.settle_tolerance = settle_tolerance
+        self.max_rounds = max_rounds
+        self.temperature = sh.temperature if temperature is None else temperature
+        if seed is None:
+            seed = numpy.random.randint(1, 2**30)
+        self.seed = int(seed)
+        self._running = False
+        self._handler = None
+        self._context = None
+        self._integrator = None
+        self._thread_handler = None
+        self._hold_force = None
+        self._hold_force_index = None
+
+        from chimerax.core.triggerset import TriggerSet
+        self.triggers = TriggerSet()
+        self.triggers.add_trigger('finished')
+
+        from .. import session_extensions as sx
+        session = sh.session
+        self._rama_mgr = sx.get_ramachandran_mgr(session)
+        self._rota_mgr = sx.get_rotamer_mgr(session)
+
+        system = sh._system
+        masses = numpy.array([system.getParticleMass(i).value_in_unit(unit.dalton)
+            for i in range(system.getNumParticles())])
+        all_atoms = sh._atoms
+        self.regions = [_Region(i, r, all_atoms, masses)
+            for i, r in enumerate(regions)]
+        for r in self.regions:
+            r.find_targets(self._rama_mgr, self._rota_mgr)
+        self._next = 0
+        self._queued = []
+
+    @property
+    def running(self):
+        return self._running
+
+    @property
+    def finished(self):
+        return all(r.state in _Region.FINISHED for r in self.regions)
+
+    def start(self, poll=True):
+        '''
+        Create the Context and hand the first regions to the worker. If poll
+        is True, collect finished regions and queue new ones on each new
+        frame.
+        '''
+        if self.running:
+            raise RuntimeError('Batch refinement is already running!')
+        if self.finished:
+            raise RuntimeError('This batch has already been run!')
+        self._create_context()
+        self._running = True
+        self._update()
+        if poll and self._running:
+            self._handler = self._sim_handler.session.triggers.add_handler(
+                'new frame', self._update)
+
+    def wait(self, poll_interval=0.01):
+        '''
+        Start the batch (if not already running) and block until it is
+        finished. Useful in scripts run without the GUI.
+        '''
+        from time import sleep
+        if not self.running:
+            self.start(poll=False)
+        elif self._handler is not None:
+            self._handler.remove()
+            self._handler = None
+        while self.running:
+            self._update()
+            if self.running:
+                sleep(poll_interval)
+
+    def _create_context(self):
+        from .custom_forces import RegionHoldForce
+        sh = self._sim_handler
+        system = sh._system
+        # Taken out again by _release(), so the simulation never sees it
+        hold = self._hold_force = RegionHoldForce(system.getNumParticles())
+        self._hold_force_index = system.addForce(hold)
+        try:
+            self._integrator, self._context, th = sh._create_worker_context(
+                0.1*sh._atoms.coords, self.temperature, self.seed)
+        except:
+            system.removeForce(self._hold_force_index)
+            self._hold_force = None
+            raise
+        th.set_region_hold_force(hold)
+        self._thread_handler = th
+
+    def _update(self, *_):
+        from chimerax.core.triggerset import DEREGISTER
+        th = self._thread_handler
+        try:
+            while True:
+                result = th.pop_region_result()
+                if result is None:
+                    break
+                self._collect(result)
+            if self._queued and th.thread_finished():
+                # Anything still queued was dropped by a failure on the worker
+                th.finalize_thread()
+            self._queue_regions()
+        except:
+            self.cancel()
+            raise
+        if not self.finished:
+            return
+        self._release()
+        self._running = False
+        self._handler = None
+        self.triggers.activate_trigger('finished', self)
+        return DEREGISTER
+
+    def _queue_regions(self):
+        '''
+        Prepare and queue pending regions until the worker has MAX_QUEUED in
+        hand, or the next one depends on coordinates it hasn't finished yet.
+        '''
+        regions = self.regions
+        while self._next < len(regions) and len(self._queued) < self.MAX_QUEUED:
+            r = regions[self._next]
+            if not len(r.indices):
+                r.state = 'skipped'
+                self._next += 1
+                continue
+            if any(r.depends_on(q) for q in self._queued):
+                break
+            r.before = _validation_counts(self._rama_mgr, self._rota_mgr, r.ramas, r.rotamers)
+            params = self._params
+            self._thread_handler.refine_region(r.index, r.indices, self.settle_tolerance,
+                self.settle_iterations, params.minimization_convergence_tol_start,
+                params.minimization_max_iterations, self.max_rounds, self.steps,
+                self.temperature, self.seed+r.index)
+            r.state = 'running'
+            self._queued.append(r)
+            self._next += 1
+
+    def _collect(self, result):
+        r = self.regions[result['id']]
+        self._queued.remove(r)
+        r.start_energy = result['start energy']
+        r.minimized_energy = result['minimized energy']
+        r.final_energy = result['final energy']
+        r.converged = result['converged']
+        r.unstable = result['unstable']
+        if result['clash']:
+            r.state = 'clashing'
+            return
+        r.mobile_atoms.coords = result['coords']
+        r.after = _validation_counts(self._rama_mgr, self._rota_mgr, r.ramas, r.rotamers)
+        r.state = 'done'
+
+    def deltas(self):
+        '''
+        Change in each validation count (after minus before) for each
+        finished region, as a list of (region, dict) tuples. Negative is
+        better.
+        '''
+        return [(r, r.deltas) for r in self.regions if r.state == 'done']
+
+    def summary(self):
+        '''
+        One line of text per region, for the log.
+        '''
+        lines = []
+        for r in self.regions:
+            head = 'Region {} ({} residues)'.format(r.index, len(r.residues))
+            if r.state == 'done':
+                lines.append('{}: E={:.1f} kJ/mol ({:+.1f}){} Rama outliers {}/allowed {} '
+                    'rotamer outliers {}/allowed {}'.format(
+                    head, r.final_energy, r.final_energy-r.start_energy,
+                    '' if r.converged else ' (not converged)',
+                    _delta_text(r, 'rama outliers'), _delta_text(r, 'rama allowed'),
+                    _delta_text(r, 'rotamer outliers'), _delta_text(r, 'rotamer allowed')))
+            else:
+                lines.append('{}: {}'.format(head, r.state))
+        return '\n'.join(lines)
+
+    def _release(self):
+        th = self._thread_handler
+        if th is None:
+            return
+        th.delete()
+        self._thread_handler = None
+        self._context = None
+        self._integrator = None
+        # Only once the Context that uses it is gone
+        system = self._sim_handler._system
+        system.removeForce(self._hold_force_index)
+        self._hold_force = None
+
+    def cancel(self):
+        '''
+        Stop handing out new regions, wait for the worker to finish those it
+        already has, and release the Context. Results of finished regions are
+        kept.
+        '''
+        if self._handler is not None:
+            self._handler.remove()
+            self._handler = None
+        self._running = False
+        th = self._thread_handler
+        if th is not None:
+            th.cancel_minimization()
+            try:
+                th.finalize_thread()
+                while True:
+                    result = th.pop_region_result()
+                    if result is None:
+                        break
+                    self._collect(result)
+            finally:
+                for r in self.regions:
+                    if r.state not in _Region.FINISHED:
+                        r.state = 'cancelled'
+                self._queued = []
+                self._release()
+
+
+def _validation_counts(rama_mgr, rota_mgr, ramas, rotamers):
+    '''
+    Ramachandran and rotamer outliers and allowed-but-not-favoured residues,
+    at the current model coordinates.
+    '''
+    counts = {}
+    Bin = rama_mgr.RamaBin
+    if len(ramas):
+        bins = rama_mgr.bin_scores(*rama_mgr.validate(ramas))
+        counts['rama outliers'] = int((bins==Bin.OUTLIER).sum())
+        counts['rama allowed'] = int((bins==Bin.ALLOWED).sum())
+    else:
+        counts['rama outliers'] = counts['rama allowed'] = 0
+    rota_allowed, rota_outlier = rota_mgr.cutoffs
+    if len(rotamers):
+        p = rota_mgr.validate_rotamers(rotamers)
+        counts['rotamer outliers'] = int((p < rota_outlier).sum())
+        counts['rotamer allowed'] = int(numpy.logical_and(p >= rota_outlier, p < rota_allowed).sum())
+    else:
+        counts['rotamer outliers'] = counts['rotamer allowed'] = 0
+    return counts
+
+def _delta_text(region, key):
+    return '{}->{}'.format(region.before[key], region.after[key])
+
+
+class _Region:
+    FINISHED = ('done', 'clashing', 'skipped', 'cancelled')
+
+    def __init__(self, index, residues_or_atoms, all_atoms, masses):
+        from chimerax.atomic import Atoms
+        if isinstance(residues_or_atoms, Atoms):
+            residues = residues_or_atoms.unique_residues
+        else:
+            residues = residues_or_atoms
+        self.index = index
+        self.residues = residues
+        indices = all_atoms.indices(residues.atoms)
+        indices = indices[indices != -1]
+        # Only atoms already mobile in the simulation, in simulation order
+        indices = numpy.sort(indices[masses[indices] > 0])
+        self.indices = indices
+        self.mobile_atoms = all_atoms[indices]
+        self._all_atoms = all_atoms
+        self.state = 'pending'
+        self.ramas = None
+        self.rotamers = None
+        self.validation_indices = None
+        self.start_energy = None
+        self.minimized_energy = None
+        self.final_energy = None
+        self.converged = None
+        self.unstable = None
+        self.before = None
+        self.after = None
+
+    def find_targets(self, rama_mgr, rota_mgr):
+        '''
+        Find the region's Ramachandran cases and rotamers, and the simulation
+        indices of every atom they depend on.
+        '''
+        from chimerax.atomic import concatenate
+        residues = self.residues
+        ramas = rama_mgr.get_ramas(residues)
+        ramas = self.ramas = ramas[ramas.valids]
+        self.rotamers = rota_mgr.get_rotamers(residues)
+        # Phi and psi reach into the neighbouring residues
+        atoms = [residues.atoms]
+        for dihedrals in (ramas.phi_dihedrals, ramas.psi_dihedrals):
+            atoms.extend(dihedrals.atoms)
+        indices = self._all_atoms.indices(concatenate(atoms))
+        self.validation_indices = indices[indices != -1]
+
+    def depends_on(self, other):
+        '''
+        True if this region's validation involves any atom the other region
+        moves, so it can't be scored until the other region is done.
+        '''
+        return numpy.in1d(self.validation_indices, other.indices).any()
+
+    @property
+    def deltas(self):
+        if self.before is None or self.after is None:
+            return None
+        return {k: self.after[k]-self.before[k] for k in self.before}
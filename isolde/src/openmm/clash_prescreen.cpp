@@ -0,0 +1,152 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#include "clash_prescreen.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include "../atomic_cpp/atom_index.h"
+
+namespace isolde
+{
+
+Clash_Prescreen::Clash_Prescreen(const uint8_t *heavy, size_t n, const int32_t *bonds, size_t n_bonds)
+    : _n(n), _excluded(n)
+{
+    std::vector<std::vector<uint32_t>> bonded(n);
+    for (size_t b=0; b<n_bonds; ++b)
+    {
+        int32_t i = bonds[2*b], j = bonds[2*b+1];
+        if (i < 0 || j < 0 || (size_t)i >= n || (size_t)j >= n)
+            throw std::out_of_range("Bonded particle index out of range!");
+        bonded[i].push_back(j);
+        bonded[j].push_back(i);
+    }
+    for (uint32_t i=0; i<n; ++i)
+    {
+        if (!heavy[i])
+            continue;
+        _heavy.push_back(i);
+        auto& ex = _excluded[i];
+        for (auto j: bonded[i])
+        {
+            ex.push_back(j);
+            for (auto k: bonded[j])
+                if (k != i)
+                    ex.push_back(k);
+        }
+        std::sort(ex.begin(), ex.end());
+        ex.erase(std::unique(ex.begin(), ex.end()), ex.end());
+    }
+}
+
+bool Clash_Prescreen::_is_excluded(uint32_t i, uint32_t j) const
+{
+    const auto& ex = _excluded[i];
+    return std::binary_search(ex.begin(), ex.end(), j);
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> Clash_Prescreen::find_overlaps(
+    const std::vector<OpenMM::Vec3>& positions, const double *mobile_mask) const
+{
+    if (positions.size() != _n)
+        throw std::logic_error("Number of positions does not match the clash pre-screen!");
+    std::vector<std::pair<uint32_t, uint32_t>> overlaps;
+    const double d = _overlap_distance, d2 = d*d;
+    Cell_Grid grid(d);
+    double xyz[3];
+    for (uint32_t h=0; h<_heavy.size(); ++h)
+    {
+        const auto& p = positions[_heavy[h]];
+        for (size_t a=0; a<3; ++a)
+            xyz[a] = p[a];
+        grid.insert(h, xyz);
+    }
+    for (uint32_t h=0; h<_heavy.size(); ++h)
+    {
+        uint32_t i = _heavy[h];
+        if (mobile_mask[i] == 0.0)
+            continue;
+        const auto& p = positions[i];
+        for (size_t a=0; a<3; ++a)
+            xyz[a] = p[a];
+        grid.for_each_in_box(xyz, d, [&](uint32_t g) {
+            uint32_t j = _heavy[g];
+            // Count each mobile-mobile pair once
+            if (j == i || (mobile_mask[j] != 0.0 && j < i))
+                return;
+            auto diff = positions[j]-p;
+            if (diff.dot(diff) < d2 && !_is_excluded(i, j))
+                overlaps.emplace_back(i, j);
+        });
+    }
+    return overlaps;
+}
+
+Clash_Prescreen::Stats Clash_Prescreen::resolve(OpenMM::Context& context,
+    const double *mobile_mask, size_t max_iterations, double constraint_tolerance) const
+{
+    Stats s;
+    auto state = context.getState(OpenMM::State::Positions);
+    auto positions = state.getPositions();
+    auto overlaps = find_overlaps(positions, mobile_mask);
+    s.found = overlaps.size();
+    while (!overlaps.empty() && s.iterations < max_iterations)
+    {
+        state = context.getState(OpenMM::State::Forces);
+        const auto& forces = state.getForces();
+        double fmax2 = 0;
+        bool finite = true;
+        for (size_t i=0; i<_n; ++i)
+        {
+            if (mobile_mask[i] == 0.0)
+                continue;
+            double f2 = forces[i].dot(forces[i]);
+            if (!std::isfinite(f2))
+            {
+                finite = false;
+                break;
+            }
+            fmax2 = std::max(fmax2, f2);
+        }
+        if (finite && fmax2 > 0)
+        {
+            double scale = _max_step/sqrt(fmax2);
+            for (size_t i=0; i<_n; ++i)
+                if (mobile_mask[i] != 0.0)
+                    positions[i] += forces[i]*scale;
+        } else {
+            // Atoms close enough to give non-finite forces: push each
+            // overlapping pair straight apart instead
+            for (const auto& o: overlaps)
+            {
+                auto diff = positions[o.first]-positions[o.second];
+                double r = sqrt(diff.dot(diff));
+                OpenMM::Vec3 dir = r > 1e-6 ? diff*(1.0/r) : OpenMM::Vec3(1, 0, 0);
+                bool mobile_j = mobile_mask[o.second] != 0.0;
+                double step = mobile_j ? _max_step/2 : _max_step;
+                positions[o.first] += dir*step;
+                if (mobile_j)
+                    positions[o.second] -= dir*step;
+            }
+        }
+        context.setPositions(positions);
+        context.applyConstraints(constraint_tolerance);
+        positions = context.getState(OpenMM::State::Positions).getPositions();
+        overlaps = find_overlaps(positions, mobile_mask);
+        s.iterations++;
+    }
+    s.remaining = overlaps.size();
+    return s;
+}
+
+} // namespace isolde
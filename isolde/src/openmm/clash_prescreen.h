@@ -0,0 +1,87 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_CLASH_PRESCREEN
+#define ISOLDE_CLASH_PRESCREEN
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <OpenMM.h>
+
+namespace isolde
+{
+
+/*! Finds and pushes apart severe overlaps between heavy atoms before energy
+ *  minimisation. The L-BFGS minimiser copes badly with atoms sitting almost
+ *  on top of each other (as in rough docked or hand-built models): the huge
+ *  forces send its line search off the scale, and it typically spends many
+ *  iterations getting nowhere before giving up. A few dozen steps of capped
+ *  steepest descent, in which the worst-affected atom moves by at most a
+ *  fixed distance per step, untangle such overlaps far more cheaply and
+ *  leave something the minimiser can finish off.
+ *
+ *  Overlaps are found with a Cell_Grid over the heavy atoms, ignoring pairs
+ *  separated by one or two bonds. Only pairs involving at least one mobile
+ *  atom count, and only mobile atoms are moved.
+ */
+class Clash_Prescreen
+{
+public:
+    struct Stats
+    {
+        size_t found = 0;      // overlaps before the pass
+        size_t remaining = 0;  // overlaps after it
+        size_t iterations = 0;
+    };
+
+    Clash_Prescreen() {}
+    /*! heavy has one flag per particle. bonds holds n_bonds pairs of particle
+     *  indices, used to exclude 1-2 and 1-3 pairs.
+     */
+    Clash_Prescreen(const uint8_t *heavy, size_t n, const int32_t *bonds, size_t n_bonds);
+
+    bool empty() const { return _heavy.empty(); }
+    size_t num_particles() const { return _n; }
+
+    //! Heavy atoms closer than this (nm) count as a severe overlap
+    void set_overlap_distance(double d) { _overlap_distance = d; }
+    double overlap_distance() const { return _overlap_distance; }
+    //! Largest distance (nm) any atom moves in one step
+    void set_max_step(double d) { _max_step = d; }
+    double max_step() const { return _max_step; }
+
+    //! Overlapping pairs of particles, where mobile_mask (one per particle) is non-zero for at least one
+    std::vector<std::pair<uint32_t, uint32_t>> find_overlaps(
+        const std::vector<OpenMM::Vec3>& positions, const double *mobile_mask) const;
+
+    /*! Run capped steepest descent on the context until no overlaps remain,
+     *  or max_iterations is reached. Leaves the context positions updated
+     *  and constrained.
+     */
+    Stats resolve(OpenMM::Context& context, const double *mobile_mask,
+        size_t max_iterations, double constraint_tolerance) const;
+
+private:
+    size_t _n = 0;
+    std::vector<uint32_t> _heavy; // particle indices
+    std::vector<std::vector<uint32_t>> _excluded; // sorted 1-2 and 1-3 partners, per particle
+    double _overlap_distance = 0.2; // nm
+    double _max_step = 0.01; // nm
+
+    bool _is_excluded(uint32_t i, uint32_t j) const;
+}; // class Clash_Prescreen
+
+} // namespace isolde
+
+#endif // ISOLDE_CLASH_PRESCREEN
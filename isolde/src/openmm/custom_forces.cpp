@@ -18,7 +18,156 @@
 
 #include "../molc.h"
 #include <vector>
+#include <cmath>
+#include <stdexcept>
 #include <OpenMM.h>
+#include "custom_forces.h"
+
+namespace isolde
+{
+namespace custom_forces
+{
+
+void update_parameters(OpenMM::CustomBondForce *f, size_t n, const int *indices, const double *params)
+{
+    int n_params = f->getNumPerBondParameters();
+    std::vector<double> param_vec(n_params);
+    int particle1, particle2;
+    for (size_t i=0; i<n; ++i) {
+        int index = *(indices++);
+        f->getBondParameters(index, particle1, particle2, param_vec);
+        for (int j=0; j<n_params; ++j) {
+            param_vec[j] = *params++;
+        }
+        f->setBondParameters(index, particle1, particle2, param_vec);
+    }
+}
+
+void update_parameters(OpenMM::CustomCompoundBondForce *f, size_t n, const int *indices, const double *params)
+{
+    int n_params = f->getNumPerBondParameters();
+    std::vector<double> param_vec(n_params);
+    int n_particles = f->getNumParticlesPerBond();
+    std::vector<int> particles(n_particles);
+    for (size_t i=0; i<n; ++i) {
+        int index = *(indices++);
+        f->getBondParameters(index, particles, param_vec);
+        for (int j=0; j<n_params; ++j) {
+            param_vec[j] = *params++;
+        }
+        f->setBondParameters(index, particles, param_vec);
+    }
+}
+
+void update_parameters(OpenMM::CustomExternalForce *f, size_t n, const int *indices, const double *params)
+{
+    int n_params = f->getNumPerParticleParameters();
+    std::vector<double> param_vec(n_params);
+    int particle;
+    for (size_t i=0; i<n; ++i) {
+        int index = *(indices++);
+        f->getParticleParameters(index, particle, param_vec);
+        for (int j=0; j<n_params; ++j) {
+            param_vec[j] = *params++;
+        }
+        f->setParticleParameters(index, particle, param_vec);
+    }
+}
+
+void update_parameters(OpenMM::CustomTorsionForce *f, size_t n, const int *indices, const double *params)
+{
+    int n_params = f->getNumPerTorsionParameters();
+    std::vector<double> param_vec(n_params);
+    int p1, p2, p3, p4;
+    for (size_t i=0; i<n; ++i) {
+        int index = *(indices++);
+        f->getTorsionParameters(index, p1, p2, p3, p4, param_vec);
+        for (int j=0; j<n_params; ++j) {
+            param_vec[j] = *params++;
+        }
+        f->setTorsionParameters(index, p1, p2, p3, p4, param_vec);
+    }
+}
+
+void update_parameters(OpenMM::Force *f, Force_Type type, size_t n, const int *indices, const double *params)
+{
+    switch (type)
+    {
+        case CUSTOM_BOND:
+            update_parameters(static_cast<OpenMM::CustomBondForce *>(f), n, indices, params);
+            return;
+        case CUSTOM_COMPOUND_BOND:
+            update_parameters(static_cast<OpenMM::CustomCompoundBondForce *>(f), n, indices, params);
+            return;
+        case CUSTOM_EXTERNAL:
+            update_parameters(static_cast<OpenMM::CustomExternalForce *>(f), n, indices, params);
+            return;
+        case CUSTOM_TORSION:
+            update_parameters(static_cast<OpenMM::CustomTorsionForce *>(f), n, indices, params);
+            return;
+    }
+    throw std::invalid_argument("Unrecognised force type!");
+}
+
+size_t num_parameters(const OpenMM::Force *f, Force_Type type)
+{
+    switch (type)
+    {
+        case CUSTOM_BOND:
+            return static_cast<const OpenMM::CustomBondForce *>(f)->getNumPerBondParameters();
+        case CUSTOM_COMPOUND_BOND:
+            return static_cast<const OpenMM::CustomCompoundBondForce *>(f)->getNumPerBondParameters();
+        case CUSTOM_EXTERNAL:
+            return static_cast<const OpenMM::CustomExternalForce *>(f)->getNumPerParticleParameters();
+        case CUSTOM_TORSION:
+            return static_cast<const OpenMM::CustomTorsionForce *>(f)->getNumPerTorsionParameters();
+    }
+    throw std::invalid_argument("Unrecognised force type!");
+}
+
+void update_parameters_in_context(OpenMM::Force *f, Force_Type type, OpenMM::Context& context)
+{
+    switch (type)
+    {
+        case CUSTOM_BOND:
+            static_cast<OpenMM::CustomBondForce *>(f)->updateParametersInContext(context);
+            return;
+        case CUSTOM_COMPOUND_BOND:
+            static_cast<OpenMM::CustomCompoundBondForce *>(f)->updateParametersInContext(context);
+            return;
+        case CUSTOM_EXTERNAL:
+            static_cast<OpenMM::CustomExternalForce *>(f)->updateParametersInContext(context);
+            return;
+        case CUSTOM_TORSION:
+            static_cast<OpenMM::CustomTorsionForce *>(f)->updateParametersInContext(context);
+            return;
+    }
+    throw std::invalid_argument("Unrecognised force type!");
+}
+
+double adaptive_distance_force(double r, const double *params)
+{
+    // Same switches as the energy expression in custom_forces.py
+    const double enabled = params[0], kappa = params[1], c = params[2];
+    const double r0 = params[3], tau = params[4], alpha = params[5];
+    double delta_r = r-r0;
+    if (enabled < 0.5 || std::abs(delta_r) < tau)
+        return 0;
+    double rho = (delta_r-tau != 0) ? r0+tau : r0-tau;
+    double x = r-rho;
+    double c_sq = c*c;
+    double q = x*x/c_sq;
+    if (alpha == 2)
+        return kappa*x/c_sq;
+    if (alpha == 0)
+        return kappa*x/c_sq / (q/2+1);
+    return kappa*x/c_sq * pow(q/std::abs(2-alpha)+1, alpha/2-1);
+}
+
+} // namespace custom_forces
+} // namespace isolde
+
+using namespace isolde;
 
 extern "C"
 {
@@ -65,18 +214,7 @@ customcompoundbondforce_update_bond_parameters(void *force, size_t n, int *indic
 {
     OpenMM::CustomCompoundBondForce *f = static_cast<OpenMM::CustomCompoundBondForce *>(force);
     try {
-        int n_params = f->getNumPerBondParameters();
-        std::vector<double> param_vec(n_params);
-        int n_particles = f->getNumParticlesPerBond();
-        std::vector<int> particles(n_particles);
-        for (size_t i=0; i<n; ++i) {
-            int index = *(indices++);
-            f->getBondParameters(index, particles, param_vec);
-            for (int j=0; j<n_params; ++j) {
-                param_vec[j] = *params++;
-            }
-            f->setBondParameters(index, particles, param_vec);
-        }
+        custom_forces::update_parameters(f, n, indices, params);
     } catch (...) {
         molc_error();
     }
@@ -107,23 +245,12 @@ custombondforce_update_bond_parameters(void *force, size_t n, int *indices, doub
 {
     OpenMM::CustomBondForce *f = static_cast<OpenMM::CustomBondForce *>(force);
     try {
-        int n_params = f->getNumPerBondParameters();
-        std::vector<double> param_vec(n_params);
-        int particle1, particle2;
-        for (size_t i=0; i<n; ++i) {
-            int index = *(indices++);
-            f->getBondParameters(index, particle1, particle2, param_vec);
-            for (int j=0; j<n_params; ++j) {
-                param_vec[j] = *params++;
-            }
-            f->setBondParameters(index, particle1, particle2, param_vec);
-        }
+        custom_forces::update_parameters(f, n, indices, params);
     } catch (...) {
         molc_error();
     }
 }
 
-
 EXPORT void
 customexternalforce_add_particles(void *force, size_t n, int *particle_indices, double *params, int *force_indices)
 {
@@ -146,17 +273,7 @@ customexternalforce_update_particle_parameters(void *force, size_t n, int *indic
 {
     OpenMM::CustomExternalForce *f = static_cast<OpenMM::CustomExternalForce *>(force);
     try {
-        int n_params = f->getNumPerParticleParameters();
-        std::vector<double> param_vec(n_params);
-        int particle;
-        for (size_t i=0; i<n; ++i) {
-            int index = *(indices++);
-            f->getParticleParameters(index, particle, param_vec);
-            for (int j=0; j<n_params; ++j) {
-                param_vec[j] = *params++;
-            }
-            f->setParticleParameters(index, particle, param_vec);
-        }
+        custom_forces::update_parameters(f, n, indices, params);
     } catch (...) {
         molc_error();
     }
@@ -189,17 +306,7 @@ customtorsionforce_update_torsion_parameters(void *force, size_t n, int *indices
 {
     OpenMM::CustomTorsionForce *f = static_cast<OpenMM::CustomTorsionForce *>(force);
     try {
-        int n_params = f->getNumPerTorsionParameters();
-        std::vector<double> param_vec(n_params);
-        int p1, p2, p3, p4;
-        for (size_t i=0; i<n; ++i) {
-            int index = *(indices++);
-            f->getTorsionParameters(index, p1, p2, p3, p4, param_vec);
-            for (int j=0; j<n_params; ++j) {
-                param_vec[j] = *params++;
-            }
-            f->setTorsionParameters(index, p1, p2, p3, p4, param_vec);
-        }
+        custom_forces::update_parameters(f, n, indices, params);
     } catch (...) {
         molc_error();
     }
@@ -0,0 +1,116 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_CUSTOM_FORCES
+#define ISOLDE_CUSTOM_FORCES
+
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <OpenMM.h>
+
+namespace isolde
+{
+namespace custom_forces
+{
+
+//! The custom force types whose per-term parameters ISOLDE updates in bulk
+enum Force_Type
+{
+    CUSTOM_BOND=0,
+    CUSTOM_COMPOUND_BOND=1,
+    CUSTOM_EXTERNAL=2,
+    CUSTOM_TORSION=3
+};
+
+/*! Replace the per-term parameters for n terms of the given force. params
+ *  holds num_parameters(force, type) values for each entry in indices.
+ */
+void update_parameters(OpenMM::CustomBondForce *f, size_t n, const int *indices, const double *params);
+void update_parameters(OpenMM::CustomCompoundBondForce *f, size_t n, const int *indices, const double *params);
+void update_parameters(OpenMM::CustomExternalForce *f, size_t n, const int *indices, const double *params);
+void update_parameters(OpenMM::CustomTorsionForce *f, size_t n, const int *indices, const double *params);
+
+//! Dispatch to the right update_parameters() overload for a generic Force
+void update_parameters(OpenMM::Force *f, Force_Type type, size_t n, const int *indices, const double *params);
+
+//! Number of per-term parameters for a generic Force
+size_t num_parameters(const OpenMM::Force *f, Force_Type type);
+
+//! Push the force's current parameters to the context
+void update_parameters_in_context(OpenMM::Force *f, Force_Type type, OpenMM::Context& context);
+
+//! Per-term parameters of an AdaptiveDistanceRestraintForce: enabled, kappa, c, r0, tau, alpha
+const size_t ADAPTIVE_DISTANCE_PARAMS = 6;
+
+/*! Derivative of the AdaptiveDistanceRestraintForce energy with respect to
+ *  distance r (nm) for one term, in kJ/mol/nm.
+ */
+double adaptive_distance_force(double r, const double *params);
+
+/*! Accumulates parameter changes for a single force. If the same term is
+ *  changed more than once before the batch is applied, only the most recent
+ *  values are kept.
+ */
+class Parameter_Batch
+{
+public:
+    Parameter_Batch() {}
+    Parameter_Batch(Force_Type type, size_t n_params): _type(type), _n_params(n_params) {}
+
+    Force_Type type() const { return _type; }
+    size_t size() const { return _indices.size(); }
+    size_t num_parameters() const { return _n_params; }
+    const int* indices() const { return _indices.data(); }
+    const double* parameters() const { return _params.data(); }
+
+    void add(size_t n, const int *indices, const double *params)
+    {
+        for (size_t i=0; i<n; ++i)
+        {
+            int index = indices[i];
+            const double *p = params + i*_n_params;
+            auto it = _slots.find(index);
+            if (it != _slots.end()) {
+                std::copy(p, p+_n_params, _params.begin() + it->second*_n_params);
+                continue;
+            }
+            _slots[index] = _indices.size();
+            _indices.push_back(index);
+            _params.insert(_params.end(), p, p+_n_params);
+        }
+    }
+
+    //! Merge in a later batch for the same force
+    void add(const Parameter_Batch& other)
+    {
+        add(other.size(), other.indices(), other.parameters());
+    }
+
+    void apply(OpenMM::Force *f) const
+    {
+        update_parameters(f, _type, size(), indices(), parameters());
+    }
+
+private:
+    Force_Type _type = CUSTOM_BOND;
+    size_t _n_params = 0;
+    std::vector<int> _indices;
+    std::vector<double> _params;
+    std::unordered_map<int, size_t> _slots; // term index -> position in _indices
+}; // class Parameter_Batch
+
+} // namespace custom_forces
+} // namespace isolde
+
+#endif // ISOLDE_CUSTOM_FORCES
@@ -71,6 +71,40 @@ OPENMM_TIME_UNIT = defaults.OPENMM_TIME_UNIT
 OPENMM_DIPOLE_UNIT = defaults.OPENMM_DIPOLE_UNIT
 
 
+class _Staged_Parameters_Mixin:
+    '''
+    Provides the bulk parameter upload used by the update_targets() (or
+    update_atoms()) methods of the restraint forces below. If
+    :attr:`thread_handler` is set (this is done by the :class:`Sim_Handler`
+    while a simulation is running) the new parameters are staged in the
+    C++ :class:`OpenMM_Thread_Handler`, which applies all staged changes for
+    all forces on the simulation thread with at most one
+    updateParametersInContext() call per force per frame. Otherwise they
+    are written directly to the force object, and :attr:`update_needed` is
+    set.
+    '''
+    # One of the custom_forces::Force_Type values in custom_forces.h
+    CUSTOM_BOND = 0
+    CUSTOM_COMPOUND_BOND = 1
+    CUSTOM_EXTERNAL = 2
+    CUSTOM_TORSION = 3
+
+    _FORCE_TYPE = None
+    _UPDATE_FUNCTION = None
+    thread_handler = None
+
+    def _upload_parameters(self, indices, params):
+        th = self.thread_handler
+        if th is not None:
+            th.stage_force_parameters(self, self._FORCE_TYPE, indices, params)
+            return
+        f = c_function(self._UPDATE_FUNCTION,
+            args=(ctypes.c_void_p, ctypes.c_size_t,
+            ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_double)))
+        f(int(self.this), len(indices), pointer(indices), pointer(params))
+        self.update_needed = True
+
+
 class AmberCMAPForce(CMAPTorsionForce):
     '''
     CMAP-style corrections to AMBER 12/14 forcefields to give improved
@@ -132,11 +166,14 @@ class AmberCMAPForce(CMAPTorsionForce):
         super().addTorsion(map_index, *phi_indices.tolist(), *psi_indices.tolist())
 
 
-class _Map_Force_Base(CustomCompoundBondForce):
+class _Map_Force_Base(_Staged_Parameters_Mixin, CustomCompoundBondForce):
     '''
     Base class for :class:`LinearInterpMapForce`,
     :class:`CubicInterpMapForce` and :class:`CubicInterpMapForce_Low_Memory`.
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_COMPOUND_BOND
+    _UPDATE_FUNCTION = 'customcompoundbondforce_update_bond_parameters'
+
     def __init__(self, data, xyz_to_ijk_transform, suffix, units = 'angstroms'):
         '''
         For a given atom at (x,y,z), the map potential will be defined
@@ -164,6 +201,7 @@ class _Map_Force_Base(CustomCompoundBondForce):
                   Either 'angstroms' or 'nanometers'
         '''
         super().__init__(1, '')
+        self._suffix = suffix
         self._process_transform(xyz_to_ijk_transform, units)
         self._initialize_transform_arguments(suffix)
         map_func = self._openmm_3D_function_from_volume(data)
@@ -270,6 +308,36 @@ class _Map_Force_Base(CustomCompoundBondForce):
                     self.setGlobalParameterDefaultValue(int(index), float(val))
                     self.update_needed=True
 
+    def set_map(self, data, xyz_to_ijk_transform, units='angstroms'):
+        '''
+        Replace the map data and its transform, e.g. to re-crop the map or
+        switch from a coarse to a full-resolution grid. Tabulated functions
+        can only be changed in the :class:`openmm.System`, so this takes
+        effect the next time the context is reinitialised.
+
+        Args:
+            * data:
+                - The map data as a 3D (i,j,k) NumPy array in C-style order
+            * xyz_to_ijk_transform:
+                - A NumPy 3x4 float array defining the transformation matrix
+                  mapping (x,y,z) coordinates to (i,j,k)
+            * units:
+                - The units in which the transformation matrix is defined.
+                  Either 'angstroms' or 'nanometers'
+        '''
+        self._process_transform(xyz_to_ijk_transform, units)
+        tf = self._transform
+        tfi = self._tf_term_indices
+        for i in range(3):
+            for j in range(4):
+                self.setGlobalParameterDefaultValue(int(tfi[i,j]), float(tf[i,j]))
+        # Terms that were (nearly) zero in the old transform were left out of
+        # the energy expression, so it has to be rebuilt
+        self.setEnergyFunction(self._set_energy_function(self._suffix))
+        new_func = self._openmm_3D_function_from_volume(data)
+        self.getTabulatedFunction(self._map_potential_index).setFunctionParameters(
+            *new_func.getFunctionParameters())
+
     # def update_transform(self, transform, units):
     #     self._process_transform(transform, units)
     #     tf = self._transform
@@ -323,16 +391,12 @@ class _Map_Force_Base(CustomCompoundBondForce):
                 - A Boolean array defining which atoms are to be enabled
                   in the force.
         '''
-        f = c_function('customcompoundbondforce_update_bond_parameters',
-            args = (ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
-                ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         ind = convert_and_sanitize_numpy_array(indices, int32)
         params = numpy.empty((n,2), float64)
         params[:,0] = ks
         params[:,1] = enableds
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
     def update_atom(self, index, k, enabled):
         '''
@@ -650,7 +714,7 @@ class LinearInterpMapForce(_Map_Force_Base):
         data_1d = numpy.ravel(data, order = 'C')
         return Discrete3DFunction(*dim, data_1d)
 
-class AdaptiveDistanceRestraintForce(CustomBondForce):
+class AdaptiveDistanceRestraintForce(_Staged_Parameters_Mixin, CustomBondForce):
     r'''
     A :py:class:`openmm.CustomBondForce` subclass using the generalised adaptive
     loss function described by Jonathan Barron
@@ -732,6 +796,9 @@ class AdaptiveDistanceRestraintForce(CustomBondForce):
     All parameters are settable at the individual restraint level.
 
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_BOND
+    _UPDATE_FUNCTION = 'custombondforce_update_bond_parameters'
+
     def __init__(self):
 
         # Loss functions
@@ -893,9 +960,6 @@ class AdaptiveDistanceRestraintForce(CustomBondForce):
                   restraint outside of the central well. Values less than one
                   cause the applied force to fall off with increasing distance.
         '''
-        f = c_function('custombondforce_update_bond_parameters',
-            args=(ctypes.c_void_p, ctypes.c_size_t,
-            ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         ind = convert_and_sanitize_numpy_array(indices, int32)
         params = numpy.empty((n,6), float64)
@@ -905,12 +969,11 @@ class AdaptiveDistanceRestraintForce(CustomBondForce):
         params[:,3] = targets
         params[:,4] = tolerances
         params[:,5] = alphas
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
 
 
-class TopOutBondForce(CustomBondForce):
+class TopOutBondForce(_Staged_Parameters_Mixin, CustomBondForce):
     r'''
     A :py:class:`openmm.CustomBondForce` subclass defined as a standard harmonic
     potential with a user-defined fixed maximum cutoff on the applied force. Any
@@ -930,6 +993,9 @@ class TopOutBondForce(CustomBondForce):
         \end{cases}
 
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_BOND
+    _UPDATE_FUNCTION = 'custombondforce_update_bond_parameters'
+
     def __init__(self, max_force):
         '''
         Initialise the force object and set the maximum force magnitude.
@@ -1052,20 +1118,16 @@ class TopOutBondForce(CustomBondForce):
             * targets:
                 - the new target distances in nanometres
         '''
-        f = c_function('custombondforce_update_bond_parameters',
-            args=(ctypes.c_void_p, ctypes.c_size_t,
-            ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         ind = convert_and_sanitize_numpy_array(indices, int32)
         params = numpy.empty((n,3), float64)
         params[:,0] = enableds
         params[:,1] = spring_constants
         params[:,2] = targets
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
 
-class TopOutRestraintForce(CustomExternalForce):
+class TopOutRestraintForce(_Staged_Parameters_Mixin, CustomExternalForce):
     r'''
     A :py:class:`openmm.CustomExternalForce` subclass designed to restrain atoms
     to defined positions via a standard harmonic potential with a user-defined
@@ -1085,6 +1147,9 @@ class TopOutRestraintForce(CustomExternalForce):
         \end{cases}
 
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_EXTERNAL
+    _UPDATE_FUNCTION = 'customexternalforce_update_particle_parameters'
+
     def __init__(self, max_force):
         '''
         Initialise the force object and set the maximum force magnitude.
@@ -1203,9 +1268,6 @@ class TopOutRestraintForce(CustomExternalForce):
                 - A (nx3) float array providing the new target (x,y,z) positions
                   in nanometres.
         '''
-        f = c_function('customexternalforce_update_particle_parameters',
-            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
-                ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         if len(targets) !=n or len(spring_constants) !=n:
             raise TypeError('Parameter array lengths must match number of indices!')
@@ -1214,8 +1276,7 @@ class TopOutRestraintForce(CustomExternalForce):
         params[:,0] = enableds
         params[:,1] = spring_constants
         params[:,2:] = targets
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
     def release_restraint(self, index):
         '''
@@ -1228,7 +1289,75 @@ class TopOutRestraintForce(CustomExternalForce):
         self.update_target(index, enabled=False)
 
 
-class FlatBottomTorsionRestraintForce(CustomTorsionForce):
+class GridBiasForce(CustomExternalForce):
+    r'''
+    Carrier for the conformational bias computed by the simulation thread
+    from ISOLDE's Ramachandran and rotamer log-probability grids
+    (:math:`E = -k \ln(P)` over the relevant dihedrals). There is one entry
+    per particle in the simulation, in particle order. The thread handler
+    periodically evaluates the grids and writes each particle's force
+    :math:`(f_x, f_y, f_z)` and share of the energy :math:`e` at its current
+    position :math:`(x_0, y_0, z_0)`, giving the first-order expansion:
+
+    .. math::
+
+        E = e - f_x(x-x_0) - f_y(y-y_0) - f_z(z-z_0)
+
+    All parameters start at zero, and are never set from Python.
+    '''
+    def __init__(self, num_particles):
+        '''
+        Args:
+            * num_particles:
+                - number of particles in the simulation
+        '''
+        super().__init__('e - fx*(x-x0) - fy*(y-y0) - fz*(z-z0)')
+        for p in ('e', 'fx', 'fy', 'fz', 'x0', 'y0', 'z0'):
+            self.addPerParticleParameter(p)
+        f = c_function('customexternalforce_add_particles',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
+                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_int32)))
+        ind = numpy.arange(num_particles, dtype=int32)
+        params = numpy.zeros((num_particles, 7), float64)
+        ret = numpy.empty(num_particles, int32)
+        f(int(self.this), num_particles, pointer(ind), pointer(params), pointer(ret))
+        self.update_needed = False
+
+
+class RegionHoldForce(CustomExternalForce):
+    r'''
+    Holds everything outside the region being equilibrated in a batch
+    refinement (see :class:`chimerax.isolde.openmm.batch_refine.BatchRefinement`),
+    so that moving on to the next region never means changing particle
+    masses and reinitialising the Context. There is one entry per particle,
+    in particle order, with the harmonic potential:
+
+    .. math::
+
+        E = 0.5 k ((x-x_0)^2 + (y-y_0)^2 + (z-z_0)^2)
+
+    All parameters start at zero, and are only ever set by the thread handler.
+    '''
+    def __init__(self, num_particles):
+        '''
+        Args:
+            * num_particles:
+                - number of particles in the simulation
+        '''
+        super().__init__('0.5*k*((x-x0)^2+(y-y0)^2+(z-z0)^2)')
+        for p in ('k', 'x0', 'y0', 'z0'):
+            self.addPerParticleParameter(p)
+        f = c_function('customexternalforce_add_particles',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
+                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_int32)))
+        ind = numpy.arange(num_particles, dtype=int32)
+        params = numpy.zeros((num_particles, 4), float64)
+        ret = numpy.empty(num_particles, int32)
+        f(int(self.this), num_particles, pointer(ind), pointer(params), pointer(ret))
+        self.update_needed = False
+
+
+class FlatBottomTorsionRestraintForce(_Staged_Parameters_Mixin, CustomTorsionForce):
     r'''
     A :py:class:`openmm.CustomTorsionForce` subclass designed to restrain
     torsion angles while allowing free movement within a range (target +/-
@@ -1246,6 +1375,9 @@ class FlatBottomTorsionRestraintForce(CustomTorsionForce):
             -k*cos(\theta-\theta_0), & \text{otherwise}
         \end{cases}
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_TORSION
+    _UPDATE_FUNCTION = 'customtorsionforce_update_torsion_parameters'
+
     def __init__(self):
         '''
         Initialise the force object. No restraints are added at this stage.
@@ -1358,9 +1490,6 @@ class FlatBottomTorsionRestraintForce(CustomTorsionForce):
             * cutoffs:
                 - the new cutoff angles in radians
         '''
-        f = c_function('customtorsionforce_update_torsion_parameters',
-            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
-                ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         ind = convert_and_sanitize_numpy_array(indices, int32)
         params = numpy.empty((n,4), float64)
@@ -1368,10 +1497,9 @@ class FlatBottomTorsionRestraintForce(CustomTorsionForce):
         params[:,1] = spring_constants
         params[:,2] = targets
         params[:,3] = numpy.cos(cutoffs)
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
-class TopOutTorsionForce(CustomTorsionForce):
+class TopOutTorsionForce(_Staged_Parameters_Mixin, CustomTorsionForce):
     r'''
     Torsion-space analogy to the AdaptiveDistanceRestraintForce: often when
     restraining the model to a template (or restraining NCS copies to their
@@ -1406,6 +1534,9 @@ class TopOutTorsionForce(CustomTorsionForce):
     centred on :math:`\theta-\theta_0`. As :math:`\kappa` approaches zero, the
     energy term converges to a standard unimodal cosine.
     '''
+    _FORCE_TYPE = _Staged_Parameters_Mixin.CUSTOM_TORSION
+    _UPDATE_FUNCTION = 'customtorsionforce_update_torsion_parameters'
+
     def __init__(self):
         default_energy_term = ('-1 + '
                       '-k * sqrt(2)*exp(-1/2*sqrt(4*kappa^2+1)-kappa+1/2)'
@@ -1527,9 +1658,6 @@ class TopOutTorsionForce(CustomTorsionForce):
             * cutoffs:
                 - the new kappas in inverse square radians
         '''
-        f = c_function('customtorsionforce_update_torsion_parameters',
-            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_int32),
-                ctypes.POINTER(ctypes.c_double)))
         n = len(indices)
         ind = convert_and_sanitize_numpy_array(indices, int32)
         params = numpy.empty((n,4), float64)
@@ -1537,8 +1665,7 @@ class TopOutTorsionForce(CustomTorsionForce):
         params[:,1] = spring_constants
         params[:,2] = targets
         params[:,3] = kappas
-        f(int(self.this), n, pointer(ind), pointer(params))
-        self.update_needed = True
+        self._upload_parameters(ind, params)
 
 
 
@@ -35,6 +35,113 @@ class Template_Mgr:
             pass
 
 
+class Template_Matcher:
+    '''
+    Native topology-based matching of residues to the templates in an OpenMM
+    forcefield. Each template's bond graph is hashed once, when the template is
+    first seen; :func:`match` then hashes the residues and confirms candidate
+    matches in C++, in parallel over all residues. Templates loaded into the
+    forcefield after the matcher was created (e.g. ligands loaded on demand)
+    are picked up automatically.
+
+    Use :func:`get_template_matcher` rather than creating these directly.
+    '''
+    NO_MATCH = -1
+    AMBIGUOUS = -2
+
+    def __init__(self, forcefield):
+        from .openmm_interface import c_function
+        import ctypes
+        self._c_function = c_function
+        self._c_pointer = ctypes.c_void_p(
+            c_function('template_matcher_new', args=(), ret=ctypes.c_void_p)())
+        self.forcefield = forcefield
+        self.template_names = []
+
+    def _update_templates(self):
+        ff_templates = self.forcefield._templates
+        names = self.template_names
+        if len(ff_templates) == len(names):
+            return
+        if len(ff_templates) < len(names):
+            raise RuntimeError('Templates have been removed from the forcefield. '
+                'Please create a new Template_Matcher.')
+        import numpy, ctypes
+        from .openmm_interface import pointer
+        new_names = list(ff_templates.keys())[len(names):]
+        atom_counts = []
+        bond_counts = []
+        elements = []
+        bonds = []
+        for name in new_names:
+            t = ff_templates[name]
+            atom_counts.append(len(t.atoms))
+            elements.extend(0 if a.element is None else a.element.atomic_number
+                for a in t.atoms)
+            bond_counts.append(len(t.bonds))
+            for b in t.bonds:
+                bonds.extend(b)
+        atom_counts = numpy.array(atom_counts, numpy.uintp)
+        bond_counts = numpy.array(bond_counts, numpy.uintp)
+        elements = numpy.array(elements, numpy.int32)
+        bonds = numpy.array(bonds, numpy.int32)
+        f = self._c_function('template_matcher_add_templates',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, len(new_names), pointer(atom_counts),
+            pointer(elements), pointer(bond_counts), pointer(bonds))
+        names.extend(new_names)
+
+    def match(self, residues):
+        '''
+        Find the forcefield template for each residue by topology, following
+        OpenMM's rules for ignoreExternalBonds=True (atoms are matched by
+        element and intra-residue bonds only).
+
+        Args:
+            * residues:
+                - a :class:`chimerax.Residues` instance
+
+        Returns:
+            * a numpy int64 array giving the index into :attr:`template_names`
+              of the only matching template for each residue, or
+              :attr:`NO_MATCH`, or :attr:`AMBIGUOUS` if more than one
+              template matches.
+        '''
+        self._update_templates()
+        import numpy, ctypes
+        from .openmm_interface import pointer
+        n = len(residues)
+        ret = numpy.empty(n, numpy.int64)
+        f = self._c_function('template_matcher_match',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+        f(self._c_pointer, residues._c_pointers, n, pointer(ret))
+        return ret
+
+    def delete(self):
+        if self._c_pointer is not None:
+            import ctypes
+            self._c_function('template_matcher_delete',
+                args=(ctypes.c_void_p,))(self._c_pointer)
+            self._c_pointer = None
+
+    def __del__(self):
+        self.delete()
+
+from weakref import WeakKeyDictionary
+_template_matchers = WeakKeyDictionary()
+
+def get_template_matcher(forcefield):
+    '''
+    Get the :class:`Template_Matcher` for a forcefield, creating it if
+    necessary.
+    '''
+    m = _template_matchers.get(forcefield, None)
+    if m is None:
+        m = _template_matchers[forcefield] = Template_Matcher(forcefield)
+    return m
+
+
 
 
 def delete_extraneous_hydrogens(residue, template):
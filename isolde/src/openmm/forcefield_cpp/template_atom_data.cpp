@@ -1,9 +0,0 @@
-/**
- * @Author: Tristan Croll <tic20>
- * @Date:   18-Feb-2019
- * @Email:  tic20@cam.ac.uk
- * @Last modified by:   tic20
- * @Last modified time: 11-Jun-2019
- * @License: Free for non-commercial use (see license.pdf)
- * @Copyright: 2016-2019 Tristan Croll
- */
@@ -3,7 +3,7 @@
  * @Date:   11-Jun-2019
  * @Email:  tic20@cam.ac.uk
  * @Last modified by:   tic20
- * @Last modified time: 11-Jun-2019
+ * @Last modified time: 14-Oct-2026
  * @License: Free for non-commercial use (see license.pdf)
  * @Copyright: 2016-2019 Tristan Croll
  */
@@ -12,34 +12,27 @@
 
 #pragma once
 
-#include <map>
-#include <string>
+#include <vector>
 
 namespace OpenMM_FF {
 
+//! One atom of a residue or template bond graph
+/*! Only what is needed to match a residue to its template is kept: the
+ *  element (atomic number, or 0 for template extra particles with no element)
+ *  and the indices of the atoms it is bonded to within the same residue.
+ */
 class TemplateAtomData
 {
 public:
-    TemplateAtomData(const std::string& name, const std::string& type,
-        const std::string& element, const std::map<std::string, double> params)
-        : name_(name), type_(type), element_(element), params_(params) {}
-
-    inline const std::string& name() const { return name_; }
-    inline const std::string& element() const { return element_; }
-    inline const std::string& type() const { return type_; }
-    inline double get_param(const std::string& name) const { return params_.at(name); }
+    TemplateAtomData(int element): element_(element) {}
+
+    inline int element() const { return element_; }
     inline const std::vector<int>& bondedTo() const { return bonded_to_; }
-    inline addBond(int index) { external_bonds_.push_back(index); }
-    inline const int& externalBonds() const { return external_bonds_; }
-    inline int& externalBonds() { return external_bonds_; }
+    inline void addBond(int index) { bonded_to_.push_back(index); }
 
 private:
-    std::string name_;
-    std::string type_;
-    std::string element_;
-    std::map<std::string, double> params_;
+    int element_;
     std::vector<int> bonded_to_;
-    int external_bonds_ = 0;
 
 }; // class TemplateAtomData
 
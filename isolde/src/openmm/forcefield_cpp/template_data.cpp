@@ -1,9 +1,183 @@
 /**
  * @Author: Tristan Croll <tic20>
- * @Date:   18-Feb-2019
+ * @Date:   11-Jun-2019
  * @Email:  tic20@cam.ac.uk
  * @Last modified by:   tic20
- * @Last modified time: 11-Jun-2019
+ * @Last modified time: 14-Oct-2026
  * @License: Free for non-commercial use (see license.pdf)
  * @Copyright: 2016-2019 Tristan Croll
  */
+
+
+
+#include "template_data.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace OpenMM_FF
+{
+
+namespace
+{
+
+inline uint64_t mix(uint64_t h, uint64_t v)
+{
+    h ^= v + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// Backtracking search for a bijection from g onto h, visiting the atoms of g
+// in breadth-first order so each new atom usually has an already-mapped
+// neighbour to pin it down.
+class Isomorphism_Search
+{
+public:
+    Isomorphism_Search(const ResidueGraph& g, const ResidueGraph& h)
+        : g_(g), h_(h), fwd_(g.numAtoms(), -1), rev_(h.numAtoms(), -1)
+    {
+        for (size_t i=0; i<h.numAtoms(); ++i)
+            by_colour_[h.colour(i)].push_back(i);
+    }
+
+    bool run()
+    {
+        if (!make_order())
+            return false;
+        return extend(0);
+    }
+
+private:
+    const ResidueGraph& g_;
+    const ResidueGraph& h_;
+    std::vector<int> fwd_, rev_, order_;
+    std::unordered_map<uint64_t, std::vector<int>> by_colour_;
+
+    const std::vector<int>* candidates(int v) const
+    {
+        auto it = by_colour_.find(g_.colour(v));
+        return it == by_colour_.end() ? nullptr : &it->second;
+    }
+
+    // Each connected component starts from its atom with the fewest candidates
+    bool make_order()
+    {
+        size_t n = g_.numAtoms();
+        std::vector<uint8_t> seen(n, 0);
+        order_.reserve(n);
+        while (order_.size() < n)
+        {
+            int start = -1;
+            size_t fewest = 0;
+            for (size_t i=0; i<n; ++i)
+            {
+                if (seen[i])
+                    continue;
+                auto c = candidates(i);
+                if (c == nullptr)
+                    return false;
+                if (start < 0 || c->size() < fewest)
+                {
+                    start = i;
+                    fewest = c->size();
+                }
+            }
+            seen[start] = 1;
+            order_.push_back(start);
+            for (size_t k=order_.size()-1; k<order_.size(); ++k)
+                for (int j: g_.atom(order_[k]).bondedTo())
+                    if (!seen[j])
+                    {
+                        seen[j] = 1;
+                        order_.push_back(j);
+                    }
+        }
+        return true;
+    }
+
+    // Mapped neighbours of v must map onto neighbours of t, and t may have no
+    // other mapped neighbours
+    bool consistent(int v, int t) const
+    {
+        if (g_.atom(v).element() != h_.atom(t).element())
+            return false;
+        const auto& tb = h_.atom(t).bondedTo();
+        size_t mapped = 0;
+        for (int u: g_.atom(v).bondedTo())
+        {
+            if (fwd_[u] < 0)
+                continue;
+            ++mapped;
+            if (std::find(tb.begin(), tb.end(), fwd_[u]) == tb.end())
+                return false;
+        }
+        size_t t_mapped = 0;
+        for (int w: tb)
+            if (rev_[w] >= 0)
+                ++t_mapped;
+        return mapped == t_mapped;
+    }
+
+    bool extend(size_t depth)
+    {
+        if (depth == order_.size())
+            return true;
+        int v = order_[depth];
+        for (int t: *candidates(v))
+        {
+            if (rev_[t] >= 0 || !consistent(v, t))
+                continue;
+            fwd_[v] = t;
+            rev_[t] = v;
+            if (extend(depth+1))
+                return true;
+            fwd_[v] = -1;
+            rev_[t] = -1;
+        }
+        return false;
+    }
+}; // class Isomorphism_Search
+
+} // anonymous namespace
+
+void ResidueGraph::finalize()
+{
+    size_t n = atoms_.size();
+    colours_.resize(n);
+    for (size_t i=0; i<n; ++i)
+        colours_[i] = mix(atoms_[i].element(), atoms_[i].bondedTo().size());
+    std::vector<uint64_t> next(n), nc;
+    for (size_t r=0; r<REFINEMENT_ROUNDS; ++r)
+    {
+        for (size_t i=0; i<n; ++i)
+        {
+            nc.clear();
+            for (int j: atoms_[i].bondedTo())
+                nc.push_back(colours_[j]);
+            std::sort(nc.begin(), nc.end());
+            uint64_t h = colours_[i];
+            for (auto c: nc)
+                h = mix(h, c);
+            next[i] = h;
+        }
+        colours_.swap(next);
+    }
+    std::vector<uint64_t> sorted(colours_);
+    std::sort(sorted.begin(), sorted.end());
+    hash_ = mix(n, num_bonds_);
+    for (auto c: sorted)
+        hash_ = mix(hash_, c);
+}
+
+bool ResidueGraph::matches(const ResidueGraph& other) const
+{
+    if (numAtoms() != other.numAtoms() || num_bonds_ != other.num_bonds_
+        || hash_ != other.hash_)
+        return false;
+    return Isomorphism_Search(*this, other).run();
+}
+
+} // namespace OpenMM_FF
@@ -3,7 +3,7 @@
  * @Date:   11-Jun-2019
  * @Email:  tic20@cam.ac.uk
  * @Last modified by:   tic20
- * @Last modified time: 11-Jun-2019
+ * @Last modified time: 14-Oct-2026
  * @License: Free for non-commercial use (see license.pdf)
  * @Copyright: 2016-2019 Tristan Croll
  */
@@ -12,26 +12,53 @@
 
 #pragma once
 
-#include <map>
-#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 #include "template_atom_data.h"
 
 namespace OpenMM_FF
 {
 
-class ResidueTemplate
+//! Element-labelled bond graph of a residue or forcefield template
+/*! Once all atoms and bonds are added, finalize() computes a colour for
+ *  each atom by a few rounds of Weisfeiler-Lehman refinement (element,
+ *  then repeatedly the sorted colours of its neighbours) and a hash of the
+ *  whole graph from the multiset of colours. Isomorphic graphs always have
+ *  equal hashes; matches() confirms a candidate pair exactly.
+ */
+class ResidueGraph
 {
 public:
-    ResidueTemplate(const std::string& name )
-        : name_(name);
+    ResidueGraph() {}
+
+    inline void addAtom(int element) { atoms_.emplace_back(element); }
+    inline void addBond(int a1, int a2)
+    {
+        atoms_[a1].addBond(a2);
+        atoms_[a2].addBond(a1);
+        ++num_bonds_;
+    }
+    void finalize();
+
+    inline size_t numAtoms() const { return atoms_.size(); }
+    inline size_t numBonds() const { return num_bonds_; }
+    inline const TemplateAtomData& atom(size_t i) const { return atoms_[i]; }
+    inline uint64_t colour(size_t i) const { return colours_[i]; }
+    inline uint64_t hash() const { return hash_; }
+
+    //! True if there is an element- and bond-preserving bijection onto other
+    bool matches(const ResidueGraph& other) const;
 
 private:
-    std::string name_;
     std::vector<TemplateAtomData> atoms_;
+    size_t num_bonds_ = 0;
+    std::vector<uint64_t> colours_;
+    uint64_t hash_ = 0;
 
+    static const size_t REFINEMENT_ROUNDS = 3;
 
-
-}; // class TemplateData
+}; // class ResidueGraph
 
 } // namespace OpenMM_FF
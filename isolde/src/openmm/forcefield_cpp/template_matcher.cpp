@@ -0,0 +1,161 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifdef _WIN32
+# define EXPORT __declspec(dllexport)
+#else
+# define EXPORT __attribute__((__visibility__("default")))
+#endif
+
+#include "../../molc.h"
+#include <algorithm>
+#include <atomstruct/Atom.h>
+#include "template_matcher.h"
+#include "../../thread_pool.h"
+
+using namespace atomstruct;
+
+namespace OpenMM_FF
+{
+
+void residue_graph(const Residue* r, ResidueGraph& graph)
+{
+    const auto& atoms = r->atoms();
+    for (auto a: atoms)
+        graph.addAtom(a->element().number());
+    for (size_t i=0; i<atoms.size(); ++i)
+        for (auto n: atoms[i]->neighbors())
+        {
+            if (n->residue() != r)
+                continue;
+            size_t j = std::find(atoms.begin(), atoms.end(), n) - atoms.begin();
+            // Each bond is seen from both ends
+            if (j > i)
+                graph.addBond(i, j);
+        }
+    graph.finalize();
+}
+
+void TemplateMatcher::addTemplate(ResidueGraph&& graph)
+{
+    by_hash_.emplace(graph.hash(), templates_.size());
+    templates_.push_back(std::move(graph));
+}
+
+void TemplateMatcher::match(Residue** residues, size_t n, int64_t* out) const
+{
+    isolde::Thread_Pool::instance().parallel_chunks(n, MIN_MATCH_CHUNK, [&](size_t start, size_t end) {
+        for (size_t i=start; i<end; ++i)
+        {
+            ResidueGraph g;
+            residue_graph(residues[i], g);
+            int64_t found = NO_MATCH;
+            auto range = by_hash_.equal_range(g.hash());
+            for (auto it=range.first; it!=range.second; ++it)
+            {
+                if (!g.matches(templates_[it->second]))
+                    continue;
+                if (found != NO_MATCH)
+                {
+                    found = AMBIGUOUS;
+                    break;
+                }
+                found = it->second;
+            }
+            out[i] = found;
+        }
+    });
+}
+
+} // namespace OpenMM_FF
+
+using namespace OpenMM_FF;
+
+extern "C"
+{
+
+EXPORT void*
+template_matcher_new()
+{
+    try {
+        return new TemplateMatcher();
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
+EXPORT void
+template_matcher_delete(void *matcher)
+{
+    auto m = static_cast<TemplateMatcher *>(matcher);
+    try {
+        delete m;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+EXPORT size_t
+template_matcher_num_templates(void *matcher)
+{
+    auto m = static_cast<TemplateMatcher *>(matcher);
+    try {
+        return m->numTemplates();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+/*! Templates are packed end to end: atom_counts[i] elements and bond_counts[i]
+ *  (a1, a2) pairs of template-local atom indices per template.
+ */
+EXPORT void
+template_matcher_add_templates(void *matcher, size_t n, size_t *atom_counts,
+    int32_t *elements, size_t *bond_counts, int32_t *bonds)
+{
+    auto m = static_cast<TemplateMatcher *>(matcher);
+    try {
+        for (size_t i=0; i<n; ++i)
+        {
+            ResidueGraph g;
+            for (size_t j=0; j<atom_counts[i]; ++j)
+                g.addAtom(*elements++);
+            for (size_t j=0; j<bond_counts[i]; ++j, bonds+=2)
+            {
+                if (bonds[0] < 0 || bonds[1] < 0 || (size_t)bonds[0] >= atom_counts[i]
+                    || (size_t)bonds[1] >= atom_counts[i])
+                    throw std::out_of_range("Template bond refers to a non-existent atom!");
+                g.addBond(bonds[0], bonds[1]);
+            }
+            g.finalize();
+            m->addTemplate(std::move(g));
+        }
+    } catch (...) {
+        molc_error();
+    }
+}
+
+EXPORT void
+template_matcher_match(void *matcher, void *residues, size_t n, int64_t *template_indices)
+{
+    auto m = static_cast<TemplateMatcher *>(matcher);
+    Residue **r = static_cast<Residue **>(residues);
+    try {
+        m->match(r, n, template_indices);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+} // extern "C"
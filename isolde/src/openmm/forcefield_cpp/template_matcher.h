@@ -0,0 +1,64 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#pragma once
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <atomstruct/Residue.h>
+
+#include "template_data.h"
+
+namespace OpenMM_FF
+{
+
+//! Matches ChimeraX residues to the residue templates of a forcefield by topology
+/*! Templates are added in the order they appear in the forcefield, and are
+ *  afterwards referred to by that index. Matching follows OpenMM's rules
+ *  with ignoreExternalBonds=True: a residue matches a template if their
+ *  intra-residue bond graphs are identical, with atoms labelled only by
+ *  element. Atom names are ignored.
+ */
+class TemplateMatcher
+{
+public:
+    static const int64_t NO_MATCH = -1;
+    static const int64_t AMBIGUOUS = -2;
+
+    TemplateMatcher() {}
+
+    //! Add one template. The graph must already be finalized.
+    void addTemplate(ResidueGraph&& graph);
+    inline size_t numTemplates() const { return templates_.size(); }
+
+    //! Find the template for each residue
+    /*! Writes the index of the only matching template, NO_MATCH, or AMBIGUOUS
+     *  if more than one template matches (OpenMM then decides whether
+     *  they are interchangeable). Residues are matched in parallel.
+     */
+    void match(atomstruct::Residue** residues, size_t n, int64_t* out) const;
+
+private:
+    std::vector<ResidueGraph> templates_;
+    std::unordered_multimap<uint64_t, size_t> by_hash_;
+
+    //! Smallest number of residues worth handing to another thread
+    static const size_t MIN_MATCH_CHUNK = 64;
+
+}; // class TemplateMatcher
+
+//! Intra-residue bond graph of a ChimeraX residue
+void residue_graph(const atomstruct::Residue* r, ResidueGraph& graph);
+
+} // namespace OpenMM_FF
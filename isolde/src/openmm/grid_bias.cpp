@@ -0,0 +1,147 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#include "grid_bias.h"
+#include <cmath>
+#include <stdexcept>
+
+namespace isolde
+{
+
+namespace
+{
+
+/*! Dihedral angle p0-p1-p2-p3 (IUPAC sign convention, as for OpenMM and
+ *  ProperDihedral), and its derivative with respect to each position. The
+ *  derivatives are left at zero if either half of the dihedral is linear.
+ */
+double dihedral_with_gradient(const OpenMM::Vec3& p0, const OpenMM::Vec3& p1,
+    const OpenMM::Vec3& p2, const OpenMM::Vec3& p3, OpenMM::Vec3 *d)
+{
+    OpenMM::Vec3 b1 = p1-p0, b2 = p2-p1, b3 = p3-p2;
+    OpenMM::Vec3 n1 = b1.cross(b2), n2 = b2.cross(b3);
+    double b2_sq = b2.dot(b2), b2_len = sqrt(b2_sq);
+    double n1_sq = n1.dot(n1), n2_sq = n2.dot(n2);
+    double angle = atan2(b2_len*b1.dot(n2), n1.dot(n2));
+    for (size_t i=0; i<4; ++i)
+        d[i] = OpenMM::Vec3();
+    if (n1_sq < 1e-12 || n2_sq < 1e-12 || b2_sq < 1e-12)
+        return angle;
+    d[0] = n1*(-b2_len/n1_sq);
+    d[3] = n2*(b2_len/n2_sq);
+    double f1 = b1.dot(b2)/b2_sq, f3 = b3.dot(b2)/b2_sq;
+    d[1] = d[3]*f3 - d[0]*(1+f1);
+    d[2] = d[0]*f1 - d[3]*(1+f3);
+    return angle;
+}
+
+} // anonymous namespace
+
+size_t Grid_Bias::add_grid(const Grid& grid, const double *periods)
+{
+    Grid_Terms gt(grid);
+    size_t dim = grid.dim();
+    if (periods != nullptr)
+        gt.periods.assign(periods, periods+dim);
+    else
+        for (size_t i=0; i<dim; ++i)
+        {
+            size_t n = grid.length()[i];
+            if (n < 3)
+                throw std::logic_error("Grid is too small to hold wrapped padding!");
+            gt.periods.push_back((grid.max()[i]-grid.min()[i])*(n-2)/(n-1));
+        }
+    _grids.push_back(std::move(gt));
+    return _grids.size()-1;
+}
+
+int Grid_Bias::_slot(int particle)
+{
+    auto it = _slot_of.find(particle);
+    if (it != _slot_of.end())
+        return it->second;
+    int slot = _particles.size();
+    _slot_of[particle] = slot;
+    _particles.push_back(particle);
+    return slot;
+}
+
+void Grid_Bias::add_terms(size_t grid, size_t n, const int *particles, const double *k)
+{
+    if (grid >= _grids.size())
+        throw std::out_of_range("Grid index out of range!");
+    auto& gt = _grids[grid];
+    size_t per_term = 4*gt.grid.dim();
+    for (size_t i=0; i<n*per_term; ++i)
+        if (particles[i] < 0)
+            throw std::out_of_range("Negative particle index!");
+    for (size_t i=0; i<n*per_term; ++i)
+        gt.slots.push_back(_slot(particles[i]));
+    gt.k.insert(gt.k.end(), k, k+n);
+    _n_terms += n;
+}
+
+void Grid_Bias::clear()
+{
+    _grids.clear();
+    _n_terms = 0;
+    _particles.clear();
+    _slot_of.clear();
+}
+
+double Grid_Bias::compute(const std::vector<OpenMM::Vec3>& positions, double scale,
+    std::vector<OpenMM::Vec3>& forces, std::vector<double>& energies)
+{
+    forces.assign(_particles.size(), OpenMM::Vec3());
+    energies.assign(_particles.size(), 0.0);
+    double total = 0;
+    for (auto& gt: _grids)
+    {
+        size_t dim = gt.grid.dim();
+        size_t n = gt.k.size();
+        if (n == 0)
+            continue;
+        gt.angles.resize(n*dim);
+        gt.dangles.resize(n*dim*4);
+        gt.values.resize(n);
+        gt.gradients.resize(n*dim);
+        for (size_t a=0; a<n*dim; ++a)
+        {
+            const int *s = gt.slots.data() + 4*a;
+            gt.angles[a] = dihedral_with_gradient(positions[_particles[s[0]]],
+                positions[_particles[s[1]]], positions[_particles[s[2]]],
+                positions[_particles[s[3]]], gt.dangles.data() + 4*a);
+        }
+        gt.grid.interpolate_with_gradient(gt.angles.data(), n, gt.values.data(),
+            gt.gradients.data(), gt.periods.data());
+        for (size_t t=0; t<n; ++t)
+        {
+            double k = gt.k[t]*scale;
+            double e = -k*gt.values[t];
+            energies[gt.slots[4*dim*t]] += e;
+            total += e;
+            for (size_t j=0; j<dim; ++j)
+            {
+                size_t a = t*dim+j;
+                // F = -dE/dphi * dphi/dr, with dE/dphi = -k dln(P)/dphi
+                double f = k*gt.gradients[a];
+                const int *s = gt.slots.data() + 4*a;
+                const OpenMM::Vec3 *d = gt.dangles.data() + 4*a;
+                for (size_t i=0; i<4; ++i)
+                    forces[s[i]] += d[i]*f;
+            }
+        }
+    }
+    return total;
+}
+
+} // namespace isolde
@@ -0,0 +1,96 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_GRID_BIAS
+#define ISOLDE_GRID_BIAS
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <OpenMM.h>
+#include "../interpolation/nd_interp.h"
+
+namespace isolde
+{
+
+/*! Conformational bias potential over sets of dihedrals, taken straight
+ *  from ISOLDE's log-probability validation grids (Ramachandran or rotamer).
+ *  Each term applies E = -k ln(P(angles)) to its dihedrals, with the
+ *  gradient from RegularGridInterpolator::interpolate_with_gradient(). The
+ *  grids are shared with (not copied from) the validation managers.
+ *
+ *  compute() evaluates every term at once, batched by grid, and gives the
+ *  resulting force on each particle involved.
+ */
+class Grid_Bias
+{
+public:
+    typedef RegularGridInterpolator<double, float> Grid;
+
+    bool empty() const { return _n_terms == 0; }
+    size_t num_grids() const { return _grids.size(); }
+    size_t num_terms() const { return _n_terms; }
+    //! Number of dihedrals in each term on the given grid
+    size_t dim(size_t grid) const { return _grids.at(grid).grid.dim(); }
+
+    /*! Add a log-probability grid, returning its index. periods gives the
+     *  period of each axis (zero if not periodic); if null, every axis is
+     *  taken to be periodic with the first and last points as wrapped
+     *  padding, as for the validation grids.
+     */
+    size_t add_grid(const Grid& grid, const double *periods=nullptr);
+
+    /*! Add n terms on the given grid. particles holds four particle indices
+     *  for each of the grid's dim() dihedrals, for each term; k is the
+     *  strength of each term in kJ/mol per unit ln(P).
+     */
+    void add_terms(size_t grid, size_t n, const int *particles, const double *k);
+    void clear();
+
+    //! Every particle in at least one term, in order of first appearance
+    const std::vector<int>& particles() const { return _particles; }
+
+    /*! Evaluate all terms at the given positions, with each term's k
+     *  multiplied by scale. On return forces[i] (kJ/mol/nm) and energies[i]
+     *  (kJ/mol) are the force on and energy assigned to particles()[i]: the
+     *  energy of each term goes to its first particle. Returns the total
+     *  energy.
+     */
+    double compute(const std::vector<OpenMM::Vec3>& positions, double scale,
+        std::vector<OpenMM::Vec3>& forces, std::vector<double>& energies);
+
+private:
+    struct Grid_Terms
+    {
+        Grid grid;
+        std::vector<double> periods;
+        std::vector<int> slots; // 4*dim per term, indices into _particles
+        std::vector<double> k;
+        // Scratch: angles, their derivatives with respect to each particle,
+        // and the interpolated values and gradients
+        std::vector<double> angles;
+        std::vector<OpenMM::Vec3> dangles;
+        std::vector<double> values, gradients;
+
+        explicit Grid_Terms(const Grid& g): grid(g) {}
+    };
+    std::vector<Grid_Terms> _grids;
+    size_t _n_terms = 0;
+    std::vector<int> _particles;
+    std::unordered_map<int, int> _slot_of;
+
+    int _slot(int particle);
+}; // class Grid_Bias
+
+} // namespace isolde
+
+#endif // ISOLDE_GRID_BIAS
@@ -0,0 +1,54 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_HAPTIC_LINK
+#define ISOLDE_HAPTIC_LINK
+
+#include "spsc_ring.h"
+
+namespace isolde
+{
+
+/*! Where a haptic device wants its tugged atom to be, in model coordinates
+ *  (Angstroms). spring_constant is in kJ mol-1 A-2.
+ */
+struct Haptic_Target
+{
+    double xyz[3];
+    double spring_constant;
+    bool tugging;
+};
+
+//! Current position of the tugged atom, in model coordinates (Angstroms)
+struct Haptic_Feedback
+{
+    double xyz[3];
+};
+
+/*! The channel between a haptic device thread and the simulation worker
+ *  (OpenMM_Thread_Handler::attach_haptic_link()). The device thread pushes
+ *  a target on every tick of its loop; the worker takes the newest one
+ *  before each chunk of integration and pushes back the atom's position
+ *  after it, which the device thread renders as force for as many ticks as
+ *  it takes the next one to arrive. Shared between separately-built
+ *  libraries, so this layout must not change without rebuilding both.
+ */
+struct Haptic_Link
+{
+    static const size_t RING_SIZE = 64;
+    Spsc_Ring<Haptic_Target, RING_SIZE> targets;    // device thread -> worker
+    Spsc_Ring<Haptic_Feedback, RING_SIZE> feedback; // worker -> device thread
+};
+
+} // namespace isolde
+
+#endif // ISOLDE_HAPTIC_LINK
@@ -0,0 +1,29 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+/* Single-precision build of the bundled liblbfgs, with its public functions
+ * renamed lbfgsf*() (see lbfgs_float_names.h). Where SSE is available the
+ * library's own arithmetic_sse_float.h kernels are used for the vector
+ * updates, working on four floats at a time (the double-precision build uses
+ * the plain ANSI arithmetic).
+ */
+
+#define LBFGS_FLOAT 32
+#if defined(__SSE__) && !defined(USE_SSE)
+#define USE_SSE
+#endif
+#if defined(USE_SSE) && !defined(_MSC_VER) && !defined(HAVE_XMMINTRIN_H)
+#define HAVE_XMMINTRIN_H 1
+#endif
+
+#include "lbfgs_float_names.h"
+#include "../deps/lbfgs/src/lbfgs.c"
@@ -0,0 +1,44 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_LBFGS_FLOAT
+#define ISOLDE_LBFGS_FLOAT
+
+/* Declarations for the single-precision liblbfgs built by lbfgs_float.c.
+ * lbfgs.h is included a second time with LBFGS_FLOAT set to 32, inside a
+ * namespace so its float typedefs don't collide with the double ones. The
+ * functions themselves keep C linkage under their lbfgsf*() names.
+ */
+
+#include "lbfgs.h"
+
+#undef __LBFGS_H__
+#undef LBFGS_FLOAT
+#define LBFGS_FLOAT 32
+
+namespace isolde
+{
+namespace lbfgs_float
+{
+#include "lbfgs_float_names.h"
+#include "lbfgs.h"
+#undef lbfgs
+#undef lbfgs_malloc
+#undef lbfgs_free
+#undef lbfgs_parameter_init
+} // namespace lbfgs_float
+} // namespace isolde
+
+#undef LBFGS_FLOAT
+#define LBFGS_FLOAT 64
+
+#endif // ISOLDE_LBFGS_FLOAT
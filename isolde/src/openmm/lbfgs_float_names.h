@@ -0,0 +1,22 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+/* Public symbol names for the single-precision build of liblbfgs, so that it
+ * can be linked alongside the double-precision one. Deliberately has no
+ * include guard: lbfgs_float.h needs to define and undefine these around its
+ * own include of lbfgs.h.
+ */
+
+#define lbfgs lbfgsf
+#define lbfgs_malloc lbfgsf_malloc
+#define lbfgs_free lbfgsf_free
+#define lbfgs_parameter_init lbfgsf_parameter_init
@@ -0,0 +1,188 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifdef _WIN32
+# define EXPORT __declspec(dllexport)
+#else
+# define EXPORT __attribute__((__visibility__("default")))
+#endif
+
+#include "../molc.h"
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "map_prep.h"
+
+namespace isolde
+{
+namespace map_prep
+{
+
+void crop_bounds(const double *tf, size_t n, const double *coords,
+    double padding, const size_t *dims, int64_t *ijk_min, int64_t *ijk_max)
+{
+    if (n == 0)
+    {
+        for (size_t a=0; a<3; ++a)
+        {
+            ijk_min[a] = 0;
+            ijk_max[a] = (int64_t)dims[a] - 1;
+        }
+        return;
+    }
+    double lo[3], hi[3];
+    for (size_t a=0; a<3; ++a)
+    {
+        lo[a] = std::numeric_limits<double>::max();
+        hi[a] = std::numeric_limits<double>::lowest();
+    }
+    for (size_t p=0; p<n; ++p)
+    {
+        const double *xyz = coords + 3*p;
+        for (size_t a=0; a<3; ++a)
+        {
+            const double *row = tf + 4*a;
+            double g = row[0]*xyz[0] + row[1]*xyz[1] + row[2]*xyz[2] + row[3];
+            lo[a] = std::min(lo[a], g);
+            hi[a] = std::max(hi[a], g);
+        }
+    }
+    for (size_t a=0; a<3; ++a)
+    {
+        // A unit step in any direction moves the grid index along this axis
+        // by at most the norm of the corresponding transform row.
+        const double *row = tf + 4*a;
+        double pad = padding * sqrt(row[0]*row[0] + row[1]*row[1] + row[2]*row[2]);
+        int64_t top = (int64_t)dims[a] - 1;
+        int64_t mn = (int64_t)floor(lo[a] - pad);
+        int64_t mx = (int64_t)ceil(hi[a] + pad);
+        ijk_min[a] = std::max((int64_t)0, std::min(mn, top));
+        ijk_max[a] = std::max(ijk_min[a], std::min(mx, top));
+    }
+}
+
+void extracted_size(const int64_t *ijk_min, const int64_t *ijk_max,
+    size_t step, size_t *out_dims)
+{
+    if (step == 0) step = 1;
+    for (size_t a=0; a<3; ++a)
+        out_dims[a] = (size_t)(ijk_max[a] - ijk_min[a]) / step + 1;
+}
+
+template <typename T>
+void extract(const T *data, const int64_t *strides, const int64_t *ijk_min,
+    const int64_t *ijk_max, size_t step, float *out)
+{
+    if (step == 0) step = 1;
+    size_t od[3];
+    extracted_size(ijk_min, ijk_max, step, od);
+    const int64_t s = (int64_t)step;
+    if (step == 1)
+    {
+        for (int64_t k=ijk_min[2]; k<=ijk_max[2]; ++k)
+            for (int64_t j=ijk_min[1]; j<=ijk_max[1]; ++j)
+            {
+                const T *row = data + k*strides[0] + j*strides[1];
+                for (int64_t i=ijk_min[0]; i<=ijk_max[0]; ++i)
+                    *out++ = (float)row[i*strides[2]];
+            }
+        return;
+    }
+    // Box average, one output row at a time
+    std::vector<double> sums(od[0]);
+    std::vector<size_t> counts(od[0]);
+    for (size_t ok=0; ok<od[2]; ++ok)
+    {
+        int64_t k0 = ijk_min[2] + s*ok;
+        int64_t k1 = std::min(k0+s-1, ijk_max[2]);
+        for (size_t oj=0; oj<od[1]; ++oj)
+        {
+            int64_t j0 = ijk_min[1] + s*oj;
+            int64_t j1 = std::min(j0+s-1, ijk_max[1]);
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (int64_t k=k0; k<=k1; ++k)
+                for (int64_t j=j0; j<=j1; ++j)
+                {
+                    const T *row = data + k*strides[0] + j*strides[1];
+                    for (int64_t i=ijk_min[0]; i<=ijk_max[0]; ++i)
+                    {
+                        size_t oi = (size_t)((i-ijk_min[0])/s);
+                        sums[oi] += row[i*strides[2]];
+                        counts[oi] += 1;
+                    }
+                }
+            for (size_t oi=0; oi<od[0]; ++oi)
+                *out++ = (float)(sums[oi]/counts[oi]);
+        }
+    }
+}
+
+template void extract<float>(const float*, const int64_t*, const int64_t*,
+    const int64_t*, size_t, float*);
+template void extract<double>(const double*, const int64_t*, const int64_t*,
+    const int64_t*, size_t, float*);
+
+} // namespace map_prep
+} // namespace isolde
+
+using namespace isolde::map_prep;
+
+extern "C"
+{
+
+EXPORT void
+map_prep_crop_bounds(double *tf, size_t n, double *coords, double padding,
+    size_t *dims, int64_t *ijk_min, int64_t *ijk_max)
+{
+    try {
+        crop_bounds(tf, n, coords, padding, dims, ijk_min, ijk_max);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+EXPORT void
+map_prep_extracted_size(int64_t *ijk_min, int64_t *ijk_max, size_t step,
+    size_t *out_dims)
+{
+    try {
+        extracted_size(ijk_min, ijk_max, step, out_dims);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+EXPORT void
+map_prep_extract_float(float *data, int64_t *strides, int64_t *ijk_min,
+    int64_t *ijk_max, size_t step, float *out)
+{
+    try {
+        extract<float>(data, strides, ijk_min, ijk_max, step, out);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+EXPORT void
+map_prep_extract_double(double *data, int64_t *strides, int64_t *ijk_min,
+    int64_t *ijk_max, size_t step, float *out)
+{
+    try {
+        extract<double>(data, strides, ijk_min, ijk_max, step, out);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+} // extern "C"
@@ -0,0 +1,51 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_MAP_PREP
+#define ISOLDE_MAP_PREP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace isolde
+{
+namespace map_prep
+{
+
+//! Grid box (inclusive, in (i,j,k) order) covering a set of coordinates
+/*! Each point is mapped to grid coordinates with the 3x4 xyz->ijk transform
+ *  tf, and the resulting bounding box is padded by padding (in the length
+ *  units of coords) along each axis and clamped to [0, dims-1]. If n is zero
+ *  the whole grid is returned.
+ */
+void crop_bounds(const double *tf, size_t n, const double *coords,
+    double padding, const size_t *dims, int64_t *ijk_min, int64_t *ijk_max);
+
+//! Size of the (i,j,k) grid extract() will produce for a box and step
+void extracted_size(const int64_t *ijk_min, const int64_t *ijk_max,
+    size_t step, size_t *out_dims);
+
+//! Copy a box out of a (possibly strided) 3D array into a packed float array
+/*! data is indexed as data[k*strides[0] + j*strides[1] + i*strides[2]]
+ *  (i.e. a C-ordered (k,j,i) array with strides in elements). The output is
+ *  C-ordered (k,j,i), sized as given by extracted_size(). With step > 1 each
+ *  output value is the mean over a step x step x step block starting at
+ *  ijk_min + step*(i,j,k), truncated at ijk_max.
+ */
+template <typename T>
+void extract(const T *data, const int64_t *strides, const int64_t *ijk_min,
+    const int64_t *ijk_max, size_t step, float *out);
+
+} // namespace map_prep
+} // namespace isolde
+
+#endif // ISOLDE_MAP_PREP
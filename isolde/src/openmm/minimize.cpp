@@ -12,6 +12,7 @@
 
 #include "minimize.h"
 #include "lbfgs.h"
+#include "lbfgs_float.h"
 #include <cmath>
 #include <sstream>
 #include <string>
@@ -20,56 +21,240 @@
 
 using namespace OpenMM;
 
+/* The double- and single-precision builds of liblbfgs, wrapped up so the rest
+ * of the minimiser can be written once for either.
+ */
+struct Double_LBFGS
+{
+    typedef lbfgsfloatval_t Real;
+    typedef lbfgs_parameter_t Param;
+    typedef lbfgs_evaluate_t Evaluate;
+    typedef lbfgs_progress_t Progress;
+    static Real* alloc(int n) { return lbfgs_malloc(n); }
+    static void free(Real* x) { lbfgs_free(x); }
+    static void parameter_init(Param* param) { lbfgs_parameter_init(param); }
+    static int run(int n, Real* x, Real* fx, Evaluate evaluate, Progress progress,
+            void* instance, Param* param)
+        { return lbfgs(n, x, fx, evaluate, progress, instance, param); }
+};
+
+struct Float_LBFGS
+{
+    typedef isolde::lbfgs_float::lbfgsfloatval_t Real;
+    typedef isolde::lbfgs_float::lbfgs_parameter_t Param;
+    typedef isolde::lbfgs_float::lbfgs_evaluate_t Evaluate;
+    typedef isolde::lbfgs_float::lbfgs_progress_t Progress;
+    static Real* alloc(int n) { return isolde::lbfgs_float::lbfgsf_malloc(n); }
+    static void free(Real* x) { isolde::lbfgs_float::lbfgsf_free(x); }
+    static void parameter_init(Param* param) { isolde::lbfgs_float::lbfgsf_parameter_init(param); }
+    static int run(int n, Real* x, Real* fx, Evaluate evaluate, Progress progress,
+            void* instance, Param* param)
+        { return isolde::lbfgs_float::lbfgsf(n, x, fx, evaluate, progress, instance, param); }
+};
+
+/* Everything evaluate() needs that doesn't change between calls is set up
+ * once here, so that each line search step does no allocation and no
+ * per-particle or per-constraint queries of the System.
+ */
 struct MinimizerData
 {
     Context& context;
     double k;
     bool checkLargeForces;
     bool largeForceEncountered=false;
-    MinimizerData(Context& context, double k) : context(context), k(k) {
+    std::vector<Vec3> positions;
+    std::vector<int> masslessParticles;
+    /* When minimizing only part of the system, the particles whose
+     * coordinates are variables (in order) and the variable index of each
+     * particle (-1 for those held fixed). Empty if everything is free.
+     */
+    std::vector<int> mobileParticles;
+    std::vector<int> variableIndex;
+    // Constraints in structure-of-arrays form
+    std::vector<int> constraintP1;
+    std::vector<int> constraintP2;
+    std::vector<double> constraintDistance;
+    // Variable indices of the constrained particles
+    std::vector<int> constraintV1, constraintV2;
+    // Per-constraint scratch space for the penalty force (times 1/r)
+    std::vector<double> penaltyX, penaltyY, penaltyZ;
+    const isolde::LocalEnergyMinimizer::Progress_Callback& progress;
+    int progressInterval;
+    bool cancelled=false;
+    /* Subtracted from the energy handed to lbfgs(). In single precision the
+     * total energy of a large model is only good to a fraction of a kJ/mol,
+     * which the line search can't work with, so it is instead given the
+     * (much smaller) change from the first evaluation.
+     */
+    double energyOffset=0;
+    bool offsetEnergy=false;
+    bool energyOffsetSet=false;
+    // Double-precision copies of x and g for the progress callback, when needed
+    std::vector<double> progressX, progressG;
+    MinimizerData(Context& context, double k,
+            const isolde::LocalEnergyMinimizer::Progress_Callback& progress, int progressInterval,
+            const std::vector<int>* mobile=nullptr)
+        : context(context), k(k), progress(progress), progressInterval(progressInterval) {
         std::string platformName = context.getPlatform().getName();
         checkLargeForces = (platformName == "CUDA" || platformName == "OpenCL");
+        const System& system = context.getSystem();
+        int numParticles = system.getNumParticles();
+        positions.resize(numParticles);
+        if (mobile != nullptr) {
+            // Massless particles never move, so just leave them out
+            variableIndex.assign(numParticles, -1);
+            for (int i: *mobile) {
+                if (i < 0 || i >= numParticles)
+                    throw OpenMMException("LocalEnergyMinimizer: Mobile particle index out of range");
+                if (variableIndex[i] < 0 && system.getParticleMass(i) != 0) {
+                    variableIndex[i] = mobileParticles.size();
+                    mobileParticles.push_back(i);
+                }
+            }
+        } else {
+            for (int i = 0; i < numParticles; i++)
+                if (system.getParticleMass(i) == 0)
+                    masslessParticles.push_back(i);
+        }
+        int numConstraints = system.getNumConstraints();
+        for (int i = 0; i < numConstraints; i++) {
+            int p1, p2;
+            double distance;
+            system.getConstraintParameters(i, p1, p2, distance);
+            int v1 = p1, v2 = p2;
+            if (mobile != nullptr) {
+                // Constraints between fixed particles stay satisfied
+                v1 = variableIndex[p1];
+                v2 = variableIndex[p2];
+                if (v1 < 0 && v2 < 0)
+                    continue;
+            }
+            constraintP1.push_back(p1);
+            constraintP2.push_back(p2);
+            constraintDistance.push_back(distance);
+            constraintV1.push_back(v1);
+            constraintV2.push_back(v2);
+        }
+        penaltyX.resize(constraintP1.size());
+        penaltyY.resize(constraintP1.size());
+        penaltyZ.resize(constraintP1.size());
     }
     ~MinimizerData() {}
+    size_t numConstraints() const { return constraintP1.size(); }
+    bool partial() const { return !variableIndex.empty(); }
+    //! Number of particles whose coordinates are variables
+    size_t numVariables() const { return partial() ? mobileParticles.size() : positions.size(); }
+
+    template <typename Real>
+    void setPositions(const Real *x) {
+        if (partial()) {
+            for (size_t j = 0; j < mobileParticles.size(); j++)
+                positions[mobileParticles[j]] = Vec3(x[3*j], x[3*j+1], x[3*j+2]);
+        } else {
+            for (size_t i = 0; i < positions.size(); i++)
+                positions[i] = Vec3(x[3*i], x[3*i+1], x[3*i+2]);
+        }
+    }
+
+    template <typename Real>
+    void getVariables(const std::vector<Vec3>& pos, Real *x) const {
+        size_t n = numVariables();
+        for (size_t j = 0; j < n; j++) {
+            const Vec3& p = pos[partial() ? mobileParticles[j] : j];
+            x[3*j] = p[0];
+            x[3*j+1] = p[1];
+            x[3*j+2] = p[2];
+        }
+    }
 };
 
-static double computeForcesAndEnergy(Context& context,
-        const std::vector<Vec3>& positions, lbfgsfloatval_t *g)
+template <typename Real>
+static double computeForcesAndEnergy(MinimizerData* data, Real *g)
 {
-    context.setPositions(positions);
+    Context& context = data->context;
+    context.setPositions(data->positions);
     context.computeVirtualSites();
     State state = context.getState(State::Forces | State::Energy);
     const std::vector<Vec3>& forces = state.getForces();
-    const System& system = context.getSystem();
-    for (int i = 0; i < forces.size(); i++) {
-        if (system.getParticleMass(i) == 0) {
-            g[3*i] = 0.0;
-            g[3*i+1] = 0.0;
-            g[3*i+2] = 0.0;
-        }
-        else {
-            g[3*i] = -forces[i][0];
-            g[3*i+1] = -forces[i][1];
-            g[3*i+2] = -forces[i][2];
+    if (data->partial()) {
+        const std::vector<int>& mobile = data->mobileParticles;
+        for (size_t j = 0; j < mobile.size(); j++) {
+            const Vec3& f = forces[mobile[j]];
+            g[3*j] = -f[0];
+            g[3*j+1] = -f[1];
+            g[3*j+2] = -f[2];
         }
+        return state.getPotentialEnergy();
+    }
+    for (size_t i = 0; i < forces.size(); i++) {
+        g[3*i] = -forces[i][0];
+        g[3*i+1] = -forces[i][1];
+        g[3*i+2] = -forces[i][2];
+    }
+    for (int i: data->masslessParticles) {
+        g[3*i] = 0.0;
+        g[3*i+1] = 0.0;
+        g[3*i+2] = 0.0;
     }
     return state.getPotentialEnergy();
 }
 
-static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x,
-        lbfgsfloatval_t *g, const int n, const lbfgsfloatval_t step)
+/* Adds harmonic penalties for all constraints to the energy and gradient.
+ * The per-constraint terms are computed in one pass over flat arrays (which
+ * the compiler can vectorise) and only then scattered into the gradient,
+ * since two constraints may share a particle. Reads the positions last set
+ * by evaluate(), since one end of a constraint may be a fixed particle.
+ */
+template <typename Real>
+static double addConstraintPenalties(MinimizerData* data, Real *g)
+{
+    size_t numConstraints = data->numConstraints();
+    const Vec3 *pos = data->positions.data();
+    const int *p1 = data->constraintP1.data();
+    const int *p2 = data->constraintP2.data();
+    const double *distance = data->constraintDistance.data();
+    double *px = data->penaltyX.data();
+    double *py = data->penaltyY.data();
+    double *pz = data->penaltyZ.data();
+    const double k = data->k;
+    double energy = 0;
+    for (size_t i = 0; i < numConstraints; i++) {
+        const Vec3& x1 = pos[p1[i]];
+        const Vec3& x2 = pos[p2[i]];
+        double dx = x2[0]-x1[0], dy = x2[1]-x1[1], dz = x2[2]-x1[2];
+        double r = sqrt(dx*dx + dy*dy + dz*dz);
+        double dr = r-distance[i];
+        double kdr = k*dr;
+        energy += 0.5*kdr*dr;
+        double scale = kdr/r;
+        px[i] = scale*dx;
+        py[i] = scale*dy;
+        pz[i] = scale*dz;
+    }
+    const int *v1 = data->constraintV1.data();
+    const int *v2 = data->constraintV2.data();
+    for (size_t i = 0; i < numConstraints; i++) {
+        if (v1[i] >= 0) {
+            Real *g1 = g + 3*v1[i];
+            g1[0] -= px[i]; g1[1] -= py[i]; g1[2] -= pz[i];
+        }
+        if (v2[i] >= 0) {
+            Real *g2 = g + 3*v2[i];
+            g2[0] += px[i]; g2[1] += py[i]; g2[2] += pz[i];
+        }
+    }
+    return energy;
+}
+
+template <typename Real>
+static Real evaluate(void *instance, const Real *x, Real *g, const int n, const Real step)
 {
     MinimizerData* data = reinterpret_cast<MinimizerData*>(instance);
-    Context& context = data->context;
-    const System& system = context.getSystem();
-    int numParticles = system.getNumParticles();
 
     // Compute the force and energy for this configuration.
 
-    std::vector<Vec3> positions(numParticles);
-    for (int i = 0; i < numParticles; i++)
-        positions[i] = Vec3(x[3*i], x[3*i+1], x[3*i+2]);
-    double energy = computeForcesAndEnergy(context, positions, g);
+    data->setPositions(x);
+    double energy = computeForcesAndEnergy(data, g);
     if (data->checkLargeForces) {
         // The CUDA and OpenCL platforms accumulate forces in fixed point, so they
         // can't handle very large forces.  If we encounter an infinite or NaN
@@ -87,8 +272,8 @@ static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x,
         // occurred, and then let the user know only if the minimiser fails to
         // converge.
 
-        for (int i = 0; i < 3*numParticles; i++) {
-            lbfgsfloatval_t grad = g[i];
+        for (int i = 0; i < n; i++) {
+            Real grad = g[i];
             // If infinite or NaN, throw our hands up immediately. Something's
             // badly wrong.
             if (grad - grad != 0) {
@@ -106,47 +291,89 @@ static lbfgsfloatval_t evaluate(void *instance, const lbfgsfloatval_t *x,
 
     // Add harmonic forces for any constraints.
 
-    int numConstraints = system.getNumConstraints();
-    const double& k = data->k;
-    for (int i = 0; i < numConstraints; i++) {
-        int particle1, particle2;
-        double distance;
-        system.getConstraintParameters(i, particle1, particle2, distance);
-        Vec3 delta = positions[particle2]-positions[particle1];
-        double r2 = delta.dot(delta);
-        double r = sqrt(r2);
-        delta *= 1/r;
-        double dr = r-distance;
-        double kdr = k*dr;
-        energy += 0.5*kdr*dr;
-        g[3*particle1] -= kdr*delta[0];
-        g[3*particle1+1] -= kdr*delta[1];
-        g[3*particle1+2] -= kdr*delta[2];
-        g[3*particle2] += kdr*delta[0];
-        g[3*particle2+1] += kdr*delta[1];
-        g[3*particle2+2] += kdr*delta[2];
+    energy += addConstraintPenalties(data, g);
+    if (data->offsetEnergy) {
+        if (!data->energyOffsetSet) {
+            data->energyOffset = energy;
+            data->energyOffsetSet = true;
+        }
+        energy -= data->energyOffset;
     }
     return energy;
 }
 
-int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
-        int maxIterations) {
+static const double* asDouble(const double *v, std::vector<double>&, size_t)
+{
+    return v;
+}
+
+static const double* asDouble(const float *v, std::vector<double>& buf, size_t n)
+{
+    buf.assign(v, v+n);
+    return buf.data();
+}
+
+template <typename Real>
+static int reportProgress(void *instance, const Real *x, const Real *g, const Real fx,
+        const Real xnorm, const Real gnorm, const Real step, int n, int k, int ls)
+{
+    MinimizerData* data = reinterpret_cast<MinimizerData*>(instance);
+    if (k % data->progressInterval != 0)
+        return 0;
+    const double *xo, *go;
+    if (data->partial()) {
+        // The callback always sees the whole system, with zero gradient on
+        // the fixed particles
+        data->setPositions(x);
+        const std::vector<Vec3>& positions = data->positions;
+        const std::vector<int>& mobile = data->mobileParticles;
+        data->progressX.resize(3*positions.size());
+        data->progressG.assign(3*positions.size(), 0.0);
+        for (size_t i = 0; i < positions.size(); i++)
+            for (int j = 0; j < 3; j++)
+                data->progressX[3*i+j] = positions[i][j];
+        for (size_t i = 0; i < mobile.size(); i++)
+            for (int j = 0; j < 3; j++)
+                data->progressG[3*mobile[i]+j] = g[3*i+j];
+        xo = data->progressX.data();
+        go = data->progressG.data();
+    } else {
+        xo = asDouble(x, data->progressX, n);
+        go = asDouble(g, data->progressG, n);
+    }
+    if (!data->progress(xo, go, fx + data->energyOffset, k)) {
+        data->cancelled = true;
+        // Any non-zero return value stops lbfgs()
+        return 1;
+    }
+    return 0;
+}
+
+template <typename LBFGS>
+int isolde::LocalEnergyMinimizer::_minimize(Context& context, double tolerance,
+        int maxIterations, const Progress_Callback& progress, int progressInterval,
+        const std::vector<int>* mobile) {
+    typedef typename LBFGS::Real Real;
+    const bool singlePrecision = sizeof(Real) < sizeof(double);
     int ret = 0;
-    const System& system = context.getSystem();
-    int numParticles = system.getNumParticles();
     double constraintTol = context.getIntegrator().getConstraintTolerance();
     double workingConstraintTol = std::max(1e-4, constraintTol);
     double k = 1000/workingConstraintTol;
-    lbfgsfloatval_t *x = lbfgs_malloc(numParticles*3);
+    MinimizerData data(context, k, progress, progressInterval, mobile);
+    data.offsetEnergy = singlePrecision;
+    int numVariables = data.numVariables();
+    if (numVariables == 0)
+        return SUCCESS;
+    Real *x = LBFGS::alloc(numVariables*3);
     if (x == NULL)
         throw OpenMMException("LocalEnergyMinimizer: Failed to allocate memory");
     try {
 
         // Initialize the minimizer.
 
-        lbfgs_parameter_t param;
-        lbfgs_parameter_init(&param);
-        if (!context.getPlatform().supportsDoublePrecision())
+        typename LBFGS::Param param;
+        LBFGS::parameter_init(&param);
+        if (singlePrecision || !context.getPlatform().supportsDoublePrecision())
             param.xtol = 1e-7;
         param.max_iterations = maxIterations;
         param.linesearch = LBFGS_LINESEARCH_BACKTRACKING_STRONG_WOLFE;
@@ -158,15 +385,12 @@ int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
         // Record the initial positions and determine a normalization constant for scaling the tolerance.
 
         std::vector<Vec3> initialPos = context.getState(State::Positions).getPositions();
+        data.positions = initialPos;
+        data.getVariables(initialPos, x);
         double norm = 0.0;
-        for (int i = 0; i < numParticles; i++) {
-            const Vec3& p = initialPos[i];
-            x[3*i] = p[0];
-            x[3*i+1] = p[1];
-            x[3*i+2] = p[2];
-            norm += p.dot(p);
-        }
-        norm /= numParticles;
+        for (int i = 0; i < 3*numVariables; i++)
+            norm += x[i]*x[i];
+        norm /= numVariables;
         norm = (norm < 1 ? 1 : sqrt(norm));
         param.epsilon = tolerance/norm;
 
@@ -188,20 +412,31 @@ int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
         // Repeatedly minimize, steadily increasing the strength of the springs until all constraints are satisfied.
 
         double prevMaxError = 1e10;
-        MinimizerData data(context, k);
+        typename LBFGS::Progress progressFunc =
+            (progress && progressInterval > 0) ? reportProgress<Real> : NULL;
         int tries=0, maxTries=3;
         while (true) {
             // Perform the minimization.
 
-            lbfgsfloatval_t fx;
+            Real fx;
             int result = -1024;
             try {
                 data.largeForceEncountered = false;
-                result = lbfgs(numParticles*3, x, &fx, evaluate, NULL, &data, &param);
+                result = LBFGS::run(numVariables*3, x, &fx, evaluate<Real>, progressFunc, &data, &param);
             } catch (std::out_of_range) {
                 ret = INFINITE_OR_NAN_FORCE;
                 break;
             }
+            if (data.cancelled)
+            {
+                // The last evaluation may have been a trial step, so make
+                // sure the context holds the accepted positions.
+                data.setPositions(x);
+                context.setPositions(data.positions);
+                context.applyConstraints(workingConstraintTol);
+                ret = CANCELLED;
+                break;
+            }
             if (LBFGSERR_MAXIMUMSTEP == result)
             {
                 tries++;
@@ -219,15 +454,12 @@ int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
             // Check whether all constraints are satisfied.
 
             std::vector<Vec3> positions = context.getState(State::Positions).getPositions();
-            int numConstraints = system.getNumConstraints();
+            size_t numConstraints = data.numConstraints();
             double maxError = 0.0;
-            for (int i = 0; i < numConstraints; i++) {
-                int particle1, particle2;
-                double distance;
-                system.getConstraintParameters(i, particle1, particle2, distance);
-                Vec3 delta = positions[particle2]-positions[particle1];
+            for (size_t i = 0; i < numConstraints; i++) {
+                Vec3 delta = positions[data.constraintP2[i]]-positions[data.constraintP1[i]];
                 double r = sqrt(delta.dot(delta));
-                double error = fabs(r-distance);
+                double error = fabs(r-data.constraintDistance[i]);
                 if (error > maxError)
                     maxError = error;
             }
@@ -254,20 +486,16 @@ int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
                 // We've gotten far enough from a valid state that we might have trouble getting
                 // back, so reset to the original positions.
 
-                for (int i = 0; i < numParticles; i++) {
-                    x[3*i] = initialPos[i][0];
-                    x[3*i+1] = initialPos[i][1];
-                    x[3*i+2] = initialPos[i][2];
-                }
+                data.getVariables(initialPos, x);
             }
         }
     }
     catch (...) {
-        lbfgs_free(x);
+        LBFGS::free(x);
         throw;
         return UNSPECIFIED_ERROR;
     }
-    lbfgs_free(x);
+    LBFGS::free(x);
 
     // If necessary, do a final constraint projection to make sure they are satisfied
     // to the full precision requested by the user.
@@ -276,3 +504,40 @@ int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
         context.applyConstraints(workingConstraintTol);
     return ret;
 }
+
+bool isolde::LocalEnergyMinimizer::use_single_precision(const Context& context, Precision precision)
+{
+    switch (precision)
+    {
+        case PRECISION_SINGLE:
+            return true;
+        case PRECISION_AUTO:
+        {
+            const Platform& platform = context.getPlatform();
+            const std::string& name = platform.getName();
+            if (name != "CUDA" && name != "OpenCL")
+                return false;
+            return platform.getPropertyValue(context, "Precision") != "double";
+        }
+        default:
+            return false;
+    }
+}
+
+int isolde::LocalEnergyMinimizer::minimize(Context& context, double tolerance,
+        int maxIterations, const Progress_Callback& progress, int progressInterval,
+        Precision precision) {
+    if (use_single_precision(context, precision))
+        return _minimize<Float_LBFGS>(context, tolerance, maxIterations, progress, progressInterval, nullptr);
+    return _minimize<Double_LBFGS>(context, tolerance, maxIterations, progress, progressInterval, nullptr);
+}
+
+int isolde::LocalEnergyMinimizer::minimize_region(Context& context,
+        const std::vector<int>& mobileParticles, double tolerance, int maxIterations,
+        const Progress_Callback& progress, int progressInterval, Precision precision) {
+    if (use_single_precision(context, precision))
+        return _minimize<Float_LBFGS>(context, tolerance, maxIterations, progress, progressInterval,
+            &mobileParticles);
+    return _minimize<Double_LBFGS>(context, tolerance, maxIterations, progress, progressInterval,
+        &mobileParticles);
+}
@@ -21,6 +21,8 @@
  *  and highlight them for the user.
  */
 
+#include <functional>
+#include <vector>
 #include <OpenMM.h>
 
 namespace isolde
@@ -30,6 +32,28 @@ class LocalEnergyMinimizer
 {
 
 public:
+    /**
+     * Optional hook called every progressInterval iterations with the current
+     * particle positions (packed xyz, nm), energy gradient and energy. Return
+     * false to stop minimizing at this point.
+     */
+    typedef std::function<bool(const double *x, const double *g, double energy, int iteration)> Progress_Callback;
+
+    /**
+     * Precision of the L-BFGS search itself. Forces and energies always come
+     * from the Context in whatever precision its Platform uses. PRECISION_SINGLE
+     * halves the memory traffic of the L-BFGS updates and uses four-wide SSE
+     * arithmetic; when the forces are themselves only single precision (the
+     * "single" and "mixed" modes of the CUDA and OpenCL platforms) very little
+     * is lost by doing so. PRECISION_AUTO chooses single precision in exactly
+     * those cases.
+     */
+    enum Precision {
+        PRECISION_DOUBLE = 0,
+        PRECISION_SINGLE = 1,
+        PRECISION_AUTO = 2
+    };
+
     /**
      * Search for a new set of particle positions that represent a local potential energy minimum.
      * On exit, the Context will have been updated with the new positions.
@@ -41,17 +65,52 @@ public:
      * @param maxIterations  the maximum number of iterations to perform.  If this is 0, minimation is continued
      *                       until the results converge without regard to how many iterations it takes.  The
      *                       default value is 0.
+     * @param progress       an optional Progress_Callback. If it returns false, the Context is left at
+     *                       the positions it was given (with constraints applied) and CANCELLED is
+     *                       returned.
+     * @param progressInterval  the number of iterations between calls to progress.
+     * @param precision      the precision of the L-BFGS arithmetic. See Precision.
      */
-    static int minimize(OpenMM::Context& context, double tolerance = 10, int maxIterations = 0);
+    static int minimize(OpenMM::Context& context, double tolerance = 10, int maxIterations = 0,
+        const Progress_Callback& progress = Progress_Callback(), int progressInterval = 10,
+        Precision precision = PRECISION_DOUBLE);
+
+    /**
+     * As minimize(), but only the given particles move: all others are held
+     * exactly where they are, and only constraints involving at least one
+     * mobile particle are enforced. Since the search space (and the set of
+     * forces that must drop below tolerance) is limited to the mobile
+     * particles, settling a small strained region in a large system takes
+     * far fewer iterations. Massless particles are never mobile. The
+     * progress callback still sees the coordinates of every particle, with
+     * the gradient zeroed on those held fixed.
+     */
+    static int minimize_region(OpenMM::Context& context, const std::vector<int>& mobileParticles,
+        double tolerance = 10, int maxIterations = 0,
+        const Progress_Callback& progress = Progress_Callback(), int progressInterval = 10,
+        Precision precision = PRECISION_DOUBLE);
+
+    /**
+     * True if minimize() would work in single precision for this Context with
+     * the given Precision setting.
+     */
+    static bool use_single_precision(const OpenMM::Context& context, Precision precision);
     enum {
         UNSPECIFIED_ERROR = -1024,
         INFINITE_OR_NAN_FORCE = -3,
         CONSTRAINT_VIOLATION_NO_LARGE_FORCE = -2,
         CONSTRAINT_VIOLATION_LARGE_FORCE = -1,
         SUCCESS = 0,
-        DID_NOT_CONVERGE=1
+        DID_NOT_CONVERGE=1,
+        CANCELLED=2
     };
 
+private:
+    template <typename LBFGS>
+    static int _minimize(OpenMM::Context& context, double tolerance, int maxIterations,
+        const Progress_Callback& progress, int progressInterval,
+        const std::vector<int>* mobile);
+
 };
 
 } // namespace isolde
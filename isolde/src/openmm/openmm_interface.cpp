@@ -12,9 +12,19 @@
 
 #define PYINSTANCE_EXPORT
 #include <iostream>
+#include <algorithm>
+#include <array>
+#include <map>
+#include <cmath>
+#include <cstddef>
+#include <atomstruct/Structure.h>
+#include <atomstruct/CoordSet.h>
+#include <atomstruct/ChangeTracker.h>
 #include "../molc.h"
 #include "openmm_interface.h"
 #include "minimize.h"
+#include "sim_scheduler.h"
+#include "vec_kernels.h"
 #include <pyinstance/PythonInstance.instantiate.h>
 
 template class pyinstance::PythonInstance<isolde::OpenMM_Thread_Handler>;
@@ -25,529 +35,2588 @@ OpenMM_Thread_Handler::OpenMM_Thread_Handler(OpenMM::Context* context)
     : _context(context)
 {
     _starting_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
+    _final_state = _starting_state;
     _natoms = _starting_state.getPositions().size();
+    _published_coords.resize(_natoms*3);
+    _update_mobile_mask();
+    _worker = std::thread(&OpenMM_Thread_Handler::_worker_loop, this);
 }
 
-void OpenMM_Thread_Handler::_step_threaded(size_t steps, bool smooth)
+OpenMM_Thread_Handler::~OpenMM_Thread_Handler()
 {
-    try
+    if (!_worker.joinable())
+        return;
     {
-        // _thread_except = nullptr;
-        auto start = std::chrono::steady_clock::now();
-        // _thread_running = true;
-        // _thread_finished = false;
-        size_t steps_done = 0;
-        _starting_state = _final_state;
-        _smoothing = smooth;
-        if (!smooth)
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _shutdown = true;
+        _stop_requested = true;
+    }
+    _queue_cv.notify_all();
+    _worker.join();
+}
+
+void OpenMM_Thread_Handler::_enqueue(Thread_Command&& cmd)
+{
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _queue.push_back(std::move(cmd));
+        _pending++;
+        _busy = true;
+    }
+    _queue_cv.notify_one();
+}
+
+void OpenMM_Thread_Handler::finalize_thread()
+{
+    {
+        std::unique_lock<std::mutex> lock(_queue_mutex);
+        _stop_requested = true;
+        _idle_cv.wait(lock, [this]{ return !_busy; });
+        _stop_requested = false;
+    }
+    _thread_error_check();
+}
+
+void OpenMM_Thread_Handler::_worker_loop()
+{
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    while (true)
+    {
+        _queue_cv.wait(lock, [this]{ return _shutdown || !_queue.empty(); });
+        if (_shutdown)
+            break;
+        Thread_Command cmd = std::move(_queue.front());
+        _queue.pop_front();
+        _pending--;
+        lock.unlock();
+        bool failed = false;
+        try {
+            _run_command(cmd);
+        } catch (...) {
+            lock.lock();
+            // Anything queued after a failed command is no longer meaningful
+            _thread_except = std::current_exception();
+            _pending -= _queue.size();
+            _queue.clear();
+            lock.unlock();
+            failed = true;
+        }
+        lock.lock();
+        // Updates flushed after the command last picked them up would
+        // otherwise wait for the next command, since the GUI thread only
+        // applies them itself once the worker is idle
+        if (_queue.empty() && !failed && _updates_waiting())
+        {
+            _queue.emplace_back(Thread_Command::APPLY_UPDATES);
+            _pending++;
+        }
+        if (_queue.empty())
+        {
+            _busy = false;
+            _idle_cv.notify_all();
+        }
+    }
+    _busy = false;
+    _idle_cv.notify_all();
+}
+
+void OpenMM_Thread_Handler::stage_force_parameters(OpenMM::Force *force,
+    custom_forces::Force_Type type, size_t n, const int *indices, const double *params)
+{
+    auto it = _staged_force_updates.find(force);
+    if (it == _staged_force_updates.end())
+        it = _staged_force_updates.emplace(force,
+            custom_forces::Parameter_Batch(type, custom_forces::num_parameters(force, type))).first;
+    else if (it->second.type() != type)
+        throw std::invalid_argument("Force type does not match previously staged updates!");
+    it->second.add(n, indices, params);
+}
+
+void OpenMM_Thread_Handler::flush_force_updates()
+{
+    if (!_unsent_tug_updates.empty())
+        _send_tug_updates();
+    if (_staged_force_updates.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(_force_update_mutex);
+        for (auto& it: _staged_force_updates)
+        {
+            auto fit = _flushed_force_updates.find(it.first);
+            if (fit == _flushed_force_updates.end())
+                _flushed_force_updates.emplace(it.first, std::move(it.second));
+            else
+                fit->second.add(it.second);
+        }
+        _force_updates_flushed = true;
+    }
+    _staged_force_updates.clear();
+    // If the worker is busy it picks these up before its next block of
+    // steps (or before going idle)
+    _run_if_idle([this]{ _apply_force_updates(); });
+}
+
+void OpenMM_Thread_Handler::discard_force_updates(OpenMM::Force *force)
+{
+    _staged_force_updates.erase(force);
+    std::lock_guard<std::mutex> lock(_force_update_mutex);
+    _flushed_force_updates.erase(force);
+}
+
+// Called by whichever thread currently owns the context: the worker while
+// busy, otherwise the GUI thread via _run_if_idle().
+void OpenMM_Thread_Handler::_apply_force_updates()
+{
+    if (!_force_updates_flushed.exchange(false))
+        return;
+    Force_Batches batches;
+    {
+        std::lock_guard<std::mutex> lock(_force_update_mutex);
+        std::swap(batches, _flushed_force_updates);
+    }
+    for (const auto& it: batches)
+    {
+        it.second.apply(it.first);
+        custom_forces::update_parameters_in_context(it.first, it.second.type(), *_context);
+        if (it.first == _monitored_force)
+            _update_monitored_params(it.second);
+    }
+    _tighten_checks = true;
+}
+
+void OpenMM_Thread_Handler::monitor_adaptive_distance_force(OpenMM::CustomBondForce *force)
+{
+    _thread_finished_check();
+    const size_t np = custom_forces::ADAPTIVE_DISTANCE_PARAMS;
+    _monitored_force = force;
+    _monitored_pairs.clear();
+    _monitored_params.clear();
+    if (force != nullptr)
+    {
+        if ((size_t)force->getNumPerBondParameters() != np)
+            throw std::invalid_argument("Not an AdaptiveDistanceRestraintForce!");
+        size_t n = force->getNumBonds();
+        _monitored_pairs.resize(2*n);
+        _monitored_params.resize(np*n);
+        std::vector<double> params;
+        for (size_t i=0; i<n; ++i)
+        {
+            force->getBondParameters(i, _monitored_pairs[2*i], _monitored_pairs[2*i+1], params);
+            std::copy(params.begin(), params.end(), _monitored_params.begin()+np*i);
+        }
+    }
+    _published_bond_forces.resize(num_monitored_bonds());
+}
+
+void OpenMM_Thread_Handler::_update_monitored_params(const custom_forces::Parameter_Batch& batch)
+{
+    const size_t np = custom_forces::ADAPTIVE_DISTANCE_PARAMS;
+    size_t n = num_monitored_bonds();
+    const int *indices = batch.indices();
+    const double *params = batch.parameters();
+    for (size_t i=0; i<batch.size(); ++i)
+    {
+        size_t idx = indices[i];
+        if (idx < n)
+            std::copy(params+np*i, params+np*(i+1), _monitored_params.begin()+np*idx);
+    }
+}
+
+void OpenMM_Thread_Handler::attach_haptic_link(Haptic_Link *link,
+    OpenMM::CustomExternalForce *force, int entry)
+{
+    _thread_finished_check();
+    if (force->getNumPerParticleParameters() != 5)
+        throw std::invalid_argument("Haptic tugging needs a TopOutRestraintForce!");
+    if (entry < 0 || entry >= force->getNumParticles())
+        throw std::out_of_range("Tugging force entry out of range!");
+    detach_haptic_link(link);
+    Haptic_Tug tug{link, force, entry, 0, false};
+    std::vector<double> params;
+    force->getParticleParameters(entry, tug.particle, params);
+    // Anything queued before now is for a previous attachment
+    Haptic_Target stale;
+    link->targets.pop_latest(stale);
+    _haptic_tugs.push_back(tug);
+}
+
+void OpenMM_Thread_Handler::detach_haptic_link(Haptic_Link *link)
+{
+    _thread_finished_check();
+    for (auto it=_haptic_tugs.begin(); it!=_haptic_tugs.end(); ++it)
+    {
+        if (it->link != link)
+            continue;
+        if (it->tugging)
+        {
+            const double zero[3] = {0,0,0};
+            _set_haptic_tug(*it, false, zero, 0);
+            it->force->updateParametersInContext(*_context);
+        }
+        _haptic_tugs.erase(it);
+        return;
+    }
+}
+
+void OpenMM_Thread_Handler::_set_haptic_tug(Haptic_Tug& tug, bool tugging, const double *xyz, double k)
+{
+    // Targets arrive in Angstroms and kJ mol-1 A-2
+    std::vector<double> params = {tugging ? 1.0 : 0.0, k*100.0, xyz[0]/10.0, xyz[1]/10.0, xyz[2]/10.0};
+    tug.force->setParticleParameters(tug.entry, tug.particle, params);
+    if (tugging && !tug.tugging)
+        _tighten_checks = true;
+    tug.tugging = tugging;
+}
+
+// Worker thread (or GUI thread while the worker is idle)
+void OpenMM_Thread_Handler::_apply_haptic_targets()
+{
+    OpenMM::CustomExternalForce *changed = nullptr;
+    for (auto& tug: _haptic_tugs)
+    {
+        Haptic_Target t;
+        if (!tug.link->targets.pop_latest(t))
+            continue;
+        if (!t.tugging && !tug.tugging)
+            continue;
+        _set_haptic_tug(tug, t.tugging, t.xyz, t.spring_constant);
+        if (changed != nullptr && changed != tug.force)
+            changed->updateParametersInContext(*_context);
+        changed = tug.force;
+    }
+    if (changed != nullptr)
+        changed->updateParametersInContext(*_context);
+}
+
+void OpenMM_Thread_Handler::_publish_haptic_feedback(const std::vector<OpenMM::Vec3>& positions)
+{
+    for (auto& tug: _haptic_tugs)
+    {
+        const auto& p = positions[tug.particle];
+        Haptic_Feedback fb{{p[0]*10.0, p[1]*10.0, p[2]*10.0}};
+        // If the device thread has fallen behind it will catch up from the
+        // next one
+        tug.link->feedback.push(fb);
+    }
+}
+
+void OpenMM_Thread_Handler::set_grid_bias_force(OpenMM::CustomExternalForce *force)
+{
+    _thread_finished_check();
+    if (force != nullptr)
+    {
+        if (force->getNumPerParticleParameters() != 7)
+            throw std::invalid_argument("Conformational bias needs a GridBiasForce!");
+        if ((size_t)force->getNumParticles() != _natoms)
+            throw std::logic_error("The bias force needs one entry per particle!");
+    }
+    _release_grid_bias();
+    _grid_bias_force = force;
+}
+
+void OpenMM_Thread_Handler::set_region_hold_force(OpenMM::CustomExternalForce *force)
+{
+    _thread_finished_check();
+    if (force != nullptr)
+    {
+        if (force->getNumPerParticleParameters() != 4)
+            throw std::invalid_argument("Batch refinement needs a RegionHoldForce!");
+        if ((size_t)force->getNumParticles() != _natoms)
+            throw std::logic_error("The region hold force needs one entry per particle!");
+    }
+    _region_hold_force = force;
+}
+
+void OpenMM_Thread_Handler::add_grid_bias_terms(size_t grid, size_t n,
+    const int *particles, const double *k)
+{
+    _thread_finished_check();
+    size_t n_particles = 4*n*_grid_bias.dim(grid);
+    for (size_t i=0; i<n_particles; ++i)
+        if (particles[i] < 0 || (size_t)particles[i] >= _natoms)
+            throw std::out_of_range("Particle index out of range!");
+    _grid_bias.add_terms(grid, n, particles, k);
+}
+
+void OpenMM_Thread_Handler::clear_grid_bias()
+{
+    _thread_finished_check();
+    _release_grid_bias();
+    _grid_bias.clear();
+}
+
+// Worker thread (or GUI thread while the worker is idle)
+void OpenMM_Thread_Handler::_apply_grid_bias(const std::vector<OpenMM::Vec3>& positions)
+{
+    _grid_bias_energy = _grid_bias.compute(positions, _grid_bias_scale,
+        _grid_bias_forces, _grid_bias_energies);
+    const auto& particles = _grid_bias.particles();
+    std::vector<double> params(7);
+    for (size_t i=0; i<particles.size(); ++i)
+    {
+        int p = particles[i];
+        const auto& f = _grid_bias_forces[i];
+        const auto& r = positions[p];
+        params = {_grid_bias_energies[i], f[0], f[1], f[2], r[0], r[1], r[2]};
+        _grid_bias_force->setParticleParameters(p, p, params);
+    }
+    _grid_bias_force->updateParametersInContext(*_context);
+    _grid_bias_applied = true;
+}
+
+// Worker thread (or GUI thread while the worker is idle)
+void OpenMM_Thread_Handler::_release_grid_bias()
+{
+    if (!_grid_bias_applied)
+        return;
+    const std::vector<double> zero(7, 0.0);
+    for (auto p: _grid_bias.particles())
+        _grid_bias_force->setParticleParameters(p, p, zero);
+    _grid_bias_force->updateParametersInContext(*_context);
+    _grid_bias_applied = false;
+    _grid_bias_energy = 0;
+}
+
+size_t OpenMM_Thread_Handler::add_restraint_animation(OpenMM::Force *force,
+    custom_forces::Force_Type type, size_t n_terms, const int *indices,
+    size_t n_keyframes, const double *keyframes, const uint8_t *stepped,
+    size_t steps_per_keyframe)
+{
+    _thread_finished_check();
+    std::unique_ptr<Restraint_Animation> a(new Restraint_Animation(force, type, n_terms,
+        indices, n_keyframes, keyframes, stepped, steps_per_keyframe));
+    size_t id = _next_animation_id++;
+    _animations[id] = std::move(a);
+    return id;
+}
+
+void OpenMM_Thread_Handler::remove_restraint_animation(size_t id)
+{
+    _thread_finished_check();
+    _animations.erase(id);
+}
+
+double OpenMM_Thread_Handler::restraint_animation_progress(size_t id) const
+{
+    auto it = _animations.find(id);
+    if (it == _animations.end())
+        throw std::out_of_range("No restraint animation with this ID!");
+    return it->second->progress();
+}
+
+// Worker thread (or GUI thread while the worker is idle)
+void OpenMM_Thread_Handler::_apply_restraint_animations()
+{
+    std::vector<std::pair<OpenMM::Force*, custom_forces::Force_Type>> changed;
+    for (auto& it: _animations)
+    {
+        auto& a = *it.second;
+        if (!a.apply())
+            continue;
+        auto key = std::make_pair(a.force(), a.type());
+        if (std::find(changed.begin(), changed.end(), key) == changed.end())
+            changed.push_back(key);
+    }
+    for (const auto& f: changed)
+        custom_forces::update_parameters_in_context(f.first, f.second, *_context);
+}
+
+void OpenMM_Thread_Handler::_advance_restraint_animations(size_t steps)
+{
+    for (auto& it: _animations)
+        it.second->advance(steps);
+}
+
+void OpenMM_Thread_Handler::push_tug_targets(OpenMM::CustomExternalForce *force,
+    size_t n, const int *entries, const double *params)
+{
+    if (force->getNumPerParticleParameters() != 5)
+        throw std::invalid_argument("Tugging needs a TopOutRestraintForce!");
+    int num_entries = force->getNumParticles();
+    for (size_t i=0; i<n; ++i)
+    {
+        if (entries[i] < 0 || entries[i] >= num_entries)
+            throw std::out_of_range("Tugging force entry out of range!");
+        Tug_Update u;
+        u.force = force;
+        u.entry = entries[i];
+        std::copy(params+5*i, params+5*(i+1), u.params);
+        _unsent_tug_updates.push_back(u);
+    }
+    _send_tug_updates();
+}
+
+void OpenMM_Thread_Handler::_send_tug_updates()
+{
+    for (;;)
+    {
+        size_t sent = 0;
+        while (sent < _unsent_tug_updates.size() && _tug_updates.push(_unsent_tug_updates[sent]))
+            ++sent;
+        _unsent_tug_updates.erase(_unsent_tug_updates.begin(), _unsent_tug_updates.begin()+sent);
+        // A busy worker drains the ring itself, before its next block of
+        // steps or before going idle
+        if (!_run_if_idle([this]{ _apply_tug_updates(); }))
+            return;
+        if (_unsent_tug_updates.empty())
+            return;
+    }
+}
+
+// Worker thread, or GUI thread via _run_if_idle()
+void OpenMM_Thread_Handler::_apply_tug_updates()
+{
+    OpenMM::CustomExternalForce *changed = nullptr;
+    std::vector<double> params;
+    int particle;
+    Tug_Update u;
+    while (_tug_updates.pop(u))
+    {
+        if (changed != nullptr && changed != u.force)
+            changed->updateParametersInContext(*_context);
+        u.force->getParticleParameters(u.entry, particle, params);
+        if (u.params[0] > 0.5 && params[0] < 0.5)
+            _tighten_checks = true;
+        params.assign(u.params, u.params+5);
+        u.force->setParticleParameters(u.entry, particle, params);
+        changed = u.force;
+    }
+    if (changed != nullptr)
+        changed->updateParametersInContext(*_context);
+}
+
+bool OpenMM_Thread_Handler::latest_bond_forces(double *out)
+{
+    if (!_published_bond_forces.update())
+        return false;
+    const double *from = _published_bond_forces.front();
+    std::copy(from, from+_published_bond_forces.size(), out);
+    return true;
+}
+
+void OpenMM_Thread_Handler::_run_command(Thread_Command& cmd)
+{
+    _apply_force_updates();
+    _apply_tug_updates();
+    switch (cmd.type)
+    {
+        case Thread_Command::STEP:
+            _step_threaded(cmd.steps, cmd.smooth);
+            break;
+        case Thread_Command::STEP_CONTINUOUS:
+            _step_continuous_threaded(cmd.steps, cmd.smooth);
+            break;
+        case Thread_Command::MINIMIZE:
+            _minimize_threaded(cmd.tolerance, cmd.max_iterations, cmd.region, cmd.radius);
+            break;
+        case Thread_Command::REINITIALIZE:
+            _reinitialize_context_threaded();
+            _update_mobile_mask();
+            _tighten_checks = true;
+            break;
+        case Thread_Command::SET_COORDS:
+            _context->setPositions(cmd.coords);
             _smoothed_coords.clear();
+            _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
+            _reference_positions.clear();
+            _tighten_checks = true;
+            break;
+        case Thread_Command::REFINE_REGION:
+            _refine_region_threaded(cmd.refinement);
+            break;
+        case Thread_Command::APPLY_UPDATES:
+            break;
+    }
+}
 
-        for (; steps_done < steps; )
+// Runs the desired number of steps in chunks defined by the adaptive
+// instability check schedule, leaving the last retrieved state in
+// _final_state. Returns false if instability was detected.
+bool OpenMM_Thread_Handler::_integrate(size_t steps, bool smooth)
+{
+    if (_check_by_displacement && _reference_positions.size() != _natoms)
+        _reset_displacement_reference(_final_state);
+    size_t steps_done = 0;
+    for (; steps_done < steps; )
+    {
+        bool bias = _grid_bias_active();
         {
-            size_t these_steps, remaining_steps = steps-steps_done;
-            if (remaining_steps > STEPS_PER_VELOCITY_CHECK) {
-                these_steps = STEPS_PER_VELOCITY_CHECK;
-            } else {
-                these_steps = remaining_steps;
-            }
-            integrator().step(these_steps);
-            steps_done += these_steps;
-            auto state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
-            auto fast = overly_fast_atoms(state.getVelocities());
-            if (fast.size() >0)
+            Stage_Timings::Scope t(_timings, Stage_Timings::PARAM_UPLOAD);
+            _apply_force_updates();
+            _apply_tug_updates();
+            _apply_haptic_targets();
+            _apply_restraint_animations();
+            if (bias)
             {
-                std::cerr << fast.size() << " atoms are moving too fast!" << std::endl;
-                _unstable = true;
-                break;
-            }
-            if (smooth)
-                _apply_smoothing(state);
+                if (steps_done == 0)
+                    _apply_grid_bias(_context->getState(OpenMM::State::Positions).getPositions());
+                else
+                    _apply_grid_bias(_final_state.getPositions());
+            } else
+                _release_grid_bias();
+        }
+        if (_tighten_checks.exchange(false))
+        {
+            _check_interval = _min_check_interval;
+            _stable_checks = 0;
+        }
+        size_t these_steps = std::min(_check_interval, steps-steps_done);
+        // The bias is linearised between updates, so mustn't go stale
+        if (bias)
+            these_steps = std::min<size_t>(these_steps, _grid_bias_interval);
+        {
+            Stage_Timings::Scope t(_timings, Stage_Timings::INTEGRATE);
+            integrator().step(these_steps);
         }
+        steps_done += these_steps;
+        _advance_restraint_animations(these_steps);
+        if (!_stability_check_in_loop())
+            return false;
+        if (!_haptic_tugs.empty())
+            _publish_haptic_feedback(_final_state.getPositions());
+        if (smooth)
+        {
+            Stage_Timings::Scope t(_timings, Stage_Timings::SMOOTHING);
+            _apply_smoothing(_final_state);
+        }
+    }
+    return true;
+}
+
+bool OpenMM_Thread_Handler::_stability_check_in_loop()
+{
+    {
+        Stage_Timings::Scope t(_timings, Stage_Timings::STATE_DOWNLOAD);
+        _final_state = _check_by_displacement
+            ? _context->getState(OpenMM::State::Positions)
+            : _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
+    }
+    {
+        Stage_Timings::Scope t(_timings, Stage_Timings::VELOCITY_CHECK);
+        _fast_atoms = _check_by_displacement
+            ? _overly_displaced_atoms(_final_state)
+            : overly_fast_atoms(_final_state.getVelocities());
+    }
+    if (_fast_atoms.size() > 0)
+    {
+        std::cerr << _fast_atoms.size() << " atoms are moving too fast!" << std::endl;
+        _unstable = true;
+        _check_interval = _min_check_interval;
+        _stable_checks = 0;
+        return false;
+    }
+    if (++_stable_checks >= STABLE_CHECKS_BEFORE_BACKOFF)
+    {
+        _check_interval = std::min<size_t>(_check_interval*2, _max_check_interval);
+        _stable_checks = 0;
+    }
+    return true;
+}
+
+void OpenMM_Thread_Handler::_reset_displacement_reference(const OpenMM::State& state)
+{
+    _reference_positions = state.getPositions();
+    _reference_time = state.getTime();
+}
+
+std::vector<size_t> OpenMM_Thread_Handler::_overly_displaced_atoms(const OpenMM::State& state)
+{
+    std::vector<size_t> fast_indices;
+    const auto& positions = state.getPositions();
+    double dt = state.getTime() - _reference_time;
+    if (_reference_positions.size() == _natoms && dt > 0)
+    {
+        double max_disp = MAX_VELOCITY * dt;
+        fast_indices = kernels::indices_diff_above_sq(kernels::flat(positions),
+            kernels::flat(_reference_positions), _natoms, max_disp*max_disp);
+    }
+    _reset_displacement_reference(state);
+    return fast_indices;
+}
+
+void OpenMM_Thread_Handler::_publish_coords(const OpenMM::State& state)
+{
+    const auto& coords_nm = (_smoothing && _smoothed_coords.size() == _natoms)
+        ? _smoothed_coords : state.getPositions();
+    double *out = _published_coords.back();
+    for (const auto& c: coords_nm)
+        for (size_t i=0; i<3; ++i)
+            *out++ = c[i]*10.0;
+    _publish_frame();
+    _publish_bond_forces(coords_nm);
+    if (_recorder && (_publish_count++ % _record_interval == 0))
+        _recorder->add_frame(coords_nm, state.getTime());
+}
+
+void OpenMM_Thread_Handler::_publish_frame()
+{
+    std::shared_ptr<Coord_Snapshot> snap;
+    if (_publish_snapshots)
+    {
+        const double *c = _published_coords.back();
+        snap = std::make_shared<Coord_Snapshot>();
+        snap->coords.assign(c, c+_natoms*3);
+    }
+    _published_coords.publish();
+    if (snap)
+    {
+        snap->generation = _published_coords.generation();
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        _snapshot = snap;
+    }
+}
+
+void OpenMM_Thread_Handler::start_recording(const std::string& filename, double precision,
+    size_t keyframe_interval, size_t record_interval)
+{
+    _thread_finished_check();
+    if (record_interval == 0)
+        throw std::invalid_argument("Recording interval must be at least 1!");
+    // Close out any earlier recording before opening the new file, in case
+    // they're the same
+    _recorder.reset();
+    _recorder.reset(new Trajectory_Recorder(filename, _natoms, precision, keyframe_interval));
+    _record_interval = record_interval;
+    _publish_count = 0;
+}
+
+void OpenMM_Thread_Handler::stop_recording()
+{
+    _thread_finished_check();
+    _recorder.reset();
+}
+
+void OpenMM_Thread_Handler::_publish_bond_forces(const std::vector<OpenMM::Vec3>& coords_nm)
+{
+    size_t n = num_monitored_bonds();
+    if (n == 0)
+        return;
+    double *out = _published_bond_forces.back();
+    const double *params = _monitored_params.data();
+    for (size_t i=0; i<n; ++i)
+    {
+        const auto& c0 = coords_nm[_monitored_pairs[2*i]];
+        const auto& c1 = coords_nm[_monitored_pairs[2*i+1]];
+        double r = sqrt((c1-c0).dot(c1-c0));
+        out[i] = custom_forces::adaptive_distance_force(r, params+custom_forces::ADAPTIVE_DISTANCE_PARAMS*i);
+    }
+    _published_bond_forces.publish();
+}
+
+void OpenMM_Thread_Handler::_stability_check() const
+{
+    if (_unstable)
+        throw std::logic_error("The last round had atoms moving dangerously fast. Fix the issues and minimise first.");
+    if (_clash)
+        throw std::logic_error("You still have clashing atoms! Fix these and minimise first.");
+}
+
+void OpenMM_Thread_Handler::_step_threaded(size_t steps, bool smooth)
+{
+    _stability_check();
+    auto start = std::chrono::steady_clock::now();
+    _starting_state = _final_state;
+    _smoothing = smooth;
+    if (!smooth)
+        _smoothed_coords.clear();
+    _timings.begin_frame();
+    if (steps == 0)
+    {
+        Stage_Timings::Scope t(_timings, Stage_Timings::STATE_DOWNLOAD);
         _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
-        auto end = std::chrono::steady_clock::now();
-        auto loop_time = end-start;
-        if (loop_time < _min_time_per_loop)
-            std::this_thread::sleep_for(_min_time_per_loop-loop_time);
-        _thread_finished = true;
-    } catch (...)
+    }
+    else
+        _integrate(steps, smooth);
+    _timed_publish_coords(_final_state);
+    auto end = std::chrono::steady_clock::now();
+    auto loop_time = end-start;
+    _timed_sleep(loop_time);
+    _timings.end_frame();
+}
+
+void OpenMM_Thread_Handler::_timed_publish_coords(const OpenMM::State& state)
+{
+    Stage_Timings::Scope t(_timings, Stage_Timings::COPY_OUT);
+    _publish_coords(state);
+}
+
+void OpenMM_Thread_Handler::_timed_sleep(std::chrono::steady_clock::duration loop_time)
+{
+    if (loop_time < _min_time_per_loop())
+        _timed_sleep_for(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            _min_time_per_loop()-loop_time));
+}
+
+void OpenMM_Thread_Handler::_timed_sleep_for(std::chrono::steady_clock::duration d)
+{
+    if (d <= std::chrono::steady_clock::duration::zero())
+        return;
+    Stage_Timings::Scope t(_timings, Stage_Timings::SLEEP);
+    std::this_thread::sleep_for(d);
+}
+
+void OpenMM_Thread_Handler::_step_continuous_threaded(size_t steps_per_publish, bool smooth)
+{
+    _stability_check();
+    _starting_state = _final_state;
+    _smoothing = smooth;
+    if (!smooth)
+        _smoothed_coords.clear();
+    bool paced = _adaptive_pacing;
+    if (paced)
+        _pacer.reset(steps_per_publish);
+    size_t steps = steps_per_publish;
+    while (_continue_running())
+    {
+        auto start = std::chrono::steady_clock::now();
+        _timings.begin_frame();
+        if (paced)
+            steps = _pacer.steps();
+        bool stable = _integrate(steps, smooth);
+        auto integrate_time = std::chrono::steady_clock::now()-start;
+        _timed_publish_coords(_final_state);
+        if (!stable)
+        {
+            _timings.end_frame();
+            break;
+        }
+        auto loop_time = std::chrono::steady_clock::now()-start;
+        if (paced)
+        {
+            typedef std::chrono::duration<double, std::milli> ms;
+            _pacer.update(steps, ms(integrate_time).count(), ms(loop_time-integrate_time).count());
+            _timed_sleep_for(_pacer.sleep());
+        } else {
+            _timed_sleep(loop_time);
+        }
+        _timings.end_frame();
+    }
+}
+
+void OpenMM_Thread_Handler::_apply_smoothing(const OpenMM::State& state)
+{
+    const auto& coords = state.getPositions();
+    if (_smoothed_coords.size() == 0) {
+        _smoothed_coords = coords;
+        return;
+    }
+    kernels::exponential_smooth(kernels::flat(_smoothed_coords), kernels::flat(coords),
+        _natoms*3, _smoothing_alpha);
+}
+
+
+// The seed atoms plus all atoms within radius of any of them, found by
+// binning the seeds on a grid of radius-sized cells, plus anything
+// constrained to one of those. Massless particles are left out.
+std::vector<int> OpenMM_Thread_Handler::_region_particles(const std::vector<OpenMM::Vec3>& positions,
+    const std::vector<size_t>& seeds, double radius) const
+{
+    const auto& system = _context->getSystem();
+    std::vector<char> in_region(_natoms, 0);
+    for (auto i: seeds)
+        in_region[i] = 1;
+    if (radius > 0)
     {
-        _thread_except = std::current_exception();
-        _thread_finished = true;
+        typedef std::array<long, 3> Cell;
+        auto cell_of = [radius](const OpenMM::Vec3& p) {
+            return Cell{{ (long)std::floor(p[0]/radius), (long)std::floor(p[1]/radius),
+                (long)std::floor(p[2]/radius) }};
+        };
+        std::map<Cell, std::vector<size_t>> grid;
+        for (auto i: seeds)
+            grid[cell_of(positions[i])].push_back(i);
+        double r2 = radius*radius;
+        for (size_t i=0; i<_natoms; ++i)
+        {
+            if (in_region[i])
+                continue;
+            const auto& p = positions[i];
+            Cell c = cell_of(p);
+            bool found = false;
+            for (long dx=-1; dx<=1 && !found; ++dx)
+            for (long dy=-1; dy<=1 && !found; ++dy)
+            for (long dz=-1; dz<=1 && !found; ++dz)
+            {
+                auto it = grid.find(Cell{{c[0]+dx, c[1]+dy, c[2]+dz}});
+                if (it == grid.end())
+                    continue;
+                for (auto j: it->second)
+                {
+                    OpenMM::Vec3 d = p - positions[j];
+                    if (d.dot(d) <= r2) { found = true; break; }
+                }
+            }
+            if (found)
+                in_region[i] = 1;
+        }
+    }
+    // Keep constrained pairs together, so that constraints are never
+    // stretched between a moving and a fixed atom unnecessarily
+    int p1, p2;
+    double dist;
+    for (int i=0; i<system.getNumConstraints(); ++i)
+    {
+        system.getConstraintParameters(i, p1, p2, dist);
+        if (in_region[p1] != in_region[p2])
+            in_region[p1] = in_region[p2] = 1;
+    }
+    std::vector<int> mobile;
+    for (size_t i=0; i<_natoms; ++i)
+        if (in_region[i] && system.getParticleMass(i) > 0.0)
+            mobile.push_back(i);
+    return mobile;
+}
+
+void OpenMM_Thread_Handler::_minimize_threaded(const double &tolerance, int max_iterations,
+    const std::vector<size_t>& region, double radius)
+{
+    if (region.empty())
+    {
+        _minimize_particles_threaded(tolerance, max_iterations, nullptr);
+        return;
+    }
+    auto positions = _context->getState(OpenMM::State::Positions).getPositions();
+    auto mobile = _region_particles(positions, region, radius);
+    _minimize_particles_threaded(tolerance, max_iterations, &mobile);
+}
+
+// Minimises only the given particles, or the whole system if mobile is null
+void OpenMM_Thread_Handler::_minimize_particles_threaded(const double &tolerance, int max_iterations,
+    const std::vector<int> *mobile)
+{
+    // std::cout << "Starting minimization with tolerance of " << tolerance << " and max iterations per round of " << max_iterations << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    _clash = false;
+    _smoothed_coords.clear();
+    _reference_positions.clear();
+    _fast_atoms.clear();
+    // The linearised bias is only valid close to where it was evaluated
+    _release_grid_bias();
+    _starting_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Energy);
+    _min_converged = false;
+    std::vector<double> region_mask;
+    if (mobile != nullptr)
+    {
+        region_mask.assign(_natoms, 0.0);
+        for (auto i: *mobile)
+            region_mask[i] = _mobile_mask[i];
+    }
+    _prescreen_stats = Clash_Prescreen::Stats();
+    if (_prescreen_enabled && _prescreen.num_particles() == _natoms)
+    {
+        // Untangle severe overlaps first, rather than have L-BFGS choke on them
+        _prescreen.set_overlap_distance(_prescreen_distance);
+        _prescreen_stats = _prescreen.resolve(*_context,
+            mobile == nullptr ? _mobile_mask.data() : region_mask.data(),
+            MAX_PRESCREEN_ITERATIONS, integrator().getConstraintTolerance());
+        if (_prescreen_stats.iterations > 0)
+            _starting_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Energy);
+    }
+    double tol = tolerance * (mobile == nullptr ? _natoms : std::max<size_t>(mobile->size(), 1));
+    _min_energy = _starting_state.getPotentialEnergy();
+    // std::cout << "Initial energy: " << _starting_state.getPotentialEnergy() << " kJ/mol" << std::endl;
+    auto progress = [this](const double *x, const double *g, double energy, int) {
+        _min_energy = energy;
+        double *out = _published_coords.back();
+        for (size_t i=0; i<_natoms*3; ++i)
+            out[i] = x[i]*10.0;
+        _publish_frame();
+        return !(_cancel_minimization && kernels::max_sq(g, _natoms) < MAX_FORCE*MAX_FORCE);
+    };
+    int interval = static_cast<int>(_min_progress_interval.load());
+    auto precision = static_cast<isolde::LocalEnergyMinimizer::Precision>(_min_precision.load());
+    auto progress_cb = interval > 0 ? progress : isolde::LocalEnergyMinimizer::Progress_Callback();
+    int result;
+    if (mobile == nullptr)
+        result = isolde::LocalEnergyMinimizer::minimize(*_context, tol, max_iterations,
+            progress_cb, interval, precision);
+    else
+        result = isolde::LocalEnergyMinimizer::minimize_region(*_context, *mobile, tol,
+            max_iterations, progress_cb, interval, precision);
+    if (result == isolde::LocalEnergyMinimizer::SUCCESS
+        || result == isolde::LocalEnergyMinimizer::CANCELLED)
+    {
+        // Minimisation has converged to within the desired tolerance (or
+        // was cancelled once all forces were reasonable), and all
+        // constraints are satisfied.
+        _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Forces | OpenMM::State::Energy);
+        _min_converged = true;
+        _unstable = false;
+    } else if (result == isolde::LocalEnergyMinimizer::DID_NOT_CONVERGE) {
+        // Minimisation ongoing. Just leave _min_converged = false, but
+        // let ISOLDE have the new coordinates.
+        _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Forces | OpenMM::State::Energy);
+    } else // if (result < 0)
+    {
+        // Minimisation failed. Revert the model to its initial state
+        // and let ISOLDE point out problem areas to the user.
+        _clash = true;
+        _final_state = _starting_state;
+    }
+    //if (_min_converged && max_force(_final_state.getForces()) > MAX_FORCE)
+    if (_min_converged)
+    {
+        double f;
+        if (mobile == nullptr)
+            f = max_force(_context->getSystem(), _final_state);
+        else {
+            // Strain elsewhere in the model is none of our business here
+            f = sqrt(kernels::max_sq_masked(kernels::flat(_final_state.getForces()), region_mask.data(), _natoms));
+        }
+        if (f > MAX_FORCE)
+            _clash = true;
+    }
+    _publish_coords(_final_state);
+    auto end = std::chrono::steady_clock::now();
+    auto loop_time = end-start;
+    if (loop_time < _min_time_per_loop())
+        std::this_thread::sleep_for(_min_time_per_loop()-loop_time);
+    // std::cout << "Finished minimization round" << std::endl;
+}
+
+// Cached 1/0 mask and index list of particles with mass, used when scanning
+// for excessive forces. Only changes when the context is reinitialised.
+void OpenMM_Thread_Handler::_update_mobile_mask()
+{
+    const auto& system = _context->getSystem();
+    size_t n = system.getNumParticles();
+    _mobile_mask.resize(n);
+    _mobile_particles.clear();
+    for (size_t i=0; i<n; ++i)
+    {
+        bool mobile = system.getParticleMass(i) > 0.0;
+        _mobile_mask[i] = mobile ? 1.0 : 0.0;
+        if (mobile)
+            _mobile_particles.push_back(i);
+    }
+}
+
+void OpenMM_Thread_Handler::_reinitialize_context_threaded()
+{
+    OpenMM::State current_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
+    _context->reinitialize();
+    _context->setPositions(current_state.getPositions());
+    _context->setVelocities(current_state.getVelocities());
+}
+
+void OpenMM_Thread_Handler::_refine_region_threaded(const Region_Refinement& job)
+{
+    Region_Result r;
+    r.id = job.id;
+    // Nothing from the previous region may leak into this one's outcome
+    _clash = false;
+    _min_converged = false;
+    _unstable = false;
+    _tighten_checks = true;
+    OpenMM::State initial = _context->getState(OpenMM::State::Positions | OpenMM::State::Energy);
+    r.start_energy = initial.getPotentialEnergy();
+    _final_state = initial;
+
+    if (job.settle_iterations > 0)
+        _minimize_particles_threaded(job.settle_tolerance, job.settle_iterations, &job.mobile);
+    size_t rounds = 0;
+    do {
+        if (_clash)
+            break;
+        _minimize_particles_threaded(job.tolerance, job.max_iterations, &job.mobile);
+    } while (!_min_converged && ++rounds < job.max_rounds);
+    r.converged = _min_converged;
+    r.clash = _clash;
+    r.minimized_energy = _final_state.getPotentialEnergy();
+    if (_clash)
+    {
+        // Leave the region as it was for the rest of the batch
+        _context->setPositions(initial.getPositions());
+        _final_state = initial;
+    }
+
+    if (!_clash && job.steps > 0)
+    {
+        OpenMM::State minimized = _final_state;
+        const auto& held = minimized.getPositions();
+        _set_region_hold(job.mobile, held, true);
+        _context->setVelocitiesToTemperature(job.temperature, job.seed);
+        _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
+        _starting_state = _final_state;
+        _smoothing = false;
+        _smoothed_coords.clear();
+        bool stable = _integrate(job.steps, false);
+        _set_region_hold(job.mobile, held, false);
+        // The held atoms go back exactly where they were
+        std::vector<OpenMM::Vec3> positions(held);
+        if (stable)
+        {
+            const auto& moved = _final_state.getPositions();
+            for (auto i: job.mobile)
+                positions[i] = moved[i];
+        } else
+            r.unstable = true;
+        _context->setPositions(positions);
+        _unstable = false;
+        _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Energy);
+        r.final_energy = _final_state.getPotentialEnergy();
+    } else
+        r.final_energy = r.minimized_energy;
+
+    const auto& positions = _final_state.getPositions();
+    r.coords.reserve(job.mobile.size()*3);
+    for (auto i: job.mobile)
+        for (size_t j=0; j<3; ++j)
+            r.coords.push_back(positions[i][j]*10.0);
+    _publish_coords(_final_state);
+    std::lock_guard<std::mutex> lock(_region_mutex);
+    _region_results.push_back(std::move(r));
+}
+
+// Worker thread. With hold true, tethers every particle with mass that isn't
+// in mobile to its given position; with hold false, lets them all go again.
+void OpenMM_Thread_Handler::_set_region_hold(const std::vector<int>& mobile,
+    const std::vector<OpenMM::Vec3>& positions, bool hold)
+{
+    std::vector<double> held(_natoms, hold ? 1.0 : 0.0);
+    for (auto i: mobile)
+        held[i] = 0.0;
+    std::vector<double> params(4);
+    for (size_t i=0; i<_natoms; ++i)
+    {
+        const auto& p = positions[i];
+        params = {held[i]*_mobile_mask[i]*REGION_HOLD_K, p[0], p[1], p[2]};
+        _region_hold_force->setParticleParameters(i, i, params);
+    }
+    _region_hold_force->updateParametersInContext(*_context);
+}
+
+std::vector<size_t> OpenMM_Thread_Handler::overly_fast_atoms(const std::vector<OpenMM::Vec3>& velocities)
+{
+    return kernels::indices_above_sq(kernels::flat(velocities), velocities.size(),
+        MAX_VELOCITY*MAX_VELOCITY);
+}
+
+void OpenMM_Thread_Handler::set_coords_in_angstroms(const std::vector<OpenMM::Vec3>& coords_ang)
+{
+    if (coords_ang.size() != natoms())
+        throw std::logic_error("Number of input atoms does not match number in simulation!");
+    Thread_Command cmd(Thread_Command::SET_COORDS);
+    cmd.coords.resize(_natoms);
+    auto from = coords_ang.begin();
+    auto to = cmd.coords.begin();
+    for (; to != cmd.coords.end(); from++, to++)
+        *to = *from * 0.1;
+    _enqueue(std::move(cmd));
+}
+
+bool OpenMM_Thread_Handler::latest_coords_to_atoms(atomstruct::Atom** atoms, size_t n, const size_t* indices)
+{
+    if (indices == nullptr && n != natoms())
+        throw std::logic_error("Mismatch between number of atoms and simulation size!");
+    if (indices != nullptr)
+        for (size_t i=0; i<n; ++i)
+            if (indices[i] >= _natoms)
+                throw std::out_of_range("Atom index out of range!");
+    _pacer.record_poll();
+    if (!_published_coords.update())
+        return false;
+    const double *from = _published_coords.front();
+    atomstruct::Structure *last = nullptr;
+    // One representative atom per structure carries the "coord changed" reason
+    std::vector<std::pair<atomstruct::Structure*, atomstruct::Atom*>> touched;
+    for (size_t i=0; i<n; ++i)
+    {
+        auto a = atoms[i];
+        const double *c = from + 3*(indices == nullptr ? i : indices[i]);
+        a->set_coord(atomstruct::Coord(c[0], c[1], c[2]), false);
+        auto s = a->structure();
+        if (s != last)
+        {
+            auto it = std::find_if(touched.begin(), touched.end(),
+                [s](const std::pair<atomstruct::Structure*, atomstruct::Atom*>& t) { return t.first == s; });
+            if (it == touched.end())
+                touched.emplace_back(s, a);
+            last = s;
+        }
+    }
+    for (const auto& t: touched)
+    {
+        auto s = t.first;
+        auto ct = s->change_tracker();
+        ct->add_modified(s, t.second, atomstruct::ChangeTracker::REASON_COORD);
+        ct->add_modified(s, s->active_coord_set(), atomstruct::ChangeTracker::REASON_COORDSET);
+        s->set_gc_shape();
+    }
+    return true;
+}
+
+void OpenMM_Thread_Handler::set_coords_in_angstroms(double *coords, size_t n)
+{
+    if (n != natoms())
+        throw std::logic_error("Number of input atoms does not match number in simulation!");
+    Thread_Command cmd(Thread_Command::SET_COORDS);
+    cmd.coords.resize(n);
+    for (auto &v: cmd.coords) {
+        for (size_t i=0; i<3; ++i)
+            v[i] = (*coords++)/10.0;
+    }
+    _enqueue(std::move(cmd));
+}
+
+double OpenMM_Thread_Handler::max_force(const std::vector<OpenMM::Vec3>& forces) const
+{
+    return sqrt(kernels::max_sq(kernels::flat(forces), forces.size()));
+}
+
+// get maximum force, ignoring massless (fixed) particles
+double OpenMM_Thread_Handler::max_force(const OpenMM::System& system, const OpenMM::State& state) const
+{
+    const auto& forces = state.getForces();
+    size_t n = system.getNumParticles();
+    if (_mobile_mask.size() == n)
+    {
+        // Typically most of the context is fixed surroundings, in which case
+        // it's cheaper to visit just the mobile particles
+        size_t n_mobile = _mobile_particles.size();
+        if (2*n_mobile < n)
+            return sqrt(kernels::max_sq_indexed(kernels::flat(forces), _mobile_particles.data(), n_mobile));
+        return sqrt(kernels::max_sq_masked(kernels::flat(forces), _mobile_mask.data(), n));
+    }
+    std::vector<double> mask(n);
+    for (size_t i=0; i<n; ++i)
+        mask[i] = system.getParticleMass(i) > 0.0 ? 1.0 : 0.0;
+    return sqrt(kernels::max_sq_masked(kernels::flat(forces), mask.data(), n));
+}
+
+
+size_t OpenMM_Thread_Handler::top_forces(double min_force, size_t max_n, size_t *indices,
+    double *magnitudes)
+{
+    finalize_thread();
+    if (max_n == 0)
+        return 0;
+    auto state = _context->getState(OpenMM::State::Forces);
+    const double* f = kernels::flat(state.getForces());
+    double min_sq = min_force*min_force;
+    std::vector<std::pair<double, size_t>> found;
+    for (auto i: _mobile_particles)
+    {
+        const double* x = f+3*i;
+        double sq = x[0]*x[0] + x[1]*x[1] + x[2]*x[2];
+        if (sq > min_sq)
+            found.emplace_back(sq, i);
+    }
+    size_t n = std::min(max_n, found.size());
+    std::partial_sort(found.begin(), found.begin()+n, found.end(),
+        [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) {
+            return a.first > b.first; });
+    for (size_t i=0; i<n; ++i)
+    {
+        *indices++ = found[i].second;
+        *magnitudes++ = sqrt(found[i].first);
+    }
+    return n;
+}
+
+void OpenMM_Thread_Handler::set_smoothing_alpha(const double &alpha)
+{
+    if (alpha < SMOOTHING_ALPHA_MIN)
+        _smoothing_alpha = SMOOTHING_ALPHA_MIN;
+    else if (alpha > SMOOTHING_ALPHA_MAX)
+        _smoothing_alpha = SMOOTHING_ALPHA_MAX;
+    else
+        _smoothing_alpha = alpha;
+}
+
+// PYTHON INTERFACE BELOW
+
+SET_PYTHON_INSTANCE(openmm_thread_handler, OpenMM_Thread_Handler)
+GET_PYTHON_INSTANCES(openmm_thread_handler, OpenMM_Thread_Handler)
+
+// Allocated with plain new, which only guarantees the default alignment
+static_assert(alignof(OpenMM_Thread_Handler) <= alignof(std::max_align_t),
+    "OpenMM_Thread_Handler must not be over-aligned!");
+
+extern "C" EXPORT void*
+openmm_thread_handler_new(void *context)
+{
+    OpenMM::Context *c = static_cast<OpenMM::Context *>(context);
+    try {
+        OpenMM_Thread_Handler *h = new OpenMM_Thread_Handler(c);
+        return h;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_delete(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        delete h;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_num_atoms(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->natoms();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT double
+openmm_thread_handler_smoothing_alpha(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->smoothing_alpha();
+    } catch (...) {
+        molc_error();
+        return -1;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_smoothing_alpha(void *handler, double alpha)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_smoothing_alpha(alpha);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+
+
+extern "C" EXPORT void
+openmm_thread_handler_step(void *handler, size_t steps, npy_bool smooth)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->step_threaded(steps, smooth);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_step_continuous(void *handler, size_t steps_per_update, npy_bool smooth)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->step_continuous_threaded(steps_per_update, smooth);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_minimize(void *handler, double tolerance, int max_iterations)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->minimize_threaded(tolerance, max_iterations);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+
+extern "C" EXPORT size_t
+openmm_thread_handler_top_forces(void *handler, double min_force, size_t max_n,
+    size_t *indices, double *magnitudes)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->top_forces(min_force, max_n, indices, magnitudes);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_minimize_region(void *handler, size_t n, size_t *indices,
+    double radius, double tolerance, int max_iterations)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        std::vector<size_t> atoms(indices, indices+n);
+        h->minimize_region_threaded(atoms, radius, tolerance, max_iterations);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_refine_region(void *handler, uint64_t id, size_t n, int32_t *mobile,
+    double settle_tolerance, int settle_iterations, double tolerance, int max_iterations,
+    size_t max_rounds, size_t steps, double temperature, int seed)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        Region_Refinement job;
+        job.id = id;
+        job.mobile.assign(mobile, mobile+n);
+        job.settle_tolerance = settle_tolerance;
+        job.settle_iterations = settle_iterations;
+        job.tolerance = tolerance;
+        job.max_iterations = max_iterations;
+        job.max_rounds = max_rounds;
+        job.steps = steps;
+        job.temperature = temperature;
+        job.seed = seed;
+        h->refine_region_threaded(std::move(job));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_num_region_results(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->num_region_results();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+/*! Writes the id, (start, minimised, final) energies, (converged, clash,
+ *  unstable) flags and up to max_coords mobile-atom coordinates of the
+ *  oldest finished region. Returns the number of mobile atoms, or -1 if no
+ *  region is finished.
+ */
+extern "C" EXPORT int64_t
+openmm_thread_handler_pop_region_result(void *handler, uint64_t *id, double *energies,
+    npy_bool *flags, size_t max_coords, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        Region_Result r;
+        if (!h->pop_region_result(r))
+            return -1;
+        size_t n = r.coords.size()/3;
+        if (n > max_coords)
+            throw std::logic_error("Output array is too small for the region's mobile atoms!");
+        *id = r.id;
+        energies[0] = r.start_energy;
+        energies[1] = r.minimized_energy;
+        energies[2] = r.final_energy;
+        flags[0] = r.converged;
+        flags[1] = r.clash;
+        flags[2] = r.unstable;
+        std::copy(r.coords.begin(), r.coords.end(), coords);
+        return n;
+    } catch (...) {
+        molc_error();
+        return -1;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_set_clash_prescreen_topology(void *handler, size_t n, npy_bool *heavy,
+    size_t n_bonds, int32_t *bonds)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_clash_prescreen_topology(heavy, n, bonds, n_bonds);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_clash_prescreen_enabled(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->clash_prescreen_enabled();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_clash_prescreen_enabled(void *handler, npy_bool flag)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_clash_prescreen_enabled(flag);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT double
+openmm_thread_handler_clash_prescreen_distance(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->clash_prescreen_distance();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_clash_prescreen_distance(void *handler, double d)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        if (d <= 0)
+            throw std::invalid_argument("Overlap distance must be positive!");
+        h->set_clash_prescreen_distance(d);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! Writes (overlaps found, overlaps remaining, iterations)
+extern "C" EXPORT void
+openmm_thread_handler_last_clash_prescreen(void *handler, size_t *stats)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        const auto& s = h->last_clash_prescreen();
+        stats[0] = s.found;
+        stats[1] = s.remaining;
+        stats[2] = s.iterations;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_set_grid_bias_force(void *handler, void *force)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_grid_bias_force(static_cast<OpenMM::CustomExternalForce *>(force));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_set_region_hold_force(void *handler, void *force)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_region_hold_force(static_cast<OpenMM::CustomExternalForce *>(force));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+/*! grid is a RegularGridInterpolator<double, float> (e.g. one of the
+ *  log-probability grids of the Ramachandran or rotamer manager), which the
+ *  bias shares. periods may be null (see Grid_Bias::add_grid()).
+ */
+extern "C" EXPORT size_t
+openmm_thread_handler_add_grid_bias_grid(void *handler, void *grid, double *periods)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->add_grid_bias_grid(*static_cast<Grid_Bias::Grid *>(grid), periods);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_add_grid_bias_terms(void *handler, size_t grid, size_t n,
+    int *particles, double *k)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->add_grid_bias_terms(grid, n, particles, k);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_clear_grid_bias(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->clear_grid_bias();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_num_grid_bias_terms(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->num_grid_bias_terms();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT double
+openmm_thread_handler_grid_bias_scale(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->grid_bias_scale();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_grid_bias_scale(void *handler, double scale)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_grid_bias_scale(scale);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_grid_bias_interval(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->grid_bias_interval();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_grid_bias_interval(void *handler, size_t steps)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_grid_bias_interval(steps);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT double
+openmm_thread_handler_last_grid_bias_energy(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->last_grid_bias_energy();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_thread_finished(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->thread_finished();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_thread_running(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->thread_running();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_finalize_thread(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->finalize_thread();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_unstable(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->unstable();
+    } catch(...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_cancel_minimization(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->cancel_minimization();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_minimization_progress_interval(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->minimization_progress_interval();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_minimization_progress_interval(void *handler, size_t iterations)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_minimization_progress_interval(iterations);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT double
+openmm_thread_handler_minimization_energy(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->minimization_energy();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT int
+openmm_thread_handler_minimizer_precision(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->minimizer_precision();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_minimizer_precision(void *handler, int precision)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        if (precision < isolde::LocalEnergyMinimizer::PRECISION_DOUBLE
+            || precision > isolde::LocalEnergyMinimizer::PRECISION_AUTO)
+            throw std::out_of_range("Unrecognised minimizer precision!");
+        h->set_minimizer_precision(precision);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_converged(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->converged();
+    } catch(...) {
+        molc_error();
+        return false;
+    }
+}
+
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_clashing(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->clash_detected();
+    } catch(...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_unstable_atoms(void *handler, size_t n, npy_bool *unstable)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        if (n != h->natoms())
+            throw std::logic_error("Mismatch between number of atoms and output array size!");
+        for (auto i: h->last_fast_atoms())
+            unstable[i] = true;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_last_coords(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->export_coords_in_angstroms(OpenMM_Thread_Handler::INITIAL_COORDS, coords, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_current_coords(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->export_coords_in_angstroms(OpenMM_Thread_Handler::FINAL_COORDS, coords, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_smoothed_coords(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->export_coords_in_angstroms(OpenMM_Thread_Handler::SMOOTHED_COORDS, coords, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+/*
+ * Write coordinates for the atoms at the given indices (or all atoms, if
+ * indices is NULL) straight into the output array, in Angstroms.
+ */
+extern "C" EXPORT void
+openmm_thread_handler_export_coords(void *handler, int source, size_t n, size_t *indices, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->export_coords_in_angstroms(static_cast<OpenMM_Thread_Handler::Coord_Source>(source), coords, n, indices);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_export_coords_f(void *handler, int source, size_t n, size_t *indices, float32_t *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->export_coords_in_angstroms(static_cast<OpenMM_Thread_Handler::Coord_Source>(source), coords, n, indices);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_latest_coords(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->latest_coords_in_angstroms(coords, n);
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_latest_coords_subset(void *handler, size_t n, size_t *indices, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->latest_coords_in_angstroms(coords, n, indices);
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_latest_coords_subset_f(void *handler, size_t n, size_t *indices, float32_t *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->latest_coords_in_angstroms(coords, n, indices);
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_latest_coords_to_atoms(void *handler, size_t n, size_t *indices, void *atoms)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->latest_coords_to_atoms(static_cast<atomstruct::Atom **>(atoms), n, indices);
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_publish_snapshots(void *handler, npy_bool flag)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_publish_snapshots(flag);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_publish_snapshots(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->publish_snapshots();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+//! Copies the latest snapshot into coords and returns its generation (0 if none)
+extern "C" EXPORT uint64_t
+openmm_thread_handler_coord_snapshot(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        if (n != h->natoms())
+            throw std::logic_error("Mismatch between number of atoms and output array size!");
+        auto snap = h->coord_snapshot();
+        if (!snap)
+            return 0;
+        std::copy(snap->coords.begin(), snap->coords.end(), coords);
+        return snap->generation;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT uint64_t
+openmm_thread_handler_coords_generation(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->coords_generation();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_current_coords(void *handler, size_t n, double *coords)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_coords_in_angstroms(coords, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+
+extern "C" EXPORT double
+openmm_thread_handler_min_thread_period(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->get_minimum_thread_time_in_ms();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_min_thread_period(void *handler, double time_ms)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_minimum_thread_time_in_ms(time_ms);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_adaptive_pacing(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->adaptive_pacing();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_adaptive_pacing(void *handler, npy_bool flag)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_adaptive_pacing(flag);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_pacing_parameters(void *handler, double *target_latency_ms, size_t *steps)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        const auto& p = h->pacer();
+        *target_latency_ms = p.target_latency_ms();
+        steps[0] = p.min_steps();
+        steps[1] = p.max_steps();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_pacing_parameters(void *handler, double target_latency_ms,
+    size_t min_steps, size_t max_steps)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->pacer().configure(target_latency_ms, min_steps, max_steps);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+/*
+ * Current pacing state: steps per chunk, sleep (ms), step time (ms),
+ * per-chunk overhead (ms), GUI polling interval (ms).
+ */
+extern "C" EXPORT void
+openmm_thread_handler_pacing_state(void *handler, double *state)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        const auto& p = h->pacer();
+        state[0] = p.current_steps();
+        state[1] = p.sleep_ms();
+        state[2] = p.step_time_ms();
+        state[3] = p.overhead_ms();
+        state[4] = p.gui_interval_ms();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_instability_check_intervals(void *handler, size_t *intervals)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        intervals[0] = h->min_instability_check_interval();
+        intervals[1] = h->max_instability_check_interval();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+set_openmm_thread_handler_instability_check_intervals(void *handler, size_t min_steps, size_t max_steps)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_instability_check_intervals(min_steps, max_steps);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_tighten_instability_checks(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->tighten_instability_checks();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_stage_force_parameters(void *handler, void *force, int type,
+    size_t n, int *indices, double *params)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    OpenMM::Force *f = static_cast<OpenMM::Force *>(force);
+    try {
+        if (type < custom_forces::CUSTOM_BOND || type > custom_forces::CUSTOM_TORSION)
+            throw std::invalid_argument("Unrecognised force type!");
+        h->stage_force_parameters(f, static_cast<custom_forces::Force_Type>(type),
+            n, indices, params);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_flush_force_updates(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->flush_force_updates();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_discard_force_updates(void *handler, void *force)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    OpenMM::Force *f = static_cast<OpenMM::Force *>(force);
+    try {
+        h->discard_force_updates(f);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_monitor_adaptive_distance_force(void *handler, void *force)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    OpenMM::CustomBondForce *f = static_cast<OpenMM::CustomBondForce *>(force);
+    try {
+        h->monitor_adaptive_distance_force(f);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_num_monitored_bonds(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->num_monitored_bonds();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT npy_bool
+openmm_thread_handler_latest_bond_forces(void *handler, double *forces)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->latest_bond_forces(forces);
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_attach_haptic_link(void *handler, void *link, void *force, int entry)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->attach_haptic_link(static_cast<Haptic_Link *>(link),
+            static_cast<OpenMM::CustomExternalForce *>(force), entry);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_push_tug_targets(void *handler, void *force, size_t n,
+    int *entries, double *params)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->push_tug_targets(static_cast<OpenMM::CustomExternalForce *>(force),
+            n, entries, params);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+openmm_thread_handler_detach_haptic_link(void *handler, void *link)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->detach_haptic_link(static_cast<Haptic_Link *>(link));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+openmm_thread_handler_add_restraint_animation(void *handler, void *force, int type,
+    size_t n_terms, int *indices, size_t n_keyframes, size_t n_params, double *keyframes,
+    uint8_t *stepped, size_t steps_per_keyframe)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    OpenMM::Force *f = static_cast<OpenMM::Force *>(force);
+    try {
+        if (type < custom_forces::CUSTOM_BOND || type > custom_forces::CUSTOM_TORSION)
+            throw std::invalid_argument("Unrecognised force type!");
+        if (n_params != custom_forces::num_parameters(f, static_cast<custom_forces::Force_Type>(type)))
+            throw std::invalid_argument("Wrong number of parameters for this force!");
+        return h->add_restraint_animation(f, static_cast<custom_forces::Force_Type>(type),
+            n_terms, indices, n_keyframes, keyframes, stepped, steps_per_keyframe);
+    } catch (...) {
+        molc_error();
+        return 0;
     }
 }
 
-void OpenMM_Thread_Handler::_apply_smoothing(const OpenMM::State& state)
+extern "C" EXPORT void
+openmm_thread_handler_remove_restraint_animation(void *handler, size_t id)
 {
-    const auto& coords = state.getPositions();
-    if (_smoothed_coords.size() == 0) {
-        _smoothed_coords = coords;
-        return;
-    }
-    for (size_t i=0; i<_natoms; ++i)
-    {
-        auto& smoothed = _smoothed_coords[i];
-        const auto& current = coords[i];
-        smoothed = current * _smoothing_alpha + smoothed * (1-_smoothing_alpha);
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->remove_restraint_animation(id);
+    } catch (...) {
+        molc_error();
     }
 }
 
-
-void OpenMM_Thread_Handler::_minimize_threaded(const double &tolerance, int max_iterations)
+extern "C" EXPORT double
+openmm_thread_handler_restraint_animation_progress(void *handler, size_t id)
 {
-    // std::cout << "Starting minimization with tolerance of " << tolerance << " and max iterations per round of " << max_iterations << std::endl;
-    try
-    {
-        // _thread_except = nullptr;
-        auto start = std::chrono::steady_clock::now();
-        _clash = false;
-        _smoothed_coords.clear();
-        // _thread_running = true;
-        // _thread_finished = false;
-        _starting_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Energy);
-        _min_converged = false;
-        double tol = tolerance * _natoms;
-        // std::cout << "Initial energy: " << _starting_state.getPotentialEnergy() << " kJ/mol" << std::endl;
-        auto result = isolde::LocalEnergyMinimizer::minimize(*_context, tol, max_iterations);
-        if (result == isolde::LocalEnergyMinimizer::SUCCESS)
-        {
-            // Minimisation has converged to within the desired tolerance,
-            // and all constraints are satisfied.
-            _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Forces | OpenMM::State::Energy);
-            _min_converged = true;
-            _unstable = false;
-        } else if (result == isolde::LocalEnergyMinimizer::DID_NOT_CONVERGE) {
-            // Minimisation ongoing. Just leave _min_converged = false, but
-            // let ISOLDE have the new coordinates.
-            _final_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Forces | OpenMM::State::Energy);
-        } else // if (result < 0)
-        {
-            // Minimisation failed. Revert the model to its initial state
-            // and let ISOLDE point out problem areas to the user.
-            _clash = true;
-            _final_state = _starting_state;
-        }
-        //if (_min_converged && max_force(_final_state.getForces()) > MAX_FORCE)
-        if (_min_converged && max_force(_context->getSystem(), _final_state) > MAX_FORCE)
-            _clash = true;
-        auto end = std::chrono::steady_clock::now();
-        auto loop_time = end-start;
-        if (loop_time < _min_time_per_loop)
-            std::this_thread::sleep_for(_min_time_per_loop-loop_time);
-        _thread_finished = true;
-        // std::cout << "Finished minimization round" << std::endl;
-    } catch (...)
-    {
-        _thread_except = std::current_exception();
-        _thread_finished = true;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->restraint_animation_progress(id);
+    } catch (...) {
+        molc_error();
+        return 0;
     }
 }
 
-void OpenMM_Thread_Handler::_reinitialize_context_threaded()
+extern "C" EXPORT npy_bool
+openmm_thread_handler_check_by_displacement(void *handler)
 {
-    try
-    {
-        _thread_except = nullptr;
-        // _thread_running = true;
-        // _thread_finished = false;
-        OpenMM::State current_state = _context->getState(OpenMM::State::Positions | OpenMM::State::Velocities);
-        _context->reinitialize();
-        _context->setPositions(current_state.getPositions());
-        _context->setVelocities(current_state.getVelocities());
-        _thread_finished = true;
-    } catch (...)
-    {
-        _thread_except = std::current_exception();
-        _thread_finished = true;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->check_by_displacement();
+    } catch (...) {
+        molc_error();
+        return false;
     }
 }
 
-std::vector<size_t> OpenMM_Thread_Handler::overly_fast_atoms(const std::vector<OpenMM::Vec3>& velocities)
+extern "C" EXPORT void
+set_openmm_thread_handler_check_by_displacement(void *handler, npy_bool flag)
 {
-    std::vector<size_t> fast_indices;
-    size_t i=0;
-    for (const auto &v: velocities) {
-        if (sqrt(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]) > MAX_VELOCITY)
-            fast_indices.push_back(i);
-        i++;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->set_check_by_displacement(flag);
+    } catch (...) {
+        molc_error();
     }
-    return fast_indices;
 }
 
-std::vector<OpenMM::Vec3> OpenMM_Thread_Handler::get_coords_in_angstroms(const OpenMM::State& state)
+extern "C" EXPORT void
+openmm_thread_handler_reinitialize_context_and_keep_state(void *handler)
 {
-    finalize_thread();
-    const auto &coords_nm = state.getPositions();
-    std::vector<OpenMM::Vec3> coords_ang(_natoms);
-    auto from = coords_nm.begin();
-    auto to = coords_ang.begin();
-    for (; from != coords_nm.end(); from++, to++)
-    {
-        *to = *from * 10.0;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->reinitialize_context_and_keep_state();
+    } catch (...) {
+        molc_error();
     }
-    return coords_ang;
 }
 
-std::vector<OpenMM::Vec3> OpenMM_Thread_Handler::get_smoothed_coords_in_angstroms()
+extern "C" EXPORT void
+openmm_thread_handler_reinitialize_context_and_keep_state_threaded(void *handler)
 {
-    finalize_thread();
-    if (!_smoothing) {
-        throw std::logic_error("Last round of equilibration was not run with smoothing enabled!");
-    }
-    std::vector<OpenMM::Vec3> coords_ang(_natoms);
-    auto from = _smoothed_coords.begin();
-    auto to = coords_ang.begin();
-    for (; from != _smoothed_coords.end(); from++, to++)
-    {
-        *to = *from * 10.0;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->reinitialize_context_threaded();
+    } catch (...) {
+        molc_error();
     }
-    return coords_ang;
 }
 
-void OpenMM_Thread_Handler::set_coords_in_angstroms(const std::vector<OpenMM::Vec3>& coords_ang)
+extern "C" EXPORT void
+openmm_thread_handler_start_recording(void *handler, const char *filename,
+    double precision, size_t keyframe_interval, size_t record_interval)
 {
-    finalize_thread();
-    std::vector<OpenMM::Vec3> coords_nm(_natoms);
-    auto from = coords_ang.begin();
-    auto to = coords_nm.begin();
-    for (; from != coords_nm.end(); from++, to++)
-    {
-        for (size_t i=0; i<3; ++i) {
-            (*to)[i] = (*from)[i]/10.0;
-        }
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->start_recording(std::string(filename), precision, keyframe_interval, record_interval);
+    } catch (...) {
+        molc_error();
     }
-    _context->setPositions(coords_nm);
-    _smoothed_coords.clear();
 }
 
-void OpenMM_Thread_Handler::set_coords_in_angstroms(double *coords, size_t n)
+extern "C" EXPORT void
+openmm_thread_handler_stop_recording(void *handler)
 {
-    finalize_thread();
-    if (n != natoms())
-        throw std::logic_error("Number of input atoms does not match number in simulation!");
-    std::vector <OpenMM::Vec3> coords_nm(n);
-    for (auto &v: coords_nm) {
-        for (size_t i=0; i<3; ++i)
-            v[i] = (*coords++)/10.0;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->stop_recording();
+    } catch (...) {
+        molc_error();
     }
-    _context->setPositions(coords_nm);
-    _smoothed_coords.clear();
 }
 
-double OpenMM_Thread_Handler::max_force(const std::vector<OpenMM::Vec3>& forces) const
+extern "C" EXPORT npy_bool
+openmm_thread_handler_recording(void *handler)
 {
-    double max_force = 0;
-
-    for (const auto &fv: forces)
-    {
-        double f_mag = 0;
-        for (size_t i=0; i<3; ++i)
-            f_mag += fv[i]*fv[i];
-        f_mag = sqrt(f_mag);
-        max_force = f_mag>max_force ? f_mag : max_force;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->recording();
+    } catch (...) {
+        molc_error();
+        return false;
     }
-    return max_force;
 }
 
-// get maximum force, ignoring massless (fixed) particles
-double OpenMM_Thread_Handler::max_force(const OpenMM::System& system, const OpenMM::State& state) const
+extern "C" EXPORT void
+openmm_thread_handler_recording_stats(void *handler, size_t *stats)
 {
-    double max_force = 0;
-    auto forces = state.getForces();
-    for (size_t i=0; i<system.getNumParticles(); ++i)
-    {
-        const auto& f = forces[i];
-        double f_mag = 0;
-        for (size_t i=0; i<3; ++i)
-            f_mag += f[i]*f[i];
-        f_mag = sqrt(f_mag);
-        if (f_mag > max_force && system.getParticleMass(i) > 0.0)
-            max_force = f_mag;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        stats[0] = h->recording_frames_written();
+        stats[1] = h->recording_frames_dropped();
+        stats[2] = h->recording_bytes_written();
+    } catch (...) {
+        molc_error();
     }
-    return max_force;
 }
 
-
-void OpenMM_Thread_Handler::set_smoothing_alpha(const double &alpha)
+extern "C" EXPORT size_t
+openmm_thread_handler_stage_timings(void *handler, size_t n_pct, double *percentiles,
+    double *out)
 {
-    if (alpha < SMOOTHING_ALPHA_MIN)
-        _smoothing_alpha = SMOOTHING_ALPHA_MIN;
-    else if (alpha > SMOOTHING_ALPHA_MAX)
-        _smoothing_alpha = SMOOTHING_ALPHA_MAX;
-    else
-        _smoothing_alpha = alpha;
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        return h->stage_timings().summarize(n_pct, percentiles, out);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
 }
 
-// PYTHON INTERFACE BELOW
+extern "C" EXPORT void
+openmm_thread_handler_clear_stage_timings(void *handler)
+{
+    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    try {
+        h->stage_timings().clear();
+    } catch (...) {
+        molc_error();
+    }
+}
 
-SET_PYTHON_INSTANCE(openmm_thread_handler, OpenMM_Thread_Handler)
-GET_PYTHON_INSTANCES(openmm_thread_handler, OpenMM_Thread_Handler)
+/*
+ * Trajectory_Reader
+ */
 
 extern "C" EXPORT void*
-openmm_thread_handler_new(void *context)
+trajectory_reader_new(const char *filename)
 {
-    OpenMM::Context *c = static_cast<OpenMM::Context *>(context);
     try {
-        OpenMM_Thread_Handler *h = new OpenMM_Thread_Handler(c);
-        return h;
+        return new Trajectory_Reader(std::string(filename));
     } catch (...) {
         molc_error();
-        return 0;
+        return nullptr;
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_delete(void *handler)
+trajectory_reader_delete(void *reader)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        delete h;
+        delete r;
     } catch (...) {
         molc_error();
     }
 }
 
 extern "C" EXPORT size_t
-openmm_thread_handler_num_atoms(void *handler)
+trajectory_reader_n_atoms(void *reader)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        return h->natoms();
+        return r->n_atoms();
     } catch (...) {
         molc_error();
         return 0;
     }
 }
 
-extern "C" EXPORT double
-openmm_thread_handler_smoothing_alpha(void *handler)
+extern "C" EXPORT size_t
+trajectory_reader_n_frames(void *reader)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        return h->smoothing_alpha();
+        return r->n_frames();
     } catch (...) {
         molc_error();
-        return -1;
+        return 0;
     }
 }
 
-extern "C" EXPORT void
-set_openmm_thread_handler_smoothing_alpha(void *handler, double alpha)
+extern "C" EXPORT double
+trajectory_reader_precision(void *reader)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        h->set_smoothing_alpha(alpha);
+        return r->precision();
     } catch (...) {
         molc_error();
+        return 0;
     }
 }
 
-
-
 extern "C" EXPORT void
-openmm_thread_handler_step(void *handler, size_t steps, npy_bool smooth)
+trajectory_reader_times(void *reader, double *times)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        h->step_threaded(steps, smooth);
+        for (size_t i=0; i<r->n_frames(); ++i)
+            times[i] = r->time(i);
     } catch (...) {
         molc_error();
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_minimize(void *handler, double tolerance, int max_iterations)
+trajectory_reader_read(void *reader, size_t frame, double *coords)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Trajectory_Reader *r = static_cast<Trajectory_Reader *>(reader);
     try {
-        h->minimize_threaded(tolerance, max_iterations);
+        r->read(frame, coords);
     } catch (...) {
         molc_error();
     }
 }
 
+/*
+ * Sim_Scheduler
+ */
 
-extern "C" EXPORT npy_bool
-openmm_thread_handler_thread_finished(void *handler)
+extern "C" EXPORT void*
+sim_scheduler_new(size_t n_devices, size_t steps_per_chunk)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
     try {
-        return h->thread_finished();
+        return new Sim_Scheduler(n_devices, steps_per_chunk);
     } catch (...) {
         molc_error();
-        return false;
+        return nullptr;
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_finalize_thread(void *handler)
+sim_scheduler_delete(void *scheduler)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        h->finalize_thread();
+        delete s;
     } catch (...) {
         molc_error();
     }
 }
 
-extern "C" EXPORT npy_bool
-openmm_thread_handler_unstable(void *handler)
+extern "C" EXPORT size_t
+sim_scheduler_n_devices(void *scheduler)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        return h->unstable();
-    } catch(...) {
+        return s->n_devices();
+    } catch (...) {
         molc_error();
-        return false;
+        return 0;
     }
 }
 
-extern "C" EXPORT npy_bool
-openmm_thread_handler_converged(void *handler)
+extern "C" EXPORT size_t
+sim_scheduler_steps_per_chunk(void *scheduler)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        return h->converged();
-    } catch(...) {
+        return s->steps_per_chunk();
+    } catch (...) {
         molc_error();
-        return false;
+        return 0;
     }
 }
 
-
-extern "C" EXPORT npy_bool
-openmm_thread_handler_clashing(void *handler)
+extern "C" EXPORT void
+set_sim_scheduler_steps_per_chunk(void *scheduler, size_t n)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        return h->clash_detected();
-    } catch(...) {
+        s->set_steps_per_chunk(n);
+    } catch (...) {
         molc_error();
-        return false;
     }
 }
 
-extern "C" EXPORT void
-openmm_thread_handler_unstable_atoms(void *handler, size_t n, npy_bool *unstable)
+extern "C" EXPORT int
+sim_scheduler_least_loaded_device(void *scheduler)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        auto fast_indices = h->overly_fast_atoms(h->final_state().getVelocities());
-        for (auto i: fast_indices)
-            unstable[i] = true;
+        return s->least_loaded_device();
     } catch (...) {
         molc_error();
+        return 0;
     }
 }
 
-extern "C" EXPORT void
-openmm_thread_handler_last_coords(void *handler, size_t n, double *coords)
+extern "C" EXPORT size_t
+sim_scheduler_add_job(void *scheduler, void *handler, int device, double weight)
 {
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
     try {
-        auto sim_coords = h->get_coords_in_angstroms(h->initial_state());
-        if (n != h->natoms())
-            throw std::logic_error("Mismatch between number of atoms and output array size!");
-        for (const auto &coord: sim_coords) {
-            for (size_t i=0; i<3; ++i)
-                *coords++ = coord[i];
-        }
+        return s->add_job(h, device, weight);
     } catch (...) {
         molc_error();
+        return 0;
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_current_coords(void *handler, size_t n, double *coords)
+sim_scheduler_remove_job(void *scheduler, size_t id)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        auto sim_coords = h->get_coords_in_angstroms(h->final_state());
-        if (n != h->natoms())
-            throw std::logic_error("Mismatch between number of atoms and output array size!");
-        for (const auto &coord: sim_coords) {
-            for (size_t i=0; i<3; ++i)
-                *coords++ = coord[i];
-        }
+        s->remove_job(id);
     } catch (...) {
         molc_error();
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_smoothed_coords(void *handler, size_t n, double *coords)
+sim_scheduler_pause_job(void *scheduler, size_t id)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        if (n != h->natoms())
-            throw std::logic_error("Mismatch between number of atoms and output array size!");
-        auto sim_coords = h->get_smoothed_coords_in_angstroms();
-        for (const auto &coord: sim_coords) {
-            for (size_t i=0; i<3; ++i)
-                *coords++ = coord[i];
-        }
+        s->pause_job(id);
     } catch (...) {
         molc_error();
     }
-
 }
 
 extern "C" EXPORT void
-set_openmm_thread_handler_current_coords(void *handler, size_t n, double *coords)
+sim_scheduler_resume_job(void *scheduler, size_t id)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        h->set_coords_in_angstroms(coords, n);
+        s->resume_job(id);
     } catch (...) {
         molc_error();
     }
 }
 
-
-extern "C" EXPORT double
-openmm_thread_handler_min_thread_period(void *handler)
+extern "C" EXPORT void
+sim_scheduler_set_job_weight(void *scheduler, size_t id, double weight)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        return h->get_minimum_thread_time_in_ms();
+        s->set_job_weight(id, weight);
     } catch (...) {
         molc_error();
-        return 0;
     }
 }
 
-extern "C" EXPORT void
-set_openmm_thread_handler_min_thread_period(void *handler, double time_ms)
+/*! Fills counts with (steps, chunks, device) and times with
+ *  (busy_seconds, wall_seconds, weight), and returns flags: bit 0 = running,
+ *  bit 1 = stalled.
+ */
+extern "C" EXPORT int
+sim_scheduler_job_stats(void *scheduler, size_t id, size_t *counts, double *times)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        h->set_minimum_thread_time_in_ms(time_ms);
+        auto st = s->job_stats(id);
+        counts[0] = st.steps;
+        counts[1] = st.chunks;
+        counts[2] = st.device;
+        times[0] = st.busy_seconds;
+        times[1] = st.wall_seconds;
+        times[2] = st.weight;
+        return (st.running ? 1 : 0) | (st.stalled ? 2 : 0);
     } catch (...) {
         molc_error();
+        return 0;
     }
 }
 
-extern "C" EXPORT void
-openmm_thread_handler_reinitialize_context_and_keep_state(void *handler)
+extern "C" EXPORT size_t
+sim_scheduler_n_jobs(void *scheduler)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        h->reinitialize_context_and_keep_state();
+        return s->job_ids().size();
     } catch (...) {
         molc_error();
+        return 0;
     }
 }
 
 extern "C" EXPORT void
-openmm_thread_handler_reinitialize_context_and_keep_state_threaded(void *handler)
+sim_scheduler_job_ids(void *scheduler, size_t *ids)
 {
-    OpenMM_Thread_Handler *h = static_cast<OpenMM_Thread_Handler *>(handler);
+    Sim_Scheduler *s = static_cast<Sim_Scheduler *>(scheduler);
     try {
-        h->reinitialize_context_threaded();
+        auto v = s->job_ids();
+        std::copy(v.begin(), v.end(), ids);
     } catch (...) {
         molc_error();
     }
 }
 
-
 // extern "C" EXPORT void
 // openmm_thread_handler_initial_positions(void *handler, size_t n, double *coords)
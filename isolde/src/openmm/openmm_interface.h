@@ -14,22 +14,99 @@
 #define ISOLDE_OPENMM
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
 #include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
+#include <memory>
 #include <stdexcept>
 #include <OpenMM.h>
 #include <pyinstance/PythonInstance.declare.h>
+#include <atomstruct/Atom.h>
+
+#include "triple_buffer.h"
+#include "haptic_link.h"
+#include "trajectory_recorder.h"
+#include "stage_timings.h"
+#include "adaptive_pacer.h"
+#include "custom_forces.h"
+#include "minimize.h"
+#include "restraint_animator.h"
+#include "clash_prescreen.h"
+#include "grid_bias.h"
 
 namespace isolde
 {
 
+/*! One region of a batch refinement: which particles are mobile, and how
+ *  hard to work on them. See OpenMM_Thread_Handler::refine_region_threaded().
+ */
+struct Region_Refinement
+{
+    uint64_t id = 0;
+    std::vector<int> mobile; // sorted indices of the particles free to move
+    // Settling: a short, loose minimisation to pull apart the worst clashes
+    double settle_tolerance = 0; // kJ/mol/atom
+    int settle_iterations = 0;
+    // Minimisation to convergence, in rounds of max_iterations
+    double tolerance = 0; // kJ/mol/atom
+    int max_iterations = 0;
+    size_t max_rounds = 1;
+    // Equilibration from fresh velocities
+    size_t steps = 0;
+    double temperature = 0; // Kelvin
+    int seed = 0;
+};
+
+//! Outcome of one Region_Refinement
+struct Region_Result
+{
+    uint64_t id = 0;
+    double start_energy = 0; // kJ/mol
+    double minimized_energy = 0;
+    double final_energy = 0;
+    bool converged = false;
+    bool clash = false;
+    bool unstable = false;
+    std::vector<double> coords; // Angstroms, for each mobile particle in index order
+};
+
+//! A single unit of work for the simulation worker thread
+struct Thread_Command
+{
+    // APPLY_UPDATES only applies flushed force and tugging updates, which
+    // every command does before anything else
+    enum Type {STEP, STEP_CONTINUOUS, MINIMIZE, REINITIALIZE, SET_COORDS, REFINE_REGION,
+        APPLY_UPDATES};
+    Type type;
+    size_t steps = 0;
+    bool smooth = false;
+    double tolerance = 0;
+    int max_iterations = 0;
+    std::vector<OpenMM::Vec3> coords; // nm
+    std::vector<size_t> region; // MINIMIZE only: if not empty, minimise around these atoms
+    double radius = 0; // nm
+    Region_Refinement refinement; // REFINE_REGION only
+    Thread_Command(Type t): type(t) {}
+};
+
+/*! Owns a single long-lived worker thread per simulation context, which
+ *  consumes a queue of commands (step, minimize, reinitialize, set coords).
+ *  All status flags shared between the worker and the calling thread are
+ *  atomic.
+ */
 class OpenMM_Thread_Handler: public pyinstance::PythonInstance<OpenMM_Thread_Handler>
 {
 public:
     typedef std::chrono::duration<double, std::ratio<1,1000>> milliseconds;
     OpenMM_Thread_Handler() {}
-    ~OpenMM_Thread_Handler() { if (_thread_running) _thread.join(); }
+    ~OpenMM_Thread_Handler();
     /*! Rather annoyingly, we have to set the temperature explicitly here
      *  since the Integrator base class doesn't provide a virtual
      *  getTemperature() method
@@ -39,8 +116,9 @@ public:
 
     OpenMM::Integrator& integrator() { return _context->getIntegrator();}
 
-    /*! Runs the desired number of steps in a separate CPU thread, checking every
-     *  ten steps to make sure that velocities remain under control. If excessive
+    /*! Queues the desired number of steps on the worker thread, periodically
+     *  checking to make sure that velocities remain under control (see
+     *  set_instability_check_intervals()). If excessive
      *  atomic velocities are detected, the thread will stop at that point and
      *  set unstable() to true. The initial and final states (containing coordinates
      *  and velocities) are accessible via initial_state() and final_state()
@@ -50,79 +128,459 @@ public:
      */
     void step_threaded(size_t steps, bool average)
     {
-        //_thread_safety_check();
-        finalize_thread();
-        if (_unstable)
-            throw std::logic_error("The last round had atoms moving dangerously fast. Fix the issues and minimise first.");
-        if (_clash)
-            throw std::logic_error("You still have clashing atoms! Fix these and minimise first.");
-          _thread_finished=false;
-          _thread_running=true;
-          _thread_except = nullptr;
-        _thread = std::thread(&OpenMM_Thread_Handler::_step_threaded, this, steps, average);
+        Thread_Command cmd(Thread_Command::STEP);
+        cmd.steps = steps;
+        cmd.smooth = average;
+        _enqueue(std::move(cmd));
+    }
+
+    /*! Runs the simulation continuously on the worker thread until
+     *  finalize_thread() is called, another command is queued, or instability
+     *  is detected, publishing the coordinates (smoothed if requested) every
+     *  steps_per_publish steps. The most recent published coordinates may be
+     *  retrieved at any time without blocking using
+     *  latest_coords_in_angstroms().
+     */
+    void step_continuous_threaded(size_t steps_per_publish, bool smooth)
+    {
+        if (steps_per_publish == 0)
+            throw std::invalid_argument("Number of steps per coordinate update must be at least 1!");
+        Thread_Command cmd(Thread_Command::STEP_CONTINUOUS);
+        cmd.steps = steps_per_publish;
+        cmd.smooth = smooth;
+        _enqueue(std::move(cmd));
     }
 
     void set_minimum_thread_time_in_ms(double time)
     {
-        _min_time_per_loop = milliseconds(time);
+        _min_time_per_loop_ms = time;
     }
 
     double get_minimum_thread_time_in_ms() const
     {
-        return _min_time_per_loop.count();
+        return _min_time_per_loop_ms;
+    }
+
+    /*! In adaptive pacing mode, continuous runs ignore steps_per_publish and
+     *  the minimum thread time, and let an Adaptive_Pacer size each chunk of
+     *  steps from the measured step time and the rate at which
+     *  latest_coords_in_angstroms() is polled. Takes effect from the next
+     *  call to step_continuous_threaded().
+     */
+    void set_adaptive_pacing(bool flag) { _adaptive_pacing = flag; }
+    bool adaptive_pacing() const { return _adaptive_pacing; }
+    Adaptive_Pacer& pacer() { return _pacer; }
+    const Adaptive_Pacer& pacer() const { return _pacer; }
+
+    /*! The interval (in steps) between instability checks starts at min_steps
+     *  and doubles after every run of STABLE_CHECKS_BEFORE_BACKOFF
+     *  consecutive stable checks, up to max_steps. It drops back to min_steps
+     *  whenever instability is detected, the coordinates or context are
+     *  changed, or tighten_instability_checks() is called.
+     */
+    void set_instability_check_intervals(size_t min_steps, size_t max_steps)
+    {
+        if (min_steps == 0 || max_steps < min_steps)
+            throw std::invalid_argument("Instability check intervals must satisfy 0 < min <= max!");
+        _min_check_interval = min_steps;
+        _max_check_interval = max_steps;
+        _tighten_checks = true;
     }
+    size_t min_instability_check_interval() const { return _min_check_interval; }
+    size_t max_instability_check_interval() const { return _max_check_interval; }
+
+    //! Call after any sudden change (e.g. a new tug or rotamer restraint).
+    void tighten_instability_checks() { _tighten_checks = true; }
+
+    /*! If true, each instability check downloads only the positions (which
+     *  are needed for display anyway), and flags atoms whose displacement
+     *  since the last check implies an average speed above MAX_VELOCITY.
+     *  This halves the device-to-host traffic per check.
+     */
+    void set_check_by_displacement(bool flag) { _check_by_displacement = flag; }
+    bool check_by_displacement() const { return _check_by_displacement; }
+
+    //! Indices of the atoms found moving too fast at the last instability check
+    const std::vector<size_t>& last_fast_atoms() const { _thread_finished_check(); return _fast_atoms; }
 
     void reinitialize_context_threaded()
     {
-        //_thread_safety_check();
-        finalize_thread();
-        _thread_running = true;
-        _thread_finished = false;
-        _thread = std::thread(&OpenMM_Thread_Handler::_reinitialize_context_threaded, this);
+        _enqueue(Thread_Command(Thread_Command::REINITIALIZE));
     }
 
     void reinitialize_context_and_keep_state()
     {
         finalize_thread();
-        OpenMM::State current_state = _context->getState(OpenMM::State::Positions + OpenMM::State::Velocities);
-        _context->reinitialize();
-        _context->setPositions(current_state.getPositions());
-        _context->setVelocities(current_state.getVelocities());
+        _reinitialize_context_threaded();
+        _update_mobile_mask();
     }
 
 
+    /*! Stage new per-term parameters for a custom force in the context.
+     *  Nothing is sent to the force or context until flush_force_updates()
+     *  is called, so any number of changes to the same force may be
+     *  accumulated for each frame. Call from the GUI thread only.
+     */
+    void stage_force_parameters(OpenMM::Force *force, custom_forces::Force_Type type,
+        size_t n, const int *indices, const double *params);
+
+    /*! Hand all staged parameter changes to the worker, which applies them
+     *  (with a single updateParametersInContext() call per changed force)
+     *  before its next chunk of steps - without interrupting a continuous
+     *  run. If the worker is idle they are applied immediately.
+     */
+    void flush_force_updates();
+
+    /*! Drop any staged or flushed-but-unapplied changes for a force that is
+     *  about to be removed from the System. Call only while the worker is
+     *  idle.
+     */
+    void discard_force_updates(OpenMM::Force *force);
+
+    /*! Also publish the force applied by each term of an
+     *  AdaptiveDistanceRestraintForce, evaluated on the worker thread from
+     *  the published coordinates (OpenMM has no per-term output). The
+     *  parameters of each term are cached here, and kept current as staged
+     *  updates are applied. Pass nullptr to stop. Call only while the
+     *  worker is idle, and again after reinitialising the context if terms
+     *  have been added.
+     */
+    void monitor_adaptive_distance_force(OpenMM::CustomBondForce *force);
+    size_t num_monitored_bonds() const { return _monitored_pairs.size()/2; }
+
+    /*! Non-blocking. If new bond forces (kJ/mol/nm, positive when pulling
+     *  the atoms together) have been published since the last call, copies
+     *  num_monitored_bonds() of them into out and returns true.
+     */
+    bool latest_bond_forces(double *out);
+
+    /*! Drive one term of the tugging force (a TopOutRestraintForce: a
+     *  CustomExternalForce with per-particle parameters enabled, k, x0, y0,
+     *  z0) from a haptic device thread. Before each chunk of integration the
+     *  worker applies the newest target on the link, and afterwards pushes
+     *  back the atom's position, so the device feels the simulation at the
+     *  simulation's own rate rather than the GUI frame rate. The link must
+     *  outlive its attachment. Call only while the worker is idle.
+     */
+    void attach_haptic_link(Haptic_Link *link, OpenMM::CustomExternalForce *force, int entry);
+    //! Releases the atom if it is being tugged. Call only while the worker is idle.
+    void detach_haptic_link(Haptic_Link *link);
+
+    /*! Interactive tugging channel. Sends new parameters (enabled, k in
+     *  kJ mol-1 nm-2, x0, y0, z0 in nm) for terms of the tugging force
+     *  straight to the worker, which applies them before its next chunk of
+     *  steps - without waiting for the next flush_force_updates() or
+     *  interrupting a continuous run. If the worker is idle they are applied
+     *  immediately. Updates are applied in the order they are sent. Call
+     *  from the GUI thread only.
+     */
+    void push_tug_targets(OpenMM::CustomExternalForce *force, size_t n,
+        const int *entries, const double *params);
+
+    /*! Schedule a change to the parameters of some terms of a restraint
+     *  force (see Restraint_Animation), run by the worker between chunks of
+     *  integration so that the targets move at the simulation's own rate.
+     *  While an animation is running its parameters override any staged
+     *  updates to the same terms. Finished animations leave their last
+     *  keyframe in place, and stay until removed. Returns an ID for the
+     *  animation. Call only while the worker is idle.
+     */
+    size_t add_restraint_animation(OpenMM::Force *force, custom_forces::Force_Type type,
+        size_t n_terms, const int *indices, size_t n_keyframes, const double *keyframes,
+        const uint8_t *stepped, size_t steps_per_keyframe);
+    //! Call only while the worker is idle. Unknown IDs are ignored.
+    void remove_restraint_animation(size_t id);
+    //! Fraction of the animation completed. Safe to call while the worker is busy.
+    double restraint_animation_progress(size_t id) const;
+
+    /*! Write every record_interval'th set of published coordinates to an
+     *  .itrj trajectory file (see Trajectory_Recorder), replacing any
+     *  recording already under way. Encoding and writing happen on a
+     *  separate thread; if it falls behind, frames are dropped (see
+     *  recording_frames_dropped()) rather than slowing the simulation.
+     *  Call only while the worker is idle.
+     */
+    void start_recording(const std::string& filename, double precision,
+        size_t keyframe_interval, size_t record_interval);
+    //! Finish writing queued frames and close the file. Call only while the worker is idle.
+    void stop_recording();
+    bool recording() const { return _recorder != nullptr; }
+    size_t recording_frames_written() const { return _recorder ? _recorder->frames_written() : 0; }
+    size_t recording_frames_dropped() const { return _recorder ? _recorder->frames_dropped() : 0; }
+    size_t recording_bytes_written() const { return _recorder ? _recorder->bytes_written() : 0; }
+
+    //! Where the time goes in each simulation frame. Safe to query from any thread.
+    const Stage_Timings& stage_timings() const { return _timings; }
+    Stage_Timings& stage_timings() { return _timings; }
+
+    /*! Queues a round of energy minimisation. Every
+     *  minimization_progress_interval() iterations the current coordinates
+     *  are published (see latest_coords_in_angstroms()), so a long
+     *  minimisation can be watched as it happens.
+     */
     void minimize_threaded(const double &tolerance, int max_iterations)
     {
-        //_thread_safety_check();
-        finalize_thread();
-        _thread_except = nullptr;
-        _thread_running = true;
-        _thread_finished = false;
-        _thread = std::thread(&OpenMM_Thread_Handler::_minimize_threaded, this, tolerance, max_iterations);
+        _cancel_minimization = false;
+        Thread_Command cmd(Thread_Command::MINIMIZE);
+        cmd.tolerance = tolerance;
+        cmd.max_iterations = max_iterations;
+        _enqueue(std::move(cmd));
+    }
+
+    /*! Queues a round of minimisation of just part of the model: the given
+     *  atoms plus every atom within radius (nm) of any of them. Everything
+     *  else is held fixed. Convergence, clash and progress reporting work as
+     *  for minimize_threaded(), but only consider the mobile atoms.
+     */
+    void minimize_region_threaded(const std::vector<size_t>& atoms, double radius,
+        const double &tolerance, int max_iterations)
+    {
+        for (auto i: atoms)
+            if (i >= _natoms)
+                throw std::out_of_range("Atom index out of range!");
+        _cancel_minimization = false;
+        Thread_Command cmd(Thread_Command::MINIMIZE);
+        cmd.tolerance = tolerance;
+        cmd.max_iterations = max_iterations;
+        cmd.region = atoms;
+        cmd.radius = radius;
+        _enqueue(std::move(cmd));
+    }
+
+    /*! Queues the settle, minimise and equilibrate sequence for one region
+     *  of a batch refinement. Only the job's mobile particles move: they
+     *  alone are minimised, and while equilibrating everything else is held
+     *  in place by the region hold force (see set_region_hold_force()) and
+     *  put back exactly afterwards, so changing regions never needs the
+     *  context reinitialised. If minimisation leaves a clash the
+     *  equilibration is skipped, and if equilibration goes unstable the
+     *  minimised coordinates are restored, so the next region always starts
+     *  from something sane. Results queue up for pop_region_result().
+     */
+    void refine_region_threaded(Region_Refinement&& job)
+    {
+        for (auto p: job.mobile)
+            if (p < 0 || (size_t)p >= _natoms)
+                throw std::out_of_range("Particle index out of range!");
+        if (job.max_rounds == 0)
+            throw std::invalid_argument("Need at least one round of minimisation!");
+        if (job.steps > 0 && _region_hold_force == nullptr)
+            throw std::logic_error("Equilibrating a region needs a region hold force!");
+        _cancel_minimization = false;
+        Thread_Command cmd(Thread_Command::REFINE_REGION);
+        cmd.refinement = std::move(job);
+        _enqueue(std::move(cmd));
+    }
+
+    size_t num_region_results() const
+    {
+        std::lock_guard<std::mutex> lock(_region_mutex);
+        return _region_results.size();
     }
 
+    //! Takes the oldest finished region result. Returns false if there is none.
+    bool pop_region_result(Region_Result& result)
+    {
+        std::lock_guard<std::mutex> lock(_region_mutex);
+        if (_region_results.empty())
+            return false;
+        result = std::move(_region_results.front());
+        _region_results.pop_front();
+        return true;
+    }
+
+    /*! Ask the current minimisation to finish early. It stops at the next
+     *  progress report at which no atom is experiencing a force above the
+     *  clash threshold, so the coordinates it leaves behind are always safe
+     *  to simulate from. The result then counts as converged.
+     */
+    void cancel_minimization() { _cancel_minimization = true; }
+
+    /*! Give the clash pre-screen (see Clash_Prescreen) the heavy-atom flags
+     *  (one per particle) and bonds it needs. Once set, each round of
+     *  minimisation first pushes apart any severe heavy-atom overlaps among
+     *  the atoms it is about to minimise. Call only while the worker is idle.
+     */
+    void set_clash_prescreen_topology(const uint8_t *heavy, size_t n, const int32_t *bonds, size_t n_bonds)
+    {
+        if (n != _natoms)
+            throw std::logic_error("Need one heavy atom flag per particle!");
+        if (_busy)
+            throw std::logic_error("Cannot change the clash pre-screen while the simulation thread is running!");
+        _prescreen = Clash_Prescreen(heavy, n, bonds, n_bonds);
+    }
+    void set_clash_prescreen_enabled(bool flag) { _prescreen_enabled = flag; }
+    bool clash_prescreen_enabled() const { return _prescreen_enabled; }
+    //! Heavy atoms closer than this (nm) count as a severe overlap
+    void set_clash_prescreen_distance(double d) { _prescreen_distance = d; }
+    double clash_prescreen_distance() const { return _prescreen_distance; }
+    //! Outcome of the pre-screen at the start of the last round of minimisation
+    const Clash_Prescreen::Stats& last_clash_prescreen() const { _thread_finished_check(); return _prescreen_stats; }
+
+    /*! Conformational bias from log-probability grids (see Grid_Bias). The
+     *  worker evaluates the grids on the CPU and hands the resulting forces
+     *  to force, a CustomExternalForce with per-particle parameters e, fx,
+     *  fy, fz, x0, y0, z0 and one entry per particle, in particle order. Its
+     *  energy is the first-order expansion of the bias about the positions
+     *  it was last evaluated at, refreshed at least every
+     *  grid_bias_interval() steps during dynamics. The bias is switched off
+     *  during minimisation. Call only while the worker is idle.
+     */
+    void set_grid_bias_force(OpenMM::CustomExternalForce *force);
+
+    /*! The RegionHoldForce through which refine_region_threaded() holds the
+     *  particles outside each region while it equilibrates. Needs one entry
+     *  per particle, all parameters zero. Call only while the worker is idle.
+     */
+    void set_region_hold_force(OpenMM::CustomExternalForce *force);
+    //! Returns the index of the grid for add_grid_bias_terms(). Call only while the worker is idle.
+    size_t add_grid_bias_grid(const Grid_Bias::Grid& grid, const double *periods)
+    {
+        _thread_finished_check();
+        return _grid_bias.add_grid(grid, periods);
+    }
+    //! See Grid_Bias::add_terms(). Call only while the worker is idle.
+    void add_grid_bias_terms(size_t grid, size_t n, const int *particles, const double *k);
+    //! Removes all grids and terms. Call only while the worker is idle.
+    void clear_grid_bias();
+    size_t num_grid_bias_terms() const { return _grid_bias.num_terms(); }
+    //! Multiplies the strength of every term. Takes effect at the next update.
+    void set_grid_bias_scale(double s) { _grid_bias_scale = s; }
+    double grid_bias_scale() const { return _grid_bias_scale; }
+    //! Maximum number of steps between re-evaluations of the bias
+    void set_grid_bias_interval(size_t steps) { _grid_bias_interval = std::max<size_t>(steps, 1); }
+    size_t grid_bias_interval() const { return _grid_bias_interval; }
+    //! Bias energy (kJ/mol) at its last evaluation
+    double last_grid_bias_energy() const { _thread_finished_check(); return _grid_bias_energy; }
+
+    //! Zero disables progress reports (and hence cancellation)
+    void set_minimization_progress_interval(size_t iterations) { _min_progress_interval = iterations; }
+    size_t minimization_progress_interval() const { return _min_progress_interval; }
+
+    //! Potential energy (kJ/mol) at the most recent minimisation progress report
+    double minimization_energy() const { return _min_energy; }
+
+    /*! Precision of the L-BFGS arithmetic (see LocalEnergyMinimizer::Precision).
+     *  Takes effect from the next round of minimisation.
+     */
+    void set_minimizer_precision(int precision) { _min_precision = precision; }
+    int minimizer_precision() const { return _min_precision; }
+
     std::vector<size_t> overly_fast_atoms(const std::vector<OpenMM::Vec3>& velocities);
 
-    std::vector<OpenMM::Vec3> get_coords_in_angstroms(const OpenMM::State& state);
-    std::vector<OpenMM::Vec3> get_smoothed_coords_in_angstroms();
+    enum Coord_Source {INITIAL_COORDS=0, FINAL_COORDS=1, SMOOTHED_COORDS=2};
+
+    /*! Write the chosen set of coordinates directly into out, scaled from nm
+     *  to Angstroms. If indices is not null, only the n atoms it lists are
+     *  written (in the given order); otherwise n must equal natoms(). T may
+     *  be float for display-only updates. Waits for the worker to finish.
+     */
+    template <typename T>
+    void export_coords_in_angstroms(Coord_Source source, T* out, size_t n, const size_t* indices=nullptr)
+    {
+        finalize_thread();
+        switch (source)
+        {
+            case INITIAL_COORDS:
+                _scale_to_angstroms(_starting_state.getPositions(), out, n, indices);
+                return;
+            case FINAL_COORDS:
+                _scale_to_angstroms(_final_state.getPositions(), out, n, indices);
+                return;
+            case SMOOTHED_COORDS:
+                if (!_smoothing)
+                    throw std::logic_error("Last round of equilibration was not run with smoothing enabled!");
+                _scale_to_angstroms(_smoothed_coords, out, n, indices);
+                return;
+        }
+        throw std::invalid_argument("Unrecognised coordinate source!");
+    }
+    //! Queued: the new coordinates are applied once prior commands complete.
     void set_coords_in_angstroms(const std::vector<OpenMM::Vec3>& coords_ang);
     void set_coords_in_angstroms(double *coords, size_t n);
-    void finalize_thread()
+
+    /*! Non-blocking. If the simulation thread has published new coordinates
+     *  since the last call, copies them (in Angstroms) into coords and
+     *  returns true. Otherwise leaves coords untouched and returns false.
+     *  Indices behave as for export_coords_in_angstroms().
+     */
+    template <typename T>
+    bool latest_coords_in_angstroms(T *coords, size_t n, const size_t* indices=nullptr)
+    {
+        if (indices == nullptr && n != natoms())
+            throw std::logic_error("Mismatch between number of atoms and output array size!");
+        _pacer.record_poll();
+        if (!_published_coords.update())
+            return false;
+        const double *from = _published_coords.front();
+        if (indices == nullptr) {
+            for (size_t i=0; i<n*3; ++i)
+                *coords++ = static_cast<T>(*from++);
+            return true;
+        }
+        for (size_t i=0; i<n; ++i)
+        {
+            size_t idx = indices[i];
+            if (idx >= _natoms)
+                throw std::out_of_range("Atom index out of range!");
+            const double *c = from + idx*3;
+            for (size_t j=0; j<3; ++j)
+                *coords++ = static_cast<T>(c[j]);
+        }
+        return true;
+    }
+    /*! Non-blocking. As latest_coords_in_angstroms(), but writes the
+     *  coordinates directly into the given atoms (atoms[i] receives the
+     *  coordinates of simulation atom indices[i], or of atom i if indices
+     *  is null). Per-atom change tracking is skipped: for each structure
+     *  touched, a single "coord changed" reason (against its first atom)
+     *  and a coordset change are recorded instead. Handlers that only look
+     *  at atom_reasons() see the usual notification, but modified_atoms()
+     *  will not list every atom that moved.
+     */
+    bool latest_coords_to_atoms(atomstruct::Atom** atoms, size_t n, const size_t* indices=nullptr);
+    uint64_t coords_generation() const { return _published_coords.generation(); }
+
+    //! An immutable copy of one published frame (Angstroms)
+    struct Coord_Snapshot
+    {
+        uint64_t generation;
+        std::vector<double> coords;
+    };
+    /*! If on, each published frame is also kept as a Coord_Snapshot, which
+     *  any number of readers may hold on to (e.g. to run validation in the
+     *  background) without contending with latest_coords_in_angstroms().
+     */
+    void set_publish_snapshots(bool flag) { _publish_snapshots = flag; }
+    bool publish_snapshots() const { return _publish_snapshots; }
+    //! Most recent snapshot, or null if none has been published
+    std::shared_ptr<const Coord_Snapshot> coord_snapshot() const
     {
-        _thread_error_check();
-        if (_thread_running)
-            _thread.join();
-        _thread_running = false;
+        std::lock_guard<std::mutex> lock(_snapshot_mutex);
+        return _snapshot;
     }
 
+    /*! Interrupts any continuous run, waits for the worker to finish all
+     *  queued commands, and rethrows any exception raised on the worker.
+     */
+    void finalize_thread();
+
     double max_force(const std::vector<OpenMM::Vec3>& forces) const;
     double max_force(const OpenMM::System& system, const OpenMM::State& state) const;
 
+    /*! Finds up to max_n mobile atoms experiencing forces greater than
+     *  min_force (kJ/mol/nm) at the current coordinates, and writes their
+     *  indices and force magnitudes to the output arrays in decreasing
+     *  order of force. Returns the number found. Waits for any running
+     *  command to finish first.
+     */
+    size_t top_forces(double min_force, size_t max_n, size_t *indices, double *magnitudes);
+
     const OpenMM::State& initial_state() const { _thread_finished_check(); return _starting_state; }
     const OpenMM::State& final_state() const { _thread_finished_check(); return _final_state; }
 
-    bool thread_finished() const { return _thread_finished; }
-    bool thread_running() const { return _thread_running; }
+    bool thread_finished() const { return !_busy; }
+    bool thread_running() const { return _busy; }
     bool unstable() const { return _unstable; }
     bool converged() const { return _min_converged; }
     size_t natoms() const { return _natoms; }
@@ -136,51 +594,240 @@ private:
     OpenMM::State _starting_state;
     OpenMM::State _final_state;
     std::vector<OpenMM::Vec3> _smoothed_coords;
+    // Coordinates (in Angstroms) handed off to the GUI thread without locking
+    Triple_Buffer<double> _published_coords;
+    std::atomic<bool> _publish_snapshots{false};
+    mutable std::mutex _snapshot_mutex;
+    std::shared_ptr<const Coord_Snapshot> _snapshot;
+    //! Publish the contents of _published_coords.back(), and a snapshot if wanted
+    void _publish_frame();
 
-    std::thread _thread;
+    // Worker thread and command queue
+    std::thread _worker;
+    std::mutex _queue_mutex;
+    std::condition_variable _queue_cv; // signals new commands or shutdown
+    std::condition_variable _idle_cv;  // signals the queue has drained
+    std::deque<Thread_Command> _queue;
+    std::atomic<size_t> _pending{0};
+    std::atomic<bool> _busy{false};
+    std::atomic<bool> _stop_requested{false};
+    bool _shutdown = false;
     std::exception_ptr _thread_except;
+
     size_t _natoms;
-    bool _clash = false;
-    bool _min_converged = false;
-    bool _thread_running = false;
-    bool _thread_finished = false;
-    bool _unstable = false;
+    std::atomic<bool> _clash{false};
+    std::atomic<bool> _min_converged{false};
+    std::atomic<bool> _unstable{false};
+
+    // Minimisation progress
+    std::atomic<bool> _cancel_minimization{false};
+    std::atomic<size_t> _min_progress_interval{10};
+    std::atomic<double> _min_energy{0};
+    std::atomic<int> _min_precision{isolde::LocalEnergyMinimizer::PRECISION_DOUBLE};
 
     // Exponential smoothing
-    bool _smoothing = false;
-    double _smoothing_alpha = 0.5;
+    std::atomic<bool> _smoothing{false};
+    std::atomic<double> _smoothing_alpha{0.5};
     const double SMOOTHING_ALPHA_MAX = 1.0; // no smoothing
     const double SMOOTHING_ALPHA_MIN = 0.01; // extremely strong smoothing
 
-    milliseconds _min_time_per_loop = milliseconds(1.0); // ms: limit on the speed of the simulation
+    std::atomic<double> _min_time_per_loop_ms{1.0}; // limit on the speed of the simulation
     const double MAX_VELOCITY = 50; //nm ps-1 (50,000 m/s)
     const double MAX_FORCE = 1e6; // kJ mol-1 nm-1
     const double MIN_TOLERANCE = 50.0; //kJ mol-1
     const size_t MAX_MIN_ITERATIONS = 500;
-    const size_t STEPS_PER_VELOCITY_CHECK = 10;
+    const size_t STABLE_CHECKS_BEFORE_BACKOFF = 10;
+
+    // Adaptive instability check schedule
+    std::atomic<size_t> _min_check_interval{10};
+    std::atomic<size_t> _max_check_interval{50};
+    std::atomic<bool> _tighten_checks{true};
+    std::atomic<bool> _check_by_displacement{false};
+    size_t _check_interval = 10; // worker thread only
+    size_t _stable_checks = 0;   // worker thread only
+    std::vector<size_t> _fast_atoms;
+    std::vector<OpenMM::Vec3> _reference_positions; // for displacement checks
+    std::vector<double> _mobile_mask; // 1 for particles with mass, 0 for fixed
+    std::vector<size_t> _mobile_particles; // indices of particles with mass
+    double _reference_time = 0;
+
+    // Finished batch refinement regions, waiting to be collected
+    mutable std::mutex _region_mutex;
+    std::deque<Region_Result> _region_results;
+
+    // Batched force parameter updates
+    typedef std::unordered_map<OpenMM::Force*, custom_forces::Parameter_Batch> Force_Batches;
+    Force_Batches _staged_force_updates; // GUI thread only
+    Force_Batches _flushed_force_updates; // guarded by _force_update_mutex
+    std::mutex _force_update_mutex;
+    std::atomic<bool> _force_updates_flushed{false};
+
+    // Per-term forces of the monitored AdaptiveDistanceRestraintForce
+    OpenMM::CustomBondForce* _monitored_force = nullptr;
+    std::vector<int> _monitored_pairs;
+    std::vector<double> _monitored_params; // ADAPTIVE_DISTANCE_PARAMS per term
+    Triple_Buffer<double> _published_bond_forces;
+
+    // Pre-minimisation clash screen. Only changed while the worker is idle.
+    Clash_Prescreen _prescreen;
+    std::atomic<bool> _prescreen_enabled{true};
+    std::atomic<double> _prescreen_distance{0.2}; // nm
+    Clash_Prescreen::Stats _prescreen_stats;
+    const size_t MAX_PRESCREEN_ITERATIONS = 200;
+
+    // Conformational bias. Terms only changed while the worker is idle.
+    Grid_Bias _grid_bias;
+    OpenMM::CustomExternalForce *_grid_bias_force = nullptr;
+    std::atomic<double> _grid_bias_scale{1.0};
+    std::atomic<size_t> _grid_bias_interval{10};
+    bool _grid_bias_applied = false;
+    double _grid_bias_energy = 0;
+    std::vector<OpenMM::Vec3> _grid_bias_forces;
+    std::vector<double> _grid_bias_energies;
+
+    // Batch refinement: holds everything outside the current region while it
+    // equilibrates. Stiff enough that the held atoms barely move, with the
+    // period for a hydrogen still ten times a 2 fs step.
+    OpenMM::CustomExternalForce *_region_hold_force = nullptr;
+    const double REGION_HOLD_K = 1e5; // kJ mol-1 nm-2
+
+    // Haptic devices tugging atoms. Only changed while the worker is idle.
+    struct Haptic_Tug
+    {
+        Haptic_Link *link;
+        OpenMM::CustomExternalForce *force;
+        int entry;
+        int particle;
+        bool tugging;
+    };
+    std::vector<Haptic_Tug> _haptic_tugs;
+
+    // Interactive tugging: GUI thread to worker. Updates that don't fit
+    // while the worker is behind wait in _unsent_tug_updates (GUI thread
+    // only) until the next push_tug_targets() or flush_force_updates().
+    struct Tug_Update
+    {
+        OpenMM::CustomExternalForce *force;
+        int entry;
+        double params[5];
+    };
+    static const size_t TUG_RING_SIZE = 256;
+    Spsc_Ring<Tug_Update, TUG_RING_SIZE> _tug_updates;
+    std::vector<Tug_Update> _unsent_tug_updates;
+
+    // Scheduled restraint changes. Only added or removed while the worker is idle.
+    std::unordered_map<size_t, std::unique_ptr<Restraint_Animation>> _animations;
+    size_t _next_animation_id = 0;
+
+    // Trajectory recording. Only touched by the worker while it is busy.
+    std::unique_ptr<Trajectory_Recorder> _recorder;
+    size_t _record_interval = 1;
+    size_t _publish_count = 0;
+
+    Stage_Timings _timings;
+
+    std::atomic<bool> _adaptive_pacing{false};
+    Adaptive_Pacer _pacer;
 
-    void _thread_safety_check() const {
-        if (_thread_running) {
-            throw std::logic_error("You need to finalize the old thread first!");
-        }
-    }
     void _thread_finished_check() const {
-        if (!_thread_finished) {
+        if (_busy) {
             throw std::logic_error("This function is not available while a thread is running!");
         }
     }
 
     void _thread_error_check()
     {
-        if (_thread_except) {
-            std::rethrow_exception(_thread_except);
+        std::exception_ptr e;
+        {
+            std::lock_guard<std::mutex> lock(_queue_mutex);
+            std::swap(e, _thread_except);
         }
+        if (e)
+            std::rethrow_exception(e);
+    }
+
+    template <typename T>
+    static void _scale_to_angstroms(const std::vector<OpenMM::Vec3>& coords_nm, T* out, size_t n, const size_t* indices)
+    {
+        if (indices == nullptr)
+        {
+            if (n != coords_nm.size())
+                throw std::logic_error("Mismatch between number of atoms and output array size!");
+            for (const auto& c: coords_nm)
+                for (size_t i=0; i<3; ++i)
+                    *out++ = static_cast<T>(c[i]*10.0);
+            return;
+        }
+        size_t N = coords_nm.size();
+        for (size_t i=0; i<n; ++i)
+        {
+            size_t idx = indices[i];
+            if (idx >= N)
+                throw std::out_of_range("Atom index out of range!");
+            const auto& c = coords_nm[idx];
+            for (size_t j=0; j<3; ++j)
+                *out++ = static_cast<T>(c[j]*10.0);
+        }
+    }
+
+    milliseconds _min_time_per_loop() const { return milliseconds(_min_time_per_loop_ms.load()); }
+    bool _continue_running() const { return !_stop_requested && _pending == 0; }
+    void _enqueue(Thread_Command&& cmd);
+    /*! Run f on the calling thread if the worker is idle, returning false
+     *  (without running it) if not. Holds the queue lock throughout, so no
+     *  command (from the GUI or from Sim_Scheduler's thread) can start on
+     *  the context meanwhile.
+     */
+    template <typename F>
+    bool _run_if_idle(F f)
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        if (_busy)
+            return false;
+        f();
+        return true;
     }
+    //! Flushed force or tugging updates the worker hasn't applied yet
+    bool _updates_waiting() const { return _force_updates_flushed || !_tug_updates.empty(); }
+    void _worker_loop();
+    void _run_command(Thread_Command& cmd);
 
+    bool _integrate(size_t steps, bool smooth);
+    bool _stability_check_in_loop();
+    std::vector<size_t> _overly_displaced_atoms(const OpenMM::State& state);
+    void _reset_displacement_reference(const OpenMM::State& state);
+    void _publish_coords(const OpenMM::State& state);
+    void _timed_publish_coords(const OpenMM::State& state);
+    void _timed_sleep(std::chrono::steady_clock::duration loop_time);
+    void _timed_sleep_for(std::chrono::steady_clock::duration d);
+    void _publish_bond_forces(const std::vector<OpenMM::Vec3>& coords_nm);
+    void _stability_check() const;
     void _step_threaded(size_t steps, bool average);
-    void _minimize_threaded(const double &tolerance, int max_iterations);
+    void _step_continuous_threaded(size_t steps_per_publish, bool smooth);
+    void _minimize_threaded(const double &tolerance, int max_iterations,
+        const std::vector<size_t>& region=std::vector<size_t>(), double radius=0);
+    void _minimize_particles_threaded(const double &tolerance, int max_iterations,
+        const std::vector<int> *mobile);
+    std::vector<int> _region_particles(const std::vector<OpenMM::Vec3>& positions,
+        const std::vector<size_t>& seeds, double radius) const;
     void _reinitialize_context_threaded();
+    void _refine_region_threaded(const Region_Refinement& job);
+    void _set_region_hold(const std::vector<int>& mobile, const std::vector<OpenMM::Vec3>& positions, bool hold);
+    void _update_mobile_mask();
+    void _apply_force_updates();
+    void _update_monitored_params(const custom_forces::Parameter_Batch& batch);
+    void _apply_haptic_targets();
+    void _send_tug_updates();
+    void _apply_tug_updates();
+    void _apply_restraint_animations();
+    void _advance_restraint_animations(size_t steps);
+    void _publish_haptic_feedback(const std::vector<OpenMM::Vec3>& positions);
+    void _set_haptic_tug(Haptic_Tug& tug, bool tugging, const double *xyz, double k);
     void _apply_smoothing(const OpenMM::State& state);
+    bool _grid_bias_active() const
+        { return _grid_bias_force != nullptr && !_grid_bias.empty() && _grid_bias_scale != 0; }
+    void _apply_grid_bias(const std::vector<OpenMM::Vec3>& positions);
+    void _release_grid_bias();
 };
 
 } //namespace isolde
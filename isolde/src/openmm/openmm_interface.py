@@ -42,19 +42,26 @@ c_array_function = _c_functions.c_array_function
 
 from ..constants import defaults
 
+# Simulation thread frame stages, in the order of Stage_Timings::Stage
+STAGE_NAMES = ('integrate', 'state download', 'velocity check', 'smoothing',
+    'copy out', 'parameter upload', 'sleep', 'total')
+
 class OpenMM_Thread_Handler:
     '''
     A lightweight wrapper class for a :class:`openmm.Context`, which
     pushes time-consuming tasks off to a C++ thread so that Python performance
-    is not interrupted. Each call to :func:`step` or :func:`minimize` will
-    create a short-lived thread to run the desired number of steps or a round of
-    minimization, respectively. Where necessary (e.g. where new  restraints are
+    is not interrupted. A single long-lived worker thread is created along with
+    the handler; each call to :func:`step`, :func:`minimize` or setting
+    :attr:`coords` queues a command for the worker to run the desired number of
+    steps, a round of minimization or a coordinate update, respectively.
+    Where necessary (e.g. where new  restraints are
     added to the simulation), the context may be reinitialised  with
     :func:`reinitialize_context_and_keep_state`. The status of the thread can be
     checked with :attr:`thread_finished`, while the initial and final
     coordinates can be retrieved with :attr:`last_coords` and :attr:`coords`
-    respectively. Within the thread, the simulation is checked for excessive
-    velocities every 10 steps. If instability (overly fast-moving atoms) is
+    respectively. Within the thread, the simulation is periodically checked
+    for excessive velocities (see :attr:`instability_check_intervals`). If
+    instability (overly fast-moving atoms) is
     detected, the thread will terminate early and :attr:`unstable` will be set
     to True. In such cases it is advisable to run one or more minimization
     rounds. When minimization converges to within tolerance, `unstable` will be
@@ -111,8 +118,8 @@ class OpenMM_Thread_Handler:
         (0.01..1), where 1 indicates no smoothing and 0.01 provides extremely
         strong smoothing. Values outside of this range will be automatically
         clamped. Internally, coordinates are added to the moving  average
-        every 10 steps or the number of steps to the next graphics  update,
-        whichever is smaller.
+        at every instability check (see :attr:`instability_check_intervals`)
+        or at the next graphics update, whichever comes first.
 
         Note that smoothing only affects the *visualisation* of the simulation,
         not the simulation itself. Applying energy minimisation or pausing  the
@@ -162,6 +169,25 @@ class OpenMM_Thread_Handler:
         self._last_mode = 'equil'
         self._last_smooth = self._smoothing
 
+    def step_continuous(self, steps_per_update):
+        '''
+        Start the simulation running freely in the C++ thread, publishing new
+        coordinates every `steps_per_update` steps. The thread will continue
+        until :func:`finalize_thread` is called (either directly or via any
+        call that needs exclusive access to the simulation), or until
+        instability is detected. Use :func:`latest_coords` to retrieve
+        coordinates while the simulation is running.
+
+        Args:
+            * steps_per_update:
+                - an integer value
+        '''
+        f = c_function('openmm_thread_handler_step_continuous',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_bool))
+        f(self._c_pointer, steps_per_update, self._smoothing)
+        self._last_mode = 'equil'
+        self._last_smooth = self._smoothing
+
     def minimize(self, tolerance=None, max_iterations=None):
         '''
         Run an energy minimization on the coordinates. If the minimisation
@@ -186,6 +212,290 @@ class OpenMM_Thread_Handler:
         f(self._c_pointer, tolerance, max_iterations)
         self._last_mode = 'min'
 
+    def top_forces(self, min_force=0, max_n=None):
+        '''
+        Find the mobile atoms experiencing the largest forces at the current
+        coordinates. Waits for the simulation thread to finish its current
+        task.
+
+        Args:
+            * min_force:
+                - only report atoms with forces above this (kJ mol-1 nm-1)
+            * max_n:
+                - maximum number of atoms to report (default: no limit)
+
+        Returns:
+            * a tuple of (indices, forces) in decreasing order of force
+        '''
+        if max_n is None:
+            max_n = self.natoms
+        indices = numpy.empty(max_n, numpy.uintp)
+        forces = numpy.empty(max_n, float64)
+        f = c_function('openmm_thread_handler_top_forces',
+            args=(ctypes.c_void_p, ctypes.c_double, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p),
+            ret=ctypes.c_size_t)
+        n = f(self._c_pointer, min_force, max_n, pointer(indices), pointer(forces))
+        return indices[:n], forces[:n]
+
+    def minimize_region(self, indices, radius, tolerance=None, max_iterations=None):
+        '''
+        Energy-minimise only the atoms with the given indices and everything
+        within radius of them, holding the rest of the simulation fixed. Far
+        quicker than :func:`minimize` for settling a small local change (e.g.
+        a rotamer swap or peptide flip) in a large simulation. Convergence and
+        clash detection only consider the mobile atoms.
+
+        Args:
+            * indices:
+                - array of atom indices into the simulation
+            * radius:
+                - distance in Angstroms around the given atoms to also
+                  minimise
+            * tolerance, max_iterations:
+                - as for :func:`minimize`
+        '''
+        if tolerance is None:
+            tolerance = self.params.minimization_convergence_tol_start
+        if max_iterations is None:
+            max_iterations=self.params.minimization_max_iterations
+        indices = numpy.ascontiguousarray(indices, numpy.uintp)
+        f = c_function('openmm_thread_handler_minimize_region',
+            args = (ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_double,
+                ctypes.c_double, ctypes.c_int))
+        f(self._c_pointer, len(indices), pointer(indices), radius/10, tolerance,
+            max_iterations)
+        self._last_mode = 'min'
+
+    def refine_region(self, region_id, mobile, settle_tolerance, settle_iterations,
+            tolerance, max_iterations, max_rounds, steps, temperature, seed):
+        '''
+        Queue one region of a batch refinement (see
+        :class:`chimerax.isolde.openmm.batch_refine.BatchRefinement`): settle
+        the mobile particles with a short, loose minimisation, minimise them
+        to convergence in up to max_rounds rounds of max_iterations, then
+        equilibrate for the given number of steps from fresh velocities with
+        everything else held in place by the force given to
+        :func:`set_region_hold_force`. Collect the outcome with
+        :func:`pop_region_result`.
+
+        Args:
+            * region_id:
+                - integer identifying the region in its result
+            * mobile:
+                - sorted array of the indices of the particles free to move
+            * settle_tolerance, settle_iterations:
+                - tolerance (kJ/mol/atom) and iteration limit of the settling
+                  round. Zero iterations skips it
+            * tolerance, max_iterations, max_rounds:
+                - for the main minimisation
+            * steps:
+                - equilibration steps after minimisation
+            * temperature:
+                - equilibration temperature in Kelvin
+            * seed:
+                - random number seed for the initial velocities
+        '''
+        mobile = numpy.ascontiguousarray(mobile, int32)
+        f = c_function('openmm_thread_handler_refine_region',
+            args=(ctypes.c_void_p, ctypes.c_uint64, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_double, ctypes.c_int, ctypes.c_double, ctypes.c_int,
+                ctypes.c_size_t, ctypes.c_size_t, ctypes.c_double, ctypes.c_int))
+        f(self._c_pointer, region_id, len(mobile), pointer(mobile), settle_tolerance,
+            settle_iterations, tolerance, max_iterations, max_rounds, steps,
+            temperature, seed)
+        self._last_mode = 'min'
+
+    def set_region_hold_force(self, force):
+        '''
+        Give the thread handler the :class:`RegionHoldForce` through which
+        :func:`refine_region` holds the rest of the model in place while
+        equilibrating a region. Only call this while the simulation thread is
+        idle.
+        '''
+        f = c_function('openmm_thread_handler_set_region_hold_force',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, None if force is None else int(force.this))
+
+    @property
+    def num_region_results(self):
+        '''Number of finished batch refinement regions not yet collected.'''
+        f = c_function('openmm_thread_handler_num_region_results',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def pop_region_result(self, max_atoms=None):
+        '''
+        Collect the oldest finished batch refinement region, as a dict with
+        keys 'id', 'start energy', 'minimized energy', 'final energy'
+        (kJ/mol), 'converged', 'clash', 'unstable' and 'coords' (Angstroms,
+        for the region's mobile atoms in simulation order). Returns None if
+        no region has finished.
+        '''
+        if max_atoms is None:
+            max_atoms = self.natoms
+        region_id = ctypes.c_uint64(0)
+        energies = numpy.empty(3, float64)
+        flags = numpy.empty(3, npy_bool)
+        coords = numpy.empty((max_atoms, 3), float64)
+        f = c_function('openmm_thread_handler_pop_region_result',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+                ctypes.c_size_t, ctypes.c_void_p),
+            ret=ctypes.c_int64)
+        n = f(self._c_pointer, ctypes.byref(region_id), pointer(energies),
+            pointer(flags), max_atoms, pointer(coords))
+        if n < 0:
+            return None
+        return {
+            'id': region_id.value,
+            'start energy': energies[0],
+            'minimized energy': energies[1],
+            'final energy': energies[2],
+            'converged': bool(flags[0]),
+            'clash': bool(flags[1]),
+            'unstable': bool(flags[2]),
+            'coords': coords[:n],
+        }
+
+    def cancel_minimization(self):
+        '''
+        Ask a running minimisation to stop early. It will do so at its next
+        progress report at which no atom is experiencing a clashing force,
+        and the result will count as converged.
+        '''
+        f = c_function('openmm_thread_handler_cancel_minimization',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    @property
+    def minimization_progress_interval(self):
+        '''
+        Number of minimiser iterations between publishing intermediate
+        coordinates (retrievable with :func:`latest_coords`). Set to zero to
+        disable progress reports and cancellation.
+        '''
+        f = c_function('openmm_thread_handler_minimization_progress_interval',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @minimization_progress_interval.setter
+    def minimization_progress_interval(self, iterations):
+        f = c_function('set_openmm_thread_handler_minimization_progress_interval',
+            args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, iterations)
+
+    @property
+    def minimization_energy(self):
+        '''
+        Potential energy (kJ/mol) at the most recent minimisation progress
+        report.
+        '''
+        f = c_function('openmm_thread_handler_minimization_energy',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_double)
+        return f(self._c_pointer)
+
+    def set_clash_prescreen_topology(self, heavy_mask, bonds):
+        '''
+        Give the clash pre-screen the information it needs to find severe
+        overlaps between heavy atoms before each round of minimisation.
+
+        Args:
+            * heavy_mask:
+                - a Boolean array with one entry per particle, True for
+                  non-hydrogen atoms
+            * bonds:
+                - an (n,2) array of particle indices for each bond, used to
+                  exclude 1-2 and 1-3 pairs from the screen
+        '''
+        f = c_function('openmm_thread_handler_set_clash_prescreen_topology',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_size_t, ctypes.c_void_p))
+        heavy_mask = numpy.array(heavy_mask, npy_bool)
+        bonds = numpy.array(bonds, numpy.int32).reshape((-1,2))
+        f(self._c_pointer, len(heavy_mask), pointer(heavy_mask),
+            len(bonds), pointer(bonds))
+
+    @property
+    def clash_prescreen(self):
+        '''
+        If True (and :func:`set_clash_prescreen_topology` has been called),
+        severe heavy-atom overlaps are pushed apart by a short, step-limited
+        steepest descent before L-BFGS minimisation starts. Without this,
+        badly-overlapping atoms can generate forces large enough to throw
+        the minimiser into a far corner of conformational space.
+        '''
+        f = c_function('openmm_thread_handler_clash_prescreen_enabled',
+            args=(ctypes.c_void_p,),
+            ret=npy_bool)
+        return f(self._c_pointer)
+
+    @clash_prescreen.setter
+    def clash_prescreen(self, flag):
+        f = c_function('set_openmm_thread_handler_clash_prescreen_enabled',
+            args=(ctypes.c_void_p, npy_bool))
+        f(self._c_pointer, flag)
+
+    @property
+    def clash_prescreen_distance(self):
+        '''
+        Heavy atoms (other than 1-2 and 1-3 bonded pairs) closer than this
+        distance (Angstroms) count as a severe overlap for the clash
+        pre-screen.
+        '''
+        f = c_function('openmm_thread_handler_clash_prescreen_distance',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_double)
+        return f(self._c_pointer)*10
+
+    @clash_prescreen_distance.setter
+    def clash_prescreen_distance(self, distance):
+        f = c_function('set_openmm_thread_handler_clash_prescreen_distance',
+            args=(ctypes.c_void_p, ctypes.c_double))
+        f(self._c_pointer, distance/10)
+
+    @property
+    def last_clash_prescreen(self):
+        '''
+        Outcome of the clash pre-screen at the start of the last round of
+        minimisation, as a tuple of (overlaps found, overlaps remaining,
+        iterations). Only available while the thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_last_clash_prescreen',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        stats = numpy.empty(3, numpy.uintp)
+        f(self._c_pointer, pointer(stats))
+        return tuple(int(s) for s in stats)
+
+    _MINIMIZER_PRECISIONS = ('double', 'single', 'auto')
+
+    @property
+    def minimizer_precision(self):
+        '''
+        Precision of the L-BFGS arithmetic used in energy minimisation: one of
+        'double', 'single' or 'auto'. Forces always come from OpenMM at the
+        precision of the platform; on the CUDA and OpenCL platforms in single
+        or mixed precision mode (the 'auto' choice for single) little is lost
+        by running the minimiser in single precision too, which halves the
+        memory traffic of its vector updates. Takes effect from the next round of
+        minimisation.
+        '''
+        f = c_function('openmm_thread_handler_minimizer_precision',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_int)
+        return self._MINIMIZER_PRECISIONS[f(self._c_pointer)]
+
+    @minimizer_precision.setter
+    def minimizer_precision(self, precision):
+        if precision not in self._MINIMIZER_PRECISIONS:
+            raise TypeError('Precision should be one of {}'.format(
+                ', '.join(self._MINIMIZER_PRECISIONS)))
+        f = c_function('set_openmm_thread_handler_minimizer_precision',
+            args=(ctypes.c_void_p, ctypes.c_int))
+        f(self._c_pointer, self._MINIMIZER_PRECISIONS.index(precision))
+
     @property
     def clashing(self):
         '''
@@ -240,10 +550,18 @@ class OpenMM_Thread_Handler:
             ret=npy_bool)
         return f(self._c_pointer)
 
+    def thread_running(self):
+        '''Does the worker thread have any commands queued or in progress?'''
+        f = c_function('openmm_thread_handler_thread_running',
+            args=(ctypes.c_void_p,),
+            ret=npy_bool)
+        return f(self._c_pointer)
+
     def finalize_thread(self):
         '''
-        Wrap up and join the existing thread. Note that if the thread has not
-        finished, Python and GUI will hang until it has.
+        Interrupt any continuous run and wait for the worker to finish all
+        queued commands. Note that if the thread has not finished, Python and
+        GUI will hang until it has.
         '''
         f = c_function('openmm_thread_handler_finalize_thread',
             args=(ctypes.c_void_p,))
@@ -265,7 +583,7 @@ class OpenMM_Thread_Handler:
         f = c_function('openmm_thread_handler_unstable_atoms',
             args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
         n = self.natoms
-        ret = numpy.empty(n, numpy.bool)
+        ret = numpy.zeros(n, numpy.bool)
         f(self._c_pointer, n, pointer(ret))
         return ret
 
@@ -290,16 +608,170 @@ class OpenMM_Thread_Handler:
         completes. Can also be set, to push edited coordinates back to the
         simulation.
         '''
+        return self.get_coords()
+
+    _COORDS_INITIAL=0
+    _COORDS_FINAL=1
+    _COORDS_SMOOTHED=2
+
+    def get_coords(self, indices=None, dtype=float64):
+        '''
+        Returns the coordinates (in Angstroms) after the most recent thread
+        completes, written directly from the simulation state into the output
+        array. Equivalent to :attr:`coords`, but optionally limited to a
+        subset of atoms.
+
+        Args:
+            * indices:
+                - optional array of atom indices into the simulation. If
+                  provided, only these atoms are returned (e.g. just the
+                  mobile atoms).
+            * dtype:
+                - float64 or float32. Use float32 for display-only updates.
+        '''
         if not self._smoothing or not self._last_smooth or self._last_mode !='equil':
-            f = c_function('openmm_thread_handler_current_coords',
-                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+            source = self._COORDS_FINAL
+        else:
+            source = self._COORDS_SMOOTHED
+        return self._export_coords(source, indices, dtype)
+
+    def _export_coords(self, source, indices, dtype):
+        if dtype == float32:
+            fname = 'openmm_thread_handler_export_coords_f'
+        elif dtype == float64:
+            fname = 'openmm_thread_handler_export_coords'
+        else:
+            raise TypeError('Coordinates can only be exported as float32 or float64!')
+        f = c_function(fname,
+            args=(ctypes.c_void_p, ctypes.c_int, ctypes.c_size_t, ctypes.c_void_p,
+                ctypes.c_void_p))
+        if indices is None:
+            n = self.natoms
+            iptr = None
+        else:
+            indices = numpy.ascontiguousarray(indices, numpy.uintp)
+            n = len(indices)
+            iptr = pointer(indices)
+        coords = numpy.empty((n,3), dtype)
+        f(self._c_pointer, source, n, iptr, pointer(coords))
+        return coords
+
+    def latest_coords(self, indices=None, dtype=float64):
+        '''
+        Returns the most recent coordinates (smoothed, if smoothing is on)
+        published by the simulation thread, or None if nothing new has been
+        published since the last call. Never waits on the thread.
+
+        Args:
+            * indices:
+                - optional array of atom indices into the simulation. If
+                  provided, only these atoms are returned.
+            * dtype:
+                - float64 or float32.
+        '''
+        if indices is None:
+            f = c_function('openmm_thread_handler_latest_coords',
+                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p),
+                ret=ctypes.c_bool)
+            if dtype != float64:
+                raise TypeError('Use indices to retrieve float32 coordinates!')
+            n = self.natoms
+            coords = numpy.empty((n,3), float64)
+            if f(self._c_pointer, n, pointer(coords)):
+                return coords
+            return None
+        if dtype == float32:
+            fname = 'openmm_thread_handler_latest_coords_subset_f'
+        elif dtype == float64:
+            fname = 'openmm_thread_handler_latest_coords_subset'
+        else:
+            raise TypeError('Coordinates can only be exported as float32 or float64!')
+        f = c_function(fname,
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.c_bool)
+        indices = numpy.ascontiguousarray(indices, numpy.uintp)
+        n = len(indices)
+        coords = numpy.empty((n,3), dtype)
+        if f(self._c_pointer, n, pointer(indices), pointer(coords)):
+            return coords
+        return None
+
+    def latest_coords_to_atoms(self, atoms, indices=None):
+        '''
+        As :func:`latest_coords`, but writes the coordinates straight into
+        the given atoms rather than returning them. This avoids the
+        round-trip through a numpy array and the per-atom change tracking of
+        :attr:`Atoms.coords`. Each structure instead gets one 'coord changed'
+        atom reason (so the usual change handlers still fire) and one
+        coordinate set change, but :func:`modified_atoms` will not list every
+        atom that moved. Returns True if new coordinates were written.
+
+        Args:
+            * atoms:
+                - a :class:`chimerax.atomic.Atoms` instance
+            * indices:
+                - optional array of atom indices into the simulation, one
+                  per atom. If not provided, atoms must cover the whole
+                  simulation in order.
+        '''
+        f = c_function('openmm_thread_handler_latest_coords_to_atoms',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.c_bool)
+        n = len(atoms)
+        if indices is None:
+            iptr = None
         else:
-            f = c_function('openmm_thread_handler_smoothed_coords',
-                args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+            indices = numpy.ascontiguousarray(indices, numpy.uintp)
+            if len(indices) != n:
+                raise TypeError('Number of indices must match the number of atoms!')
+            iptr = pointer(indices)
+        return f(self._c_pointer, n, iptr, atoms._c_pointers)
+
+    @property
+    def coords_generation(self):
+        '''
+        Number of coordinate sets published by the simulation thread so far.
+        '''
+        f = c_function('openmm_thread_handler_coords_generation',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_uint64)
+        return f(self._c_pointer)
+
+    @property
+    def publish_snapshots(self):
+        '''
+        If True, every frame published by the simulation thread is also kept
+        as an immutable snapshot (see :func:`coord_snapshot`). Off by
+        default, since it costs a copy of the coordinates per frame.
+        '''
+        f = c_function('openmm_thread_handler_publish_snapshots',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_bool)
+        return f(self._c_pointer)
+
+    @publish_snapshots.setter
+    def publish_snapshots(self, flag):
+        f = c_function('set_openmm_thread_handler_publish_snapshots',
+            args=(ctypes.c_void_p, ctypes.c_bool))
+        f(self._c_pointer, flag)
+
+    def coord_snapshot(self):
+        '''
+        Returns a (generation, coords) tuple for the most recent snapshot
+        published by the simulation thread, or (0, None) if there is none
+        yet. Unlike :func:`latest_coords` this does not consume the frame, so
+        it can be used alongside the normal coordinate updates. Never waits
+        on the thread. Requires :attr:`publish_snapshots` to be on.
+        '''
+        f = c_function('openmm_thread_handler_coord_snapshot',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p),
+            ret=ctypes.c_uint64)
         n = self.natoms
         coords = numpy.empty((n,3), float64)
-        f(self._c_pointer, n, pointer(coords))
-        return coords
+        generation = f(self._c_pointer, n, pointer(coords))
+        if generation == 0:
+            return (0, None)
+        return (generation, coords)
 
     @coords.setter
     def coords(self, coords):
@@ -330,13 +802,535 @@ class OpenMM_Thread_Handler:
 
     min_thread_period = property(_get_min_thread_period, _set_min_thread_period)
 
+    def _get_adaptive_pacing(self):
+        '''
+        If True, :func:`step_continuous` ignores its steps_per_update
+        argument (other than as a starting point) and :attr:`min_thread_period`,
+        and instead sizes each chunk of steps to fill the time between calls to
+        :func:`latest_coords` (or :attr:`pacing_parameters` target latency, if
+        shorter), based on the measured time per step. Takes effect from the
+        next call to :func:`step_continuous`.
+        '''
+        f = c_function('openmm_thread_handler_adaptive_pacing',
+            args=(ctypes.c_void_p,), ret=npy_bool)
+        return f(self._c_pointer)
+
+    def _set_adaptive_pacing(self, flag):
+        f = c_function('set_openmm_thread_handler_adaptive_pacing',
+            args=(ctypes.c_void_p, npy_bool))
+        f(self._c_pointer, flag)
+
+    adaptive_pacing = property(_get_adaptive_pacing, _set_adaptive_pacing)
+
+    def _get_pacing_parameters(self):
+        '''
+        (target latency in ms, min steps, max steps) for adaptive pacing. The
+        simulation thread only sleeps once chunks reach max steps.
+        '''
+        f = c_function('openmm_thread_handler_pacing_parameters',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double),
+                ctypes.POINTER(ctypes.c_size_t)))
+        latency = ctypes.c_double()
+        steps = (ctypes.c_size_t*2)()
+        f(self._c_pointer, ctypes.byref(latency), steps)
+        return (latency.value, steps[0], steps[1])
+
+    def _set_pacing_parameters(self, params):
+        f = c_function('set_openmm_thread_handler_pacing_parameters',
+            args=(ctypes.c_void_p, ctypes.c_double, ctypes.c_size_t, ctypes.c_size_t))
+        latency, min_steps, max_steps = params
+        f(self._c_pointer, latency, min_steps, max_steps)
+
+    pacing_parameters = property(_get_pacing_parameters, _set_pacing_parameters)
+
+    @property
+    def pacing_state(self):
+        '''
+        Current decisions and measurements of the adaptive pacer, as a dict.
+        Times are in milliseconds.
+        '''
+        f = c_function('openmm_thread_handler_pacing_state',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)))
+        state = numpy.empty(5, float64)
+        f(self._c_pointer, pointer(state))
+        return {
+            'steps per update': int(state[0]),
+            'sleep': state[1],
+            'time per step': state[2],
+            'overhead per update': state[3],
+            'gui interval': state[4],
+        }
+
+    def _get_instability_check_intervals(self):
+        '''
+        (min, max) number of steps between checks for overly fast-moving
+        atoms. The interval starts at min, doubles after each run of stable
+        checks up to max, and drops back to min whenever instability is
+        detected, the coordinates or context change, or
+        :func:`tighten_instability_checks` is called.
+        '''
+        f = c_function('openmm_thread_handler_instability_check_intervals',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        ret = numpy.empty(2, numpy.uintp)
+        f(self._c_pointer, pointer(ret))
+        return tuple(ret)
+
+    def _set_instability_check_intervals(self, intervals):
+        f = c_function('set_openmm_thread_handler_instability_check_intervals',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t))
+        f(self._c_pointer, *intervals)
+
+    instability_check_intervals = property(_get_instability_check_intervals,
+        _set_instability_check_intervals)
+
+    def tighten_instability_checks(self):
+        '''
+        Reset the instability check interval to its minimum. Should be called
+        after any sudden change to the forces acting on the model (e.g. a new
+        tug or rotamer restraint).
+        '''
+        f = c_function('openmm_thread_handler_tighten_instability_checks',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    def stage_force_parameters(self, force, force_type, indices, params):
+        '''
+        Stage new per-term parameters for one of the custom restraint forces
+        in the simulation. Nothing is changed in the force or context until
+        :func:`flush_force_updates` is called. If the same term is staged
+        more than once, only the last values are kept.
+
+        Args:
+            * force:
+                - the OpenMM custom force object
+            * force_type:
+                - one of the force type constants defined in
+                  :class:`custom_forces._Staged_Parameters_Mixin`
+            * indices:
+                - a Numpy int32 array giving the indices of the terms in the
+                  force
+            * params:
+                - a (n x nparams) Numpy float64 array of the new parameters
+        '''
+        f = c_function('openmm_thread_handler_stage_force_parameters',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_double)))
+        n = len(indices)
+        if params.shape[0] != n:
+            raise TypeError('Parameter array length must match number of indices!')
+        f(self._c_pointer, int(force.this), force_type, n, pointer(indices),
+            pointer(params))
+
+    def push_tug_targets(self, force, indices, params):
+        '''
+        Send new parameters for terms of the tugging force straight to the
+        simulation thread, which applies them (in order) before its next block
+        of steps. Unlike :func:`stage_force_parameters` there is no need to
+        call :func:`flush_force_updates`.
+
+        Args:
+            * force:
+                - the :class:`TopOutRestraintForce` used for tugging
+            * indices:
+                - a Numpy int32 array giving the indices of the terms in the
+                  force
+            * params:
+                - a (n x 5) Numpy float64 array of (enabled, k, x0, y0, z0),
+                  in OpenMM units
+        '''
+        f = c_function('openmm_thread_handler_push_tug_targets',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_int32), ctypes.POINTER(ctypes.c_double)))
+        n = len(indices)
+        if params.shape != (n, 5):
+            raise TypeError('Need 5 parameters for each index!')
+        indices = numpy.ascontiguousarray(indices, numpy.int32)
+        params = numpy.ascontiguousarray(params, numpy.float64)
+        f(self._c_pointer, int(force.this), n, pointer(indices), pointer(params))
+
+    def flush_force_updates(self):
+        '''
+        Pass all staged force parameter changes to the simulation thread,
+        which applies them with a single updateParametersInContext() call
+        per changed force before its next block of steps. This does not
+        interrupt a continuously-running simulation.
+        '''
+        f = c_function('openmm_thread_handler_flush_force_updates',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    def monitor_adaptive_distance_force(self, force):
+        '''
+        Have the simulation thread publish the force applied by each term of
+        an :class:`AdaptiveDistanceRestraintForce` alongside the coordinates
+        (see :func:`latest_bond_forces`). Pass None to stop. Only call this
+        while the simulation thread is idle, and again after the context is
+        reinitialised.
+        '''
+        f = c_function('openmm_thread_handler_monitor_adaptive_distance_force',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, None if force is None else int(force.this))
+
+    def latest_bond_forces(self):
+        '''
+        Returns the force (kJ/mol/nm, positive when pulling the atoms together)
+        applied by each term of the force given to
+        :func:`monitor_adaptive_distance_force`, if new values have been
+        published since the last call. Otherwise returns None. Does not wait
+        on the simulation thread.
+        '''
+        nf = c_function('openmm_thread_handler_num_monitored_bonds',
+            args=(ctypes.c_void_p,), ret=ctypes.c_size_t)
+        n = nf(self._c_pointer)
+        if not n:
+            return None
+        f = c_function('openmm_thread_handler_latest_bond_forces',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)),
+            ret=ctypes.c_bool)
+        forces = numpy.empty(n, float64)
+        if not f(self._c_pointer, pointer(forces)):
+            return None
+        return forces
+
+    def attach_haptic_link(self, link, force, entry):
+        '''
+        Let a haptic device drive one term of the tugging force directly from
+        its own thread (see the C++ Haptic_Link). Only call this while the
+        simulation thread is idle.
+
+        Args:
+            * link:
+                - pointer to the device's Haptic_Link (from
+                  :func:`HapticHandler.haptic_link`)
+            * force:
+                - the :class:`TopOutRestraintForce` used for tugging
+            * entry:
+                - index of the tugged atom's term in the force
+        '''
+        f = c_function('openmm_thread_handler_attach_haptic_link',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int))
+        f(self._c_pointer, link, int(force.this), entry)
+
+    def detach_haptic_link(self, link):
+        '''
+        Disconnect a haptic device attached with :func:`attach_haptic_link`,
+        releasing its atom. Only call this while the simulation thread is
+        idle.
+        '''
+        f = c_function('openmm_thread_handler_detach_haptic_link',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, link)
+
+    def set_grid_bias_force(self, force):
+        '''
+        Give the thread handler the :class:`GridBiasForce` through which it
+        applies the conformational bias (see :func:`add_grid_bias_grid`).
+        Only call this while the simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_set_grid_bias_force',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, None if force is None else int(force.this))
+
+    def add_grid_bias_grid(self, grid_pointer, periods=None):
+        '''
+        Add a log-probability grid to the conformational bias, returning its
+        index for :func:`add_grid_bias_terms`. Only call this while the
+        simulation thread is idle.
+
+        Args:
+            * grid_pointer:
+                - pointer to a C++ log-probability grid, from
+                  :func:`RamaMgr._log_interpolator_pointer` or
+                  :func:`RotaMgr._log_interpolator_pointer`. Its values
+                  are shared rather than copied.
+            * periods:
+                - the period of each axis (zero if not periodic). If None,
+                  every axis is taken to be periodic with one point of
+                  wrapped padding at each end, as for the validation grids.
+        '''
+        f = c_function('openmm_thread_handler_add_grid_bias_grid',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.c_size_t)
+        if periods is not None:
+            periods = numpy.array(periods, float64)
+            return f(self._c_pointer, grid_pointer, pointer(periods))
+        return f(self._c_pointer, grid_pointer, None)
+
+    def add_grid_bias_terms(self, grid, particles, k):
+        '''
+        Bias sets of dihedrals towards the favoured regions of a grid, with
+        energy :math:`-k \ln(P)`. Only call this while the simulation thread
+        is idle.
+
+        Args:
+            * grid:
+                - index returned by :func:`add_grid_bias_grid`
+            * particles:
+                - an (n, dim, 4) array giving, for each term, the particle
+                  indices of each of the grid's dim dihedrals
+            * k:
+                - the strength of each term in kJ/mol per unit ln(P): one
+                  value, or one per term
+        '''
+        f = c_function('openmm_thread_handler_add_grid_bias_terms',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t,
+                ctypes.c_void_p, ctypes.c_void_p))
+        particles = numpy.array(particles, int32)
+        n = len(particles)
+        k = numpy.array(numpy.broadcast_to(k, (n,)), float64)
+        f(self._c_pointer, grid, n, pointer(particles), pointer(k))
+
+    def clear_grid_bias(self):
+        '''
+        Remove all terms and grids from the conformational bias. Only call
+        this while the simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_clear_grid_bias',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    @property
+    def num_grid_bias_terms(self):
+        f = c_function('openmm_thread_handler_num_grid_bias_terms',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @property
+    def grid_bias_scale(self):
+        '''
+        Multiplier applied to the strength of every conformational bias term.
+        Can be changed while the simulation is running, and takes effect at
+        the next update of the bias. Zero switches the bias off.
+        '''
+        f = c_function('openmm_thread_handler_grid_bias_scale',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_double)
+        return f(self._c_pointer)
+
+    @grid_bias_scale.setter
+    def grid_bias_scale(self, scale):
+        f = c_function('set_openmm_thread_handler_grid_bias_scale',
+            args=(ctypes.c_void_p, ctypes.c_double))
+        f(self._c_pointer, scale)
+
+    @property
+    def grid_bias_interval(self):
+        '''
+        Maximum number of steps between re-evaluations of the conformational
+        bias. Between evaluations the bias is applied as a constant force, so
+        longer intervals trade accuracy for speed.
+        '''
+        f = c_function('openmm_thread_handler_grid_bias_interval',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @grid_bias_interval.setter
+    def grid_bias_interval(self, steps):
+        f = c_function('set_openmm_thread_handler_grid_bias_interval',
+            args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, steps)
+
+    @property
+    def last_grid_bias_energy(self):
+        '''
+        Energy of the conformational bias (kJ/mol) when last evaluated. Only
+        available while the simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_last_grid_bias_energy',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_double)
+        return f(self._c_pointer)
+
+    def add_restraint_animation(self, force, force_type, indices, keyframes,
+            steps_per_keyframe, stepped=None):
+        '''
+        Schedule a change to the parameters of some terms of a restraint
+        force, carried out on the simulation thread between blocks of steps
+        (see the C++ Restraint_Animation). While the animation runs, its
+        parameters take precedence over any staged for the same terms. Only
+        call this while the simulation thread is idle. Returns an ID for use
+        with :func:`restraint_animation_progress` and
+        :func:`remove_restraint_animation`.
+
+        Args:
+            * force:
+                - the OpenMM custom force object
+            * force_type:
+                - one of the force type constants defined in
+                  :class:`custom_forces._Staged_Parameters_Mixin`
+            * indices:
+                - the indices of the terms in the force
+            * keyframes:
+                - a (n_keyframes x n x nparams) array of parameters, in the
+                  force's own units and order. Angles should be unwrapped.
+            * steps_per_keyframe:
+                - number of simulation steps from one keyframe to the next
+            * stepped:
+                - optional array of nparams booleans, True for parameters to
+                  be held at the last keyframe's value rather than
+                  interpolated (e.g. enabled)
+        '''
+        f = c_function('openmm_thread_handler_add_restraint_animation',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_int32), ctypes.c_size_t, ctypes.c_size_t,
+                ctypes.POINTER(ctypes.c_double), ctypes.POINTER(ctypes.c_uint8),
+                ctypes.c_size_t),
+            ret=ctypes.c_size_t)
+        indices = numpy.ascontiguousarray(indices, int32)
+        n = len(indices)
+        keyframes = numpy.ascontiguousarray(keyframes, float64)
+        if keyframes.ndim != 3 or keyframes.shape[1] != n:
+            raise TypeError('Keyframes should be a (n_keyframes x n x nparams) array!')
+        if stepped is None:
+            stepped_p = None
+        else:
+            stepped = numpy.ascontiguousarray(stepped, uint8)
+            if len(stepped) != keyframes.shape[2]:
+                raise TypeError('Need one stepped flag per parameter!')
+            stepped_p = pointer(stepped)
+        return f(self._c_pointer, int(force.this), force_type, n, pointer(indices),
+            keyframes.shape[0], keyframes.shape[2], pointer(keyframes), stepped_p,
+            steps_per_keyframe)
+
+    def remove_restraint_animation(self, animation_id):
+        '''
+        Remove an animation added with :func:`add_restraint_animation`,
+        leaving its terms with whatever parameters it last applied. Only call
+        this while the simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_remove_restraint_animation',
+            args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, animation_id)
+
+    def restraint_animation_progress(self, animation_id):
+        '''
+        Fraction (0..1) of the animation completed so far. Safe to call while
+        the simulation is running.
+        '''
+        f = c_function('openmm_thread_handler_restraint_animation_progress',
+            args=(ctypes.c_void_p, ctypes.c_size_t), ret=ctypes.c_double)
+        return f(self._c_pointer, animation_id)
+
+    def start_recording(self, filename, precision=0.001, keyframe_interval=100,
+            record_interval=1):
+        '''
+        Record the trajectory to an ISOLDE trajectory (.itrj) file, replacing
+        any recording already in progress. Frames are compressed and written
+        by a separate thread; if it can't keep up, frames are dropped rather
+        than slowing the simulation (see :attr:`recording_stats`). Recording
+        stops when :func:`stop_recording` is called or the handler is
+        deleted. Only call this while the simulation thread is idle.
+
+        Args:
+            * filename:
+                - path to the file, which will be overwritten
+            * precision:
+                - coordinates are stored rounded to a multiple of this (in
+                  Angstroms)
+            * keyframe_interval:
+                - number of frames between keyframes, which are stored in full
+                  and allow seeking to nearby frames without reading the whole
+                  file. The file is also flushed to disk at each keyframe.
+            * record_interval:
+                - record every nth set of coordinates published by the
+                  simulation thread
+        '''
+        f = c_function('openmm_thread_handler_start_recording',
+            args=(ctypes.c_void_p, ctypes.c_char_p, ctypes.c_double,
+                ctypes.c_size_t, ctypes.c_size_t))
+        f(self._c_pointer, os.fsencode(filename), precision, keyframe_interval,
+            record_interval)
+
+    def stop_recording(self):
+        '''
+        Finish writing any queued frames and close the trajectory file. Only
+        call this while the simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_stop_recording',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    @property
+    def recording(self):
+        '''Is a trajectory currently being recorded?'''
+        f = c_function('openmm_thread_handler_recording',
+            args=(ctypes.c_void_p,), ret=npy_bool)
+        return f(self._c_pointer)
+
+    @property
+    def recording_stats(self):
+        '''
+        A dict giving the number of frames written and dropped, and the
+        number of bytes written, for the current recording.
+        '''
+        f = c_function('openmm_thread_handler_recording_stats',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)))
+        stats = (ctypes.c_size_t*3)()
+        f(self._c_pointer, stats)
+        return {'frames written': stats[0], 'frames dropped': stats[1],
+            'bytes written': stats[2]}
+
+    def stage_timings(self, percentiles=(50, 90, 99)):
+        '''
+        Summarise how long the simulation thread has spent in each stage of
+        its recent frames (up to the last 1024). Returns a tuple of (number of
+        frames sampled, dict mapping each of :data:`STAGE_NAMES` to an array
+        of the given percentiles in milliseconds).
+        '''
+        f = c_function('openmm_thread_handler_stage_timings',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double),
+                ctypes.POINTER(ctypes.c_double)), ret=ctypes.c_size_t)
+        pct = numpy.array(percentiles, float64)
+        out = numpy.empty((len(STAGE_NAMES), len(pct)), float64)
+        n = f(self._c_pointer, len(pct), pointer(pct), pointer(out))
+        return n, {name: out[i] for i, name in enumerate(STAGE_NAMES)}
+
+    def clear_stage_timings(self):
+        '''Forget all stored stage timings.'''
+        f = c_function('openmm_thread_handler_clear_stage_timings',
+            args=(ctypes.c_void_p,))
+        f(self._c_pointer)
+
+    def discard_force_updates(self, force):
+        '''
+        Forget any parameter changes staged for a force, which must be done
+        before the force is removed from the System. Only call this while the
+        simulation thread is idle.
+        '''
+        f = c_function('openmm_thread_handler_discard_force_updates',
+            args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, int(force.this))
+
+    def _get_check_by_displacement(self):
+        '''
+        If True, instability checks download only the atomic positions (which
+        are needed for display anyway) and flag atoms whose displacement since
+        the last check implies an excessive average velocity, rather than
+        downloading the velocities themselves.
+        '''
+        f = c_function('openmm_thread_handler_check_by_displacement',
+            args=(ctypes.c_void_p,),
+            ret=ctypes.c_bool)
+        return f(self._c_pointer)
+
+    def _set_check_by_displacement(self, flag):
+        f = c_function('set_openmm_thread_handler_check_by_displacement',
+            args=(ctypes.c_void_p, ctypes.c_bool))
+        f(self._c_pointer, flag)
+
+    check_by_displacement = property(_get_check_by_displacement,
+        _set_check_by_displacement)
+
 class Sim_Construct:
     '''
     Container class defining the ChimeraX atoms (all, mobile and fixed)
     in a simulation. Also responsible for storing the visualisation state of
     these atoms prior to simulation startup, and reverting it when done.
     '''
-    def __init__(self, model, mobile_atoms, fixed_atoms, excluded_atoms=None):
+    def __init__(self, model, mobile_atoms, fixed_atoms, excluded_atoms=None,
+            regions=None):
         '''
         Prepare the construct. The atoms in each array will be sorted in the
         same order as :attr:`model.residues.atoms`, primarily because OpenMM
@@ -355,6 +1349,12 @@ class Sim_Construct:
             * excluded_atoms:
                 - A :py:class:`chimerax.Atoms` instance defining any atoms to
                   be excluded from the simulation. This may be set to None.
+            * regions:
+                - optional (residues, state, indices) tuple as returned by
+                  :func:`Sim_Manager.build_regions`. If given, mobile_atoms,
+                  fixed_atoms and excluded_atoms are ignored (and may be None)
+                  and the atom arrays are taken directly from the per-atom
+                  state, with no further sorting.
 
         NOTE: the simulation will fail if mobile_atoms and fixed_atoms do not
         combine to form a set containing only complete residues. Also note that
@@ -364,25 +1364,40 @@ class Sim_Construct:
         '''
         self.model = model
 
-        # Chains in OpenMM must be in a single unbroken block
-        residues = model.residues
-        residues = residues[numpy.lexsort((residues.numbers, residues.chain_ids))]
-
-        # Sort all the atoms according to their order in the model#
-        model_atoms = residues.atoms
-        if len(mobile_atoms.intersect(fixed_atoms)):
-            raise TypeError('Atoms cannot be both fixed and mobile!')
-        from chimerax.atomic import concatenate
-        all_atoms = concatenate((mobile_atoms, fixed_atoms))
-        all_i = model_atoms.indices(all_atoms)
-        if -1 in all_i:
-            raise TypeError('All atoms must be from the targeted model!')
-        all_atoms = self._all_atoms = model_atoms[numpy.sort(all_i)]
-        mob_i = model_atoms.indices(mobile_atoms)
-        ma = self._mobile_atoms = model_atoms[numpy.sort(mob_i)]
-        mr = self._mobile_residues = ma.unique_residues
-        fixed_i = model_atoms.indices(fixed_atoms)
-        self._fixed_atoms = model_atoms[numpy.sort(fixed_i)]
+        if regions is not None:
+            residues, state, indices = regions
+            model_atoms = residues.atoms
+            from ..molobject import SimRegionState as rs
+            in_sim = numpy.logical_or(state==rs.MOBILE, state==rs.FIXED)
+            all_atoms = self._all_atoms = model_atoms[in_sim]
+            mobile_mask = (state==rs.MOBILE)
+            ma = self._mobile_atoms = model_atoms[mobile_mask]
+            self._mobile_indices = indices[mobile_mask]
+            self._fixed_atoms = model_atoms[state==rs.FIXED]
+            excluded_atoms = model_atoms[state==rs.EXCLUDED]
+            if not len(excluded_atoms):
+                excluded_atoms = None
+        else:
+            # Chains in OpenMM must be in a single unbroken block
+            residues = model.residues
+            residues = residues[numpy.lexsort((residues.numbers, residues.chain_ids))]
+
+            # Sort all the atoms according to their order in the model#
+            model_atoms = residues.atoms
+            if len(mobile_atoms.intersect(fixed_atoms)):
+                raise TypeError('Atoms cannot be both fixed and mobile!')
+            from chimerax.atomic import concatenate
+            all_atoms = concatenate((mobile_atoms, fixed_atoms))
+            all_i = model_atoms.indices(all_atoms)
+            if -1 in all_i:
+                raise TypeError('All atoms must be from the targeted model!')
+            all_atoms = self._all_atoms = model_atoms[numpy.sort(all_i)]
+            mob_i = model_atoms.indices(mobile_atoms)
+            ma = self._mobile_atoms = model_atoms[numpy.sort(mob_i)]
+            self._mobile_indices = None
+            fixed_i = model_atoms.indices(fixed_atoms)
+            self._fixed_atoms = model_atoms[numpy.sort(fixed_i)]
+        self._mobile_residues = ma.unique_residues
         self._excluded_atoms = excluded_atoms
 
         self.store_original_visualisation()
@@ -399,6 +1414,16 @@ class Sim_Construct:
         '''
         return self._mobile_atoms
 
+    @property
+    def mobile_indices(self):
+        '''
+        Indices of :attr:`mobile_atoms` in :attr:`all_atoms` (i.e. their
+        particle indices in the simulation).
+        '''
+        if self._mobile_indices is None:
+            self._mobile_indices = self._all_atoms.indices(self._mobile_atoms)
+        return self._mobile_indices
+
     @property
     def mobile_heavy_atoms(self):
         '''
@@ -500,6 +1525,173 @@ class Sim_Construct:
 
 
 
+# SimParams that define the OpenMM System, integrator or Context. A cached
+# handler is only reused if all of these are unchanged.
+_SIM_CACHE_PARAMS = (
+    'forcefield', 'platform', 'device_index',
+    'integrator', 'variable_integrator_tolerance', 'fixed_integrator_timestep',
+    'constraint_tolerance', 'friction_coefficient',
+    'nonbonded_cutoff_method', 'nonbonded_cutoff_distance',
+    'vacuum_dielectric_correction', 'use_gbsa', 'gbsa_cutoff_method',
+    'gbsa_solvent_dielectric', 'gbsa_solute_dielectric', 'gbsa_sa_method',
+    'gbsa_cutoff', 'gbsa_kappa', 'rigid_bonds', 'rigid_water',
+    'remove_c_of_m_motion', 'restraint_max_force', 'max_cubic_map_size',
+)
+
+def _sim_cache_signature(sim_params):
+    return tuple(str(getattr(sim_params, name)) for name in _SIM_CACHE_PARAMS)
+
+def get_sim_handler_cache(session):
+    '''
+    Get the session-level :class:`Sim_Handler_Cache`, creating it if it doesn't
+    yet exist.
+
+    Args:
+        * session:
+            - the top-level ChimeraX session instance
+    '''
+    cache = getattr(session, 'isolde_sim_handler_cache', None)
+    if cache is None:
+        cache = session.isolde_sim_handler_cache = Sim_Handler_Cache(session)
+    return cache
+
+class Sim_Handler_Cache:
+    '''
+    Keeps the :py:class:`Sim_Handler` from the last simulation after it ends,
+    along with its OpenMM System, forces and Context. Restarting on the same
+    region (or a smaller one inside it) then skips building the System and
+    compiling the GPU kernels: see :func:`Sim_Handler.prepare_for_reuse`.
+
+    Only one handler is kept, since each holds on to GPU memory. The cache is
+    cleared if atoms, bonds or residue names change in its model, and on any
+    request it can't satisfy (so the old Context is freed before a new one is
+    made).
+    '''
+    def __init__(self, session):
+        self.session = session
+        self._handler = None
+        self._model = None
+        self._signature = None
+        self._volumes = None
+        self._model_handlers = []
+
+    @property
+    def handler(self):
+        '''The cached :py:class:`Sim_Handler`, or None. Read only.'''
+        return self._handler
+
+    def store(self, sim_handler, model, sim_params, volumes):
+        '''
+        Keep a finished handler, replacing any already cached.
+
+        Args:
+            * sim_handler:
+                - a :py:class:`Sim_Handler` whose simulation has ended
+            * model:
+                - the :py:class:`chimerax.AtomicStructure` it simulated
+            * sim_params:
+                - the :py:class:`SimParams` it was built with
+            * volumes:
+                - the :py:class:`chimerax.Volume` instances it has MDFF
+                  forces for
+        '''
+        self.clear()
+        self._handler = sim_handler
+        self._model = model
+        self._signature = _sim_cache_signature(sim_params)
+        self._volumes = set(volumes)
+        t = model.triggers
+        self._model_handlers = [
+            t.add_handler('changes', self._model_changes_cb),
+            t.add_handler('deleted', self._model_deleted_cb),
+        ]
+
+    def take(self, model, regions, sim_params, volumes):
+        '''
+        Remove the cached handler and return it if it can run the simulation
+        defined by regions, otherwise clear the cache. A handler can be used if
+        it was built with the same parameters and maps, and its atoms include
+        every mobile and fixed atom and no excluded ones. Any extra atoms it
+        holds are made fixed in the returned regions, provided there are no
+        more than :attr:`SimParams.sim_cache_max_oversize` times as many as the
+        new simulation needs.
+
+        Returns a (handler, regions) tuple. handler is None on a miss, in which
+        case regions is returned unchanged.
+
+        Args:
+            * model:
+                - the :py:class:`chimerax.AtomicStructure` to simulate
+            * regions:
+                - (residues, state, indices) as returned by
+                  :func:`Sim_Manager.build_regions`
+            * sim_params:
+                - a :py:class:`SimParams` instance
+            * volumes:
+                - the :py:class:`chimerax.Volume` instances to be used for
+                  MDFF
+        '''
+        sh = self._handler
+        if sh is None:
+            return None, regions
+        if (model is not self._model
+                or self._signature != _sim_cache_signature(sim_params)
+                or self._volumes != set(volumes)):
+            self.clear()
+            return None, regions
+        from ..molobject import SimRegionState as rs
+        residues, state, indices = regions
+        model_atoms = residues.atoms
+        cached_i = model_atoms.indices(sh.atoms)
+        # The cached atoms must still be in simulation order
+        if -1 in cached_i or numpy.any(numpy.diff(cached_i) < 0):
+            self.clear()
+            return None, regions
+        cached = numpy.zeros(len(model_atoms), bool)
+        cached[cached_i] = True
+        in_sim = numpy.logical_or(state==rs.MOBILE, state==rs.FIXED)
+        if (numpy.any(in_sim & ~cached)
+                or numpy.any(cached & (state==rs.EXCLUDED))
+                or cached.sum() > sim_params.sim_cache_max_oversize * in_sim.sum()):
+            self.clear()
+            return None, regions
+        state = state.copy()
+        state[cached & (state==rs.OUTSIDE)] = rs.FIXED
+        indices = numpy.where(cached, numpy.cumsum(cached)-1, -1)
+        self._forget()
+        return sh, (residues, state, indices)
+
+    def clear(self):
+        '''
+        Drop the cached handler and free its Context.
+        '''
+        sh = self._handler
+        self._forget()
+        if sh is not None:
+            sh.release_context()
+
+    def _forget(self):
+        m = self._model
+        if m is not None and not m.deleted:
+            for h in self._model_handlers:
+                m.triggers.remove_handler(h)
+        self._model_handlers = []
+        self._handler = None
+        self._model = None
+
+    def _model_changes_cb(self, trigger_name, changes):
+        changes = changes[1]
+        if (changes.num_deleted_atoms() or len(changes.created_atoms())
+                or changes.num_deleted_bonds() or len(changes.created_bonds())
+                or 'name changed' in changes.residue_reasons()):
+            self.clear()
+
+    def _model_deleted_cb(self, *_):
+        self._model_handlers = []
+        self._model = None
+        self.clear()
+
+
 class Sim_Manager:
     '''
     Responsible for creating the :py:class:`Sim_Handler` and managing the
@@ -513,15 +1705,18 @@ class Sim_Manager:
         Prepares a simulation according to the following workflow:
             * Expands an initial selection of atoms to complete residues
               according to the rules defined by expansion_mode
-            * Finds a shell of residues around this selection to act as the
-              fixed context
-            * Restricts the live validation managers to focus only on the
-              mobile selection (creating the managers as necessary)
             * Finds/creates all restraint managers for the model
-            * Expands the fixed atom selection to include any non-mobile
-              residues containing atoms participating in distance restraints
-              with mobile atoms
+            * In a single pass (see :func:`build_regions`), finds a shell of
+              residues around this selection to act as the fixed context,
+              adds any non-mobile residues containing atoms participating in
+              distance restraints with mobile atoms, and fixes the atoms
+              bonded to any excluded residues
+            * Takes the handler from the previous simulation out of the
+              :py:class:`Sim_Handler_Cache` if it covers the new selection,
+              in which case any extra atoms it holds become fixed
             * Creates the :py:class:`Sim_Construct` object
+            * Restricts the live validation managers to focus only on the
+              mobile selection (creating the managers as necessary)
             * Prepares the molecule visualisation for simulation (masking maps
               to the mobile selection, hiding atoms not in the simulation, etc.)
             * Prepares the MDFF managers (NOTE: this *must* be done after the
@@ -529,7 +1724,8 @@ class Sim_Manager:
               has a region covering the mobile selection with sufficient padding)
             * Prepares all necessary callbacks to update the simulation when
               the parameters of restraints, mdff atom proxies etc. change.
-            * Creates the :py:class:`Sim_Handler`
+            * Creates the :py:class:`Sim_Handler` (or prepares the cached one
+              for reuse)
             * Adds all existing restraints and MDFF atom proxies to the
               simulation.
 
@@ -568,18 +1764,21 @@ class Sim_Manager:
         # need to push them to the simulation before resuming
         self._pause_atom_changes_handler = None
         self._revert_to = None
+        self._snapshot_validator = None
         logger.status('Determining simulation layout')
-        mobile_atoms = self.expand_mobile_selection(selected_atoms, expansion_mode)
-        from ..selections import get_shell_of_residues
-        fixed_atoms = get_shell_of_residues(mobile_atoms.unique_residues,
-            isolde_params.hard_shell_cutoff_distance).atoms
-        self._prepare_validation_managers(mobile_atoms)
         self._prepare_restraint_managers()
-        fixed_atoms = self._add_fixed_atoms_from_distance_restraints(mobile_atoms, fixed_atoms)
-        if excluded_residues is not None:
-            mobile_atoms, fixed_atoms, excluded_atoms = self._add_fixed_atoms_from_excluded_residues(mobile_atoms, fixed_atoms, excluded_residues)
-
-        sc = self.sim_construct = Sim_Construct(model, mobile_atoms, fixed_atoms, excluded_atoms)
+        regions = self.build_regions(selected_atoms, expansion_mode,
+            excluded_residues=excluded_residues)
+        mdff_mgrs = self._find_mdff_managers()
+        cache = get_sim_handler_cache(session)
+        cached_handler = None
+        if sim_params.cache_sim_contexts:
+            cached_handler, regions = cache.take(model, regions, sim_params,
+                mdff_mgrs.keys())
+        else:
+            cache.clear()
+        sc = self.sim_construct = Sim_Construct(model, None, None, regions=regions)
+        self._prepare_validation_managers(sc.mobile_atoms)
         self.prepare_sim_visualisation()
 
         logger.status('Preparing simulation handler')
@@ -587,8 +1786,12 @@ class Sim_Manager:
         sh = self.sim_handler = None
         uh = self._update_handlers = []
         try:
-            sh = self.sim_handler = Sim_Handler(session, sim_params, sc,
-                isolde.forcefield_mgr)
+            if cached_handler is not None:
+                sh = self.sim_handler = cached_handler
+                sh.prepare_for_reuse(sc, sim_params)
+            else:
+                sh = self.sim_handler = Sim_Handler(session, sim_params, sc,
+                    isolde.forcefield_mgr)
         except Exception as e:
             self._sim_end_cb(None, None)
             if isinstance(e, ValueError):
@@ -609,6 +1812,7 @@ class Sim_Manager:
                     raise e
         sh.triggers.add_handler('sim paused', self._sim_pause_cb)
         sh.triggers.add_handler('sim resumed', self._sim_resume_cb)
+        sh.triggers.add_handler('coord update', self._atom_index_update_cb)
 
         self._initialize_restraints(uh)
         self._initialize_mdff(uh)
@@ -620,13 +1824,15 @@ class Sim_Manager:
         '''
         return self.sim_handler.sim_running
 
-    def start_reporting_performance(self, report_interval=20):
+    def start_reporting_performance(self, report_interval=20, stages=False):
         if hasattr(self, '_performance_tracker') and self._performance_tracker is not None:
             pt = self._performance_tracker
             pt.report_interval = report_interval
+            pt.stage_log_func = self.session.logger.info if stages else None
             pt.start()
         else:
-            pt = self._performance_tracker = Sim_Performance_Tracker(self.sim_handler, report_interval, self.session.logger.status)
+            pt = self._performance_tracker = Sim_Performance_Tracker(self.sim_handler, report_interval, self.session.logger.status,
+                stage_log_func = self.session.logger.info if stages else None)
             pt.start()
 
     def stop_reporting_performance(self):
@@ -665,8 +1871,12 @@ class Sim_Manager:
         '''
         sh = self.sim_handler
         sh.start_sim()
-        from ..checkpoint import CheckPoint
-        self._starting_checkpoint = self._current_checkpoint = CheckPoint(self.isolde)
+        from ..checkpoint import CheckpointStore
+        cs = self._checkpoints = CheckpointStore(self.isolde,
+            self.sim_params.checkpoint_history_length)
+        self._starting_checkpoint = self._current_checkpoint = cs.save()
+        if self.sim_params.background_validation:
+            self._start_background_validation()
         sh.triggers.add_handler('sim terminated', self._sim_end_cb)
 
     def stop_sim(self, revert = None):
@@ -721,20 +1931,175 @@ class Sim_Manager:
         :py:class:`Sim_Manager` automatically saves a checkpoint when the
         simulation is started. This method allows the saving of an intermediate
         state - particularly useful before experimenting on an ambiguous
-        region of your map. Each call to :func:`checkpoint` overwrites the
-        previously-saved one. When ending a simulation you may choose to keep
-        the final coordinates or revert to either of the last saved checkpoint
-        or the start-of-simulation checkpoint.
+        region of your map. Up to :attr:`SimParams.checkpoint_history_length`
+        checkpoints are kept (beyond that the oldest after the start are
+        dropped), each stored as the difference from the one before. When
+        ending a simulation you may choose to keep the final coordinates or
+        revert to either of the last saved checkpoint or the
+        start-of-simulation checkpoint.
         '''
-        from ..checkpoint import CheckPoint
-        self._current_checkpoint = CheckPoint(self.isolde)
+        self._current_checkpoint = self._checkpoints.save()
+
+    def revert_to_checkpoint(self, levels_back=0):
+        '''
+        Reverts to the last saved checkpoint, or to an earlier one. If no
+        checkpoint has been manually saved, reverts to the start of the
+        simulation. Checkpoints saved after the one reverted to are
+        discarded.
+
+        Args:
+            * levels_back:
+                - 0 for the most recent checkpoint, 1 for the one before it,
+                  etc. Stops at the start of the simulation.
+        '''
+        self._current_checkpoint = self._checkpoints.revert(levels_back)
+
+    @property
+    def num_checkpoints(self):
+        '''
+        Number of checkpoints (including the start of the simulation) that
+        can currently be reverted to.
+        '''
+        return len(self._checkpoints)
+
+    def animate_restraints(self, key, sim_indices, keyframes, steps_per_keyframe,
+            stepped=None):
+        '''
+        Move a set of restraints through a series of keyframes on the
+        simulation thread, at the simulation's own rate rather than once per
+        GUI frame (see :func:`OpenMM_Thread_Handler.add_restraint_animation`).
+        The restraint objects themselves are not changed: once
+        :func:`restraint_animation_progress` reaches 1, the caller should set
+        them to their final values and call :func:`end_restraint_animation`.
+
+        Args:
+            * key:
+                - the restraint force to animate: 'position', 'dihedral',
+                  'adaptive distance' or 'adaptive dihedral'
+            * sim_indices:
+                - the :attr:`sim_index` of each restraint
+            * keyframes:
+                - a (n_keyframes x n x nparams) array of parameters, in the
+                  force's units and parameter order
+            * steps_per_keyframe:
+                - number of simulation steps from one keyframe to the next
+            * stepped:
+                - optional array of nparams booleans, True for parameters to
+                  be switched at each keyframe rather than interpolated
+        '''
+        th = self._thread_handler
+        if th is None:
+            raise TypeError('No simulation running!')
+        sim_indices = numpy.asarray(sim_indices, int32)
+        if numpy.any(sim_indices == -1):
+            raise TypeError('All restraints must be in the current simulation!')
+        self._finalize_thread()
+        sf = self._sparse_forces.get(key, None)
+        entries = sim_indices
+        if sf is not None:
+            if sf.pin(sim_indices):
+                # The new entries must be in the context before the thread
+                # starts animating them
+                self._reinitialize_context()
+                self._finalize_thread()
+            entries = sf.entries(sim_indices)
+        force = getattr(self, self._SPARSE_FORCE_ATTRS[key])
+        try:
+            aid = th.add_restraint_animation(force, force._FORCE_TYPE, entries,
+                keyframes, steps_per_keyframe, stepped)
+        except:
+            if sf is not None:
+                sf.unpin()
+            raise
+        self._restraint_animations[aid] = key
+        return aid
 
-    def revert_to_checkpoint(self):
+    def restraint_animation_progress(self, animation_id):
         '''
-        Reverts to the last saved checkpoint. If no checkpoint has been manually
-        saved, reverts to the start of the simulation.
+        Fraction (0..1) of the animation completed, or None if it is no
+        longer running.
         '''
-        self._current_checkpoint.revert()
+        th = self._thread_handler
+        if th is None or animation_id not in self._restraint_animations:
+            return None
+        return th.restraint_animation_progress(animation_id)
+
+    def end_restraint_animation(self, animation_id):
+        '''
+        Stop an animation started with :func:`animate_restraints`. Its
+        restraints keep the parameters it last applied until they are next
+        updated.
+        '''
+        key = self._restraint_animations.pop(animation_id, None)
+        if key is None:
+            return
+        sf = self._sparse_forces.get(key, None)
+        if sf is not None:
+            sf.unpin()
+        self._finalize_thread()
+        self._thread_handler.remove_restraint_animation(animation_id)
+
+    def record_trajectory(self, filename, precision=0.001, keyframe_interval=100,
+            record_interval=1):
+        '''
+        Record the running simulation to an ISOLDE trajectory (.itrj) file.
+        See :func:`Sim_Handler.record_trajectory`.
+        '''
+        self.sim_handler.record_trajectory(filename, precision=precision,
+            keyframe_interval=keyframe_interval, record_interval=record_interval)
+
+    def stop_recording(self):
+        '''
+        Stop recording the trajectory. Recording also stops automatically
+        when the simulation ends.
+        '''
+        return self.sim_handler.stop_recording()
+
+    def use_scheduler(self, scheduler, weight=1.0):
+        '''
+        Run the simulation through a
+        :class:`chimerax.isolde.openmm.scheduler.SimScheduler` shared with
+        other simulations. Call before :func:`start_sim`. See
+        :func:`Sim_Handler.use_scheduler`.
+        '''
+        self.sim_handler.use_scheduler(scheduler, weight=weight)
+
+    def run_replicas(self, n_replicas, steps=2000, temperatures=None, seeds=None,
+            scheduler=None):
+        '''
+        Run n_replicas independent copies of this simulation from the
+        current coordinates, each with its own random seed (and optionally
+        temperature), without disturbing the simulation itself (which must be
+        paused or not yet started). Returns the running
+        :class:`chimerax.isolde.openmm.replicas.ReplicaEnsemble`, whose
+        'finished' trigger fires when all are done and scored. Use
+        e.g. :func:`ReplicaEnsemble.apply_best` to keep the best result.
+        '''
+        from .replicas import ReplicaEnsemble
+        ens = ReplicaEnsemble(self.sim_handler, n_replicas, steps=steps,
+            temperatures=temperatures, seeds=seeds, scheduler=scheduler)
+        ens.start()
+        return ens
+
+    def batch_refine(self, regions, steps=500, settle_iterations=50,
+            settle_tolerance=1.0, max_rounds=5, temperature=None, seed=None):
+        '''
+        Settle, minimise, briefly equilibrate and re-validate each of a list
+        of regions (:py:class:`chimerax.Residues`) in turn, holding the rest
+        of the simulation fixed, in a single Context built once from this
+        simulation's System. The simulation itself must be paused or not yet
+        started, and left alone until the batch is done. Returns the running
+        :class:`chimerax.isolde.openmm.batch_refine.BatchRefinement`; call its
+        :func:`wait` to block until it is finished, then e.g.
+        :func:`BatchRefinement.summary` for the change in validation of each
+        region.
+        '''
+        from .batch_refine import BatchRefinement
+        batch = BatchRefinement(self.sim_handler, regions, steps=steps,
+            settle_iterations=settle_iterations, settle_tolerance=settle_tolerance,
+            max_rounds=max_rounds, temperature=temperature, seed=seed)
+        batch.start()
+        return batch
 
     def _prepare_validation_managers(self, mobile_atoms):
         from .. import session_extensions as sx
@@ -744,6 +2109,37 @@ class Sim_Manager:
         rota_a = self.rota_annotator = sx.get_rota_annotator(m)
         rama_a.restrict_to_selected_residues(mobile_res)
         rota_a.restrict_to_selected_residues(mobile_res)
+        # Only residues with moving backbone atoms need to be re-scored on
+        # each coordinate update
+        rama_mgr = self._rama_mgr = sx.get_ramachandran_mgr(self.session)
+        rama_mgr.set_mobile_atoms(mobile_atoms)
+        rama_mgr.set_incremental(True)
+
+    def _start_background_validation(self):
+        '''
+        Score the mobile residues on a background thread against snapshots
+        published by the simulation thread, rather than on the GUI thread
+        after each coordinate update.
+        '''
+        from .. import session_extensions as sx
+        from ..molobject import SnapshotValidator
+        sh = self.sim_handler
+        sv = self._snapshot_validator = SnapshotValidator(self._rama_mgr,
+            sx.get_rotamer_mgr(self.session), sh.atoms)
+        sv.chirals = sx.get_chiral_mgr(self.session).get_chirals(
+            self.sim_construct.mobile_atoms)
+        self.RamaAnnotator.use_snapshot_validator(sv)
+        self.rota_annotator.use_snapshot_validator(sv)
+        sv.follow_simulation(sh)
+
+    def _stop_background_validation(self):
+        sv = self._snapshot_validator
+        if sv is None:
+            return
+        self.RamaAnnotator.use_snapshot_validator(None)
+        self.rota_annotator.use_snapshot_validator(None)
+        sv.delete()
+        self._snapshot_validator = None
 
     def _prepare_restraint_managers(self):
         from .. import session_extensions as sx
@@ -783,7 +2179,7 @@ class Sim_Manager:
         crs = cr_m.add_restraints_by_atoms(sc.mobile_heavy_atoms)
         # crs = crs.restrict_to_sel(sc.all_atoms)
         sh.add_dihedral_restraints(crs)
-        uh.append((cr_m, cr_m.triggers.add_handler('changes', self._dihe_r_changed_cb)))
+        uh.append((cr_m, cr_m.triggers.add_handler('coalesced changes', self._dihe_r_changed_cb)))
 
         pdr_m = self.proper_dihedral_restraint_mgr
         pdrs = pdr_m.add_all_defined_restraints_for_residues(mobile_res)
@@ -805,54 +2201,70 @@ class Sim_Manager:
                 omega_rs.enableds = True
 
         sh.add_dihedral_restraints(pdrs)
-        uh.append((pdr_m, pdr_m.triggers.add_handler('changes', self._dihe_r_changed_cb)))
+        uh.append((pdr_m, pdr_m.triggers.add_handler('coalesced changes', self._dihe_r_changed_cb)))
 
         apdr_m = self.adaptive_dihedral_restraint_mgr
         apdrs = apdr_m.get_all_restraints_for_residues(mobile_res)
         sh.add_adaptive_dihedral_restraints(apdrs)
-        uh.append((apdr_m, apdr_m.triggers.add_handler('changes', self._adaptive_dihe_r_changed_cb)))
+        uh.append((apdr_m, apdr_m.triggers.add_handler('coalesced changes', self._adaptive_dihe_r_changed_cb)))
 
         dr_m = self.distance_restraint_mgr
         # Pre-create all restraints necessary for secondary structure manipulation
         dr_m.add_ss_restraints(sc.all_atoms.unique_residues)
         drs = dr_m.atoms_restraints(sc.mobile_atoms)
         sh.add_distance_restraints(drs)
-        uh.append((dr_m, dr_m.triggers.add_handler('changes', self._dr_changed_cb)))
+        uh.append((dr_m, dr_m.triggers.add_handler('coalesced changes', self._dr_changed_cb)))
 
+        adrs_in_sim = self._adaptive_distance_restraints_in_sim = {}
         for adr_m in self.adaptive_distance_restraint_mgrs:
             adrs = adr_m.atoms_restraints(sc.mobile_atoms)
             sh.add_adaptive_distance_restraints(adrs)
-            uh.append((adr_m, adr_m.triggers.add_handler('changes', self._adr_changed_cb)))
+            adrs_in_sim[adr_m] = adrs
+            uh.append((adr_m, adr_m.triggers.add_handler('coalesced changes', self._adr_changed_cb)))
+        uh.append((sh, sh.triggers.add_handler('coord update', self._adr_force_update_cb)))
 
         pr_m = self.position_restraint_mgr
         prs = pr_m.add_restraints(sc.mobile_atoms)
         sh.add_position_restraints(prs)
-        uh.append((pr_m, pr_m.triggers.add_handler('changes', self._pr_changed_cb)))
+        uh.append((pr_m, pr_m.triggers.add_handler('coalesced changes', self._pr_changed_cb)))
 
         ta_m = self.tuggable_atoms_mgr
         tuggables = ta_m.add_tuggables(sc.mobile_atoms)
-        uh.append((ta_m, ta_m.triggers.add_handler('changes', self._tug_changed_cb)))
+        uh.append((ta_m, ta_m.triggers.add_handler('coalesced changes', self._tug_changed_cb)))
+        ta_m.direct_tug_handler = sh.update_tuggables
         sh.add_tuggables(tuggables)
 
-    def _prepare_mdff_managers(self):
+    def _find_mdff_managers(self):
         '''
-        Take experimental density maps and convert to MDFF potential energy
-        fields. For crystallographic data, only the map named "MDFF potential"
-        will be used, since it is guaranteed to exclude the free reflections.
+        Find the enabled MDFF managers for the model's maps, as a
+        {Volume: manager} dict (also stored as :attr:`mdff_mgrs`). For
+        crystallographic data, only the map named "MDFF potential" will have
+        one, since it is guaranteed to exclude the free reflections.
         '''
         from .. import session_extensions as sx
-        isolde_params = self.isolde.params
         m = self.model
         mdff_mgr_map = self.mdff_mgrs = {}
-        from chimerax.map import Volume
         from chimerax.clipper.symmetry import get_symmetry_handler
         sh = get_symmetry_handler(m)
         if sh is None:
-            return
+            return mdff_mgr_map
         for v in sh.map_mgr.all_maps:
             mgr = sx.get_mdff_mgr(m, v, create=False)
             if mgr is not None and mgr.enabled:
                 mdff_mgr_map[v] = mgr
+        return mdff_mgr_map
+
+    def _prepare_mdff_managers(self):
+        '''
+        Cover the mobile selection with the maps found by
+        :func:`_find_mdff_managers`, ready for conversion to MDFF potential
+        energy fields.
+        '''
+        isolde_params = self.isolde.params
+        from chimerax.clipper.symmetry import get_symmetry_handler
+        sh = get_symmetry_handler(self.model)
+        if sh is None:
+            return
         sh.isolate_and_cover_selection(self.sim_construct.mobile_atoms,
             include_surrounding_residues = 0,
             show_context = isolde_params.hard_shell_cutoff_distance,
@@ -874,66 +2286,57 @@ class Sim_Manager:
                 hydrogens = sp.hydrogens_feel_maps)
             sh.set_mdff_global_k(v, mgr.global_k)
             sh.add_mdff_atoms(mdff_atoms, v)
-            uh.append((mgr, mgr.triggers.add_handler('changes', self._mdff_changed_cb)))
+            uh.append((mgr, mgr.triggers.add_handler('coalesced changes', self._mdff_changed_cb)))
             uh.append((mgr, mgr.triggers.add_handler('global k changed', self._mdff_global_k_change_cb)))
 
 
-    def _add_fixed_atoms_from_distance_restraints(self, mobile_atoms, fixed_atoms):
+    def _sorted_residues(self):
         '''
-        If we have a distance restraint where only one atom is mobile, we must
-        make sure that the other atom is included in the fixed selection to
-        prevent it drifting unrestrained.
+        All residues in the model, sorted so that each chain is a single
+        unbroken block as OpenMM requires.
         '''
-        dr_m = self.distance_restraint_mgr
-        drs = dr_m.atoms_restraints(mobile_atoms)
-        from chimerax.atomic import concatenate
-        dr_atoms = concatenate(drs.atoms, remove_duplicates=True)
-        remainder = dr_atoms.subtract(dr_atoms.intersect(mobile_atoms))
-        remainder = remainder.subtract(remainder.intersect(fixed_atoms))
-        fixed_atoms = concatenate((fixed_atoms, remainder.unique_residues.atoms))
-        return fixed_atoms
-
-    def _add_fixed_atoms_from_excluded_residues(self, mobile_atoms, fixed_atoms, excluded_residues):
-        '''
-        Filter out any residues that are to be excluded from the simulation, and
-        fix any atoms (with their attendant hydrogens) that are directly bonded
-        to an excluded residue.
-        '''
-        from ..molobject import residue_bonded_neighbors
-        all_sim_atoms = mobile_atoms.merge(fixed_atoms)
-        all_sim_res = mobile_atoms.unique_residues
-        sim_excludes = excluded_residues.atoms.intersect(all_sim_atoms)
-        sim_exclude_res = sim_excludes.unique_residues
-        from chimerax.atomic import Atoms
-        extra_fixed = []
-        for r in sim_exclude_res:
-            neighbors = residue_bonded_neighbors(r)
-            for n in neighbors:
-                if n in all_sim_res:
-                    bonds = r.bonds_between(n)
-                    for b in bonds:
-                        for a in b.atoms:
-                            if a.residue == n:
-                                extra_fixed.append(a)
-                                # Fix directly attached atoms, atoms directly
-                                # attached to those, and associated hydrogens
-                                for na in a.neighbors:
-                                    if na.residue !=r:
-                                        extra_fixed.append(na)
-                                        if na.element.name != 'H':
-                                            for nb in na.neighbors:
-                                                if nb.element.name == 'H':
-                                                    extra_fixed.append(nb)
-        extra_fixed = Atoms(extra_fixed)
-        fixed_atoms = fixed_atoms.merge(extra_fixed)
-        fixed_atoms = fixed_atoms.subtract(sim_excludes)
-        mobile_atoms = mobile_atoms.subtract(extra_fixed)
-        mobile_atoms = mobile_atoms.subtract(sim_excludes)
-        return mobile_atoms, fixed_atoms, sim_excludes
-
+        residues = self.model.residues
+        return residues[numpy.lexsort((residues.numbers, residues.chain_ids))]
 
+    def _expand_core_selection(self, core_atoms, expansion_mode):
+        from .. import selections
+        iparams = self.isolde_params
+        if expansion_mode == 'extend':
+            return selections.expand_selection_along_chains(core_atoms,
+                iparams.num_selection_padding_residues)
+        raise TypeError('Unrecognised expansion mode!')
 
+    def build_regions(self, core_atoms, expansion_mode, excluded_residues=None):
+        '''
+        Work out the full layout of the simulation around core_atoms in a
+        single pass: the mobile selection as described in
+        :func:`expand_mobile_selection`, a shell of fixed residues within
+        :attr:`IsoldeParams.hard_shell_cutoff_distance` of it, any other
+        residues distance-restrained to mobile atoms, and the fixed atoms
+        around any excluded residues. Returns a (residues, state, indices)
+        tuple suitable for the `regions` argument to :class:`Sim_Construct`,
+        where state and indices are as given by
+        :func:`molobject.build_sim_regions`.
 
+        Args:
+            * core_atoms:
+                - a :py:class:`chimerax.Atoms` instance
+            * expansion_mode:
+                - see :func:`expand_mobile_selection`
+            * excluded_residues:
+                - optional :py:class:`chimerax.Residues` to leave out of the
+                  simulation
+        '''
+        from ..molobject import build_sim_regions
+        iparams = self.isolde_params
+        sel = self._expand_core_selection(core_atoms, expansion_mode)
+        residues = self._sorted_residues()
+        dr_m = getattr(self, 'distance_restraint_mgr', None)
+        restrained = dr_m.all_restraints.atoms if dr_m is not None else None
+        state, indices = build_sim_regions(residues, sel,
+            iparams.soft_shell_cutoff_distance, iparams.hard_shell_cutoff_distance,
+            restrained_atoms=restrained, excluded_residues=excluded_residues)
+        return residues, state, indices
 
     def expand_mobile_selection(self, core_atoms, expansion_mode):
         '''
@@ -954,18 +2357,13 @@ class Sim_Manager:
                   :attr:`IsoldeParams.num_selection_padding_residues`
                 - other modes will be added later
         '''
-        from .. import selections
+        from ..molobject import build_sim_regions, SimRegionState
         iparams = self.isolde_params
-        if expansion_mode == 'extend':
-            sel = selections.expand_selection_along_chains(core_atoms,
-                iparams.num_selection_padding_residues)
-        else:
-            raise TypeError('Unrecognised expansion mode!')
-        shell = selections.get_shell_of_residues(sel.unique_residues,
-            iparams.soft_shell_cutoff_distance).atoms
-        from chimerax.atomic import concatenate
-        merged_sel = concatenate((sel, shell), remove_duplicates=True)
-        return merged_sel
+        sel = self._expand_core_selection(core_atoms, expansion_mode)
+        residues = self._sorted_residues()
+        cutoff = iparams.soft_shell_cutoff_distance
+        state, _ = build_sim_regions(residues, sel, cutoff, cutoff)
+        return residues.atoms[state==SimRegionState.MOBILE]
 
     def prepare_sim_visualisation(self):
         '''
@@ -984,6 +2382,17 @@ class Sim_Manager:
     # CALLBACKS
     #######################################
 
+    def _atom_index_update_cb(self, *_):
+        '''
+        Keep the model's shared atom index (if any) current with only the
+        mobile atoms, so queries during the simulation don't need a full
+        refresh.
+        '''
+        from ..molobject import get_atom_index
+        idx = get_atom_index(self.model, create=False, refresh=False)
+        if idx is not None:
+            idx.update(self.sim_construct.mobile_atoms)
+
     def _atom_changes_while_paused_cb(self, trigger_name, changes):
         '''
         If changes are made to the model while the simulation is paused, we need
@@ -1012,6 +2421,7 @@ class Sim_Manager:
         self._dihe_r_sim_end_cb()
         self._adaptive_dihe_r_sim_end_cb()
         self._tug_sim_end_cb()
+        self._stop_background_validation()
         self._rama_a_sim_end_cb()
         self._rota_a_sim_end_cb()
         self._mdff_sim_end_cb()
@@ -1025,6 +2435,11 @@ class Sim_Manager:
             print('reverting to start')
             self._starting_checkpoint.revert()
         self.sim_construct.revert_visualisation()
+        sh = self.sim_handler
+        if (reason is None and sh is not None and sh.reusable
+                and self.sim_params.cache_sim_contexts):
+            get_sim_handler_cache(self.session).store(sh, self.model,
+                self.sim_params, self.mdff_mgrs.keys())
         if reason == 'coord length mismatch':
             msg = ('Mismatch between number of simulated atoms and the model. '
                 'The most common cause of this is the addition or removal of '
@@ -1035,6 +2450,8 @@ class Sim_Manager:
             generic_warning(msg)
 
     def _rama_a_sim_end_cb(self, *_):
+        self._rama_mgr.set_incremental(False)
+        self._rama_mgr.clear_mobile_atoms()
         self.RamaAnnotator.track_whole_model = True
         from chimerax.core.triggerset import DEREGISTER
         return DEREGISTER
@@ -1048,19 +2465,33 @@ class Sim_Manager:
         'target changed', 'enabled/disabled', 'spring constant changed'
     ))
 
+    def _sim_changeds(self, changes, reasons):
+        '''
+        Restraints in a :class:`CoalescedChanges` record changed for any of
+        the given reasons, limited to those actually in the simulation.
+        '''
+        changed = changes.any_of(reasons)
+        return changed[changed.sim_indices != -1]
+
+    def _sim_createds(self, changes):
+        '''
+        Restraints created this frame which are not yet in the simulation but
+        have all their atoms in it.
+        '''
+        created = changes.created
+        # avoid double counting
+        created = created[created.sim_indices == -1]
+        if not len(created):
+            return created
+        all_atoms = self.sim_construct.all_atoms
+        indices = numpy.array([all_atoms.indices(atoms) for atoms in created.atoms])
+        return created[numpy.all(indices != -1, axis=0)]
+
     def _pr_changed_cb(self, trigger_name, changes):
         mgr, changes = changes
-        change_types = set(changes.keys())
-        from chimerax.atomic import concatenate
-        changeds = []
-        for reason in self._pr_update_reasons.intersection(change_types):
-            changeds.append(changes[reason])
+        changeds = self._sim_changeds(changes, self._pr_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            # limit to restraints that are actually in the simulation
-            # TODO: might be better to just ignore -1 indices in the update_... functions
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_position_restraints(all_changeds)
+            self.sim_handler.update_position_restraints(changeds)
 
     def _pr_sim_end_cb(self, *_):
         restraints = self.position_restraint_mgr.get_restraints(self.sim_construct.all_atoms)
@@ -1072,24 +2503,12 @@ class Sim_Manager:
 
     def _dr_changed_cb(self, trigger_name, changes):
         mgr, changes = changes
-        change_types = set(changes.keys())
-        from chimerax.atomic import concatenate
-        if 'created' in change_types:
-            # avoid double counting
-            created = changes['created']
-            created = created[created.sim_indices == -1]
-            # add only restraints with both atoms in the sim
-            all_atoms = self.sim_construct.all_atoms
-            indices = numpy.array([all_atoms.indices(atoms) for atoms in created.atoms])
-            created = created[numpy.all(indices != -1, axis=0)]
+        created = self._sim_createds(changes)
+        if len(created):
             self.sim_handler.add_distance_restraints(created)
-        changeds = []
-        for reason in self._dr_update_reasons.intersection(change_types):
-            changeds.append(changes[reason])
+        changeds = self._sim_changeds(changes, self._dr_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_distance_restraints(all_changeds)
+            self.sim_handler.update_distance_restraints(changeds)
 
     def _dr_sim_end_cb(self, *_):
         restraints = self.distance_restraint_mgr.intra_restraints(self.sim_construct.all_atoms)
@@ -1105,56 +2524,59 @@ class Sim_Manager:
 
     def _adr_changed_cb(self, trigger_name, changes):
         mgr, changes = changes
-        change_types = set(changes.keys())
         from chimerax.atomic import concatenate
-        if 'created' in change_types:
-            created = changes['created']
-            created = created[created.sim_indices == -1]
-            # add only restraints with both atoms in the sim
-            all_atoms = self.sim_construct.all_atoms
-            indices = numpy.array([all_atoms.indices(atoms) for atoms in created.atoms])
-            created = created[numpy.all(indices != -1, axis=0)]
+        created = self._sim_createds(changes)
+        if len(created):
             self.sim_handler.add_adaptive_distance_restraints(created)
-        changeds = []
-        for reason in self._adr_update_reasons.intersection(change_types):
-            changeds.append(changes[reason])
+            adrs_in_sim = self._adaptive_distance_restraints_in_sim
+            if mgr in adrs_in_sim:
+                adrs_in_sim[mgr] = concatenate((adrs_in_sim[mgr], created),
+                    remove_duplicates=True)
+        changeds = self._sim_changeds(changes, self._adr_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != 1]
-            self.sim_handler.update_adaptive_distance_restraints(all_changeds)
+            self.sim_handler.update_adaptive_distance_restraints(changeds)
+
+    def _adr_force_update_cb(self, *_):
+        '''
+        Hand the restraint forces evaluated by the simulation thread to the
+        adaptive distance restraints, so drawing them doesn't need a host-side
+        evaluation for each.
+        '''
+        adrs_in_sim = getattr(self, '_adaptive_distance_restraints_in_sim', {})
+        if not adrs_in_sim:
+            return
+        from chimerax.atomic import concatenate
+        restraints = concatenate(list(adrs_in_sim.values()))
+        restraints = restraints[restraints.sim_indices != -1]
+        if not len(restraints):
+            return
+        forces = self.sim_handler.latest_adaptive_distance_restraint_forces(
+            restraints.sim_indices)
+        if forces is not None:
+            restraints.set_sim_forces(forces)
 
     def _adr_sim_end_cb(self, *_):
         for adrm in self.adaptive_distance_restraint_mgrs:
             restraints = adrm.intra_restraints(self.sim_construct.all_atoms)
             restraints.clear_sim_indices()
+            restraints.clear_sim_forces()
+        self._adaptive_distance_restraints_in_sim = {}
         from chimerax.core.triggerset import DEREGISTER
         return DEREGISTER
 
+    _dihe_r_update_reasons = frozenset((
+        'target changed', 'enabled/disabled', 'spring constant changed'
+    ))
+
     def _dihe_r_changed_cb(self, trigger_name, changes):
         '''Used for proper dihedral and chiral restraints.'''
         mgr, changes = changes
-        change_types = list(changes.keys())
-        from chimerax.atomic import concatenate
-        changeds = []
-        if 'created' in change_types:
-            # avoid double counting
-            created = changes['created']
-            created = created[created.sim_indices == -1]
-            # add only restraints with all atoms in the sim
-            all_atoms = self.sim_construct.all_atoms
-            indices = numpy.array([all_atoms.indices(atoms) for atoms in created.atoms])
-            created = created[numpy.all(indices != -1, axis=0)]
+        created = self._sim_createds(changes)
+        if len(created):
             self.sim_handler.add_dihedral_restraints(created)
-        if 'target changed' in change_types:
-            changeds.append(changes['target changed'])
-        if 'enabled/disabled' in change_types:
-            changeds.append(changes['enabled/disabled'])
-        if 'spring constant changed' in change_types:
-            changeds.append(changes['spring constant changed'])
+        changeds = self._sim_changeds(changes, self._dihe_r_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_dihedral_restraints(all_changeds)
+            self.sim_handler.update_dihedral_restraints(changeds)
 
 
     def _dihe_r_sim_end_cb(self, *_):
@@ -1167,33 +2589,20 @@ class Sim_Manager:
         from chimerax.core.triggerset import DEREGISTER
         return DEREGISTER
 
+    _adaptive_dihe_r_update_reasons = frozenset((
+        'target changed', 'enabled/disabled', 'spring constant changed',
+        'adaptive restraint constant changed'
+    ))
+
     def _adaptive_dihe_r_changed_cb(self, trigger_name, changes):
         '''Used for all forms of dihedral restraints.'''
         mgr, changes = changes
-        change_types = list(changes.keys())
-        from chimerax.atomic import concatenate
-        changeds = []
-        if 'created' in change_types:
-            # avoid double counting
-            created = changes['created']
-            created = created[created.sim_indices == -1]
-            # add only restraints with all atoms in the sim
-            all_atoms = self.sim_construct.all_atoms
-            indices = numpy.array([all_atoms.indices(atoms) for atoms in created.atoms])
-            created = created[numpy.all(indices != -1, axis=0)]
+        created = self._sim_createds(changes)
+        if len(created):
             self.sim_handler.add_adaptive_dihedral_restraints(created)
-        if 'target changed' in change_types:
-            changeds.append(changes['target changed'])
-        if 'enabled/disabled' in change_types:
-            changeds.append(changes['enabled/disabled'])
-        if 'spring constant changed' in change_types:
-            changeds.append(changes['spring constant changed'])
-        if 'adaptive restraint constant changed' in change_types:
-            changeds.append(changes['adaptive restraint constant changed'])
+        changeds = self._sim_changeds(changes, self._adaptive_dihe_r_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_adaptive_dihedral_restraints(all_changeds)
+            self.sim_handler.update_adaptive_dihedral_restraints(changeds)
 
 
     def _adaptive_dihe_r_sim_end_cb(self, *_):
@@ -1206,41 +2615,52 @@ class Sim_Manager:
 
 
 
+    _tug_update_reasons = frozenset((
+        'target changed', 'enabled/disabled', 'spring constant changed'
+    ))
+
     def _tug_changed_cb(self, trigger_name, changes):
         mgr, changes = changes
-        change_types = list(changes.keys())
-        from chimerax.atomic import concatenate
-        changeds = []
-        if 'target changed' in change_types:
-            changeds.append(changes['target changed'])
-        if 'enabled/disabled' in change_types:
-            changeds.append(changes['enabled/disabled'])
-        if 'spring constant changed' in change_types:
-            changeds.append(changes['spring constant changed'])
+        changeds = self._sim_changeds(changes, self._tug_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_tuggables(all_changeds)
+            self.sim_handler.update_tuggables(changeds)
+
+    def attach_haptic_device(self, link, atom):
+        '''
+        Let a haptic device tug an atom directly, at the simulation's own
+        rate: device targets go straight to the tugging force, and the atom's
+        position goes straight back to the device for force feedback.
+
+        Args:
+            * link:
+                - pointer to the device's Haptic_Link (from
+                  :func:`HapticHandler.haptic_link`)
+            * atom:
+                - the :class:`chimerax.Atom` to tug
+        '''
+        from chimerax.atomic import Atoms
+        tuggables = self.tuggable_atoms_mgr.get_tuggables(Atoms([atom]))
+        if not len(tuggables):
+            raise TypeError('This atom is not tuggable!')
+        self.sim_handler.attach_haptic_device(link, tuggables[0])
+
+    def detach_haptic_device(self, link):
+        self.sim_handler.detach_haptic_device(link)
 
     def _tug_sim_end_cb(self, *_):
+        self.tuggable_atoms_mgr.direct_tug_handler = None
         tuggables = self.tuggable_atoms_mgr.get_tuggables(self.sim_construct.all_atoms)
         tuggables.clear_sim_indices()
         from chimerax.core.triggerset import DEREGISTER
         return DEREGISTER
 
+    _mdff_update_reasons = frozenset(('enabled/disabled', 'spring constant changed'))
+
     def _mdff_changed_cb(self, trigger_name, changes):
         mgr, changes = changes
-        change_types = list(changes.keys())
-        from chimerax.atomic import concatenate
-        changeds = []
-        if 'enabled/disabled' in change_types:
-            changeds.append(changes['enabled/disabled'])
-        if 'spring constant changed' in change_types:
-            changeds.append(changes['spring constant changed'])
+        changeds = self._sim_changeds(changes, self._mdff_update_reasons)
         if len(changeds):
-            all_changeds = concatenate(changeds, remove_duplicates=True)
-            all_changeds = all_changeds[all_changeds.sim_indices != -1]
-            self.sim_handler.update_mdff_atoms(all_changeds, mgr.volume)
+            self.sim_handler.update_mdff_atoms(changeds, mgr.volume)
 
     def _mdff_global_k_change_cb(self, trigger_name, data):
         mgr, k = data
@@ -1256,6 +2676,175 @@ class Sim_Manager:
 
 
 
+class Sparse_Restraint_Force:
+    '''
+    Keeps one of the large restraint forces (position, adaptive distance and
+    dihedral restraints) free of dead weight. Disabled restraints still cost a
+    full evaluation on every step, so when a batch being added holds enough of
+    them they are withheld from the OpenMM force, and once disabled entries
+    make up a large enough fraction of the force it is rebuilt without them.
+
+    Each restraint's :attr:`sim_index` is a stable slot number in this object
+    rather than an index into the force. The parameters and particles of every
+    slot are kept here, and slots are mapped to force entries on update.
+    Anything that changes the number of entries (adding a withheld restraint
+    when it is enabled, or a rebuild) needs a context reinitialisation: the
+    methods doing so return True, and a pending rebuild is carried out by
+    :func:`rebuild` at reinitialisation time.
+    '''
+    def __init__(self, force, factory, add, num_particles, min_withheld,
+            rebuild_fraction):
+        '''
+        Args:
+            * force:
+                - the (empty) OpenMM force object
+            * factory:
+                - factory(old_force) returns a new empty force of the same
+                  kind and settings as old_force
+            * add:
+                - add(force, particles, params) adds entries to a force and
+                  returns their indices, where particles is an (n x k) array
+                  and params is a list of parameter arrays in the order taken
+                  by the force's update_targets() (enabled first)
+            * num_particles:
+                - number of particles per entry
+            * min_withheld:
+                - smallest number of disabled restraints (in one batch, or
+                  dead in the force) worth a context reinitialisation
+            * rebuild_fraction:
+                - rebuild once at least this fraction of the force is disabled
+        '''
+        self.force = force
+        self._factory = factory
+        self._add = add
+        self._min_withheld = min_withheld
+        self._rebuild_fraction = rebuild_fraction
+        self._particles = numpy.empty((0, num_particles), int32)
+        self._params = None
+        # Force entry for each slot, -1 if withheld
+        self._entries = numpy.empty(0, int32)
+        # Enabled state of each force entry
+        self._entry_enabled = numpy.empty(0, bool)
+        # Number of outstanding pin() calls
+        self._pins = 0
+
+    @property
+    def num_entries(self):
+        '''Number of entries currently in the OpenMM force.'''
+        return len(self._entry_enabled)
+
+    @property
+    def rebuild_needed(self):
+        if self._pins:
+            return False
+        n_dead = self.num_entries - numpy.count_nonzero(self._entry_enabled)
+        return (n_dead >= self._min_withheld
+            and n_dead > self._rebuild_fraction * self.num_entries)
+
+    def add(self, particles, params):
+        '''
+        Add restraints, returning their slot numbers. Enabled restraints (and
+        disabled ones, unless there are at least min_withheld of them) go
+        straight into the force.
+        '''
+        particles = numpy.asarray(particles, int32).reshape((-1, self._particles.shape[1]))
+        params = [numpy.array(p, float64) for p in params]
+        n = len(particles)
+        slots = numpy.arange(len(self._entries), len(self._entries)+n, dtype=int32)
+        self._particles = numpy.concatenate((self._particles, particles))
+        if self._params is None:
+            self._params = params
+        else:
+            self._params = [numpy.concatenate((a, p)) for a, p in zip(self._params, params)]
+        self._entries = numpy.concatenate((self._entries, -numpy.ones(n, int32)))
+        enabled = params[0] > 0.5
+        if n - numpy.count_nonzero(enabled) >= self._min_withheld:
+            self._add_entries(slots[enabled])
+        else:
+            self._add_entries(slots)
+        return slots
+
+    def update_targets(self, slots, *params):
+        '''
+        Update the parameters of the restraints in the given slots, with the
+        same arguments as the force's own update_targets(). Returns True if a
+        context reinitialisation is needed, either because withheld
+        restraints were enabled and added to the force or because it is due a
+        rebuild.
+        '''
+        slots = numpy.asarray(slots, int32)
+        if not len(slots):
+            return False
+        for store, p in zip(self._params, params):
+            store[slots] = p
+        entries = self._entries[slots]
+        in_force = entries != -1
+        enabled = self._params[0][slots] > 0.5
+        if in_force.any():
+            s = slots[in_force]
+            e = entries[in_force]
+            self.force.update_targets(e, *[p[s] for p in self._params])
+            self._entry_enabled[e] = enabled[in_force]
+        newly_enabled = slots[numpy.logical_and(~in_force, enabled)]
+        self._add_entries(newly_enabled)
+        return len(newly_enabled) > 0 or self.rebuild_needed
+
+    def disable(self, slots):
+        '''
+        Disable the restraints in the given slots without touching any other
+        parameters.
+        '''
+        slots = numpy.asarray(slots, int32)
+        params = [p[slots] for p in self._params]
+        params[0] = numpy.zeros(len(slots))
+        return self.update_targets(slots, *params)
+
+    def entries(self, slots):
+        '''
+        Index in the OpenMM force of the restraint in each slot, or -1 for
+        withheld restraints.
+        '''
+        return self._entries[numpy.asarray(slots, int32)]
+
+    def pin(self, slots):
+        '''
+        Make sure the restraints in the given slots have entries in the
+        force, and keep the force from being rebuilt until :func:`unpin` is
+        called, so that their entries stay put (e.g. while the simulation
+        thread is animating them). Returns True if withheld restraints were
+        added, needing a context reinitialisation.
+        '''
+        slots = numpy.asarray(slots, int32)
+        withheld = slots[self._entries[slots] == -1]
+        self._add_entries(withheld)
+        self._pins += 1
+        return len(withheld) > 0
+
+    def unpin(self):
+        self._pins = max(self._pins-1, 0)
+
+    def rebuild(self):
+        '''
+        Replace the force with a new one holding only the enabled restraints,
+        and return the new force. The caller is responsible for swapping it
+        into the System.
+        '''
+        self.force = self._factory(self.force)
+        self._entries[:] = -1
+        self._entry_enabled = numpy.empty(0, bool)
+        self._add_entries(numpy.where(self._params[0] > 0.5)[0].astype(int32))
+        return self.force
+
+    def _add_entries(self, slots):
+        if not len(slots):
+            return
+        entries = self._add(self.force, self._particles[slots],
+            [p[slots] for p in self._params])
+        self._entries[slots] = entries
+        self._entry_enabled = numpy.concatenate((self._entry_enabled,
+            self._params[0][slots] > 0.5))
+
+
 class Sim_Handler:
     '''
     Responsible for creating a :py:class:`openmm.Simulation`, instantiating and
@@ -1294,14 +2883,35 @@ class Sim_Handler:
         self._params = sim_params
         self._sim_construct = sim_construct
 
-        self._thread_handler = None
-
-        self._paused = False
-        self._sim_running = False
-        self._unstable = True
-        self._unstable_counter = 0
+        # Context and integrator, created on the first start_sim() and kept
+        # if the handler is reused from the Sim_Handler_Cache
+        self._context = None
+        self._integrator = None
+        # Sim_Handler_Cache bookkeeping: {force key: {(pointer, particle
+        # indices): sim_index}} for every restraint/proxy ever added, and the
+        # slots used by the current run
+        self._cache_slots = {}
+        self._touched_slots = {}
+        self._cache_force_info = {}
+        self._reused = False
+        # {force key: Sparse_Restraint_Force} for restraint forces kept
+        # compact, and {force key: Sim_Handler attribute} naming each force
+        self._sparse_forces = {}
+        # {animation ID: force key} for restraint animations running on the
+        # simulation thread
+        self._restraint_animations = {}
+        # Optional SimScheduler sharing the GPU with other simulations, the
+        # device it put this one on, and the weight to schedule it with
+        self._scheduler = None
+        self._scheduler_device = None
+        self._scheduler_weight = 1.0
+        self._reset_run_state()
 
         atoms = self._atoms = sim_construct.all_atoms
+        # Fixed atoms never move, so only the mobile subset is copied back
+        # from the simulation on each update
+        self._set_mobile_atoms(sim_construct.mobile_atoms,
+            sim_construct.mobile_indices)
         # Forcefield used in this simulation
 #        from .forcefields import forcefields
         ff = forcefield_mgr[sim_params.forcefield]
@@ -1313,26 +2923,68 @@ class Sim_Handler:
 
         # A Volume: LinearInterpMapForce dict covering all MDFF forces
         self.mdff_forces = {}
+        # Volume: [region transform, ijk_min, ijk_max, step] describing the
+        # part of each map currently loaded into its MDFF force
+        self._mdff_crops = {}
 
         logger = self.session.logger
+        # A System previously built for exactly these atoms and settings can
+        # be loaded from disk, skipping template assignment and parameterisation
+        system = None
+        cache_key = None
+        if sim_params.system_disk_cache:
+            from .system_cache import system_cache_key, load_cached_system
+            cache_key = system_cache_key(atoms, ff, sim_params)
+            system = load_cached_system(cache_key, len(atoms))
+        if system is None:
+            template_dict = find_residue_templates(sim_construct.all_residues, ff, ligand_db=ligand_db, logger=session.logger)
+        else:
+            template_dict = {}
         # Overall simulation topology
-        template_dict = find_residue_templates(sim_construct.all_residues, ff, ligand_db=ligand_db, logger=session.logger)
         top, residue_templates = self.create_openmm_topology(atoms, template_dict)
         self._topology = top
 
 
         self._temperature = sim_params.temperature
 
-        system = self._system = self._create_openmm_system(ff, top,
-            sim_params, residue_templates)
+        if system is None:
+            system = self._create_openmm_system(ff, top, sim_params,
+                residue_templates)
+            if cache_key is not None:
+                from .system_cache import store_system
+                store_system(cache_key, system,
+                    sim_params.system_disk_cache_max_entries)
+        self._system = system
 
         self.set_fixed_atoms(sim_construct.fixed_atoms)
-        self._thread_handler = None
         # CustomExternalForce handling mouse and haptic interactions
         self._tugging_force = None
+        # GridBiasForce carrying the Ramachandran/rotamer conformational bias
+        self._grid_bias_force = None
+
+    def _reset_run_state(self):
+        '''
+        Clear everything specific to a single run of the simulation, including
+        all trigger handlers. Called on creation, and again when the handler is
+        reused from the :class:`Sim_Handler_Cache`.
+        '''
+        self._thread_handler = None
+        # ID of this run's job in self._scheduler
+        self._scheduler_job = None
+
+        self._paused = False
+        self._sim_running = False
+        self._unstable = True
+        self._unstable_counter = 0
 
         self._force_update_pending = False
         self._coord_update_pending = False
+        # Per-frame handler polling the thread while in free-running equilibration
+        self._continuous_handler = None
+        # Per-frame handler picking up intermediate coordinates during minimisation
+        self._minimization_progress_handler = None
+        # (indices, radius) for a local minimisation to run on the next round
+        self._pending_region_minimization = None
 
         self._context_reinit_pending = False
         self._minimize = False
@@ -1351,6 +3003,188 @@ class Sim_Handler:
         for name in trigger_names:
             t.add_trigger(name)
 
+    @property
+    def reusable(self):
+        '''
+        True if this handler has a Context from a finished run, and can be
+        kept in the :class:`Sim_Handler_Cache`.
+        '''
+        return self._context is not None and not self._sim_running
+
+    def release_context(self):
+        '''
+        Drop the OpenMM Context (and with it any GPU resources) kept after
+        the simulation ended. The handler can't be reused afterwards.
+        '''
+        if self._sim_running:
+            raise RuntimeError('Cannot release the context of a running simulation!')
+        self._context = None
+        self._integrator = None
+
+    @property
+    def reused(self):
+        '''
+        True if this handler was taken from the :class:`Sim_Handler_Cache`
+        rather than built from scratch for the current simulation.
+        '''
+        return self._reused
+
+    def prepare_for_reuse(self, sim_construct, sim_params):
+        '''
+        Set up a handler from the :class:`Sim_Handler_Cache` for a new run. The
+        System, forces and Context from the previous run are kept: only atom
+        masses are changed to match the new mobile selection, and restraints
+        already in the forces are re-attached rather than added again (see
+        :func:`_add_or_restore`). If anything changed that the Context can't
+        pick up as a parameter update, it is reinitialised (keeping its state)
+        when the simulation starts.
+
+        Args:
+            * sim_construct:
+                - a :py:class:`Sim_Construct` with exactly the same
+                  :attr:`all_atoms` as the one this handler was built for
+            * sim_params:
+                - a :py:class:`SimParams` instance
+        '''
+        self._reset_run_state()
+        self._reused = True
+        self._touched_slots = {}
+        self._params = sim_params
+        self._temperature = sim_params.temperature
+        self._sim_construct = sim_construct
+        old_mobile = self._mobile_atoms
+        new_mobile = sim_construct.mobile_atoms
+        newly_fixed = old_mobile.subtract(new_mobile)
+        newly_mobile = new_mobile.subtract(old_mobile)
+        sys = self._system
+        for index in self._atoms.indices(newly_fixed).tolist():
+            sys.setParticleMass(index, 0)
+        masses = newly_mobile.elements.masses
+        for index, mass in zip(self._atoms.indices(newly_mobile).tolist(), masses):
+            sys.setParticleMass(index, mass)
+        self._set_mobile_atoms(new_mobile, sim_construct.mobile_indices)
+        if len(newly_fixed) or len(newly_mobile):
+            self.context_reinit_needed()
+
+    def _add_or_restore(self, key, force, enabled_column, items, indices, add,
+            restore=None):
+        '''
+        Add a set of restraints (or tuggables, MDFF atoms etc.) to a force, and
+        remember where they went. If the handler has been reused from the
+        :class:`Sim_Handler_Cache`, any item already in the force on the same
+        particles is not added again: its sim_index is set back to its old
+        slot and restore(items) is called to push its current parameters.
+
+        Args:
+            * key:
+                - hashable name for the force
+            * force:
+                - the OpenMM force object (None if its entries can't be
+                  disabled, e.g. CMAP)
+            * enabled_column:
+                - index of the "enabled" per-entry parameter in the force
+            * items:
+                - a :py:class:`chimerax.Collection` of the objects to add
+            * indices:
+                - simulation particle indices for items, either as a 1D array
+                  or a list of 1D arrays (one per atom in each entry)
+            * add:
+                - add(items, indices) adds the items to the force, where
+                  indices is an (n x k) array, and returns their sim indices
+                  (or None)
+            * restore:
+                - optional restore(items), normally the matching update_...
+                  method
+        '''
+        if isinstance(indices, (list, tuple)):
+            indices = numpy.column_stack(indices) if len(indices) else numpy.empty((0,1), int)
+        else:
+            indices = numpy.asarray(indices)
+            if indices.ndim == 1:
+                indices = indices[:,None]
+        slots = self._cache_slots.setdefault(key, {})
+        touched = self._touched_slots.setdefault(key, set())
+        self._cache_force_info[key] = (force, enabled_column)
+        ptrs = items._pointers
+        slot_keys = [(p, tuple(i)) for p, i in zip(ptrs.tolist(), indices.tolist())]
+        if self._reused and len(slots):
+            found = numpy.array([k in slots for k in slot_keys], bool)
+            if found.any():
+                old_keys = [k for k, f in zip(slot_keys, found) if f]
+                touched.update(old_keys)
+                if restore is not None:
+                    restored = items[found]
+                    restored.sim_indices = numpy.array([slots[k] for k in old_keys], int32)
+                    restore(restored)
+                keep = numpy.logical_not(found)
+                items = items[keep]
+                indices = indices[keep]
+                slot_keys = [k for k, f in zip(slot_keys, found) if not f]
+        if not len(items):
+            return
+        sim_indices = add(items, indices)
+        self.context_reinit_needed()
+        if sim_indices is None:
+            sim_indices = -numpy.ones(len(items), int32)
+        else:
+            items.sim_indices = sim_indices
+        slots.update(zip(slot_keys, numpy.asarray(sim_indices).tolist()))
+        touched.update(slot_keys)
+
+    def _add_or_restore_one(self, key, force, enabled_column, item, indices,
+            add, restore=None):
+        '''
+        Singular form of :func:`_add_or_restore`. Here add() takes no
+        arguments and returns the new sim index, and restore(item) is called
+        for a re-attached item.
+        '''
+        slot = (item._c_pointer.value, tuple(int(i) for i in indices))
+        slots = self._cache_slots.setdefault(key, {})
+        self._touched_slots.setdefault(key, set()).add(slot)
+        self._cache_force_info[key] = (force, enabled_column)
+        if self._reused and slot in slots:
+            item.sim_index = slots[slot]
+            if restore is not None:
+                restore(item)
+            return
+        sim_index = add()
+        self.context_reinit_needed()
+        slots[slot] = sim_index
+        item.sim_index = sim_index
+
+    def _disable_stale_cached_entries(self):
+        '''
+        Entries left in a reused handler's forces from earlier runs that were
+        not re-attached for this one are switched off, so they can't act on
+        atoms that are now mobile.
+        '''
+        from simtk.openmm import CustomTorsionForce, CustomExternalForce
+        for key, slots in self._cache_slots.items():
+            force, col = self._cache_force_info.get(key, (None, None))
+            if force is None:
+                continue
+            touched = self._touched_slots.get(key, set())
+            stale = [i for k, i in slots.items() if k not in touched and i >= 0]
+            if not stale:
+                continue
+            sf = self._sparse_forces.get(key, None)
+            if sf is not None:
+                if sf.disable(stale):
+                    self.context_reinit_needed()
+                continue
+            if isinstance(force, CustomTorsionForce):
+                get, put = force.getTorsionParameters, force.setTorsionParameters
+            elif isinstance(force, CustomExternalForce):
+                get, put = force.getParticleParameters, force.setParticleParameters
+            else:
+                get, put = force.getBondParameters, force.setBondParameters
+            for i in stale:
+                entry = list(get(i))
+                params = list(entry[-1])
+                params[col] = 0
+                put(i, *entry[:-1], params)
+            force.update_needed = True
+
     @property
     def triggers(self):
         '''
@@ -1365,12 +3199,12 @@ class Sim_Handler:
         ''' Get/set the simulation temperature in Kelvin. '''
         if not self.sim_running:
             return self._temperature
-        t = self._simulation.integrator.getTemperature()
+        t = self._integrator.getTemperature()
         return t.value_in_unit(defaults.OPENMM_TEMPERATURE_UNIT)
 
     @temperature.setter
     def temperature(self, temperature):
-        self._simulation.integrator.setTemperature(temperature)
+        self._integrator.setTemperature(temperature)
 
     @property
     def smoothing(self):
@@ -1477,6 +3311,9 @@ class Sim_Handler:
                 - Add an "adaptive" dihedral restraints force (implemented as a
                   :py:class:`TopOutTorsionForce`)
         '''
+        if self._reused:
+            # All forces are already in the System
+            return
         logger = self.session.logger
         params = self._params
         logger.status('Initialising forces...')
@@ -1494,6 +3331,8 @@ class Sim_Handler:
             self.initialize_dihedral_restraints_force()
         if adaptive_dihedral_restraints:
             self.initialize_adaptive_dihedral_restraints_force()
+        if params.conformation_bias:
+            self.initialize_conformation_bias_force()
 
     def initialize_mdff_forces(self, volumes):
         '''
@@ -1510,18 +3349,20 @@ class Sim_Handler:
     def _prepare_sim(self):
         logger = self.session.logger
         params = self._params
+        if self._context is not None:
+            self._prepare_reused_sim()
+            return
         if params.use_gbsa:
             self.initialize_implicit_solvent(params)
-        integrator = self._prepare_integrator(params)
+        integrator = self._integrator = self._prepare_integrator(params)
         platform = openmm.Platform.getPlatformByName(params.platform)
 
-        properties = {}
         device_index = params.device_index
-        if device_index is not None:
-            if params.platform=="CUDA":
-                properties['CudaDeviceIndex']=str(device_index)
-            elif params.platform=='OpenCL':
-                properties['OpenCLDeviceIndex']=str(device_index)
+        if self._scheduler is not None:
+            if device_index is None:
+                device_index = self._scheduler.device_for_new_job()
+            self._scheduler_device = device_index
+        properties = self._platform_properties(device_index)
 
 
         from simtk.openmm import app
@@ -1531,10 +3372,113 @@ class Sim_Handler:
         c = self._context = s.context
         c.setPositions(0.1*self._atoms.coords)
         c.setVelocitiesToTemperature(self.temperature)
-        self._thread_handler = OpenMM_Thread_Handler(c, params)
+        self._start_thread_handler()
+        logger.status('')
+
+    def _prepare_reused_sim(self):
+        '''
+        Bring a Context kept from an earlier run up to date. Parameter changes
+        are pushed directly; anything needing a reinitialisation is left
+        flagged for :func:`start_sim`.
+        '''
+        c = self._context
+        self._disable_stale_cached_entries()
+        self._integrator.setTemperature(self._temperature)
+        c.setPositions(0.1*self._atoms.coords)
+        c.setVelocitiesToTemperature(self._temperature)
+        for f in self.all_forces:
+            if getattr(f, 'update_needed', False):
+                f.updateParametersInContext(c)
+                f.update_needed = False
+        self._start_thread_handler()
+
+    def _platform_properties(self, device_index):
+        params = self._params
+        properties = {}
+        if device_index is not None:
+            if params.platform=="CUDA":
+                properties['CudaDeviceIndex']=str(device_index)
+            elif params.platform=='OpenCL':
+                properties['OpenCLDeviceIndex']=str(device_index)
+        return properties
+
+    def _create_worker_context(self, positions, temperature, seed, device_index=None):
+        '''
+        Build a second Context on this handler's System, for runs such as
+        replicas and batch refinements that work alongside (or instead of)
+        the main simulation, with a thread handler configured as for the main
+        one. Returns (integrator, context, thread_handler).
+
+        Args:
+            * positions:
+                - starting coordinates in nanometres
+            * temperature:
+                - integrator temperature in Kelvin
+            * seed:
+                - the integrator's random number seed
+            * device_index:
+                - GPU to use. Defaults to that in the simulation parameters
+        '''
+        params = self._params
+        integrator = self._prepare_integrator(params)
+        integrator.setTemperature(temperature*defaults.OPENMM_TEMPERATURE_UNIT)
+        integrator.setRandomNumberSeed(seed)
+        if device_index is None:
+            device_index = params.device_index
+        platform = openmm.Platform.getPlatformByName(params.platform)
+        c = openmm.Context(self._system, integrator, platform,
+            self._platform_properties(device_index))
+        c.setPositions(positions)
+        th = OpenMM_Thread_Handler(c, params)
+        th.instability_check_intervals = (
+            params.instability_check_min_interval,
+            params.instability_check_max_interval)
+        th.check_by_displacement = params.instability_check_by_displacement
+        th.minimizer_precision = params.minimizer_precision
+        self._configure_clash_prescreen(th)
+        # Nothing to share the device with, or the scheduler does the sharing
+        th.min_thread_period = 0
+        return integrator, c, th
+
+    def _configure_clash_prescreen(self, th):
+        params = self._params
+        atoms = self._atoms
+        a1, a2 = atoms.intra_bonds.atoms
+        th.set_clash_prescreen_topology(atoms.element_numbers > 1,
+            numpy.array([atoms.indices(a1), atoms.indices(a2)]).T)
+        th.clash_prescreen = params.clash_prescreen
+        th.clash_prescreen_distance = params.clash_prescreen_distance.value_in_unit(
+            unit.angstrom)
+
+    def _start_thread_handler(self):
+        params = self._params
+        c = self._context
+        th = self._thread_handler = OpenMM_Thread_Handler(c, params)
+        th.instability_check_intervals = (
+            params.instability_check_min_interval,
+            params.instability_check_max_interval)
+        th.check_by_displacement = params.instability_check_by_displacement
+        th.minimizer_precision = params.minimizer_precision
+        th.pacing_parameters = (params.pacing_target_latency,
+            params.pacing_min_steps_per_update, params.pacing_max_steps_per_update)
+        th.adaptive_pacing = params.adaptive_pacing
+        self._configure_clash_prescreen(th)
+        if self._grid_bias_force is not None:
+            th.set_grid_bias_force(self._grid_bias_force)
+            th.grid_bias_interval = params.conformation_bias_interval
+        if self._scheduler is not None:
+            # Sleeping between chunks would only hold up the other jobs on
+            # the device
+            th.min_thread_period = 0
+            self._scheduler_job = self._scheduler.add(th, self._scheduler_device,
+                self._scheduler_weight)
+        from .custom_forces import _Staged_Parameters_Mixin
+        for f in self.all_forces:
+            if isinstance(f, _Staged_Parameters_Mixin):
+                f.thread_handler = th
         self.smoothing = params.trajectory_smoothing
         self.smoothing_alpha = params.smoothing_alpha
-        logger.status('')
+        self._monitor_adaptive_distance_forces()
 
     def _prepare_integrator(self, params):
         integrator = params.integrator
@@ -1559,6 +3503,35 @@ class Sim_Handler:
         _integrator.setConstraintTolerance(params.constraint_tolerance)
         return _integrator
 
+    def use_scheduler(self, scheduler, weight=1.0):
+        '''
+        Share the GPU with other simulations through a
+        :class:`chimerax.isolde.openmm.scheduler.SimScheduler`. Must be called
+        before :func:`start_sim`. Unless the simulation parameters name a
+        device, the simulation is put on the scheduler's least loaded device.
+        While equilibrating, the simulation then advances in chunks of
+        :attr:`SimScheduler.steps_per_chunk` steps, in turn with the other
+        simulations on its device (weight sets its relative share).
+        Minimisation runs as normal.
+        '''
+        if self._sim_running:
+            raise RuntimeError('Cannot change scheduler while the simulation is running!')
+        if self._context is not None and scheduler is not self._scheduler:
+            # The device was fixed when the Context was created
+            raise RuntimeError('This simulation was already set up without the scheduler!')
+        self._scheduler = scheduler
+        self._scheduler_weight = weight
+
+    @property
+    def scheduler(self):
+        '''The SimScheduler running this simulation, if any.'''
+        return self._scheduler
+
+    @property
+    def scheduler_job(self):
+        '''ID of this simulation in :attr:`scheduler`, while running.'''
+        return self._scheduler_job
+
     def start_sim(self):
         '''
         Start the main simulation loop. Automatically runs a minimisation, then
@@ -1572,48 +3545,119 @@ class Sim_Handler:
         self._sim_running = True
         self._startup = True
         self._startup_counter = 0
-        self._minimize_and_go()
+        if self._context_reinit_pending:
+            # A reused Context has to pick up changed masses or force sizes
+            # before anything else
+            delayed_reaction(self.session.triggers, 'new frame',
+                self._reinitialize_context, [], self.thread_handler.thread_finished,
+                self._minimize_and_go, [])
+        else:
+            self._minimize_and_go()
 
-    def find_clashing_atoms(self, max_force = defaults.CLASH_FORCE):
+    def find_clashing_atoms(self, max_force = defaults.CLASH_FORCE, max_n = None):
+        '''
+        Returns the indices of mobile atoms experiencing forces greater than
+        max_force (in decreasing order of force), and the forces themselves.
+        If max_n is given, at most that many atoms are returned.
+        '''
         if not self._sim_running:
             raise RuntimeError('Simulation must be running first!')
-        c = self._context
-        state = c.getState(getForces=True)
-        forces = state.getForces(asNumpy = True)
-        import numpy
-        force_mags = numpy.linalg.norm(forces, axis=1)
-        sort_i = numpy.argsort(force_mags)[::-1]
-        sorted_forces = numpy.sort(force_mags)[::-1]
-        fmask = (sorted_forces > max_force)
-        sc = self._sim_construct
-        mmask = numpy.zeros(fmask.shape, numpy.bool)
-        mmask[sc.all_atoms.indices(sc.mobile_atoms)] = True
-
-        mask = numpy.logical_and(fmask, mmask[sort_i])
-        clashes = sort_i[mask]
-        return clashes, sorted_forces[mask]
+        return self.thread_handler.top_forces(max_force, max_n)
 
 
     def _minimize_and_go(self):
         th = self.thread_handler
-        delayed_reaction(self.session.triggers, 'new frame', th.minimize, [],
+        delayed_reaction(self.session.triggers, 'new frame', self._start_minimization, [],
             th.thread_finished, self._update_coordinates_and_repeat, [True])
 
+    def _start_minimization(self, *args):
+        self.thread_handler.minimize(*args)
+        self._watch_minimization()
+
+    def _start_region_minimization(self, indices, radius):
+        self.thread_handler.minimize_region(indices, radius)
+        self._watch_minimization()
+
+    def _watch_minimization(self):
+        if self._minimization_progress_handler is None:
+            self._minimization_progress_handler = self.session.triggers.add_handler(
+                'new frame', self._minimization_progress_update)
+
+    def _minimization_progress_update(self, *_):
+        '''
+        Called on every new frame while minimisation is running, to show the
+        intermediate coordinates. Pausing or stopping the simulation cancels
+        the minimisation as soon as it is safe to do so.
+        '''
+        from chimerax.core.triggerset import DEREGISTER
+        th = self.thread_handler
+        if th is None or th.thread_finished():
+            self._minimization_progress_handler = None
+            return DEREGISTER
+        if self._pause or self._stop:
+            th.cancel_minimization()
+        if th.latest_coords_to_atoms(self._mobile_atoms, self._mobile_indices):
+            self.triggers.activate_trigger('coord update', None)
+
+    def minimize_region(self, atoms, radius=5.0):
+        '''
+        On the next round of the simulation loop, energy-minimise just the
+        given atoms and their surroundings within radius (Angstroms), with
+        everything else held fixed. Intended for settling the local strain
+        after a discrete change like a rotamer swap, without pausing to
+        minimise the whole model. Atoms not in the simulation are ignored.
+        '''
+        indices = self._atoms.indices(atoms)
+        indices = indices[indices != -1]
+        if not len(indices):
+            return
+        self._pending_region_minimization = (indices, radius)
+
+    def cancel_minimization(self):
+        '''
+        Stop the current round of energy minimisation early, as soon as no
+        atoms are clashing, and move on to equilibration.
+        '''
+        th = self.thread_handler
+        if th is not None and self._minimization_progress_handler is not None:
+            th.cancel_minimization()
+
     def _repeat_step(self):
         th = self.thread_handler
         params = self._params
+        if (self.mdff_maps_coarse and th.minimization_converged
+                and not (th.unstable() or self._unstable)):
+            # The coarse maps have done their job of getting atoms close
+            self.refine_mdff_maps()
         if self._context_reinit_pending:
             f = self._reinitialize_context
             f_args = []
             final_args = []
         elif th.unstable() or self._unstable or not th.minimization_converged:
-            f = th.minimize
+            f = self._start_minimization
             f_args = []
             final_args = [True]
+            # A full minimisation covers any pending local one
+            self._pending_region_minimization = None
+        elif self._pending_region_minimization is not None:
+            f = self._start_region_minimization
+            f_args = self._pending_region_minimization
+            self._pending_region_minimization = None
+            final_args = [True]
         elif self.minimize:
-            f = th.minimize
+            f = self._start_minimization
             f_args=[params.minimization_convergence_tol_end]
             final_args = [True]
+        elif ((params.continuous_equilibration or self._scheduler is not None)
+                and not self._startup):
+            self._unstable = False
+            if self._scheduler is not None:
+                self._scheduler.resume(self._scheduler_job)
+            else:
+                th.step_continuous(params.sim_steps_per_gui_update)
+            self._continuous_handler = self.session.triggers.add_handler(
+                'new frame', self._continuous_update)
+            return
         else:
             f = th.step
             f_args = (params.sim_steps_per_gui_update,)
@@ -1622,6 +3666,53 @@ class Sim_Handler:
             th.thread_finished, self._update_coordinates_and_repeat, final_args)
         self._unstable = False
 
+    def _continuous_update(self, *_):
+        '''
+        Called on every new frame while the simulation thread is running freely
+        (or being run by the scheduler). Picks up the most recently published
+        coordinates (if any) without waiting on the thread, and drops back to
+        the standard loop as soon as anything needs exclusive access to the
+        simulation.
+        '''
+        from chimerax.core.triggerset import DEREGISTER
+        th = self.thread_handler
+        if th is None:
+            self._continuous_handler = None
+            return DEREGISTER
+        if self._scheduler is not None:
+            job = self._scheduler.job_stats(self._scheduler_job)
+            stopped, idle = job['stalled'], not job['running']
+        else:
+            stopped, idle = th.thread_finished(), not th.thread_running()
+        if stopped:
+            # Thread has stopped itself due to instability
+            if self._scheduler_job is not None:
+                self._scheduler.pause(self._scheduler_job)
+            self._continuous_handler = None
+            self._update_coordinates_and_repeat()
+            return DEREGISTER
+        if th.latest_coords_to_atoms(self._mobile_atoms, self._mobile_indices):
+            self.triggers.activate_trigger('coord update', None)
+        if self._force_update_pending and self._flush_staged_force_updates():
+            self._force_update_pending = False
+        if (self._pause or self._stop or self._unstable or self.minimize
+                or self._force_update_pending or self._context_reinit_pending
+                or self._pending_region_minimization is not None
+                or idle):
+            self._finalize_thread()
+            self._continuous_handler = None
+            self._check_state_and_repeat()
+            return DEREGISTER
+
+    def _finalize_thread(self):
+        '''
+        Take the thread handler back from the scheduler (if any), and wait
+        for the worker to finish.
+        '''
+        if self._scheduler_job is not None:
+            self._scheduler.pause(self._scheduler_job)
+        self._thread_handler.finalize_thread()
+
     def _resume(self):
         if self._force_update_pending:
             self._update_forces_in_context_if_needed()
@@ -1638,10 +3729,14 @@ class Sim_Handler:
                 self._startup = False
         th = self.thread_handler
         try:
-            self.atoms.coords = th.coords
+            self._mobile_atoms.coords = th.get_coords(self._mobile_indices)
         except ValueError:
             self.stop(reason='coord length mismatch')
         self.triggers.activate_trigger('coord update', None)
+        self._check_state_and_repeat(reinit_vels)
+
+    def _check_state_and_repeat(self, reinit_vels = False):
+        th = self.thread_handler
         if th.clashing:
             self._unstable = True
             if not self._startup:
@@ -1660,8 +3755,7 @@ class Sim_Handler:
         if reinit_vels:
             th.reinitialize_velocities()
         if self._stop:
-            self._thread_handler.delete()
-            self._thread_handler = None
+            self._delete_thread_handler()
             self._simulation = None
             self._sim_running = False
             self.triggers.activate_trigger('sim terminated', self._stop_reason)
@@ -1749,8 +3843,7 @@ class Sim_Handler:
         self._stop = True
         self._stop_reason = reason
         if self.pause:
-            self._thread_handler.delete()
-            self._thread_handler = None
+            self._delete_thread_handler()
             self._simulation = None
             self._sim_running = False
             self.triggers.activate_trigger('sim terminated', reason)
@@ -1760,6 +3853,21 @@ class Sim_Handler:
         ''' Is the simulation curently running (i.e. started and not destroyed)? '''
         return self._sim_running
 
+    def _delete_thread_handler(self):
+        for f in self.all_forces:
+            if getattr(f, 'thread_handler', None) is not None:
+                f.thread_handler = None
+        if self._scheduler_job is not None:
+            self._scheduler.remove(self._scheduler_job)
+            self._scheduler_job = None
+        self._thread_handler.delete()
+        self._thread_handler = None
+        for key in self._restraint_animations.values():
+            sf = self._sparse_forces.get(key, None)
+            if sf is not None:
+                sf.unpin()
+        self._restraint_animations = {}
+
     def force_update_needed(self):
         '''
         This must be called after any changes to force objects to ensure
@@ -1775,16 +3883,33 @@ class Sim_Handler:
             self._force_update_pending = True
 
 
+    def _flush_staged_force_updates(self):
+        '''
+        Hand any staged restraint parameter changes to the simulation thread.
+        Returns True if there are no other (unstaged) force changes that still
+        need the thread to be stopped.
+        '''
+        th = self._thread_handler
+        if th is None or self._context_reinit_pending:
+            return False
+        th.flush_force_updates()
+        return not any(f.update_needed for f in self.all_forces)
+
     def _update_forces_in_context_if_needed(self):
         if self._context_reinit_pending:
             # defer until the reinit is done
             return
+        if self._flush_staged_force_updates():
+            self._force_update_pending = False
+            return
         context = self._context
         for f in self.all_forces:
             if f.update_needed:
                 f.updateParametersInContext(context)
                 f.update_needed = False
         self._force_update_pending = False
+        if self._thread_handler is not None:
+            self._thread_handler.tighten_instability_checks()
 
     def context_reinit_needed(self):
         '''
@@ -1797,6 +3922,10 @@ class Sim_Handler:
         be reinitialised on the next iteration of the main loop.
         '''
         if not self.sim_running:
+            # A Context kept from an earlier run still has to pick the change
+            # up before the next one starts
+            if self._context is not None:
+                self._context_reinit_pending = True
             return
         # if self._paused:
         #     self._reinitialize_context()
@@ -1805,8 +3934,91 @@ class Sim_Handler:
 
     def _reinitialize_context(self):
         th = self._thread_handler
+        self._rebuild_sparse_forces()
         th.reinitialize_context_and_keep_state()
         self._context_reinit_pending = False
+        self._monitor_adaptive_distance_forces()
+
+    _SPARSE_FORCE_ATTRS = {
+        'position': '_position_restraints_force',
+        'adaptive distance': '_adaptive_distance_restraints_force',
+        'dihedral': '_dihedral_restraint_force',
+        'adaptive dihedral': '_adaptive_dihedral_restraint_force',
+    }
+
+    def _make_sparse(self, key, force, factory, add, num_particles):
+        '''
+        Manage one of the restraint forces with a
+        :class:`Sparse_Restraint_Force` if enabled in the simulation
+        parameters.
+        '''
+        params = self._params
+        if not params.sparse_restraint_forces:
+            return
+        self._sparse_forces[key] = Sparse_Restraint_Force(force, factory, add,
+            num_particles, params.sparse_restraint_min_withheld,
+            params.sparse_restraint_rebuild_fraction)
+
+    def _update_targets(self, key, force, indices, *params):
+        '''
+        Push new restraint parameters to a force, via its
+        :class:`Sparse_Restraint_Force` if it has one.
+        '''
+        sf = self._sparse_forces.get(key, None)
+        if sf is None:
+            force.update_targets(indices, *params)
+        elif sf.update_targets(indices, *params):
+            self.context_reinit_needed()
+        self.force_update_needed()
+
+    def _add_entries(self, key, force_add, indices, params):
+        '''
+        Add restraints to a force (with force_add(indices, *params)), or to
+        its :class:`Sparse_Restraint_Force` if it has one. Returns their
+        sim indices.
+        '''
+        sf = self._sparse_forces.get(key, None)
+        if sf is None:
+            return force_add(indices, *params)
+        return sf.add(indices, params)
+
+    def _single_adder(self, key, indices, params, add):
+        '''
+        The add() function for :func:`_add_or_restore_one`: add itself, or
+        the equivalent through the force's :class:`Sparse_Restraint_Force`.
+        '''
+        sf = self._sparse_forces.get(key, None)
+        if sf is None:
+            return add
+        return lambda: int(sf.add([indices], [[p] for p in params])[0])
+
+    def _rebuild_sparse_forces(self):
+        '''
+        Swap any restraint force due a rebuild for a compacted copy. Only
+        called while the simulation thread is idle, immediately before the
+        context is reinitialised.
+        '''
+        th = self._thread_handler
+        sys = self._system
+        for key, sf in self._sparse_forces.items():
+            if not sf.rebuild_needed:
+                continue
+            old = sf.force
+            ptr = int(old.this)
+            index = [int(sys.getForce(i).this) for i in range(sys.getNumForces())].index(ptr)
+            if th is not None:
+                # Staged parameters are already held by sf
+                th.discard_force_updates(old)
+            new = sf.rebuild()
+            new.setForceGroup(old.getForceGroup())
+            new.thread_handler = getattr(old, 'thread_handler', None)
+            self.all_forces[self.all_forces.index(old)] = new
+            setattr(self, self._SPARSE_FORCE_ATTRS[key], new)
+            if key in self._cache_force_info:
+                self._cache_force_info[key] = (new, self._cache_force_info[key][1])
+            # The System owns (and now deletes) the old force
+            sys.removeForce(index)
+            sys.addForce(new)
 
     ####
     # AMBER-specific CMAP backbone torsion corrections
@@ -1829,7 +4041,6 @@ class Sim_Handler:
         cf = self._amber_cmap_force
         sc = self._atoms
         valid_ramas = ramas[ramas.valids]
-        resnames = valid_ramas.residues.names
         phi_atoms = valid_ramas.phi_dihedrals.atoms
         psi_atoms = valid_ramas.psi_dihedrals.atoms
         phi_indices = numpy.column_stack([sc.indices(atoms) for atoms in phi_atoms])
@@ -1837,10 +4048,11 @@ class Sim_Handler:
         psi_indices = numpy.column_stack([sc.indices(atoms) for atoms in psi_atoms])
         psi_filter = numpy.all(psi_indices!=-1, axis=1)
         combined_filter = numpy.logical_and(phi_filter, psi_filter)
-        resnames = resnames[combined_filter]
-        phi_indices = phi_indices[combined_filter]
-        psi_indices = psi_indices[combined_filter]
-        cf.add_torsions(resnames, phi_indices, psi_indices)
+        def add(ramas, indices):
+            cf.add_torsions(ramas.residues.names, indices[:,:4], indices[:,4:])
+        self._add_or_restore('cmap', None, None, valid_ramas[combined_filter],
+            numpy.column_stack((phi_indices[combined_filter], psi_indices[combined_filter])),
+            add)
 
     ####
     # Dihedral restraints
@@ -1859,6 +4071,9 @@ class Sim_Handler:
         df = self._dihedral_restraint_force = FlatBottomTorsionRestraintForce()
         self._system.addForce(df)
         self.all_forces.append(df)
+        self._make_sparse('dihedral', df,
+            lambda old: FlatBottomTorsionRestraintForce(),
+            lambda f, p, params: f.add_torsions(list(p.T), *params), 4)
 
     def add_dihedral_restraints(self, restraints):
         '''
@@ -1881,9 +4096,12 @@ class Sim_Handler:
         atom_indices = [a[ifilter] for a in atom_indices]
         #atom_indices = atom_indices[ifilter]
         restraints = restraints[ifilter]
-        restraints.sim_indices = force.add_torsions(atom_indices,
-            restraints.enableds, restraints.spring_constants, restraints.targets, restraints.cutoffs)
-        self.context_reinit_needed()
+        def add(r, indices):
+            return self._add_entries('dihedral',
+                lambda i, *p: force.add_torsions(list(i.T), *p), indices,
+                (r.enableds, r.spring_constants, r.targets, r.cutoffs))
+        self._add_or_restore('dihedral', force, 0, restraints, atom_indices,
+            add, self.update_dihedral_restraints)
 
     def add_dihedral_restraint(self, restraint):
         '''
@@ -1898,9 +4116,12 @@ class Sim_Handler:
         all_atoms = self._atoms
         dihedral_atoms = restraint.dihedral.atoms
         indices = [all_atoms.index(atom) for atom in dihedral_atoms]
-        restraint.sim_index = force.add_torsion(*indices,
-            (float(restraint.enabled), restraint.spring_constant, restraint.target, cos(restraint.cutoff)))
-        self.context_reinit_needed()
+        self._add_or_restore_one('dihedral', force, 0, restraint, indices,
+            self._single_adder('dihedral', indices, (float(restraint.enabled),
+                restraint.spring_constant, restraint.target, restraint.cutoff),
+                lambda: force.add_torsion(*indices, (float(restraint.enabled),
+                restraint.spring_constant, restraint.target, cos(restraint.cutoff)))),
+            self.update_dihedral_restraint)
 
         ##
         # During simulation
@@ -1919,9 +4140,8 @@ class Sim_Handler:
         '''
         force = self._dihedral_restraint_force
         restraints = restraints[restraints.sim_indices != -1]
-        force.update_targets(restraints.sim_indices,
+        self._update_targets('dihedral', force, restraints.sim_indices,
             restraints.enableds, restraints.spring_constants, restraints.targets, restraints.cutoffs)
-        self.force_update_needed()
 
     def update_dihedral_restraint(self, restraint):
         '''
@@ -1935,10 +4155,9 @@ class Sim_Handler:
                   ignored.
         '''
         force = self._dihedral_restraint_force
-        force.update_target(restraint.sim_index,
-            enabled=restraint.enabled, k=restraint.spring_constant,
-            target=restraint.target, cutoff=restraint.cutoff)
-        self.force_update_needed()
+        self._update_targets('dihedral', force, [restraint.sim_index],
+            [restraint.enabled], [restraint.spring_constant],
+            [restraint.target], [restraint.cutoff])
 
     #####
     # Adaptive Dihedral Restraints
@@ -1953,6 +4172,9 @@ class Sim_Handler:
         df = self._adaptive_dihedral_restraint_force = TopOutTorsionForce()
         self._system.addForce(df)
         self.all_forces.append(df)
+        self._make_sparse('adaptive dihedral', df,
+            lambda old: TopOutTorsionForce(),
+            lambda f, p, params: f.add_torsions(list(p.T), *params), 4)
 
     def add_adaptive_dihedral_restraints(self, restraints):
         '''
@@ -1974,9 +4196,12 @@ class Sim_Handler:
         atom_indices = [a[ifilter] for a in atom_indices]
         #atom_indices = atom_indices[ifilter]
         restraints = restraints[ifilter]
-        restraints.sim_indices = force.add_torsions(atom_indices,
-            restraints.enableds, restraints.spring_constants, restraints.targets, restraints.kappas)
-        self.context_reinit_needed()
+        def add(r, indices):
+            return self._add_entries('adaptive dihedral',
+                lambda i, *p: force.add_torsions(list(i.T), *p), indices,
+                (r.enableds, r.spring_constants, r.targets, r.kappas))
+        self._add_or_restore('adaptive dihedral', force, 0, restraints,
+            atom_indices, add, self.update_adaptive_dihedral_restraints)
 
     def add_adaptive_dihedral_restraint(self, restraint):
         '''
@@ -1990,9 +4215,12 @@ class Sim_Handler:
         all_atoms = self._atoms
         dihedral_atoms = restraint.dihedral.atoms
         indices = [all_atoms.index(atom) for atom in dihedral_atoms]
-        restraint.sim_index = force.add_torsion(*indices,
-            (float(restraint.enabled), restraint.spring_constant, restraint.target, cos(restraint.kappa)))
-        self.context_reinit_needed()
+        self._add_or_restore_one('adaptive dihedral', force, 0, restraint, indices,
+            self._single_adder('adaptive dihedral', indices, (float(restraint.enabled),
+                restraint.spring_constant, restraint.target, restraint.kappa),
+                lambda: force.add_torsion(*indices, (float(restraint.enabled),
+                restraint.spring_constant, restraint.target, cos(restraint.kappa)))),
+            self.update_adaptive_dihedral_restraint)
 
     def update_adaptive_dihedral_restraints(self, restraints):
         '''
@@ -2007,9 +4235,8 @@ class Sim_Handler:
         '''
         force = self._adaptive_dihedral_restraint_force
         restraints = restraints[restraints.sim_indices != -1]
-        force.update_targets(restraints.sim_indices,
+        self._update_targets('adaptive dihedral', force, restraints.sim_indices,
             restraints.enableds, restraints.spring_constants, restraints.targets, restraints.kappas)
-        self.force_update_needed()
 
     def update_adaptive_dihedral_restraint(self, restraint):
         '''
@@ -2023,10 +4250,9 @@ class Sim_Handler:
                   ignored.
         '''
         force = self._adaptive_dihedral_restraint_force
-        force.update_target(restraint.sim_index,
-            enabled=restraint.enabled, k=restraint.spring_constant,
-            target=restraint.target, kappa=restraint.kappa)
-        self.force_update_needed()
+        self._update_targets('adaptive dihedral', force, [restraint.sim_index],
+            [restraint.enabled], [restraint.spring_constant],
+            [restraint.target], [restraint.kappa])
 
 
 
@@ -2070,9 +4296,11 @@ class Sim_Handler:
         ifilter = numpy.all(indices!=-1, axis=0)
         indices = [i[ifilter] for i in indices]
         restraints = restraints[ifilter]
-        restraints.sim_indices = force.add_bonds(indices,
-            restraints.enableds, restraints.spring_constants, restraints.targets/10)
-        self.context_reinit_needed()
+        def add(r, indices):
+            return force.add_bonds(list(indices.T),
+                r.enableds, r.spring_constants, r.targets/10)
+        self._add_or_restore('distance', force, 0, restraints, indices,
+            add, self.update_distance_restraints)
 
     def add_distance_restraint(self, restraint):
         '''
@@ -2090,9 +4318,10 @@ class Sim_Handler:
         indices = [all_atoms.index(atom) for atom in dr_atoms]
         if -1 in indices:
             raise TypeError('At least one atom in this restraint is not in the simulation!')
-        restraint.sim_index = force.addBond(*indices,
-            (float(restraint.enabled), restraint.spring_constant, restraint.target/10))
-        self.context_reinit_needed()
+        self._add_or_restore_one('distance', force, 0, restraint, indices,
+            lambda: force.addBond(*indices, (float(restraint.enabled),
+                restraint.spring_constant, restraint.target/10)),
+            self.update_distance_restraint)
 
         ##
         # During simulation
@@ -2125,8 +4354,8 @@ class Sim_Handler:
                 - a :py:class:`DistanceRestraint` instance
         '''
         force = self._distance_restraints_force
-        force.update_target(restraint.sim_index,
-            restraint.enabled, k=restraint.spring_constant, target=restraint.target/10)
+        force.update_targets([restraint.sim_index],
+            [restraint.enabled], [restraint.spring_constant], [restraint.target/10])
         self.force_update_needed()
 
     ####
@@ -2148,6 +4377,9 @@ class Sim_Handler:
         f = self._adaptive_distance_restraints_force = AdaptiveDistanceRestraintForce()
         self._system.addForce(f)
         self.all_forces.append(f)
+        self._make_sparse('adaptive distance', f,
+            lambda old: AdaptiveDistanceRestraintForce(),
+            lambda f, p, params: f.add_bonds(list(p.T), *params), 2)
         return f
 
     def add_adaptive_distance_restraints(self, restraints):
@@ -2167,11 +4399,13 @@ class Sim_Handler:
         ifilter = numpy.all(indices!=-1, axis=0)
         indices = [i[ifilter] for i in indices]
         restraints = restraints[ifilter]
-        restraints.sim_indices = force.add_bonds(indices,
-            restraints.enableds, restraints.kappas, restraints.cs/10,
-            restraints.targets/10, restraints.tolerances/10, restraints.alphas
-        )
-        self.context_reinit_needed()
+        def add(r, indices):
+            return self._add_entries('adaptive distance',
+                lambda i, *p: force.add_bonds(list(i.T), *p), indices,
+                (r.enableds, r.kappas, r.cs/10, r.targets/10, r.tolerances/10,
+                r.alphas))
+        self._add_or_restore('adaptive distance', force, 0, restraints, indices,
+            add, self.update_adaptive_distance_restraints)
 
     def add_adaptive_distance_restraint(self, restraint):
         '''
@@ -2189,15 +4423,48 @@ class Sim_Handler:
         indices = [all_atoms.index(atom) for atom in dr_atoms]
         if -1 in indices:
             raise TypeError('At least one atom in this restraint is not in the simulation!')
-        restraint.sim_index = force.addBond(*indices,
-            (float(restraint.enabled), restraint.kappa, restraint.c/10,
-            restraint.target/10, restraint.tolerance/10, restraint.alpha))
-        self.context_reinit_needed()
+        params = (float(restraint.enabled), restraint.kappa, restraint.c/10,
+            restraint.target/10, restraint.tolerance/10, restraint.alpha)
+        self._add_or_restore_one('adaptive distance', force, 0, restraint, indices,
+            self._single_adder('adaptive distance', indices, params,
+                lambda: force.addBond(*indices, params)),
+            self.update_adaptive_distance_restraint)
 
         ##
         # During simulation
         ##
 
+    def _monitor_adaptive_distance_forces(self):
+        th = self._thread_handler
+        if th is None or not self._params.adaptive_distance_forces_from_sim:
+            return
+        th.monitor_adaptive_distance_force(
+            getattr(self, '_adaptive_distance_restraints_force', None))
+
+    def latest_adaptive_distance_restraint_forces(self, sim_indices):
+        '''
+        Returns the force (kJ/mol/Angstrom) currently applied by the adaptive
+        distance restraints with the given sim indices, as published by the
+        simulation thread along with the most recent coordinates. Returns
+        None if nothing new has been published since the last call, or if
+        :attr:`adaptive_distance_forces_from_sim` is off. Call at most once
+        per coordinate update.
+        '''
+        th = self._thread_handler
+        if th is None:
+            return None
+        forces = th.latest_bond_forces()
+        if forces is None:
+            return None
+        sim_indices = numpy.asarray(sim_indices, int32)
+        sf = self._sparse_forces.get('adaptive distance', None)
+        entries = sim_indices if sf is None else sf.entries(sim_indices)
+        out = numpy.zeros(len(entries), float64)
+        # Withheld restraints are disabled, so apply no force
+        valid = numpy.logical_and(entries >= 0, entries < len(forces))
+        out[valid] = forces[entries[valid]]/10
+        return out
+
     def update_adaptive_distance_restraints(self, restraints):
         '''
         Update the simulation to reflect the current parameters of the given
@@ -2209,10 +4476,9 @@ class Sim_Handler:
         '''
         force = self._adaptive_distance_restraints_force
         restraints = restraints[restraints.sim_indices != -1]
-        force.update_targets(restraints.sim_indices,
+        self._update_targets('adaptive distance', force, restraints.sim_indices,
             restraints.enableds, restraints.kappas, restraints.cs/10,
             restraints.targets/10, restraints.tolerances/10, restraints.alphas)
-        self.force_update_needed()
 
     def update_adaptive_distance_restraint(self, restraint):
         '''
@@ -2224,10 +4490,9 @@ class Sim_Handler:
                 - a :py:class:`DistanceRestraint` instance
         '''
         force = self._adaptive_distance_restraints_force
-        force.update_target(restraint.sim_index,
-            restraint.enabled, restraint.kappa, restraint.c/10,
-            restraint.target/10, restraint.tolerance/10, restraint.alpha)
-        self.force_update_needed()
+        self._update_targets('adaptive distance', force, [restraint.sim_index],
+            [restraint.enabled], [restraint.kappa], [restraint.c/10],
+            [restraint.target/10], [restraint.tolerance/10], [restraint.alpha])
 
 
 
@@ -2252,6 +4517,9 @@ class Sim_Handler:
         rf = self._position_restraints_force = TopOutRestraintForce(max_force)
         self._system.addForce(rf)
         self.all_forces.append(rf)
+        self._make_sparse('position', rf,
+            lambda old: TopOutRestraintForce(old.max_force),
+            lambda f, p, params: f.add_particles(p[:,0], *params), 1)
         return rf
 
     def add_position_restraints(self, restraints):
@@ -2267,9 +4535,12 @@ class Sim_Handler:
         force = self._position_restraints_force
         all_atoms = self._atoms
         indices = all_atoms.indices(restraints.atoms)
-        restraints.sim_indices = force.add_particles(indices,
-            restraints.enableds, restraints.spring_constants, restraints.targets/10)
-        self.context_reinit_needed()
+        def add(r, indices):
+            return self._add_entries('position',
+                lambda i, *p: force.add_particles(i[:,0], *p), indices,
+                (r.enableds, r.spring_constants, r.targets/10))
+        self._add_or_restore('position', force, 0, restraints, indices,
+            add, self.update_position_restraints)
 
     def add_position_restraint(self, restraint):
         '''
@@ -2282,11 +4553,14 @@ class Sim_Handler:
                 - a :py:class:`PositionRestraint` instance
         '''
         force = self._position_restraints_force
-        index = self._all_atoms.index(restraint.atom)
+        index = self._atoms.index(restraint.atom)
         target = (restraint.target/10).tolist()
-        restraint.sim_index = force.addParticle(index,
-            (restraint.enabled, restraint.spring_constant, *target))
-        self.context_reinit_needed()
+        self._add_or_restore_one('position', force, 0, restraint, [index],
+            self._single_adder('position', [index], (float(restraint.enabled),
+                restraint.spring_constant, restraint.target/10),
+                lambda: force.addParticle(index,
+                (restraint.enabled, restraint.spring_constant, *target))),
+            self.update_position_restraint)
 
         ##
         # During simulation
@@ -2304,9 +4578,8 @@ class Sim_Handler:
         '''
         force = self._position_restraints_force
         restraints = restraints[restraints.sim_indices != -1]
-        force.update_targets(restraints.sim_indices,
+        self._update_targets('position', force, restraints.sim_indices,
             restraints.enableds, restraints.spring_constants, restraints.targets/10)
-        self.force_update_needed()
 
     def update_position_restraint(self, restraint):
         '''
@@ -2319,9 +4592,8 @@ class Sim_Handler:
                 - a :py:class:`PositionRestraint` instance
         '''
         force = self._position_restraints_force
-        force.update_target(restraint.sim_index,
-            restraint.enabled, restraint.spring_constant, restraint.target/10)
-        self.force_update_needed()
+        self._update_targets('position', force, [restraint.sim_index],
+            [restraint.enabled], [restraint.spring_constant], [restraint.target/10])
 
     ####
     # Tugging force
@@ -2345,6 +4617,142 @@ class Sim_Handler:
         self._system.addForce(f)
         self.all_forces.append(f)
 
+    def initialize_conformation_bias_force(self):
+        '''
+        Add the :class:`GridBiasForce` through which :func:`bias_ramas` and
+        :func:`bias_rotamers` act. Must be called before the simulation
+        starts. Costs a little on every step even when no bias is applied,
+        so is only added if the conformation_bias parameter is True.
+        '''
+        from .custom_forces import GridBiasForce
+        f = self._grid_bias_force = GridBiasForce(len(self._atoms))
+        self._system.addForce(f)
+        self.all_forces.append(f)
+
+    def _grid_bias_thread_handler(self):
+        if self._grid_bias_force is None:
+            raise TypeError('This simulation was started without the '
+                'conformation bias force! Set the conformation_bias '
+                'simulation parameter to use it.')
+        th = self._thread_handler
+        if th is None:
+            raise TypeError('No simulation running!')
+        # Interrupts a continuous run, which picks up again on the next frame
+        self._finalize_thread()
+        return th
+
+    def _add_grid_bias_terms(self, th, grid_pointer, dihedral_atoms, k):
+        '''
+        dihedral_atoms is a list (one per term) of lists of four-tuples of
+        Atoms. Terms with any atom outside the simulation are dropped.
+        Returns the number of terms added.
+        '''
+        atoms = self._atoms
+        particles = numpy.array([[atoms.indices(a) for a in d] for d in dihedral_atoms])
+        # (dim, 4, n) -> (n, dim, 4)
+        particles = particles.transpose((2, 0, 1))
+        keep = numpy.all(particles >= 0, axis=(1, 2))
+        if not numpy.any(keep):
+            return 0
+        grid = th.add_grid_bias_grid(grid_pointer)
+        th.add_grid_bias_terms(grid, particles[keep], k)
+        return int(numpy.count_nonzero(keep))
+
+    def bias_ramas(self, ramas, k=None):
+        '''
+        Bias the backbone of each residue towards the favoured regions of its
+        Ramachandran plot, with energy :math:`-k \ln(P(\phi, \psi))` taken
+        straight from the validation grids (no CMAP or tabulated functions
+        are built). Useful for coaxing poorly-fitted stretches towards
+        sensible conformations. Requires the conformation_bias simulation
+        parameter. Returns the number of residues biased.
+
+        Args:
+            * ramas:
+                - a :class:`Ramas` instance
+            * k:
+                - strength in kJ/mol per unit :math:`\ln(P)`. Defaults to the
+                  conformation_bias_strength simulation parameter.
+        '''
+        th = self._grid_bias_thread_handler()
+        if k is None:
+            k = self._params.conformation_bias_strength.value_in_unit(unit.kilojoule_per_mole)
+        from .. import session_extensions as sx
+        rama_mgr = sx.get_ramachandran_mgr(self.session)
+        ramas = ramas[ramas.valids]
+        cases = ramas.cases
+        count = 0
+        for case in numpy.unique(cases):
+            if case == 0:
+                continue
+            r = ramas[cases == case]
+            count += self._add_grid_bias_terms(th,
+                rama_mgr._log_interpolator_pointer(int(case)),
+                (r.phi_dihedrals.atoms, r.psi_dihedrals.atoms), k)
+        return count
+
+    def bias_rotamers(self, rotamers, k=None):
+        '''
+        Bias each rotamer towards the favoured regions of its chi-angle
+        distribution, with energy :math:`-k \ln(P(\chi_1, ...))` taken
+        straight from the validation grids. Requires the conformation_bias
+        simulation parameter. Returns the number of rotamers biased.
+
+        Args:
+            * rotamers:
+                - a :class:`Rotamers` instance
+            * k:
+                - strength in kJ/mol per unit :math:`\ln(P)`. Defaults to the
+                  conformation_bias_strength simulation parameter.
+        '''
+        th = self._grid_bias_thread_handler()
+        if k is None:
+            k = self._params.conformation_bias_strength.value_in_unit(unit.kilojoule_per_mole)
+        from .. import session_extensions as sx
+        rota_mgr = sx.get_rotamer_mgr(self.session)
+        by_name = {}
+        for rot in rotamers:
+            by_name.setdefault(rot.residue.name, []).append(rot)
+        from chimerax.atomic import concatenate
+        count = 0
+        for name, rots in by_name.items():
+            chis = [rot.chi_dihedrals for rot in rots]
+            dihedral_atoms = [concatenate([c[i:i+1] for c in chis]).atoms
+                for i in range(len(chis[0]))]
+            count += self._add_grid_bias_terms(th,
+                rota_mgr._log_interpolator_pointer(name), dihedral_atoms, k)
+        return count
+
+    def clear_conformation_bias(self):
+        '''
+        Remove all Ramachandran and rotamer bias terms added with
+        :func:`bias_ramas` or :func:`bias_rotamers`.
+        '''
+        th = self._thread_handler
+        if th is None or self._grid_bias_force is None:
+            return
+        self._finalize_thread()
+        th.clear_grid_bias()
+
+    @property
+    def conformation_bias_scale(self):
+        '''
+        Multiplier on the strength of every Ramachandran and rotamer bias
+        term. Can be changed while the simulation is running; zero switches
+        the bias off without removing the terms.
+        '''
+        th = self._thread_handler
+        if th is None:
+            return 1.0
+        return th.grid_bias_scale
+
+    @conformation_bias_scale.setter
+    def conformation_bias_scale(self, scale):
+        th = self._thread_handler
+        if th is None:
+            raise TypeError('No simulation running!')
+        th.grid_bias_scale = scale
+
     def add_tuggables(self, tuggables):
         '''
         Add a set of tuggable atom proxies to the simulation. Sets
@@ -2358,9 +4766,11 @@ class Sim_Handler:
         force = self._tugging_force
         all_atoms = self._atoms
         indices = all_atoms.indices(tuggables.atoms)
-        tuggables.sim_indices = force.add_particles(indices,
-            tuggables.enableds, tuggables.spring_constants, tuggables.targets/10)
-        self.context_reinit_needed()
+        def add(t, indices):
+            return force.add_particles(indices[:,0],
+                t.enableds, t.spring_constants, t.targets/10)
+        self._add_or_restore('tuggable', force, 0, tuggables, indices,
+            add, self.update_tuggables)
 
     def add_tuggable(self, tuggable):
         '''
@@ -2373,16 +4783,77 @@ class Sim_Handler:
                 - a :py:class:`TuggableAtom` instance
         '''
         force = self._tugging_force
-        index = self._all_atoms.index(tuggable.atom)
+        index = self._atoms.index(tuggable.atom)
         target = (tuggable.target/10).tolist()
-        tuggable.sim_index = force.addParticle(index,
-            (float(tuggable.enabled), tuggable.spring_constant, *target))
-        self.context_reinit_needed()
+        self._add_or_restore_one('tuggable', force, 0, tuggable, [index],
+            lambda: force.addParticle(index,
+                (float(tuggable.enabled), tuggable.spring_constant, *target)),
+            self.update_tuggable)
 
         ##
         # During simulation
         ##
 
+    def attach_haptic_device(self, link, tuggable):
+        '''
+        Hand a tuggable atom over to a haptic device, which then tugs it
+        directly from the device thread without going through the GUI. Any
+        atom previously tugged by the same device is released.
+
+        Args:
+            * link:
+                - pointer to the device's Haptic_Link
+            * tuggable:
+                - a :class:`TuggableAtom` in this simulation
+        '''
+        if tuggable.sim_index == -1:
+            raise TypeError('This atom is not tuggable in the current simulation!')
+        th = self._thread_handler
+        # Interrupts a continuous run, which picks up again on the next frame
+        self._finalize_thread()
+        th.attach_haptic_link(link, self._tugging_force, tuggable.sim_index)
+
+    def detach_haptic_device(self, link):
+        th = self._thread_handler
+        if th is None:
+            return
+        self._finalize_thread()
+        th.detach_haptic_link(link)
+
+    def record_trajectory(self, filename, precision=0.001, keyframe_interval=100,
+            record_interval=1):
+        '''
+        Record the simulation to an ISOLDE trajectory (.itrj) file until
+        :func:`stop_recording` is called or the simulation ends. Along with
+        the trajectory, a file named filename+'.atoms.json' describing the
+        simulated atoms is written, so that the trajectory can later be
+        replayed onto the model with
+        :class:`chimerax.isolde.openmm.trajectory.TrajectoryReader`. See
+        :func:`OpenMM_Thread_Handler.start_recording` for the arguments.
+        '''
+        th = self._thread_handler
+        if th is None:
+            raise TypeError('No simulation running!')
+        from .trajectory import write_atom_list
+        write_atom_list(filename, self._atoms)
+        self._finalize_thread()
+        th.start_recording(filename, precision=precision,
+            keyframe_interval=keyframe_interval, record_interval=record_interval)
+
+    def stop_recording(self):
+        '''
+        Stop recording the trajectory. Returns the recording statistics (see
+        :attr:`OpenMM_Thread_Handler.recording_stats`), or None if no
+        trajectory was being recorded.
+        '''
+        th = self._thread_handler
+        if th is None or not th.recording:
+            return None
+        self._finalize_thread()
+        stats = th.recording_stats
+        th.stop_recording()
+        return stats
+
     def update_tuggables(self, tuggables):
         '''
         Update the simulation to reflect the current parameters (target
@@ -2395,6 +4866,15 @@ class Sim_Handler:
         '''
         force = self._tugging_force
         tuggables = tuggables[tuggables.sim_indices !=-1]
+        th = self._thread_handler
+        if th is not None:
+            # Tugging is interactive, so skip the once-per-frame staging
+            params = numpy.empty((len(tuggables),5), numpy.float64)
+            params[:,0] = tuggables.enableds
+            params[:,1] = tuggables.spring_constants
+            params[:,2:] = tuggables.targets/10
+            th.push_tug_targets(force, tuggables.sim_indices, params)
+            return
         force.update_targets(tuggables.sim_indices,
             tuggables.enableds, tuggables.spring_constants, tuggables.targets/10)
         self.force_update_needed()
@@ -2409,10 +4889,8 @@ class Sim_Handler:
             * tuggable:
                 - a :py:class:`TuggableAtom` instance
         '''
-        force = self._tugging_force
-        force.update_target(tuggable.sim_index,
-            tuggable.enabled, tuggable.spring_constant, tuggable.target/10)
-        self.force_update_needed()
+        from ..molarray import TuggableAtoms
+        self.update_tuggables(TuggableAtoms([tuggable]))
 
     ####
     # MDFF forces
@@ -2427,9 +4905,14 @@ class Sim_Handler:
         Prepare an MDFF map from a :py:class:`chimerax.Volume` instance.  The
         Volume instance is expected to have a single :attr:`region` applied that
         is big enough to cover the expected range of motion of the MDFF atoms
-        that will be coupled to it (and for performance/memory reasons, ideally
-        not too much bigger). Must be called before the simulation is started,
-        and before any MDFF atoms are added.
+        that will be coupled to it. Must be called before the simulation is
+        started, and before any MDFF atoms are added.
+
+        Only the part of the region within :attr:`mdff_crop_padding` Angstroms
+        of the mobile atoms is sent to the GPU. If :attr:`mdff_coarse_step` is
+        greater than 1, the map starts out downsampled by that factor and is
+        switched to full resolution once the initial minimisation converges
+        (see :func:`refine_mdff_maps`).
 
         Args:
             * volume:
@@ -2439,35 +4922,95 @@ class Sim_Handler:
             CubicInterpMapForce_Low_Memory
             )
         v = volume
+        params = self._params
         region = v.region
         # Ensure that the region ijk step size is [1,1,1]
         v.new_region(ijk_min=region[0], ijk_max=region[1], ijk_step=[1,1,1])
         data = v.region_matrix()
-        if not data.data.c_contiguous:
-            data_copy = numpy.empty(data.shape, numpy.float32)
-            data_copy[:] = data
-            data = data_copy
-        if data.size < self._params.max_cubic_map_size:
+        from chimerax.core.geometry import Place
+        tf = v.data.xyz_to_ijk_transform
+        # Shift the transform to the origin of the region
+        region_tf = Place(axes=tf.axes(), origin = tf.origin() -
+            v.data.xyz_to_ijk(v.region_origin_and_step(v.region)[0])).matrix
+        ijk_min, ijk_max = self._mdff_crop_bounds(data.shape, region_tf)
+        step = max(int(params.mdff_coarse_step), 1)
+        if v in self.mdff_forces:
+            # Handler reused from the cache: the force is already in the
+            # System, and only needs the map for the new region
+            self._mdff_crops[v] = [region_tf, ijk_min, ijk_max, step]
+            self._reload_mdff_map(v)
+            return
+        # Choose the implementation by the full-resolution size, so that the
+        # force can still hold the map after refinement
+        if numpy.prod(ijk_max-ijk_min+1) < params.max_cubic_map_size:
             Map_Force = CubicInterpMapForce
         else:
             print("Map is too large for fast cubic interpolation on the GPU!"\
                   +" Switching to slower, more memory-efficient implementation.")
             Map_Force = CubicInterpMapForce_Low_Memory
-        from chimerax.core.geometry import Place
-        tf = v.data.xyz_to_ijk_transform
-        # Shift the transform to the origin of the region
-        region_tf = Place(axes=tf.axes(), origin = tf.origin() -
-            v.data.xyz_to_ijk(v.region_origin_and_step(v.region)[0]))
+        cropped, cropped_tf = mdff_map_extract(data, region_tf, ijk_min,
+            ijk_max, step)
         # In OpenMM forces, parameters can only be per-particle, or global to
         # the entire context. So if we want a parameter that's constant to all
         # particles in this force, it needs a unique name so it doesn't
         # interfere with other instances of the same force.
         suffix = str(len(self.mdff_forces)+1)
-        f = Map_Force(data, region_tf.matrix, suffix, units='angstroms')
+        f = Map_Force(cropped, cropped_tf, suffix, units='angstroms')
         f.setForceGroup(1)
         self.all_forces.append(f)
         self._system.addForce(f)
         self.mdff_forces[v] = f
+        self._mdff_crops[v] = [region_tf, ijk_min, ijk_max, step]
+
+    def _mdff_crop_bounds(self, data_shape, region_tf):
+        padding = self._params.mdff_crop_padding
+        if padding is None or padding <= 0:
+            coords = None
+        else:
+            coords = self._mobile_atoms.coords
+        return mdff_map_crop_bounds(data_shape, region_tf, coords, padding)
+
+    def _reload_mdff_map(self, volume):
+        region_tf, ijk_min, ijk_max, step = self._mdff_crops[volume]
+        data, tf = mdff_map_extract(volume.region_matrix(), region_tf,
+            ijk_min, ijk_max, step)
+        self.mdff_forces[volume].set_map(data, tf, units='angstroms')
+        self.context_reinit_needed()
+
+    def recrop_mdff_maps(self):
+        '''
+        Grow the loaded part of each MDFF map as needed to cover the current
+        mobile atoms (plus :attr:`mdff_crop_padding`). The cropped box only
+        ever grows, and maps that already cover the mobile atoms are left
+        alone. Any change requires a context reinitialisation, which is
+        flagged automatically. Called by :func:`release_fixed_atoms`.
+        '''
+        for v, crop in self._mdff_crops.items():
+            ijk_min, ijk_max = self._mdff_crop_bounds(
+                v.region_matrix().shape, crop[0])
+            new_min = numpy.minimum(ijk_min, crop[1])
+            new_max = numpy.maximum(ijk_max, crop[2])
+            if numpy.any(new_min != crop[1]) or numpy.any(new_max != crop[2]):
+                crop[1], crop[2] = new_min, new_max
+                self._reload_mdff_map(v)
+
+    def refine_mdff_maps(self):
+        '''
+        Replace any downsampled MDFF maps (see :attr:`mdff_coarse_step`) with
+        their full-resolution equivalents. Requires a context
+        reinitialisation, which is flagged automatically.
+        '''
+        for v, crop in self._mdff_crops.items():
+            if crop[3] != 1:
+                crop[3] = 1
+                self._reload_mdff_map(v)
+
+    @property
+    def mdff_maps_coarse(self):
+        '''
+        True if any MDFF map is currently loaded at reduced resolution.
+        '''
+        return any(crop[3] != 1 for crop in self._mdff_crops.values())
 
     def add_mdff_atoms(self, mdff_atoms, volume):
         '''
@@ -2484,9 +5027,10 @@ class Sim_Handler:
         f = self.mdff_forces[volume]
         all_atoms = self._atoms
         indices = all_atoms.indices(mdff_atoms.atoms)
-        mdff_atoms.sim_indices = f.add_atoms(indices,
-            mdff_atoms.coupling_constants, mdff_atoms.enableds)
-        self.context_reinit_needed()
+        def add(a, indices):
+            return f.add_atoms(indices[:,0], a.coupling_constants, a.enableds)
+        self._add_or_restore(('mdff', volume), f, 1, mdff_atoms, indices,
+            add, lambda a: self.update_mdff_atoms(a, volume))
 
     def add_mdff_atom(self, mdff_atom, volume):
         '''
@@ -2503,9 +5047,10 @@ class Sim_Handler:
         f = self.mdff_forces[volume]
         all_atoms = self._atoms
         index = all_atoms.index(mdff_atom.atom)
-        mdff_atom.sim_index = f.addParticle(index,
-            (mdff_atom.coupling_constant, float(mdff_atom.enabled)))
-        self.context_reinit_needed()
+        self._add_or_restore_one(('mdff', volume), f, 1, mdff_atom, [index],
+            lambda: f.addParticle(index,
+                (mdff_atom.coupling_constant, float(mdff_atom.enabled))),
+            lambda a: self.update_mdff_atom(a, volume))
 
         ##
         # During simulation
@@ -2540,10 +5085,13 @@ class Sim_Handler:
         from chimerax.core.geometry import Place
         region_tf = Place(axes=tf.axes(), origin = tf.origin() -
             volume.data.xyz_to_ijk(volume.region_origin_and_step(region)[0]))
+        crop = self._mdff_crops[volume]
+        crop[0] = region_tf.matrix
+        cropped_tf = mdff_cropped_transform(crop[0], crop[1], crop[3])
 
         if self.sim_running:
             context = self.thread_handler.context
-            f.update_transform(region_tf.matrix, context=context)
+            f.update_transform(cropped_tf, context=context)
 
 
     def set_mdff_scale_factor(self, volume, scale_factor):
@@ -2604,6 +5152,7 @@ class Sim_Handler:
         f = self.mdff_forces[volume]
         f.update_atom(mdff_atom.sim_index,
             mdff_atom.coupling_constant, mdff_atom.enabled)
+        self.force_update_needed()
 
 
     def set_fixed_atoms(self, fixed_atoms):
@@ -2625,8 +5174,15 @@ class Sim_Handler:
         sys = self._system
         for index in fixed_indices:
             sys.setParticleMass(index, 0)
+        self._set_mobile_atoms(self._mobile_atoms.subtract(fixed_atoms))
         self.context_reinit_needed()
 
+    def _set_mobile_atoms(self, mobile_atoms, indices=None):
+        self._mobile_atoms = mobile_atoms
+        if indices is None:
+            indices = self._atoms.indices(mobile_atoms)
+        self._mobile_indices = indices.astype(numpy.uintp)
+
     def release_fixed_atoms(self, atoms):
         '''
         Make the desired fixed atoms mobile again. NOTE: a fixed atom can not be
@@ -2643,11 +5199,13 @@ class Sim_Handler:
             * atoms:
                 - a :py:class:`chimerax.Atoms` instance
         '''
-        indices = self._atoms.indices(fixed_atoms).tolist()
+        indices = self._atoms.indices(atoms).tolist()
         masses = atoms.elements.masses
         sys = self.system
         for index, mass in zip(indices, masses):
             sys.setParticleMass(index, mass)
+        self._set_mobile_atoms(self._mobile_atoms.merge(atoms))
+        self.recrop_mdff_maps()
         self.context_reinit_needed()
 
     def define_forcefield(self, forcefield_file_list):
@@ -2963,7 +5521,8 @@ class Map_Scale_Optimizer:
 
 class Sim_Performance_Tracker:
     c = 0
-    def __init__(self, sim_handler, report_interval=50, log_func=None):
+    def __init__(self, sim_handler, report_interval=50, log_func=None,
+            stage_log_func=None):
         self._ri = report_interval
         self._sh = sim_handler
         self._params = sim_handler._params
@@ -2971,6 +5530,8 @@ class Sim_Performance_Tracker:
             self._log_func = log_func
         else:
             self._log_func = print
+        # If set, also report where the time goes within each frame
+        self.stage_log_func = stage_log_func
         self._running = False
     def start(self):
         if self._running:
@@ -2994,7 +5555,21 @@ class Sim_Performance_Tracker:
             from time import time
             interval = (time()-self._start_time)/self._ri
             self._log_func('Average time per coord update: {:.2f} ms ({:.2f} time steps/s)'.format(interval*1000, 1/interval*self._params.sim_steps_per_gui_update))
+            if self.stage_log_func is not None:
+                self._report_stages()
             self._start_time = time()
+
+    def _report_stages(self):
+        th = self._sh.thread_handler
+        if th is None:
+            return
+        n, timings = th.stage_timings((50, 90, 99))
+        if not n:
+            return
+        self.stage_log_func('Simulation frame times over the last {} frames '
+            '(ms; median/90th/99th percentile): '.format(n)
+            + '; '.join('{}: {:.2f}/{:.2f}/{:.2f}'.format(name, *t)
+                for name, t in timings.items()))
     def stop(self):
         if self._h is not None:
             self._sh.triggers.remove_handler(self._h)
@@ -3082,6 +5657,26 @@ def find_residue_templates(residues, forcefield, ligand_db = None, logger=None):
         if template_name is not None:
             templates[residues.index(r)] = template_name
 
+    # Everything else is matched by topology in C++, so that OpenMM only has
+    # to confirm a single template for each residue rather than trying every
+    # template with the same elemental composition.
+    from .ff_tools import get_template_matcher
+    matcher = get_template_matcher(forcefield)
+    matches = matcher.match(residues)
+    tnames = matcher.template_names
+    for i in numpy.where(matches >= 0)[0]:
+        templates.setdefault(i, tnames[matches[i]])
+
+    # With no template generators or patches OpenMM has no other way to find
+    # a template, so fail now rather than after building the rest of the
+    # System. The message mirrors OpenMM's so it is handled the same way.
+    if not (getattr(forcefield, '_templateGenerators', None)
+            or getattr(forcefield, '_patches', None)):
+        for i in numpy.where(matches == matcher.NO_MATCH)[0]:
+            if i not in templates:
+                raise ValueError('No template found for residue {} ({}).  '
+                    'The set of atoms and bonds matches no template in the '
+                    'forcefield.'.format(i+1, residues[i].name))
 
     return templates
 
@@ -3127,3 +5722,93 @@ def get_available_platforms():
             name = p.getName()
             platform_names.append(name)
         return platform_names
+
+def mdff_map_crop_bounds(data_shape, xyz_to_ijk, coords=None, padding=0):
+    '''
+    Find the (inclusive) grid box of a map region needed to cover a set of
+    atoms.
+
+    Args:
+        * data_shape:
+            - the (k,j,i) shape of the map array
+        * xyz_to_ijk:
+            - a 3x4 transformation matrix from atomic coordinates to (i,j,k)
+              indices into the map array
+        * coords:
+            - an (n x 3) array of coordinates. If None or empty, the whole
+              grid is returned
+        * padding:
+            - padding around the coordinates, in the same length units
+
+    Returns:
+        * (ijk_min, ijk_max) as int64 arrays in (i,j,k) order
+    '''
+    f = c_function('map_prep_crop_bounds',
+        args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_double,
+            ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p))
+    tf = numpy.ascontiguousarray(xyz_to_ijk, float64)
+    if coords is None:
+        coords = numpy.empty((0,3), float64)
+    coords = numpy.ascontiguousarray(coords, float64)
+    dims = numpy.array(data_shape[::-1], numpy.uintp)
+    ijk_min = numpy.empty(3, numpy.int64)
+    ijk_max = numpy.empty(3, numpy.int64)
+    f(pointer(tf), len(coords), pointer(coords), padding, pointer(dims),
+        pointer(ijk_min), pointer(ijk_max))
+    return ijk_min, ijk_max
+
+def mdff_map_extract(data, xyz_to_ijk, ijk_min, ijk_max, step=1):
+    '''
+    Copy a box out of a map array into a new contiguous float32 array, ready
+    for upload to an MDFF force. With step > 1 the box is downsampled by
+    averaging over step x step x step blocks of voxels.
+
+    Args:
+        * data:
+            - the (k,j,i) map array. Need not be contiguous.
+        * xyz_to_ijk:
+            - the 3x4 transformation matrix from atomic coordinates to (i,j,k)
+              indices into data
+        * ijk_min, ijk_max:
+            - the inclusive box to extract, as returned by
+              :func:`mdff_map_crop_bounds`
+        * step:
+            - integer downsampling factor
+
+    Returns:
+        * the extracted (k,j,i) float32 array, and the 3x4 transform from
+          atomic coordinates to its (i,j,k) indices
+    '''
+    step = max(int(step), 1)
+    if data.dtype not in (float32, float64):
+        data = data.astype(float32)
+    if data.dtype == float32:
+        fname = 'map_prep_extract_float'
+    else:
+        fname = 'map_prep_extract_double'
+    f = c_function(fname,
+        args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+            ctypes.c_size_t, ctypes.c_void_p))
+    fs = c_function('map_prep_extracted_size',
+        args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p))
+    ijk_min = numpy.ascontiguousarray(ijk_min, numpy.int64)
+    ijk_max = numpy.ascontiguousarray(ijk_max, numpy.int64)
+    dims = numpy.empty(3, numpy.uintp)
+    fs(pointer(ijk_min), pointer(ijk_max), step, pointer(dims))
+    out = numpy.empty(dims[::-1], float32)
+    strides = numpy.array(data.strides, numpy.int64)//data.itemsize
+    f(data.ctypes.data, pointer(strides), pointer(ijk_min), pointer(ijk_max),
+        step, pointer(out))
+    return out, mdff_cropped_transform(xyz_to_ijk, ijk_min, step)
+
+def mdff_cropped_transform(xyz_to_ijk, ijk_min, step=1):
+    '''
+    Convert a transform from atomic coordinates to map (i,j,k) indices into
+    the equivalent for a box extracted by :func:`mdff_map_extract`.
+    '''
+    # Output index n covers source voxels ijk_min + step*n ... + step-1, so
+    # its centre sits (step-1)/2 voxels further along
+    tf = numpy.array(xyz_to_ijk, float64)
+    tf[:,3] -= ijk_min + (step-1)/2
+    tf /= step
+    return tf
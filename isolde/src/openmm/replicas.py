@@ -0,0 +1,317 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Running several independent copies ("replicas") of a simulation at once, each
+from the model's current coordinates but with its own random seed and
+(optionally) temperature, then picking the best result by energy or by
+Ramachandran and rotamer validation. This replaces the manual routine of
+re-running a difficult region over and over from perturbed starts:
+
+    ens = sim_manager.run_replicas(8, steps=5000, temperatures=[100, 200, 300, 400]*2)
+    ens.triggers.add_handler('finished', lambda *_: ens.apply_best())
+
+Each replica is its own OpenMM Context built from the simulation's System,
+so it sees exactly the same restraints and MDFF potentials (as they stood
+when the ensemble was started), and runs on its own
+:class:`OpenMM_Thread_Handler` thread. With a
+:class:`chimerax.isolde.openmm.scheduler.SimScheduler`, the equilibration is
+shared out over the scheduler's devices.
+'''
+
+import numpy
+
+from ..constants import defaults
+
+TEMPERATURE_UNIT = defaults.OPENMM_TEMPERATURE_UNIT
+ENERGY_UNIT = defaults.OPENMM_ENERGY_UNIT
+
+class ReplicaEnsemble:
+    '''
+    Runs a set of replicas of a :class:`Sim_Handler`'s simulation. The
+    replicas are minimised, then equilibrated for a fixed number of steps,
+    all concurrently and without blocking the GUI. Once all are done, each
+    is scored and the 'finished' trigger fires.
+    '''
+    CRITERIA = ('validation', 'energy')
+
+    def __init__(self, sim_handler, n_replicas, steps=2000, temperatures=None,
+            seeds=None, scheduler=None):
+        '''
+        Args:
+            * sim_handler:
+                - the :class:`Sim_Handler` to copy. Its simulation must not be
+                  running (paused is fine)
+            * n_replicas:
+                - number of replicas
+            * steps:
+                - equilibration steps for each replica after minimisation
+            * temperatures:
+                - optional list of n_replicas temperatures (Kelvin). Defaults
+                  to the simulation temperature for all
+            * seeds:
+                - optional list of n_replicas random number seeds
+            * scheduler:
+                - optional :class:`SimScheduler` to run the equilibration
+                  through
+        '''
+        if n_replicas < 1:
+            raise TypeError('Need at least one replica!')
+        sh = self._sim_handler = sim_handler
+        if sh.sim_running and not sh.pause:
+            raise RuntimeError('Pause the simulation before starting replicas!')
+        params = self._params = sh._params
+        if temperatures is None:
+            temperatures = [sh.temperature]*n_replicas
+        if seeds is None:
+            seeds = numpy.random.randint(1, 2**30, size=n_replicas).tolist()
+        if len(temperatures) != n_replicas or len(seeds) != n_replicas:
+            raise TypeError('Need one temperature and one seed per replica!')
+        self.steps = steps
+        self._scheduler = scheduler
+        self._running = False
+        self._handler = None
+
+        from chimerax.core.triggerset import TriggerSet
+        self.triggers = TriggerSet()
+        self.triggers.add_trigger('finished')
+
+        self._mobile_atoms = sh._mobile_atoms
+        self._mobile_indices = sh._mobile_indices
+        self.replicas = [_Replica(i, t, s) for i, (t, s) in
+            enumerate(zip(temperatures, seeds))]
+        coords = 0.1*sh._atoms.coords
+        for r in self.replicas:
+            self._create_context(r, coords)
+
+    def _create_context(self, r, coords):
+        device_index = self._params.device_index
+        if self._scheduler is not None:
+            if device_index is None:
+                device_index = self._scheduler.device_for_new_job()
+            r.device = device_index
+        r.integrator, r.context, r.thread_handler = \
+            self._sim_handler._create_worker_context(coords, r.temperature, r.seed,
+                device_index)
+        th = r.thread_handler
+        if self._scheduler is not None:
+            # Added (paused) now so that the next replica sees this one in
+            # the device load. It's resumed once minimisation is done.
+            r.job = self._scheduler.add(th, r.device, 1.0)
+
+    @property
+    def running(self):
+        return self._running
+
+    @property
+    def finished(self):
+        return all(r.state in ('done', 'failed') for r in self.replicas)
+
+    def start(self, poll=True):
+        '''
+        Start all replicas, and (if poll is True) begin checking on them on
+        each new frame.
+        '''
+        if self.running:
+            raise RuntimeError('Replicas are already running!')
+        for r in self.replicas:
+            r.thread_handler.minimize()
+            r.state = 'minimizing'
+        self._running = True
+        if poll:
+            self._handler = self._sim_handler.session.triggers.add_handler(
+                'new frame', self._update)
+
+    def wait(self, poll_interval=0.01):
+        '''
+        Start the replicas (if not already running) and block until all are
+        finished. Useful in scripts run without the GUI.
+        '''
+        from time import sleep
+        if not self.running:
+            self.start(poll=False)
+        elif self._handler is not None:
+            self._handler.remove()
+            self._handler = None
+        while self.running:
+            self._update()
+            if self.running:
+                sleep(poll_interval)
+
+    def _update(self, *_):
+        from chimerax.core.triggerset import DEREGISTER
+        sched = self._scheduler
+        for r in self.replicas:
+            th = r.thread_handler
+            if r.state == 'minimizing' and th.thread_finished():
+                th.finalize_thread()
+                if th.unstable():
+                    r.state = 'failed'
+                    continue
+                r.context.setVelocitiesToTemperature(r.temperature*TEMPERATURE_UNIT, r.seed)
+                if sched is not None:
+                    sched.resume(r.job)
+                else:
+                    th.step(self.steps)
+                r.state = 'equilibrating'
+            elif r.state == 'equilibrating':
+                if sched is not None:
+                    stats = sched.job_stats(r.job)
+                    if stats['steps'] < self.steps and not stats['stalled']:
+                        continue
+                    sched.pause(r.job)
+                elif not th.thread_finished():
+                    continue
+                th.finalize_thread()
+                r.state = 'failed' if th.unstable() else 'done'
+                if r.state == 'done':
+                    r.coords = th.get_coords(self._mobile_indices)
+                    r.energy = r.context.getState(getEnergy=True).getPotentialEnergy(
+                        ).value_in_unit(ENERGY_UNIT)
+        if not self.finished:
+            return
+        self._score()
+        self._release()
+        self._running = False
+        self._handler = None
+        self.triggers.activate_trigger('finished', self)
+        return DEREGISTER
+
+    def _score(self):
+        '''
+        Count the Ramachandran and rotamer outliers and non-favoured residues
+        in each successful replica, by briefly putting its coordinates on the
+        model.
+        '''
+        from .. import session_extensions as sx
+        session = self._sim_handler.session
+        atoms = self._mobile_atoms
+        residues = atoms.unique_residues
+        rama_mgr = sx.get_ramachandran_mgr(session)
+        rota_mgr = sx.get_rotamer_mgr(session)
+        ramas = rama_mgr.get_ramas(residues)
+        ramas = ramas[ramas.valids]
+        rotamers = rota_mgr.get_rotamers(residues)
+        rota_allowed, rota_outlier = rota_mgr.cutoffs
+        Bin = rama_mgr.RamaBin
+        original = atoms.coords
+        try:
+            for r in self.replicas:
+                if r.state != 'done':
+                    continue
+                atoms.coords = r.coords
+                bins = rama_mgr.bin_scores(*rama_mgr.validate(ramas))
+                p = rota_mgr.validate_rotamers(rotamers)
+                r.rama_outliers = int((bins==Bin.OUTLIER).sum())
+                r.rama_allowed = int((bins==Bin.ALLOWED).sum())
+                r.rota_outliers = int((p < rota_outlier).sum())
+                r.rota_allowed = int(numpy.logical_and(p >= rota_outlier, p < rota_allowed).sum())
+        finally:
+            atoms.coords = original
+
+    def ranked(self, criterion='validation'):
+        '''
+        Successful replicas, best first. By 'energy', lowest potential energy
+        wins. By 'validation', fewest outliers (Ramachandran plus rotamer)
+        wins, then fewest allowed-but-not-favoured, with energy as the
+        tie-breaker.
+        '''
+        if criterion not in self.CRITERIA:
+            raise TypeError('Criterion must be one of {}!'.format(', '.join(self.CRITERIA)))
+        done = [r for r in self.replicas if r.state == 'done']
+        if criterion == 'energy':
+            key = lambda r: r.energy
+        else:
+            key = lambda r: (r.rama_outliers+r.rota_outliers,
+                r.rama_allowed+r.rota_allowed, r.energy)
+        return sorted(done, key=key)
+
+    def best(self, criterion='validation'):
+        ranked = self.ranked(criterion)
+        return ranked[0] if ranked else None
+
+    def apply(self, replica):
+        '''
+        Put the replica's coordinates on the model. If the simulation is
+        paused, they are pushed into it when it resumes.
+        '''
+        self._mobile_atoms.coords = replica.coords
+
+    def apply_best(self, criterion='validation'):
+        '''
+        Apply the best replica (if any succeeded), and return it.
+        '''
+        r = self.best(criterion)
+        if r is not None:
+            self.apply(r)
+        return r
+
+    def summary(self):
+        '''
+        One line of text per replica, for the log.
+        '''
+        lines = []
+        for r in self.replicas:
+            if r.state == 'done':
+                lines.append('Replica {}: T={:.0f} K seed={} E={:.1f} kJ/mol '
+                    'Rama outliers/allowed={}/{} rotamer outliers/allowed={}/{}'.format(
+                    r.index, r.temperature, r.seed, r.energy, r.rama_outliers,
+                    r.rama_allowed, r.rota_outliers, r.rota_allowed))
+            else:
+                lines.append('Replica {}: T={:.0f} K seed={} {}'.format(
+                    r.index, r.temperature, r.seed, r.state))
+        return '\n'.join(lines)
+
+    def _release(self):
+        # Thread handlers must go before their Contexts
+        for r in self.replicas:
+            if r.thread_handler is None:
+                continue
+            if r.job is not None:
+                self._scheduler.remove(r.job)
+                r.job = None
+            r.thread_handler.delete()
+            r.thread_handler = None
+            r.context = None
+            r.integrator = None
+
+    def cancel(self):
+        '''
+        Stop all replicas and release their Contexts. Results of replicas
+        already finished are kept.
+        '''
+        if self._handler is not None:
+            self._handler.remove()
+            self._handler = None
+        self._running = False
+        for r in self.replicas:
+            if r.thread_handler is not None and r.state not in ('done', 'failed'):
+                if r.job is not None:
+                    self._scheduler.pause(r.job)
+                r.thread_handler.finalize_thread()
+                r.state = 'cancelled'
+        self._release()
+
+
+class _Replica:
+    def __init__(self, index, temperature, seed):
+        self.index = index
+        self.temperature = temperature
+        self.seed = int(seed)
+        self.device = None
+        self.job = None
+        self.state = 'new'
+        self.context = None
+        self.integrator = None
+        self.thread_handler = None
+        self.coords = None
+        self.energy = None
+        self.rama_outliers = None
+        self.rama_allowed = None
+        self.rota_outliers = None
+        self.rota_allowed = None
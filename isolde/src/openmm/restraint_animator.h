@@ -0,0 +1,123 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_RESTRAINT_ANIMATOR
+#define ISOLDE_RESTRAINT_ANIMATOR
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include <atomic>
+#include <stdexcept>
+#include <OpenMM.h>
+
+#include "custom_forces.h"
+
+namespace isolde
+{
+
+/*! A scheduled change to the parameters of a set of terms of one restraint
+ *  force, laid out as a series of keyframes a fixed number of integration
+ *  steps apart. Between keyframes each parameter is either interpolated
+ *  linearly or held at the value of the earlier keyframe (for switches like
+ *  "enabled"). Angles should be given unwrapped, so that interpolating
+ *  between consecutive keyframes takes the intended path.
+ *
+ *  Only the worker thread advances an animation; its progress may be read
+ *  from any thread.
+ */
+class Restraint_Animation
+{
+public:
+    /*! keyframes holds n_keyframes blocks of n_terms*num_parameters(force)
+     *  values, in the same per-term layout as
+     *  custom_forces::update_parameters(). If stepped is not null it holds
+     *  one flag per parameter: non-zero for those to be held rather than
+     *  interpolated.
+     */
+    Restraint_Animation(OpenMM::Force *force, custom_forces::Force_Type type,
+        size_t n_terms, const int *indices, size_t n_keyframes,
+        const double *keyframes, const uint8_t *stepped, size_t steps_per_keyframe)
+        : _force(force), _type(type), _n_params(custom_forces::num_parameters(force, type)),
+          _indices(indices, indices+n_terms), _n_keyframes(n_keyframes),
+          _steps_per_keyframe(steps_per_keyframe)
+    {
+        if (n_keyframes < 2)
+            throw std::invalid_argument("An animation needs at least two keyframes!");
+        if (steps_per_keyframe == 0)
+            throw std::invalid_argument("Steps per keyframe must be greater than zero!");
+        _keyframes.assign(keyframes, keyframes + n_keyframes*n_terms*_n_params);
+        _stepped.assign(_n_params, 0);
+        if (stepped != nullptr)
+            _stepped.assign(stepped, stepped+_n_params);
+        _current.resize(n_terms*_n_params);
+    }
+
+    OpenMM::Force* force() const { return _force; }
+    custom_forces::Force_Type type() const { return _type; }
+    size_t total_steps() const { return (_n_keyframes-1)*_steps_per_keyframe; }
+    size_t steps_done() const { return _steps_done.load(); }
+    bool finished() const { return steps_done() >= total_steps(); }
+    double progress() const { return std::min(1.0, (double)steps_done()/total_steps()); }
+
+    /*! Write the parameters for the current step to the force. Returns
+     *  false (doing nothing) if they have already been written since the
+     *  animation last advanced.
+     */
+    bool apply()
+    {
+        if (_applied)
+            return false;
+        size_t n = _indices.size();
+        size_t block = n*_n_params;
+        size_t done = std::min(steps_done(), total_steps());
+        size_t k = std::min(done/_steps_per_keyframe, _n_keyframes-2);
+        double t = (double)(done - k*_steps_per_keyframe)/_steps_per_keyframe;
+        const double *a = _keyframes.data() + k*block;
+        const double *b = a + block;
+        if (t >= 1.0)
+            std::copy(b, b+block, _current.begin());
+        else
+            for (size_t i=0; i<block; ++i)
+                _current[i] = _stepped[i%_n_params] ? a[i] : a[i] + t*(b[i]-a[i]);
+        custom_forces::update_parameters(_force, _type, n, _indices.data(), _current.data());
+        _applied = true;
+        return true;
+    }
+
+    //! Worker thread only
+    void advance(size_t steps)
+    {
+        if (finished())
+            return;
+        _steps_done += steps;
+        _applied = false;
+    }
+
+private:
+    OpenMM::Force *_force;
+    custom_forces::Force_Type _type;
+    size_t _n_params;
+    std::vector<int> _indices;
+    size_t _n_keyframes;
+    size_t _steps_per_keyframe;
+    std::vector<double> _keyframes;
+    std::vector<uint8_t> _stepped;
+    std::vector<double> _current;
+    std::atomic<size_t> _steps_done{0};
+    bool _applied = false;
+}; // class Restraint_Animation
+
+} // namespace isolde
+
+#endif // ISOLDE_RESTRAINT_ANIMATOR
@@ -0,0 +1,194 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Running several simulations at once on the GPU(s) of one machine. A
+:class:`SimScheduler` shares each device between the simulations assigned to
+it, giving each one short chunks of steps in turn (in proportion to its
+weight), and keeps a running tally of each simulation's throughput:
+
+    from chimerax.isolde.openmm.scheduler import SimScheduler
+    sched = SimScheduler(n_devices=2)
+    for sm in sim_managers:
+        sm.use_scheduler(sched)
+        sm.start_sim()
+    ...
+    for sm in sim_managers:
+        print(sched.throughput(sm.sim_handler.scheduler_job))
+
+Only the free-running equilibration phase of each simulation is scheduled;
+minimisation still runs on the simulation's own thread, as before. While a
+job is scheduled, anything else needing its thread handler must use
+:func:`SimScheduler.paused`.
+'''
+
+import ctypes
+import numpy
+from contextlib import contextmanager
+
+from .openmm_interface import c_function
+
+class SimScheduler:
+    '''
+    Python interface to the C++ Sim_Scheduler (see sim_scheduler.h).
+    '''
+    def __init__(self, n_devices=1, steps_per_chunk=50):
+        f = c_function('sim_scheduler_new', args=(ctypes.c_size_t, ctypes.c_size_t),
+            ret=ctypes.c_void_p)
+        self._c_pointer = ctypes.c_void_p(f(n_devices, steps_per_chunk))
+
+    def delete(self):
+        '''
+        Stop the scheduler thread, after letting any chunks in flight finish.
+        The simulations themselves are untouched.
+        '''
+        if getattr(self, '_c_pointer', None) is not None:
+            c_function('sim_scheduler_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+            self._c_pointer = None
+
+    def __del__(self):
+        self.delete()
+
+    @property
+    def num_devices(self):
+        f = c_function('sim_scheduler_n_devices', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def _get_steps_per_chunk(self):
+        f = c_function('sim_scheduler_steps_per_chunk', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def _set_steps_per_chunk(self, n):
+        f = c_function('set_sim_scheduler_steps_per_chunk',
+            args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, n)
+
+    steps_per_chunk = property(_get_steps_per_chunk, _set_steps_per_chunk,
+        doc='''
+        Number of steps each job runs before the device is handed to the next
+        one (and a new set of coordinates is published). Smaller chunks share
+        the device more finely at the cost of more overhead per step.
+        ''')
+
+    def device_for_new_job(self):
+        '''
+        The device with the least total weight of jobs currently on it.
+        '''
+        f = c_function('sim_scheduler_least_loaded_device', args=(ctypes.c_void_p,),
+            ret=ctypes.c_int)
+        return f(self._c_pointer)
+
+    def add(self, thread_handler, device, weight=1.0):
+        '''
+        Add a simulation's :class:`OpenMM_Thread_Handler`, whose Context must
+        be on the given device. The job starts paused: call :func:`resume` to
+        start it running. Returns the job's ID.
+        '''
+        f = c_function('sim_scheduler_add_job',
+            args=(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_double),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer, thread_handler.cpp_pointer, device, weight)
+
+    def remove(self, job):
+        '''
+        Remove a job, waiting for its current chunk (if any) to finish.
+        '''
+        f = c_function('sim_scheduler_remove_job', args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, job)
+
+    def pause(self, job):
+        '''
+        Stop giving the job new chunks, and wait for its current chunk (if
+        any) to finish. Its thread handler is then free to use as normal.
+        '''
+        f = c_function('sim_scheduler_pause_job', args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, job)
+
+    def resume(self, job):
+        '''
+        Start (or restart) scheduling the job. This also clears a stall due
+        to instability, so fix that first.
+        '''
+        f = c_function('sim_scheduler_resume_job', args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, job)
+
+    @contextmanager
+    def paused(self, job):
+        '''
+        Context manager pausing the job for the duration, and resuming it
+        afterwards if it was running before.
+        '''
+        was_running = self.job_stats(job)['running']
+        self.pause(job)
+        try:
+            yield
+        finally:
+            if was_running:
+                self.resume(job)
+
+    def set_weight(self, job, weight):
+        '''
+        Set the job's share of its device relative to the other jobs there.
+        '''
+        f = c_function('sim_scheduler_set_job_weight',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_double))
+        f(self._c_pointer, job, weight)
+
+    @property
+    def jobs(self):
+        '''IDs of all current jobs.'''
+        nf = c_function('sim_scheduler_n_jobs', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        n = nf(self._c_pointer)
+        ids = numpy.empty(n, numpy.uintp)
+        f = c_function('sim_scheduler_job_ids', args=(ctypes.c_void_p, ctypes.c_void_p))
+        f(self._c_pointer, ids.ctypes.data_as(ctypes.c_void_p))
+        return ids.tolist()
+
+    def job_stats(self, job):
+        '''
+        Returns a dict of the job's device, weight, total steps and chunks run,
+        seconds spent running chunks ("busy") and since it was added ("wall"),
+        whether it is currently scheduled ("running") and whether it has been
+        stopped by instability in the simulation ("stalled").
+        '''
+        counts = numpy.empty(3, numpy.uintp)
+        times = numpy.empty(3, numpy.double)
+        f = c_function('sim_scheduler_job_stats',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.c_void_p, ctypes.c_void_p),
+            ret=ctypes.c_int)
+        flags = f(self._c_pointer, job, counts.ctypes.data_as(ctypes.c_void_p),
+            times.ctypes.data_as(ctypes.c_void_p))
+        return {
+            'steps': int(counts[0]),
+            'chunks': int(counts[1]),
+            'device': int(counts[2]),
+            'busy': float(times[0]),
+            'wall': float(times[1]),
+            'weight': float(times[2]),
+            'running': bool(flags & 1),
+            'stalled': bool(flags & 2),
+        }
+
+    def throughput(self, job, timestep=None):
+        '''
+        Returns the job's steps per second of wall time and the fraction of
+        it spent with a chunk running. If the integrator timestep (in
+        picoseconds) is given, ns/day is added too.
+        '''
+        s = self.job_stats(job)
+        wall = max(s['wall'], 1e-9)
+        result = {
+            'steps_per_second': s['steps']/wall,
+            'device_share': s['busy']/wall,
+        }
+        if timestep is not None:
+            result['ns_per_day'] = s['steps']*timestep/1000/wall*86400
+        return result
@@ -96,6 +96,7 @@ class SimParams(Param_Mgr):
         'rotamer_spring_constant':              (defaults.ROTAMER_SPRING_CONSTANT, OPENMM_RADIAL_SPRING_UNIT),
         'peptide_bond_spring_constant':         (defaults.PEPTIDE_SPRING_CONSTANT, OPENMM_RADIAL_SPRING_UNIT),
         'phi_psi_spring_constant':              (defaults.PHI_PSI_SPRING_CONSTANT, OPENMM_RADIAL_SPRING_UNIT),
+        'conformation_bias_strength':           (defaults.CONFORMATION_BIAS_STRENGTH, OPENMM_ENERGY_UNIT),
         'cis_peptide_bond_cutoff_angle':        (defaults.CIS_PEPTIDE_BOND_CUTOFF, OPENMM_ANGLE_UNIT),
         'standard_map_coupling_base_constant':  (defaults.STANDARD_MAP_MDFF_BASE_CONSTANT, None),
         #'difference_map_coupling_constant':     (defaults.DIFFERENCE_MAP_K, None),
@@ -132,11 +133,20 @@ class SimParams(Param_Mgr):
         'fixed_integrator_timestep':            (defaults.OPENMM_FIXED_INTEGRATOR_TS, None),
         'constraint_tolerance':                 (defaults.OPENMM_CONSTRAINT_TOL, None),
         'sim_steps_per_gui_update':             (defaults.SIM_STEPS_PER_GUI_UPDATE, None),
+        'continuous_equilibration':             (defaults.CONTINUOUS_EQUILIBRATION, None),
+        'instability_check_min_interval':       (defaults.INSTABILITY_CHECK_MIN_INTERVAL, None),
+        'instability_check_max_interval':       (defaults.INSTABILITY_CHECK_MAX_INTERVAL, None),
+        'instability_check_by_displacement':    (defaults.INSTABILITY_CHECK_BY_DISPLACEMENT, None),
         'simulation_startup_rounds':            (defaults.SIM_STARTUP_ROUNDS, None),
         'maximum_unstable_rounds':              (defaults.MAX_UNSTABLE_ROUNDS, None),
         'minimization_convergence_tol_start':   (defaults.MIN_CONVERGENCE_TOL_START, None),
         'minimization_convergence_tol_end':     (defaults.MIN_CONVERGENCE_TOL_END, None),
         'minimization_max_iterations':          (defaults.MAX_MIN_ITERATIONS, None),
+        'minimizer_precision':                  (defaults.MINIMIZER_PRECISION, None),
+        'clash_prescreen':                      (defaults.CLASH_PRESCREEN, None),
+        'clash_prescreen_distance':             (defaults.CLASH_PRESCREEN_DISTANCE, OPENMM_LENGTH_UNIT),
+        'conformation_bias':                    (defaults.CONFORMATION_BIAS, None),
+        'conformation_bias_interval':           (defaults.CONFORMATION_BIAS_INTERVAL, None),
         'tug_hydrogens':                        (defaults.TUGGABLE_HYDROGENS, None),
         'hydrogens_feel_maps':                  (defaults.HYDROGENS_FEEL_MAPS, None),
         'target_loop_period':                   (defaults.TARGET_LOOP_PERIOD, None),
@@ -149,4 +159,20 @@ class SimParams(Param_Mgr):
         'trajectory_smoothing':                 (defaults.TRAJECTORY_SMOOTHING, None),
         'smoothing_alpha':                      (defaults.SMOOTHING_ALPHA, None),
         'max_cubic_map_size':                   (defaults.MAX_CUBIC_MAP_SIZE, None),
+        'mdff_crop_padding':                    (defaults.MDFF_CROP_PADDING, None),
+        'mdff_coarse_step':                     (defaults.MDFF_COARSE_STEP, None),
+        'cache_sim_contexts':                   (defaults.CACHE_SIM_CONTEXTS, None),
+        'sim_cache_max_oversize':               (defaults.SIM_CACHE_MAX_OVERSIZE, None),
+        'system_disk_cache':                    (defaults.SYSTEM_DISK_CACHE, None),
+        'system_disk_cache_max_entries':        (defaults.SYSTEM_DISK_CACHE_MAX_ENTRIES, None),
+        'sparse_restraint_forces':              (defaults.SPARSE_RESTRAINT_FORCES, None),
+        'sparse_restraint_min_withheld':        (defaults.SPARSE_RESTRAINT_MIN_WITHHELD, None),
+        'sparse_restraint_rebuild_fraction':    (defaults.SPARSE_RESTRAINT_REBUILD_FRACTION, None),
+        'adaptive_distance_forces_from_sim':    (defaults.ADAPTIVE_DISTANCE_FORCES_FROM_SIM, None),
+        'checkpoint_history_length':            (defaults.CHECKPOINT_HISTORY_LENGTH, None),
+        'adaptive_pacing':                      (defaults.ADAPTIVE_PACING, None),
+        'pacing_target_latency':                (defaults.PACING_TARGET_LATENCY, None),
+        'pacing_min_steps_per_update':          (defaults.PACING_MIN_STEPS_PER_UPDATE, None),
+        'pacing_max_steps_per_update':          (defaults.PACING_MAX_STEPS_PER_UPDATE, None),
+        'background_validation':                (defaults.BACKGROUND_VALIDATION, None),
     }
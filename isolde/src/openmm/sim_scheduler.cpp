@@ -0,0 +1,259 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#include "sim_scheduler.h"
+#include "openmm_interface.h"
+#include <limits>
+#include <stdexcept>
+
+namespace isolde
+{
+
+Sim_Scheduler::Sim_Scheduler(size_t n_devices, size_t steps_per_chunk)
+    : _n_devices(n_devices), _device_busy(n_devices, false)
+{
+    if (n_devices == 0)
+        throw std::invalid_argument("Need at least one device!");
+    set_steps_per_chunk(steps_per_chunk);
+    _thread = std::thread(&Sim_Scheduler::_run, this);
+}
+
+Sim_Scheduler::~Sim_Scheduler()
+{
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        // Don't leave chunks running on handlers that may be about to be
+        // deleted
+        for (auto& it: _jobs)
+            it.second.running = false;
+        _chunk_done.wait(lock, [this]{
+            for (const auto& it: _jobs)
+                if (it.second.in_flight) return false;
+            return true;
+        });
+        _stop = true;
+    }
+    _changed.notify_all();
+    _thread.join();
+}
+
+void Sim_Scheduler::set_steps_per_chunk(size_t n)
+{
+    if (n == 0)
+        throw std::invalid_argument("Need at least one step per chunk!");
+    std::lock_guard<std::mutex> lock(_mutex);
+    _steps_per_chunk = n;
+}
+
+int Sim_Scheduler::least_loaded_device() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<double> load(_n_devices, 0);
+    for (const auto& it: _jobs)
+        load[it.second.device] += it.second.weight;
+    int best = 0;
+    for (size_t d=1; d<_n_devices; ++d)
+        if (load[d] < load[best])
+            best = d;
+    return best;
+}
+
+Sim_Scheduler::Job& Sim_Scheduler::_job(size_t id)
+{
+    auto it = _jobs.find(id);
+    if (it == _jobs.end())
+        throw std::out_of_range("No such scheduler job!");
+    return it->second;
+}
+
+const Sim_Scheduler::Job& Sim_Scheduler::_job(size_t id) const
+{
+    auto it = _jobs.find(id);
+    if (it == _jobs.end())
+        throw std::out_of_range("No such scheduler job!");
+    return it->second;
+}
+
+double Sim_Scheduler::_min_vtime(int device) const
+{
+    double vmin = std::numeric_limits<double>::infinity();
+    for (const auto& it: _jobs)
+        if (it.second.device == device && it.second.running)
+            vmin = std::min(vmin, it.second.vtime);
+    return vmin == std::numeric_limits<double>::infinity() ? 0.0 : vmin;
+}
+
+size_t Sim_Scheduler::add_job(OpenMM_Thread_Handler *handler, int device, double weight)
+{
+    if (device < 0 || (size_t)device >= _n_devices)
+        throw std::out_of_range("Device index out of range!");
+    if (!(weight > 0))
+        throw std::invalid_argument("Job weight must be greater than zero!");
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (const auto& it: _jobs)
+        if (it.second.handler == handler)
+            throw std::logic_error("This simulation is already scheduled!");
+    Job job;
+    job.handler = handler;
+    job.device = device;
+    job.weight = weight;
+    job.added = clock::now();
+    size_t id = _next_id++;
+    _jobs.emplace(id, job);
+    return id;
+}
+
+void Sim_Scheduler::_wait_for_chunk(std::unique_lock<std::mutex>& lock, size_t id)
+{
+    _changed.notify_all();
+    _chunk_done.wait(lock, [this, id]{
+        auto it = _jobs.find(id);
+        return it == _jobs.end() || !it->second.in_flight;
+    });
+}
+
+void Sim_Scheduler::remove_job(size_t id)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _job(id).running = false;
+    _wait_for_chunk(lock, id);
+    _jobs.erase(id);
+}
+
+void Sim_Scheduler::pause_job(size_t id)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _job(id).running = false;
+    _wait_for_chunk(lock, id);
+}
+
+void Sim_Scheduler::resume_job(size_t id)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto& job = _job(id);
+        if (!job.running)
+        {
+            // Coming back from a pause shouldn't let a job claim all the
+            // device time it missed
+            job.vtime = std::max(job.vtime, _min_vtime(job.device));
+            job.running = true;
+        }
+        job.stalled = false;
+    }
+    _changed.notify_all();
+}
+
+void Sim_Scheduler::set_job_weight(size_t id, double weight)
+{
+    if (!(weight > 0))
+        throw std::invalid_argument("Job weight must be greater than zero!");
+    std::lock_guard<std::mutex> lock(_mutex);
+    _job(id).weight = weight;
+}
+
+Sim_Scheduler::Job_Stats Sim_Scheduler::job_stats(size_t id) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    const auto& job = _job(id);
+    Job_Stats s;
+    s.steps = job.steps;
+    s.chunks = job.chunks;
+    s.busy_seconds = job.busy;
+    s.wall_seconds = std::chrono::duration<double>(clock::now()-job.added).count();
+    s.device = job.device;
+    s.weight = job.weight;
+    s.running = job.running;
+    s.stalled = job.stalled;
+    return s;
+}
+
+std::vector<size_t> Sim_Scheduler::job_ids() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::vector<size_t> ids;
+    for (const auto& it: _jobs)
+        ids.push_back(it.first);
+    return ids;
+}
+
+void Sim_Scheduler::_reap_finished(clock::time_point now)
+{
+    bool any = false;
+    for (auto& it: _jobs)
+    {
+        auto& job = it.second;
+        if (!job.in_flight || !job.handler->thread_finished())
+            continue;
+        double dt = std::chrono::duration<double>(now-job.chunk_start).count();
+        job.busy += dt;
+        job.vtime += dt/job.weight;
+        job.steps += job.chunk_steps;
+        job.chunks++;
+        job.in_flight = false;
+        _device_busy[job.device] = false;
+        // The handler stops early (and won't take more steps) if atoms are
+        // moving too fast. Leave it for the owner to sort out.
+        if (job.handler->unstable() || job.handler->clash_detected())
+            job.stalled = true;
+        any = true;
+    }
+    if (any)
+        _chunk_done.notify_all();
+}
+
+void Sim_Scheduler::_dispatch(clock::time_point now)
+{
+    for (size_t d=0; d<_n_devices; ++d)
+    {
+        if (_device_busy[d])
+            continue;
+        Job *next = nullptr;
+        for (auto& it: _jobs)
+        {
+            auto& job = it.second;
+            if (job.device != (int)d || !job.running || job.stalled || job.in_flight)
+                continue;
+            if (next == nullptr || job.vtime < next->vtime)
+                next = &job;
+        }
+        if (next == nullptr)
+            continue;
+        next->chunk_steps = _steps_per_chunk;
+        next->chunk_start = now;
+        next->in_flight = true;
+        _device_busy[d] = true;
+        next->handler->step_threaded(next->chunk_steps, false);
+    }
+}
+
+void Sim_Scheduler::_run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop)
+    {
+        auto now = clock::now();
+        _reap_finished(now);
+        _dispatch(now);
+        // Handlers don't signal completion, so poll while anything is in
+        // flight. Otherwise sleep until something changes.
+        bool in_flight = false;
+        for (bool b: _device_busy)
+            in_flight |= b;
+        if (in_flight)
+            _changed.wait_for(lock, std::chrono::microseconds(200));
+        else
+            _changed.wait(lock);
+    }
+}
+
+} // namespace isolde
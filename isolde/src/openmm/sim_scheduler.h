@@ -0,0 +1,122 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SIM_SCHEDULER
+#define ISOLDE_SIM_SCHEDULER
+
+#include <map>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace isolde
+{
+
+class OpenMM_Thread_Handler;
+
+/*! Shares one or more GPUs between several simulations in the same process.
+ *
+ *  Each job is an OpenMM_Thread_Handler whose Context lives on a given
+ *  device. The scheduler thread keeps at most one chunk of steps in flight
+ *  per device, and always gives the next chunk on a device to the runnable
+ *  job there that has had the least device time (divided by its weight), so
+ *  a large job can't starve small ones and no device sits idle while it has
+ *  work. Jobs on different devices run concurrently.
+ *
+ *  While a job is running the scheduler owns its handler's command queue.
+ *  Anything else that needs the handler must pause_job() first, which waits
+ *  for the chunk in flight to finish. A job whose simulation becomes
+ *  unstable is stalled (no more chunks) until resumed.
+ */
+class Sim_Scheduler
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    struct Job_Stats
+    {
+        size_t steps = 0;
+        size_t chunks = 0;
+        double busy_seconds = 0;  // wall time with a chunk in flight
+        double wall_seconds = 0;  // since the job was added
+        int device = 0;
+        double weight = 1;
+        bool running = false;     // scheduled (not paused)
+        bool stalled = false;     // stopped by instability
+    };
+
+    Sim_Scheduler(size_t n_devices, size_t steps_per_chunk);
+    ~Sim_Scheduler();
+
+    size_t n_devices() const { return _n_devices; }
+    size_t steps_per_chunk() const { return _steps_per_chunk; }
+    void set_steps_per_chunk(size_t n);
+
+    //! The device with the least total weight of jobs on it
+    int least_loaded_device() const;
+
+    //! The job starts paused. Returns its ID.
+    size_t add_job(OpenMM_Thread_Handler *handler, int device, double weight);
+    //! Waits for any chunk in flight
+    void remove_job(size_t id);
+    //! Waits for any chunk in flight, after which the handler is free to use
+    void pause_job(size_t id);
+    //! Also clears a stall
+    void resume_job(size_t id);
+    void set_job_weight(size_t id, double weight);
+    Job_Stats job_stats(size_t id) const;
+    std::vector<size_t> job_ids() const;
+
+private:
+    struct Job
+    {
+        OpenMM_Thread_Handler *handler;
+        int device;
+        double weight;
+        bool running = false;
+        bool stalled = false;
+        bool in_flight = false;
+        size_t chunk_steps = 0;
+        clock::time_point chunk_start;
+        clock::time_point added;
+        size_t steps = 0;
+        size_t chunks = 0;
+        double busy = 0;
+        double vtime = 0; // busy/weight, for choosing the next job
+    };
+
+    size_t _n_devices;
+    size_t _steps_per_chunk;
+    size_t _next_id = 0;
+    std::map<size_t, Job> _jobs;
+    std::vector<bool> _device_busy;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _changed;   // wakes the scheduler thread
+    std::condition_variable _chunk_done; // wakes pause_job()/remove_job()
+    bool _stop = false;
+    std::thread _thread;
+
+    Job& _job(size_t id);
+    const Job& _job(size_t id) const;
+    double _min_vtime(int device) const;
+    void _wait_for_chunk(std::unique_lock<std::mutex>& lock, size_t id);
+    void _run();
+    void _reap_finished(clock::time_point now);
+    void _dispatch(clock::time_point now);
+}; // class Sim_Scheduler
+
+} // namespace isolde
+
+#endif // ISOLDE_SIM_SCHEDULER
@@ -0,0 +1,102 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SPSC_RING
+#define ISOLDE_SPSC_RING
+
+#include <atomic>
+#include <cstddef>
+
+namespace isolde
+{
+
+/*! Fixed-capacity single-producer, single-consumer ring buffer.
+ *
+ *  Unlike Triple_Buffer this carries a stream of items rather than just the
+ *  latest frame, although pop_latest() gives the same "most recent wins"
+ *  behaviour when that is all the consumer wants. Neither side ever blocks
+ *  or allocates: a full ring simply refuses new items, so a producer running
+ *  faster than its consumer should expect push() to fail and try again with
+ *  fresher data next time round.
+ *
+ *  T must be trivially copyable. N must be a power of two.
+ */
+template <typename T, size_t N>
+class Spsc_Ring
+{
+    static_assert(N > 0 && (N & (N-1)) == 0, "Ring capacity must be a power of two!");
+public:
+    static constexpr size_t capacity() { return N; }
+
+    //! Producer side. Returns false (and drops the item) if the ring is full.
+    bool push(const T& item)
+    {
+        size_t head = _head.value.load(std::memory_order_relaxed);
+        if (head - _tail.value.load(std::memory_order_acquire) == N)
+            return false;
+        _items[head & (N-1)] = item;
+        _head.value.store(head+1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side. Returns false if the ring is empty.
+    bool pop(T& item)
+    {
+        size_t tail = _tail.value.load(std::memory_order_relaxed);
+        if (tail == _head.value.load(std::memory_order_acquire))
+            return false;
+        item = _items[tail & (N-1)];
+        _tail.value.store(tail+1, std::memory_order_release);
+        return true;
+    }
+
+    //! Consumer side: discard everything but the newest item. Returns false if empty.
+    bool pop_latest(T& item)
+    {
+        size_t tail = _tail.value.load(std::memory_order_relaxed);
+        size_t head = _head.value.load(std::memory_order_acquire);
+        if (tail == head)
+            return false;
+        item = _items[(head-1) & (N-1)];
+        _tail.value.store(head, std::memory_order_release);
+        return true;
+    }
+
+    //! Approximate when called from either side while the other is active
+    size_t size() const
+    {
+        return _head.value.load(std::memory_order_acquire) - _tail.value.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+    //! Padded out to a full cache line. Padding rather than alignas() keeps
+    //! the ring (and anything holding one) to the default alignment, so
+    //! plain operator new works on targets without aligned new (macOS < 10.14).
+    struct Padded_Index
+    {
+        std::atomic<size_t> value{0};
+        char pad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    };
+
+    T _items[N];
+    // Keep the two ends on separate cache lines so producer and consumer
+    // don't fight over them
+    char _pad[CACHE_LINE];
+    Padded_Index _head;
+    Padded_Index _tail;
+}; // class Spsc_Ring
+
+} // namespace isolde
+
+#endif // ISOLDE_SPSC_RING
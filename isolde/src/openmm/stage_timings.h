@@ -0,0 +1,136 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_STAGE_TIMINGS
+#define ISOLDE_STAGE_TIMINGS
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+namespace isolde
+{
+
+//! Per-stage wall-clock timings of the simulation thread's frames
+/*! A frame is one cycle from the start of integration to publishing the
+ *  coordinates (and the sleep that caps the simulation rate). The worker
+ *  accumulates time per stage over the frame, then stores the totals as one
+ *  sample in a fixed-size ring. The newest HISTORY samples can be summarised
+ *  as percentiles from any thread. The mutex is held only to store a sample
+ *  or take a copy of the ring, so the worker never waits on anything slow.
+ */
+class Stage_Timings
+{
+public:
+    // Keep in sync with STAGE_NAMES in openmm_interface.py
+    enum Stage {
+        INTEGRATE = 0,      // integrator().step()
+        STATE_DOWNLOAD,     // Context::getState()
+        VELOCITY_CHECK,     // looking for atoms moving too fast
+        SMOOTHING,
+        COPY_OUT,           // publishing coordinates (and bond forces, trajectory frames)
+        PARAM_UPLOAD,       // applying staged restraint and tugging parameters
+        SLEEP,              // waiting out the minimum time per frame
+        TOTAL,
+        NUM_STAGES
+    };
+    static const size_t HISTORY = 1024;
+    typedef std::chrono::steady_clock clock;
+
+    //! Times a block of code as part of a stage of the current frame
+    class Scope
+    {
+    public:
+        Scope(Stage_Timings& t, Stage s): _t(t), _s(s), _start(clock::now()) {}
+        ~Scope() { _t.add(_s, clock::now()-_start); }
+    private:
+        Stage_Timings& _t;
+        Stage _s;
+        clock::time_point _start;
+    };
+
+    // Worker thread
+    void begin_frame()
+    {
+        std::fill(_current, _current+NUM_STAGES, 0.0);
+        _frame_start = clock::now();
+    }
+    void add(Stage s, clock::duration d)
+    {
+        _current[s] += std::chrono::duration<double, std::milli>(d).count();
+    }
+    void end_frame()
+    {
+        _current[TOTAL] = std::chrono::duration<double, std::milli>(clock::now()-_frame_start).count();
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::copy(_current, _current+NUM_STAGES, _samples[_next % HISTORY]);
+        _next++;
+    }
+
+    // Any thread
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _next = 0;
+    }
+
+    /*! Fills out (NUM_STAGES x n_pct, row-major) with the given percentiles
+     *  (0-100) of the time in milliseconds spent in each stage, over the
+     *  stored samples. Returns the number of samples used.
+     */
+    size_t summarize(size_t n_pct, const double *percentiles, double *out) const
+    {
+        std::vector<double> copy;
+        size_t n;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            n = std::min<size_t>(_next, (size_t)HISTORY);
+            copy.assign(&_samples[0][0], &_samples[0][0] + n*NUM_STAGES);
+        }
+        std::vector<double> stage(n);
+        for (size_t s=0; s<NUM_STAGES; ++s)
+        {
+            for (size_t i=0; i<n; ++i)
+                stage[i] = copy[i*NUM_STAGES+s];
+            std::sort(stage.begin(), stage.end());
+            for (size_t p=0; p<n_pct; ++p)
+                out[s*n_pct+p] = _percentile(stage, percentiles[p]);
+        }
+        return n;
+    }
+
+private:
+    mutable std::mutex _mutex;
+    double _samples[HISTORY][NUM_STAGES];
+    size_t _next = 0; // total samples ever stored since the last clear()
+
+    // Worker thread only
+    double _current[NUM_STAGES];
+    clock::time_point _frame_start;
+
+    static double _percentile(const std::vector<double>& sorted, double pct)
+    {
+        if (sorted.empty())
+            return 0.0;
+        double pos = std::min(std::max(pct, 0.0), 100.0)/100.0 * (sorted.size()-1);
+        size_t lo = (size_t)pos;
+        size_t hi = std::min(lo+1, sorted.size()-1);
+        double frac = pos - lo;
+        return sorted[lo]*(1-frac) + sorted[hi]*frac;
+    }
+}; // class Stage_Timings
+
+} // namespace isolde
+
+#endif // ISOLDE_STAGE_TIMINGS
@@ -0,0 +1,192 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+
+
+'''
+On-disk cache of parameterised OpenMM Systems. Template assignment and
+:func:`ForceField.createSystem` dominate simulation startup for large models,
+and give the same result every time the same atoms are simulated with the same
+forcefield settings. Systems are stored (gzipped XML from
+:class:`openmm.XmlSerializer`) as they come out of the forcefield, before
+fixed atoms, implicit solvent or any restraint forces are added.
+'''
+
+import os
+
+# Bump to invalidate all existing cache entries
+_FORMAT_VERSION = 1
+_SUFFIX = '.xml.gz'
+
+# SimParams that change the output of createSystem()
+_SYSTEM_PARAMS = (
+    'nonbonded_cutoff_method',
+    'nonbonded_cutoff_distance',
+    'rigid_bonds',
+    'rigid_water',
+    'remove_c_of_m_motion',
+)
+
+_writer = None
+
+def get_system_cache_dir():
+    from .forcefields import get_forcefield_cache_dir
+    d = os.path.join(get_forcefield_cache_dir(), 'systems')
+    if not os.path.exists(d):
+        os.makedirs(d)
+    return d
+
+def system_cache_key(atoms, forcefield, sim_params):
+    '''
+    Hash of everything that determines the System built for a set of atoms:
+    atom, residue and element names, residue numbering and chain IDs (which
+    define the OpenMM residues), bonds, the forcefield and the definitions of
+    its user-defined templates, the createSystem() arguments and the OpenMM
+    and ISOLDE versions.
+
+    Args:
+        * atoms:
+            - a :class:`chimerax.Atoms` instance, in simulation order
+        * forcefield:
+            - the :class:`openmm.app.ForceField` the System is built from
+        * sim_params:
+            - a :class:`SimParams` instance
+    '''
+    import hashlib, numpy
+    from simtk.openmm import version
+    from chimerax.isolde import __version__
+    h = hashlib.sha256()
+    header = (_FORMAT_VERSION, version.version, __version__,
+        sim_params.forcefield, _user_template_definitions(forcefield),
+        [str(getattr(sim_params, p)) for p in _SYSTEM_PARAMS])
+    h.update(repr(header).encode())
+    residues = atoms.residues
+    for strings in (atoms.names, residues.names, residues.chain_ids,
+            residues.insertion_codes):
+        h.update('\0'.join(strings).encode())
+    h.update(numpy.ascontiguousarray(residues.numbers, numpy.int64).tobytes())
+    h.update(numpy.ascontiguousarray(atoms.elements.numbers, numpy.int32).tobytes())
+    for indices in (atoms.indices(alist) for alist in atoms.intra_bonds.atoms):
+        h.update(numpy.ascontiguousarray(indices, numpy.int64).tobytes())
+    return h.hexdigest()
+
+def _user_template_definitions(forcefield):
+    '''
+    Everything about each user-defined (USER_*) template that affects the
+    System: atom names, types and charges, bonds and external bonds. Ligand
+    templates are often regenerated under the same name, so the names alone
+    are not enough.
+    '''
+    templates = [forcefield._templates[n] for n in sorted(forcefield._templates.keys())
+        if n.startswith('USER_')]
+    charges = _charges_by_type(forcefield,
+        set(a.type for t in templates for a in t.atoms))
+    defs = []
+    for t in templates:
+        atoms = [(a.name, a.type, charges.get(a.type),
+            # Per-atom parameters (e.g. charges) given in the template itself
+            sorted(getattr(a, 'parameters', {}).items()))
+            for a in t.atoms]
+        bonds = sorted(tuple(sorted(b)) for b in t.bonds)
+        defs.append((t.name, atoms, bonds, sorted(t.externalBonds)))
+    return defs
+
+def _charges_by_type(forcefield, atom_types):
+    '''
+    Charges assigned to each of the given atom types by the forcefield's
+    generators (one per generator defining a charge for that type).
+    '''
+    charges = {}
+    for g in forcefield.getGenerators():
+        params = getattr(getattr(g, 'params', None), 'paramsForType', None)
+        if params is None:
+            continue
+        for atype in atom_types:
+            p = params.get(atype)
+            if p is not None and 'charge' in p:
+                charges.setdefault(atype, []).append(p['charge'])
+    return charges
+
+def _cache_file(key):
+    return os.path.join(get_system_cache_dir(), key+_SUFFIX)
+
+def load_cached_system(key, num_particles):
+    '''
+    Returns the cached :class:`openmm.System` for a key from
+    :func:`system_cache_key`, or None if there is none. Entries with the wrong
+    number of particles or that fail to load are deleted.
+    '''
+    filename = _cache_file(key)
+    if not os.path.exists(filename):
+        return None
+    import gzip
+    from simtk.openmm import XmlSerializer
+    try:
+        with gzip.open(filename, 'rt') as f:
+            system = XmlSerializer.deserialize(f.read())
+        if system.getNumParticles() != num_particles:
+            raise ValueError('Cached System has the wrong number of particles')
+    except Exception:
+        _remove(filename)
+        return None
+    # Mark as recently used so it survives pruning
+    os.utime(filename)
+    return system
+
+def store_system(key, system, max_entries):
+    '''
+    Save a System under a key from :func:`system_cache_key`. The System is
+    serialised immediately (so it may be modified as soon as this returns);
+    compressing and writing happens on a background thread. The least recently
+    used entries beyond max_entries are then deleted.
+    '''
+    from simtk.openmm import XmlSerializer
+    xml = XmlSerializer.serialize(system)
+    global _writer
+    if _writer is None:
+        from concurrent.futures import ThreadPoolExecutor
+        _writer = ThreadPoolExecutor(max_workers=1)
+    _writer.submit(_write, _cache_file(key), xml, max_entries)
+
+def _write(filename, xml, max_entries):
+    import gzip
+    # Write to a temporary file then move it into place, so a concurrent load
+    # never sees a partial entry
+    tmp = filename + '.tmp'
+    try:
+        with gzip.open(tmp, 'wt', compresslevel=1) as f:
+            f.write(xml)
+        os.replace(tmp, filename)
+    except Exception:
+        _remove(tmp)
+        return
+    prune_system_cache(max_entries)
+
+def prune_system_cache(max_entries):
+    '''
+    Delete all but the max_entries most recently used cached Systems.
+    '''
+    d = get_system_cache_dir()
+    entries = [os.path.join(d, f) for f in os.listdir(d) if f.endswith(_SUFFIX)]
+    if len(entries) <= max_entries:
+        return
+    entries.sort(key=os.path.getmtime, reverse=True)
+    for filename in entries[max_entries:]:
+        _remove(filename)
+
+def clear_system_cache():
+    '''
+    Delete all cached Systems.
+    '''
+    prune_system_cache(0)
+
+def _remove(filename):
+    try:
+        os.remove(filename)
+    except OSError:
+        pass
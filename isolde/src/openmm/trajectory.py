@@ -0,0 +1,153 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Reading back trajectories recorded with
+:func:`Sim_Manager.record_trajectory`. The coordinates are in an ISOLDE
+trajectory (.itrj) file (format described in trajectory_recorder.h), and the
+identities of the simulated atoms in a JSON file alongside it.
+'''
+
+import os
+import json
+import ctypes
+import numpy
+
+from .openmm_interface import c_function, pointer
+
+def _atom_list_filename(filename):
+    return filename + '.atoms.json'
+
+def write_atom_list(filename, atoms):
+    '''
+    Write the identities (chain ID, residue number, insertion code and atom
+    name) of the atoms in a trajectory, in the order they are recorded.
+    '''
+    residues = atoms.residues
+    m = atoms.unique_structures[0]
+    data = {
+        'model': m.id_string,
+        'model_name': m.name,
+        'chain_ids': residues.chain_ids.tolist(),
+        'residue_numbers': residues.numbers.tolist(),
+        'insertion_codes': residues.insertion_codes.tolist(),
+        'atom_names': atoms.names.tolist(),
+    }
+    with open(_atom_list_filename(filename), 'wt') as f:
+        json.dump(data, f)
+
+
+class TrajectoryReader:
+    '''
+    Random access to the frames of an ISOLDE trajectory file. Frames are
+    decoded from the nearest preceding keyframe, so reading them in order is
+    much faster than jumping around.
+    '''
+    def __init__(self, filename):
+        f = c_function('trajectory_reader_new', args=(ctypes.c_char_p,),
+            ret=ctypes.c_void_p)
+        self._c_pointer = ctypes.c_void_p(f(os.fsencode(filename)))
+        self.filename = filename
+        alf = _atom_list_filename(filename)
+        if os.path.exists(alf):
+            with open(alf, 'rt') as af:
+                self.atom_list = json.load(af)
+        else:
+            self.atom_list = None
+
+    def delete(self):
+        if getattr(self, '_c_pointer', None) is not None:
+            c_function('trajectory_reader_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+            self._c_pointer = None
+
+    def __del__(self):
+        self.delete()
+
+    @property
+    def num_atoms(self):
+        f = c_function('trajectory_reader_n_atoms', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def __len__(self):
+        f = c_function('trajectory_reader_n_frames', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    @property
+    def precision(self):
+        '''Precision (in Angstroms) the coordinates were stored at.'''
+        f = c_function('trajectory_reader_precision', args=(ctypes.c_void_p,),
+            ret=ctypes.c_double)
+        return f(self._c_pointer)
+
+    @property
+    def times(self):
+        '''Simulation time (in picoseconds) of each frame.'''
+        f = c_function('trajectory_reader_times',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double)))
+        times = numpy.empty(len(self), numpy.float64)
+        f(self._c_pointer, pointer(times))
+        return times
+
+    def __getitem__(self, i):
+        '''Coordinates of frame i (n x 3, Angstroms).'''
+        n = len(self)
+        if i < 0:
+            i += n
+        if not 0 <= i < n:
+            raise IndexError('Trajectory frame index out of range!')
+        f = c_function('trajectory_reader_read',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double)))
+        coords = numpy.empty((self.num_atoms, 3), numpy.float64)
+        f(self._c_pointer, i, pointer(coords))
+        return coords
+
+    def atoms_in(self, model):
+        '''
+        Find the recorded atoms in a model, in trajectory order. All of them
+        must be present.
+        '''
+        al = self.atom_list
+        if al is None:
+            raise RuntimeError('No atom list was found for this trajectory!')
+        atoms = model.atoms
+        residues = atoms.residues
+        index = {key: i for i, key in enumerate(zip(residues.chain_ids,
+            residues.numbers, residues.insertion_codes, atoms.names))}
+        try:
+            indices = [index[key] for key in zip(al['chain_ids'],
+                al['residue_numbers'], al['insertion_codes'], al['atom_names'])]
+        except KeyError as e:
+            raise RuntimeError('Atom {} from the trajectory is missing from '
+                'model {}!'.format(' '.join(str(k) for k in e.args[0]),
+                model.id_string))
+        return atoms[numpy.array(indices, numpy.int32)]
+
+    def apply(self, i, atoms):
+        '''
+        Set the coordinates of atoms (as returned by :func:`atoms_in`) to
+        those in frame i.
+        '''
+        atoms.coords = self[i]
+
+    def replay(self, session, atoms, start=0, stop=None, step=1):
+        '''
+        Play the trajectory back onto atoms, one frame per graphics frame.
+        Returns the handler for the session's 'new frame' trigger, which may
+        be removed to stop playback early.
+        '''
+        frames = iter(range(start, len(self) if stop is None else stop, step))
+        def _next_frame(*_):
+            try:
+                i = next(frames)
+            except StopIteration:
+                from chimerax.core.triggerset import DEREGISTER
+                return DEREGISTER
+            self.apply(i, atoms)
+        return session.triggers.add_handler('new frame', _next_frame)
@@ -0,0 +1,268 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#include "trajectory_recorder.h"
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+namespace isolde
+{
+
+// Allocated with plain new (by OpenMM_Thread_Handler::start_recording()),
+// which only guarantees the default alignment
+static_assert(alignof(Trajectory_Recorder) <= alignof(std::max_align_t),
+    "Trajectory_Recorder must not be over-aligned!");
+
+// The format is defined as little-endian, which is every platform ChimeraX
+// runs on, so plain values are written and read directly.
+template <typename T>
+static void write_value(std::ostream& out, const T& v)
+{
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+static void read_value(std::istream& in, T& v)
+{
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+static inline void put_varint(std::vector<uint8_t>& buf, int32_t v)
+{
+    uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    while (z >= 0x80)
+    {
+        buf.push_back((uint8_t)(z | 0x80));
+        z >>= 7;
+    }
+    buf.push_back((uint8_t)z);
+}
+
+static inline int32_t get_varint(const uint8_t*& p, const uint8_t* end)
+{
+    uint32_t z = 0;
+    for (int shift=0; shift<35; shift+=7)
+    {
+        if (p == end)
+            throw std::runtime_error("Truncated trajectory frame!");
+        uint8_t b = *p++;
+        z |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    }
+    throw std::runtime_error("Corrupt trajectory frame!");
+}
+
+Trajectory_Recorder::Trajectory_Recorder(const std::string& filename, size_t n_atoms,
+    double precision, size_t keyframe_interval)
+    : _n(n_atoms), _precision(precision), _keyframe_interval(keyframe_interval)
+{
+    if (!(precision > 0))
+        throw std::invalid_argument("Trajectory precision must be greater than zero!");
+    if (keyframe_interval == 0)
+        throw std::invalid_argument("Keyframe interval must be at least 1!");
+    _file.open(filename, std::ios::binary | std::ios::trunc);
+    if (!_file)
+        throw std::runtime_error("Could not open " + filename + " for writing!");
+    _file.write(trajectory_format::MAGIC, 8);
+    write_value(_file, trajectory_format::VERSION);
+    write_value(_file, (uint32_t)_n);
+    write_value(_file, _precision);
+    write_value(_file, (uint32_t)_keyframe_interval);
+    write_value(_file, (uint32_t)0);
+    _file.flush();
+    _bytes = (size_t)_file.tellp();
+    for (uint32_t i=0; i<QUEUE_SIZE; ++i)
+    {
+        _buffers[i].coords.resize(3*_n);
+        _free.push(i);
+    }
+    _last.resize(3*_n);
+    _payload.reserve(3*_n*2);
+    _writer = std::thread(&Trajectory_Recorder::_run, this);
+}
+
+Trajectory_Recorder::~Trajectory_Recorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(_wake_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+    if (_writer.joinable())
+        _writer.join();
+}
+
+bool Trajectory_Recorder::add_frame(const std::vector<OpenMM::Vec3>& coords_nm, double time_ps)
+{
+    uint32_t idx;
+    if (_failed || coords_nm.size() != _n || !_free.pop(idx))
+    {
+        _dropped++;
+        return false;
+    }
+    auto& buf = _buffers[idx];
+    float *out = buf.coords.data();
+    for (const auto& c: coords_nm)
+        for (size_t i=0; i<3; ++i)
+            *out++ = (float)(c[i]*10.0);
+    buf.time = time_ps;
+    _filled.push(idx);
+    // Not taking the lock here: at worst the writer sleeps out its timeout
+    _wake.notify_one();
+    return true;
+}
+
+void Trajectory_Recorder::_run()
+{
+    for (;;)
+    {
+        uint32_t idx;
+        while (_filled.pop(idx))
+        {
+            if (!_failed)
+                _write_frame(_buffers[idx]);
+            _free.push(idx);
+        }
+        if (_stop)
+        {
+            // add_frame() is never called once destruction has started, so
+            // the queue is now empty for good
+            if (_filled.empty())
+                break;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_wake_mutex);
+        _wake.wait_for(lock, std::chrono::milliseconds(20),
+            [this]{ return _stop || !_filled.empty(); });
+    }
+    _file.flush();
+    _file.close();
+}
+
+void Trajectory_Recorder::_write_frame(const Frame_Buffer& f)
+{
+    size_t index = _written;
+    bool key = (index % _keyframe_interval == 0);
+    if (key)
+        std::fill(_last.begin(), _last.end(), 0);
+    double scale = 1.0/_precision;
+    _payload.clear();
+    for (size_t i=0; i<3*_n; ++i)
+    {
+        int32_t q = (int32_t)std::lround(f.coords[i]*scale);
+        put_varint(_payload, q - _last[i]);
+        _last[i] = q;
+    }
+    write_value(_file, trajectory_format::FRAME_MAGIC);
+    write_value(_file, key ? trajectory_format::KEYFRAME : (uint32_t)0);
+    write_value(_file, (uint64_t)index);
+    write_value(_file, f.time);
+    write_value(_file, (uint64_t)_payload.size());
+    _file.write(reinterpret_cast<const char*>(_payload.data()), _payload.size());
+    // Flush at the end of each chunk, so everything up to the last complete
+    // chunk survives a crash
+    if ((index+1) % _keyframe_interval == 0)
+        _file.flush();
+    if (!_file)
+    {
+        _failed = true;
+        return;
+    }
+    _bytes += 32 + _payload.size();
+    _written++;
+}
+
+Trajectory_Reader::Trajectory_Reader(const std::string& filename)
+{
+    _file.open(filename, std::ios::binary);
+    if (!_file)
+        throw std::runtime_error("Could not open " + filename + "!");
+    char magic[8];
+    _file.read(magic, 8);
+    uint32_t version, n, key_interval, reserved;
+    read_value(_file, version);
+    read_value(_file, n);
+    read_value(_file, _precision);
+    read_value(_file, key_interval);
+    read_value(_file, reserved);
+    if (!_file || std::memcmp(magic, trajectory_format::MAGIC, 8) != 0)
+        throw std::runtime_error(filename + " is not an ISOLDE trajectory file!");
+    if (version != trajectory_format::VERSION)
+        throw std::runtime_error("Unsupported trajectory file version!");
+    _n = n;
+    // Index the frames. A partly-written frame at the end (e.g. after a
+    // crash) is ignored.
+    _file.seekg(0, std::ios::end);
+    uint64_t file_size = (uint64_t)_file.tellg();
+    uint64_t pos = 32;
+    while (pos + 32 <= file_size)
+    {
+        _file.seekg(pos);
+        uint32_t fmagic, flags;
+        uint64_t index, length;
+        double t;
+        read_value(_file, fmagic);
+        read_value(_file, flags);
+        read_value(_file, index);
+        read_value(_file, t);
+        read_value(_file, length);
+        if (!_file || fmagic != trajectory_format::FRAME_MAGIC
+            || pos + 32 + length > file_size)
+            break;
+        if (_offsets.empty() && !(flags & trajectory_format::KEYFRAME))
+            throw std::runtime_error("Trajectory does not start with a keyframe!");
+        _offsets.push_back(pos+32);
+        _lengths.push_back(length);
+        _times.push_back(t);
+        _keyframe.push_back(flags & trajectory_format::KEYFRAME);
+        pos += 32 + length;
+    }
+    _file.clear();
+    _current.resize(3*_n);
+}
+
+void Trajectory_Reader::_decode(size_t i)
+{
+    _payload.resize(_lengths[i]);
+    _file.seekg(_offsets[i]);
+    _file.read(reinterpret_cast<char*>(_payload.data()), _payload.size());
+    if (!_file)
+        throw std::runtime_error("Error reading trajectory frame!");
+    if (_keyframe[i])
+        std::fill(_current.begin(), _current.end(), 0);
+    const uint8_t *p = _payload.data();
+    const uint8_t *end = p + _payload.size();
+    for (auto& q: _current)
+        q += get_varint(p, end);
+    _current_index = i;
+}
+
+void Trajectory_Reader::read(size_t i, double *coords)
+{
+    if (i >= n_frames())
+        throw std::out_of_range("Trajectory frame index out of range!");
+    size_t start = i;
+    while (!_keyframe[start])
+        start--;
+    // Carry on from the cached frame if it's in the same chunk and not past i
+    if (_current_index >= (int64_t)start && _current_index <= (int64_t)i)
+        start = _current_index + 1;
+    for (size_t k=start; k<=i; ++k)
+        _decode(k);
+    for (size_t k=0; k<3*_n; ++k)
+        coords[k] = _current[k]*_precision;
+}
+
+} // namespace isolde
@@ -0,0 +1,143 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_TRAJECTORY_RECORDER
+#define ISOLDE_TRAJECTORY_RECORDER
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include <OpenMM.h>
+#include "spsc_ring.h"
+
+namespace isolde
+{
+
+/*! ISOLDE trajectory (.itrj) file layout. All values little-endian.
+ *
+ *  File header: 8-byte magic "ISOLTRJ1", uint32 version, uint32 n_atoms,
+ *  float64 precision (Angstroms), uint32 keyframe interval, uint32 reserved.
+ *
+ *  Each frame: uint32 magic "FRME", uint32 flags (bit 0 set for a
+ *  keyframe), uint64 frame index, float64 simulation time (ps), uint64
+ *  payload length, then the payload: every coordinate rounded to a multiple
+ *  of the precision and stored as the difference from the previous frame
+ *  (from zero for a keyframe), zig-zag and varint encoded. Keyframes start
+ *  each chunk of frames, so a reader can seek without decoding from the
+ *  start, and the file is flushed after each chunk.
+ */
+namespace trajectory_format
+{
+    const char MAGIC[8] = {'I','S','O','L','T','R','J','1'};
+    const uint32_t VERSION = 1;
+    const uint32_t FRAME_MAGIC = 0x454d5246; // "FRME"
+    const uint32_t KEYFRAME = 1;
+}
+
+//! Records coordinate frames from the simulation thread to an .itrj file
+/*! add_frame() only copies the coordinates into a free buffer and hands it
+ *  to a writer thread, which does all the encoding and file I/O. If the
+ *  writer falls behind, frames are dropped rather than holding up the
+ *  simulation.
+ */
+class Trajectory_Recorder
+{
+public:
+    static const size_t QUEUE_SIZE = 8;
+
+    Trajectory_Recorder(const std::string& filename, size_t n_atoms,
+        double precision, size_t keyframe_interval);
+    //! Writes any queued frames and closes the file
+    ~Trajectory_Recorder();
+
+    //! Simulation thread. Returns false if the frame had to be dropped.
+    bool add_frame(const std::vector<OpenMM::Vec3>& coords_nm, double time_ps);
+
+    size_t n_atoms() const { return _n; }
+    size_t frames_written() const { return _written; }
+    size_t frames_dropped() const { return _dropped; }
+    size_t bytes_written() const { return _bytes; }
+    //! Set if the writer hit an I/O error (no further frames are written)
+    bool failed() const { return _failed; }
+
+private:
+    struct Frame_Buffer
+    {
+        std::vector<float> coords; // Angstroms
+        double time;
+    };
+
+    size_t _n;
+    double _precision;
+    size_t _keyframe_interval;
+    std::ofstream _file;
+
+    Frame_Buffer _buffers[QUEUE_SIZE];
+    Spsc_Ring<uint32_t, QUEUE_SIZE> _free;   // writer -> simulation
+    Spsc_Ring<uint32_t, QUEUE_SIZE> _filled; // simulation -> writer
+
+    std::thread _writer;
+    std::mutex _wake_mutex;
+    std::condition_variable _wake;
+    std::atomic<bool> _stop{false};
+    std::atomic<size_t> _written{0};
+    std::atomic<size_t> _dropped{0};
+    std::atomic<size_t> _bytes{0};
+    std::atomic<bool> _failed{false};
+
+    // Writer thread only
+    std::vector<int32_t> _last;
+    std::vector<uint8_t> _payload;
+
+    void _run();
+    void _write_frame(const Frame_Buffer& f);
+}; // class Trajectory_Recorder
+
+//! Random access to the frames of an .itrj file
+class Trajectory_Reader
+{
+public:
+    Trajectory_Reader(const std::string& filename);
+
+    size_t n_atoms() const { return _n; }
+    size_t n_frames() const { return _offsets.size(); }
+    double precision() const { return _precision; }
+    double time(size_t i) const { return _times.at(i); }
+    //! Coordinates of frame i in Angstroms. Fastest when read in order.
+    void read(size_t i, double *coords);
+
+private:
+    std::ifstream _file;
+    size_t _n;
+    double _precision;
+    std::vector<uint64_t> _offsets; // of each frame's payload
+    std::vector<uint64_t> _lengths;
+    std::vector<double> _times;
+    std::vector<uint8_t> _keyframe;
+
+    // The last frame decoded, to continue from
+    std::vector<int32_t> _current;
+    int64_t _current_index = -1;
+    std::vector<uint8_t> _payload;
+
+    void _decode(size_t i);
+}; // class Trajectory_Reader
+
+} // namespace isolde
+
+#endif // ISOLDE_TRAJECTORY_RECORDER
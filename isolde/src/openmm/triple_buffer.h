@@ -0,0 +1,109 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_TRIPLE_BUFFER
+#define ISOLDE_TRIPLE_BUFFER
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+namespace isolde
+{
+
+/*! Single-producer, single-consumer triple buffer.
+ *
+ *  The producer (simulation thread) always has a private back buffer to
+ *  write into, and the consumer (GUI thread) always has a private front
+ *  buffer to read from. The third buffer sits in the middle, and is swapped
+ *  with either side using a single atomic exchange. Neither side ever blocks
+ *  the other: the consumer simply picks up the most recent complete frame
+ *  (if any) that the producer has published since the last read.
+ *
+ *  Each publish increments a generation counter, allowing the consumer to
+ *  cheaply tell whether anything new has arrived.
+ */
+template <typename T>
+class Triple_Buffer
+{
+public:
+    Triple_Buffer() {}
+    Triple_Buffer(size_t n) { resize(n); }
+
+    //! Not thread-safe: only call when neither side is active.
+    void resize(size_t n)
+    {
+        for (auto& b: _buffers)
+            b.assign(n, T());
+        _back = 0;
+        _middle.store(1);
+        _front = 2;
+        _generation.store(0);
+        _front_generation = 0;
+        for (auto& g: _gen)
+            g = 0;
+    }
+
+    size_t size() const { return _buffers[0].size(); }
+
+    //! Producer side: the buffer to be filled before calling publish().
+    T* back() { return _buffers[_back].data(); }
+
+    //! Producer side: make the contents of back() available to the consumer.
+    void publish()
+    {
+        _gen[_back] = _generation.load(std::memory_order_relaxed) + 1;
+        uint8_t prev = _middle.exchange(static_cast<uint8_t>(_back | FRESH_BIT),
+            std::memory_order_acq_rel);
+        _back = prev & INDEX_MASK;
+        _generation.fetch_add(1, std::memory_order_release);
+    }
+
+    /*! Consumer side: if a new frame has been published since the last call
+     *  swap it into the front buffer. Returns true if the front buffer has
+     *  changed.
+     */
+    bool update()
+    {
+        if (!(_middle.load(std::memory_order_relaxed) & FRESH_BIT))
+            return false;
+        uint8_t prev = _middle.exchange(static_cast<uint8_t>(_front), std::memory_order_acq_rel);
+        _front = prev & INDEX_MASK;
+        _front_generation = _gen[_front];
+        return true;
+    }
+
+    //! Consumer side: the most recent frame retrieved by update().
+    const T* front() const { return _buffers[_front].data(); }
+
+    //! Generation of the frame currently held in front(). Zero if none yet.
+    uint64_t front_generation() const { return _front_generation; }
+
+    //! Total number of frames published so far. Safe from either side.
+    uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+private:
+    static const uint8_t FRESH_BIT = 0x4;
+    static const uint8_t INDEX_MASK = 0x3;
+    std::vector<T> _buffers[3];
+    uint64_t _gen[3] = {0,0,0};
+    size_t _back = 0;
+    std::atomic<uint8_t> _middle{1};
+    size_t _front = 2;
+    std::atomic<uint64_t> _generation{0};
+    uint64_t _front_generation = 0;
+}; // class Triple_Buffer
+
+} // namespace isolde
+
+#endif // ISOLDE_TRIPLE_BUFFER
@@ -0,0 +1,180 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_VEC_KERNELS
+#define ISOLDE_VEC_KERNELS
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <OpenMM.h>
+
+/*
+ * Tight loops over flat arrays of xyz triplets, written so that the compiler
+ * can auto-vectorise them for whatever instruction set the bundle is built
+ * for (SSE2/AVX on x86, NEON on ARM). All magnitude comparisons are done on
+ * squared values, so no square roots are taken in the inner loops. Counts
+ * are accumulated in doubles and maxima are found in blocks, since neither
+ * integer/double mixing nor floating-point max reductions are vectorised
+ * without -ffast-math.
+ */
+
+namespace isolde
+{
+namespace kernels
+{
+
+static_assert(sizeof(OpenMM::Vec3) == 3*sizeof(double),
+    "OpenMM::Vec3 must be three packed doubles to be treated as a flat array");
+
+inline const double* flat(const std::vector<OpenMM::Vec3>& v)
+{
+    return reinterpret_cast<const double*>(v.data());
+}
+inline double* flat(std::vector<OpenMM::Vec3>& v)
+{
+    return reinterpret_cast<double*>(v.data());
+}
+
+//! In place: smoothed = alpha*current + (1-alpha)*smoothed over n doubles
+inline void exponential_smooth(double* __restrict smoothed, const double* __restrict current,
+    size_t n, double alpha)
+{
+    const double beta = 1.0-alpha;
+    for (size_t i=0; i<n; ++i)
+        smoothed[i] = alpha*current[i] + beta*smoothed[i];
+}
+
+const size_t MAX_BLOCK_SIZE = 64;
+
+//! Number of the n 3-vectors in v with squared magnitude greater than limit_sq
+inline size_t count_above_sq(const double* __restrict v, size_t n, double limit_sq)
+{
+    double count = 0;
+    for (size_t i=0; i<n; ++i)
+    {
+        const double* x = v+3*i;
+        double sq = x[0]*x[0] + x[1]*x[1] + x[2]*x[2];
+        count += (sq > limit_sq) ? 1.0 : 0.0;
+    }
+    return static_cast<size_t>(count);
+}
+
+//! Number of the n 3-vectors for which |a-b|^2 is greater than limit_sq
+inline size_t count_diff_above_sq(const double* __restrict a, const double* __restrict b,
+    size_t n, double limit_sq)
+{
+    double count = 0;
+    for (size_t i=0; i<n; ++i)
+    {
+        const double* x = a+3*i;
+        const double* y = b+3*i;
+        double dx = x[0]-y[0], dy = x[1]-y[1], dz = x[2]-y[2];
+        count += ((dx*dx + dy*dy + dz*dz) > limit_sq) ? 1.0 : 0.0;
+    }
+    return static_cast<size_t>(count);
+}
+
+/*! Indices of the 3-vectors in v with squared magnitude greater than
+ *  limit_sq. Runs the cheap vectorised count first, so the (branchy) index
+ *  collection only happens in the rare case that any are found.
+ */
+inline std::vector<size_t> indices_above_sq(const double* v, size_t n, double limit_sq)
+{
+    std::vector<size_t> indices;
+    if (count_above_sq(v, n, limit_sq) == 0)
+        return indices;
+    for (size_t i=0; i<n; ++i)
+    {
+        const double* x = v+3*i;
+        if (x[0]*x[0] + x[1]*x[1] + x[2]*x[2] > limit_sq)
+            indices.push_back(i);
+    }
+    return indices;
+}
+
+//! As for indices_above_sq(), but for the differences a-b
+inline std::vector<size_t> indices_diff_above_sq(const double* a, const double* b, size_t n, double limit_sq)
+{
+    std::vector<size_t> indices;
+    if (count_diff_above_sq(a, b, n, limit_sq) == 0)
+        return indices;
+    for (size_t i=0; i<n; ++i)
+    {
+        const double* x = a+3*i;
+        const double* y = b+3*i;
+        double dx = x[0]-y[0], dy = x[1]-y[1], dz = x[2]-y[2];
+        if (dx*dx + dy*dy + dz*dz > limit_sq)
+            indices.push_back(i);
+    }
+    return indices;
+}
+
+//! Maximum squared magnitude of the n 3-vectors in v
+inline double max_sq(const double* __restrict v, size_t n)
+{
+    double m = 0;
+    double sq[MAX_BLOCK_SIZE];
+    for (size_t start=0; start<n; start+=MAX_BLOCK_SIZE)
+    {
+        size_t len = std::min(MAX_BLOCK_SIZE, n-start);
+        const double* x = v+3*start;
+        for (size_t i=0; i<len; ++i)
+            sq[i] = x[3*i]*x[3*i] + x[3*i+1]*x[3*i+1] + x[3*i+2]*x[3*i+2];
+        for (size_t i=0; i<len; ++i)
+            m = sq[i] > m ? sq[i] : m;
+    }
+    return m;
+}
+
+//! Maximum squared magnitude of the n 3-vectors in v, each multiplied by mask[i]
+inline double max_sq_masked(const double* __restrict v, const double* __restrict mask, size_t n)
+{
+    double m = 0;
+    double sq[MAX_BLOCK_SIZE];
+    for (size_t start=0; start<n; start+=MAX_BLOCK_SIZE)
+    {
+        size_t len = std::min(MAX_BLOCK_SIZE, n-start);
+        const double* x = v+3*start;
+        const double* k = mask+start;
+        for (size_t i=0; i<len; ++i)
+            sq[i] = (x[3*i]*x[3*i] + x[3*i+1]*x[3*i+1] + x[3*i+2]*x[3*i+2]) * k[i];
+        for (size_t i=0; i<len; ++i)
+            m = sq[i] > m ? sq[i] : m;
+    }
+    return m;
+}
+
+//! Maximum squared magnitude over the 3-vectors of v at the n given indices
+inline double max_sq_indexed(const double* __restrict v, const size_t* __restrict indices, size_t n)
+{
+    double m = 0;
+    double sq[MAX_BLOCK_SIZE];
+    for (size_t start=0; start<n; start+=MAX_BLOCK_SIZE)
+    {
+        size_t len = std::min(MAX_BLOCK_SIZE, n-start);
+        const size_t* idx = indices+start;
+        for (size_t i=0; i<len; ++i)
+        {
+            const double* x = v+3*idx[i];
+            sq[i] = x[0]*x[0] + x[1]*x[1] + x[2]*x[2];
+        }
+        for (size_t i=0; i<len; ++i)
+            m = sq[i] > m ? sq[i] : m;
+    }
+    return m;
+}
+
+} // namespace kernels
+} // namespace isolde
+
+#endif // ISOLDE_VEC_KERNELS
@@ -53,7 +53,8 @@ class B_Factor_Direct_Iso:
         # want to update B-factors for the mobile atoms
         sim_construct = isolde.sim_manager.sim_construct
         ma = self._mobile_atoms = sim_construct.mobile_atoms
-        self._trajectory = numpy.empty((num_samples, *ma.coords.shape))
+        from ..geometry import CoordStatistics
+        self._coord_stats = CoordStatistics(len(ma))
 
         isolde.sim_handler.triggers.add_handler('coord update', self._coord_update_cb)
 
@@ -62,8 +63,7 @@ class B_Factor_Direct_Iso:
             return
         m = self.model
         if self._count < self._num_samples:
-            coords = self._mobile_atoms.coords
-            self._trajectory[self._count] = coords
+            self._coord_stats.add(self._mobile_atoms.coords)
             self._count += 1
         else:
             self.isolde.discard_sim(revert_to='start', warn=False)
@@ -73,10 +73,10 @@ class B_Factor_Direct_Iso:
 
     def _optimize_u_iso(self):
         import numpy
-        traj = self._trajectory
-        variance = traj.var(axis=0).sum(axis=1)
-        from chimerax.clipper.clipper_python import Util
-        self._u_base = numpy.array([Util.u2b(u) for u in variance]).astype(numpy.float32)
+        from math import pi
+        variance = self._coord_stats.variances()
+        # U to B
+        self._u_base = (8*pi**2*variance).astype(numpy.float32)
         from chimerax.clipper.symmetry import get_map_mgr
         map_mgr = get_map_mgr(self.model)
         xmapset = self._xmapset = map_mgr.xmapsets[0]
@@ -145,8 +145,9 @@ class B_Factor_Direct_Aniso:
         isolde.sim_params.temperature = 100
 
         import numpy
-        # Prepare a container to hold the sampled coordinates
-        self._trajectory = numpy.empty((num_samples, len(m.atoms.coords), 3))
+        # Running statistics of the sampled coordinates
+        from ..geometry import CoordStatistics
+        self._coord_stats = CoordStatistics(len(m.atoms))
         self._current_frame = 0
         self._num_samples = num_samples
 
@@ -168,7 +169,7 @@ class B_Factor_Direct_Aniso:
         if self.isolde.simulation_mode == 'min':
             return
         if self._current_frame < self._num_samples:
-            self._trajectory[self._current_frame] = self.model.atoms.coords
+            self._coord_stats.add(self.model.atoms.coords)
             self._current_frame += 1
         else:
             self.isolde.discard_sim(revert_to='start', warn=False)
@@ -178,24 +179,8 @@ class B_Factor_Direct_Aniso:
 
     def _optimize_anisou(self):
         import numpy
-        from numpy import cov
-        natoms = len(self.model.atoms)
-        covariances = self._covariances = numpy.empty((natoms,3,3))
-        traj = self._trajectory
-        for i in range(natoms):
-            coords = traj[:,i,:]
-            covariances[i] = numpy.abs(cov(coords, rowvar=False))
-        #tensors = self._tensors = numpy.empty(covariances.shape)
-        # for cv, t in zip(covariances, tensors):
-        #     t[:] = numpy.abs(numpy.linalg.inv(cv))
-
-        anisou = self._anisou_base = numpy.empty((natoms, 6))
-        anisou[:,0] = covariances[:,0,0]
-        anisou[:,1] = covariances[:,1,1]
-        anisou[:,2] = covariances[:,2,2]
-        anisou[:,3] = covariances[:,0,1]
-        anisou[:,4] = covariances[:,0,2]
-        anisou[:,5] = covariances[:,1,2]
+        # Already in aniso_u6 order (xx, yy, zz, xy, xz, yz)
+        anisou = self._anisou_base = numpy.abs(self._coord_stats.covariances())
         # Convert from B to U
         from math import pi
         anisou[:] = numpy.sqrt(anisou/(8*pi**2))
@@ -11,6 +11,8 @@ def register_remote_commands(logger):
     register_isolde_xmlrpc_server(logger)
     from.rest_server.cmd import register_isolde_rest_server
     register_isolde_rest_server(logger)
+    from .websockets.cmd import register_isolde_websocket_server
+    register_isolde_websocket_server(logger)
 
 from . import server_methods as _sm
 
@@ -0,0 +1,131 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright: 2016-2019 Tristan Croll
+
+'''
+Binary message format for the ISOLDE websocket server, for clients that move
+whole coordinate sets or large batches of restraint edits. Depends only on
+NumPy, so it may be copied into a client that doesn't have ChimeraX.
+
+Each websocket binary message holds one frame (all values little-endian)::
+
+    header:   4s magic (b'ISLB'), B version, B message type, H reserved,
+              I request id, I metadata length, I number of arrays
+    metadata: UTF-8 JSON object (small values only: model IDs, restraint kind)
+    arrays:   each a length-prefixed block of
+              16s name, 4s dtype (NumPy type string, e.g. b'<f8'), B ndim,
+              3x padding, ndim x Q shape, Q data length, then the raw data
+              (C order)
+
+Replies carry the request ID of the frame they answer. Errors come back as
+an ERROR frame with 'error' and 'traceback' in the metadata.
+'''
+
+import struct
+import json
+import numpy
+
+MAGIC = b'ISLB'
+VERSION = 1
+
+# Message types
+ERROR = 0
+REPLY = 1
+GET_COORDS = 2
+SET_COORDS = 3
+EDIT_RESTRAINTS = 4
+SUBSCRIBE_COORDS = 5
+UNSUBSCRIBE_COORDS = 6
+COORDS_FRAME = 7
+
+_HEADER = struct.Struct('<4sBBHIII')
+_ARRAY_HEADER = struct.Struct('<16s4sB3x')
+_U64 = struct.Struct('<Q')
+
+_ALLOWED_KINDS = 'biuf'
+
+def encode(msg_type, request_id=0, meta=None, arrays=None):
+    '''
+    Pack a frame into a bytes object.
+
+    Args:
+        * msg_type:
+            - one of the message type constants in this module
+        * request_id:
+            - arbitrary 32-bit integer, echoed back in the reply
+        * meta:
+            - a JSON-serialisable dict, or None
+        * arrays:
+            - a dict mapping names (up to 16 ASCII characters) to NumPy
+              arrays of booleans, integers or floats, or None
+    '''
+    meta_bytes = json.dumps(meta or {}).encode('utf-8')
+    arrays = arrays or {}
+    parts = [_HEADER.pack(MAGIC, VERSION, msg_type, 0, request_id,
+        len(meta_bytes), len(arrays)), meta_bytes]
+    for name, arr in arrays.items():
+        arr = numpy.ascontiguousarray(arr)
+        if arr.dtype.kind not in _ALLOWED_KINDS:
+            raise TypeError('Array {} has unsupported type {}'.format(name, arr.dtype))
+        name_bytes = name.encode('ascii')
+        if len(name_bytes) > 16:
+            raise ValueError('Array names are limited to 16 characters!')
+        # Always send little-endian
+        arr = arr.astype(arr.dtype.newbyteorder('<'), copy=False)
+        dtype_str = arr.dtype.str.encode('ascii')
+        parts.append(_ARRAY_HEADER.pack(name_bytes, dtype_str, arr.ndim))
+        parts.append(struct.pack('<{}Q'.format(arr.ndim), *arr.shape))
+        data = arr.tobytes()
+        parts.append(_U64.pack(len(data)))
+        parts.append(data)
+    return b''.join(parts)
+
+def decode(frame):
+    '''
+    Unpack a frame made by :func:`encode`. Returns (msg_type, request_id,
+    meta, arrays). The arrays are read-only views into the frame.
+    '''
+    view = memoryview(frame)
+    if len(view) < _HEADER.size:
+        raise ValueError('Frame is too short!')
+    magic, version, msg_type, _, request_id, meta_len, n_arrays = \
+        _HEADER.unpack_from(view, 0)
+    if magic != MAGIC:
+        raise ValueError('Not an ISOLDE binary frame!')
+    if version != VERSION:
+        raise ValueError('Unsupported binary frame version {}'.format(version))
+    offset = _HEADER.size
+    meta = json.loads(bytes(view[offset:offset+meta_len]).decode('utf-8'))
+    offset += meta_len
+    arrays = {}
+    for _ in range(n_arrays):
+        name, dtype_str, ndim = _ARRAY_HEADER.unpack_from(view, offset)
+        offset += _ARRAY_HEADER.size
+        shape = struct.unpack_from('<{}Q'.format(ndim), view, offset)
+        offset += 8*ndim
+        nbytes, = _U64.unpack_from(view, offset)
+        offset += 8
+        if offset + nbytes > len(view):
+            raise ValueError('Array data runs past the end of the frame!')
+        # Type strings shorter than 4 characters are padded with NULs
+        dtype = numpy.dtype(dtype_str.rstrip(b'\0').decode('ascii'))
+        if dtype.kind not in _ALLOWED_KINDS:
+            raise TypeError('Unsupported array type {}'.format(dtype))
+        arr = numpy.frombuffer(view[offset:offset+nbytes], dtype=dtype)
+        arrays[name.rstrip(b'\0').decode('ascii')] = arr.reshape(shape)
+        offset += nbytes
+    return msg_type, request_id, meta, arrays
+
+def error_frame(request_id, err):
+    '''
+    Frame reporting an exception raised while handling a request.
+    '''
+    import traceback
+    return encode(ERROR, request_id, {
+        'error': str(err),
+        'traceback': ''.join(traceback.format_exception(type(err), err, err.__traceback__)),
+    })
@@ -0,0 +1,151 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright: 2016-2019 Tristan Croll
+
+'''
+Handlers for binary frames (see :mod:`binary_frames`). Each takes the
+ChimeraX session, the frame metadata and its arrays, runs in the GUI thread,
+and returns the (meta, arrays) for the reply. Atoms are always identified by
+their indices in model.atoms.
+'''
+
+import numpy
+from ..server_methods import _model_from_id
+
+def _structure(session, meta):
+    from chimerax.atomic import AtomicStructure
+    try:
+        model_id = meta['model']
+    except KeyError:
+        raise TypeError('You must provide a model ID with the key "model"!')
+    m = _model_from_id(session, model_id)
+    if not isinstance(m, AtomicStructure):
+        raise TypeError('Model {} is not an atomic structure!'.format(model_id))
+    return m
+
+def _selected_atoms(m, arrays, key='indices'):
+    atoms = m.atoms
+    indices = arrays.get(key, None)
+    if indices is None:
+        return atoms
+    indices = numpy.asarray(indices, numpy.int64)
+    if len(indices) and (indices.min() < 0 or indices.max() >= len(atoms)):
+        raise IndexError('Atom indices out of range for model {}!'.format(m.id_string))
+    return atoms[indices]
+
+def _running_sim_model(session):
+    isolde = getattr(session, 'isolde', None)
+    if isolde is None or not isolde.simulation_running:
+        return None
+    return isolde.selected_model
+
+def get_coords(session, meta, arrays):
+    '''
+    Coordinates of a model's atoms.
+
+    Meta: 'model' (required); 'dtype' ('f8' by default, or 'f4' to halve the
+    data sent).
+    Arrays: optional int 'indices' to return only a subset of atoms.
+    Reply arrays: 'coords' (n x 3, Angstroms).
+    '''
+    m = _structure(session, meta)
+    atoms = _selected_atoms(m, arrays)
+    coords = atoms.coords.astype(meta.get('dtype', 'f8'), copy=False)
+    return {'model': m.id_string, 'num_atoms': len(atoms)}, {'coords': coords}
+
+def set_coords(session, meta, arrays):
+    '''
+    Replace a model's coordinates. Not allowed on a model while it is being
+    simulated, since the simulation would overwrite them.
+
+    Meta: 'model' (required).
+    Arrays: 'coords' (n x 3, Angstroms), optional int 'indices' if n is not
+    the number of atoms in the model.
+    '''
+    m = _structure(session, meta)
+    if m is _running_sim_model(session):
+        raise RuntimeError('Model {} is being simulated. Stop the simulation '
+            'before setting its coordinates.'.format(m.id_string))
+    atoms = _selected_atoms(m, arrays)
+    coords = arrays.get('coords', None)
+    if coords is None or coords.shape != (len(atoms), 3):
+        raise ValueError('Need an (n x 3) "coords" array with one row per atom!')
+    atoms.coords = coords
+    return {'num_atoms': len(atoms)}, {}
+
+# Restraint parameters that may be set in a batch, and the number of atoms
+# in each restraint
+_RESTRAINT_KINDS = {
+    'position': (1, ('targets', 'spring_constants', 'enableds')),
+    'distance': (2, ('targets', 'spring_constants', 'enableds')),
+    'adaptive_distance': (2, ('targets', 'tolerances', 'kappas', 'cs',
+        'alphas', 'enableds')),
+}
+
+def edit_restraints(session, meta, arrays):
+    '''
+    Create or update a batch of restraints in one call. Restraints are
+    created where they don't already exist. Property arrays are applied in
+    the order listed below, with enableds last, so a restraint can be fully
+    defined and switched on in the same frame.
+
+    Meta: 'model' (required); 'kind' (required, one of 'position',
+    'distance', 'adaptive_distance'); 'name' (adaptive distance restraint
+    group, default 'Adaptive Distance Restraints').
+    Arrays: int 'atoms' - (n,) for position restraints or (n x 2) for
+    distance restraints - plus any of the following, each with n rows:
+
+        position:           targets (n x 3), spring_constants, enableds
+        distance:           targets, spring_constants, enableds
+        adaptive_distance:  targets, tolerances, kappas, cs, alphas, enableds
+
+    Units are as for the matching properties of the restraint collections.
+    Reply meta: 'num_restraints'.
+    '''
+    m = _structure(session, meta)
+    kind = meta.get('kind', None)
+    if kind not in _RESTRAINT_KINDS:
+        raise TypeError('Restraint kind must be one of {}'.format(
+            ', '.join(_RESTRAINT_KINDS)))
+    n_atoms, properties = _RESTRAINT_KINDS[kind]
+    unknown = set(arrays) - set(properties) - {'atoms'}
+    if unknown:
+        raise TypeError('Parameters {} are not valid for {} restraints!'.format(
+            ', '.join(sorted(unknown)), kind))
+    all_atoms = m.atoms
+    indices = numpy.asarray(arrays.get('atoms', ()), numpy.int64)
+    if n_atoms == 1:
+        indices = indices.reshape(-1)
+    elif indices.ndim != 2 or indices.shape[1] != n_atoms:
+        raise ValueError('"atoms" must be an (n x {}) array!'.format(n_atoms))
+    n = len(indices)
+    if n and (indices.min() < 0 or indices.max() >= len(all_atoms)):
+        raise IndexError('Atom indices out of range for model {}!'.format(m.id_string))
+    from chimerax.isolde import session_extensions as sx
+    if kind == 'position':
+        restraints = sx.get_position_restraint_mgr(m).add_restraints(all_atoms[indices])
+    else:
+        if kind == 'distance':
+            mgr = sx.get_distance_restraint_mgr(m)
+        else:
+            mgr = sx.get_adaptive_distance_restraint_mgr(m,
+                name=meta.get('name', 'Adaptive Distance Restraints'))
+        restraints = mgr._get_restraints(all_atoms[indices[:,0]],
+            all_atoms[indices[:,1]], create=True)
+    if len(restraints) != n:
+        # Some were rejected (hydrogens for position restraints; same or
+        # bonded atoms for distance restraints)
+        raise ValueError('Only {} of {} restraints could be created.'.format(
+            len(restraints), n))
+    for prop in properties:
+        vals = arrays.get(prop, None)
+        if vals is None:
+            continue
+        if len(vals) != n:
+            raise ValueError('"{}" must have one row per restraint!'.format(prop))
+        setattr(restraints, prop, vals)
+    return {'num_restraints': n}, {}
@@ -0,0 +1,61 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright: 2016-2019 Tristan Croll
+
+_server = None
+
+def start_server(session, port=None):
+    from chimerax.core.commands import run
+    run(session, 'isolde start')
+    global _server
+    if _server is not None:
+        session.logger.warning('ISOLDE websocket server is already running')
+    else:
+        from .local_server import IsoldeSocketServer
+        _server = IsoldeSocketServer(session)
+        _server.start(port)
+    return _server
+
+def report_info(session):
+    port = getattr(_server, 'port', None)
+    if port is None:
+        session.logger.info('ISOLDE websocket server is not running')
+    else:
+        session.logger.info('ISOLDE websocket server is listening on host {} port {}'.format(
+            _server.address, port))
+
+def stop_server(session):
+    global _server
+    if _server is None:
+        session.logger.info('ISOLDE websocket server is not running')
+    else:
+        _server.terminate()
+        _server = None
+        session.logger.info('ISOLDE websocket server stopped')
+
+
+def register_isolde_websocket_server(logger):
+    from chimerax.core.commands import (
+        register,
+        CmdDesc, IntArg,
+    )
+    def register_start(logger):
+        desc = CmdDesc(
+            keyword=[('port', IntArg),
+                ],
+            synopsis='Start ISOLDE websocket server (JSON and binary frames)'
+        )
+        register('isolde remote websocket start', desc, start_server, logger=logger)
+    def register_report_port(logger):
+        desc = CmdDesc(synopsis='Report ISOLDE websocket server address and port')
+        register('isolde remote websocket info', desc, report_info, logger=logger)
+    def register_stop_server(logger):
+        desc = CmdDesc(synopsis='Stop the ISOLDE websocket server')
+        register('isolde remote websocket stop', desc, stop_server, logger=logger)
+    register_start(logger)
+    register_report_port(logger)
+    register_stop_server(logger)
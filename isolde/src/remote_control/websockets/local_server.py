@@ -1,4 +1,5 @@
 import asyncio
+import numpy
 try:
     import websockets
 except ImportError:
@@ -37,42 +38,202 @@ class SocketManager:
             await websocket.send(message)
 
 
+def _call_in_gui_thread(session, func, *args):
+    '''
+    Run func(session, *args) in the ChimeraX GUI thread and wait for the
+    result. Exceptions are re-raised in the calling thread.
+    '''
+    from queue import Queue
+    q = Queue()
+    def inner_func():
+        try:
+            q.put((func(session, *args), None))
+        except Exception as e:
+            q.put((None, e))
+    session.ui.thread_safe(inner_func)
+    result, err = q.get()
+    if err is not None:
+        raise err
+    return result
+
+
+class _CoordStream:
+    '''
+    Per-connection coordinate streaming. For each subscribed model, a
+    COORDS_FRAME is pushed whenever its coordinates change (at most once per
+    graphics frame, since that is when ChimeraX fires its 'changes'
+    triggers). If the client falls behind, the oldest unsent frames are
+    dropped.
+    '''
+    MAX_QUEUED = 4
+
+    def __init__(self, loop):
+        self.loop = loop
+        self.queue = asyncio.Queue()
+        self._handlers = {}
+
+    # GUI thread
+    def subscribe(self, session, model, request_id, meta, atom_indices):
+        from . import binary_frames as bf
+        self.unsubscribe(session, model)
+        if atom_indices is not None:
+            atom_indices = numpy.array(atom_indices, numpy.int64)
+        dtype = meta.get('dtype', 'f8')
+        count = [0]
+        def push():
+            atoms = model.atoms
+            if atom_indices is not None:
+                atoms = atoms[atom_indices]
+            frame_meta = {'model': model.id_string, 'frame': count[0]}
+            count[0] += 1
+            frame = bf.encode(bf.COORDS_FRAME, request_id, frame_meta,
+                {'coords': atoms.coords.astype(dtype, copy=False)})
+            self.loop.call_soon_threadsafe(self._enqueue, frame)
+        def changes_cb(trigger_name, changes):
+            if 'coord changed' in changes[1].atom_reasons():
+                push()
+        self._handlers[model] = model.triggers.add_handler('changes', changes_cb)
+        push()
+
+    # GUI thread
+    def unsubscribe(self, session, model):
+        h = self._handlers.pop(model, None)
+        if h is not None and not model.deleted:
+            model.triggers.remove_handler(h)
+
+    # GUI thread
+    def close(self, session):
+        for model in list(self._handlers.keys()):
+            self.unsubscribe(session, model)
+
+    # Event loop thread
+    def _enqueue(self, frame):
+        while self.queue.qsize() >= self.MAX_QUEUED:
+            self.queue.get_nowait()
+        self.queue.put_nowait(frame)
+
+
 class IsoldeSocketServer(Task):
+    '''
+    Websocket server for remote control of ISOLDE. Each text message is a
+    JSON command dict (as for the REST server) answered with a JSON result.
+    Each binary message is a frame as defined in :mod:`binary_frames`,
+    carrying coordinates or restraint parameters as packed arrays; this is
+    much faster for clients moving whole coordinate sets many times over.
+    Binary clients may also subscribe to a stream of coordinate frames.
+    '''
     def __init__(self, *args, **kw):
         super().__init__(*args, **kw)
+        self._server = None
         self._server_methods = {}
         from .. import default_server_methods, thread_safe
         self.standard_functions = default_server_methods
         for fname, func in self.standard_functions.items():
             self.register_server_method(fname, thread_safe(func))
         self._server_methods['batch'] = self.batch_run
+        from . import binary_frames as bf, binary_methods as bm
+        self._binary_methods = {
+            bf.GET_COORDS:      bm.get_coords,
+            bf.SET_COORDS:      bm.set_coords,
+            bf.EDIT_RESTRAINTS: bm.edit_restraints,
+        }
+
+    SESSION_SAVE = False
 
     def run(self, port, address='localhost'):
-        self.port = port
+        if port is None:
+            # Any available port
+            port = 0
         self.address = address
         loop = self._async_loop = asyncio.new_event_loop()
-        stop = self._stop_trigger = loop.create_future()
-        start_server = self._server = websockets.serve(self._serve, 'localhost', port, loop=loop)
-        loop.run_until_complete(start_server)
+        asyncio.set_event_loop(loop)
+        self._server = loop.run_until_complete(
+            websockets.serve(self._serve, address, port))
+        self.port = self._server.sockets[0].getsockname()[1]
+        self.session.ui.thread_safe(self.session.logger.info,
+            'ISOLDE websocket server started on host {} port {}'.format(address, self.port))
         loop.run_forever()
+        loop.run_until_complete(self._server.wait_closed())
+        loop.close()
 
     def terminate(self):
         self.stop()
         super().terminate()
 
     def stop(self):
-        self._server.ws_server.close()
+        if self._server is None:
+            return
+        loop = self._async_loop
+        def shutdown():
+            self._server.close()
+            loop.stop()
+        loop.call_soon_threadsafe(shutdown)
         self.session.ui.thread_safe(self.session.logger.info, 'Shutting down server on {} port {}'.format(self.address, self.port))
 
-    async def _serve(self, websocket, cmd):
-        cmd = await websocket.recv()
+    async def _serve(self, websocket, path):
+        stream = _CoordStream(self._async_loop)
+        consumer_task = asyncio.ensure_future(
+            self._incoming_handler(websocket, stream))
+        producer_task = asyncio.ensure_future(
+            self._stream_handler(websocket, stream))
+        done, pending = await asyncio.wait(
+            [consumer_task, producer_task],
+            return_when=asyncio.FIRST_COMPLETED
+        )
+        for task in pending:
+            task.cancel()
+        self.session.ui.thread_safe(stream.close, self.session)
+
+    async def _incoming_handler(self, websocket, stream):
         import json
-        cmd_dict = json.loads(cmd)
-        if cmd_dict is None:
-            await websocket.send(json.dumps(self.list_server_methods()))
-        else:
-            result = self._run_cmd(cmd_dict)
-            await websocket.send(json.dumps(result))
+        loop = self._async_loop
+        async for message in websocket:
+            # Commands block until the GUI thread has run them, so they must
+            # not hold up the event loop (and with it, the coordinate stream)
+            if isinstance(message, bytes):
+                reply = await loop.run_in_executor(None, self._run_binary, message, stream)
+            else:
+                cmd_dict = json.loads(message)
+                if cmd_dict is None:
+                    result = self.list_server_methods()
+                else:
+                    result = await loop.run_in_executor(None, self._run_cmd, cmd_dict)
+                reply = json.dumps(result)
+            await websocket.send(reply)
+
+    async def _stream_handler(self, websocket, stream):
+        while True:
+            frame = await stream.queue.get()
+            await websocket.send(frame)
+
+    def _run_binary(self, message, stream):
+        from . import binary_frames as bf
+        request_id = 0
+        try:
+            msg_type, request_id, meta, arrays = bf.decode(message)
+            session = self.session
+            if msg_type == bf.SUBSCRIBE_COORDS:
+                from .binary_methods import _structure, _selected_atoms
+                def subscribe(session):
+                    m = _structure(session, meta)
+                    # Check the indices now rather than on the first frame
+                    _selected_atoms(m, arrays)
+                    stream.subscribe(session, m, request_id, meta, arrays.get('indices', None))
+                    return {'model': m.id_string}
+                return bf.encode(bf.REPLY, request_id, _call_in_gui_thread(session, subscribe))
+            if msg_type == bf.UNSUBSCRIBE_COORDS:
+                from .binary_methods import _structure
+                def unsubscribe(session):
+                    stream.unsubscribe(session, _structure(session, meta))
+                    return {}
+                return bf.encode(bf.REPLY, request_id, _call_in_gui_thread(session, unsubscribe))
+            func = self._binary_methods.get(msg_type, None)
+            if func is None:
+                raise TypeError('Unrecognised binary message type: {}'.format(msg_type))
+            reply_meta, reply_arrays = _call_in_gui_thread(session, func, meta, arrays)
+            return bf.encode(bf.REPLY, request_id, reply_meta, reply_arrays)
+        except Exception as e:
+            return bf.error_frame(request_id, e)
 
     def _run_cmd(self, cmd_dict):
         try:
@@ -16,6 +16,10 @@ _torsion_adjustments_chi1 = {
 _torsion_adjustments_chi2 = {
     'TRP': radians(180),
 }
+_torsion_adjustments = {
+    'chi1': _torsion_adjustments_chi1,
+    'chi2': _torsion_adjustments_chi2,
+}
 
 from chimerax.core.errors import UserError
 
@@ -88,26 +92,27 @@ def restrain_torsions_to_template(session, template_residues, restrained_residue
 
     def apply_restraints(trs, rrs):
         for name in names:
-            for tr, rr in zip(trs, rrs):
-                if 'chi' in name and identical_sidechains_only and tr.name != rr.name:
-                    continue
-                td = tdm.get_dihedral(tr, name)
-                rdr = rdrm.add_restraint_by_residue_and_name(rr, name)
-                if td and rdr:
-                    # Due to naming conventions, some sidechain torsions need to be
-                    # rotated for best match to other residues
-                    if name == 'chi1':
-                        target = (td.angle + _torsion_adjustments_chi1.get(tr.name, 0)
-                            - _torsion_adjustments_chi1.get(rr.name, 0))
-                    elif name == 'chi2':
-                        target = (td.angle + _torsion_adjustments_chi2.get(tr.name, 0)
-                            - _torsion_adjustments_chi2.get(rr.name, 0))
-                    else:
-                        target = td.angle
-                    rdr.target = target
-                    rdr.spring_constant = spring_constant
-                    rdr.kappa = kappa
-                    rdr.enabled = True
+            mask = numpy.logical_and(
+                tdm.residues_have_dihedral(trs, name),
+                tdm.residues_have_dihedral(rrs, name)
+            )
+            if 'chi' in name and identical_sidechains_only:
+                mask = numpy.logical_and(mask, trs.names == rrs.names)
+            if not mask.any():
+                continue
+            mtrs, mrrs = trs[mask], rrs[mask]
+            tds = tdm.get_dihedrals(mtrs, name)
+            rds = tdm.get_dihedrals(mrrs, name)
+            # Due to naming conventions, some sidechain torsions need to be
+            # rotated for best match to other residues
+            adjustments = _torsion_adjustments.get(name)
+            if adjustments is not None:
+                offsets = numpy.array([adjustments.get(tn, 0) - adjustments.get(rn, 0)
+                    for tn, rn in zip(mtrs.names, mrrs.names)])
+            else:
+                offsets = None
+            rdrm.restrain_to_template(rds, tds, offsets=offsets,
+                spring_constant=spring_constant, kappa=kappa)
         if restrain_backbone:
             # For omega dihedrals we really want to stick with the standard
             # proper dihedral restraints, but we *don't* want to blindly
@@ -222,12 +227,11 @@ def restrain_small_ligands(model, distance_cutoff=4, heavy_atom_limit=3, spring_
     from .. import session_extensions as sx
     drm = sx.get_distance_restraint_mgr(model)
     prm = sx.get_position_restraint_mgr(model)
-    all_heavy_atoms = model.atoms[model.atoms.element_names!='H']
-    if not bond_to_carbon:
-        all_heavy_atoms = all_heavy_atoms[all_heavy_atoms.element_names != 'C']
-    all_heavy_coords = all_heavy_atoms.coords
+    # Candidate partners are found by radius search on the model's shared
+    # atom index, then filtered by element
+    idx = sx.get_atom_index(model)
 
-    from chimerax.core.geometry import find_close_points, distance
+    from chimerax.core.geometry import distance
     for r in small_ligands:
         r_heavy_atoms = r.atoms[r.atoms.element_names != 'H']
         if not bond_to_carbon:
@@ -240,19 +244,20 @@ def restrain_small_ligands(model, distance_cutoff=4, heavy_atom_limit=3, spring_
                 prs.enableds = True
                 continue
             r_heavy_atoms = r_non_carbon_atoms
-        r_indices = all_heavy_atoms.indices(r_heavy_atoms)
         r_coords = r_heavy_atoms.coords
+        near, offsets = idx.within_each(r_coords, distance_cutoff)
         applied_drs = False
-        for ra, ri, rc in zip(r_heavy_atoms, r_indices, r_coords):
-            _, found_i = find_close_points([rc], all_heavy_coords, distance_cutoff)
-            found_i = found_i[found_i!=ri]
+        for i, (ra, rc) in enumerate(zip(r_heavy_atoms, r_coords)):
+            found = near[offsets[i]:offsets[i+1]]
+            found = found[found.element_names != 'H']
+            if not bond_to_carbon:
+                found = found[found.element_names != 'C']
+            found = found.subtract(r_heavy_atoms)
             num_drs = 0
-            for fi in found_i:
-                if fi in r_indices:
-                    continue
-                dr = drm.add_restraint(ra, all_heavy_atoms[fi])
+            for fa in found:
+                dr = drm.add_restraint(ra, fa)
                 dr.spring_constant = spring_constant
-                dr.target=distance(rc, all_heavy_coords[fi])
+                dr.target=distance(rc, fa.coord)
                 dr.enabled = True
                 num_drs += 1
                 # applied_drs = True
@@ -461,7 +466,6 @@ def restrain_atom_distances_to_template(session, template_residues, restrained_r
     if display_threshold is None:
         display_threshold = 0
     adrm.display_threshold = display_threshold
-    from chimerax.core.geometry import find_close_points, distance
     from chimerax.atomic import concatenate
 
     atom_names = []
@@ -489,31 +493,9 @@ def restrain_atom_distances_to_template(session, template_residues, restrained_r
         template_as = Atoms(template_as)
         restrained_as = Atoms(restrained_as)
 
-        template_coords = template_as.coords
-        for i, ra1 in enumerate(restrained_as):
-            query_coord = numpy.array([template_coords[i]])
-            indices = find_close_points(query_coord, template_coords, distance_cutoff)[1]
-            indices = indices[indices !=i]
-            for ind in indices:
-                ra2 = restrained_as[ind]
-                if ra1.residue == ra2.residue:
-                    continue
-                try:
-                    dr = adrm.add_restraint(ra1, ra2)
-                except ValueError:
-                    continue
-                dist = distance(query_coord[0], template_coords[ind])
-                dr.tolerance = tolerance * dist
-                dr.target = dist
-                dr.c = max(dist*well_half_width, 0.1)
-                #dr.effective_spring_constant = spring_constant
-                dr.kappa = kappa
-                from math import log
-                if dist < 1:
-                    dr.alpha = -2
-                else:
-                    dr.alpha = -2 - fall_off * log(dist)
-                dr.enabled = True
+        adrm.restrain_to_template(restrained_as, template_as.coords,
+            distance_cutoff=distance_cutoff, tolerance=tolerance, kappa=kappa,
+            well_half_width=well_half_width, fall_off=fall_off)
 
 
     if all(trs == rrs for trs, rrs in zip(template_residues, restrained_residues)):
@@ -13,6 +13,7 @@
 #define PYINSTANCE_EXPORT
 
 #include "adaptive_distance_restraints.h"
+#include "../geometry/spatial_grid.h"
 #include <pyinstance/PythonInstance.instantiate.h>
 template class pyinstance::PythonInstance<isolde::AdaptiveDistanceRestraint>;
 template class pyinstance::PythonInstance<isolde::AdaptiveDistanceRestraintMgr>;
@@ -55,6 +56,7 @@ Change_Tracker* AdaptiveDistanceRestraint::change_tracker() const
 
 void AdaptiveDistanceRestraint::set_target(const double &target)
 {
+    _has_sim_force = false;
     _target = target < MIN_DISTANCE_RESTRAINT_TARGET ? MIN_DISTANCE_RESTRAINT_TARGET : target;
     if (_tolerance > _target)
         set_tolerance(_target);
@@ -64,6 +66,7 @@ void AdaptiveDistanceRestraint::set_target(const double &target)
 
 void AdaptiveDistanceRestraint::set_tolerance(const double &tolerance)
 {
+    _has_sim_force = false;
     _tolerance = tolerance < 0 ? 0 : tolerance;
     _tolerance = _tolerance > _target ? _target : _tolerance;
     _mgr->track_change(this, change_tracker()->REASON_CUTOFF_CHANGED);
@@ -72,18 +75,21 @@ void AdaptiveDistanceRestraint::set_tolerance(const double &tolerance)
 
 void AdaptiveDistanceRestraint::set_kappa(const double &kappa)
 {
+    _has_sim_force = false;
     _kappa = kappa<0 ? 0.0 : kappa;
     _mgr->track_change(this, change_tracker()->REASON_SPRING_CONSTANT_CHANGED);
 }
 
 void AdaptiveDistanceRestraint::set_alpha(const double &alpha)
 {
+    _has_sim_force = false;
     _alpha = alpha;
     _mgr->track_change(this, change_tracker()->REASON_ADAPTIVE_C_CHANGED);
 }
 
 void AdaptiveDistanceRestraint::set_c(const double &c)
 {
+    _has_sim_force = false;
     _c = c<MIN_C ? MIN_C : c;
     _mgr->track_change(this, change_tracker()->REASON_ADAPTIVE_C_CHANGED);
     _update_thresholds();
@@ -93,6 +99,7 @@ void AdaptiveDistanceRestraint::set_enabled(bool flag)
 {
     if (_enabled != flag) {
         _enabled = flag;
+        _has_sim_force = false;
         _mgr->track_change(this, change_tracker()->REASON_ENABLED_CHANGED);
     }
 }
@@ -127,6 +134,8 @@ double AdaptiveDistanceRestraint::radius() const
 
 double AdaptiveDistanceRestraint::force_magnitude() const
 {
+    if (_has_sim_force)
+        return _sim_force;
     double r = distance();
     double r_m_r0 = r-_target;
     if (!_enabled || std::abs(r_m_r0) < _tolerance || _kappa == 0)
@@ -153,11 +162,7 @@ AdaptiveDistanceRestraint::colormap() const
 
 void AdaptiveDistanceRestraint::color(uint8_t *color) const
 {
-    colors::color thecolor;
-    colormap()->interpolate(distance(), _thresholds, thecolor);
-    for (size_t j=0; j<4; ++j) {
-        *(color++) = (uint8_t)(thecolor[j]*255.0);
-    }
+    colormap()->interpolate(distance(), _thresholds, color);
 }
 
 void
@@ -179,6 +184,79 @@ AdaptiveDistanceRestraint::bond_transforms(float *rot44_e1, float *rot44_m, floa
     geometry::bond_cylinder_transform_gl<Coord, float>(t2, c1, r*0.99, 1.0, rot44_e2);
 }
 
+void
+AdaptiveDistanceRestraint::batch_transforms(AdaptiveDistanceRestraint * const *restraints,
+    size_t n, float *ends, float *mids, uint8_t *end_colors, uint8_t *mid_colors)
+{
+    std::vector<float> c0s(n*3), c1s(n*3), t1s(n*3), t2s(n*3);
+    std::vector<float> radii(n), end_radii(n), ones(n, 1.0);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto r = restraints[i];
+        const Coord &c0 = r->atoms()[0]->coord();
+        const Coord &c1 = r->atoms()[1]->coord();
+        float d = c0.distance(c1);
+        auto end_frac = (d-r->get_target()-r->get_tolerance())/(2*d);
+        for (size_t j=0; j<3; ++j)
+        {
+            auto end_offset = (c1[j]-c0[j])*end_frac;
+            c0s[3*i+j] = c0[j];
+            c1s[3*i+j] = c1[j];
+            t1s[3*i+j] = c0[j] + end_offset;
+            t2s[3*i+j] = c1[j] - end_offset;
+        }
+        radii[i] = r->radius();
+        end_radii[i] = radii[i]*0.99;
+        if (mid_colors != nullptr || end_colors != nullptr)
+        {
+            uint8_t color[4];
+            r->color(color);
+            if (mid_colors != nullptr)
+                std::copy(color, color+4, mid_colors+4*i);
+            if (end_colors != nullptr) {
+                std::copy(color, color+4, end_colors+8*i);
+                std::copy(color, color+4, end_colors+8*i+4);
+            }
+        }
+    }
+    geometry::bond_cylinder_transforms_gl<float>(n, t1s.data(), c0s.data(),
+        end_radii.data(), ones.data(), ends, 32);
+    geometry::bond_cylinder_transforms_gl<float>(n, t1s.data(), t2s.data(),
+        radii.data(), ones.data(), mids);
+    geometry::bond_cylinder_transforms_gl<float>(n, t2s.data(), c1s.data(),
+        end_radii.data(), ones.data(), ends+16, 32);
+}
+
+std::vector<AdaptiveDistanceRestraint*>
+AdaptiveDistanceRestraintMgr::restrain_to_template(Atom * const *atoms,
+    const double *template_coords, size_t n, double cutoff, double tolerance,
+    double kappa, double well_half_width, double fall_off)
+{
+    std::vector<AdaptiveDistanceRestraint*> restraints;
+    geometry::Spatial_Grid<double> grid(template_coords, n, cutoff);
+    grid.for_each_close_pair(cutoff, [&](size_t i, size_t j, double dist)
+    {
+        Atom *a1 = atoms[i], *a2 = atoms[j];
+        if (a1->residue() == a2->residue())
+            return;
+        AdaptiveDistanceRestraint *r;
+        try {
+            r = get_restraint(a1, a2, true);
+        } catch (std::logic_error&) {
+            return;
+        }
+        // Target first, since the tolerance is capped at the target
+        r->set_target(dist);
+        r->set_tolerance(tolerance*dist);
+        r->set_c(std::max(dist*well_half_width, 0.1));
+        r->set_kappa(kappa);
+        r->set_alpha(dist < 1 ? -2 : -2 - fall_off*log(dist));
+        r->set_enabled(true);
+        restraints.push_back(r);
+    });
+    return restraints;
+}
+
 template class DistanceRestraintMgr_Tmpl<AdaptiveDistanceRestraint>;
 
 } //namespace isolde;
@@ -80,6 +80,13 @@ public:
     double radius() const;
     //! Transforms for a tripartite bond representation
     void bond_transforms(float *rot44_e1, float *rot44_m, float *rot44_e2) const;
+    /*! Batched equivalent of bond_transforms() and color() for n restraints.
+     *  ends receives the two end transforms for each restraint, mids the
+     *  middle one. end_colors (two per restraint) and mid_colors may be
+     *  nullptr.
+     */
+    static void batch_transforms(AdaptiveDistanceRestraint * const *restraints,
+        size_t n, float *ends, float *mids, uint8_t *end_colors, uint8_t *mid_colors);
     double display_threshold() const;
     bool visible() const;
 
@@ -88,6 +95,12 @@ public:
     double distance() const {return _atoms[0]->coord().distance(_atoms[1]->coord());}
     // Current magnitude of the applied force (for scaling/colouring bonds)
     double force_magnitude() const;
+    /*! Force (kJ/mol/Angstrom) reported by a running simulation, returned
+     *  by force_magnitude() instead of evaluating it from the current
+     *  coordinates. Forgotten when any parameter of this restraint changes.
+     */
+    void set_sim_force(double f) { _sim_force = f; _has_sim_force = true; }
+    void clear_sim_force() { _has_sim_force = false; }
     Structure* structure() const {return _atoms[0]->structure();}
     Change_Tracker *change_tracker() const;
     DistanceRestraintMgr_Tmpl<AdaptiveDistanceRestraint> *mgr() const { return _mgr; }
@@ -107,6 +120,8 @@ private:
     double _c = MIN_C;
     double _alpha = -2;
     bool _enabled=false;
+    double _sim_force = 0;
+    bool _has_sim_force = false;
     const char* err_msg_bonded()
     { return "Can't create a distance restraint between bonded atoms!";}
     void _update_thresholds()
@@ -144,9 +159,24 @@ public:
     }
     colors::variable_colormap* colormap() { return &_colormap; }
 
+    /*! Build a web of restraints reproducing the local geometry of a
+     *  template. atoms[i] is restrained to every other atom j (not in the
+     *  same residue) whose template position lies within cutoff of
+     *  template_coords[i], with target equal to the template distance d,
+     *  tolerance tolerance*d, c max(well_half_width*d, 0.1) and alpha
+     *  -2 - fall_off*ln(d) (or -2 for d < 1). Pairs that can't be restrained
+     *  (e.g. bonded atoms) are skipped, and existing restraints are updated
+     *  in place. Returns every restraint created or updated.
+     */
+    std::vector<AdaptiveDistanceRestraint*> restrain_to_template(
+        Atom * const *atoms, const double *template_coords, size_t n,
+        double cutoff, double tolerance, double kappa, double well_half_width,
+        double fall_off);
+
     double display_threshold() const { return _display_threshold; }
     void set_display_threshold(const double &t) {
         _display_threshold = t > 0 ? t : 0;
+        invalidate_visible();
     }
 
 private:
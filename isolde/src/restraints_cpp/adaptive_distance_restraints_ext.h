@@ -146,6 +146,27 @@ adaptive_distance_restraint_mgr_intra_restraints(void *mgr, void *atoms, size_t
     }
 }
 
+extern "C" EXPORT PyObject*
+adaptive_distance_restraint_mgr_restrain_to_template(void *mgr, void *atoms,
+    double *template_coords, size_t n, double cutoff, double tolerance,
+    double kappa, double well_half_width, double fall_off)
+{
+    AdaptiveDistanceRestraintMgr *d = static_cast<AdaptiveDistanceRestraintMgr *>(mgr);
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        auto drs = d->restrain_to_template(a, template_coords, n, cutoff,
+            tolerance, kappa, well_half_width, fall_off);
+        void **dptr;
+        PyObject *da = python_voidp_array(drs.size(), &dptr);
+        for (auto dr: drs)
+            *dptr++ = dr;
+        return da;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
 extern "C" EXPORT double
 adaptive_distance_restraint_mgr_display_threshold(void *mgr) {
     AdaptiveDistanceRestraintMgr *d = static_cast<AdaptiveDistanceRestraintMgr *>(mgr);
@@ -172,11 +193,7 @@ adaptive_distance_restraint_mgr_visible_restraints(void *mgr)
 {
     AdaptiveDistanceRestraintMgr *d = static_cast<AdaptiveDistanceRestraintMgr *>(mgr);
     try {
-        std::vector<AdaptiveDistanceRestraint *> visibles;
-        for (auto r: d->all_restraints()) {
-            if (r->visible())
-                visibles.push_back(r);
-        }
+        const auto &visibles = d->visible_restraints();
         void **rptr;
         PyObject *ra = python_voidp_array(visibles.size(), &rptr);
         for (auto r: visibles)
@@ -188,6 +205,17 @@ adaptive_distance_restraint_mgr_visible_restraints(void *mgr)
     }
 }
 
+extern "C" EXPORT void
+adaptive_distance_restraint_mgr_invalidate_visible(void *mgr)
+{
+    AdaptiveDistanceRestraintMgr *d = static_cast<AdaptiveDistanceRestraintMgr *>(mgr);
+    try {
+        d->invalidate_visible();
+    } catch (...) {
+        molc_error();
+    }
+}
+
 extern "C" EXPORT PyObject*
 adaptive_distance_restraint_mgr_all_restraints(void *mgr)
 {
@@ -387,6 +415,25 @@ adaptive_distance_restraint_force_magnitude(void *restraint, size_t n, double *f
     error_wrap_array_get<AdaptiveDistanceRestraint, double, double>(d, n, &AdaptiveDistanceRestraint::force_magnitude, force);
 }
 
+extern "C" EXPORT void
+adaptive_distance_restraint_set_sim_force(void *restraint, size_t n, double *force)
+{
+    AdaptiveDistanceRestraint **d = static_cast<AdaptiveDistanceRestraint **>(restraint);
+    error_wrap_array_set<AdaptiveDistanceRestraint, double, double>(d, n, &AdaptiveDistanceRestraint::set_sim_force, force);
+}
+
+extern "C" EXPORT void
+adaptive_distance_restraint_clear_sim_force(void *restraint, size_t n)
+{
+    AdaptiveDistanceRestraint **r = static_cast<AdaptiveDistanceRestraint **>(restraint);
+    try {
+        for (size_t i=0; i<n; ++i)
+            (*r++)->clear_sim_force();
+    } catch (...) {
+        molc_error();
+    }
+}
+
 extern "C" EXPORT void
 adaptive_distance_restraint_distance(void *restraint, size_t n, double *distance)
 {
@@ -420,10 +467,20 @@ adaptive_distance_restraint_bond_transforms(void *restraint, size_t n, float *ro
 {
     AdaptiveDistanceRestraint **d = static_cast<AdaptiveDistanceRestraint **>(restraint);
     try {
-        for (size_t i=0; i<n; ++i) {
-            (*d++)->bond_transforms(rot44_ends, rot44_m, rot44_ends+16);
-            rot44_ends += 32; rot44_m += 16;
-        }
+        AdaptiveDistanceRestraint::batch_transforms(d, n, rot44_ends, rot44_m, nullptr, nullptr);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+adaptive_distance_restraint_bond_transforms_and_colors(void *restraint, size_t n,
+    float *rot44_ends, float *rot44_m, uint8_t *end_colors, uint8_t *mid_colors)
+{
+    AdaptiveDistanceRestraint **d = static_cast<AdaptiveDistanceRestraint **>(restraint);
+    try {
+        AdaptiveDistanceRestraint::batch_transforms(d, n, rot44_ends, rot44_m,
+            end_colors, mid_colors);
     } catch (...) {
         molc_error();
     }
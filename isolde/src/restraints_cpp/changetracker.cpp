@@ -30,4 +30,54 @@ Change_Tracker::Change_Tracker() {
     _reason_strings[REASON_CUTOFF_CHANGED] = std::string("cutoff changed");
 }
 
+void Change_Tracker::destructors_done(const std::set<void*>& destroyed)
+{
+    bool found = false;
+    for (auto it = _mgr_index.begin(); it != _mgr_index.end(); )
+    {
+        if (destroyed.find(const_cast<void*>(it->first)) != destroyed.end())
+        {
+            it = _mgr_index.erase(it);
+            found = true;
+        } else
+            ++it;
+    }
+    if (!found)
+        return;
+    Change_List kept;
+    kept.reserve(_mgr_index.size());
+    for (auto& m: _mgr_changes)
+    {
+        auto it = _mgr_index.find(m.mgr);
+        if (it == _mgr_index.end())
+            continue;
+        it->second = kept.size();
+        kept.push_back(std::move(m));
+    }
+    _mgr_changes.swap(kept);
+    _last_mgr = nullptr;
+    _coalesced_valid = false;
+}
+
+Memory_Usage Change_Tracker::memory_usage() const
+{
+    Memory_Usage u;
+    u.container_bytes = memory::hash_bytes(_python_class_name) + memory::hash_bytes(_reason_strings)
+        + memory::hash_bytes(_mgr_index) + memory::vector_bytes(_mgr_changes)
+        + memory::vector_bytes(_coalesced);
+    for (const auto& it: _python_class_name)
+        u.container_bytes += memory::string_bytes(it.second.first) + memory::string_bytes(it.second.second);
+    for (const auto& it: _reason_strings)
+        u.container_bytes += memory::string_bytes(it.second);
+    for (const auto& m: _mgr_changes)
+        for (const auto& c: m.changed)
+        {
+            u.objects += c.size();
+            u.buffer_bytes += memory::vector_bytes(c);
+        }
+    for (const auto& c: _coalesced)
+        u.buffer_bytes += memory::vector_bytes(c.changed) + memory::vector_bytes(c.reasons);
+    return u;
+}
+
 } //namespace isolde
@@ -19,10 +19,15 @@
 #include <typeinfo>
 #include <unordered_map>
 #include <set>
-#include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
 
+#include <atomstruct/destruct.h>
 #include <pyinstance/PythonInstance.declare.h>
 
+#include "../memory_report.h"
+
 namespace isolde
 {
 class PositionRestraintMgr;
@@ -33,23 +38,9 @@ class DihedralRestraintMgr;
 class Dihedral_Restraint;
 
 
-class Change_Tracker: public pyinstance::PythonInstance<Change_Tracker>
+class Change_Tracker: public atomstruct::DestructionObserver, public pyinstance::PythonInstance<Change_Tracker>
 {
 public:
-    /* Hierarchy:
-     * <Manager Type>
-     *      |
-     *      ---<Manager ptr>
-     *            |
-     *            --- <Reason>
-     *                   |
-     *                   ----<Changed pointers>
-     *
-     */
-    typedef std::unordered_map<int, std::set<const void*>> Reason_to_Ptrs;
-    typedef std::unordered_map<const void*, Reason_to_Ptrs> Mgr_to_Managed;
-    typedef std::unordered_map<std::type_index, Mgr_to_Managed> Ptr_Type_to_Set;
-
     enum Reasons{
         REASON_RESTRAINT_CREATED,
         REASON_TARGET_CHANGED,
@@ -58,19 +49,47 @@ public:
         REASON_ADAPTIVE_C_CHANGED,
         REASON_DISPLAY_CHANGED,
         REASON_ENABLED_CHANGED,
+        NUM_REASONS
     };
 
-    Change_Tracker();
-    ~Change_Tracker() {}
+    /* Changes are stored flat, one entry per manager, with an append-only
+     * vector of changed pointers for each reason. Recording a change is
+     * just a push_back (plus a hash lookup when the manager differs from
+     * the last one seen). Duplicates are removed lazily by get_changes().
+     */
+    struct Mgr_Changes
+    {
+        Mgr_Changes(const std::type_index& t, const void *m): mgr_type(t), mgr(m) {}
+        std::type_index mgr_type;
+        const void *mgr;
+        std::vector<const void*> changed[NUM_REASONS];
+        bool empty() const
+        {
+            for (const auto& c: changed)
+                if (!c.empty()) return false;
+            return true;
+        }
+    };
+    typedef std::vector<Mgr_Changes> Change_List;
 
-    template<class Mgr>
-    std::set<const void*>& get_change_set(std::type_index mgr_type, Mgr* mgr, int reason)
+    /* Everything that changed in one manager since the last clear(), packed
+     * into a single record: each changed pointer once, in ascending order,
+     * alongside a bitmask with bit (1<<reason) set for every reason it
+     * changed. Lets the Python side handle a whole frame's changes to a
+     * manager with a few vectorised calls rather than one per reason.
+     */
+    struct Coalesced_Changes
     {
-        if (_python_class_name.find(mgr_type) == _python_class_name.end())
-            throw std::out_of_range("Restraint manager type has not been registered!");
+        Coalesced_Changes(const std::type_index& t, const void *m): mgr_type(t), mgr(m) {}
+        std::type_index mgr_type;
+        const void *mgr;
+        std::vector<const void*> changed;
+        std::vector<uint32_t> reasons;
+    };
+    typedef std::vector<Coalesced_Changes> Coalesced_List;
 
-        return _change_map[mgr_type][static_cast<const void *>(mgr)][reason];
-    }
+    Change_Tracker();
+    ~Change_Tracker() {}
 
     void register_mgr(const std::type_index &mgr_type,
         const std::string &mgr_pyname, const std::string &c_pyname)
@@ -96,52 +115,206 @@ public:
     template <class Mgr, class C>
     void add_created(const std::type_index &mgr_type, Mgr* mgr, C* ptr)
     {
-        auto& cset = get_change_set(mgr_type, mgr, REASON_RESTRAINT_CREATED);
-        cset.insert(ptr);
+        _changed(mgr_type, mgr, REASON_RESTRAINT_CREATED).push_back(ptr);
     }
 
     template <class Mgr, class C>
-    void add_created_batch(const std::type_index &mgr_type, Mgr* mgr, std::vector<C*> ptrs)
+    void add_created_batch(const std::type_index &mgr_type, Mgr* mgr, const std::vector<C*>& ptrs)
     {
-        auto& cset = get_change_set(mgr_type, mgr, REASON_RESTRAINT_CREATED);
-        for (const auto &p: ptrs)
-            cset.insert(p);
+        auto& changed = _changed(mgr_type, mgr, REASON_RESTRAINT_CREATED);
+        changed.insert(changed.end(), ptrs.begin(), ptrs.end());
     }
 
     template <class Mgr, class C>
     void add_modified(const std::type_index &mgr_type, Mgr *mgr, C* ptr, int reason)
     {
-        auto& cset = get_change_set(mgr_type, mgr, reason);
-        cset.insert(ptr);
+        _changed(mgr_type, mgr, reason).push_back(ptr);
     }
 
     template <class Mgr, class C>
-    void add_modified_batch(const std::type_index &mgr_type, Mgr *mgr, std::vector<C*> ptrs, int reason)
+    void add_modified_batch(const std::type_index &mgr_type, Mgr *mgr, const std::vector<C*>& ptrs, int reason)
     {
-        auto& cset = get_change_set(mgr_type, mgr, reason);
-        for (const auto &p: ptrs)
-            cset.insert(p);
+        auto& changed = _changed(mgr_type, mgr, reason);
+        changed.insert(changed.end(), ptrs.begin(), ptrs.end());
     }
 
+    //! Keeps the per-manager storage (and its capacity) for reuse
     void clear()
     {
-        _change_map.clear();
+        for (auto& m: _mgr_changes)
+            for (auto& c: m.changed)
+                c.clear();
+        _compacted = true;
+        _coalesced.clear();
+        _coalesced_valid = true;
+        _generation++;
     }
 
+    //! Incremented each time the tracker is cleared
+    uint64_t generation() const { return _generation; }
 
-    const Ptr_Type_to_Set& get_changes() const {
-        return _change_map;
-    }
+    //! Objects are the changes currently recorded (before de-duplication)
+    Memory_Usage memory_usage() const;
 
+    //! Forgets deleted managers, along with any changes still recorded for them
+    virtual void destructors_done(const std::set<void*>& destroyed);
 
+    /*! All changes since the last clear(), with each changed pointer listed
+     *  once per reason in ascending order. Managers and reasons with no
+     *  changes are present but empty.
+     */
+    const Change_List& get_changes()
+    {
+        if (!_compacted)
+        {
+            for (auto& m: _mgr_changes)
+                for (auto& c: m.changed)
+                {
+                    std::sort(c.begin(), c.end());
+                    c.erase(std::unique(c.begin(), c.end()), c.end());
+                }
+            _compacted = true;
+        }
+        return _mgr_changes;
+    }
 
+    //! One record for each manager with changes since the last clear()
+    const Coalesced_List& get_coalesced_changes()
+    {
+        if (_coalesced_valid)
+            return _coalesced;
+        _coalesced.clear();
+        std::vector<std::pair<const void*, uint32_t>> flagged;
+        for (const auto& m: get_changes())
+        {
+            if (m.empty())
+                continue;
+            flagged.clear();
+            for (int reason=0; reason<NUM_REASONS; ++reason)
+                for (auto ptr: m.changed[reason])
+                    flagged.emplace_back(ptr, 1u<<reason);
+            std::sort(flagged.begin(), flagged.end());
+            _coalesced.emplace_back(m.mgr_type, m.mgr);
+            auto& c = _coalesced.back();
+            for (const auto& f: flagged)
+            {
+                if (!c.changed.empty() && c.changed.back() == f.first)
+                    c.reasons.back() |= f.second;
+                else {
+                    c.changed.push_back(f.first);
+                    c.reasons.push_back(f.second);
+                }
+            }
+        }
+        _coalesced_valid = true;
+        return _coalesced;
+    }
 
 private:
     std::unordered_map<std::type_index, std::pair<std::string, std::string>> _python_class_name;
     std::unordered_map<int, std::string> _reason_strings;
-    Ptr_Type_to_Set _change_map;
+    Change_List _mgr_changes;
+    std::unordered_map<const void*, size_t> _mgr_index;
+    const void *_last_mgr = nullptr;
+    size_t _last_index = 0;
+    bool _compacted = true;
+    Coalesced_List _coalesced;
+    bool _coalesced_valid = true;
+    uint64_t _generation = 0;
+
+    std::vector<const void*>& _changed(const std::type_index &mgr_type, const void *mgr, int reason)
+    {
+        if (reason < 0 || reason >= NUM_REASONS)
+            throw std::out_of_range("Unrecognised change reason!");
+        _compacted = false;
+        _coalesced_valid = false;
+        if (_mgr_changes.empty() || mgr != _last_mgr
+                || _mgr_changes[_last_index].mgr_type != mgr_type)
+            _set_current_mgr(mgr_type, mgr);
+        return _mgr_changes[_last_index].changed[reason];
+    }
+
+    void _set_current_mgr(const std::type_index &mgr_type, const void *mgr)
+    {
+        if (_python_class_name.find(mgr_type) == _python_class_name.end())
+            throw std::out_of_range("Restraint manager type has not been registered!");
+        auto it = _mgr_index.find(mgr);
+        if (it == _mgr_index.end())
+        {
+            it = _mgr_index.emplace(mgr, _mgr_changes.size()).first;
+            _mgr_changes.emplace_back(mgr_type, mgr);
+        } else {
+            // A manager may have been deleted and another created at the same address
+            auto& m = _mgr_changes[it->second];
+            if (m.mgr_type != mgr_type)
+            {
+                for (auto& c: m.changed)
+                    c.clear();
+                m.mgr_type = mgr_type;
+            }
+        }
+        _last_mgr = mgr;
+        _last_index = it->second;
+    }
 
 }; //class Change_Tracker
+
+/*! Holds back the changes made to one manager's restraints while a batch is
+ *  open, then hands them to the Change_Tracker with one add_created_batch()
+ *  or add_modified_batch() call per reason when the last (outermost) batch
+ *  closes. Used by operations that touch many restraints in one go.
+ */
+class Change_Batch
+{
+public:
+    bool open() const { return _depth > 0; }
+    void begin() { _depth++; }
+    void add(const void *r, int reason) { _pending.at(reason).push_back(r); }
+    size_t bytes() const
+    {
+        size_t b = memory::vector_bytes(_pending);
+        for (const auto& p: _pending)
+            b += memory::vector_bytes(p);
+        return b;
+    }
+
+    template <class Mgr>
+    void end(Change_Tracker *ct, const std::type_index &mgr_type, Mgr *mgr)
+    {
+        if (_depth == 0 || --_depth > 0)
+            return;
+        for (int reason=0; reason<Change_Tracker::NUM_REASONS; ++reason)
+        {
+            auto& p = _pending[reason];
+            if (p.empty())
+                continue;
+            if (reason == Change_Tracker::REASON_RESTRAINT_CREATED)
+                ct->add_created_batch(mgr_type, mgr, p);
+            else
+                ct->add_modified_batch(mgr_type, mgr, p, reason);
+            p.clear();
+        }
+    }
+
+private:
+    size_t _depth = 0;
+    std::vector<std::vector<const void*>> _pending =
+        std::vector<std::vector<const void*>>(Change_Tracker::NUM_REASONS);
+}; // class Change_Batch
+
+//! Opens a batch on the manager for the lifetime of the scope
+template <class Mgr>
+class Change_Batch_Scope
+{
+public:
+    Change_Batch_Scope(Mgr *mgr): _mgr(mgr) { _mgr->begin_change_batch(); }
+    ~Change_Batch_Scope() { _mgr->end_change_batch(); }
+    Change_Batch_Scope(const Change_Batch_Scope&) = delete;
+    Change_Batch_Scope& operator=(const Change_Batch_Scope&) = delete;
+private:
+    Mgr *_mgr;
+};
+
 } //namespace isolde
 
 #endif //ISOLDE_CHANGETRACKER
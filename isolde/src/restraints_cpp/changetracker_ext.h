@@ -62,36 +62,42 @@ change_tracker_clear(void *tracker)
 }
 
 static PyObject* changes_as_py_dict(Change_Tracker *t,
-    const Change_Tracker::Ptr_Type_to_Set &changes)
+    const Change_Tracker::Change_List &changes)
 {
     PyObject* changes_data = PyDict_New();
-    for (const auto &it1: changes)
+    for (const auto &m: changes)
     {
-        const auto& py_classnames = t->get_python_class_names(it1.first);
+        if (m.empty())
+            continue;
+        const auto& py_classnames = t->get_python_class_names(m.mgr_type);
         PyObject *mgr_type_key = unicode_from_string(py_classnames.first);
-        PyObject* mgr_type_dict = PyDict_New();
-        for (const auto &it2: it1.second)
+        PyObject *mgr_type_dict = PyDict_GetItem(changes_data, mgr_type_key); // borrowed
+        if (mgr_type_dict == nullptr)
         {
-            PyObject *mgr_key = PyLong_FromVoidPtr(const_cast<void*>(it2.first));
-            PyObject *change_dict = PyDict_New();
-            for (const auto &it3: it2.second)
-            {
-                PyObject *change_key = unicode_from_string(t->reason_string(it3.first));
-                void **ptrs;
-                PyObject *ptr_array = python_voidp_array(it3.second.size(), &ptrs);
-                for (auto ptr: it3.second)
-                    (*ptrs++) = const_cast<void*>(ptr);
-                PyDict_SetItem(change_dict, change_key, ptr_array);
-                Py_DECREF(change_key);
-                Py_DECREF(ptr_array);
-            }
-            PyDict_SetItem(mgr_type_dict, mgr_key, change_dict);
-            Py_DECREF(mgr_key);
-            Py_DECREF(change_dict);
+            mgr_type_dict = PyDict_New();
+            PyDict_SetItem(changes_data, mgr_type_key, mgr_type_dict);
+            Py_DECREF(mgr_type_dict);
         }
-        PyDict_SetItem(changes_data, mgr_type_key, mgr_type_dict);
         Py_DECREF(mgr_type_key);
-        Py_DECREF(mgr_type_dict);
+        PyObject *mgr_key = PyLong_FromVoidPtr(const_cast<void*>(m.mgr));
+        PyObject *change_dict = PyDict_New();
+        for (int reason=0; reason<Change_Tracker::NUM_REASONS; ++reason)
+        {
+            const auto& changed = m.changed[reason];
+            if (changed.empty())
+                continue;
+            PyObject *change_key = unicode_from_string(t->reason_string(reason));
+            void **ptrs;
+            PyObject *ptr_array = python_voidp_array(changed.size(), &ptrs);
+            for (auto ptr: changed)
+                (*ptrs++) = const_cast<void*>(ptr);
+            PyDict_SetItem(change_dict, change_key, ptr_array);
+            Py_DECREF(change_key);
+            Py_DECREF(ptr_array);
+        }
+        PyDict_SetItem(mgr_type_dict, mgr_key, change_dict);
+        Py_DECREF(mgr_key);
+        Py_DECREF(change_dict);
     }
     return changes_data;
 }
@@ -108,6 +114,75 @@ change_tracker_changes(void *tracker)
     }
 }
 
+/*! Summary of the coalesced changes since the last clear(), as a list of
+ *  (manager type name, manager pointer, number of changed objects) tuples.
+ *  Fetch the contents of record i with change_tracker_coalesced_fill().
+ */
+extern "C" EXPORT PyObject*
+change_tracker_coalesced_changes(void *tracker)
+{
+    Change_Tracker *t = static_cast<Change_Tracker *>(tracker);
+    try {
+        const auto& records = t->get_coalesced_changes();
+        PyObject* ret = PyList_New(records.size());
+        size_t i=0;
+        for (const auto& c: records)
+        {
+            PyObject *rec = PyTuple_New(3);
+            PyTuple_SET_ITEM(rec, 0, unicode_from_string(t->get_python_class_names(c.mgr_type).first));
+            PyTuple_SET_ITEM(rec, 1, PyLong_FromVoidPtr(const_cast<void*>(c.mgr)));
+            PyTuple_SET_ITEM(rec, 2, PyLong_FromSize_t(c.changed.size()));
+            PyList_SET_ITEM(ret, i++, rec);
+        }
+        return ret;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+/*! Copy the changed objects and reason masks of coalesced record i into
+ *  arrays of length n. The records are rebuilt whenever the changes are
+ *  fetched again, so n must still match the count from the summary:
+ *  anything else raises a ValueError rather than overrunning the arrays.
+ */
+extern "C" EXPORT void
+change_tracker_coalesced_fill(void *tracker, size_t i, size_t n, pyobject_t *changed, uint32_t *reasons)
+{
+    Change_Tracker *t = static_cast<Change_Tracker *>(tracker);
+    try {
+        const auto& c = t->get_coalesced_changes().at(i);
+        if (c.changed.size() != n)
+            throw std::logic_error("Coalesced changes were recomputed since the summary was taken!");
+        for (auto ptr: c.changed)
+            *changed++ = const_cast<void*>(ptr);
+        std::copy(c.reasons.begin(), c.reasons.end(), reasons);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! Dict mapping each reason name to its bit in the coalesced reason masks
+extern "C" EXPORT PyObject*
+change_tracker_reason_bits(void *tracker)
+{
+    Change_Tracker *t = static_cast<Change_Tracker *>(tracker);
+    try {
+        PyObject* ret = PyDict_New();
+        for (const auto &r: t->all_reason_strings()) {
+            PyObject *key = unicode_from_string(r.second);
+            PyObject *val = PyLong_FromUnsignedLong(1ul<<r.first);
+            PyDict_SetItem(ret, key, val);
+            Py_DECREF(key);
+            Py_DECREF(val);
+        }
+        return ret;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
 extern "C" EXPORT PyObject*
 change_tracker_reason_names(void *tracker)
 {
@@ -12,6 +12,7 @@
 
 #define PYINSTANCE_EXPORT
 #include "dihedral_restraints.h"
+#include "../atomic_cpp/dihedral_mgr.h"
 #include <pyinstance/PythonInstance.instantiate.h>
 
 template class pyinstance::PythonInstance<isolde::ChiralRestraintMgr>;
@@ -32,8 +33,9 @@ void DihedralRestraintMgr_Base<DType, RType>::_delete_restraints(const std::set<
     for (auto r: to_delete) {
         auto d = r->get_dihedral();
         _dihedral_to_restraint.erase(d);
-        delete r;
+        _restraints.destroy(r);
     }
+    _columns_dirty = true;
 }
 
 template <class DType, class RType>
@@ -48,20 +50,31 @@ void DihedralRestraintMgr_Base<DType, RType>::destructors_done(const std::set<vo
 {
     auto db = DestructionBatcher(this);
     std::set<RType *> to_delete;
-    for (auto &it: _dihedral_to_restraint) {
-        auto d = it.first;
-        if (destroyed.find(d) != destroyed.end())
-            to_delete.insert(it.second);
-    }
+    for_each_destroyed(destroyed, _dihedral_to_restraint, [&to_delete](decltype(_dihedral_to_restraint.begin()) it) {
+        to_delete.insert(it->second);
+    });
     _delete_restraints(to_delete);
 }
 
+template <class DType, class RType>
+Memory_Usage DihedralRestraintMgr_Base<DType, RType>::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _restraints.size();
+    u.buffer_bytes = _restraints.allocated_bytes() + memory::vector_bytes(_annotation_cache)
+        + memory::vector_bytes(_columns.restraints) + memory::vector_bytes(_columns.targets)
+        + memory::vector_bytes(_columns.spring_constants) + memory::vector_bytes(_columns.enabled)
+        + memory::vector_bytes(_columns.display);
+    u.container_bytes = _restraints.bookkeeping_bytes() + memory::hash_bytes(_dihedral_to_restraint)
+        + change_batch_bytes();
+    return u;
+}
+
 template <class DType, class RType>
 DihedralRestraintMgr_Base<DType, RType>::~DihedralRestraintMgr_Base()
 {
     auto du = DestructionUser(this);
-    for (auto &it: _dihedral_to_restraint)
-        delete it.second;
+    _restraints.clear();
     _dihedral_to_restraint.clear();
 }
 
@@ -80,7 +93,7 @@ RType* DihedralRestraintMgr_Base<DType, RType>::new_restraint(DType *d)
 template <class DType, class RType>
 RType* DihedralRestraintMgr_Base<DType, RType>::_new_restraint(DType *d)
 {
-    RType *r = new RType(d, static_cast<Dihedral_Restraint_Change_Mgr *>(this));
+    RType *r = _restraints.create(d, static_cast<Dihedral_Restraint_Change_Mgr *>(this));
     _dihedral_to_restraint[d] = r;
     track_created(static_cast<const void *>(r));
     return r;
@@ -102,15 +115,151 @@ template <class DType, class RType>
 std::vector<RType *> DihedralRestraintMgr_Base<DType, RType>::visible_restraints() const
 {
     std::vector<RType *> visibles;
-    for (auto &it: _dihedral_to_restraint)
-    {
-        auto r = it.second;
+    _restraints.for_each([&visibles](RType *r) {
         if (r->visible())
             visibles.push_back(r);
-    }
+    });
     return visibles;
 }
 
+template <class DType, class RType>
+const typename DihedralRestraintMgr_Base<DType, RType>::Columns&
+DihedralRestraintMgr_Base<DType, RType>::columns()
+{
+    if (!_columns_dirty)
+        return _columns;
+    auto &c = _columns;
+    c.restraints = _restraints.all();
+    size_t n = c.restraints.size();
+    c.targets.resize(n);
+    c.spring_constants.resize(n);
+    c.enabled.resize(n);
+    c.display.resize(n);
+    for (size_t i=0; i<n; ++i)
+    {
+        const RType *r = c.restraints[i];
+        c.targets[i] = r->get_target();
+        c.spring_constants[i] = r->get_spring_constant();
+        c.enabled[i] = r->is_enabled();
+        c.display[i] = r->get_display();
+    }
+    _columns_dirty = false;
+    return _columns;
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::_check_column_size(size_t n)
+{
+    if (n != columns().restraints.size())
+        throw std::logic_error("Array length does not match the number of restraints!");
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::set_column_targets(const double *targets, size_t n)
+{
+    _check_column_size(n);
+    for (auto r: _columns.restraints)
+        r->set_target(*targets++);
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::set_column_spring_constants(const double *k, size_t n)
+{
+    _check_column_size(n);
+    for (auto r: _columns.restraints)
+        r->set_spring_constant(*k++);
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::set_column_enabled(const uint8_t *flags, size_t n)
+{
+    _check_column_size(n);
+    for (auto r: _columns.restraints)
+        r->set_enabled(*flags++);
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::set_column_display(const uint8_t *flags, size_t n)
+{
+    _check_column_size(n);
+    for (auto r: _columns.restraints)
+        r->set_display(*flags++);
+}
+
+template <class DType, class RType>
+void DihedralRestraintMgr_Base<DType, RType>::annotations(RType * const *restraints,
+    size_t n, float *ring_tfs, float *post_tfs, uint8_t *colors)
+{
+    auto &cache = _annotation_cache;
+    if (cache.size() < _restraints.capacity())
+        cache.resize(_restraints.capacity());
+    size_t gen = color_generation();
+    std::vector<Annotation_Entry*> entries(n);
+    std::vector<Annotation_Entry*> stale;
+    for (size_t i=0; i<n; ++i)
+    {
+        const RType *r = restraints[i];
+        auto &e = cache[_restraints.slot_of(r)];
+        entries[i] = &e;
+        auto b = r->get_dihedral()->axial_bond();
+        const Coord &c0 = b->atoms()[0]->coord();
+        const Coord &c1 = b->atoms()[1]->coord();
+        // offset() re-uses the dihedral's cached angle if its atoms haven't moved
+        double offset = r->offset();
+        double k = r->get_spring_constant();
+        const double *cutoffs = r->annotation_cutoffs();
+        if (e.valid && util::coords_equal(c0, e.c0) && util::coords_equal(c1, e.c1)
+            && offset == e.offset && k == e.spring_constant && gen == e.color_generation
+            && std::equal(cutoffs, cutoffs+3, e.cutoffs))
+            continue;
+        e.c0 = c0;
+        e.c1 = c1;
+        e.offset = offset;
+        e.spring_constant = k;
+        e.width = r->annotation_width();
+        std::copy(cutoffs, cutoffs+3, e.cutoffs);
+        e.color_generation = gen;
+        e.valid = true;
+        colormap()->interpolate(std::abs(offset), e.cutoffs, e.color);
+        stale.push_back(&e);
+    }
+    size_t m = stale.size();
+    if (m > 0)
+    {
+        std::vector<float> c0s(m*3), c1s(m*3), offsets(m), widths(m), ones(m, 1.0);
+        std::vector<float> rings(m*16), posts(m*16);
+        for (size_t i=0; i<m; ++i)
+        {
+            const auto &e = *stale[i];
+            for (size_t j=0; j<3; ++j)
+            {
+                c0s[3*i+j] = e.c0[j];
+                c1s[3*i+j] = e.c1[j];
+            }
+            offsets[i] = e.offset;
+            widths[i] = e.width;
+        }
+        geometry::bond_cylinder_transforms_gl<float>(m, c0s.data(), c1s.data(),
+            ones.data(), widths.data(), posts.data());
+        geometry::dihedral_ring_transforms_gl<float>(m, offsets.data(), posts.data(), rings.data());
+        for (size_t i=0; i<m; ++i)
+        {
+            std::copy(rings.begin()+16*i, rings.begin()+16*(i+1), stale[i]->ring);
+            std::copy(posts.begin()+16*i, posts.begin()+16*(i+1), stale[i]->post);
+        }
+    }
+    for (size_t i=0; i<n; ++i)
+    {
+        const auto &e = *entries[i];
+        if (ring_tfs != nullptr)
+            std::copy(e.ring, e.ring+16, ring_tfs+16*i);
+        if (post_tfs != nullptr)
+            std::copy(e.post, e.post+16, post_tfs+16*i);
+        if (colors != nullptr)
+            std::copy(e.color, e.color+4, colors+4*i);
+    }
+}
+
 /***************************************************
  *
  * Specialisations
@@ -165,8 +314,7 @@ void ProperDihedralRestraintBase::get_annotation_transform(float *tf)
     float *tf1 = tf;
     float *tf2 = tf+16;
     bool flip = offset() < 0;
-    float width = get_spring_constant()/MAX_RADIAL_SPRING_CONSTANT *
-        (DIHEDRAL_RESTRAINT_MAX_WIDTH-DIHEDRAL_RESTRAINT_MIN_WIDTH) + DIHEDRAL_RESTRAINT_MIN_WIDTH;
+    float width = annotation_width();
 
     geometry::rotation_gl<float>(Z_AXIS, offset(), tf1);
     if(flip)
@@ -196,17 +344,73 @@ void ProperDihedralRestraintBase::get_annotation_transform(float *tf)
 
 void ProperDihedralRestraintBase::get_annotation_color(uint8_t *color)
 {
-    colors::color thecolor;
-    colormap()->interpolate(std::abs(offset()), _cutoffs, thecolor);
-    for (size_t j=0; j<4; ++j) {
-        *(color++) = (uint8_t)(thecolor[j]*255.0);
-    }
+    colormap()->interpolate(std::abs(offset()), _cutoffs, color);
 } //get_annotation_color
 
 ProperDihedralRestraintMgr* ProperDihedralRestraint::mgr() const { return static_cast<ProperDihedralRestraintMgr*>(base_mgr()); }
 
 AdaptiveDihedralRestraintMgr* AdaptiveDihedralRestraint::mgr() const { return static_cast<AdaptiveDihedralRestraintMgr*>(base_mgr()); }
 
+void ProperDihedralRestraintMgr::restrain_secondary_structure(
+    Dihedral_Mgr<ProperDihedral> *dihedral_mgr, Residue * const *residues,
+    size_t n, double phi, double psi, double cutoff, double spring_constant,
+    std::vector<ProperDihedralRestraint *> &phi_restraints,
+    std::vector<ProperDihedralRestraint *> &psi_restraints)
+{
+    static const std::string phi_name("phi");
+    static const std::string psi_name("psi");
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(this);
+    auto restrain = [&](Residue *res, const std::string& name, double target,
+        std::vector<ProperDihedralRestraint *> &out)
+    {
+        ProperDihedral *d;
+        try {
+            d = dihedral_mgr->get_dihedral(res, name, true);
+        } catch (std::out_of_range&) {
+            return;
+        }
+        if (d == nullptr)
+            return;
+        auto r = get_restraint(d, true);
+        if (r == nullptr)
+            return;
+        r->set_target(target);
+        r->set_spring_constant(spring_constant);
+        r->set_cutoff(cutoff);
+        r->set_enabled(true);
+        out.push_back(r);
+    };
+    for (size_t i=0; i<n; ++i)
+    {
+        restrain(residues[i], phi_name, phi, phi_restraints);
+        restrain(residues[i], psi_name, psi, psi_restraints);
+    }
+}
+
+std::vector<AdaptiveDihedralRestraint*>
+AdaptiveDihedralRestraintMgr::restrain_to_template(ProperDihedral * const *dihedrals,
+    ProperDihedral * const *templates, const double *offsets, size_t n,
+    double spring_constant, double kappa)
+{
+    std::vector<AdaptiveDihedralRestraint*> restraints;
+    restraints.reserve(n);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto r = get_restraint(dihedrals[i], true);
+        if (r == nullptr)
+            continue;
+        double target = templates[i]->angle();
+        if (offsets != nullptr)
+            target += offsets[i];
+        r->set_target(target);
+        r->set_spring_constant(spring_constant);
+        r->set_kappa(kappa);
+        r->set_enabled(true);
+        restraints.push_back(r);
+    }
+    return restraints;
+}
+
 
 
 template class Dihedral_Restraint_Base<ChiralCenter>;
@@ -22,6 +22,8 @@
 #include "../colors.h"
 #include "changetracker.h"
 #include "sim_restraint_base.h"
+#include "../destruction_index.h"
+#include "../slab_pool.h"
 #include <atomstruct/destruct.h>
 #include <atomstruct/AtomicStructure.h>
 #include <atomstruct/Atom.h>
@@ -39,6 +41,7 @@ class DihedralRestraintMgr_Base;
 class ProperDihedralRestraintMgr;
 class ChiralRestraintMgr;
 class AdaptiveDihedralRestraintMgr;
+template<class DType> class Dihedral_Mgr;
 
 class Dihedral_Restraint_Change_Mgr
 {
@@ -56,18 +59,43 @@ public:
             thecolors[2][i] = ((double) *(maxc++)) / 255.0;
         }
         _colormap = colors::variable_colormap(thecolors, 3);
+        _color_generation++;
     }
     colors::variable_colormap* colormap() { return &_colormap; }
+    //! Incremented on every change of colour scale
+    size_t color_generation() const { return _color_generation; }
     Change_Tracker* change_tracker() const { return _change_tracker; }
-    void track_created(const void *r) { change_tracker()->add_created(_mgr_type, _mgr_pointer, r); }
-    void track_change(const void *r, int reason) {change_tracker()->add_modified(_mgr_type, _mgr_pointer, r, reason);}
+    void track_created(const void *r)
+    {
+        _columns_dirty = true;
+        if (_batch.open())
+            _batch.add(r, Change_Tracker::REASON_RESTRAINT_CREATED);
+        else
+            change_tracker()->add_created(_mgr_type, _mgr_pointer, r);
+    }
+    void track_change(const void *r, int reason)
+    {
+        _columns_dirty = true;
+        if (_batch.open())
+            _batch.add(r, reason);
+        else
+            change_tracker()->add_modified(_mgr_type, _mgr_pointer, r, reason);
+    }
+    //! See Change_Batch
+    void begin_change_batch() { _batch.begin(); }
+    void end_change_batch() { _batch.end(change_tracker(), _mgr_type, _mgr_pointer); }
 
 protected:
+    size_t change_batch_bytes() const { return _batch.bytes(); }
     std::type_index _mgr_type = std::type_index(typeid(this));
     void *_mgr_pointer = static_cast<void *>(this);
+    // Any change to the restraints invalidates the manager's column copies
+    bool _columns_dirty = true;
 private:
     colors::variable_colormap _colormap;
+    size_t _color_generation = 0;
     Change_Tracker *_change_tracker;
+    Change_Batch _batch;
 
 }; //class Dihedral_Restraint_Colormap
 
@@ -114,6 +142,14 @@ public:
     double offset() const {return util::wrapped_angle(_dihedral->angle()-get_target());}
     //! Returns (current angle) - (target angle) in degrees
     double offset_deg() const {return util::degrees(offset()); }
+    //! Width of the annotation, scaled by the spring constant
+    float annotation_width() const
+    {
+        return get_spring_constant()/MAX_RADIAL_SPRING_CONSTANT *
+            (DIHEDRAL_RESTRAINT_MAX_WIDTH-DIHEDRAL_RESTRAINT_MIN_WIDTH) + DIHEDRAL_RESTRAINT_MIN_WIDTH;
+    }
+    //! Offsets at which the annotation colour scale changes
+    const double* annotation_cutoffs() const { return _cutoffs; }
     //! Get the transform mapping an annotation primitive to the dihedral location
     virtual void get_annotation_transform(float *tf)
     {
@@ -143,7 +179,7 @@ private:
 
 }; // Dihedral_Restraint_Base
 
-class ChiralRestraint:
+class ChiralRestraint final:
     public Dihedral_Restraint_Base<ChiralCenter>,
     public pyinstance::PythonInstance<ChiralRestraint>
 {
@@ -231,7 +267,7 @@ protected:
 private:
 }; // ProperDihedralRestraintBase
 
-class ProperDihedralRestraint: public ProperDihedralRestraintBase,
+class ProperDihedralRestraint final: public ProperDihedralRestraintBase,
     public pyinstance::PythonInstance<ProperDihedralRestraint>
 {
 public:
@@ -255,7 +291,7 @@ private:
 
 
 
-class AdaptiveDihedralRestraint: public ProperDihedralRestraintBase,
+class AdaptiveDihedralRestraint final: public ProperDihedralRestraintBase,
     public pyinstance::PythonInstance<AdaptiveDihedralRestraint>
 {
 public:
@@ -308,12 +344,67 @@ public:
     void delete_restraints(const std::set<RType *>& to_delete);
     virtual void destructors_done(const std::set<void *>& deleted);
 
+    /*! Struct-of-arrays copies of the most commonly-used restraint
+     *  properties, one entry per restraint in pool slot order. Rebuilt in a
+     *  single pass over the pool (with no virtual calls, since RType is
+     *  final) only when a restraint has been created, changed or deleted
+     *  since the last call, so the Python layer can fetch each property for
+     *  the whole manager with one memcpy rather than passing in an array of
+     *  pointers.
+     */
+    struct Columns
+    {
+        std::vector<RType*> restraints;
+        std::vector<double> targets;
+        std::vector<double> spring_constants;
+        std::vector<uint8_t> enabled;
+        std::vector<uint8_t> display;
+    };
+    const Columns& columns();
+    //! Set properties of all restraints, in the order of columns().restraints
+    void set_column_targets(const double *targets, size_t n);
+    void set_column_spring_constants(const double *k, size_t n);
+    void set_column_enabled(const uint8_t *flags, size_t n);
+    void set_column_display(const uint8_t *flags, size_t n);
+
+    /*! Batched equivalent of get_annotation_transform() and
+     *  get_annotation_color() for n restraints (normally the visible ones),
+     *  writing ring and post transforms and colours to separate arrays (any
+     *  of which may be null). Results are cached by pool slot along with
+     *  everything they depend on - the axial bond coordinates, offset from
+     *  target, spring constant, cutoffs and colour scale - so only those
+     *  restraints that have moved or changed since the last call are
+     *  recomputed, in a single vectorisable pass.
+     */
+    void annotations(RType * const *restraints, size_t n, float *ring_tfs,
+        float *post_tfs, uint8_t *colors);
+
+    //! The column copies and annotation cache count as buffers
+    Memory_Usage memory_usage() const;
+
 protected:
     RType* new_restraint(DType *d);
 
 
 private:
     std::unordered_map<DType*, RType*> _dihedral_to_restraint;
+    Slab_Pool<RType> _restraints;
+    Columns _columns;
+    void _check_column_size(size_t n);
+    struct Annotation_Entry
+    {
+        Coord c0, c1;
+        double offset;
+        double spring_constant;
+        float width;
+        double cutoffs[3];
+        size_t color_generation;
+        bool valid = false;
+        float ring[16];
+        float post[16];
+        uint8_t color[4];
+    };
+    std::vector<Annotation_Entry> _annotation_cache;
     Structure* _atomic_model;
     // Change_Tracker* _change_tracker;
     // colors::variable_colormap _colormap;
@@ -360,6 +451,16 @@ public:
         change_tracker()->register_mgr(_mgr_type, _py_name, _managed_class_py_name);
     }
 
+    /*! Create (if necessary), set and enable phi and psi restraints for the
+     *  given residues, reporting all the changes to the tracker at once.
+     *  Residues lacking either dihedral are skipped.
+     */
+    void restrain_secondary_structure(Dihedral_Mgr<ProperDihedral> *dihedral_mgr,
+        Residue * const *residues, size_t n, double phi, double psi,
+        double cutoff, double spring_constant,
+        std::vector<ProperDihedralRestraint *> &phi_restraints,
+        std::vector<ProperDihedralRestraint *> &psi_restraints);
+
 private:
     const std::string _py_name = "ProperDihedralRestraintMgr";
     const std::string _managed_class_py_name = "ProperDihedralRestraint";
@@ -378,6 +479,16 @@ public:
         change_tracker()->register_mgr(_mgr_type, _py_name, _managed_class_py_name);
     }
 
+    /*! Restrain each of n dihedrals to the current angle of its counterpart
+     *  in templates (which may be in a different model), plus the matching
+     *  entry in offsets (for sidechains where naming conventions differ by a
+     *  fixed rotation; may be nullptr). Restraints are created as
+     *  necessary and enabled, with the given spring constant and kappa.
+     */
+    std::vector<AdaptiveDihedralRestraint*> restrain_to_template(
+        ProperDihedral * const *dihedrals, ProperDihedral * const *templates,
+        const double *offsets, size_t n, double spring_constant, double kappa);
+
 private:
     const std::string _py_name = "AdaptiveDihedralRestraintMgr";
     const std::string _managed_class_py_name = "AdaptiveDihedralRestraint";
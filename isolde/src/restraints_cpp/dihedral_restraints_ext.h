@@ -14,11 +14,89 @@
 #define ISOLDE_DIHEDRAL_RESTRAINTS_EXT
 
 #include "dihedral_restraints.h"
+#include "../atomic_cpp/dihedral_mgr.h"
 #include "../molc.h"
 
 using namespace atomstruct;
 using namespace isolde;
 
+/*! Whole-manager column accessors (see DihedralRestraintMgr_Base::columns()).
+ *  FNAME_columns() returns the restraints in column order, and copies each
+ *  property into the matching array (which may be null to skip it). Each
+ *  array must be num_restraints() long.
+ */
+#define DIHEDRAL_RESTRAINT_MGR_COLUMNS(FNAME, CLASSNAME) \
+extern "C" EXPORT PyObject* \
+FNAME##_columns(void *mgr, size_t n, double *targets, double *spring_constants, \
+    npy_bool *enabled, npy_bool *display) \
+{ \
+    CLASSNAME *m = static_cast<CLASSNAME *>(mgr); \
+    try { \
+        const auto &c = m->columns(); \
+        if (n != c.restraints.size()) \
+            throw std::logic_error("Array length does not match the number of restraints!"); \
+        if (targets != nullptr) \
+            std::copy(c.targets.begin(), c.targets.end(), targets); \
+        if (spring_constants != nullptr) \
+            std::copy(c.spring_constants.begin(), c.spring_constants.end(), spring_constants); \
+        if (enabled != nullptr) \
+            std::copy(c.enabled.begin(), c.enabled.end(), enabled); \
+        if (display != nullptr) \
+            std::copy(c.display.begin(), c.display.end(), display); \
+        void **rptr; \
+        PyObject *ra = python_voidp_array(n, &rptr); \
+        std::copy(c.restraints.begin(), c.restraints.end(), rptr); \
+        return ra; \
+    } catch (...) { \
+        molc_error(); \
+        return 0; \
+    } \
+} \
+\
+extern "C" EXPORT void \
+set_##FNAME##_column_targets(void *mgr, size_t n, double *targets) \
+{ \
+    CLASSNAME *m = static_cast<CLASSNAME *>(mgr); \
+    try { \
+        m->set_column_targets(targets, n); \
+    } catch (...) { \
+        molc_error(); \
+    } \
+} \
+\
+extern "C" EXPORT void \
+set_##FNAME##_column_spring_constants(void *mgr, size_t n, double *k) \
+{ \
+    CLASSNAME *m = static_cast<CLASSNAME *>(mgr); \
+    try { \
+        m->set_column_spring_constants(k, n); \
+    } catch (...) { \
+        molc_error(); \
+    } \
+} \
+\
+extern "C" EXPORT void \
+set_##FNAME##_column_enabled(void *mgr, size_t n, npy_bool *flags) \
+{ \
+    CLASSNAME *m = static_cast<CLASSNAME *>(mgr); \
+    try { \
+        m->set_column_enabled(flags, n); \
+    } catch (...) { \
+        molc_error(); \
+    } \
+} \
+\
+extern "C" EXPORT void \
+set_##FNAME##_column_display(void *mgr, size_t n, npy_bool *flags) \
+{ \
+    CLASSNAME *m = static_cast<CLASSNAME *>(mgr); \
+    try { \
+        m->set_column_display(flags, n); \
+    } catch (...) { \
+        molc_error(); \
+    } \
+}
+
 
 /***************************************************************
  *
@@ -27,6 +105,7 @@ using namespace isolde;
  ***************************************************************/
 SET_PYTHON_INSTANCE(chiral_restraint_mgr, ChiralRestraintMgr)
 GET_PYTHON_INSTANCES(chiral_restraint_mgr, ChiralRestraintMgr)
+DIHEDRAL_RESTRAINT_MGR_COLUMNS(chiral_restraint_mgr, ChiralRestraintMgr)
 
 extern "C" EXPORT void*
 chiral_restraint_mgr_new(void *structure, void *change_tracker)
@@ -111,6 +190,7 @@ chiral_restraint_mgr_delete_restraint(void *mgr, void *restraint, size_t n)
  ***************************************************************/
 SET_PYTHON_INSTANCE(proper_dihedral_restraint_mgr, ProperDihedralRestraintMgr)
 GET_PYTHON_INSTANCES(proper_dihedral_restraint_mgr, ProperDihedralRestraintMgr)
+DIHEDRAL_RESTRAINT_MGR_COLUMNS(proper_dihedral_restraint_mgr, ProperDihedralRestraintMgr)
 
 extern "C" EXPORT void*
 proper_dihedral_restraint_mgr_new(void *structure, void *change_tracker)
@@ -200,6 +280,50 @@ proper_dihedral_restraint_mgr_visible_restraints(void *mgr)
     }
 }
 
+//! Ring and post transforms and colours for drawing the given restraints
+extern "C" EXPORT void
+proper_dihedral_restraint_mgr_annotations(void *mgr, void *restraint, size_t n, float *tf1, float *tf2,
+    uint8_t *colors)
+{
+    ProperDihedralRestraintMgr *m = static_cast<ProperDihedralRestraintMgr *>(mgr);
+    ProperDihedralRestraint **r = static_cast<ProperDihedralRestraint **>(restraint);
+    try {
+        m->annotations(r, n, tf1, tf2, colors);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT PyObject*
+proper_dihedral_restraint_mgr_restrain_secondary_structure(void *mgr, void *dihedral_mgr,
+    void *residues, size_t n, double phi, double psi, double cutoff, double spring_constant)
+{
+    ProperDihedralRestraintMgr *m = static_cast<ProperDihedralRestraintMgr *>(mgr);
+    ProperDihedralMgr *dm = static_cast<ProperDihedralMgr *>(dihedral_mgr);
+    Residue **r = static_cast<Residue **>(residues);
+    PyObject* ret = PyTuple_New(2);
+    try {
+        std::vector<ProperDihedralRestraint *> phi_restraints;
+        std::vector<ProperDihedralRestraint *> psi_restraints;
+        m->restrain_secondary_structure(dm, r, n, phi, psi, cutoff, spring_constant,
+            phi_restraints, psi_restraints);
+        void **rptr;
+        PyObject* phi_array = python_voidp_array(phi_restraints.size(), &rptr);
+        for (auto pr: phi_restraints)
+            *rptr++ = pr;
+        PyObject* psi_array = python_voidp_array(psi_restraints.size(), &rptr);
+        for (auto pr: psi_restraints)
+            *rptr++ = pr;
+        PyTuple_SET_ITEM(ret, 0, phi_array);
+        PyTuple_SET_ITEM(ret, 1, psi_array);
+        return ret;
+    } catch (...) {
+        molc_error();
+        Py_XDECREF(ret);
+        return 0;
+    }
+}
+
 extern "C" EXPORT void
 proper_dihedral_restraint_mgr_delete_restraint(void *mgr, void *restraint, size_t n)
 {
@@ -223,6 +347,7 @@ proper_dihedral_restraint_mgr_delete_restraint(void *mgr, void *restraint, size_
  ***************************************************************/
 SET_PYTHON_INSTANCE(adaptive_dihedral_restraint_mgr, AdaptiveDihedralRestraintMgr)
 GET_PYTHON_INSTANCES(adaptive_dihedral_restraint_mgr, AdaptiveDihedralRestraintMgr)
+DIHEDRAL_RESTRAINT_MGR_COLUMNS(adaptive_dihedral_restraint_mgr, AdaptiveDihedralRestraintMgr)
 
 extern "C" EXPORT void*
 adaptive_dihedral_restraint_mgr_new(void *structure, void *change_tracker)
@@ -294,6 +419,27 @@ adaptive_dihedral_restraint_mgr_get_restraint(void *mgr, void *dihedral,
     }
 }
 
+extern "C" EXPORT PyObject*
+adaptive_dihedral_restraint_mgr_restrain_to_template(void *mgr, void *dihedral,
+    void *template_dihedral, double *offsets, size_t n, double spring_constant,
+    double kappa)
+{
+    AdaptiveDihedralRestraintMgr *m = static_cast<AdaptiveDihedralRestraintMgr *>(mgr);
+    ProperDihedral **d = static_cast<ProperDihedral **>(dihedral);
+    ProperDihedral **t = static_cast<ProperDihedral **>(template_dihedral);
+    try {
+        auto restraints = m->restrain_to_template(d, t, offsets, n, spring_constant, kappa);
+        void **rptr;
+        PyObject *ra = python_voidp_array(restraints.size(), &rptr);
+        for (auto r: restraints)
+            *rptr++ = r;
+        return ra;
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
 extern "C" EXPORT PyObject*
 adaptive_dihedral_restraint_mgr_visible_restraints(void *mgr)
 {
@@ -312,6 +458,20 @@ adaptive_dihedral_restraint_mgr_visible_restraints(void *mgr)
     }
 }
 
+//! Ring and post transforms and colours for drawing the given restraints
+extern "C" EXPORT void
+adaptive_dihedral_restraint_mgr_annotations(void *mgr, void *restraint, size_t n, float *tf1, float *tf2,
+    uint8_t *colors)
+{
+    AdaptiveDihedralRestraintMgr *m = static_cast<AdaptiveDihedralRestraintMgr *>(mgr);
+    AdaptiveDihedralRestraint **r = static_cast<AdaptiveDihedralRestraint **>(restraint);
+    try {
+        m->annotations(r, n, tf1, tf2, colors);
+    } catch (...) {
+        molc_error();
+    }
+}
+
 extern "C" EXPORT void
 adaptive_dihedral_restraint_mgr_delete_restraint(void *mgr, void *restraint, size_t n)
 {
@@ -13,6 +13,7 @@
 #define PYINSTANCE_EXPORT
 
 #include "distance_restraints.h"
+#include <atomstruct/Residue.h>
 #include <pyinstance/PythonInstance.instantiate.h>
 template class pyinstance::PythonInstance<isolde::DistanceRestraint>;
 template class pyinstance::PythonInstance<isolde::DistanceRestraintMgr>;
@@ -100,6 +101,94 @@ void DistanceRestraint::_bond_transform(float *rot44, float radius, float length
     geometry::bond_cylinder_transform_gl<Coord, float>(c0, c1, radius, length_scale, rot44);
 }
 
+void DistanceRestraint::batch_transforms(DistanceRestraint * const *restraints,
+    size_t n, float *bonds, float *targets)
+{
+    std::vector<float> xyz0(n*3), xyz1(n*3), radii(n), scales(n), ones(n, 1.0);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto r = restraints[i];
+        const Coord &c0 = r->atoms()[0]->coord();
+        const Coord &c1 = r->atoms()[1]->coord();
+        for (size_t j=0; j<3; ++j)
+        {
+            xyz0[3*i+j] = c0[j];
+            xyz1[3*i+j] = c1[j];
+        }
+        radii[i] = r->radius();
+        scales[i] = r->get_target() / c0.distance(c1);
+    }
+    if (bonds != nullptr)
+        geometry::bond_cylinder_transforms_gl<float>(n, xyz0.data(), xyz1.data(),
+            ones.data(), ones.data(), bonds);
+    if (targets != nullptr)
+        geometry::bond_cylinder_transforms_gl<float>(n, xyz0.data(), xyz1.data(),
+            radii.data(), scales.data(), targets);
+}
+
+void DistanceRestraintMgr::ss_restraints(Residue * const *residues, size_t n,
+    bool create, std::vector<DistanceRestraint *> &o_to_n_plus_four,
+    std::vector<DistanceRestraint *> &ca_to_ca_plus_two)
+{
+    if (n < 3)
+        throw std::logic_error("Secondary structure restraints require at least three contiguous residues!");
+    auto r = residues;
+    for (size_t i=0; i<n-2; ++i)
+    {
+        Residue* cr = *r++;
+        if (cr->polymer_type() != PT_AMINO)
+            continue;
+        Atom* cca = cr->find_atom("CA");
+        Atom* co = cr->find_atom("O");
+        if (cca==nullptr || co==nullptr)
+            continue;
+        Residue* rp1 = *r;
+        if (!(cr->connects_to(rp1)) || !(rp1->polymer_type()==PT_AMINO))
+            continue;
+        Residue* rp2 = *(r+1);
+        if (!rp1->connects_to(rp2) || !(rp2->polymer_type()==PT_AMINO))
+            continue;
+        Atom* cap2 = rp2->find_atom("CA");
+        if (cap2 != nullptr) {
+            DistanceRestraint* cad = get_restraint(cca, cap2, create);
+            if (cad != nullptr)
+                ca_to_ca_plus_two.push_back(cad);
+        }
+        if (i+4 >= n) continue;
+        Residue* rp3 = *(r+2);
+        if (!rp2->connects_to(rp3) || !(rp3->polymer_type()==PT_AMINO)) continue;
+        Residue* rp4 = *(r+3);
+        if (!rp3->connects_to(rp4) || !(rp4->polymer_type()==PT_AMINO)) continue;
+        Atom* np4 = rp4->find_atom("N");
+        if (np4 != nullptr) {
+            DistanceRestraint* on4 = get_restraint(co, np4, create);
+            if (on4 != nullptr)
+                o_to_n_plus_four.push_back(on4);
+        }
+    }
+}
+
+void DistanceRestraintMgr::restrain_secondary_structure(Residue * const *residues,
+    size_t n, double o_to_n_plus_four_target, double ca_to_ca_plus_two_target,
+    double k, std::vector<DistanceRestraint *> &o_to_n_plus_four,
+    std::vector<DistanceRestraint *> &ca_to_ca_plus_two)
+{
+    Change_Batch_Scope<DistanceRestraintMgr> batch(this);
+    ss_restraints(residues, n, true, o_to_n_plus_four, ca_to_ca_plus_two);
+    for (auto r: o_to_n_plus_four)
+    {
+        r->set_target(o_to_n_plus_four_target);
+        r->set_k(k);
+        r->set_enabled(true);
+    }
+    for (auto r: ca_to_ca_plus_two)
+    {
+        r->set_target(ca_to_ca_plus_two_target);
+        r->set_k(k);
+        r->set_enabled(true);
+    }
+}
+
 template class DistanceRestraintMgr_Tmpl<DistanceRestraint>;
 
 } //namespace isolde;
@@ -14,11 +14,15 @@
 #define ISOLDE_DISTANCE_RESTRAINTS
 
 #include <string>
+#include <vector>
+#include <algorithm>
 #include "../colors.h"
 #include "../constants.h"
 #include "../geometry/geometry.h"
 #include "changetracker.h"
 #include "sim_restraint_base.h"
+#include "../destruction_index.h"
+#include "../slab_pool.h"
 #include <atomstruct/destruct.h>
 #include <atomstruct/string_types.h>
 #include <atomstruct/Atom.h>
@@ -63,6 +67,11 @@ public:
     double radius() const;
     void target_transform(float *rot44) const;
     void bond_cylinder_transform(float *rot44) const;
+    /*! Batched equivalent of bond_cylinder_transform() and target_transform()
+     *  for n restraints. Either output may be nullptr.
+     */
+    static void batch_transforms(DistanceRestraint * const *restraints, size_t n,
+        float *bonds, float *targets);
     bool visible() const;
 
     // General monitoring
@@ -105,18 +114,45 @@ public:
     R* new_restraint(Atom *a1, Atom *a2);
     R* get_restraint(Atom *a1, Atom *a2, bool create);
 
-    const std::set<R *>& all_restraints() { return _restraints; }
-    size_t num_restraints() const { return _restraints.size(); }
-    const std::set<R *>& get_restraints(Atom *a) const;
+    //! All restraints, in a dense array (order changes when restraints are deleted)
+    const std::vector<R *>& all_restraints() const { return _restraint_list; }
+    size_t num_restraints() const { return _restraint_list.size(); }
+    const std::vector<R *>& get_restraints(Atom *a) const;
+
+    /*! Restraints for which visible() is true. The result is cached until the
+     *  next change to any restraint, or a call to invalidate_visible(). The
+     *  manager can't see atom display or coordinate changes for itself, so
+     *  the Python side must call invalidate_visible() when those happen.
+     */
+    const std::vector<R *>& visible_restraints();
+    void invalidate_visible() { _visible_valid = false; }
 
     void delete_restraints(const std::set<R *> &delete_list);
 
-    // Atom_Map maps individual atoms to a set of the DistanceRestraints they belong to
-    typedef std::unordered_map<Atom*, std::set<R *> > Atom_Map;
+    Memory_Usage memory_usage() const;
+
+    // Atom_Map maps individual atoms to the DistanceRestraints they belong to
+    typedef std::unordered_map<Atom*, std::vector<R *> > Atom_Map;
     Structure* structure() const { return _structure; }
     Change_Tracker* change_tracker() const { return _change_tracker; }
-    void track_created(const void *r) { change_tracker()->add_created(_mgr_type, this, r); }
-    void track_change(const void *r, int reason) {change_tracker()->add_modified(_mgr_type, this, r, reason);}
+    void track_created(const void *r)
+    {
+        if (_batch.open())
+            _batch.add(r, Change_Tracker::REASON_RESTRAINT_CREATED);
+        else
+            change_tracker()->add_created(_mgr_type, this, r);
+    }
+    void track_change(const void *r, int reason)
+    {
+        _visible_valid = false;
+        if (_batch.open())
+            _batch.add(r, reason);
+        else
+            change_tracker()->add_modified(_mgr_type, this, r, reason);
+    }
+    //! See Change_Batch
+    void begin_change_batch() { _batch.begin(); }
+    void end_change_batch() { _batch.end(change_tracker(), _mgr_type, this); }
 
     virtual void destructors_done(const std::set<void*>& destroyed);
 protected:
@@ -124,9 +160,16 @@ protected:
     Change_Tracker* _change_tracker;
     std::type_index _mgr_type = std::type_index(typeid(this));
     R* _new_restraint(Atom *a1, Atom *a2);
-    std::set<R *> _restraints;
-    std::set<R *> _null_set;
+    Slab_Pool<R> _restraints;
+    // Dense list of live restraints. _list_index maps each restraint's pool
+    // slot to its position in the list, for O(1) swap-removal.
+    std::vector<R *> _restraint_list;
+    std::vector<size_t> _list_index;
+    std::vector<R *> _visible_list;
+    bool _visible_valid = false;
+    std::vector<R *> _null_list;
     Atom_Map _atom_to_restraints;
+    Change_Batch _batch;
     // std::set<Atom *> _mapped_atoms;
     std::string _py_name; // = "DistanceRestraintMgr";
     std::string _managed_class_py_name; // = "DistanceRestraints";
@@ -157,6 +200,21 @@ public:
         "DistanceRestraintMgr", "DistanceRestraints"
     )
     {}
+
+    /*! O(n)-N(n+4) and CA(n)-CA(n+2) restraints (optionally creating them)
+     *  along runs of connected amino acid residues. The residues must be
+     *  sorted.
+     */
+    void ss_restraints(Residue * const *residues, size_t n, bool create,
+        std::vector<DistanceRestraint *> &o_to_n_plus_four,
+        std::vector<DistanceRestraint *> &ca_to_ca_plus_two);
+    /*! Create (if necessary), set and enable the ss_restraints() for the
+     *  given residues, reporting all the changes to the tracker at once.
+     */
+    void restrain_secondary_structure(Residue * const *residues, size_t n,
+        double o_to_n_plus_four_target, double ca_to_ca_plus_two_target, double k,
+        std::vector<DistanceRestraint *> &o_to_n_plus_four,
+        std::vector<DistanceRestraint *> &ca_to_ca_plus_two);
 private:
     std::type_index _mgr_type = std::type_index(typeid(this));
 };
@@ -199,10 +257,15 @@ R* DistanceRestraintMgr_Tmpl<R>::_new_restraint(Atom *a1, Atom *a2)
         throw std::logic_error(error_same_atom());
         return nullptr;
     }
-    R *d = new R(a1, a2, this);
-    _restraints.insert(d);
-    _atom_to_restraints[a1].insert(d);
-    _atom_to_restraints[a2].insert(d);
+    R *d = _restraints.create(a1, a2, this);
+    size_t slot = _restraints.slot_of(d);
+    if (slot >= _list_index.size())
+        _list_index.resize(_restraints.capacity());
+    _list_index[slot] = _restraint_list.size();
+    _restraint_list.push_back(d);
+    _atom_to_restraints[a1].push_back(d);
+    _atom_to_restraints[a2].push_back(d);
+    _visible_valid = false;
     track_created(d);
     return d;
 }
@@ -231,21 +294,49 @@ R* DistanceRestraintMgr_Tmpl<R>::get_restraint(Atom *a1, Atom *a2, bool create)
 }
 
 template <class R>
-const std::set<R *>& DistanceRestraintMgr_Tmpl<R>::get_restraints(Atom *a) const
+const std::vector<R *>& DistanceRestraintMgr_Tmpl<R>::get_restraints(Atom *a) const
 {
     auto it = _atom_to_restraints.find(a);
     if (it != _atom_to_restraints.end())
         return it->second;
-    return _null_set;
+    return _null_list;
+}
+
+template <class R>
+const std::vector<R *>& DistanceRestraintMgr_Tmpl<R>::visible_restraints()
+{
+    if (!_visible_valid)
+    {
+        _visible_list.clear();
+        for (auto r: _restraint_list)
+            if (r->visible())
+                _visible_list.push_back(r);
+        _visible_valid = true;
+    }
+    return _visible_list;
+}
+
+template <class R>
+Memory_Usage DistanceRestraintMgr_Tmpl<R>::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _restraints.size();
+    u.buffer_bytes = _restraints.allocated_bytes();
+    u.container_bytes = _restraints.bookkeeping_bytes() + memory::vector_bytes(_restraint_list)
+        + memory::vector_bytes(_list_index) + memory::vector_bytes(_visible_list)
+        + memory::hash_bytes(_atom_to_restraints) + _batch.bytes();
+    for (const auto& it: _atom_to_restraints)
+        u.container_bytes += memory::vector_bytes(it.second);
+    return u;
 }
 
 template <class R>
 DistanceRestraintMgr_Tmpl<R>::~DistanceRestraintMgr_Tmpl()
 {
     auto du = DestructionUser(this);
-    for (auto r: _restraints) {
-        delete r;
-    }
+    _restraint_list.clear();
+    _visible_list.clear();
+    _restraints.clear();
     _atom_to_restraints.clear();
 }
 
@@ -259,18 +350,30 @@ void DistanceRestraintMgr_Tmpl<R>::delete_restraints(const std::set<R *> &delete
 template <class R>
 void DistanceRestraintMgr_Tmpl<R>::_delete_restraints(const std::set<R *> &delete_list )
 {
+    if (delete_list.empty())
+        return;
+    _visible_valid = false;
     for (auto d: delete_list) {
-        _restraints.erase(d);
         for (auto &a: d->atoms()) {
             auto it = _atom_to_restraints.find(a);
             if (it != _atom_to_restraints.end()) {
-                auto &dset = it->second;
-                dset.erase(d);
-                if (!dset.size())
+                auto &dlist = it->second;
+                auto dit = std::find(dlist.begin(), dlist.end(), d);
+                if (dit != dlist.end()) {
+                    *dit = dlist.back();
+                    dlist.pop_back();
+                }
+                if (!dlist.size())
                     _atom_to_restraints.erase(it);
             }
         }
-        delete d;
+        // Swap-remove from the dense list
+        size_t pos = _list_index[_restraints.slot_of(d)];
+        auto last = _restraint_list.back();
+        _restraint_list[pos] = last;
+        _list_index[_restraints.slot_of(last)] = pos;
+        _restraint_list.pop_back();
+        _restraints.destroy(d);
     }
 }
 
@@ -280,18 +383,14 @@ void DistanceRestraintMgr_Tmpl<R>::destructors_done(const std::set<void *>& dest
     auto db = DestructionBatcher(this);
     std::set<R *> to_delete;
     // Need to check for deleted atoms and delete their corresponding DistanceRestraints
-    for (auto it=_atom_to_restraints.begin(); it != _atom_to_restraints.end();) {
-        auto a = it->first;
-        if (destroyed.find(static_cast<void *>(a)) != destroyed.end()) {
-            auto &dset = it->second;
-            for (auto d: dset) {
-                to_delete.insert(d);
-            }
-            it = _atom_to_restraints.erase(it);
-        } else {
-            it++;
-        }
-    }
+    std::vector<Atom *> dead_atoms;
+    for_each_destroyed(destroyed, _atom_to_restraints, [&](decltype(_atom_to_restraints.begin()) it) {
+        dead_atoms.push_back(it->first);
+        for (auto d: it->second)
+            to_delete.insert(d);
+    });
+    for (auto a: dead_atoms)
+        _atom_to_restraints.erase(a);
     _delete_restraints(to_delete);
 } //destructors_done
 
@@ -153,11 +153,7 @@ distance_restraint_mgr_visible_restraints(void *mgr)
 {
     DistanceRestraintMgr *d = static_cast<DistanceRestraintMgr *>(mgr);
     try {
-        std::vector<DistanceRestraint *> visibles;
-        for (auto r: d->all_restraints()) {
-            if (r->visible())
-                visibles.push_back(r);
-        }
+        const auto &visibles = d->visible_restraints();
         void **rptr;
         PyObject *ra = python_voidp_array(visibles.size(), &rptr);
         for (auto r: visibles)
@@ -169,6 +165,17 @@ distance_restraint_mgr_visible_restraints(void *mgr)
     }
 }
 
+extern "C" EXPORT void
+distance_restraint_mgr_invalidate_visible(void *mgr)
+{
+    DistanceRestraintMgr *d = static_cast<DistanceRestraintMgr *>(mgr);
+    try {
+        d->invalidate_visible();
+    } catch (...) {
+        molc_error();
+    }
+}
+
 extern "C" EXPORT PyObject*
 distance_restraint_mgr_all_restraints(void *mgr)
 {
@@ -195,49 +202,43 @@ distance_restraint_mgr_get_ss_restraints(void *mgr, void *residues, size_t n, bo
     Residue **r = static_cast<Residue **>(residues);
     PyObject* ret = PyTuple_New(2);
     try {
-        if (n < 3) {
-            throw std::logic_error("Secondary structure restraints require at least three contiguous residues!");
-        }
         std::vector<DistanceRestraint *> o_to_n_plus_four;
         std::vector<DistanceRestraint *> ca_to_ca_plus_two;
-        for (size_t i=0; i<n-2; ++i)
-        {
-            Residue* cr = *r++;
-            if (cr->polymer_type() != PT_AMINO) {
-                continue;
-            }
-            Atom* cca = cr->find_atom("CA");
-            Atom* co = cr->find_atom("O");
-            if (cca==nullptr || co==nullptr) {
-                continue;
-                //throw std::logic_error("Missing backbone atoms detected!");
-            }
-            Residue* rp1 = *r;
-            if (!(cr->connects_to(rp1)) || !(rp1->polymer_type()==PT_AMINO)) {
-                continue;
-            }
-            Residue* rp2 = *(r+1);
-            if (!rp1->connects_to(rp2) || !(rp2->polymer_type()==PT_AMINO)) {
-                continue;
-            }
-            Atom* cap2 = rp2->find_atom("CA");
-            if (cap2 != nullptr) {
-                DistanceRestraint* cad = d->get_restraint(cca, cap2, create);
-                if (cad != nullptr)
-                    ca_to_ca_plus_two.push_back(cad);
-            }
-            if (i+4 >= n) continue;
-            Residue* rp3 = *(r+2);
-            if (!rp2->connects_to(rp3) || !(rp3->polymer_type()==PT_AMINO)) continue;
-            Residue* rp4 = *(r+3);
-            if (!rp3->connects_to(rp4) || !(rp4->polymer_type()==PT_AMINO)) continue;
-            Atom* np4 = rp4->find_atom("N");
-            if (np4 != nullptr) {
-                DistanceRestraint* on4 = d->get_restraint(co, np4, create);
-                if (on4 != nullptr)
-                    o_to_n_plus_four.push_back(on4);
-            }
-        }
+        d->ss_restraints(r, n, create, o_to_n_plus_four, ca_to_ca_plus_two);
+        void **onptrs;
+        PyObject* on_restr_array = python_voidp_array(o_to_n_plus_four.size(), &onptrs);
+        for (const auto &ptr: o_to_n_plus_four)
+            *onptrs++ = ptr;
+
+        void **captrs;
+        PyObject* ca_restr_array = python_voidp_array(ca_to_ca_plus_two.size(), &captrs);
+        for (const auto &ptr: ca_to_ca_plus_two)
+            *captrs++ = ptr;
+
+        PyTuple_SET_ITEM(ret, 0, on_restr_array);
+        PyTuple_SET_ITEM(ret, 1, ca_restr_array);
+        return ret;
+    } catch(...) {
+        molc_error();
+        Py_XDECREF(ret);
+        return 0;
+    }
+}
+
+//! Residues must be sorted, as for distance_restraint_mgr_get_ss_restraints
+extern "C" EXPORT PyObject*
+distance_restraint_mgr_restrain_secondary_structure(void *mgr, void *residues,
+    size_t n, double o_to_n_plus_four_target, double ca_to_ca_plus_two_target,
+    double k)
+{
+    DistanceRestraintMgr *d = static_cast<DistanceRestraintMgr *>(mgr);
+    Residue **r = static_cast<Residue **>(residues);
+    PyObject* ret = PyTuple_New(2);
+    try {
+        std::vector<DistanceRestraint *> o_to_n_plus_four;
+        std::vector<DistanceRestraint *> ca_to_ca_plus_two;
+        d->restrain_secondary_structure(r, n, o_to_n_plus_four_target,
+            ca_to_ca_plus_two_target, k, o_to_n_plus_four, ca_to_ca_plus_two);
         void **onptrs;
         PyObject* on_restr_array = python_voidp_array(o_to_n_plus_four.size(), &onptrs);
         for (const auto &ptr: o_to_n_plus_four)
@@ -387,10 +388,7 @@ distance_restraint_bond_transform(void *restraint, size_t n, float *rot44)
 {
     DistanceRestraint **d = static_cast<DistanceRestraint **>(restraint);
     try {
-        for (size_t i=0; i<n; ++i) {
-            (*d++)->bond_cylinder_transform(rot44);
-            rot44+=16;
-        }
+        DistanceRestraint::batch_transforms(d, n, rot44, nullptr);
     } catch (...) {
         molc_error();
     }
@@ -401,10 +399,18 @@ distance_restraint_target_transform(void *restraint, size_t n, float *rot44)
 {
     DistanceRestraint **d = static_cast<DistanceRestraint **>(restraint);
     try {
-        for (size_t i=0; i<n; ++i) {
-            (*d++)->target_transform(rot44);
-            rot44+=16;
-        }
+        DistanceRestraint::batch_transforms(d, n, nullptr, rot44);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+distance_restraint_transforms(void *restraint, size_t n, float *bonds, float *targets)
+{
+    DistanceRestraint **d = static_cast<DistanceRestraint **>(restraint);
+    try {
+        DistanceRestraint::batch_transforms(d, n, bonds, targets);
     } catch (...) {
         molc_error();
     }
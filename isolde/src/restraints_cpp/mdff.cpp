@@ -23,7 +23,6 @@ namespace isolde
 
 MDFFAtom::MDFFAtom(Atom* atom, MDFFMgr *mgr) : _atom(atom), _mgr(mgr)
 {
-    _coupling_constant = _atom->element().mass();
 }
 
 Change_Tracker* MDFFAtom::change_tracker() const
@@ -33,17 +32,12 @@ Change_Tracker* MDFFAtom::change_tracker() const
 
 void MDFFAtom::set_coupling_constant(double k)
 {
-    _coupling_constant = k<0 ? 0.0 : k;
-    mgr()->track_change(this, change_tracker()->REASON_SPRING_CONSTANT_CHANGED);
+    mgr()->set_coupling_constant(this, k);
 }
 
 void MDFFAtom::set_enabled(bool flag)
 {
-    if (_enabled != flag)
-    {
-        _enabled = flag;
-        mgr()->track_change(this, change_tracker()->REASON_ENABLED_CHANGED);
-    }
+    mgr()->set_enabled(this, flag);
 }
 
 MDFFAtom* MDFFMgr::_new_mdff_atom(Atom *atom)
@@ -51,12 +45,86 @@ MDFFAtom* MDFFMgr::_new_mdff_atom(Atom *atom)
     if (atom->structure() != _atomic_model) {
         throw std::logic_error(error_different_mol());
     }
-    MDFFAtom* mdffa = new MDFFAtom(atom, this);
+    MDFFAtom* mdffa = _mdff_atoms.create(atom, this);
+    size_t slot = _mdff_atoms.slot_of(mdffa);
+    mdffa->_slot = slot;
+    if (slot >= _coupling_constants.size()) {
+        _coupling_constants.resize(slot+1);
+        _enableds.resize(slot+1);
+    }
+    _coupling_constants[slot] = atom->element().mass();
+    _enableds[slot] = true;
     _atom_to_mdff[atom] = mdffa;
     track_created(mdffa);
     return mdffa;
 }
 
+void MDFFMgr::reserve(size_t n)
+{
+    size_t total = num_atoms() + n;
+    _mdff_atoms.reserve(total);
+    _atom_to_mdff.reserve(total);
+    _coupling_constants.reserve(total);
+    _enableds.reserve(total);
+}
+
+void MDFFMgr::_set_coupling_constant(MDFFAtom* a, double k)
+{
+    _coupling_constants[a->_slot] = k<0 ? 0.0 : k;
+    track_change(a, change_tracker()->REASON_SPRING_CONSTANT_CHANGED);
+}
+
+void MDFFMgr::set_coupling_constant(MDFFAtom* a, double k)
+{
+    _set_coupling_constant(a, k);
+}
+
+void MDFFMgr::set_enabled(MDFFAtom* a, bool flag)
+{
+    char& e = _enableds[a->_slot];
+    if (e != flag)
+    {
+        e = flag;
+        track_change(a, change_tracker()->REASON_ENABLED_CHANGED);
+    }
+}
+
+size_t MDFFMgr::set_coupling_constants(Atom** atoms, size_t n, const double* k)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+    {
+        auto it = _atom_to_mdff.find(atoms[i]);
+        if (it == _atom_to_mdff.end())
+            continue;
+        _set_coupling_constant(it->second, k[i]);
+        count++;
+    }
+    return count;
+}
+
+size_t MDFFMgr::reset_coupling_constants_to_mass(Atom** atoms, size_t n, double scale)
+{
+    size_t count = 0;
+    for (size_t i=0; i<n; ++i)
+    {
+        auto it = _atom_to_mdff.find(atoms[i]);
+        if (it == _atom_to_mdff.end())
+            continue;
+        _set_coupling_constant(it->second, scale*atoms[i]->element().mass());
+        count++;
+    }
+    return count;
+}
+
+size_t MDFFMgr::reset_all_coupling_constants_to_mass(double scale)
+{
+    _mdff_atoms.for_each([this, scale](MDFFAtom* a) {
+        _set_coupling_constant(a, scale*a->atom()->element().mass());
+    });
+    return _mdff_atoms.size();
+}
+
 MDFFAtom* MDFFMgr::get_mdff_atom(Atom *atom, bool create)
 {
     auto it = _atom_to_mdff.find(atom);
@@ -77,7 +145,7 @@ void MDFFMgr::_delete_mdff_atoms(const std::set<MDFFAtom *>& to_delete)
 {
     for (auto a: to_delete) {
         _atom_to_mdff.erase(a->atom());
-        delete a;
+        _mdff_atoms.destroy(a);
     }
 }
 
@@ -85,21 +153,26 @@ void MDFFMgr::destructors_done(const std::set<void *>& destroyed)
 {
     auto db = DestructionBatcher(this);
     std::set<MDFFAtom *> to_delete;
-    for (const auto &it: _atom_to_mdff) {
-        auto a = it.first;
-        if (destroyed.find(static_cast<void *>(a)) != destroyed.end()) {
-            to_delete.insert(it.second);
-        }
-    }
+    for_each_destroyed(destroyed, _atom_to_mdff, [&to_delete](decltype(_atom_to_mdff.begin()) it) {
+        to_delete.insert(it->second);
+    });
     _delete_mdff_atoms(to_delete);
 }
 
+Memory_Usage MDFFMgr::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _mdff_atoms.size();
+    u.buffer_bytes = _mdff_atoms.allocated_bytes() + memory::vector_bytes(_coupling_constants)
+        + memory::vector_bytes(_enableds);
+    u.container_bytes = _mdff_atoms.bookkeeping_bytes() + memory::hash_bytes(_atom_to_mdff);
+    return u;
+}
+
 MDFFMgr::~MDFFMgr()
 {
     auto du = DestructionUser(this);
-    for (auto &it: _atom_to_mdff) {
-        delete it.second;
-    }
+    _mdff_atoms.clear();
     _atom_to_mdff.clear();
 }
 
@@ -14,10 +14,13 @@
 #define ISOLDE_MDFF
 
 #include <iostream>
+#include <vector>
 
 #include "../constants.h"
 #include "changetracker.h"
 #include "sim_restraint_base.h"
+#include "../destruction_index.h"
+#include "../slab_pool.h"
 #include <atomstruct/destruct.h>
 #include <atomstruct/Atom.h>
 #include <atomstruct/Coord.h>
@@ -33,20 +36,22 @@ class MDFFMgr;
 //! Handles the coupling of an Atom to a MDFF map.
 /*! Unlike in the case of restraints, MDFFAtom objects are enabled by default,
  *  and are instantiated with their coupling constants pre-set to the mass of
- *  the atom.
+ *  the atom. The coupling constants and enabled states themselves live in
+ *  flat arrays in the MDFFMgr, indexed by the MDFFAtom's slot in its pool.
  */
 class MDFFAtom:
     public pyinstance::PythonInstance<MDFFAtom>,
     public Sim_Restraint_Base
 {
 public:
+    friend class MDFFMgr;
     MDFFAtom() {}
     ~MDFFAtom() { auto du=DestructionUser(this); }
     MDFFAtom(Atom* atom, MDFFMgr *mgr);
     void set_coupling_constant(double k);
-    double get_coupling_constant () const { return _coupling_constant; }
+    double get_coupling_constant () const;
     void set_enabled(bool flag);
-    bool enabled() const { return _enabled; }
+    bool enabled() const;
     Atom* atom() const { return _atom; }
     MDFFMgr* mgr() const { return _mgr; }
     Change_Tracker* change_tracker() const;
@@ -55,8 +60,7 @@ public:
 private:
     Atom* _atom;
     MDFFMgr *_mgr;
-    double _coupling_constant = 0.0;
-    bool _enabled = true;
+    size_t _slot = 0;
 
 }; //class MDFFAtom
 
@@ -77,6 +81,8 @@ public:
     Structure* structure() const { return _atomic_model; }
     MDFFAtom* get_mdff_atom(Atom *atom, bool create);
     size_t num_atoms() const { return _atom_to_mdff.size(); }
+    //! Make room for n more MDFF atoms without further allocation
+    void reserve(size_t n);
     Change_Tracker* change_tracker() const { return _change_tracker; }
     void track_created(const void *r) { change_tracker()->add_created(_mgr_type, this, r); }
     void track_change(const void *r, int reason)
@@ -86,8 +92,24 @@ public:
     double global_k() const { return _global_coupling_constant; }
     void set_global_k(double k) { _global_coupling_constant = k; }
 
+    double coupling_constant(const MDFFAtom* a) const { return _coupling_constants[a->_slot]; }
+    void set_coupling_constant(MDFFAtom* a, double k);
+    bool enabled(const MDFFAtom* a) const { return _enableds[a->_slot]; }
+    void set_enabled(MDFFAtom* a, bool flag);
+
+    /*! Bulk setters for the coupling constants of whichever of the given
+     *  atoms are coupled to this map. Atoms without an MDFFAtom are skipped.
+     *  Each returns the number of MDFFAtoms changed.
+     */
+    size_t set_coupling_constants(Atom** atoms, size_t n, const double* k);
+    //! Coupling constant = scale * element mass for each given atom
+    size_t reset_coupling_constants_to_mass(Atom** atoms, size_t n, double scale);
+    //! Coupling constant = scale * element mass for every MDFFAtom
+    size_t reset_all_coupling_constants_to_mass(double scale);
+
     void delete_mdff_atoms(const std::set<MDFFAtom *>& to_delete);
     virtual void destructors_done(const std::set<void *>& destroyed);
+    Memory_Usage memory_usage() const;
 
 private:
     const std::string _py_name = "MDFFMgr";
@@ -98,7 +120,12 @@ private:
     Structure* _atomic_model;
     Change_Tracker* _change_tracker;
     std::unordered_map<Atom*, MDFFAtom*> _atom_to_mdff;
+    Slab_Pool<MDFFAtom> _mdff_atoms;
+    // Indexed by pool slot
+    std::vector<double> _coupling_constants;
+    std::vector<char> _enableds;
     MDFFAtom* _new_mdff_atom(Atom *atom);
+    void _set_coupling_constant(MDFFAtom* a, double k);
     const char* error_different_mol() const {
         return "This atom is in the wrong structure!";
     }
@@ -106,6 +133,9 @@ private:
 
 }; //class MDFFMgr
 
+inline double MDFFAtom::get_coupling_constant() const { return _mgr->coupling_constant(this); }
+inline bool MDFFAtom::enabled() const { return _mgr->enabled(this); }
+
 
 
 } //namespace isolde
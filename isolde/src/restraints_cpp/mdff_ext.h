@@ -60,6 +60,8 @@ mdff_mgr_get_mdff_atom(void *mgr, void *atom, size_t n, npy_bool create, pyobjec
     Atom **a = static_cast<Atom **>(atom);
     size_t count =0;
     try {
+        if (create)
+            m->reserve(n);
         for (size_t i=0; i<n; ++i) {
             MDFFAtom *ma = m->get_mdff_atom(*a++, create);
             if (ma!=nullptr) {
@@ -86,6 +88,44 @@ mdff_mgr_num_atoms(void *mgr)
     }
 }
 
+extern "C" EXPORT size_t
+mdff_mgr_set_coupling_constants(void *mgr, void *atom, size_t n, double *k)
+{
+    MDFFMgr *m = static_cast<MDFFMgr *>(mgr);
+    Atom **a = static_cast<Atom **>(atom);
+    try {
+        return m->set_coupling_constants(a, n, k);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT size_t
+mdff_mgr_reset_coupling_constants_to_mass(void *mgr, void *atom, size_t n, double scale)
+{
+    MDFFMgr *m = static_cast<MDFFMgr *>(mgr);
+    Atom **a = static_cast<Atom **>(atom);
+    try {
+        return m->reset_coupling_constants_to_mass(a, n, scale);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT size_t
+mdff_mgr_reset_all_coupling_constants_to_mass(void *mgr, double scale)
+{
+    MDFFMgr *m = static_cast<MDFFMgr *>(mgr);
+    try {
+        return m->reset_all_coupling_constants_to_mass(scale);
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
 extern "C" EXPORT double
 mdff_mgr_global_k(void *mgr)
 {
@@ -80,6 +80,26 @@ void PositionRestraint::bond_cylinder_transform(float *rot44) const
     geometry::bond_cylinder_transform_gl<Coord, float>(c0, c1, radius(), 1.0, rot44);
 }
 
+void PositionRestraint::batch_transforms(PositionRestraint * const *restraints,
+    size_t n, float *rot44)
+{
+    std::vector<float> xyz0(n*3), xyz1(n*3), radii(n), ones(n, 1.0);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto r = restraints[i];
+        const Coord &c0 = r->atom()->coord();
+        const Coord &c1 = r->get_target();
+        for (size_t j=0; j<3; ++j)
+        {
+            xyz0[3*i+j] = c0[j];
+            xyz1[3*i+j] = c1[j];
+        }
+        radii[i] = r->radius();
+    }
+    geometry::bond_cylinder_transforms_gl<float>(n, xyz0.data(), xyz1.data(),
+        radii.data(), ones.data(), rot44);
+}
+
 PositionRestraint* PositionRestraintMgr_Base::_new_restraint(Atom *atom, const Coord& target)
 {
     if (atom->structure() != _atomic_model) {
@@ -88,7 +108,7 @@ PositionRestraint* PositionRestraintMgr_Base::_new_restraint(Atom *atom, const C
     // if (atom->element().number() == 1) {
     //     throw std::logic_error(error_hydrogen());
     // }
-    PositionRestraint* restraint = new PositionRestraint(atom, target, this);
+    PositionRestraint* restraint = _restraints.create(atom, target, this);
     _atom_to_restraint[atom] = restraint;
     track_created(restraint);
     return restraint;
@@ -112,12 +132,10 @@ PositionRestraint* PositionRestraintMgr_Base::get_restraint(Atom *atom, bool cre
 std::vector<PositionRestraint *> PositionRestraintMgr_Base::visible_restraints() const
 {
     std::vector<PositionRestraint *> visibles;
-    for (auto &it: _atom_to_restraint)
-    {
-        auto r = it.second;
+    _restraints.for_each([&visibles](PositionRestraint *r) {
         if (r->visible())
             visibles.push_back(r);
-    }
+    });
     return visibles;
 }
 
@@ -132,7 +150,7 @@ void PositionRestraintMgr_Base::_delete_restraints(const std::set<PositionRestra
 {
     for (auto r: to_delete) {
         _atom_to_restraint.erase(r->atom());
-        delete r;
+        _restraints.destroy(r);
     }
 }
 
@@ -140,21 +158,25 @@ void PositionRestraintMgr_Base::destructors_done(const std::set<void *>& destroy
 {
     auto db = DestructionBatcher(this);
     std::set<PositionRestraint *> to_delete;
-    for (auto &it: _atom_to_restraint) {
-        auto r = it.second;
-        if (destroyed.find(static_cast<void *>(r->atom())) != destroyed.end()) {
-            to_delete.insert(r);
-        }
-    }
+    for_each_destroyed(destroyed, _atom_to_restraint, [&to_delete](decltype(_atom_to_restraint.begin()) it) {
+        to_delete.insert(it->second);
+    });
     _delete_restraints(to_delete);
 }
 
+Memory_Usage PositionRestraintMgr_Base::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _restraints.size();
+    u.buffer_bytes = _restraints.allocated_bytes();
+    u.container_bytes = _restraints.bookkeeping_bytes() + memory::hash_bytes(_atom_to_restraint);
+    return u;
+}
+
 PositionRestraintMgr_Base::~PositionRestraintMgr_Base()
 {
     auto du = DestructionUser(this);
-    for (auto &it: _atom_to_restraint) {
-        delete it.second;
-    }
+    _restraints.clear();
     _atom_to_restraint.clear();
 }
 
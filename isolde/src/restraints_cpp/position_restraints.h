@@ -19,6 +19,8 @@
 #include "../geometry/geometry.h"
 #include "changetracker.h"
 #include "sim_restraint_base.h"
+#include "../destruction_index.h"
+#include "../slab_pool.h"
 #include <atomstruct/destruct.h>
 #include <atomstruct/string_types.h>
 #include <atomstruct/Atom.h>
@@ -48,6 +50,10 @@ public:
 
     void set_target(const Real &x, const Real &y, const Real &z);
     void set_target(Real *target);
+    //! Change the target without notifying the change tracker (see TuggableAtomsMgr.tug())
+    void set_target_untracked(const Real *target) {
+        for (size_t i=0; i<3; ++i) _target[i] = target[i];
+    }
     const Coord& get_target() const { return _target; }
     void get_target(double *target) const {
         for (size_t i=0; i<3; ++i)
@@ -63,6 +69,8 @@ public:
     double radius() const;
     //! Provide a 4x4 OpenGL array transforming a primitive unit bond onto this restraint
     void bond_cylinder_transform(float *rot44) const;
+    //! Batched equivalent of bond_cylinder_transform() for n restraints
+    static void batch_transforms(PositionRestraint * const *restraints, size_t n, float *rot44);
     Change_Tracker* change_tracker() const;
     PositionRestraintMgr_Base* mgr() const { return _mgr; }
 
@@ -95,6 +103,7 @@ public:
     void track_change(const void *r, int reason) {change_tracker()->add_modified(_mgr_type, this, r, reason);}
     void delete_restraints(const std::set<PositionRestraint *>& to_delete);
     virtual void destructors_done(const std::set<void *>& destroyed);
+    Memory_Usage memory_usage() const;
 
 protected:
     std::string _py_name = "PositionRestraintMgr";
@@ -105,6 +114,7 @@ private:
     Structure* _atomic_model;
     Change_Tracker* _change_tracker;
     std::unordered_map<Atom*, PositionRestraint*> _atom_to_restraint;
+    Slab_Pool<PositionRestraint> _restraints;
     PositionRestraint* _new_restraint(Atom *atom);
     PositionRestraint* _new_restraint(Atom *atom, const Coord& target);
     const char* error_different_mol() const {
@@ -242,6 +242,20 @@ set_position_restraint_target(void *restraint, size_t n, double *target)
     }
 }
 
+extern "C" EXPORT void
+set_position_restraint_target_untracked(void *restraint, size_t n, double *target)
+{
+    PositionRestraint **r = static_cast<PositionRestraint **>(restraint);
+    try {
+        for (size_t i=0; i<n; ++i) {
+            (*r++)->set_target_untracked(target);
+            target+=3;
+        }
+    } catch (...) {
+        molc_error();
+    }
+}
+
 extern "C" EXPORT void
 position_restraint_sim_index(void *restraint, size_t n, int *index)
 {
@@ -331,10 +345,7 @@ extern "C" EXPORT void position_restraint_bond_transform(void *restraint, size_t
 {
     PositionRestraint **r = static_cast<PositionRestraint **>(restraint);
     try {
-        for (size_t i=0; i<n; ++i) {
-            (*r++)->bond_cylinder_transform(transform);
-            transform += 16;
-        }
+        PositionRestraint::batch_transforms(r, n, transform);
     } catch (...) {
         molc_error();
     }
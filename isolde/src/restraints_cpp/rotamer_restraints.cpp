@@ -13,6 +13,7 @@
 #define PYINSTANCE_EXPORT
 #include "rotamer_restraints.h"
 #include "../util.h"
+#include <limits>
 #include <pyinstance/PythonInstance.instantiate.h>
 
 
@@ -62,6 +63,32 @@ void RotamerRestraint::set_target_index(int t_index) {
     }
 }
 
+int RotamerRestraint::nearest_target_index() const {
+    auto rot = rotamer();
+    size_t n_targets = rot->num_target_defs();
+    if (n_targets == 0)
+        return -1;
+    auto current = rot->angles();
+    int best = -1;
+    double best_d2 = std::numeric_limits<double>::infinity();
+    for (size_t t=0; t<n_targets; ++t)
+    {
+        const auto def = rot->get_target_def(t);
+        double d2 = 0;
+        for (size_t i=0; i<n_chi(); ++i)
+        {
+            double d = util::wrapped_angle(current[i]-def->angles[i])/def->esds[i];
+            d2 += d*d;
+        }
+        if (d2 < best_d2)
+        {
+            best_d2 = d2;
+            best = t;
+        }
+    }
+    return best;
+}
+
 bool RotamerRestraint::enabled() const {
     for (auto r: _chi_restraints) {
         if (!r->is_enabled()) return false;
@@ -70,10 +97,24 @@ bool RotamerRestraint::enabled() const {
 }
 
 
+Memory_Usage RotamerRestraintMgr::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _restraints.size();
+    u.buffer_bytes = _restraints.allocated_bytes();
+    u.container_bytes = _restraints.bookkeeping_bytes() + memory::hash_bytes(_restraint_map)
+        + memory::vector_bytes(_dense);
+    _restraints.for_each([&u](RotamerRestraint *r) {
+        u.buffer_bytes += memory::vector_bytes(r->chi_restraints());
+    });
+    return u;
+}
+
 RotamerRestraintMgr::~RotamerRestraintMgr()
 {
     auto du = DestructionUser(this);
-    delete_restraints(all_restraints());
+    auto db = DestructionBatcher(this);
+    _restraints.clear();
     _restraint_map.clear();
 }
 
@@ -93,8 +134,9 @@ RotamerRestraint* RotamerRestraintMgr::new_restraint(Rotamer *rot)
 
 RotamerRestraint* RotamerRestraintMgr::_new_restraint(Rotamer *rot)
 {
-    RotamerRestraint *r = new RotamerRestraint(rot, this);
+    RotamerRestraint *r = _restraints.create(rot, this);
     _restraint_map[rot] = r;
+    _dense_dirty = true;
     track_created(r);
     return r;
 }
@@ -110,12 +152,68 @@ RotamerRestraint* RotamerRestraintMgr::get_restraint(Rotamer *rot, bool create)
     return nullptr;
 }
 
-std::set<RotamerRestraint *> RotamerRestraintMgr::all_restraints() const
+const std::vector<RotamerRestraint *>& RotamerRestraintMgr::all_restraints() const
+{
+    if (_dense_dirty)
+    {
+        _dense.clear();
+        _dense.reserve(_restraints.size());
+        _restraints.for_each([this](RotamerRestraint *r) { _dense.push_back(r); });
+        _dense_dirty = false;
+    }
+    return _dense;
+}
+
+void RotamerRestraintMgr::set_target_indices(RotamerRestraint * const *restraints,
+    const int32_t *indices, size_t n)
 {
-    std::set<RotamerRestraint *> ret;
-    for (const auto &it: _restraint_map)
-        ret.insert(it.second);
-    return ret;
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(_dihedral_restraint_mgr);
+    for (size_t i=0; i<n; ++i)
+        restraints[i]->set_target_index(indices[i]);
+}
+
+void RotamerRestraintMgr::set_spring_constants(RotamerRestraint * const *restraints,
+    const double *k, size_t n)
+{
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(_dihedral_restraint_mgr);
+    for (size_t i=0; i<n; ++i)
+        restraints[i]->set_spring_constant(k[i]);
+}
+
+void RotamerRestraintMgr::set_spring_constant(RotamerRestraint * const *restraints,
+    double k, size_t n)
+{
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(_dihedral_restraint_mgr);
+    for (size_t i=0; i<n; ++i)
+        restraints[i]->set_spring_constant(k);
+}
+
+void RotamerRestraintMgr::set_enabled(RotamerRestraint * const *restraints,
+    const uint8_t *flags, size_t n)
+{
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(_dihedral_restraint_mgr);
+    for (size_t i=0; i<n; ++i)
+        restraints[i]->set_enabled(flags[i]);
+}
+
+std::vector<RotamerRestraint *> RotamerRestraintMgr::restrain_to_current(
+    Rotamer * const *rotamers, size_t n, double spring_constant)
+{
+    Change_Batch_Scope<ProperDihedralRestraintMgr> batch(_dihedral_restraint_mgr);
+    std::vector<RotamerRestraint *> restraints;
+    restraints.reserve(n);
+    for (size_t i=0; i<n; ++i)
+    {
+        auto r = get_restraint(rotamers[i], true);
+        int t = r->nearest_target_index();
+        if (t < 0)
+            continue;
+        r->set_target_index(t);
+        r->set_spring_constant(spring_constant);
+        r->set_enabled(true);
+        restraints.push_back(r);
+    }
+    return restraints;
 }
 
 void RotamerRestraintMgr::delete_restraints(const std::set<RotamerRestraint *>& delete_list)
@@ -130,23 +228,18 @@ void RotamerRestraintMgr::_delete_restraints(const std::set<RotamerRestraint *>&
     {
         auto r = d->rotamer();
         _restraint_map.erase(r);
-        delete d;
+        _restraints.destroy(d);
     }
+    _dense_dirty = true;
 }
 
 void RotamerRestraintMgr::destructors_done(const std::set<void *>& destroyed)
 {
     auto db = DestructionBatcher(this);
     std::set<RotamerRestraint *> to_delete;
-    for (auto it=_restraint_map.begin(); it != _restraint_map.end();) {
-        auto r = it->first;
-        if (destroyed.find(static_cast<void *>(r)) != destroyed.end()) {
-            to_delete.insert(it->second);
-            it = _restraint_map.erase(it);
-        } else {
-            it++;
-        }
-    }
+    for_each_destroyed(destroyed, _restraint_map, [&to_delete](decltype(_restraint_map.begin()) it) {
+        to_delete.insert(it->second);
+    });
     _delete_restraints(to_delete);
 }
 
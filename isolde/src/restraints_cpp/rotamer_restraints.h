@@ -47,6 +47,8 @@ public:
     bool enabled() const;
     // Set the target angles and cutoffs according to the target definition at t_index
     void set_target_index (int t_index);
+    //! Index of the target definition nearest the current chi angles (-1 if none)
+    int nearest_target_index() const;
     int target_index() const { return _current_target_index; }
 
     RotamerRestraintMgr *mgr() const { return _mgr; }
@@ -77,10 +79,29 @@ public:
     RotamerRestraint* new_restraint(Rotamer *rot);
     RotamerRestraint* get_restraint(Rotamer *rot, bool create);
 
-    std::set<RotamerRestraint *> all_restraints() const;
+    /*! All restraints in pool slot order. Kept as a dense list, rebuilt only
+     *  after restraints have been created or deleted.
+     */
+    const std::vector<RotamerRestraint *>& all_restraints() const;
     size_t num_restraints() const { return _restraint_map.size(); }
     void delete_restraints(const std::set<RotamerRestraint *>& delete_list);
 
+    /*! Batched setters over n restraints. Each is a single pass writing
+     *  straight through to the chi dihedral restraints, with all the
+     *  resulting changes reported to the tracker at once.
+     */
+    void set_target_indices(RotamerRestraint * const *restraints, const int32_t *indices, size_t n);
+    void set_spring_constants(RotamerRestraint * const *restraints, const double *k, size_t n);
+    void set_spring_constant(RotamerRestraint * const *restraints, double k, size_t n);
+    void set_enabled(RotamerRestraint * const *restraints, const uint8_t *flags, size_t n);
+    /*! Restrain each of n rotamers (creating restraints as necessary) to the
+     *  target conformation closest to its current chi angles, measured in
+     *  standard deviations, with the given spring constant. Rotamers without
+     *  target definitions are skipped. Returns the restraints.
+     */
+    std::vector<RotamerRestraint *> restrain_to_current(Rotamer * const *rotamers,
+        size_t n, double spring_constant);
+
     ProperDihedralRestraintMgr* dihedral_restraint_mgr() const
     {
         return _dihedral_restraint_mgr;
@@ -94,6 +115,8 @@ public:
     RotaMgr* rota_mgr() const { return _rota_mgr; }
 
     virtual void destructors_done(const std::set<void *>& destroyed);
+    //! The chi dihedral restraints are counted by the ProperDihedralRestraintMgr
+    Memory_Usage memory_usage() const;
 
 private:
     std::type_index _mgr_type = std::type_index(typeid(this));
@@ -103,6 +126,9 @@ private:
     RotaMgr *_rota_mgr;
 
     std::unordered_map<Rotamer*, RotamerRestraint*> _restraint_map;
+    Slab_Pool<RotamerRestraint> _restraints;
+    mutable std::vector<RotamerRestraint *> _dense;
+    mutable bool _dense_dirty = true;
     const std::string _py_name = "RotamerRestraintMgr";
     const std::string _managed_class_py_name = "RotamerRestraints";
 
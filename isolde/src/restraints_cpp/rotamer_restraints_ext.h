@@ -68,6 +68,34 @@ rotamer_restraint_mgr_num_restraints(void *mgr)
     }
 } //rotamer_restraint_mgr_num_restraints
 
+extern "C" EXPORT void
+rotamer_restraint_mgr_all_restraints(void *mgr, pyobject_t *restraints)
+{
+    RotamerRestraintMgr *m = static_cast<RotamerRestraintMgr *>(mgr);
+    try {
+        const auto& all = m->all_restraints();
+        std::copy(all.begin(), all.end(), restraints);
+    } catch (...) {
+        molc_error();
+    }
+} //rotamer_restraint_mgr_all_restraints
+
+extern "C" EXPORT size_t
+rotamer_restraint_mgr_restrain_to_current(void *mgr, void *rotamer, size_t n,
+    double spring_constant, pyobject_t *restraints)
+{
+    RotamerRestraintMgr *m = static_cast<RotamerRestraintMgr *>(mgr);
+    Rotamer **r = static_cast<Rotamer **>(rotamer);
+    try {
+        auto rr = m->restrain_to_current(r, n, spring_constant);
+        std::copy(rr.begin(), rr.end(), restraints);
+        return rr.size();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+} //rotamer_restraint_mgr_restrain_to_current
+
 extern "C" EXPORT size_t
 rotamer_restraint_mgr_get_restraint(void *mgr, void *rotamer, size_t n, bool create, pyobject_t *restraint)
 {
@@ -99,6 +127,24 @@ rotamer_restraint_mgr_get_restraint(void *mgr, void *rotamer, size_t n, bool cre
 SET_PYTHON_CLASS(rotamer_restraint, RotamerRestraint)
 GET_PYTHON_INSTANCES(rotamer_restraint, RotamerRestraint)
 
+/*! Arrays of restraints may span several models. Hand each run belonging
+ *  to the same manager to f(mgr, restraints, offset, count) in turn, so the
+ *  manager's batched setters can be used.
+ */
+template <typename F>
+static void for_each_mgr_run(RotamerRestraint **rr, size_t n, F f)
+{
+    for (size_t start=0; start<n; )
+    {
+        auto mgr = rr[start]->mgr();
+        size_t end = start+1;
+        while (end < n && rr[end]->mgr() == mgr)
+            ++end;
+        f(mgr, rr+start, start, end-start);
+        start = end;
+    }
+}
+
 extern "C" EXPORT void
 rotamer_restraint_get_manager(void *restraint, size_t n, pyobject_t *mgr)
 {
@@ -151,9 +197,22 @@ set_rotamer_restraint_spring_constant(void *restraint, size_t n, double k)
 {
     RotamerRestraint** rr = static_cast<RotamerRestraint **>(restraint);
     try {
-        for (size_t i=0; i<n; ++i) {
-            (*rr++)->set_spring_constant(k);
-        }
+        for_each_mgr_run(rr, n, [k](RotamerRestraintMgr *m, RotamerRestraint **r, size_t, size_t count) {
+            m->set_spring_constant(r, k, count);
+        });
+    } catch(...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+set_rotamer_restraint_spring_constants(void *restraint, size_t n, double *k)
+{
+    RotamerRestraint** rr = static_cast<RotamerRestraint **>(restraint);
+    try {
+        for_each_mgr_run(rr, n, [k](RotamerRestraintMgr *m, RotamerRestraint **r, size_t offset, size_t count) {
+            m->set_spring_constants(r, k+offset, count);
+        });
     } catch(...) {
         molc_error();
     }
@@ -170,7 +229,13 @@ extern "C" EXPORT void
 set_rotamer_restraint_enabled(void *restraint, size_t n, npy_bool *enabled)
 {
     RotamerRestraint** rr = static_cast<RotamerRestraint **>(restraint);
-    error_wrap_array_set<RotamerRestraint, bool, npy_bool>(rr, n, &RotamerRestraint::set_enabled, enabled);
+    try {
+        for_each_mgr_run(rr, n, [enabled](RotamerRestraintMgr *m, RotamerRestraint **r, size_t offset, size_t count) {
+            m->set_enabled(r, enabled+offset, count);
+        });
+    } catch(...) {
+        molc_error();
+    }
 }
 
 extern "C" EXPORT void
@@ -184,7 +249,13 @@ extern "C" EXPORT void
 set_rotamer_restraint_target_index(void *restraint, size_t n, int32_t *index)
 {
     RotamerRestraint** rr = static_cast<RotamerRestraint **>(restraint);
-    error_wrap_array_set<RotamerRestraint, int, int32_t>(rr, n, &RotamerRestraint::set_target_index, index);
+    try {
+        for_each_mgr_run(rr, n, [index](RotamerRestraintMgr *m, RotamerRestraint **r, size_t offset, size_t count) {
+            m->set_target_indices(r, index+offset, count);
+        });
+    } catch(...) {
+        molc_error();
+    }
 }
 
 
@@ -14,19 +14,13 @@ def get_shell_of_residues(residues, dist_cutoff):
     within a user-defined cut-off distance surrounding residues. Expects
     all residues to be within the same model.
     '''
-    from chimerax.core.geometry import find_close_points
-    from chimerax.atomic import selected_atoms, Atoms, concatenate
+    from .molobject import get_atom_index
     us = residues.unique_structures
-    selatoms = residues.atoms
     if len(us) !=1:
         raise Exception('selection should contain atoms from a single molecule!')
-    allres = us[0].residues
-    unsel_residues = allres.subtract(residues)
-    unselected_atoms = unsel_residues.atoms
-    selcoords = selatoms.coords
-    unselcoords = unselected_atoms.coords
-    ignore, shell_indices = find_close_points(selcoords, unselcoords, dist_cutoff)
-    shell_residues = unselected_atoms[shell_indices].unique_residues
+    idx = get_atom_index(us[0])
+    near_atoms = idx.within(residues.atoms.coords, dist_cutoff)
+    shell_residues = near_atoms.unique_residues.subtract(residues)
     return shell_residues
 
 def expand_selection_along_chains(atoms, extension):
@@ -10,7 +10,8 @@ from .molobject import (
     get_proper_dihedral_mgr,
     get_chiral_mgr,
     get_ramachandran_mgr,
-    get_rotamer_mgr
+    get_rotamer_mgr,
+    get_atom_index,
 )
 
 def get_chiral_restraint_mgr(model, create=True):
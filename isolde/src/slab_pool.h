@@ -0,0 +1,202 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SLAB_POOL
+#define ISOLDE_SLAB_POOL
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+namespace isolde
+{
+
+/*! Pooled storage for large numbers of heap objects of a single type.
+ *
+ *  Objects are constructed in place in fixed-size chunks, so their addresses
+ *  never change for as long as they live (important for anything with a
+ *  Python-side pointer). Destroyed slots go onto a free list for re-use.
+ *  Each live object has a stable integer slot number, which can be used to
+ *  index flat side tables, and live objects can be visited in slot order.
+ */
+template <typename T, size_t CHUNK_SIZE=1024>
+class Slab_Pool
+{
+public:
+    Slab_Pool() {}
+    Slab_Pool(const Slab_Pool&) = delete;
+    Slab_Pool& operator=(const Slab_Pool&) = delete;
+    ~Slab_Pool() { clear(); }
+
+    //! Construct a new object in the pool
+    template <typename... Args>
+    T* create(Args&&... args)
+    {
+        size_t slot;
+        if (!_free.empty()) {
+            slot = _free.back();
+            _free.pop_back();
+        } else {
+            if (_high_water == _chunks.size()*CHUNK_SIZE)
+                _add_chunk();
+            slot = _high_water++;
+        }
+        auto& chunk = *_chunks[slot/CHUNK_SIZE];
+        size_t i = slot % CHUNK_SIZE;
+        T* obj;
+        try {
+            obj = new (&chunk.storage[i]) T(std::forward<Args>(args)...);
+        } catch (...) {
+            _free.push_back(slot);
+            throw;
+        }
+        chunk.live[i] = true;
+        _size++;
+        return obj;
+    }
+
+    //! Destroy an object previously returned by create()
+    void destroy(T* obj)
+    {
+        size_t slot = slot_of(obj);
+        auto& chunk = *_chunks[slot/CHUNK_SIZE];
+        size_t i = slot % CHUNK_SIZE;
+        if (!chunk.live[i])
+            throw std::logic_error("Attempted to destroy an object that is not live in this pool!");
+        chunk.live[i] = false;
+        _size--;
+        _free.push_back(slot);
+        obj->~T();
+    }
+
+    //! Slot number of a live object, in the range [0, capacity())
+    size_t slot_of(const T* obj) const
+    {
+        auto p = reinterpret_cast<const char*>(obj);
+        // Chunks are kept sorted by address, so find the last one starting at or before p
+        auto it = std::upper_bound(_chunk_order.begin(), _chunk_order.end(), p,
+            [this](const char* ptr, size_t ci) {
+                return ptr < reinterpret_cast<const char*>(_chunks[ci]->storage);
+            });
+        if (it != _chunk_order.begin()) {
+            size_t ci = *(--it);
+            auto base = reinterpret_cast<const char*>(_chunks[ci]->storage);
+            size_t offset = static_cast<size_t>(p - base);
+            if (offset < sizeof(Storage)*CHUNK_SIZE && offset % sizeof(Storage) == 0)
+                return ci*CHUNK_SIZE + offset/sizeof(Storage);
+        }
+        throw std::out_of_range("Object was not allocated from this pool!");
+    }
+
+    //! The live object in the given slot, or nullptr
+    T* at_slot(size_t slot) const
+    {
+        if (slot >= _high_water)
+            return nullptr;
+        auto& chunk = *_chunks[slot/CHUNK_SIZE];
+        size_t i = slot % CHUNK_SIZE;
+        return chunk.live[i] ? reinterpret_cast<T*>(&chunk.storage[i]) : nullptr;
+    }
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+    //! One more than the highest slot number ever used
+    size_t capacity() const { return _high_water; }
+
+    //! Bytes allocated for object storage, live or not
+    size_t allocated_bytes() const { return _chunks.size()*sizeof(Chunk); }
+    //! Bytes used by the chunk list and free list
+    size_t bookkeeping_bytes() const
+    {
+        return _chunks.capacity()*sizeof(std::unique_ptr<Chunk>)
+            + (_chunk_order.capacity() + _free.capacity())*sizeof(size_t);
+    }
+
+    //! Pre-allocate chunks for at least n objects
+    void reserve(size_t n)
+    {
+        while (_chunks.size()*CHUNK_SIZE < n)
+            _add_chunk();
+    }
+
+    //! Call f(T*) for each live object, in slot order
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (size_t slot=0; slot<_high_water; ++slot) {
+            auto& chunk = *_chunks[slot/CHUNK_SIZE];
+            size_t i = slot % CHUNK_SIZE;
+            if (chunk.live[i])
+                f(reinterpret_cast<T*>(&chunk.storage[i]));
+        }
+    }
+
+    //! Pointers to all live objects, in slot order
+    std::vector<T*> all() const
+    {
+        std::vector<T*> objs;
+        objs.reserve(_size);
+        for_each([&objs](T* obj) { objs.push_back(obj); });
+        return objs;
+    }
+
+    //! Destroy all live objects. Allocated chunks are kept for re-use.
+    void clear()
+    {
+        for (size_t slot=0; slot<_high_water; ++slot) {
+            auto& chunk = *_chunks[slot/CHUNK_SIZE];
+            size_t i = slot % CHUNK_SIZE;
+            if (chunk.live[i]) {
+                chunk.live[i] = false;
+                reinterpret_cast<T*>(&chunk.storage[i])->~T();
+            }
+        }
+        _free.clear();
+        _high_water = 0;
+        _size = 0;
+    }
+
+private:
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type Storage;
+    struct Chunk
+    {
+        Storage storage[CHUNK_SIZE];
+        bool live[CHUNK_SIZE];
+        Chunk() { std::fill(live, live+CHUNK_SIZE, false); }
+    };
+    std::vector<std::unique_ptr<Chunk>> _chunks;
+    std::vector<size_t> _chunk_order; // chunk indices sorted by address
+    std::vector<size_t> _free;
+    size_t _high_water = 0;
+    size_t _size = 0;
+
+    void _add_chunk()
+    {
+        size_t ci = _chunks.size();
+        _chunks.emplace_back(new Chunk());
+        auto base = reinterpret_cast<const char*>(_chunks[ci]->storage);
+        auto it = std::upper_bound(_chunk_order.begin(), _chunk_order.end(), base,
+            [this](const char* ptr, size_t cj) {
+                return ptr < reinterpret_cast<const char*>(_chunks[cj]->storage);
+            });
+        _chunk_order.insert(it, ci);
+    }
+}; // class Slab_Pool
+
+} // namespace isolde
+
+#endif // ISOLDE_SLAB_POOL
@@ -5,3 +5,10 @@
 # @Last modified time: 26-Apr-2018
 # @License: Free for non-commercial use (see license.pdf)
 # @Copyright:2016-2019 Tristan Croll
+
+
+
+def make_interpolator(values, min_vals, max_vals):
+    from ..interpolation.interp import RegularGridInterpolator
+    return RegularGridInterpolator(values.ndim, values.shape, min_vals, max_vals,
+        values)
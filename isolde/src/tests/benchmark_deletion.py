@@ -0,0 +1,99 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Timing of atom deletion with all of ISOLDE's managers populated. Every
+manager is a DestructionObserver, so the cost of their destructors_done()
+methods is paid on every deletion anywhere in the session. Run from the
+ChimeraX shell:
+
+    from chimerax.isolde.tests.benchmark_deletion import run_benchmark
+    run_benchmark(session)
+
+or pass a model of your own. With no model, a large test case is built by
+combining copies of the 1pmx test structure.
+'''
+
+from time import time
+
+def build_test_model(session, n_copies=100):
+    import os
+    from chimerax.core.commands import run
+    base = run(session, 'open {}'.format(
+        os.path.join(os.path.dirname(__file__), '1pmx_1.pdb')))[0]
+    copies = [base]
+    for i in range(n_copies-1):
+        copies.append(base.copy())
+    from chimerax.atomic.struct_edit import combine
+    model = combine(copies, name='deletion benchmark')
+    session.models.close(copies)
+    session.models.add([model])
+    return model
+
+def populate_managers(session, model):
+    from .. import session_extensions as sx
+    residues = model.residues
+    atoms = residues.atoms
+    timings = {}
+    start = time()
+    sx.get_proper_dihedral_mgr(session).create_all_dihedrals(residues)
+    timings['dihedrals'] = time()-start
+    start = time()
+    sx.get_ramachandran_mgr(session).get_ramas(residues)
+    timings['ramas'] = time()-start
+    start = time()
+    sx.get_rotamer_mgr(session).get_rotamers(residues)
+    timings['rotamers'] = time()-start
+    start = time()
+    sx.get_chiral_mgr(session).get_chirals(atoms)
+    timings['chirals'] = time()-start
+    start = time()
+    sx.get_position_restraint_mgr(model).add_restraints(atoms)
+    sx.get_proper_dihedral_restraint_mgr(model).add_restraints_by_residues_and_name(residues, 'phi')
+    sx.get_rotamer_restraint_mgr(model).add_restraints(residues)
+    ca = atoms[atoms.names=='CA']
+    sx.get_distance_restraint_mgr(model).add_restraints(ca[:-1], ca[1:])
+    timings['restraints'] = time()-start
+    return timings
+
+def time_chain_deletion(session, model, chain_id=None):
+    residues = model.residues
+    if chain_id is None:
+        chain_id = residues.chain_ids[-1]
+    atoms = residues[residues.chain_ids == chain_id].atoms
+    n = len(atoms)
+    start = time()
+    # Destruction observers are notified before delete() returns
+    atoms.delete()
+    elapsed = time()-start
+    return n, elapsed
+
+def run_benchmark(session, model=None, n_copies=100, n_deletions=5):
+    if model is None:
+        model = build_test_model(session, n_copies)
+    log = session.logger
+    log.info('Deletion benchmark: {} atoms, {} residues'.format(
+        model.num_atoms, model.num_residues))
+    for key, t in populate_managers(session, model).items():
+        log.info('  Populating {}: {:.3f} s'.format(key, t))
+    for i in range(n_deletions):
+        if model.deleted or model.num_atoms == 0:
+            break
+        n, t = time_chain_deletion(session, model)
+        log.info('  Deleted {} atoms in {:.4f} s'.format(n, t))
+    # A small deletion in a different model should cost next to nothing
+    from chimerax.atomic import AtomicStructure
+    from chimerax.atomic.struct_edit import add_atom
+    other = AtomicStructure(session, name='deletion benchmark scratch')
+    r = other.new_residue('HOH', 'A', 1)
+    add_atom('O', 'O', r, [0,0,0])
+    session.models.add([other])
+    start = time()
+    other.atoms.delete()
+    log.info('  Deleted 1 unrelated atom in {:.5f} s'.format(time()-start))
+    session.models.close([other])
@@ -0,0 +1,307 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+'''
+Benchmarks of the compiled parts of ISOLDE (the molc, _nd_interp and openmm
+libraries), run through their Python interfaces on the demo_data models and a
+synthetic case built from copies of 6out. Results come back as a dict and can
+be written to a JSON file, so runs on different builds or machines can be
+compared:
+
+    from chimerax.isolde.tests.benchmark_suite import run_benchmarks
+    run_benchmarks(session, output='isolde_benchmarks.json')
+
+or without the GUI:
+
+    chimerax --nogui --offscreen --exit --cmd "runscript /path/to/benchmark_suite.py isolde_benchmarks.json"
+
+Every result records the benchmark name, the test case, the number of items
+processed, the wall-clock time (in seconds) of each repeat and the median.
+The simulation benchmarks use a system of unbonded particles held by
+harmonic position restraints, so that they time the ISOLDE thread handler
+rather than the force field.
+'''
+
+import os
+import json
+from time import perf_counter, sleep
+import numpy
+
+DEMO_MODELS = {
+    '2b9r': ('2b9r', 'before.cif'),
+    '3io0': ('3io0', 'before.pdb'),
+    '6out': ('6out', '6out.pdb'),
+}
+
+def _demo_path(*parts):
+    return os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))),
+        'demo_data', *parts)
+
+class _Results:
+    def __init__(self, repeats, log=None):
+        self.repeats = repeats
+        self.records = []
+        self._log = log
+
+    def time(self, name, case, n, func, setup=None, repeats=None):
+        '''
+        Times func() (after setup(), which isn't timed) repeats times. If
+        setup returns a value, it is passed to func.
+        '''
+        times = []
+        for _ in range(repeats or self.repeats):
+            arg = setup() if setup is not None else None
+            start = perf_counter()
+            if setup is not None:
+                func(arg)
+            else:
+                func()
+            times.append(perf_counter()-start)
+        self.add(name, case, n, times)
+        return times
+
+    def add(self, name, case, n, times, **extra):
+        med = float(numpy.median(times))
+        rec = {
+            'benchmark': name,
+            'case': case,
+            'n': int(n),
+            'times': [float(t) for t in times],
+            'median': med,
+            'per_item_us': med/n*1e6 if n else None,
+        }
+        rec.update(extra)
+        self.records.append(rec)
+        if self._log is not None:
+            self._log('{:<32s} {:<8s} n={:<9d} {:10.4f} s'.format(name, case, int(n), med))
+
+
+def open_demo_models(session, names=DEMO_MODELS.keys()):
+    from chimerax.core.commands import run
+    models = {}
+    for name in names:
+        d, f = DEMO_MODELS[name]
+        m = run(session, 'open {}'.format(_demo_path(d, f)), log=False)[0]
+        models[name] = m
+    return models
+
+def build_synthetic_model(session, base, target_atoms=1000000):
+    '''
+    Combine translated copies of base until the result has at least
+    target_atoms atoms.
+    '''
+    n_copies = max(1, -(-target_atoms // base.num_atoms))
+    extent = numpy.ptp(base.atoms.coords, axis=0) + 10
+    side = int(numpy.ceil(n_copies**(1/3)))
+    copies = []
+    for i in range(n_copies):
+        c = base.copy()
+        offset = extent*numpy.array([i % side, (i//side) % side, i//(side*side)])
+        c.atoms.coords = c.atoms.coords + offset
+        copies.append(c)
+    from chimerax.atomic.struct_edit import combine
+    model = combine(copies, name='synthetic benchmark')
+    for c in copies:
+        c.delete()
+    session.models.add([model])
+    return model
+
+
+def bench_interpolator(results, n_points=1000000):
+    from ..interpolation.interp import RegularGridInterpolator
+    for dim, length in ((2, 361), (3, 73), (4, 37)):
+        grid = numpy.random.rand(*([length]*dim))
+        interp = RegularGridInterpolator(dim, [length]*dim, [0]*dim, [1]*dim, grid)
+        data = numpy.random.rand(n_points, dim)
+        results.time('interpolate', '{}d'.format(dim), n_points,
+            lambda: interp.interpolate(data))
+
+def bench_dihedrals(results, session, case, model):
+    from .. import session_extensions as sx
+    pdm = sx.get_proper_dihedral_mgr(session)
+    residues = model.residues
+    # Only the first call finds the atoms; after that the dihedrals are
+    # looked up
+    start = perf_counter()
+    pdm.create_all_dihedrals(residues)
+    results.add('dihedral discovery', case, len(residues), [perf_counter()-start])
+    results.time('dihedral lookup', case, len(residues),
+        lambda: [pdm.get_dihedrals(residues, name) for name in ('phi', 'psi', 'omega')])
+
+def bench_validation(results, session, case, model):
+    from .. import session_extensions as sx
+    residues = model.residues
+    rama_m = sx.get_ramachandran_mgr(session)
+    rota_m = sx.get_rotamer_mgr(session)
+    start = perf_counter()
+    ramas = rama_m.get_ramas(residues)
+    results.add('rama creation', case, len(residues), [perf_counter()-start])
+    results.time('rama validation', case, len(ramas), lambda: rama_m.validate(ramas))
+    start = perf_counter()
+    rotamers = rota_m.get_rotamers(residues)
+    results.add('rotamer creation', case, len(residues), [perf_counter()-start])
+    results.time('rotamer validation', case, len(rotamers),
+        lambda: rota_m.validate_rotamers(rotamers))
+
+def bench_restraints(results, session, case, model):
+    from .. import session_extensions as sx
+    atoms = model.atoms
+    heavy = atoms[atoms.element_names != 'H']
+    ca = atoms[atoms.names == 'CA']
+
+    def make_position_restraints(*_):
+        return sx.get_position_restraint_mgr(model).add_restraints(heavy)
+    def make_distance_restraints(*_):
+        return sx.get_distance_restraint_mgr(model).add_restraints(ca[:-1], ca[1:])
+
+    for name, make, n in (('position', make_position_restraints, len(heavy)),
+            ('distance', make_distance_restraints, len(ca)-1)):
+        def setup():
+            # Start each repeat with no manager
+            mgr = (sx.get_position_restraint_mgr(model, create=False) if name=='position'
+                else sx.get_distance_restraint_mgr(model, create=False))
+            if mgr is not None:
+                session.models.close([mgr])
+        results.time('{} restraint creation'.format(name), case, n,
+            make, setup=setup)
+        def teardown_setup():
+            make()
+            return (sx.get_position_restraint_mgr(model) if name=='position'
+                else sx.get_distance_restraint_mgr(model))
+        results.time('{} restraint deletion'.format(name), case, n,
+            lambda mgr: session.models.close([mgr]), setup=teardown_setup)
+
+    # Change tracking: edit every restraint, then collect and dispatch the
+    # changes as happens at the start of each graphics frame
+    prs = make_position_restraints()
+    tracker = session.isolde_changes
+    tracker.clear()
+    def edit_and_collect():
+        prs.targets = prs.targets + 0.01
+        prs.spring_constants = prs.spring_constants * 1.01
+        tracker._get_and_clear_changes()
+    results.time('change tracker', case, 2*len(prs), edit_and_collect)
+
+
+def _restrained_particle_context(coords, platform_name):
+    from simtk import openmm, unit
+    system = openmm.System()
+    f = openmm.CustomExternalForce('0.5*k*((x-x0)^2+(y-y0)^2+(z-z0)^2)')
+    for p in ('k', 'x0', 'y0', 'z0'):
+        f.addPerParticleParameter(p)
+    coords_nm = coords/10
+    for c in coords_nm:
+        i = system.addParticle(12.0)
+        f.addParticle(i, (1000.0, *c))
+    system.addForce(f)
+    integrator = openmm.LangevinIntegrator(100*unit.kelvin, 5/unit.picosecond,
+        0.002*unit.picosecond)
+    platform = openmm.Platform.getPlatformByName(platform_name)
+    context = openmm.Context(system, integrator, platform)
+    context.setPositions(coords_nm)
+    context.setVelocitiesToTemperature(100*unit.kelvin)
+    return context, integrator
+
+def bench_thread_handler(results, case, coords, params, n_frames=20):
+    from ..openmm.openmm_interface import OpenMM_Thread_Handler
+    context, integrator = _restrained_particle_context(coords, params.platform)
+    th = OpenMM_Thread_Handler(context, params)
+    try:
+        th.min_thread_period = 0
+        steps = params.sim_steps_per_gui_update
+        n = len(coords)
+        def step():
+            th.step(steps)
+            th.finalize_thread()
+        results.time('thread handler step', case, n, step)
+        results.time('thread handler copy out', case, n, lambda: th.get_coords())
+        results.time('thread handler copy out f32', case, n,
+            lambda: th.get_coords(indices=numpy.arange(n), dtype=numpy.float32))
+        # Free-running, as in an interactive simulation
+        th.clear_stage_timings()
+        th.step_continuous(steps)
+        frames = 0
+        start = perf_counter()
+        while frames < n_frames:
+            if th.latest_coords() is not None:
+                frames += 1
+            else:
+                sleep(0.0005)
+        elapsed = perf_counter()-start
+        th.finalize_thread()
+        n_sampled, stages = th.stage_timings((50, 90, 99))
+        results.add('thread handler continuous', case, n, [elapsed/n_frames],
+            stages_ms={k: [float(x) for x in v] for k, v in stages.items()},
+            frames_sampled=int(n_sampled))
+    finally:
+        th.delete()
+        del context, integrator
+
+
+def run_benchmarks(session, models=tuple(DEMO_MODELS.keys()), synthetic_atoms=1000000,
+        output=None, repeats=3, simulation=True, log=True):
+    '''
+    Run the benchmark suite.
+
+    Args:
+        * models:
+            - names of the demo_data models to use
+        * synthetic_atoms:
+            - approximate size of the synthetic case built from copies of 6out
+              (0 to skip it)
+        * output:
+            - optional path for a JSON file of the results
+        * repeats:
+            - number of times each timed operation is repeated
+        * simulation:
+            - include the OpenMM thread handler benchmarks
+        * log:
+            - write each result to the ChimeraX log as it completes
+    '''
+    import platform
+    from .. import __version__
+    results = _Results(repeats, session.logger.info if log else None)
+    bench_interpolator(results)
+    cases = open_demo_models(session, models)
+    if synthetic_atoms:
+        base = cases.get('6out', None) or open_demo_models(session, ['6out'])['6out']
+        cases['synthetic'] = build_synthetic_model(session, base, synthetic_atoms)
+    if simulation:
+        from ..openmm.sim_param_mgr import SimParams
+        params = SimParams()
+    for case, m in cases.items():
+        bench_dihedrals(results, session, case, m)
+        bench_validation(results, session, case, m)
+        bench_restraints(results, session, case, m)
+        if simulation:
+            bench_thread_handler(results, case, m.atoms.coords, params)
+    info = {
+        'isolde_version': __version__,
+        'python': platform.python_version(),
+        'machine': platform.machine(),
+        'system': platform.platform(),
+        'cpu_count': os.cpu_count(),
+        'numpy': numpy.__version__,
+        'cases': {case: {'atoms': int(m.num_atoms), 'residues': int(m.num_residues)}
+            for case, m in cases.items()},
+    }
+    if simulation:
+        from simtk import openmm
+        info['openmm'] = openmm.Platform.getOpenMMVersion()
+        info['platform'] = params.platform
+    out = {'info': info, 'results': results.records}
+    session.models.close(list(cases.values()))
+    if output is not None:
+        with open(output, 'wt') as f:
+            json.dump(out, f, indent=1)
+    return out
+
+if __name__.startswith('ChimeraX_sandbox'):
+    import sys
+    from chimerax.isolde.tests.benchmark_suite import run_benchmarks
+    run_benchmarks(session, output=sys.argv[1] if len(sys.argv) > 1 else None)
@@ -0,0 +1,66 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+
+
+import numpy
+
+def test_round_trip():
+    from ..remote_control.websockets import binary_frames as bf
+    rng = numpy.random.RandomState(0)
+    arrays = {
+        'coords': rng.rand(17, 3),
+        'coords32': rng.rand(5, 3).astype(numpy.float32),
+        'indices': numpy.arange(11, dtype=numpy.int32),
+        'big': numpy.arange(6, dtype=numpy.int64).reshape(1, 2, 3),
+        'bytes': numpy.array([0, 7, 255], numpy.uint8),
+        'enabled': numpy.array([True, False, True]),
+        'scalar': numpy.array(2.5),
+        'empty': numpy.empty((0, 3)),
+        'big_endian': numpy.arange(4, dtype='>f8'),
+        'longest_name_16c': numpy.array([1, 2], numpy.uint16),
+    }
+    meta = {'model': [1, 2], 'kind': 'distance'}
+    frame = bf.encode(bf.SET_COORDS, 42, meta, arrays)
+    msg_type, request_id, meta_out, arrays_out = bf.decode(frame)
+    assert msg_type == bf.SET_COORDS
+    assert request_id == 42
+    assert meta_out == meta
+    assert set(arrays_out.keys()) == set(arrays.keys())
+    for name, arr in arrays.items():
+        out = arrays_out[name]
+        assert out.shape == arr.shape, '{}: shape {} != {}'.format(name, out.shape, arr.shape)
+        assert out.dtype == arr.dtype.newbyteorder('<'), \
+            '{}: dtype {} != {}'.format(name, out.dtype, arr.dtype)
+        assert numpy.array_equal(out, arr), '{} changed in transit'.format(name)
+
+def test_no_arrays():
+    from ..remote_control.websockets import binary_frames as bf
+    msg_type, request_id, meta, arrays = bf.decode(bf.encode(bf.GET_COORDS, 3))
+    assert (msg_type, request_id, meta, arrays) == (bf.GET_COORDS, 3, {}, {})
+
+def test_bad_frames():
+    from ..remote_control.websockets import binary_frames as bf
+    frame = bf.encode(bf.REPLY, 1, None, {'x': numpy.arange(10.)})
+    for bad in (frame[:8], b'NOPE'+frame[4:], frame[:-1]):
+        try:
+            bf.decode(bad)
+        except ValueError:
+            continue
+        raise AssertionError('Bad frame was decoded')
+    try:
+        bf.encode(bf.REPLY, 1, None, {'s': numpy.array(['a'])})
+    except TypeError:
+        pass
+    else:
+        raise AssertionError('String array was encoded')
+
+def run_all():
+    test_round_trip()
+    test_no_arrays()
+    test_bad_frames()
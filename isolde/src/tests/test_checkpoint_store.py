@@ -0,0 +1,121 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+
+
+import ctypes
+import numpy
+from ..molobject import c_function, pointer
+
+class StoreTester:
+    '''
+    Pushes coordinates into a bare C++ checkpoint store (no model or
+    simulation needed), keeping its own list of what each held snapshot
+    should be. Like CheckpointStore, drops the second-oldest snapshot once
+    there are more than max_levels.
+    '''
+    def __init__(self, n_atoms, max_levels, seed):
+        f = c_function('checkpoint_store_new',
+            args=(ctypes.c_size_t, ctypes.c_size_t, ctypes.c_bool),
+            ret=ctypes.c_void_p)
+        self._c_pointer = ctypes.c_void_p(f(n_atoms, max_levels, False))
+        self.n_atoms = n_atoms
+        self.max_levels = max_levels
+        self.rng = numpy.random.RandomState(seed)
+        self.expected = []
+
+    def __del__(self):
+        c_function('checkpoint_store_delete', args=(ctypes.c_void_p,))(self._c_pointer)
+
+    def size(self):
+        f = c_function('checkpoint_store_size', args=(ctypes.c_void_p,),
+            ret=ctypes.c_size_t)
+        return f(self._c_pointer)
+
+    def push(self, coords):
+        f = c_function('checkpoint_store_push',
+            args=(ctypes.c_void_p, ctypes.POINTER(ctypes.c_double), ctypes.c_void_p))
+        coords = numpy.ascontiguousarray(coords, numpy.double)
+        f(self._c_pointer, pointer(coords), None)
+        self.expected.append(coords)
+        if len(self.expected) > self.max_levels:
+            del self.expected[1]
+
+    def get(self, i):
+        f = c_function('checkpoint_store_get',
+            args=(ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_double),
+                ctypes.c_void_p))
+        coords = numpy.empty((self.n_atoms, 3), numpy.double)
+        f(self._c_pointer, i, pointer(coords), None)
+        return coords
+
+    def truncate(self, n):
+        f = c_function('checkpoint_store_truncate', args=(ctypes.c_void_p, ctypes.c_size_t))
+        f(self._c_pointer, n)
+        del self.expected[n:]
+
+    def random_coords(self):
+        # Multiples of 1/1024, so that every difference between snapshots is
+        # exactly representable in float32
+        return self.rng.randint(-50000, 50000, (self.n_atoms, 3))/1024
+
+    def moved(self, coords, fraction):
+        coords = coords.copy()
+        moving = self.rng.rand(len(coords)) < fraction
+        coords[moving] += self.rng.randint(-2000, 2001, (moving.sum(), 3))/1024
+        return coords
+
+    def check(self, tolerance=0):
+        assert self.size() == len(self.expected), \
+            'Store holds {} snapshots, not {}'.format(self.size(), len(self.expected))
+        for i, e in enumerate(self.expected):
+            err = numpy.abs(self.get(i)-e).max()
+            assert err <= tolerance, 'Snapshot {} is out by {}'.format(i, err)
+
+
+def test_exact_restore():
+    # 150 atoms, so the last word of the change mask is only partly used
+    t = StoreTester(150, 10, seed=3)
+    coords = t.random_coords()
+    for i in range(8):
+        t.push(coords)
+        coords = t.moved(coords, 0.3)
+    t.check()
+    # Nothing moved: an empty delta
+    t.push(t.expected[-1])
+    t.check()
+
+def test_restore_after_eviction():
+    t = StoreTester(150, 3, seed=5)
+    coords = t.random_coords()
+    for i in range(10):
+        t.push(coords)
+        t.check()
+        coords = t.moved(coords, 0.5)
+    # Back to the second snapshot, and on from there
+    t.truncate(2)
+    t.check()
+    coords = t.moved(t.expected[-1], 0.5)
+    for i in range(4):
+        t.push(coords)
+        t.check()
+        coords = t.moved(coords, 0.5)
+    # The first snapshot is never evicted
+    t.truncate(1)
+    t.check()
+
+def test_error_does_not_accumulate():
+    # Each difference is rounded to float32 from the stored (not the true)
+    # previous snapshot, so 50 snapshots on the error is still that of a
+    # single rounding
+    t = StoreTester(100, 50, seed=11)
+    coords = t.rng.rand(100, 3)*100
+    for i in range(50):
+        t.push(coords)
+        coords = coords + t.rng.normal(scale=0.3, size=coords.shape)
+    t.check(tolerance=10*numpy.finfo(numpy.float32).eps)
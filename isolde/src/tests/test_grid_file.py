@@ -0,0 +1,97 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+
+
+import os
+import numpy
+from . import make_interpolator
+
+class GridFileTester:
+    '''
+    Saves a random 3D grid into a scratch directory, where the tests write
+    their own good and damaged copies of it. Mappings are shared by file
+    name, so every file gets a new name. Call close() when done, which
+    releases the mappings before removing the directory.
+    '''
+    # Offset of the version number in the header, after the 8-byte magic
+    VERSION_OFFSET = 8
+
+    def __init__(self, seed=13):
+        from tempfile import TemporaryDirectory
+        self._dir = TemporaryDirectory()
+        rng = numpy.random.RandomState(seed)
+        self.original = make_interpolator(rng.rand(13, 7, 5), (-1., 0., 2.5),
+            (1., 3., 4.))
+        self.good = self.filename('good.grid')
+        self.original.save(self.good)
+        with open(self.good, 'rb') as f:
+            self.data = f.read()
+
+    def filename(self, name):
+        return os.path.join(self._dir.name, name)
+
+    def write(self, name, contents):
+        filename = self.filename(name)
+        with open(filename, 'wb') as f:
+            f.write(contents)
+        return filename
+
+    def map(self, filename):
+        from ..interpolation.interp import RegularGridInterpolator
+        return RegularGridInterpolator.from_file(filename)
+
+    def expect_rejected(self, filename, message):
+        try:
+            self.map(filename)
+        except RuntimeError as e:
+            assert message in str(e), '{}: {}'.format(os.path.basename(filename), e)
+        else:
+            raise AssertionError('{} was mapped'.format(os.path.basename(filename)))
+
+    def round_trip(self):
+        o = self.original
+        mapped = self.map(self.good)
+        assert mapped.dim == o.dim
+        assert numpy.array_equal(mapped.axis_lengths, o.axis_lengths)
+        assert numpy.array_equal(mapped.min, o.min)
+        assert numpy.array_equal(mapped.max, o.max)
+        assert numpy.array_equal(mapped.values, o.values)
+        points = o.min + numpy.random.RandomState(1).rand(100, o.dim)*(o.max-o.min)
+        assert numpy.array_equal(mapped.interpolate(points), o.interpolate(points))
+        # A second interpolator on the same file shares the mapping
+        assert numpy.array_equal(self.map(self.good).values, o.values)
+
+    def bad_files_rejected(self):
+        data = self.data
+        self.expect_rejected(self.write('truncated_data.grid', data[:-8]), 'truncated or corrupt')
+        self.expect_rejected(self.write('truncated_header.grid', data[:20]), 'too short')
+        self.expect_rejected(self.write('empty.grid', b''), 'too short')
+        off = self.VERSION_OFFSET
+        version = numpy.frombuffer(data, numpy.uint32, 1, off)[0]
+        bad = data[:off] + numpy.uint32(version+1).tobytes() + data[off+4:]
+        self.expect_rejected(self.write('wrong_version.grid', bad), 'different version')
+        self.expect_rejected(self.write('not_grid.grid', b'NOTAGRID'+data[8:]), 'not a grid file')
+        self.expect_rejected(self.filename('missing.grid'), 'Could not open')
+        # None of which should upset the good file
+        assert numpy.array_equal(self.map(self.good).values, self.original.values)
+
+    def close(self):
+        import gc
+        self.original = None
+        gc.collect()
+        self._dir.cleanup()
+
+
+def test_grid_files():
+    t = GridFileTester()
+    try:
+        t.round_trip()
+        t.bad_files_rejected()
+    finally:
+        t.close()
@@ -0,0 +1,172 @@
+# @Author: Tristan Croll <tic20>
+# @Date:   14-Oct-2026
+# @Email:  tic20@cam.ac.uk
+# @Last modified by:   tic20
+# @Last modified time: 14-Oct-2026
+# @License: Free for non-commercial use (see license.pdf)
+# @Copyright:2016-2019 Tristan Croll
+
+
+
+import numpy
+from . import make_interpolator
+
+def bilinear(x, y):
+    return 1 + 2*x - 3*y + 0.5*x*y
+
+def bilinear_gradient(x, y):
+    return numpy.array([2 + 0.5*y, -3 + 0.5*x])
+
+def bilinear_interpolator():
+    min_vals, max_vals = (0., -1.), (5., 4.)
+    x = numpy.linspace(min_vals[0], max_vals[0], 11)
+    y = numpy.linspace(min_vals[1], max_vals[1], 21)
+    interp = make_interpolator(bilinear(*numpy.meshgrid(x, y, indexing='ij')),
+        min_vals, max_vals)
+    return interp, x, y
+
+def central_difference(interp, p, axis, h=1e-6):
+    d = numpy.zeros(len(p))
+    d[axis] = h
+    return (interp.interpolate(numpy.array([p+d]))[0]
+        - interp.interpolate(numpy.array([p-d]))[0])/(2*h)
+
+def test_bilinear_gradient():
+    # Multilinear interpolation of a bilinear function is exact, so its
+    # gradient should be too - including on cell boundaries and grid points
+    interp, x, y = bilinear_interpolator()
+    points = numpy.array([
+        [1.23, 0.77],
+        [3.9, -0.61],
+        [x[4], 1.37],
+        [2.11, y[10]],
+        [x[6], y[13]],
+    ])
+    values, gradients = interp.interpolate_with_gradient(points)
+    assert numpy.allclose(values, bilinear(points[:,0], points[:,1]), atol=1e-12)
+    assert numpy.allclose(values, interp.interpolate(points), atol=1e-12)
+    for p, g in zip(points, gradients):
+        assert numpy.allclose(g, bilinear_gradient(*p), atol=1e-12), \
+            'Gradient at {}: {}'.format(p, g)
+
+def test_random_grid_gradient(seed=7):
+    rng = numpy.random.RandomState(seed)
+    n = numpy.array((9, 8, 7))
+    min_vals, max_vals = numpy.array((-1., 0., 2.)), numpy.array((1., 3.5, 5.))
+    interp = make_interpolator(rng.rand(*n), min_vals, max_vals)
+    steps = (max_vals-min_vals)/(n-1)
+
+    cells = numpy.array([rng.randint(0, ni-1, 20) for ni in n]).T
+    points = min_vals + (cells + 0.1 + 0.8*rng.rand(20, 3))*steps
+    _, gradients = interp.interpolate_with_gradient(points)
+    for p, g in zip(points, gradients):
+        for axis in range(3):
+            fd = central_difference(interp, p, axis)
+            assert abs(fd-g[axis]) < 1e-6, \
+                'Gradient at {} along axis {}: {} vs. {}'.format(p, axis, g[axis], fd)
+
+    # On a cell boundary the surface has a kink. The gradient across it
+    # comes from the cell above, so should match a forward difference.
+    h = 1e-6
+    p = numpy.array([min_vals[0]+4*steps[0], 1.3, 3.3])
+    g = interp.interpolate_with_gradient(numpy.array([p]))[1][0]
+    v = lambda q: interp.interpolate(numpy.array([q]))[0]
+    d = numpy.array([h, 0, 0])
+    forward = (v(p+d)-v(p))/h
+    backward = (v(p)-v(p-d))/h
+    assert abs(forward-backward) > 1e-3, 'No kink at the test point'
+    assert abs(forward-g[0]) < 1e-6
+    for axis in (1, 2):
+        assert abs(central_difference(interp, p, axis)-g[axis]) < 1e-6
+
+def test_periodic_gradient():
+    interp, _, _ = bilinear_interpolator()
+    periods = numpy.array([4., 0.])
+    inside = numpy.array([[1.23, 0.77], [3.9, -0.61]])
+    outside = inside + numpy.array([[4., 0.], [-8., 0.]])
+    v_in, g_in = interp.interpolate_with_gradient(inside, periods)
+    v_out, g_out = interp.interpolate_with_gradient(outside, periods)
+    assert numpy.allclose(v_in, v_out, atol=1e-12)
+    assert numpy.allclose(g_in, g_out, atol=1e-12)
+
+
+class RamaBiasTester:
+    '''
+    Five massless particles whose first and last four atoms form a phi and
+    psi dihedral, under the general-case Ramachandran bias.
+    '''
+    def __init__(self, session, k=10.0):
+        from simtk import openmm
+        from ..openmm.openmm_interface import OpenMM_Thread_Handler
+        from ..openmm.sim_param_mgr import SimParams
+        from ..openmm.custom_forces import GridBiasForce
+        from .. import session_extensions as sx
+        rama_mgr = sx.get_ramachandran_mgr(session)
+
+        system = openmm.System()
+        for i in range(5):
+            system.addParticle(0)
+        force = self.force = GridBiasForce(5)
+        system.addForce(force)
+        self.context = openmm.Context(system, openmm.VerletIntegrator(0.001),
+            openmm.Platform.getPlatformByName('Reference'))
+        th = self.thread_handler = OpenMM_Thread_Handler(self.context, SimParams())
+        th.set_grid_bias_force(force)
+        grid = th.add_grid_bias_grid(
+            rama_mgr._log_interpolator_pointer(int(rama_mgr.RamaCase.GENERAL)))
+        th.add_grid_bias_terms(grid, [[[0,1,2,3],[1,2,3,4]]], k)
+
+    def bias_energy(self, positions):
+        th = self.thread_handler
+        self.context.setPositions(positions)
+        th.step(1)
+        th.finalize_thread()
+        return th.last_grid_bias_energy
+
+    def check_forces(self, phi, psi, h=1e-6):
+        positions = backbone(phi, psi)
+        assert self.bias_energy(positions) != 0
+        # Loaded by the step, at these positions
+        forces = numpy.array([self.force.getParticleParameters(i)[1][1:4]
+            for i in range(5)])
+        for i in range(5):
+            for axis in range(3):
+                p = positions.copy()
+                p[i, axis] += h
+                ep = self.bias_energy(p)
+                p[i, axis] -= 2*h
+                em = self.bias_energy(p)
+                fd = -(ep-em)/(2*h)
+                f = forces[i, axis]
+                assert abs(fd-f) < 1e-4*max(1, abs(f)), \
+                    'phi={}, psi={}: force on {} along axis {} is {} vs. {}'.format(
+                        phi, psi, i, axis, f, fd)
+
+    def delete(self):
+        self.thread_handler.delete()
+        self.context = None
+
+def place(a, b, c, bond, angle, torsion):
+    bc = (c-b)/numpy.linalg.norm(c-b)
+    n = numpy.cross(b-a, bc)
+    n /= numpy.linalg.norm(n)
+    m = numpy.cross(n, bc)
+    return c + bond*(-numpy.cos(angle)*bc
+        + numpy.sin(angle)*(numpy.cos(torsion)*m + numpy.sin(torsion)*n))
+
+def backbone(phi, psi):
+    from math import radians
+    a = numpy.array([0., 0., 0.])
+    b = numpy.array([0.133, 0., 0.])
+    c = numpy.array([0.2, 0.12, 0.])
+    d = place(a, b, c, 0.152, radians(111), radians(phi))
+    e = place(b, c, d, 0.133, radians(116), radians(psi))
+    return numpy.array([a, b, c, d, e])
+
+def test_rama_bias_forces(session):
+    tester = RamaBiasTester(session)
+    try:
+        for phi, psi in ((-63., -41.), (-120., 130.), (75., 20.)):
+            tester.check_forces(phi, psi)
+    finally:
+        tester.delete()
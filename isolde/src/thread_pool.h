@@ -0,0 +1,174 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_THREAD_POOL
+#define ISOLDE_THREAD_POOL
+
+#include <cstddef>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <algorithm>
+
+namespace isolde
+{
+
+/*! Minimal fork-join pool for data-parallel loops.
+ *
+ *  parallel_for() hands out task indices 0..n-1 to the worker threads and
+ *  the calling thread, and returns once all are complete. Tasks are expected
+ *  to write to disjoint parts of their output, so results are independent of
+ *  the order in which they happen to run. The first exception thrown by any
+ *  task is rethrown on the calling thread.
+ *
+ *  Only one parallel_for() runs at a time: concurrent callers are simply
+ *  serialised. Calls made from inside a task run serially on that thread.
+ */
+class Thread_Pool
+{
+public:
+    //! Shared pool, created on first use with one thread per core.
+    static Thread_Pool& instance()
+    {
+        static Thread_Pool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return pool;
+    }
+
+    Thread_Pool(size_t n_workers)
+    {
+        for (size_t i=0; i<n_workers; ++i)
+            _workers.emplace_back(&Thread_Pool::_worker_loop, this);
+    }
+
+    ~Thread_Pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _work_available.notify_all();
+        for (auto& w: _workers)
+            w.join();
+    }
+
+    //! Number of threads (including the caller) that take part in a loop
+    size_t num_threads() const { return _workers.size()+1; }
+
+    void parallel_for(size_t n, const std::function<void(size_t)>& task)
+    {
+        if (n == 0)
+            return;
+        if (n == 1 || _workers.empty() || _in_task()) {
+            for (size_t i=0; i<n; ++i)
+                task(i);
+            return;
+        }
+        std::lock_guard<std::mutex> job_lock(_job_mutex);
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _task = &task;
+            _n_tasks = n;
+            _next_task = 0;
+            _n_done = 0;
+            _error = nullptr;
+            ++_job_id;
+        }
+        _work_available.notify_all();
+        _run_tasks();
+        std::unique_lock<std::mutex> lock(_mutex);
+        _job_done.wait(lock, [this]{ return _n_done == _n_tasks; });
+        _task = nullptr;
+        if (_error)
+            std::rethrow_exception(_error);
+    }
+
+    /*! Split [0, n) into contiguous chunks of at least min_chunk items (at
+     *  most a few per thread), and call fn(start, end) on each in parallel.
+     */
+    void parallel_chunks(size_t n, size_t min_chunk,
+        const std::function<void(size_t, size_t)>& fn)
+    {
+        size_t chunk = std::max(min_chunk, n/(4*num_threads())+1);
+        size_t n_chunks = (n+chunk-1)/chunk;
+        parallel_for(n_chunks, [&](size_t c) {
+            size_t start = c*chunk;
+            fn(start, std::min(n, start+chunk));
+        });
+    }
+
+private:
+    std::vector<std::thread> _workers;
+    std::mutex _job_mutex; // serialises callers of parallel_for()
+    std::mutex _mutex;
+    std::condition_variable _work_available;
+    std::condition_variable _job_done;
+    const std::function<void(size_t)>* _task = nullptr;
+    size_t _n_tasks = 0;
+    size_t _next_task = 0;
+    size_t _n_done = 0;
+    size_t _job_id = 0;
+    std::exception_ptr _error;
+    bool _stop = false;
+
+    static bool& _in_task()
+    {
+        static thread_local bool flag = false;
+        return flag;
+    }
+
+    // Claim and run tasks from the current job until none are left
+    void _run_tasks()
+    {
+        _in_task() = true;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_task != nullptr && _next_task < _n_tasks)
+        {
+            size_t i = _next_task++;
+            auto task = _task;
+            lock.unlock();
+            try {
+                (*task)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> elock(_mutex);
+                if (!_error)
+                    _error = std::current_exception();
+            }
+            lock.lock();
+            if (++_n_done == _n_tasks)
+                _job_done.notify_all();
+        }
+        _in_task() = false;
+    }
+
+    void _worker_loop()
+    {
+        size_t last_job = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _work_available.wait(lock, [&]{ return _stop || _job_id != last_job; });
+                if (_stop)
+                    return;
+                last_job = _job_id;
+            }
+            _run_tasks();
+        }
+    }
+}; // class Thread_Pool
+
+} // namespace isolde
+
+#endif // ISOLDE_THREAD_POOL
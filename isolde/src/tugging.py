@@ -194,7 +194,7 @@ class TugAtomsMode(MouseMode):
         ref_point = self._pull_reference_point()
         pull_vector = self._offset_vector(x, y, ref_point)
         tugs = self._picked_tuggables
-        tugs.targets = self._picked_atoms.coords + pull_vector
+        self._tug_mgr.tug(tugs, self._picked_atoms.coords + pull_vector)
 
     def mouse_up(self, event):
         MouseMode.mouse_up(self, event)
@@ -234,7 +234,7 @@ class TugAtomsMode(MouseMode):
             ref_point = self._focal_atom.scene_coord
         pull_vector = self._offset_vector(x, y, ref_point)
         tugs = self._picked_tuggables
-        tugs.targets = coords + pull_vector
+        self._tug_mgr.tug(tugs, coords + pull_vector)
 
     def vr_press(self, event):
         # Virtual reality hand controller button press.
@@ -257,7 +257,7 @@ class TugAtomsMode(MouseMode):
         ref_point = self._pull_reference_point()
         pull_vector = event.tip_position - ref_point
         tugs = self._picked_tuggables
-        tugs.targets = self._picked_atoms.coords + pull_vector
+        self._tug_mgr.tug(tugs, self._picked_atoms.coords + pull_vector)
         # TODO: Apply torgue if there are multiple atoms.
 
     def vr_release(self, release):
@@ -276,16 +276,33 @@ class HapticTugger():
         self.tugging = False
 
         self.tug_atom = None
+        # True if the device is tugging through its direct link to the
+        # simulation, rather than via update_target() on every frame
+        self._linked = False
 
-    def start_tugging(self, atom):
+    def start_tugging(self, atom, spring_constant=None):
         self.tug_atom = atom
         self.tugging = True
-        self.update_target()
+        sm = getattr(self.session.isolde, 'sim_manager', None)
+        if sm is not None and sm.sim_running:
+            hh = self._hh
+            if spring_constant is None:
+                spring_constant = sm.sim_params.haptic_spring_constant
+                if hasattr(spring_constant, 'value_in_unit'):
+                    spring_constant = spring_constant.value_in_unit(defaults.OPENMM_SPRING_UNIT)
+                # kJ mol-1 nm-2 to kJ mol-1 A-2
+                spring_constant /= 100
+            hh.setTugSpringConstant(self.index, spring_constant)
+            sm.attach_haptic_device(hh.haptic_link(self.index, atom.structure), atom)
+            self._linked = True
+        else:
+            self.update_target()
         #~ self._hh.setTargetPosition(self.index, *atom.coord, scene_coords = True)
         self._hh.startTugging(self.index)
 
     # Set the target position of the device to the current atom position, and
-    # return the device position as the target for the atom
+    # return the device position as the target for the atom. Not needed while
+    # tugging through the simulation link.
     def update_target(self):
         atom_xyz = self.tug_atom.coord
         pointer_xyz = self._hh.getPosition(self.index, scene_coords = True)
@@ -296,6 +313,9 @@ class HapticTugger():
         self._hh.stopTugging(self.index)
         self.tugging = False
         self.tug_atom = None
+        # The haptics thread tells the simulation to let go; the link stays
+        # attached until the next start_tugging() or the end of the simulation
+        self._linked = False
 
     def __del__(self):
         self.cleanup()
@@ -28,6 +28,12 @@ namespace util
 
     }
 
+    //! Exact comparison of two coordinates
+    inline bool coords_equal(const atomstruct::Coord& a, const atomstruct::Coord& b)
+    {
+        return a[0]==b[0] && a[1]==b[1] && a[2]==b[2];
+    }
+
 
     inline double wrapped_angle(const double &angle) { return remainder(angle, TWO_PI); }
     inline double wrapped_angle_deg(const double &angle) { return remainder(angle, 360.0); }
@@ -13,6 +13,7 @@
 #define PYINSTANCE_EXPORT
 
 #include "rama.h"
+#include "../interpolation/grid_file.h"
 #include <pyinstance/PythonInstance.instantiate.h>
 
 template class pyinstance::PythonInstance<isolde::Rama>;
@@ -38,17 +39,20 @@ Rama::Rama(Residue* residue, ProperDihedralMgr *dmgr, RamaMgr *rmgr)
 
 Dihedral* Rama::omega()
 {
-    _omega = (_omega != nullptr) ? _omega : _dmgr->get_dihedral(_residue, OMEGA_STR);
+    if (_omega == nullptr && (_omega = _dmgr->get_dihedral(_residue, OMEGA_STR)) != nullptr)
+        _rmgr->_dependents.add(_omega, this);
     return _omega;
 }
 Dihedral* Rama::phi()
 {
-    _phi = (_phi != nullptr) ? _phi : _dmgr->get_dihedral(_residue, PHI_STR);
+    if (_phi == nullptr && (_phi = _dmgr->get_dihedral(_residue, PHI_STR)) != nullptr)
+        _rmgr->_dependents.add(_phi, this);
     return _phi;
 }
 Dihedral* Rama::psi()
 {
-    _psi = (_psi != nullptr) ? _psi : _dmgr->get_dihedral(_residue, PSI_STR);
+    if (_psi == nullptr && (_psi = _dmgr->get_dihedral(_residue, PSI_STR)) != nullptr)
+        _rmgr->_dependents.add(_psi, this);
     return _psi;
 }
 double Rama::omega_angle()
@@ -91,6 +95,44 @@ bool Rama::no_valid_dihedrals()
 }
 
 
+size_t Rama::backbone_atoms(Atom **atoms)
+{
+    size_t count = 0;
+    Dihedral *dihedrals[3] = {omega(), phi(), psi()};
+    for (auto d: dihedrals) {
+        if (d == nullptr)
+            continue;
+        for (auto a: d->atoms()) {
+            if (std::find(atoms, atoms+count, a) == atoms+count)
+                atoms[count++] = a;
+        }
+    }
+    return count;
+}
+
+bool Rama::cache_current(double threshold_sq) const
+{
+    if (!_cache_valid)
+        return false;
+    if (!_mobile)
+        return true;
+    for (size_t i=0; i<_n_cached_atoms; ++i) {
+        if (_cached_atoms[i]->coord().sqdistance(_cached_coords[i]) > threshold_sq)
+            return false;
+    }
+    return true;
+}
+
+void Rama::update_cache(double score, uint8_t r_case)
+{
+    _cached_score = score;
+    _cached_case = r_case;
+    _n_cached_atoms = backbone_atoms(_cached_atoms);
+    for (size_t i=0; i<_n_cached_atoms; ++i)
+        _cached_coords[i] = _cached_atoms[i]->coord();
+    _cache_valid = true;
+}
+
 double Rama::score()
 {
     // if (!is_valid_rama())
@@ -99,15 +141,17 @@ double Rama::score()
 }
 
 uint8_t Rama::rama_case()
+{
+    return _rmgr->rama_case(this);
+}
+
+uint8_t Rama::_static_case()
 {
     if (!is_valid_rama())
         return _rmgr->CASE_NONE;
     const ResName &name = _residue->name();
-    if (name == "PRO") {
-        if (std::abs(_omega->angle()) <= CIS_CUTOFF)
-            return _rmgr->CISPRO;
+    if (name == "PRO")
         return _rmgr->TRANSPRO;
-    }
     if (name == "GLY")
         return _rmgr->GLYCINE;
     if ((_psi->atoms())[3]->residue()->name() == "PRO")
@@ -138,6 +182,9 @@ bool Rama::check_for_deleted_dihedrals( const std::set<void *> &destroyed)
             _psi = nullptr;
         }
     }
+    if (_omega==nullptr || _phi==nullptr || _psi==nullptr)
+        // The cached atom pointers may no longer be valid
+        invalidate_cache();
     return (_omega==nullptr && _phi==nullptr && _psi==nullptr);
 }
 
@@ -149,6 +196,25 @@ RamaMgr::~RamaMgr()
     }
 }
 
+Memory_Usage RamaMgr::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _residue_to_rama.size();
+    u.buffer_bytes = _residue_to_rama.size()*sizeof(Rama) + memory::vector_bytes(_table)
+        + memory::vector_bytes(_color_luts);
+    u.container_bytes = memory::hash_bytes(_residue_to_rama) + _dependents.container_bytes()
+        + memory::hash_bytes(_cutoffs) + memory::hash_bytes(_colors);
+    return u;
+}
+
+Memory_Usage RamaMgr::interpolator_memory_usage() const
+{
+    std::unordered_set<const void*> seen;
+    auto u = isolde::interpolator_memory_usage(_interpolators, seen);
+    u += isolde::interpolator_memory_usage(_log_interpolators, seen);
+    return u;
+}
+
 Rama* RamaMgr::get_rama(Residue *res)
 {
     auto it = _residue_to_rama.find(res);
@@ -156,13 +222,117 @@ Rama* RamaMgr::get_rama(Residue *res)
         return it->second;
     Rama *r = new Rama(res, _mgr, this);
     _residue_to_rama[res] = r;
+    if (r->CA_atom() != nullptr)
+        _dependents.add(r->CA_atom(), r);
+    if (!_table_dirty) {
+        r->_table_index = _table.size();
+        _table.emplace_back();
+        _table.back().rama = r;
+        _resolve_entry(_table.back());
+    }
     return r;
 }
 
+void RamaMgr::topology_changed()
+{
+    _table_dirty = true;
+    for (auto &it: _residue_to_rama)
+        it.second->invalidate_cache();
+}
+
+void RamaMgr::_rebuild_table()
+{
+    _table.resize(_residue_to_rama.size());
+    size_t i = 0;
+    for (auto &it: _residue_to_rama)
+    {
+        Rama *r = it.second;
+        r->_table_index = i;
+        auto &entry = _table[i++];
+        entry.rama = r;
+        _resolve_entry(entry);
+    }
+    _table_dirty = false;
+}
+
+void RamaMgr::_resolve_entry(Rama_Entry& entry)
+{
+    Rama *r = entry.rama;
+    entry.static_case = r->_static_case();
+    if (entry.static_case == CASE_NONE)
+        return;
+    const auto &o = r->omega()->atoms();
+    const auto &ph = r->phi()->atoms();
+    const auto &ps = r->psi()->atoms();
+    if (!(o[1]==ph[0] && o[2]==ph[1] && o[3]==ph[2] &&
+          ph[1]==ps[0] && ph[2]==ps[1] && ph[3]==ps[2]))
+        throw std::logic_error("Omega, phi and psi dihedrals must form a contiguous backbone chain!");
+    entry.atoms[0] = o[0];
+    for (size_t i=0; i<4; ++i)
+        entry.atoms[i+1] = ph[i];
+    entry.atoms[5] = ps[3];
+}
+
+RamaMgr::Rama_Entry& RamaMgr::_entry(Rama *r)
+{
+    if (_table_dirty)
+        _rebuild_table();
+    auto &entry = _table[r->_table_index];
+    // Incomplete residues may since have gained their missing dihedrals
+    if (entry.static_case == CASE_NONE)
+        _resolve_entry(entry);
+    return entry;
+}
+
+uint8_t RamaMgr::_entry_case(const Rama_Entry& entry) const
+{
+    if (entry.static_case != TRANSPRO)
+        return entry.static_case;
+    auto a = entry.atoms;
+    double omega = geometry::dihedral_angle<Coord, Real>(a[0]->coord(),
+        a[1]->coord(), a[2]->coord(), a[3]->coord());
+    return (std::abs(omega) <= CIS_CUTOFF) ? CISPRO : TRANSPRO;
+}
+
+void RamaMgr::_entry_phipsi(const Rama_Entry& entry, double *phipsi) const
+{
+    auto a = entry.atoms;
+    const Coord &c1 = a[1]->coord(), &c2 = a[2]->coord(), &c3 = a[3]->coord(), &c4 = a[4]->coord();
+    phipsi[0] = geometry::dihedral_angle<Coord, Real>(c1, c2, c3, c4);
+    phipsi[1] = geometry::dihedral_angle<Coord, Real>(c2, c3, c4, a[5]->coord());
+}
+
 void RamaMgr::add_interpolator(size_t r_case,
     const size_t &dim, uint32_t *n, double *min, double *max, double *data)
 {
-    _interpolators[r_case] = RegularGridInterpolator<double>(dim, n, min, max, data);
+    size_t n_points = 1;
+    for (size_t i=0; i<dim; ++i)
+        n_points *= n[i];
+    _interpolators[r_case] = Grid_Interpolator(dim, n, min, max, data);
+    auto log_data = log_values(data, n_points, LOG_GRID_FLOOR);
+    _log_interpolators[r_case] = Grid_Interpolator(dim, n, min, max, log_data.data());
+    _config_version++;
+}
+
+void RamaMgr::add_interpolator_from_file(size_t r_case, const std::string &filename)
+{
+    auto f = shared_grid_file(filename);
+    if (f->n_grids() != 2)
+        throw std::runtime_error(filename + " is not a Ramachandran grid file!");
+    _interpolators[r_case] = Grid_Interpolator(f->dim(), f->lengths(), f->min(), f->max(),
+        f->grid<float>(0), f);
+    _log_interpolators[r_case] = Grid_Interpolator(f->dim(), f->lengths(), f->min(), f->max(),
+        f->grid<float>(1), f);
+    _config_version++;
+}
+
+void RamaMgr::write_interpolator_file(size_t r_case, const std::string &filename) const
+{
+    const auto &g = _interpolators.at(r_case);
+    const auto &lg = _log_interpolators.at(r_case);
+    std::vector<uint32_t> n(g.length().begin(), g.length().end());
+    write_grid_file<float>(filename, g.dim(), n.data(), g.min().data(), g.max().data(),
+        {g.data(), lg.data()});
 }
 
 void RamaMgr::set_colors(uint8_t *max, uint8_t *mid, uint8_t *min, uint8_t *na)
@@ -184,21 +354,40 @@ void RamaMgr::set_colors(uint8_t *max, uint8_t *mid, uint8_t *min, uint8_t *na)
         these_cutoffs[2] = 0;
         _colors[i] = colors::colormap(these_cutoffs, thecolors, 3);
     }
+    _color_luts.assign(NUM_RAMA_CASES, colors::colormap_lut());
+    for (size_t i=1; i<NUM_RAMA_CASES; ++i)
+        _color_luts[i] = colors::colormap_lut(_colors[i]);
+    colors::color_as_intcolor(_null_color, _null_intcolor);
+    _config_version++;
 }
 
 uint8_t RamaMgr::rama_case(Residue *res)
 {
-    return get_rama(res)->rama_case();
+    return rama_case(get_rama(res));
+}
+
+uint8_t RamaMgr::rama_case(Rama *r)
+{
+    return _entry_case(_entry(r));
+}
+
+uint8_t RamaMgr::packed_backbone(Rama *r, Atom **atoms)
+{
+    const auto &entry = _entry(r);
+    if (entry.static_case != CASE_NONE)
+        std::copy(entry.atoms, entry.atoms+6, atoms);
+    return entry.static_case;
 }
 
 double RamaMgr::validate(Rama *r)
 {
-    auto rcase = r->rama_case();
+    const auto &entry = _entry(r);
+    auto rcase = _entry_case(entry);
     if (rcase==CASE_NONE)
         return NO_RAMA_SCORE;
     auto &interpolator = _interpolators.at(rcase);
     double phipsi[2];
-    r->phipsi(phipsi);
+    _entry_phipsi(entry, phipsi);
     return interpolator.interpolate(phipsi);
 }
 
@@ -210,73 +399,173 @@ double RamaMgr::validate(Residue *r)
 
 void RamaMgr::validate(Rama **rama, size_t n, double *scores, uint8_t *r_cases)
 {
-    std::unordered_map<uint8_t, std::pair<std::vector<size_t>, std::vector<double> > > case_map;
-    uint8_t this_case;
-    double this_phipsi[2];
+    _validate(_interpolators, rama, n, scores, r_cases);
+}
+
+void RamaMgr::validate_incremental(Rama **rama, size_t n, double *scores, uint8_t *r_cases)
+{
+    if (!_incremental) {
+        validate(rama, n, scores, r_cases);
+        return;
+    }
+    std::vector<Rama *> stale;
+    std::vector<size_t> stale_indices;
     for (size_t i=0; i<n; ++i)
     {
-        this_case = (*rama)->rama_case();
-        *r_cases++ = this_case;
-        switch (this_case)
-        {
-            case CASE_NONE:
-                scores[i] = NO_RAMA_SCORE;
+        Rama *r = rama[i];
+        if (r->cache_current(_move_threshold_sq)) {
+            scores[i] = r->cached_score();
+            r_cases[i] = r->cached_case();
+        } else {
+            stale.push_back(r);
+            stale_indices.push_back(i);
+        }
+    }
+    size_t n_stale = stale.size();
+    if (n_stale == 0)
+        return;
+    std::vector<double> stale_scores(n_stale);
+    std::vector<uint8_t> stale_cases(n_stale);
+    validate(stale.data(), n_stale, stale_scores.data(), stale_cases.data());
+    for (size_t i=0; i<n_stale; ++i)
+    {
+        auto idx = stale_indices[i];
+        scores[idx] = stale_scores[i];
+        r_cases[idx] = stale_cases[i];
+        // Only cache complete Ramachandran cases, so that anything that
+        // might still gain a dihedral is always re-checked
+        if (stale_cases[i] != CASE_NONE)
+            stale[i]->update_cache(stale_scores[i], stale_cases[i]);
+    }
+}
+
+void RamaMgr::set_incremental(bool flag, double threshold)
+{
+    if (threshold < 0)
+        throw std::invalid_argument("Movement threshold must be non-negative!");
+    _incremental = flag;
+    _move_threshold_sq = threshold*threshold;
+    for (auto &it: _residue_to_rama)
+        it.second->invalidate_cache();
+}
+
+void RamaMgr::set_mobile_atoms(Atom **atoms, size_t n)
+{
+    std::unordered_set<Atom *> mobile(atoms, atoms+n);
+    std::unordered_set<Structure *> structures;
+    for (auto a: mobile)
+        structures.insert(a->structure());
+    Atom *bb_atoms[Rama::MAX_BACKBONE_ATOMS];
+    for (auto &it: _residue_to_rama)
+    {
+        Rama *r = it.second;
+        if (structures.find(r->residue()->structure()) == structures.end())
+            continue;
+        bool is_mobile = false;
+        size_t n_bb = r->backbone_atoms(bb_atoms);
+        for (size_t i=0; i<n_bb; ++i) {
+            if (mobile.find(bb_atoms[i]) != mobile.end()) {
+                is_mobile = true;
                 break;
-            default:
-                (*rama)->phipsi(this_phipsi);
-                auto &case_pair = case_map[this_case];
-                case_pair.first.push_back(i);
-                auto &avec = case_pair.second;
-                avec.push_back(this_phipsi[0]);
-                avec.push_back(this_phipsi[1]);
+            }
         }
-        rama++;
+        r->set_mobile(is_mobile);
+        r->invalidate_cache();
     }
-    for (auto &cit: case_map) {
-        auto &interpolator = _interpolators.at(cit.first);
-        auto &cpair = cit.second;
-        auto &case_indices = cpair.first;
-        auto &case_angles = cpair.second;
-        size_t case_n = case_indices.size();
-        std::vector<double> case_scores(case_n);
-        double *adata = case_angles.data();
-        try { //DELETEME
-            interpolator.interpolate(adata, case_n, case_scores.data());
-        } catch (std::out_of_range) {
-            std::cerr << "Bad data on case " << cit.first << ":"; //DELETEME
-            for (size_t i=0; i<case_n; i+=2) { //DELETEME
-                std::cerr << " " << adata[i] << ", " << adata[i+1] << "; "; //DELETEME
-            } std::cerr << std::endl; //DELETEME
+}
+
+void RamaMgr::clear_mobile_atoms()
+{
+    for (auto &it: _residue_to_rama)
+        it.second->set_mobile(true);
+}
+
+void RamaMgr::validate_log(Rama **rama, size_t n, double *log_scores, uint8_t *r_cases)
+{
+    _validate(_log_interpolators, rama, n, log_scores, r_cases);
+}
+
+void RamaMgr::_validate(const std::unordered_map<size_t, Grid_Interpolator>& interpolators,
+    Rama **rama, size_t n, double *scores, uint8_t *r_cases)
+{
+    // Resolving table entries may modify the table, so has to be done serially
+    std::vector<const Rama_Entry*> entries(n);
+    for (size_t i=0; i<n; ++i)
+        entries[i] = &_entry(rama[i]);
+
+    // Determine cases and measure angles in parallel chunks
+    auto& pool = Thread_Pool::instance();
+    std::vector<double> phipsi(2*n);
+    pool.parallel_chunks(n, MIN_VALIDATION_CHUNK, [&](size_t start, size_t end) {
+        for (size_t i=start; i<end; ++i)
+        {
+            uint8_t this_case = _entry_case(*entries[i]);
+            r_cases[i] = this_case;
+            if (this_case == CASE_NONE) {
+                scores[i] = NO_RAMA_SCORE;
+                continue;
+            }
+            _entry_phipsi(*entries[i], phipsi.data()+2*i);
         }
-        for (size_t i=0; i<case_n; ++i)
-            scores[case_indices[i]] = case_scores[i];
+    });
+
+    // Sort into cases, then score each case in chunks. Every chunk writes to
+    // its own slice of the output, so the result is the same as a serial run.
+    std::vector<size_t> case_indices[NUM_RAMA_CASES];
+    for (size_t i=0; i<n; ++i)
+        if (r_cases[i] != CASE_NONE)
+            case_indices[r_cases[i]].push_back(i);
+    const size_t chunk_size = MIN_VALIDATION_CHUNK;
+    struct Chunk { size_t r_case, start, end; };
+    std::vector<Chunk> chunks;
+    for (size_t c=1; c<NUM_RAMA_CASES; ++c) {
+        size_t case_n = case_indices[c].size();
+        for (size_t start=0; start<case_n; start+=chunk_size)
+            chunks.push_back({c, start, std::min(case_n, start+chunk_size)});
     }
+    pool.parallel_for(chunks.size(), [&](size_t ci) {
+        const auto &chunk = chunks[ci];
+        const auto &indices = case_indices[chunk.r_case];
+        size_t chunk_n = chunk.end-chunk.start;
+        std::vector<double> angles(2*chunk_n);
+        std::vector<double> chunk_scores(chunk_n);
+        for (size_t i=0; i<chunk_n; ++i) {
+            size_t idx = indices[chunk.start+i];
+            angles[2*i] = phipsi[2*idx];
+            angles[2*i+1] = phipsi[2*idx+1];
+        }
+        interpolators.at(chunk.r_case).interpolate(angles.data(), chunk_n, chunk_scores.data());
+        for (size_t i=0; i<chunk_n; ++i)
+            scores[indices[chunk.start+i]] = chunk_scores[i];
+    });
 }
 
 void RamaMgr::color_by_scores(double *score, uint8_t *r_case, size_t n, uint8_t *out)
 {
-    colors::intcolor default_color;
-    colors::color_as_intcolor(_null_color, default_color);
-    colors::color this_color;
-    for (size_t i=0; i<n; ++i) {
-        _color_by_score(*score++, *r_case++, this_color);
-        for (size_t j=0; j<4; ++j) {
-            *out++ = (uint8_t)(this_color[j]*255.0);
-        }
+    if (_color_luts.empty())
+        throw std::logic_error("Ramachandran colours have not been set!");
+    for (size_t i=0; i<n; ++i, out+=4) {
+        double s = score[i];
+        uint8_t c = r_case[i];
+        if (s < 0 || c == CASE_NONE)
+            colors::copy_color(_null_intcolor, *reinterpret_cast<colors::intcolor*>(out));
+        else
+            _color_luts[c].lookup(log(s), out);
     }
 } //color_by_scores
 
-void RamaMgr::_color_by_score(const double &score, const uint8_t &r_case, colors::color &color)
+void RamaMgr::color_by_log_scores(double *log_score, uint8_t *r_case, size_t n, uint8_t *out)
 {
-    if (score < 0 || r_case == CASE_NONE)
-    {
-        for(size_t i=0; i<4; ++i)
-            color[i]=_null_color[i];
-        return;
+    if (_color_luts.empty())
+        throw std::logic_error("Ramachandran colours have not been set!");
+    for (size_t i=0; i<n; ++i, out+=4) {
+        uint8_t c = r_case[i];
+        if (c == CASE_NONE)
+            colors::copy_color(_null_intcolor, *reinterpret_cast<colors::intcolor*>(out));
+        else
+            _color_luts[c].lookup(log_score[i], out);
     }
-    auto cmap = get_colors(r_case);
-    cmap->interpolate(log(score), color);
-}
+} //color_by_log_scores
 
 int32_t RamaMgr::bin_score(const double &score, uint8_t r_case)
 {
@@ -302,8 +591,30 @@ void RamaMgr::_delete_ramas(const std::set<Rama *> to_delete)
 {
     for (auto r: to_delete) {
         _residue_to_rama.erase(r->residue());
+        _unindex_rama(r);
         delete r;
     }
+    _table_dirty = true;
+}
+
+void RamaMgr::_index_rama(Rama *r)
+{
+    if (r->_CA_atom != nullptr)
+        _dependents.add(r->_CA_atom, r);
+    Dihedral *dihedrals[3] = {r->_omega, r->_phi, r->_psi};
+    for (auto d: dihedrals)
+        if (d != nullptr)
+            _dependents.add(d, r);
+}
+
+void RamaMgr::_unindex_rama(Rama *r)
+{
+    if (r->_CA_atom != nullptr)
+        _dependents.remove(r->_CA_atom, r);
+    Dihedral *dihedrals[3] = {r->_omega, r->_phi, r->_psi};
+    for (auto d: dihedrals)
+        if (d != nullptr)
+            _dependents.remove(d, r);
 }
 
 void RamaMgr::destructors_done(const std::set<void *>& destroyed)
@@ -315,18 +626,26 @@ void RamaMgr::destructors_done(const std::set<void *>& destroyed)
         return;
     }
 
+    std::set<Rama *> affected;
+    _dependents.find_dependents(destroyed, affected);
+    if (affected.empty())
+        return;
+    // Any of the tabulated atoms may be gone
+    _table_dirty = true;
     std::set<Rama *> to_delete;
     // We want to delete a Ramachandran case if its CA is gone or if all three
     // of its dihedrals are gone. Otherwise we keep it on as a partial.
-    for (auto &it: _residue_to_rama) {
-        auto r = it.second;
+    for (auto r: affected) {
         if (destroyed.find(static_cast<void *>(r->CA_atom())) != destroyed.end()) {
             to_delete.insert(r);
             continue;
         }
+        _unindex_rama(r);
         if (r->check_for_deleted_dihedrals(destroyed)) {
             to_delete.insert(r);
+            continue;
         }
+        _index_rama(r);
     }
     _delete_ramas(to_delete);
 }
@@ -15,11 +15,15 @@
 
 #include <cmath>
 #include <array>
+#include <algorithm>
+#include <unordered_set>
 
 #include "../atomic_cpp/dihedral.h"
 #include "../atomic_cpp/dihedral_mgr.h"
 #include "../interpolation/nd_interp.h"
 #include "../colors.h"
+#include "../thread_pool.h"
+#include "../destruction_index.h"
 
 #include <atomstruct/destruct.h>
 #include <atomstruct/string_types.h>
@@ -34,6 +38,7 @@ class RamaMgr;
 //! Ramachandran dihedrals for a single amino acid residue
 class Rama: public pyinstance::PythonInstance<Rama>
 {
+    friend class RamaMgr;
 public:
     Rama() {}
     ~Rama() { auto du = DestructionUser(this); }
@@ -61,6 +66,23 @@ public:
     Residue *residue() const {return _residue;}
     bool check_for_deleted_dihedrals( const std::set<void *> &destroyed);
 
+    static const size_t MAX_BACKBONE_ATOMS = 6;
+    //! Unique atoms making up the omega, phi and psi dihedrals (at most 6)
+    size_t backbone_atoms(Atom **atoms);
+
+    // Cache used by RamaMgr::validate_incremental()
+    /*! True if the cached score is valid and, if this residue is mobile, none
+     *  of its backbone atoms has moved by more than sqrt(threshold_sq)
+     *  since the cache was last updated.
+     */
+    bool cache_current(double threshold_sq) const;
+    void update_cache(double score, uint8_t r_case);
+    void invalidate_cache() { _cache_valid = false; }
+    double cached_score() const { return _cached_score; }
+    uint8_t cached_case() const { return _cached_case; }
+    bool mobile() const { return _mobile; }
+    void set_mobile(bool flag) { _mobile = flag; }
+
 private:
     Dihedral* _omega = nullptr;
     Dihedral* _phi = nullptr;
@@ -70,6 +92,18 @@ private:
     ProperDihedralMgr* _dmgr;
     RamaMgr* _rmgr;
 
+    size_t _table_index = 0; // position in RamaMgr's packed residue table
+    //! Case ignoring omega (i.e. all prolines are TRANSPRO)
+    uint8_t _static_case();
+
+    bool _cache_valid = false;
+    bool _mobile = true;
+    double _cached_score;
+    uint8_t _cached_case;
+    size_t _n_cached_atoms = 0;
+    Atom* _cached_atoms[MAX_BACKBONE_ATOMS];
+    Coord _cached_coords[MAX_BACKBONE_ATOMS];
+
     const char* err_msg_not_protein()
     {
         return "Residue must be part of a protein chain!";
@@ -91,6 +125,7 @@ private:
  */
 class RamaMgr: public pyinstance::PythonInstance<RamaMgr>, public DestructionObserver
 {
+    friend class Rama;
 public:
     RamaMgr() {}
     ~RamaMgr();
@@ -108,6 +143,7 @@ public:
     };
 
     Rama* get_rama(Residue *res);
+    ProperDihedralMgr* dihedral_mgr() const { return _mgr; }
 
     void set_cutoffs(size_t r_case, const double &outlier, const double &allowed) {
         _cutoffs[r_case] = cutoffs(allowed, outlier);
@@ -116,18 +152,46 @@ public:
 
     void set_colors(uint8_t *max, uint8_t *mid, uint8_t *min, uint8_t *na);
     colors::colormap *get_colors(size_t r_case) { return &(_colors.at(r_case)); }
+    //! RGBA8 tables over log(score) used by color_by_scores(), indexed by case. Empty until set_colors().
+    const std::vector<colors::colormap_lut>& color_luts() const { return _color_luts; }
+    const colors::intcolor& null_intcolor() const { return _null_intcolor; }
+    //! Changes whenever the colours or any of the grids are replaced
+    uint64_t config_version() const { return _config_version; }
     const colors::color& default_color() const {return _null_color;}
 
+    //! Contour grids are stored as float32 to halve their cache footprint
+    typedef RegularGridInterpolator<double, float> Grid_Interpolator;
+
+    /*! Adds both the probability grid and the matching log-probability grid
+     *  (used for colouring) for the given case.
+     */
     void add_interpolator(size_t r_case, const size_t &dim,
         uint32_t *n, double *min, double *max, double *data);
-    RegularGridInterpolator<double> *get_interpolator(size_t r_case)
+    //! Maps both grids for the case from a file written by write_interpolator_file()
+    void add_interpolator_from_file(size_t r_case, const std::string &filename);
+    void write_interpolator_file(size_t r_case, const std::string &filename) const;
+    Grid_Interpolator *get_interpolator(size_t r_case)
         { return &(_interpolators.at(r_case)); }
+    Grid_Interpolator *get_log_interpolator(size_t r_case)
+        { return &(_log_interpolators.at(r_case)); }
 
     const colors::intcolor& cis_pro_color() const { return _cis_pro_color; }
     const colors::intcolor& cis_nonpro_color() const { return _cis_nonpro_color; }
     const colors::intcolor& twisted_color() const { return _twisted_color; }
 
     uint8_t rama_case(Residue *res);
+    uint8_t rama_case(Rama *r);
+    /*! Case ignoring omega (i.e. all prolines are TRANSPRO), or CASE_NONE
+     *  if any dihedral is missing. Otherwise also writes the six backbone
+     *  atoms CA(i-1), C(i-1), N, CA, C, N(i+1) to atoms, for code that needs
+     *  to measure omega, phi and psi itself.
+     */
+    uint8_t packed_backbone(Rama *r, Atom **atoms);
+
+    /*! Residue names may have changed, so all Ramachandran cases need to be
+     *  re-determined. Deletions are picked up automatically.
+     */
+    void topology_changed();
 
     //! Get the Ramachandran P-value for a single residue
     double validate(Rama *r);
@@ -142,6 +206,31 @@ public:
      */
     void validate(Rama **ramas, size_t n, double *scores, uint8_t *r_cases);
 
+    /*! Incremental scoring for live simulations. Each Rama caches its last
+     *  score and case along with the positions of its backbone atoms, and is
+     *  only re-scored if any of these has moved by more than the threshold
+     *  set in set_incremental(). Ramas marked as immobile by
+     *  set_mobile_atoms() are not even checked. Equivalent to
+     *  validate(Rama**, ...) unless incremental mode is on.
+     */
+    void validate_incremental(Rama **ramas, size_t n, double *scores, uint8_t *r_cases);
+    //! Turning incremental mode on or off clears all cached scores
+    void set_incremental(bool flag, double threshold);
+    bool incremental() const { return _incremental; }
+    /*! Ramas in the same structure(s) as the given atoms are marked mobile
+     *  only if at least one of their backbone atoms is in the set.
+     */
+    void set_mobile_atoms(Atom **atoms, size_t n);
+    //! Mark all Ramas as mobile
+    void clear_mobile_atoms();
+
+    /*! As for validate(Rama**, ...), but the scores are interpolated from the
+     *  log-probability grids. Intended for colouring/display, where the
+     *  results can go straight to color_by_log_scores() with no per-residue
+     *  log(). Residues with no valid case get NO_RAMA_SCORE.
+     */
+    void validate_log(Rama **ramas, size_t n, double *log_scores, uint8_t *r_cases);
+
     //! Score a pre-processed set of residues
     /*!
      * This function is designed for highest-speed re-scoring of a set
@@ -151,23 +240,66 @@ public:
      */
 
     void color_by_scores(double *scores, uint8_t *r_case, size_t n, uint8_t *out);
+    void color_by_log_scores(double *log_scores, uint8_t *r_case, size_t n, uint8_t *out);
     int32_t bin_score(const double &score, uint8_t r_case);
 
     void delete_ramas(const std::set<Rama *> to_delete);
     virtual void destructors_done(const std::set<void*>& destroyed);
 
+    Memory_Usage memory_usage() const;
+    //! The contour grids for all cases, counting each shared grid once
+    Memory_Usage interpolator_memory_usage() const;
+
 private:
     ProperDihedralMgr* _mgr;
     std::unordered_map<Residue*, Rama*> _residue_to_rama;
-    std::unordered_map<size_t, RegularGridInterpolator<double>> _interpolators;
+    // Each Rama is indexed by its CA atom and whichever of its dihedrals
+    // have been found so far
+    Destruction_Index<Rama> _dependents;
+    void _index_rama(Rama *r);
+    void _unindex_rama(Rama *r);
+    std::unordered_map<size_t, Grid_Interpolator> _interpolators;
+    std::unordered_map<size_t, Grid_Interpolator> _log_interpolators;
+    const double LOG_GRID_FLOOR = 1e-8; // well below any outlier cutoff
     std::unordered_map<size_t, cutoffs> _cutoffs;
     std::unordered_map<size_t, colors::colormap> _colors;
+    // RGBA8 tables over log(score) made from _colors, indexed by case
+    std::vector<colors::colormap_lut> _color_luts;
+    uint64_t _config_version = 0;
     colors::color _null_color;
+    colors::intcolor _null_intcolor;
     colors::intcolor _cis_pro_color = {64, 255, 64, 255};
     colors::intcolor _cis_nonpro_color = {255, 64, 64, 255};
     colors::intcolor _twisted_color = {255, 255, 64, 255};
+    bool _incremental = false;
+    double _move_threshold_sq = 0;
+    //! Smallest number of residues worth handing to another thread
+    static const size_t MIN_VALIDATION_CHUNK = 256;
+
+    /* Packed per-residue table of backbone atoms and pre-determined cases,
+     * so that bulk validation can stream through coordinates without going
+     * back to the dihedral manager or comparing residue names. Rebuilt only
+     * when the topology changes.
+     */
+    struct Rama_Entry
+    {
+        Rama* rama;
+        // CA(i-1), C(i-1), N, CA, C, N(i+1): omega, phi and psi are the
+        // dihedrals defined by atoms [0..3], [1..4] and [2..5] respectively
+        Atom* atoms[6];
+        // Case ignoring omega, or CASE_NONE if any dihedral is missing.
+        uint8_t static_case;
+    };
+    std::vector<Rama_Entry> _table;
+    bool _table_dirty = true;
+    void _rebuild_table();
+    void _resolve_entry(Rama_Entry& entry);
+    Rama_Entry& _entry(Rama *r);
+    uint8_t _entry_case(const Rama_Entry& entry) const;
+    void _entry_phipsi(const Rama_Entry& entry, double *phipsi) const;
 
-    void _color_by_score(const double &score, const uint8_t &r_case, colors::color &color);
+    void _validate(const std::unordered_map<size_t, Grid_Interpolator>& interpolators,
+        Rama **ramas, size_t n, double *scores, uint8_t *r_cases);
     void _delete_ramas(const std::set<Rama *> to_delete);
 }; //class RamaMgr
 }//namespace isolde
@@ -42,6 +42,10 @@ class RamaAnnotator(Model):
     which will restart when display is turned back on.
     '''
     pickable = False
+    # Set by use_snapshot_validator()
+    _snapshot_validator = None
+    _snapshot_handler = None
+    _snapshot_results = None
 
     def __init__(self, atomic_structure, hide_favored = False,
         ignore_ribbon_hides = True):
@@ -181,7 +185,46 @@ class RamaAnnotator(Model):
         ''' Returns a 3-tuple of (r,g,b,a) arrays defining the current colour scale.'''
         return self._mgr.color_scale
 
+    def use_snapshot_validator(self, validator):
+        '''
+        Take scores and colours from a
+        :py:class:`chimerax.isolde.molobject.SnapshotValidator` (typically
+        following a running simulation) rather than validating on the GUI
+        thread after every coordinate change. Until its first results for the
+        current set of residues arrive, validation is done directly as usual.
+        Call with None to go back to validating directly.
+        '''
+        if self._snapshot_handler is not None:
+            self._snapshot_validator.triggers.remove_handler(self._snapshot_handler)
+            self._snapshot_handler = None
+        self._snapshot_validator = validator
+        self._snapshot_results = None
+        if validator is not None:
+            validator.ramas = self._visible_ramas
+            self._snapshot_handler = validator.triggers.add_handler('results',
+                self._snapshot_results_cb)
+
+    def _snapshot_results_cb(self, trigger_name, results):
+        self._snapshot_results = results
+
+    def _snapshot_positions_colors_and_selecteds(self, ramas, results):
+        '''
+        As :func:`RamaMgr._ca_positions_colors_and_selecteds`, but with the
+        scores and colours taken from a :py:class:`SnapshotValidationResults`.
+        '''
+        cases = results.rama_cases
+        mask = (cases != 0)
+        if self.hide_favored:
+            cutoffs = self._mgr.cutoffs
+            allowed = numpy.zeros(max(cutoffs)+1)
+            for case, (outlier, allowed_cutoff) in cutoffs.items():
+                allowed[case] = allowed_cutoff
+            mask = numpy.logical_and(mask, results.rama_scores <= allowed[cases])
+        cas = ramas[mask].ca_atoms
+        return cas.coords, results.rama_colors[mask], cas.selected
+
     def delete(self):
+        self.use_snapshot_validator(None)
         h = self._structure_change_handler
         if h is not None:
             self._atomic_structure.triggers.remove_handler(h)
@@ -230,8 +273,17 @@ class RamaAnnotator(Model):
             rd.display = False
             return
         mgr = self._mgr
-        #mgr.color_cas_by_rama_score(ramas, self.hide_favored)
-        coords, colors, selecteds = mgr._ca_positions_colors_and_selecteds(ramas, self.hide_favored)
+        sv = self._snapshot_validator
+        if sv is not None and sv.ramas is not ramas:
+            sv.ramas = ramas
+            self._snapshot_results = None
+        results = self._snapshot_results
+        if results is not None and results.ramas is ramas:
+            coords, colors, selecteds = self._snapshot_positions_colors_and_selecteds(
+                ramas, results)
+        else:
+            #mgr.color_cas_by_rama_score(ramas, self.hide_favored)
+            coords, colors, selecteds = mgr._ca_positions_colors_and_selecteds(ramas, self.hide_favored)
         n = len(coords)
         if n > 0:
             xyzr = numpy.empty((n, 4), numpy.float32)
@@ -120,6 +120,41 @@ rama_mgr_add_interpolator(void *mgr, size_t r_case, size_t dim,
     }
 }
 
+extern "C" EXPORT void
+rama_mgr_add_interpolator_from_file(void *mgr, size_t r_case, const char *filename)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        m->add_interpolator_from_file(r_case, std::string(filename));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+rama_mgr_write_interpolator_file(void *mgr, size_t r_case, const char *filename)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        m->write_interpolator_file(r_case, std::string(filename));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! The log-probability grid for the case, for use as a bias potential
+extern "C" EXPORT void*
+rama_mgr_log_interpolator(void *mgr, size_t r_case)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        return m->get_log_interpolator(r_case);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
 extern "C" EXPORT size_t
 rama_mgr_interpolator_dim(void *mgr, size_t r_case)
 {
@@ -167,8 +202,9 @@ rama_mgr_interpolator_values(void *mgr, size_t r_case, double *vals)
     RamaMgr *m = static_cast<RamaMgr *>(mgr);
     try {
         auto it = m->get_interpolator(r_case);
-        for (auto d: it->data())
-            *vals++ = d;
+        auto d = it->data();
+        for (size_t i=0; i<it->size(); ++i)
+            *vals++ = d[i];
     } catch (...) {
         molc_error();
     }
@@ -181,6 +217,14 @@ rama_mgr_get_rama(void *mgr, void *residue, size_t n, pyobject_t *ramas)
     Residue **r = static_cast<Residue **>(residue);
     size_t found=0;
     try {
+        // Find all the backbone dihedrals in one pass, rather than one
+        // residue at a time as each Rama is created
+        static const std::vector<std::string> bb_names = {"omega", "phi", "psi"};
+        std::vector<Residue *> protein;
+        for (size_t i=0; i<n; ++i)
+            if (r[i]->polymer_type() == PT_AMINO)
+                protein.push_back(r[i]);
+        m->dihedral_mgr()->create_dihedrals(protein.data(), protein.size(), bb_names);
         for (size_t i=0; i<n; ++i) {
             Residue *thisr = *r++;
             if (thisr->polymer_type() != PT_AMINO)
@@ -241,17 +285,86 @@ rama_mgr_validate(void *mgr, void *rama, size_t n, double *score, uint8_t *rcase
     }
 }
 
+extern "C" EXPORT void
+rama_mgr_topology_changed(void *mgr)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        m->topology_changed();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+rama_mgr_validate_incremental(void *mgr, void *rama, size_t n, double *score, uint8_t *rcase)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    Rama **r = static_cast<Rama **>(rama);
+    try {
+        m->validate_incremental(r, n, score, rcase);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+set_rama_mgr_incremental(void *mgr, npy_bool flag, double threshold)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        m->set_incremental(flag, threshold);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+rama_mgr_incremental(void *mgr)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        return m->incremental();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT void
+rama_mgr_set_mobile_atoms(void *mgr, void *atoms, size_t n)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        m->set_mobile_atoms(a, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+rama_mgr_clear_mobile_atoms(void *mgr)
+{
+    RamaMgr *m = static_cast<RamaMgr *>(mgr);
+    try {
+        m->clear_mobile_atoms();
+    } catch (...) {
+        molc_error();
+    }
+}
+
 //! Provide an array of colors corresponding to Ramachandran scores
 extern "C" EXPORT void
 rama_mgr_validate_and_color(void *mgr, void *rama, size_t n, uint8_t *colors)
 {
     RamaMgr *m = static_cast<RamaMgr *>(mgr);
     Rama **r = static_cast<Rama **>(rama);
-    std::vector<double> scores(n);
+    std::vector<double> log_scores(n);
     std::vector<uint8_t> rcases(n);
     try {
-        m->validate(r, n, scores.data(), rcases.data());
-        m->color_by_scores(scores.data(), rcases.data(), n, colors);
+        m->validate_log(r, n, log_scores.data(), rcases.data());
+        m->color_by_log_scores(log_scores.data(), rcases.data(), n, colors);
     } catch (...) {
         molc_error();
     }
@@ -268,7 +381,7 @@ rama_mgr_ca_positions_and_colors(void *mgr, void *rama, size_t n, npy_bool hide_
     std::vector<uint8_t> rcases(n);
     std::vector<Rama *> non_favored;
     try {
-        m->validate(r, n, scores.data(), rcases.data());
+        m->validate_incremental(r, n, scores.data(), rcases.data());
         size_t count = 0;
         for (size_t i=0; i<n; ++i)
         {
@@ -308,8 +421,10 @@ rama_mgr_validate_and_color_cas(void *mgr, void *rama, size_t n, npy_bool hide_f
     std::vector<Rama *> non_favored;
     Atom::DrawMode BALL_STYLE = static_cast<Atom::DrawMode>(1); //Atom::DrawMode::Ball;
     try {
-        m->validate(r, n, scores.data(), rcases.data());
         if (hide_favored) {
+            // Favored/non-favored decisions are made on the probability
+            // grids, to stay consistent with the reported scores.
+            m->validate(r, n, scores.data(), rcases.data());
             uint8_t color[4];
             for (size_t i=0; i<n; ++i) {
                 if (rcases[i] == m->CASE_NONE) {r++; continue;}
@@ -332,7 +447,8 @@ rama_mgr_validate_and_color_cas(void *mgr, void *rama, size_t n, npy_bool hide_f
                 r++;
             }
         } else {
-            m->color_by_scores(scores.data(), rcases.data(), n, colors.data());
+            m->validate_log(r, n, scores.data(), rcases.data());
+            m->color_by_log_scores(scores.data(), rcases.data(), n, colors.data());
             auto cdata = colors.data();
             for (size_t i=0; i<n; ++i) {
                 auto ca = (*r++)->CA_atom();
@@ -346,7 +462,6 @@ rama_mgr_validate_and_color_cas(void *mgr, void *rama, size_t n, npy_bool hide_f
     }
 }
 
-const int32_t T_INDICES[9] = {0,1,4,1,2,4,2,3,4};
 const size_t D_LENGTH = 12;
 const size_t V_LENGTH = 15;
 const size_t N_LENGTH = 15;
@@ -354,8 +469,8 @@ const size_t T_LENGTH = 9;
 
 
 extern "C" EXPORT size_t
-rama_mgr_draw_cis_and_twisted_omegas(void *mgr, void *rama, size_t n, double *vertices,
-    double *normals, int32_t *triangles, uint8_t *colors)
+rama_mgr_draw_cis_and_twisted_omegas(void *mgr, void *rama, size_t n, float *vertices,
+    float *normals, int32_t *triangles, uint8_t *colors)
 {
     RamaMgr *m = static_cast<RamaMgr *>(mgr);
     Rama **r = static_cast<Rama **>(rama);
@@ -372,30 +487,16 @@ rama_mgr_draw_cis_and_twisted_omegas(void *mgr, void *rama, size_t n, double *ve
             abs_angle = std::abs(omega->angle());
             if (abs_angle < TWISTED_CUTOFF) {
                 const auto &atoms = omega->atoms();
-                double *v = vertices;
+                double coords[D_LENGTH];
+                double *c = coords;
                 for (auto a: atoms) {
                     const auto &coord = a->coord();
                     for (size_t j=0; j<3; ++j) {
-                        *v++ = coord[j];
+                        *c++ = coord[j];
                     }
                 }
-                for (size_t j=0; j<3; ++j) {
-                    *v++ = (vertices[j] + vertices[9+j])/2;
-                }
-                // Pretend the surface is planar, and assign a single normal
-                double v1[3], v2[3];
-                for (size_t j=0; j<3; ++j) {
-                    v1[j] = vertices[3+j]-vertices[j];
-                    v2[j] = vertices[9+j]-vertices[j];
-                }
-                geometry::cross_product_3D(v1, v2, normals);
-                // Copy this normal to the others
-                for (size_t j=3; j<N_LENGTH; ++j) {
-                    normals[j] = normals[j%3];
-                }
-                for (size_t j=0; j<T_LENGTH; ++j) {
-                    triangles[j] = vertex_count + T_INDICES[j];
-                }
+                geometry::dihedral_fill_plane(coords, vertices, normals,
+                    triangles, (int32_t)vertex_count);
                 vertex_count += V_LENGTH/3;
                 vertices += V_LENGTH;
                 normals += N_LENGTH;
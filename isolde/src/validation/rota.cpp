@@ -13,6 +13,7 @@
 #define PYINSTANCE_EXPORT
 
 #include "rota.h"
+#include "../interpolation/grid_file.h"
 #include <sstream> //DELETEME
 #include <pyinstance/PythonInstance.instantiate.h>
 
@@ -38,6 +39,7 @@ Rotamer::Rotamer(Residue *res, RotaMgr *mgr): _residue(res), _mgr(mgr)
 {
     auto rname = res->name();
     _def = mgr->get_rotamer_def(rname);
+    _type_id = mgr->rotamer_type_id(rname);
     auto n_chi = _def->n_chi();
     auto dmgr = mgr->dihedral_mgr();
     static const std::string basename("chi");
@@ -100,12 +102,51 @@ RotaMgr::~RotaMgr()
         delete it.second;
 }
 
+Memory_Usage RotaMgr::memory_usage() const
+{
+    Memory_Usage u;
+    u.objects = _residue_to_rotamer.size();
+    u.buffer_bytes = _residue_to_rotamer.size()*sizeof(Rotamer);
+    for (const auto &it: _residue_to_rotamer)
+        u.buffer_bytes += memory::vector_bytes(it.second->dihedrals());
+    {
+        std::lock_guard<std::mutex> lock(_scratch_mutex);
+        u.buffer_bytes += memory::vector_bytes(_type_offsets) + memory::vector_bytes(_order)
+            + memory::vector_bytes(_chi_scratch) + memory::vector_bytes(_score_scratch)
+            + memory::vector_bytes(_chunk_scratch);
+    }
+    u.container_bytes = memory::hash_bytes(_residue_to_rotamer) + _dependents.container_bytes()
+        + memory::hash_bytes(_resname_to_rota_def) + memory::hash_bytes(_type_ids)
+        + memory::vector_bytes(_types);
+    for (const auto &it: _resname_to_rota_def)
+    {
+        const auto& def = it.second;
+        u.container_bytes += memory::vector_bytes(def.targets());
+        for (const auto& t: def.targets())
+            u.container_bytes += memory::vector_bytes(t.angles) + memory::vector_bytes(t.esds);
+        for (size_t i=0; i<def.n_chi(); ++i)
+            u.container_bytes += memory::vector_bytes(def.moving_atom_names(i));
+    }
+    return u;
+}
+
+Memory_Usage RotaMgr::interpolator_memory_usage() const
+{
+    std::unordered_set<const void*> seen;
+    auto u = isolde::interpolator_memory_usage(_interpolators, seen);
+    u += isolde::interpolator_memory_usage(_log_interpolators, seen);
+    return u;
+}
+
 void RotaMgr::add_rotamer_def(const std::string &resname, size_t n_chi, size_t val_nchi,
     bool symmetric, const std::vector<std::vector<std::string>>& moving_atom_names)
 {
     if (_resname_to_rota_def.find(resname) == _resname_to_rota_def.end()) {
         Rota_Def rdef(n_chi, val_nchi, symmetric, moving_atom_names);
         _resname_to_rota_def[resname] = rdef;
+        _type_ids[resname] = _types.size();
+        _types.push_back(Rota_Type(&_resname_to_rota_def[resname]));
+        _link_interpolators(resname);
     } else {
         throw std::runtime_error("Rotamer definition alread exists!");
     }
@@ -126,6 +167,8 @@ void RotaMgr::set_colors(uint8_t *max, uint8_t *mid, uint8_t *min)
     these_cutoffs[1] = cuts->log_allowed;
     these_cutoffs[2] = 0;
     _colors = colors::colormap(these_cutoffs, thecolors, 3);
+    _color_lut = colors::colormap_lut(_colors);
+    _config_version++;
 }
 
 Rota_Def* RotaMgr::get_rotamer_def(const std::string &resname)
@@ -141,7 +184,52 @@ Rota_Def* RotaMgr::get_rotamer_def(const std::string &resname)
 void RotaMgr::add_interpolator(const std::string &resname, const size_t &dim,
     uint32_t *n, double *min, double *max, double *data)
 {
-    _interpolators[resname] = RegularGridInterpolator<double>(dim, n, min, max, data);
+    size_t n_points = 1;
+    for (size_t i=0; i<dim; ++i)
+        n_points *= n[i];
+    _interpolators[resname] = Grid_Interpolator(dim, n, min, max, data);
+    auto log_data = log_values(data, n_points, LOG_GRID_FLOOR);
+    _log_interpolators[resname] = Grid_Interpolator(dim, n, min, max, log_data.data());
+    _link_interpolators(resname);
+    _config_version++;
+}
+
+void RotaMgr::add_interpolator_from_file(const std::string &resname, const std::string &filename)
+{
+    auto f = shared_grid_file(filename);
+    if (f->n_grids() != 2)
+        throw std::runtime_error(filename + " is not a rotamer grid file!");
+    _interpolators[resname] = Grid_Interpolator(f->dim(), f->lengths(), f->min(), f->max(),
+        f->grid<float>(0), f);
+    _log_interpolators[resname] = Grid_Interpolator(f->dim(), f->lengths(), f->min(), f->max(),
+        f->grid<float>(1), f);
+    _link_interpolators(resname);
+    _config_version++;
+}
+
+void RotaMgr::write_interpolator_file(const std::string &resname, const std::string &filename) const
+{
+    const auto &g = _interpolators.at(resname);
+    const auto &lg = _log_interpolators.at(resname);
+    std::vector<uint32_t> n(g.length().begin(), g.length().end());
+    write_grid_file<float>(filename, g.dim(), n.data(), g.min().data(), g.max().data(),
+        {g.data(), lg.data()});
+}
+
+// Definitions and grids may be added in either order. Map values are never
+// moved once inserted, so the pointers stay valid.
+void RotaMgr::_link_interpolators(const std::string &resname)
+{
+    auto tit = _type_ids.find(resname);
+    if (tit == _type_ids.end())
+        return;
+    auto &type = _types[tit->second];
+    auto it = _interpolators.find(resname);
+    if (it != _interpolators.end())
+        type.interpolator = &(it->second);
+    auto lit = _log_interpolators.find(resname);
+    if (lit != _log_interpolators.end())
+        type.log_interpolator = &(lit->second);
 }
 
 Rotamer* RotaMgr::new_rotamer(Residue* residue)
@@ -149,6 +237,9 @@ Rotamer* RotaMgr::new_rotamer(Residue* residue)
     try {
         auto r = new Rotamer(residue, this);
         _residue_to_rotamer[residue] = r;
+        _dependents.add(r, r);
+        for (auto d: r->dihedrals())
+            _dependents.add(d, r);
         return r;
     } catch (...) {
         return nullptr;
@@ -180,40 +271,90 @@ Rotamer* RotaMgr::get_rotamer(Residue* residue)
 //! Fast validation of pre-defined rotamers
 void RotaMgr::validate(Rotamer** rotamers, size_t n, double* scores)
 {
-    std::map<ResName, std::vector<size_t>> case_indices;
-    for (size_t i=0; i<n; ++i) {
-        case_indices[rotamers[i]->residue()->name()].push_back(i);
-    }
-    for (auto &it: case_indices) {
-        std::string name = std::string(it.first);
-        auto &indices = it.second;
-
-        // This is ever-so-slightly dodgy, but it saves code and it works.
-        // The problem is that Proline is a special case: while it has three
-        // chi dihedrals, only the first is actually used for validation
-        // (since the other two are tightly constrained due to the cyclic
-        // sidechain). Rather than introduce a whole lot of extra code for this
-        // one special case, we'll get all the chi angles, but overwrite the
-        // extras.
-        auto rdef = get_rotamer_def(name);
-        size_t n_chi = rdef->n_chi();
-        size_t val_nchi = rdef->val_nchi();
-        size_t n_rot = indices.size();
-        size_t n_angles = n_rot*n_chi;
-
-        std::vector<double> chi_angles(n_angles);
-        for (size_t i=0; i<n_rot; i++) {
-            rotamers[indices[i]]->angles(chi_angles.data()+i*val_nchi);
-        }
+    _validate(false, rotamers, n, scores);
+}
 
-        auto &interpolator = _interpolators.at(name);
-        std::vector<double> cur_scores(n_rot);
-        interpolator.interpolate(chi_angles.data(), n_rot, cur_scores.data());
+void RotaMgr::validate_log(Rotamer** rotamers, size_t n, double* log_scores)
+{
+    _validate(true, rotamers, n, log_scores);
+}
 
-        for (size_t i=0; i<n_rot; ++i) {
-            scores[indices[i]] = cur_scores[i];
+void RotaMgr::_validate(bool log_scores, Rotamer** rotamers, size_t n, double* scores)
+{
+    std::lock_guard<std::mutex> lock(_scratch_mutex);
+
+    // Counting sort of the rotamers by residue type. After this,
+    // _order[_type_offsets[t]..._type_offsets[t+1]] holds the indices of all
+    // rotamers of type t.
+    size_t n_types = _types.size();
+    _type_offsets.assign(n_types+1, 0);
+    for (size_t i=0; i<n; ++i)
+        _type_offsets[rotamers[i]->type_id()+1]++;
+    for (size_t t=0; t<n_types; ++t)
+        _type_offsets[t+1] += _type_offsets[t];
+    _order.resize(n);
+    for (size_t i=0; i<n; ++i)
+        _order[_type_offsets[rotamers[i]->type_id()]++] = i;
+    // The fill above advanced each offset to the start of the next type
+    for (size_t t=n_types; t>0; --t)
+        _type_offsets[t] = _type_offsets[t-1];
+    _type_offsets[0] = 0;
+
+    // Each residue type is split into chunks which are scored in parallel.
+    // Every chunk writes only to its own entries in scores, so the result is
+    // identical to a serial run.
+    //
+    // This is ever-so-slightly dodgy, but it saves code and it works. The
+    // problem is that Proline is a special case: while it has three chi
+    // dihedrals, only the first is actually used for validation (since the
+    // other two are tightly constrained due to the cyclic sidechain). Rather
+    // than introduce a whole lot of extra code for this one special case,
+    // we'll get all the chi angles, but overwrite the extras - so each chunk
+    // gets n_chi spare slots at the end of its angle block.
+    _chunk_scratch.clear();
+    size_t n_angles = 0;
+    for (size_t t=0; t<n_types; ++t) {
+        size_t first = _type_offsets[t], last = _type_offsets[t+1];
+        if (first == last)
+            continue;
+        const auto &type = _types[t];
+        const auto interp = log_scores ? type.log_interpolator : type.interpolator;
+        if (interp == nullptr)
+            throw std::out_of_range("No validation grid is defined for this residue type!");
+        for (size_t start=first; start<last; start+=MIN_VALIDATION_CHUNK) {
+            size_t end = std::min(last, start+MIN_VALIDATION_CHUNK);
+            _chunk_scratch.push_back({start, end, n_angles, &type});
+            n_angles += (end-start)*type.def->val_nchi() + type.def->n_chi();
         }
     }
+    _chi_scratch.resize(n_angles);
+    _score_scratch.resize(n);
+
+    // Everything the workers need is reached through a single reference, so
+    // the std::function built for the pool fits its small-object buffer.
+    struct Job
+    {
+        RotaMgr* mgr;
+        Rotamer** rotamers;
+        double* scores;
+        bool log_scores;
+    } job = {this, rotamers, scores, log_scores};
+    Thread_Pool::instance().parallel_for(_chunk_scratch.size(), [&job](size_t ci) {
+        auto mgr = job.mgr;
+        const auto &chunk = mgr->_chunk_scratch[ci];
+        const auto &type = *chunk.type;
+        const size_t val_nchi = type.def->val_nchi();
+        const size_t n_rot = chunk.end - chunk.start;
+        const size_t *order = mgr->_order.data() + chunk.start;
+        double *chi_angles = mgr->_chi_scratch.data() + chunk.angle_offset;
+        double *cur_scores = mgr->_score_scratch.data() + chunk.start;
+        for (size_t i=0; i<n_rot; i++)
+            job.rotamers[order[i]]->angles(chi_angles+i*val_nchi);
+        const auto interp = job.log_scores ? type.log_interpolator : type.interpolator;
+        interp->interpolate(chi_angles, n_rot, cur_scores);
+        for (size_t i=0; i<n_rot; ++i)
+            job.scores[order[i]] = cur_scores[i];
+    });
 }
 
 //! Slower, but more robust validation that allows non-rotameric residues.
@@ -228,36 +369,27 @@ void RotaMgr::validate(Residue** residues, size_t n, double* scores)
             scores[i] = -1.0;
             continue;
         }
-        auto &interpolator = _interpolators.at(std::string(res->name()));
-        scores[i] = interpolator.interpolate((rot->angles()));
+        auto interpolator = _types[rot->type_id()].interpolator;
+        if (interpolator == nullptr)
+            throw std::out_of_range("No validation grid is defined for this residue type!");
+        scores[i] = interpolator->interpolate((rot->angles()));
     }
 }
 
-/**********TESTING***********/
-void RotaMgr::_validate_from_thread(Rotamer **rotamers, size_t n, double* scores)
-{
-    _thread_running = true;
-    _thread_done = false;
-    validate(rotamers, n, scores);
-    _thread_done = true;
-}
-void RotaMgr::validate_threaded(Rotamer **rotamers, size_t n, double* scores)
-{
-    _validation_thread = std::thread(&RotaMgr::_validate_from_thread, this, rotamers, n, scores);
-}
-/******END TESTING***********/
 
 
 void RotaMgr::color_by_score(double *score, size_t n, uint8_t *out)
 {
-    colors::color this_color;
-    auto cmap = get_colors();
-    for (size_t i=0; i<n; ++i) {
-        cmap->interpolate(log(*score++), this_color);
-        for(size_t j=0; j<4; ++j) {
-            *out++ = (uint8_t)(this_color[j]*255.0);
-        }
-    }
+    if (_color_lut.empty())
+        throw std::logic_error("Rotamer colours have not been set!");
+    _color_lut.apply_log(score, n, out);
+}
+
+void RotaMgr::color_by_log_score(double *log_score, size_t n, uint8_t *out)
+{
+    if (_color_lut.empty())
+        throw std::logic_error("Rotamer colours have not been set!");
+    _color_lut.apply(log_score, n, out);
 }
 
 int32_t RotaMgr::bin_score(const double &score)
@@ -277,32 +409,17 @@ void RotaMgr::destructors_done(const std::set<void*>& destroyed)
 {
     auto db = DestructionBatcher(this);
     std::set<Rotamer*> to_delete;
-    bool del;
-    for (auto it=_residue_to_rotamer.begin(); it!=_residue_to_rotamer.end();) {
-        auto rot = it->second;
-        del = false;
-        // If a residue is deleted then any associated dihedrals will be
-        // deleted by the Dihedral_Mgr, so we only need to worry about
-        // checking for deleted dihedrals and rotamers.
-        if (destroyed.find(static_cast<void *>(rot)) != destroyed.end()) {
-            del=true;
-        } else {
-            for (auto d: rot->dihedrals()) {
-                if (destroyed.find(static_cast<void *>(d)) != destroyed.end()) {
-                    del = true;
-                    break;
-                }
-            }
-        }
-        if (del) {
-            to_delete.insert(rot);
-            it = _residue_to_rotamer.erase(it);
-        } else {
-            ++it;
-        }
-    }
-    for (auto r: to_delete)
+    // If a residue is deleted then any associated dihedrals will be
+    // deleted by the Dihedral_Mgr, so we only need to worry about
+    // checking for deleted dihedrals and rotamers.
+    _dependents.find_dependents(destroyed, to_delete);
+    for (auto r: to_delete) {
+        _residue_to_rotamer.erase(r->residue());
+        _dependents.remove(r, r);
+        for (auto d: r->dihedrals())
+            _dependents.remove(d, r);
         delete r;
+    }
 }
 
 
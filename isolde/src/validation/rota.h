@@ -13,14 +13,16 @@
 #ifndef ISOLDE_ROTA
 #define ISOLDE_ROTA
 
-#include <thread> //testing
-
 #include <string>
+#include <mutex>
 #include "../atomic_cpp/dihedral.h"
 #include "../atomic_cpp/dihedral_mgr.h"
 #include "../interpolation/nd_interp.h"
 #include "../colors.h"
+#include "../thread_pool.h"
+#include "../destruction_index.h"
 #include "../geometry/geometry.h"
+#include "rota_search.h"
 #include <atomstruct/destruct.h>
 #include <atomstruct/string_types.h>
 #include <pyinstance/PythonInstance.declare.h>
@@ -111,6 +113,8 @@ public:
     bool visible() const { return ca_cb_bond()->shown(); }
 
     Rota_Def* def() const { return _def; }
+    //! Interned residue type (see RotaMgr::rotamer_type_id())
+    size_t type_id() const { return _type_id; }
     size_t num_target_defs() const { return _def->num_targets(); }
     Rota_Target* get_target_def(size_t i) const { return _def->get_target(i); }
 
@@ -119,6 +123,7 @@ private:
     RotaMgr* _mgr;
     std::vector<ProperDihedral *> _chi_dihedrals;
     Rota_Def *_def;
+    size_t _type_id;
     // size_t _n_chi;
     // bool _symmetric = false;
 
@@ -152,51 +157,118 @@ public:
     void add_rotamer_def(const std::string &resname, size_t n_chi, size_t val_nchi,
         bool symmetric, const std::vector<std::vector<std::string>>& moving_atom_names);
     Rota_Def* get_rotamer_def(const std::string &resname);
+    //! Small integer ID assigned to each residue type when its definition is added
+    size_t rotamer_type_id(const std::string &resname) const { return _type_ids.at(resname); }
     // Rota_Def* get_rotamer_def(const ResName &resname);
     Rotamer* new_rotamer(Residue* residue);
     Rotamer* get_rotamer(Residue* residue);
 
+    //! Contour grids are stored as float32 to halve their cache footprint
+    typedef RegularGridInterpolator<double, float> Grid_Interpolator;
+
+    /*! Adds both the probability grid and the matching log-probability grid
+     *  (used for colouring) for the given residue type.
+     */
     void add_interpolator(const std::string &resname, const size_t &dim,
         uint32_t *n, double *min, double *max, double *data);
-    RegularGridInterpolator<double>* get_interpolator(const std::string &resname)
+    //! Maps both grids for the residue type from a file written by write_interpolator_file()
+    void add_interpolator_from_file(const std::string &resname, const std::string &filename);
+    void write_interpolator_file(const std::string &resname, const std::string &filename) const;
+    Grid_Interpolator* get_interpolator(const std::string &resname)
     {
         return &(_interpolators.at(resname));
     }
+    Grid_Interpolator* get_log_interpolator(const std::string &resname)
+    {
+        return &(_log_interpolators.at(resname));
+    }
     // RegularGridInterpolator<double>* get_interpolator(const ResName &resname)
     // {
     //     return &(_interpolators.at(std::string(resname)));
     // }
     ProperDihedralMgr* dihedral_mgr() { return _dmgr; }
     void validate(Rotamer** rotamers, size_t n, double* scores);
+    //! As for validate(Rotamer**, ...), but interpolated from the log-probability grids
+    void validate_log(Rotamer** rotamers, size_t n, double* log_scores);
     void validate(Residue** residues, size_t n, double* scores);
 
-    /**********TESTING***********/
-    void validate_threaded(Rotamer **rotamers, size_t n, double* scores);
-    bool thread_running() const { return _thread_running; }
-    bool thread_done() const { return _thread_done; }
-    void finalize_thread() { _validation_thread.join(); _thread_running=false; }
-    /******END TESTING***********/
+    //! Rank each rotamer's targets by clashes with its surroundings and fit to density
+    /*! For each rotamer, the sidechain is built in every target conformation
+     *  (without touching the model) and scored against the other atoms of
+     *  the structure, and optionally against a density map (see
+     *  Rota_Search_Params for the scoring). All rotamers must come from the
+     *  same structure; the surroundings are taken as they currently are.
+     *  Clashes within the residue itself are not scored.
+     *
+     *  Writes the indices of the best max_results targets for rotamer i,
+     *  best first, to target_indices[i*max_results...], with their scores in
+     *  the matching entries of scores. Unused entries get -1 and NaN.
+     */
+    void search(Rotamer** rotamers, size_t n, const Rota_Search_Params& params,
+        const Rota_Search_Map* map, size_t max_results, int32_t* target_indices,
+        double* scores);
+
 
 
     int32_t bin_score(const double &score);
     void color_by_score(double *score, size_t n, uint8_t *out);
+    void color_by_log_score(double *log_score, size_t n, uint8_t *out);
+    //! RGBA8 table over log(score) used by color_by_score(). Empty until set_colors().
+    const colors::colormap_lut& color_lut() const { return _color_lut; }
+    //! Changes whenever the colours or any of the grids are replaced
+    uint64_t config_version() const { return _config_version; }
     virtual void destructors_done(const std::set<void*>& destroyed);
 
+    Memory_Usage memory_usage() const;
+    //! The probability grids for all residue types, counting each shared grid once
+    Memory_Usage interpolator_memory_usage() const;
+
 private:
     ProperDihedralMgr* _dmgr;
     std::unordered_map<Residue*, Rotamer*> _residue_to_rotamer;
+    // Each rotamer is indexed by itself and by each of its chi dihedrals
+    Destruction_Index<Rotamer> _dependents;
     std::unordered_map<std::string, Rota_Def> _resname_to_rota_def;
-    std::unordered_map<std::string, RegularGridInterpolator<double>> _interpolators;
+    std::unordered_map<std::string, Grid_Interpolator> _interpolators;
+    std::unordered_map<std::string, Grid_Interpolator> _log_interpolators;
+    const double LOG_GRID_FLOOR = 1e-8; // well below the outlier cutoff
     colors::colormap _colors;
+    // RGBA8 table over log(score) made from _colors
+    colors::colormap_lut _color_lut;
+    uint64_t _config_version = 0;
     cutoffs _cutoffs;
 
-    /*************TESTING********/
-    void _validate_from_thread(Rotamer **rotamers, size_t n, double* scores);
-    std::thread _validation_thread;
-    bool _thread_done = false;
-    bool _thread_running = false;
+    //! Everything validation needs for one residue type, indexed by type ID
+    struct Rota_Type
+    {
+        Rota_Def* def;
+        const Grid_Interpolator* interpolator;
+        const Grid_Interpolator* log_interpolator;
+        Rota_Type(Rota_Def* d): def(d), interpolator(nullptr), log_interpolator(nullptr) {}
+    };
+    std::unordered_map<std::string, size_t> _type_ids;
+    std::vector<Rota_Type> _types;
+    void _link_interpolators(const std::string &resname);
 
-    /*********END TESTING********/
+    //! Smallest number of rotamers worth handing to another thread
+    static const size_t MIN_VALIDATION_CHUNK = 128;
+    struct Validation_Chunk
+    {
+        size_t start, end; // range in _order
+        size_t angle_offset; // start of this chunk's chi angles in _chi_scratch
+        const Rota_Type* type;
+    };
+    // Scratch space reused by _validate(), so that repeatedly validating the
+    // same model allocates nothing. Only grows; guarded by _scratch_mutex.
+    mutable std::mutex _scratch_mutex;
+    std::vector<size_t> _type_offsets;
+    std::vector<size_t> _order;
+    std::vector<double> _chi_scratch;
+    std::vector<double> _score_scratch;
+    std::vector<Validation_Chunk> _chunk_scratch;
+    //! Smallest number of rotamers worth handing to another thread in search()
+    static const size_t MIN_SEARCH_CHUNK = 16;
+    void _validate(bool log_scores, Rotamer** rotamers, size_t n, double* scores);
 
 
 }; // class RotaMgr
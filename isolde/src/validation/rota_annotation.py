@@ -50,6 +50,10 @@ class RotamerAnnotator(Model):
     which will restart when display is turned back on.
     '''
     pickable = False
+    # Set by use_snapshot_validator()
+    _snapshot_validator = None
+    _snapshot_handler = None
+    _snapshot_results = None
 
     def __init__(self, atomic_structure):
         '''
@@ -145,7 +149,47 @@ class RotamerAnnotator(Model):
         if flag != cflag:
             self.update_graphics()
 
+    def use_snapshot_validator(self, validator):
+        '''
+        Take scores and colours from a
+        :py:class:`chimerax.isolde.molobject.SnapshotValidator` (typically
+        following a running simulation) rather than validating on the GUI
+        thread after every coordinate change. Until its first results for the
+        current set of residues arrive, validation is done directly as usual.
+        Call with None to go back to validating directly.
+        '''
+        if self._snapshot_handler is not None:
+            self._snapshot_validator.triggers.remove_handler(self._snapshot_handler)
+            self._snapshot_handler = None
+        self._snapshot_validator = validator
+        self._snapshot_results = None
+        if validator is not None:
+            validator.rotamers = self._selected_rotamers
+            self._snapshot_handler = validator.triggers.add_handler('results',
+                self._snapshot_results_cb)
+
+    def _snapshot_results_cb(self, trigger_name, results):
+        self._snapshot_results = results
+
+    def _snapshot_scale_and_color_rotamers(self, rotamers, results):
+        '''
+        As :func:`RotaMgr.validate_scale_and_color_rotamers`, but with the
+        scores and colours taken from a :py:class:`SnapshotValidationResults`.
+        '''
+        scores = results.rota_scores
+        mask = rotamers.visibles
+        allowed, outlier = self._mgr.cutoffs
+        if self._hide_favored:
+            mask = numpy.logical_and(mask, scores <= allowed)
+        log_allowed = log(allowed)
+        with numpy.errstate(divide='ignore'):
+            log_scores = numpy.log(scores[mask])
+        scales = numpy.minimum((log_scores-log_allowed)/(log(outlier)-log_allowed)+1,
+            self._MAX_SCALE)
+        return rotamers[mask], scales, results.rota_colors[mask]
+
     def delete(self):
+        self.use_snapshot_validator(None)
         h = self._structure_change_handler
         if h is not None:
             self._atomic_structure.triggers.remove_handler(h)
@@ -184,9 +228,19 @@ class RotamerAnnotator(Model):
     def update_graphics(self, *_, scale_by_scores = True):
         if not self.visible:
             return
-        rots, scales, colors = self._mgr.validate_scale_and_color_rotamers(
-            self._selected_rotamers, max_scale=self._MAX_SCALE,
-            non_favored_only = self._hide_favored)
+        selected = self._selected_rotamers
+        sv = self._snapshot_validator
+        if sv is not None and sv.rotamers is not selected:
+            sv.rotamers = selected
+            self._snapshot_results = None
+        results = self._snapshot_results
+        if results is not None and results.rotamers is selected:
+            rots, scales, colors = self._snapshot_scale_and_color_rotamers(
+                selected, results)
+        else:
+            rots, scales, colors = self._mgr.validate_scale_and_color_rotamers(
+                selected, max_scale=self._MAX_SCALE,
+                non_favored_only = self._hide_favored)
         d = self._drawing
         if not len(rots):
             d.display = False
@@ -104,6 +104,44 @@ rota_mgr_add_interpolator(void *mgr, pyobject_t *resname, size_t dim,
     }
 }
 
+extern "C" EXPORT void
+rota_mgr_add_interpolator_from_file(void *mgr, pyobject_t *resname, const char *filename)
+{
+    RotaMgr *m = static_cast<RotaMgr *>(mgr);
+    try {
+        std::string rname(PyUnicode_AsUTF8(static_cast<PyObject *>(resname[0])));
+        m->add_interpolator_from_file(rname, std::string(filename));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+rota_mgr_write_interpolator_file(void *mgr, pyobject_t *resname, const char *filename)
+{
+    RotaMgr *m = static_cast<RotaMgr *>(mgr);
+    try {
+        std::string rname(PyUnicode_AsUTF8(static_cast<PyObject *>(resname[0])));
+        m->write_interpolator_file(rname, std::string(filename));
+    } catch (...) {
+        molc_error();
+    }
+}
+
+//! The log-probability grid for the residue type, for use as a bias potential
+extern "C" EXPORT void*
+rota_mgr_log_interpolator(void *mgr, pyobject_t *resname)
+{
+    RotaMgr *m = static_cast<RotaMgr *>(mgr);
+    try {
+        std::string rname(PyUnicode_AsUTF8(static_cast<PyObject *>(resname[0])));
+        return m->get_log_interpolator(rname);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
 extern "C" EXPORT void
 rota_mgr_set_cutoffs(void *mgr, double allowed, double outlier)
 {
@@ -163,6 +201,9 @@ rota_mgr_get_rotamer(void *mgr, void *residue, size_t n)
     Residue **r = static_cast<Residue **>(residue);
     std::vector<Rotamer *> found;
     try {
+        // Find all chi dihedrals in one pass before creating the rotamers
+        static const std::vector<std::string> chi_names = {"chi1", "chi2", "chi3", "chi4"};
+        m->dihedral_mgr()->create_dihedrals(r, n, chi_names);
         for (size_t i=0; i<n; ++i) {
             Rotamer* rot = m->get_rotamer(*r++);
             if (rot != nullptr) {
@@ -193,55 +234,6 @@ rota_mgr_validate_rotamer(void *mgr, void *rotamer, size_t n, double *scores)
     }
 } //rota_mgr_validate_rotamer
 
-/*******TESTING***********/
-extern "C" EXPORT void
-rota_mgr_validate_rotamer_threaded(void *mgr, void *rotamer, size_t n, double *scores)
-{
-    RotaMgr *m = static_cast<RotaMgr *>(mgr);
-    Rotamer **r = static_cast<Rotamer **>(rotamer);
-    try {
-        m->validate_threaded(r, n, scores);
-    } catch (...) {
-        molc_error();
-    }
-} //rota_mgr_validate_rotamer
-
-extern "C" EXPORT npy_bool
-rota_mgr_thread_running(void *mgr) {
-    RotaMgr *m = static_cast<RotaMgr *>(mgr);
-    try {
-        return m->thread_running();
-    } catch (...) {
-        molc_error();
-        return 0;
-    }
-}
-
-extern "C" EXPORT npy_bool
-rota_mgr_thread_done(void *mgr) {
-    RotaMgr *m = static_cast<RotaMgr *>(mgr);
-    try {
-        return m->thread_done();
-    } catch (...) {
-        molc_error();
-        return 0;
-    }
-}
-
-extern "C" EXPORT void
-rota_mgr_finalize_thread(void *mgr) {
-    RotaMgr *m = static_cast<RotaMgr *>(mgr);
-    try {
-        m->finalize_thread();
-    } catch (...) {
-        molc_error();
-    }
-}
-
-
-/******END TESTING***********/
-
-
 extern "C" EXPORT void
 rota_mgr_validate_residue(void *mgr, void *residue, size_t n, double *scores)
 {
@@ -279,14 +271,22 @@ rota_mgr_validate_scale_and_color_rotamers(void *mgr, void *rotamer, size_t n,
         const auto &log_allowed = cutoffs->log_allowed;
         const auto &allowed = cutoffs->allowed;
         auto log_range = cutoffs->log_outlier-log_allowed;
-        m->validate(r,n,scores.data());
+        // Favored/non-favored decisions are made on the probability grids,
+        // to stay consistent with the reported scores. If everything is to
+        // be drawn, go straight to the log-probability grids instead.
+        if (non_favored_only)
+            m->validate(r,n,scores.data());
+        else
+            m->validate_log(r,n,scores.data());
         for (auto &s: scores) {
-            if (non_favored_only)
+            double log_s = s;
+            if (non_favored_only) {
                 if (s>allowed) { r++; continue; }
+                log_s = log(s);
+            }
             *rot_out++ = *r++;
-            m->color_by_score(&s, 1, color_out);
+            m->color_by_log_score(&log_s, 1, color_out);
             color_out +=4;
-            auto log_s = log(s);
             auto this_scale = (log_s-log_allowed)/log_range + 1;
             *scale++ = this_scale>max_scale ? max_scale : this_scale;
             ret++;
@@ -298,6 +298,41 @@ rota_mgr_validate_scale_and_color_rotamers(void *mgr, void *rotamer, size_t n,
     }
 }
 
+//! Rank the targets of each rotamer (see RotaMgr::search())
+/*! weights holds (clash_weight, map_weight, clash_threshold, hbond_allowance).
+ *  If map_data is null the density term is skipped, otherwise map_dims is the
+ *  (i,j,k) size of the packed float32 array, map_tf its 3x4 xyz->ijk
+ *  transform and map_sigma its standard deviation.
+ */
+extern "C" EXPORT void
+rota_mgr_search(void *mgr, void *rotamer, size_t n, double *weights,
+    float *map_data, size_t *map_dims, double *map_tf, double map_sigma,
+    size_t max_results, int32_t *target_indices, double *scores)
+{
+    RotaMgr *m = static_cast<RotaMgr *>(mgr);
+    Rotamer **r = static_cast<Rotamer **>(rotamer);
+    try {
+        Rota_Search_Params params;
+        params.clash_weight = weights[0];
+        params.map_weight = weights[1];
+        params.clash_threshold = weights[2];
+        params.hbond_allowance = weights[3];
+        Rota_Search_Map map;
+        if (map_data != nullptr) {
+            map.data = map_data;
+            for (size_t i=0; i<3; ++i)
+                map.dims[i] = map_dims[i];
+            for (size_t i=0; i<12; ++i)
+                map.tf[i] = map_tf[i];
+            map.sigma = map_sigma;
+        }
+        m->search(r, n, params, map_data==nullptr ? nullptr : &map,
+            max_results, target_indices, scores);
+    } catch (...) {
+        molc_error();
+    }
+} //rota_mgr_search
+
 extern "C" EXPORT void
 rota_mgr_color_by_score(void *mgr, double *score, size_t n, uint8_t *color)
 {
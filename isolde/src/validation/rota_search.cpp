@@ -0,0 +1,311 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#include "rota.h"
+#include "../atomic_cpp/atom_index.h"
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace isolde
+{
+
+double Rota_Search_Map::value(const double *xyz) const
+{
+    int64_t i0[3];
+    double f[3];
+    for (size_t a=0; a<3; ++a)
+    {
+        const double *row = tf + 4*a;
+        double g = row[0]*xyz[0] + row[1]*xyz[1] + row[2]*xyz[2] + row[3];
+        if (dims[a] < 2 || g < 0 || g > (double)(dims[a]-1))
+            return 0;
+        i0[a] = std::min((int64_t)g, (int64_t)dims[a]-2);
+        f[a] = g - i0[a];
+    }
+    const size_t sj = dims[0], sk = dims[0]*dims[1];
+    const float *p = data + i0[2]*sk + i0[1]*sj + i0[0];
+    double c00 = p[0]*(1-f[0]) + p[1]*f[0];
+    double c10 = p[sj]*(1-f[0]) + p[sj+1]*f[0];
+    double c01 = p[sk]*(1-f[0]) + p[sk+1]*f[0];
+    double c11 = p[sk+sj]*(1-f[0]) + p[sk+sj+1]*f[0];
+    double c0 = c00*(1-f[1]) + c10*f[1];
+    double c1 = c01*(1-f[1]) + c11*f[1];
+    return c0*(1-f[2]) + c1*f[2];
+}
+
+namespace
+{
+
+inline bool is_polar(const Atom* a)
+{
+    auto e = a->element().number();
+    if (e == 7 || e == 8)
+        return true;
+    if (e == 1)
+        for (auto n: a->neighbors())
+        {
+            auto ne = n->element().number();
+            if (ne == 7 || ne == 8)
+                return true;
+        }
+    return false;
+}
+
+// Snapshot of the atoms surrounding the rotamers being searched, binned into
+// cubic cells for neighbour lookup. Everything the worker threads need is
+// copied out of the structure up front.
+class Search_Environment
+{
+public:
+    std::vector<double> coords;
+    std::vector<float> radii;
+    std::vector<uint8_t> polar;
+    std::vector<Residue*> residues;
+    std::unordered_map<Atom*, uint32_t> index;
+
+    Search_Environment(const Structure::Atoms& atoms, double cell)
+        : _grid(cell)
+    {
+        size_t n = atoms.size();
+        coords.resize(3*n);
+        radii.resize(n);
+        polar.resize(n);
+        residues.resize(n);
+        index.reserve(n);
+        _max_radius = 0;
+        for (size_t i=0; i<n; ++i)
+        {
+            auto a = atoms[i];
+            const auto& c = a->coord();
+            for (size_t j=0; j<3; ++j)
+                coords[3*i+j] = c[j];
+            radii[i] = a->radius();
+            _max_radius = std::max(_max_radius, (double)radii[i]);
+            polar[i] = is_polar(a);
+            residues[i] = a->residue();
+            index[a] = i;
+        }
+        for (size_t i=0; i<n; ++i)
+            _grid.insert(i, coords.data()+3*i);
+    }
+
+    double max_radius() const { return _max_radius; }
+
+    //! Call fn(index) for all atoms in cells overlapping a cube of half-width r around xyz
+    template <typename F>
+    void for_each_near(const double *xyz, double r, F fn) const
+    {
+        _grid.for_each_in_box(xyz, r, fn);
+    }
+
+private:
+    Cell_Grid _grid;
+    double _max_radius;
+};
+
+// Per-rotamer data gathered serially before the threaded scoring
+struct Search_Case
+{
+    const Rota_Def* def;
+    Residue* residue;
+    std::vector<double> coords; // all atoms in the residue
+    std::vector<std::array<size_t, 4>> chi_atoms;
+    std::vector<std::vector<size_t>> moving; // per chi, indices into coords
+    std::vector<float> radii;
+    std::vector<uint8_t> polar;
+    std::vector<double> weights; // atomic numbers
+    std::vector<uint32_t> excluded; // sorted environment indices bonded to the sidechain
+};
+
+void prepare_case(Rotamer* rot, const Search_Environment& env, Search_Case& c)
+{
+    c.def = rot->def();
+    c.residue = rot->residue();
+    const auto& atoms = c.residue->atoms();
+    size_t na = atoms.size();
+    c.coords.resize(3*na);
+    c.radii.resize(na);
+    c.polar.resize(na);
+    c.weights.resize(na);
+    for (size_t i=0; i<na; ++i)
+    {
+        auto it = env.index.find(atoms[i]);
+        size_t e = it->second;
+        for (size_t j=0; j<3; ++j)
+            c.coords[3*i+j] = env.coords[3*e+j];
+        c.radii[i] = env.radii[e];
+        c.polar[i] = env.polar[e];
+        c.weights[i] = atoms[i]->element().number();
+    }
+    auto local = [&atoms](const Atom* a) -> size_t {
+        auto it = std::find(atoms.begin(), atoms.end(), a);
+        if (it == atoms.end())
+            throw std::logic_error("Chi dihedral atom is not in its residue!");
+        return it - atoms.begin();
+    };
+    size_t n_chi = c.def->n_chi();
+    c.chi_atoms.resize(n_chi);
+    c.moving.resize(n_chi);
+    for (size_t i=0; i<n_chi; ++i)
+    {
+        const auto& datoms = rot->dihedrals()[i]->atoms();
+        for (size_t j=0; j<4; ++j)
+            c.chi_atoms[i][j] = local(datoms[j]);
+        const auto& names = c.def->moving_atom_names(i);
+        for (size_t j=0; j<na; ++j)
+            for (const auto& name: names)
+                if (atoms[j]->name() == name)
+                {
+                    c.moving[i].push_back(j);
+                    break;
+                }
+    }
+    // 1-2 and 1-3 partners of the sidechain outside the residue (disulfides,
+    // glycosylation etc.) are not clashes
+    for (auto j: c.moving[0])
+        for (auto n1: atoms[j]->neighbors())
+        {
+            if (n1->residue() != c.residue)
+                c.excluded.push_back(env.index.at(n1));
+            for (auto n2: n1->neighbors())
+                if (n2->residue() != c.residue)
+                    c.excluded.push_back(env.index.at(n2));
+        }
+    std::sort(c.excluded.begin(), c.excluded.end());
+}
+
+// Rotate the moving atoms for each chi in turn to the target angles
+void build_target(const Search_Case& c, const Rota_Target& t, double *xyz)
+{
+    for (size_t i=0; i<c.chi_atoms.size(); ++i)
+    {
+        const auto& ca = c.chi_atoms[i];
+        double *p0 = xyz+3*ca[0], *p1 = xyz+3*ca[1], *p2 = xyz+3*ca[2], *p3 = xyz+3*ca[3];
+        double delta = t.angles[i] - geometry::dihedral_angle<double>(p0, p1, p2, p3);
+        double axis[3], center[3], rot[12];
+        for (size_t j=0; j<3; ++j)
+        {
+            axis[j] = p2[j] - p1[j];
+            center[j] = p1[j];
+        }
+        geometry::normalize_vector_3d(axis);
+        geometry::rotation<double>(axis, delta, rot);
+        for (auto m: c.moving[i])
+        {
+            double *p = xyz+3*m;
+            double d[3] = {p[0]-center[0], p[1]-center[1], p[2]-center[2]};
+            for (size_t j=0; j<3; ++j)
+                p[j] = rot[4*j]*d[0] + rot[4*j+1]*d[1] + rot[4*j+2]*d[2] + center[j];
+        }
+    }
+}
+
+double score_target(const Search_Case& c, const double *xyz,
+    const Search_Environment& env, const Rota_Search_Params& params,
+    const Rota_Search_Map* map)
+{
+    double clash = 0, density = 0, weight = 0;
+    const double reach_pad = env.max_radius() - params.clash_threshold;
+    for (auto m: c.moving[0])
+    {
+        const double *p = xyz+3*m;
+        const double ra = c.radii[m];
+        env.for_each_near(p, ra + reach_pad, [&](uint32_t e) {
+            if (env.residues[e] == c.residue)
+                return;
+            if (std::binary_search(c.excluded.begin(), c.excluded.end(), e))
+                return;
+            const double *q = env.coords.data()+3*e;
+            double d2 = 0;
+            for (size_t j=0; j<3; ++j)
+            {
+                double dd = p[j]-q[j];
+                d2 += dd*dd;
+            }
+            double overlap = ra + env.radii[e] - sqrt(d2);
+            if (c.polar[m] && env.polar[e])
+                overlap -= params.hbond_allowance;
+            if (overlap >= params.clash_threshold)
+                clash += overlap;
+        });
+        if (map != nullptr)
+        {
+            density += map->value(p) * c.weights[m];
+            weight += c.weights[m];
+        }
+    }
+    double score = params.clash_weight * clash;
+    if (map != nullptr && weight > 0)
+        score -= params.map_weight * density / weight / map->sigma;
+    return score;
+}
+
+} // anonymous namespace
+
+void RotaMgr::search(Rotamer** rotamers, size_t n, const Rota_Search_Params& params,
+    const Rota_Search_Map* map, size_t max_results, int32_t* target_indices,
+    double* scores)
+{
+    std::fill(target_indices, target_indices+n*max_results, -1);
+    std::fill(scores, scores+n*max_results, std::numeric_limits<double>::quiet_NaN());
+    if (n == 0 || max_results == 0)
+        return;
+    auto s = rotamers[0]->structure();
+    for (size_t i=1; i<n; ++i)
+        if (rotamers[i]->structure() != s)
+            throw std::invalid_argument("All rotamers must come from the same structure!");
+
+    // Environment and per-rotamer snapshots are built serially: Atom::radius()
+    // and friends may fill lazily-computed structure data on first use.
+    Search_Environment env(s->atoms(), 4.0);
+    std::vector<Search_Case> cases(n);
+    for (size_t i=0; i<n; ++i)
+        prepare_case(rotamers[i], env, cases[i]);
+
+    Thread_Pool::instance().parallel_chunks(n, MIN_SEARCH_CHUNK, [&](size_t start, size_t end) {
+        std::vector<double> xyz;
+        std::vector<double> tscores;
+        std::vector<size_t> order;
+        for (size_t i=start; i<end; ++i)
+        {
+            const auto& c = cases[i];
+            const auto& targets = c.def->targets();
+            size_t nt = targets.size();
+            tscores.resize(nt);
+            for (size_t t=0; t<nt; ++t)
+            {
+                xyz = c.coords;
+                build_target(c, targets[t], xyz.data());
+                tscores[t] = score_target(c, xyz.data(), env, params, map);
+            }
+            // Targets are stored in descending order of frequency, so a stable
+            // sort breaks ties in favour of the more common rotamer.
+            order.resize(nt);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(),
+                [&tscores](size_t a, size_t b) { return tscores[a] < tscores[b]; });
+            size_t nout = std::min(nt, max_results);
+            for (size_t k=0; k<nout; ++k)
+            {
+                target_indices[i*max_results+k] = order[k];
+                scores[i*max_results+k] = tscores[order[k]];
+            }
+        }
+    });
+}
+
+} // namespace isolde
@@ -0,0 +1,58 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_ROTA_SEARCH
+#define ISOLDE_ROTA_SEARCH
+
+#include <cstddef>
+#include <cstdint>
+
+namespace isolde
+{
+
+//! Density map sampled when ranking rotamer targets
+/*! The map is held by the caller. data is a packed, C-ordered (k,j,i) float
+ *  array of size dims[2]*dims[1]*dims[0], and tf is the 3x4 transform taking
+ *  coordinates in the frame of the structure being searched to (i,j,k) grid
+ *  indices.
+ */
+struct Rota_Search_Map
+{
+    const float *data;
+    size_t dims[3];
+    double tf[12];
+    double sigma;
+    //! Trilinearly interpolated value at xyz. Points off the grid give zero.
+    double value(const double *xyz) const;
+};
+
+//! Weights and clash criteria for RotaMgr::search()
+/*! The clash criteria follow ChimeraX's "clashes" defaults: a pair of atoms
+ *  clashes when the sum of their radii exceeds their separation by at least
+ *  clash_threshold, after subtracting hbond_allowance for polar pairs. The
+ *  score for each target is clash_weight times the summed overlaps, minus
+ *  map_weight times the atomic-number-weighted mean density (in units of
+ *  sigma) at the sidechain atoms. Lower is better.
+ */
+struct Rota_Search_Params
+{
+    double clash_weight;
+    double map_weight;
+    double clash_threshold;
+    double hbond_allowance;
+    Rota_Search_Params()
+        : clash_weight(0.5), map_weight(1.0), clash_threshold(0.6), hbond_allowance(0.4) {}
+};
+
+} // namespace isolde
+
+#endif // ISOLDE_ROTA_SEARCH
@@ -0,0 +1,368 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#define PYINSTANCE_EXPORT
+
+#include "snapshot_validator.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include "../geometry/geometry.h"
+#include <pyinstance/PythonInstance.instantiate.h>
+
+template class pyinstance::PythonInstance<isolde::Snapshot_Validator>;
+
+namespace isolde
+{
+
+Snapshot_Validator::Snapshot_Validator(RamaMgr *rama_mgr, RotaMgr *rota_mgr, Atom** atoms, size_t n)
+    : _rama_mgr(rama_mgr), _rota_mgr(rota_mgr), _n_atoms(n)
+{
+    if (n > std::numeric_limits<uint32_t>::max()/2)
+        throw std::logic_error("Too many atoms for a validation snapshot!");
+    _atom_index.reserve(n);
+    for (size_t i=0; i<n; ++i)
+        if (!_atom_index.emplace(atoms[i], i).second)
+            throw std::invalid_argument("Each atom may only appear once in a snapshot!");
+    _worker = std::thread(&Snapshot_Validator::_worker_loop, this);
+}
+
+Snapshot_Validator::~Snapshot_Validator()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cv.notify_all();
+    if (_worker.joinable())
+        _worker.join();
+    auto du = DestructionUser(this);
+}
+
+void Snapshot_Validator::set_ramas(Rama** ramas, size_t n)
+{
+    _ramas.assign(ramas, ramas+n);
+    _rebuild_targets();
+}
+
+void Snapshot_Validator::set_rotamers(Rotamer** rotamers, size_t n)
+{
+    _rotamers.assign(rotamers, rotamers+n);
+    _rebuild_targets();
+}
+
+void Snapshot_Validator::set_chirals(ChiralCenter** chirals, size_t n)
+{
+    _chirals.assign(chirals, chirals+n);
+    _rebuild_targets();
+}
+
+uint32_t Snapshot_Validator::_index(Atom *a, Targets& t, std::unordered_map<Atom*, uint32_t>& fixed) const
+{
+    auto it = _atom_index.find(a);
+    if (it != _atom_index.end())
+        return it->second;
+    auto fit = fixed.find(a);
+    if (fit != fixed.end())
+        return fit->second;
+    uint32_t idx = _n_atoms + fixed.size();
+    fixed[a] = idx;
+    const auto& c = a->coord();
+    for (size_t j=0; j<3; ++j)
+        t.fixed_coords.push_back(c[j]);
+    return idx;
+}
+
+void Snapshot_Validator::_rebuild_targets(bool new_version)
+{
+    auto t = std::make_shared<Targets>();
+    t->version = new_version ? _next_version++ : _targets->version;
+    t->rama_config = _rama_mgr->config_version();
+    t->rota_config = _rota_mgr->config_version();
+    std::unordered_map<Atom*, uint32_t> fixed;
+
+    if (!_ramas.empty())
+    {
+        for (size_t c=1; c<RamaMgr::NUM_RAMA_CASES; ++c)
+        {
+            try {
+                t->rama_grids[c] = *_rama_mgr->get_interpolator(c);
+                t->rama_has_grid[c] = true;
+            } catch (std::out_of_range&) {
+                // Caught on the worker if a residue actually needs it
+            }
+        }
+        t->rama_luts = _rama_mgr->color_luts();
+        colors::copy_color(_rama_mgr->null_intcolor(), t->rama_null_color);
+    }
+    Atom *bb[6];
+    for (auto r: _ramas)
+    {
+        uint8_t c = _rama_mgr->packed_backbone(r, bb);
+        t->rama_static_cases.push_back(c);
+        for (size_t j=0; j<6; ++j)
+            t->rama_atoms.push_back(c == RamaMgr::CASE_NONE ? 0 : _index(bb[j], *t, fixed));
+    }
+
+    // Residue types sharing a grid (e.g. via _link_interpolators()) share a copy
+    std::unordered_map<const RotaMgr::Grid_Interpolator*, uint32_t> grid_index;
+    std::vector<std::pair<uint32_t, uint32_t>> by_type;
+    for (uint32_t i=0; i<_rotamers.size(); ++i)
+    {
+        auto r = _rotamers[i];
+        t->rota_offsets.push_back(t->rota_atoms.size());
+        for (auto d: r->dihedrals())
+            for (auto a: d->atoms())
+                t->rota_atoms.push_back(_index(a, *t, fixed));
+        const RotaMgr::Grid_Interpolator* interp = _rota_mgr->get_interpolator(r->residue()->name());
+        auto git = grid_index.find(interp);
+        if (git == grid_index.end())
+        {
+            git = grid_index.emplace(interp, t->rota_grids.size()).first;
+            t->rota_grids.push_back(*interp);
+        }
+        t->rota_grid.push_back(git->second);
+        t->rota_val_nchi.push_back(r->def()->val_nchi());
+        t->rota_symmetric.push_back(r->is_symmetric());
+        by_type.emplace_back(git->second, i);
+    }
+    t->rota_offsets.push_back(t->rota_atoms.size());
+    if (!_rotamers.empty())
+        t->rota_lut = _rota_mgr->color_lut();
+    std::stable_sort(by_type.begin(), by_type.end(),
+        [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b)
+        { return a.first < b.first; });
+    for (const auto& bt: by_type)
+        t->rota_order.push_back(bt.second);
+
+    for (auto c: _chirals)
+    {
+        for (auto a: c->atoms())
+            t->chiral_atoms.push_back(_index(a, *t, fixed));
+        t->chiral_expected.push_back(c->expected_angle());
+    }
+    _targets = t;
+}
+
+void Snapshot_Validator::submit(const double *coords, uint64_t generation)
+{
+    if (_rama_mgr->config_version() != _targets->rama_config
+        || _rota_mgr->config_version() != _targets->rota_config)
+        _rebuild_targets(false);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending_coords.assign(coords, coords+_n_atoms*3);
+        _pending_generation = generation;
+        _pending_targets = _targets;
+        _pending = true;
+    }
+    _cv.notify_one();
+}
+
+bool Snapshot_Validator::busy() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _pending || _working;
+}
+
+bool Snapshot_Validator::fetch()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_error)
+    {
+        auto e = _error;
+        _error = nullptr;
+        std::rethrow_exception(e);
+    }
+    if (!_have_ready)
+        return false;
+    std::swap(_fetched, _ready);
+    _have_ready = false;
+    return true;
+}
+
+void Snapshot_Validator::_worker_loop()
+{
+    std::vector<double> coords;
+    Results results;
+    while (true)
+    {
+        std::shared_ptr<const Targets> targets;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _working = false;
+            _cv.wait(lock, [this]{ return _stop || _pending; });
+            if (_stop)
+                return;
+            std::swap(coords, _pending_coords);
+            results.generation = _pending_generation;
+            targets = std::move(_pending_targets);
+            _pending = false;
+            _working = true;
+        }
+        try {
+            _validate(*targets, coords.data(), _n_atoms, results);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _error = std::current_exception();
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::swap(_ready, results);
+        _have_ready = true;
+    }
+}
+
+void Snapshot_Validator::_validate(const Targets& t, const double *coords, size_t n_atoms, Results& r)
+{
+    auto xyz = [&](uint32_t i) -> const double* {
+        return i < n_atoms ? coords+3*i : t.fixed_coords.data()+3*(i-n_atoms);
+    };
+    auto dihedral = [&](const uint32_t *a) {
+        return geometry::dihedral_angle<const double*, double>(xyz(a[0]), xyz(a[1]), xyz(a[2]), xyz(a[3]));
+    };
+    r.targets_version = t.version;
+
+    // Ramachandran: determine cases, then score each case as one array
+    size_t n_rama = t.rama_static_cases.size();
+    r.rama_scores.assign(n_rama, NO_RAMA_SCORE);
+    r.rama_cases.resize(n_rama);
+    r.rama_colors.resize(n_rama*4);
+    std::vector<double> phipsi[RamaMgr::NUM_RAMA_CASES];
+    std::vector<size_t> members[RamaMgr::NUM_RAMA_CASES];
+    for (size_t i=0; i<n_rama; ++i)
+    {
+        uint8_t c = t.rama_static_cases[i];
+        const uint32_t *a = t.rama_atoms.data() + 6*i;
+        if (c == RamaMgr::TRANSPRO && std::abs(dihedral(a)) <= CIS_CUTOFF)
+            c = RamaMgr::CISPRO;
+        r.rama_cases[i] = c;
+        if (c == RamaMgr::CASE_NONE)
+            continue;
+        if (!t.rama_has_grid[c])
+            throw std::out_of_range("No Ramachandran grid is defined for this case!");
+        phipsi[c].push_back(dihedral(a+1));
+        phipsi[c].push_back(dihedral(a+2));
+        members[c].push_back(i);
+    }
+    std::vector<double> scores;
+    for (size_t c=1; c<RamaMgr::NUM_RAMA_CASES; ++c)
+    {
+        size_t n = members[c].size();
+        if (n == 0)
+            continue;
+        scores.resize(n);
+        t.rama_grids[c].interpolate(phipsi[c].data(), n, scores.data());
+        for (size_t i=0; i<n; ++i)
+            r.rama_scores[members[c][i]] = scores[i];
+    }
+    if (n_rama)
+    {
+        // As RamaMgr::color_by_scores()
+        if (t.rama_luts.empty())
+            throw std::logic_error("Ramachandran colours have not been set!");
+        uint8_t *out = r.rama_colors.data();
+        for (size_t i=0; i<n_rama; ++i, out+=4)
+        {
+            double s = r.rama_scores[i];
+            uint8_t c = r.rama_cases[i];
+            if (s < 0 || c == RamaMgr::CASE_NONE)
+                colors::copy_color(t.rama_null_color, *reinterpret_cast<colors::intcolor*>(out));
+            else
+                t.rama_luts[c].lookup(log(s), out);
+        }
+    }
+
+    // Rotamers: each residue type is a contiguous run of rota_order
+    size_t n_rota = t.rota_grid.size();
+    r.rota_scores.resize(n_rota);
+    r.rota_colors.resize(n_rota*4);
+    std::vector<double> angles, chis;
+    for (size_t start=0; start<n_rota; )
+    {
+        uint32_t grid = t.rota_grid[t.rota_order[start]];
+        size_t end = start;
+        while (end < n_rota && t.rota_grid[t.rota_order[end]] == grid)
+            ++end;
+        size_t val_nchi = t.rota_val_nchi[t.rota_order[start]];
+        angles.resize((end-start)*val_nchi);
+        scores.resize(end-start);
+        for (size_t k=start; k<end; ++k)
+        {
+            size_t idx = t.rota_order[k];
+            size_t offset = t.rota_offsets[idx];
+            size_t n_chi = (t.rota_offsets[idx+1]-offset)/4;
+            chis.resize(n_chi);
+            for (size_t j=0; j<n_chi; ++j)
+                chis[j] = dihedral(t.rota_atoms.data()+offset+4*j);
+            // As Rotamer::angles()
+            if (t.rota_symmetric[idx] && chis[n_chi-1] < 0)
+                chis[n_chi-1] += M_PI;
+            std::copy(chis.begin(), chis.begin()+val_nchi, angles.begin()+(k-start)*val_nchi);
+        }
+        t.rota_grids[grid].interpolate(angles.data(), end-start, scores.data());
+        for (size_t k=start; k<end; ++k)
+            r.rota_scores[t.rota_order[k]] = scores[k-start];
+        start = end;
+    }
+    if (n_rota)
+    {
+        std::vector<double> log_scores(n_rota);
+        for (size_t i=0; i<n_rota; ++i)
+            log_scores[i] = log(r.rota_scores[i]);
+        // As RotaMgr::color_by_log_score()
+        if (t.rota_lut.empty())
+            throw std::logic_error("Rotamer colours have not been set!");
+        t.rota_lut.apply(log_scores.data(), n_rota, r.rota_colors.data());
+    }
+
+    // Chirality
+    size_t n_chiral = t.chiral_expected.size();
+    r.chiral_deviations.resize(n_chiral);
+    for (size_t i=0; i<n_chiral; ++i)
+        r.chiral_deviations[i] = util::wrapped_angle(
+            dihedral(t.chiral_atoms.data()+4*i) - t.chiral_expected[i]);
+}
+
+template <class T>
+static bool any_destroyed(const std::vector<T*>& objects, const std::set<void*>& destroyed)
+{
+    for (auto o: objects)
+        if (destroyed.find(static_cast<void*>(o)) != destroyed.end())
+            return true;
+    return false;
+}
+
+void Snapshot_Validator::destructors_done(const std::set<void*>& destroyed)
+{
+    bool changed = false;
+    for (auto ptr: destroyed)
+    {
+        auto it = _atom_index.find(static_cast<Atom*>(ptr));
+        if (it == _atom_index.end())
+            continue;
+        // The snapshot layout no longer matches the model
+        _atom_index.erase(it);
+        _ramas.clear();
+        _rotamers.clear();
+        _chirals.clear();
+        changed = true;
+    }
+    if (any_destroyed(_ramas, destroyed)) { _ramas.clear(); changed = true; }
+    if (any_destroyed(_rotamers, destroyed)) { _rotamers.clear(); changed = true; }
+    if (any_destroyed(_chirals, destroyed)) { _chirals.clear(); changed = true; }
+    if (changed)
+        _rebuild_targets();
+}
+
+} // namespace isolde
@@ -0,0 +1,170 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright:2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef ISOLDE_SNAPSHOT_VALIDATOR
+#define ISOLDE_SNAPSHOT_VALIDATOR
+
+#include <vector>
+#include <unordered_map>
+#include <set>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <cstdint>
+
+#include <atomstruct/destruct.h>
+#include <atomstruct/Atom.h>
+#include <pyinstance/PythonInstance.declare.h>
+
+#include "rama.h"
+#include "rota.h"
+#include "../atomic_cpp/chiral.h"
+
+using namespace atomstruct;
+
+namespace isolde
+{
+
+//! Ramachandran, rotamer and chirality validation of coordinate snapshots on a background thread
+/*! The atoms given to the constructor define the layout of the snapshots
+ *  (typically all atoms in a simulation, in simulation order). Setting the
+ *  Ramas, Rotamers and ChiralCenters to validate resolves each of them once
+ *  (on the calling thread) to indices into the snapshot, so that the
+ *  background thread works purely on the coordinates and its own copies of
+ *  the MolProbity grids and colour tables, without ever touching the model
+ *  or the managers. Any atoms outside the snapshot are taken at their
+ *  positions at the time the targets are set.
+ *
+ *  submit() copies a snapshot and returns immediately. If the worker is
+ *  still busy with an earlier one only the newest pending snapshot is kept.
+ *  If the colours or grids in either manager have changed since the targets
+ *  were resolved, submit() takes fresh copies first. fetch() picks up the
+ *  latest finished results, if any. Apart from the worker itself,
+ *  everything here is for the GUI thread only.
+ */
+class Snapshot_Validator: public DestructionObserver, public pyinstance::PythonInstance<Snapshot_Validator>
+{
+public:
+    //! Validation of one snapshot against one version of the targets
+    struct Results
+    {
+        uint64_t generation = 0; // of the snapshot
+        uint64_t targets_version = 0;
+        std::vector<double> rama_scores;
+        std::vector<uint8_t> rama_cases;
+        std::vector<uint8_t> rama_colors; // RGBA8
+        std::vector<double> rota_scores;
+        std::vector<uint8_t> rota_colors; // RGBA8
+        std::vector<double> chiral_deviations; // radians
+    };
+
+    Snapshot_Validator() {} // null constructor
+    Snapshot_Validator(RamaMgr *rama_mgr, RotaMgr *rota_mgr, Atom** atoms, size_t n);
+    ~Snapshot_Validator();
+
+    //! Number of atoms in each snapshot
+    size_t num_atoms() const { return _n_atoms; }
+
+    void set_ramas(Rama** ramas, size_t n);
+    void set_rotamers(Rotamer** rotamers, size_t n);
+    void set_chirals(ChiralCenter** chirals, size_t n);
+    size_t num_ramas() const { return _ramas.size(); }
+    size_t num_rotamers() const { return _rotamers.size(); }
+    size_t num_chirals() const { return _chirals.size(); }
+    /*! Changes whenever the targets are set, or any of them is deleted
+     *  (in which case all targets of that kind are dropped).
+     */
+    uint64_t targets_version() const { return _targets->version; }
+
+    //! Queue a copy of coords (num_atoms()*3, Angstroms) for validation
+    void submit(const double *coords, uint64_t generation);
+    //! True if the worker has results or a snapshot in hand
+    bool busy() const;
+    /*! If the worker has finished any results since the last call, makes the
+     *  newest available from results() and returns true. Rethrows any
+     *  exception raised on the worker.
+     */
+    bool fetch();
+    const Results& results() const { return _fetched; }
+
+    virtual void destructors_done(const std::set<void*>& destroyed);
+
+private:
+    //! Everything the worker needs, as indices into the coordinates
+    struct Targets
+    {
+        uint64_t version = 0;
+        // RamaMgr::config_version() and RotaMgr::config_version() when copied
+        uint64_t rama_config = 0;
+        uint64_t rota_config = 0;
+        std::vector<double> fixed_coords; // atoms outside the snapshot
+        // Ramachandran: 6 atoms (as RamaMgr::packed_backbone()) per residue
+        std::vector<uint32_t> rama_atoms;
+        std::vector<uint8_t> rama_static_cases;
+        // Copies share the grid values, but not the manager's storage
+        RamaMgr::Grid_Interpolator rama_grids[RamaMgr::NUM_RAMA_CASES];
+        bool rama_has_grid[RamaMgr::NUM_RAMA_CASES] = {};
+        std::vector<colors::colormap_lut> rama_luts; // as RamaMgr::color_luts()
+        colors::intcolor rama_null_color = {0, 0, 0, 0};
+        // Rotamers, sorted so that each residue type forms a contiguous run
+        std::vector<uint32_t> rota_order;
+        std::vector<uint32_t> rota_atoms; // 4 per chi dihedral
+        std::vector<size_t> rota_offsets; // start of each rotamer in rota_atoms, then the end
+        std::vector<RotaMgr::Grid_Interpolator> rota_grids; // one per distinct grid
+        std::vector<uint32_t> rota_grid; // index into rota_grids for each rotamer
+        colors::colormap_lut rota_lut;
+        std::vector<uint8_t> rota_val_nchi;
+        std::vector<uint8_t> rota_symmetric;
+        // Chiral centres: 4 atoms each
+        std::vector<uint32_t> chiral_atoms;
+        std::vector<double> chiral_expected;
+    };
+
+    RamaMgr* _rama_mgr = nullptr;
+    RotaMgr* _rota_mgr = nullptr;
+    size_t _n_atoms = 0;
+    std::unordered_map<Atom*, uint32_t> _atom_index;
+    std::vector<Rama*> _ramas;
+    std::vector<Rotamer*> _rotamers;
+    std::vector<ChiralCenter*> _chirals;
+    std::shared_ptr<const Targets> _targets = std::make_shared<Targets>();
+    uint64_t _next_version = 1;
+    Results _fetched;
+
+    // Shared with the worker
+    std::thread _worker;
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _stop = false;
+    bool _working = false;
+    bool _pending = false;
+    std::vector<double> _pending_coords;
+    uint64_t _pending_generation = 0;
+    std::shared_ptr<const Targets> _pending_targets;
+    bool _have_ready = false;
+    Results _ready;
+    std::exception_ptr _error;
+
+    //! Index of the atom in the snapshot, or else in t.fixed_coords (offset by _n_atoms)
+    uint32_t _index(Atom *a, Targets& t, std::unordered_map<Atom*, uint32_t>& fixed) const;
+    //! Re-resolve all targets, under a new version unless only the managers' settings changed
+    void _rebuild_targets(bool new_version=true);
+
+    void _worker_loop();
+    static void _validate(const Targets& t, const double *coords, size_t n_atoms, Results& r);
+}; // class Snapshot_Validator
+
+} // namespace isolde
+
+#endif // ISOLDE_SNAPSHOT_VALIDATOR
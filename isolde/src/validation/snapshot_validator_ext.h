@@ -0,0 +1,215 @@
+/**
+ * @Author: Tristan Croll <tic20>
+ * @Date:   14-Oct-2026
+ * @Email:  tic20@cam.ac.uk
+ * @Last modified by:   tic20
+ * @Last modified time: 14-Oct-2026
+ * @License: Free for non-commercial use (see license.pdf)
+ * @Copyright: 2016-2019 Tristan Croll
+ */
+
+
+
+#ifndef SNAPSHOT_VALIDATOR_EXT
+#define SNAPSHOT_VALIDATOR_EXT
+
+#include "snapshot_validator.h"
+
+#include "../molc.h"
+using namespace atomstruct;
+using namespace isolde;
+
+/*************************************
+ *
+ * Snapshot_Validator functions
+ *
+ *************************************/
+
+SET_PYTHON_INSTANCE(snapshot_validator, Snapshot_Validator)
+GET_PYTHON_INSTANCES(snapshot_validator, Snapshot_Validator)
+
+extern "C" EXPORT void*
+snapshot_validator_new(void *rama_mgr, void *rota_mgr, void *atoms, size_t n)
+{
+    RamaMgr *rmgr = static_cast<RamaMgr *>(rama_mgr);
+    RotaMgr *rotmgr = static_cast<RotaMgr *>(rota_mgr);
+    Atom **a = static_cast<Atom **>(atoms);
+    try {
+        return new Snapshot_Validator(rmgr, rotmgr, a, n);
+    } catch (...) {
+        molc_error();
+        return nullptr;
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_delete(void *validator)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        delete sv;
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT size_t
+snapshot_validator_num_atoms(void *validator)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        return sv->num_atoms();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_set_ramas(void *validator, void *ramas, size_t n)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    Rama **t = static_cast<Rama **>(ramas);
+    try {
+        sv->set_ramas(t, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_set_rotamers(void *validator, void *rotamers, size_t n)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    Rotamer **t = static_cast<Rotamer **>(rotamers);
+    try {
+        sv->set_rotamers(t, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_set_chirals(void *validator, void *chirals, size_t n)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    ChiralCenter **t = static_cast<ChiralCenter **>(chirals);
+    try {
+        sv->set_chirals(t, n);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT uint64_t
+snapshot_validator_targets_version(void *validator)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        return sv->targets_version();
+    } catch (...) {
+        molc_error();
+        return 0;
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_submit(void *validator, size_t n, double *coords, uint64_t generation)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        if (n != sv->num_atoms())
+            throw std::logic_error("Snapshot size does not match the validator!");
+        sv->submit(coords, generation);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT npy_bool
+snapshot_validator_busy(void *validator)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        return sv->busy();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+extern "C" EXPORT npy_bool
+snapshot_validator_fetch(void *validator)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        return sv->fetch();
+    } catch (...) {
+        molc_error();
+        return false;
+    }
+}
+
+//! Generation and targets version of the fetched results, and the number of each kind of target
+extern "C" EXPORT void
+snapshot_validator_results_info(void *validator, uint64_t *versions, size_t *sizes)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        const auto& r = sv->results();
+        versions[0] = r.generation;
+        versions[1] = r.targets_version;
+        sizes[0] = r.rama_cases.size();
+        sizes[1] = r.rota_scores.size();
+        sizes[2] = r.chiral_deviations.size();
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_rama_results(void *validator, size_t n, double *scores, uint8_t *cases, uint8_t *colors)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        const auto& r = sv->results();
+        if (n != r.rama_cases.size())
+            throw std::logic_error("Output size does not match the results!");
+        std::copy(r.rama_scores.begin(), r.rama_scores.end(), scores);
+        std::copy(r.rama_cases.begin(), r.rama_cases.end(), cases);
+        std::copy(r.rama_colors.begin(), r.rama_colors.end(), colors);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_rota_results(void *validator, size_t n, double *scores, uint8_t *colors)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        const auto& r = sv->results();
+        if (n != r.rota_scores.size())
+            throw std::logic_error("Output size does not match the results!");
+        std::copy(r.rota_scores.begin(), r.rota_scores.end(), scores);
+        std::copy(r.rota_colors.begin(), r.rota_colors.end(), colors);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+extern "C" EXPORT void
+snapshot_validator_chiral_results(void *validator, size_t n, double *deviations)
+{
+    Snapshot_Validator *sv = static_cast<Snapshot_Validator *>(validator);
+    try {
+        const auto& r = sv->results();
+        if (n != r.chiral_deviations.size())
+            throw std::logic_error("Output size does not match the results!");
+        std::copy(r.chiral_deviations.begin(), r.chiral_deviations.end(), deviations);
+    } catch (...) {
+        molc_error();
+    }
+}
+
+#endif // SNAPSHOT_VALIDATOR_EXT
@@ -31,6 +31,16 @@ def get_molprobity_data_dir():
 def get_molprobity_cache_dir():
     return user_data_dir
 
+def grid_file_path(cache_dir, file_prefix):
+    '''
+    Path of the binary grid file caching a MolProbity data set in the form
+    the Ramachandran and rotamer managers memory-map directly (format in
+    interpolation/grid_file.h). Unlike the pickle written by
+    :func:`generate_interpolator_data`, nothing needs to be parsed or copied
+    to use it, and all processes on a machine share one copy in memory.
+    '''
+    return os.path.join(cache_dir, file_prefix+'.isogrid')
+
 def generate_scipy_interpolator(data_dir, cache_dir, file_prefix, wrap_axes = True):
     '''
     (Deprecated - use generate_interpolator() instead)